@@ -17,6 +17,8 @@ namespace WixToolset.Data
                 new IntermediateFieldDefinition(nameof(WixBundleContainerSymbolFields.Hash), IntermediateFieldType.String),
                 new IntermediateFieldDefinition(nameof(WixBundleContainerSymbolFields.AttachedContainerIndex), IntermediateFieldType.Number),
                 new IntermediateFieldDefinition(nameof(WixBundleContainerSymbolFields.WorkingPath), IntermediateFieldType.String),
+                new IntermediateFieldDefinition(nameof(WixBundleContainerSymbolFields.ChunkSize), IntermediateFieldType.Number),
+                new IntermediateFieldDefinition(nameof(WixBundleContainerSymbolFields.ChunkHashes), IntermediateFieldType.String),
             },
             typeof(WixBundleContainerSymbol));
     }
@@ -35,6 +37,8 @@ namespace WixToolset.Data.Symbols
         Hash,
         AttachedContainerIndex,
         WorkingPath,
+        ChunkSize,
+        ChunkHashes,
     }
 
     /// <summary>
@@ -99,5 +103,23 @@ namespace WixToolset.Data.Symbols
             get => (string)this.Fields[(int)WixBundleContainerSymbolFields.WorkingPath];
             set => this.Set((int)WixBundleContainerSymbolFields.WorkingPath, value);
         }
+
+        /// <summary>
+        /// Size in kilobytes of the chunks a detached container is verified in, or null to verify it as a whole.
+        /// </summary>
+        public int? ChunkSize
+        {
+            get => (int?)this.Fields[(int)WixBundleContainerSymbolFields.ChunkSize];
+            set => this.Set((int)WixBundleContainerSymbolFields.ChunkSize, value);
+        }
+
+        /// <summary>
+        /// Space separated hashes of each chunk of the container, in order.
+        /// </summary>
+        public string ChunkHashes
+        {
+            get => (string)this.Fields[(int)WixBundleContainerSymbolFields.ChunkHashes];
+            set => this.Set((int)WixBundleContainerSymbolFields.ChunkHashes, value);
+        }
     }
 }
@@ -32,6 +32,8 @@ namespace WixToolset.Data.Symbols
         DisableRollback = 0x1,
         DisableSystemRestore = 0x2,
         ParallelCache = 0x4,
+        ParallelDetect = 0x8,
+        IncrementalPlan = 0x10,
     }
 
     public class WixChainSymbol : IntermediateSymbol
@@ -99,5 +101,37 @@ namespace WixToolset.Data.Symbols
                 }
             }
         }
+
+        public bool ParallelDetect
+        {
+            get { return this.Attributes.HasFlag(WixChainAttributes.ParallelDetect); }
+            set
+            {
+                if (value)
+                {
+                    this.Attributes |= WixChainAttributes.ParallelDetect;
+                }
+                else
+                {
+                    this.Attributes &= ~WixChainAttributes.ParallelDetect;
+                }
+            }
+        }
+
+        public bool IncrementalPlan
+        {
+            get { return this.Attributes.HasFlag(WixChainAttributes.IncrementalPlan); }
+            set
+            {
+                if (value)
+                {
+                    this.Attributes |= WixChainAttributes.IncrementalPlan;
+                }
+                else
+                {
+                    this.Attributes &= ~WixChainAttributes.IncrementalPlan;
+                }
+            }
+        }
     }
 }
@@ -35,6 +35,7 @@ typedef struct _BURN_CACHE_CONTEXT
     DWORD64 qwTotalCacheSize;
     DWORD64 qwSuccessfulCacheProgress;
     LPCWSTR wzLayoutDirectory;
+    BOOL fParallelCache;
     LPWSTR* rgSearchPaths;
     DWORD cSearchPaths;
     DWORD cSearchPathsMax;
@@ -54,6 +55,17 @@ typedef struct _BURN_CACHE_PROGRESS_CONTEXT
     HRESULT hrError;
 } BURN_CACHE_PROGRESS_CONTEXT;
 
+typedef struct _BURN_CACHE_PENDING_PAYLOAD
+{
+    HANDLE hPipe;
+    BURN_PACKAGE* pPackage;
+    BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem;
+    BOOL fMove;
+    LPWSTR sczLocalAcquisitionSourcePath; // source of this payload while the next one is acquired.
+    BURN_CACHE_RECORDING recording; // replayed by the cache thread so the BA only hears from one thread.
+    HRESULT hr;
+} BURN_CACHE_PENDING_PAYLOAD;
+
 typedef struct _BURN_EXECUTE_CONTEXT
 {
     BURN_CACHE* pCache;
@@ -117,12 +129,46 @@ static HRESULT ApplyLayoutContainer(
     __in BURN_CACHE_CONTEXT* pContext,
     __in BURN_CONTAINER* pContainer
     );
+static HRESULT ApplyCachePackagePayloads(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_PACKAGE* pPackage,
+    __in BOOL fVital
+    );
 static HRESULT ApplyProcessPayload(
     __in BURN_CACHE_CONTEXT* pContext,
     __in_opt BURN_PACKAGE* pPackage,
     __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
     __in BOOL fVital
     );
+static HRESULT ApplyVerifyPayload(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in_opt BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
+    __in BOOL fVital,
+    __out BOOL* pfAcquire
+    );
+static HRESULT ApplyAcquireAndCachePayload(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in_opt BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
+    __in DWORD cTryAgainAttempts
+    );
+static HRESULT QueuePendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_CACHE_PENDING_PAYLOAD* pPending,
+    __in BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem
+    );
+static HRESULT CALLBACK CachePendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT FinishPendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_CACHE_PENDING_PAYLOAD* pPending
+    );
 static HRESULT ApplyCacheVerifyContainerOrPayload(
     __in BURN_CACHE_CONTEXT* pContext,
     __in_opt BURN_CONTAINER* pContainer,
@@ -133,6 +179,11 @@ static HRESULT ExtractContainer(
     __in BURN_CACHE_CONTEXT* pContext,
     __in BURN_CONTAINER* pContainer
     );
+static HRESULT CountStreamsToExtract(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __in BURN_CONTAINER* pContainer,
+    __out DWORD* pcStreams
+    );
 static HRESULT LayoutBundle(
     __in BURN_CACHE_CONTEXT* pContext,
     __in_z LPCWSTR wzExecutableName,
@@ -160,6 +211,7 @@ static HRESULT LayoutOrCacheContainerOrPayload(
     __in_opt BURN_PACKAGE* pPackage,
     __in_opt BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
     __in DWORD cTryAgainAttempts,
+    __in_opt BURN_CACHE_PENDING_PAYLOAD* pPending,
     __out BOOL* pfRetry
     );
 static HRESULT PreparePayloadDestinationPath(
@@ -592,6 +644,7 @@ extern "C" HRESULT ApplyCache(
     cacheContext.pVariables = pVariables;
     cacheContext.qwTotalCacheSize = pPlan->qwCacheSizeTotal;
     cacheContext.wzLayoutDirectory = pPlan->sczLayoutDirectory;
+    cacheContext.fParallelCache = pContext->fParallelCache;
 
     hr = MemAllocArray(reinterpret_cast<LPVOID*>(&cacheContext.rgSearchPaths), sizeof(LPWSTR), BURN_CACHE_MAX_SEARCH_PATHS);
     ExitOnNull(cacheContext.rgSearchPaths, hr, E_OUTOFMEMORY, "Failed to allocate cache search paths array.");
@@ -990,16 +1043,7 @@ static HRESULT ApplyCachePackage(
         }
         else
         {
-            for (DWORD i = 0; i < pPackage->payloads.cItems; ++i)
-            {
-                BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem = pPackage->payloads.rgItems + i;
-
-                hr = ApplyProcessPayload(pContext, pPackage, pPayloadGroupItem, fVital);
-                if (FAILED(hr))
-                {
-                    break;
-                }
-            }
+            hr = ApplyCachePackagePayloads(pContext, pPackage, fVital);
         }
 
         pPackage->hrCacheResult = hr;
@@ -1193,7 +1237,7 @@ static HRESULT ApplyLayoutContainer(
         hr = ApplyAcquireContainerOrPayload(pContext, pContainer, NULL, NULL);
         LogExitOnFailure(hr, MSG_FAILED_ACQUIRE_CONTAINER, "Failed to acquire container: %ls to working path: %ls", pContainer->sczId, pContainer->sczUnverifiedPath);
 
-        hr = LayoutOrCacheContainerOrPayload(pContext, pContainer, NULL, NULL, cTryAgainAttempts, &fRetry);
+        hr = LayoutOrCacheContainerOrPayload(pContext, pContainer, NULL, NULL, cTryAgainAttempts, NULL, &fRetry);
         if (SUCCEEDED(hr))
         {
             break;
@@ -1221,6 +1265,128 @@ LExit:
     return hr;
 }
 
+static HRESULT ApplyCachePackagePayloads(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_PACKAGE* pPackage,
+    __in BOOL fVital
+    )
+{
+    HRESULT hr = S_OK;
+    BOOL* rgfAcquire = NULL;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+    BURN_CACHE_PENDING_PAYLOAD pending = { };
+    BURN_PAYLOAD* pAcquiringPayload = NULL;
+
+    // Pipelining verifies all of a package's payloads before acquiring any of them, which changes the
+    // order the BA sees, so it is only done when the bundle opted into parallel caching. Only per-machine
+    // packages wait on a round trip to the elevated process to complete each payload.
+    if (!pContext->fParallelCache || pContext->wzLayoutDirectory || INVALID_HANDLE_VALUE == pContext->hPipe || 2 > pPackage->payloads.cItems)
+    {
+        for (DWORD i = 0; i < pPackage->payloads.cItems; ++i)
+        {
+            hr = ApplyProcessPayload(pContext, pPackage, pPackage->payloads.rgItems + i, fVital);
+            if (FAILED(hr))
+            {
+                ExitFunction();
+            }
+        }
+
+        ExitFunction();
+    }
+
+    rgfAcquire = static_cast<BOOL*>(MemAlloc(sizeof(BOOL) * pPackage->payloads.cItems, TRUE));
+    ExitOnNull(rgfAcquire, hr, E_OUTOFMEMORY, "Failed to allocate payloads to acquire.");
+
+    // Verify everything up front since verification shares the pipe that payloads are completed on.
+    for (DWORD i = 0; i < pPackage->payloads.cItems; ++i)
+    {
+        BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem = pPackage->payloads.rgItems + i;
+
+        hr = ApplyVerifyPayload(pContext, pPackage, pPayloadGroupItem, fVital, rgfAcquire + i);
+        if (FAILED(hr) || !rgfAcquire[i])
+        {
+            FinalizePayloadAcquisition(pContext, pPayloadGroupItem->pPayload, SUCCEEDED(hr));
+
+            if (FAILED(hr))
+            {
+                ExitFunction();
+            }
+        }
+    }
+
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize thread pool to cache payloads.");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create group to cache payloads.");
+
+    // Each payload is acquired while the elevated process completes the one before it.
+    for (DWORD i = 0; i < pPackage->payloads.cItems; ++i)
+    {
+        BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem = pPackage->payloads.rgItems + i;
+
+        if (!rgfAcquire[i])
+        {
+            continue;
+        }
+
+        // Extracting a container can rewrite the unverified payload that is being completed.
+        if (pPayloadGroupItem->pPayload->pContainer)
+        {
+            hr = FinishPendingPayload(hGroup, pContext, &pending);
+            if (FAILED(hr))
+            {
+                ExitFunction();
+            }
+        }
+
+        pAcquiringPayload = pPayloadGroupItem->pPayload;
+
+        hr = ApplyAcquireContainerOrPayload(pContext, NULL, pPackage, pPayloadGroupItem);
+        LogExitOnFailure(hr, MSG_FAILED_ACQUIRE_PAYLOAD, "Failed to acquire payload: %ls to working path: %ls", pAcquiringPayload->sczKey, pAcquiringPayload->sczUnverifiedPath);
+
+        hr = FinishPendingPayload(hGroup, pContext, &pending);
+        if (FAILED(hr))
+        {
+            ExitFunction();
+        }
+
+        hr = QueuePendingPayload(hGroup, pContext, &pending, pPackage, pPayloadGroupItem);
+        ExitOnFailure(hr, "Failed to queue payload to be cached: %ls", pAcquiringPayload->sczKey);
+
+        pAcquiringPayload = NULL;
+    }
+
+    hr = FinishPendingPayload(hGroup, pContext, &pending);
+
+LExit:
+    if (pAcquiringPayload)
+    {
+        FinalizePayloadAcquisition(pContext, pAcquiringPayload, FALSE);
+    }
+
+    // The worker uses the pending payload on the stack so it must finish first.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    CacheReleaseRecording(&pending.recording);
+    ReleaseStr(pending.sczLocalAcquisitionSourcePath);
+    ReleaseMem(rgfAcquire);
+
+    return hr;
+}
+
 static HRESULT ApplyProcessPayload(
     __in BURN_CACHE_CONTEXT* pContext,
     __in_opt BURN_PACKAGE* pPackage,
@@ -1229,13 +1395,35 @@ static HRESULT ApplyProcessPayload(
     )
 {
     HRESULT hr = S_OK;
-    DWORD cTryAgainAttempts = 0;
-    BOOL fRetry = FALSE;
+    BOOL fAcquire = FALSE;
+
+    hr = ApplyVerifyPayload(pContext, pPackage, pPayloadGroupItem, fVital, &fAcquire);
+    if (SUCCEEDED(hr) && fAcquire)
+    {
+        hr = ApplyAcquireAndCachePayload(pContext, pPackage, pPayloadGroupItem, 0);
+    }
+
+    FinalizePayloadAcquisition(pContext, pPayloadGroupItem->pPayload, SUCCEEDED(hr));
+
+    return hr;
+}
+
+static HRESULT ApplyVerifyPayload(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in_opt BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
+    __in BOOL fVital,
+    __out BOOL* pfAcquire
+    )
+{
+    HRESULT hr = S_OK;
     BOOTSTRAPPER_CACHEPACKAGENONVITALVALIDATIONFAILURE_ACTION action = BOOTSTRAPPER_CACHEPACKAGENONVITALVALIDATIONFAILURE_ACTION_NONE;
     BURN_PAYLOAD* pPayload = pPayloadGroupItem->pPayload;
 
     Assert(pContext->pPayloads && pPackage || pContext->wzLayoutDirectory);
 
+    *pfAcquire = FALSE;
+
     if (pPayload->pContainer && pContext->wzLayoutDirectory)
     {
         ExitFunction();
@@ -1259,6 +1447,24 @@ static HRESULT ApplyProcessPayload(
         pPackage->fAcquireOptionalSource = TRUE;
     }
 
+    *pfAcquire = TRUE;
+    hr = S_OK;
+
+LExit:
+    return hr;
+}
+
+static HRESULT ApplyAcquireAndCachePayload(
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in_opt BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
+    __in DWORD cTryAgainAttempts
+    )
+{
+    HRESULT hr = S_OK;
+    BOOL fRetry = FALSE;
+    BURN_PAYLOAD* pPayload = pPayloadGroupItem->pPayload;
+
     for (;;)
     {
         fRetry = FALSE;
@@ -1266,7 +1472,7 @@ static HRESULT ApplyProcessPayload(
         hr = ApplyAcquireContainerOrPayload(pContext, NULL, pPackage, pPayloadGroupItem);
         LogExitOnFailure(hr, MSG_FAILED_ACQUIRE_PAYLOAD, "Failed to acquire payload: %ls to working path: %ls", pPayload->sczKey, pPayload->sczUnverifiedPath);
 
-        hr = LayoutOrCacheContainerOrPayload(pContext, NULL, pPackage, pPayloadGroupItem, cTryAgainAttempts, &fRetry);
+        hr = LayoutOrCacheContainerOrPayload(pContext, NULL, pPackage, pPayloadGroupItem, cTryAgainAttempts, NULL, &fRetry);
         if (SUCCEEDED(hr))
         {
             break;
@@ -1289,8 +1495,114 @@ static HRESULT ApplyProcessPayload(
     }
 
 LExit:
+    return hr;
+}
+
+static HRESULT QueuePendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_CACHE_PENDING_PAYLOAD* pPending,
+    __in BURN_PACKAGE* pPackage,
+    __in BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem
+    )
+{
+    HRESULT hr = S_OK;
+
+    pPending->hPipe = pContext->hPipe;
+    pPending->pPackage = pPackage;
+    pPending->pPayloadGroupItem = pPayloadGroupItem;
+    pPending->fMove = 1 == pPayloadGroupItem->pPayload->cRemainingInstances;
+    pPending->hr = S_OK;
+
+    CacheReleaseRecording(&pPending->recording);
+
+    // The source the payload was acquired from now belongs to the pending payload.
+    pPending->sczLocalAcquisitionSourcePath = pContext->sczLocalAcquisitionSourcePath;
+    pContext->sczLocalAcquisitionSourcePath = NULL;
+
+    hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, CachePendingPayload, pPending);
+    if (FAILED(hr))
+    {
+        pContext->sczLocalAcquisitionSourcePath = pPending->sczLocalAcquisitionSourcePath;
+        pPending->sczLocalAcquisitionSourcePath = NULL;
+        pPending->pPayloadGroupItem = NULL;
+    }
+
+    return hr;
+}
+
+static HRESULT CALLBACK CachePendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    UNREFERENCED_PARAMETER(hGroup);
+
+    BURN_CACHE_PENDING_PAYLOAD* pPending = static_cast<BURN_CACHE_PENDING_PAYLOAD*>(pvContext);
+    BURN_PAYLOAD* pPayload = pPending->pPayloadGroupItem->pPayload;
+
+    // Only the elevated round trip runs here. Its messages and progress are recorded and the cache
+    // thread sends them to the BA, so the BA callbacks and cache progress stay on that thread.
+    pPending->hr = ElevationCacheCompletePayload(pPending->hPipe, pPending->pPackage, pPayload, pPayload->sczUnverifiedPath, pPending->fMove, CacheRecordMessage, CacheRecordProgress, &pPending->recording);
+
+    // Failures are handled by the cache thread so they must not cancel the group.
+    return S_OK;
+}
+
+static HRESULT FinishPendingPayload(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in BURN_CACHE_CONTEXT* pContext,
+    __in BURN_CACHE_PENDING_PAYLOAD* pPending
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem = pPending->pPayloadGroupItem;
+    BURN_PAYLOAD* pPayload = NULL;
+    LPWSTR sczLocalAcquisitionSourcePath = NULL;
+    BOOL fRetry = FALSE;
+
+    if (!pPayloadGroupItem)
+    {
+        ExitFunction();
+    }
+
+    pPayload = pPayloadGroupItem->pPayload;
+
+    hr = ThrdGroupWait(hGroup, INFINITE);
+    ExitOnFailure(hr, "Failed to wait for payload to be cached: %ls", pPayload->sczKey);
+
+    pPending->pPayloadGroupItem = NULL;
+
+    // Set aside the source of the payload that was acquired in the meantime so this payload records its own.
+    sczLocalAcquisitionSourcePath = pContext->sczLocalAcquisitionSourcePath;
+    pContext->sczLocalAcquisitionSourcePath = pPending->sczLocalAcquisitionSourcePath;
+    pPending->sczLocalAcquisitionSourcePath = NULL;
+
+    hr = LayoutOrCacheContainerOrPayload(pContext, NULL, pPending->pPackage, pPayloadGroupItem, 0, pPending, &fRetry);
+    if (FAILED(hr))
+    {
+        LogErrorId(hr, MSG_FAILED_CACHE_PAYLOAD, pPayload->sczKey, NULL, pPayload->sczUnverifiedPath);
+    }
+
+    if (FAILED(hr) && fRetry)
+    {
+        pContext->qwSuccessfulCacheProgress -= pPayloadGroupItem->qwCommittedCacheProgress;
+        pPayloadGroupItem->qwCommittedCacheProgress = 0;
+        LogErrorId(hr, MSG_CACHE_RETRYING_PAYLOAD, pPayload->sczKey, NULL, NULL);
+
+        FinalizePayloadAcquisition(pContext, pPayload, FALSE);
+
+        hr = ApplyAcquireAndCachePayload(pContext, pPending->pPackage, pPayloadGroupItem, 1);
+    }
+
     FinalizePayloadAcquisition(pContext, pPayload, SUCCEEDED(hr));
 
+    ReleaseStr(pContext->sczLocalAcquisitionSourcePath);
+    pContext->sczLocalAcquisitionSourcePath = sczLocalAcquisitionSourcePath;
+
+LExit:
+    CacheReleaseRecording(&pPending->recording);
+
     return hr;
 }
 
@@ -1321,7 +1633,8 @@ static HRESULT ApplyCacheVerifyContainerOrPayload(
     }
     else
     {
-        hr = CacheVerifyPayload(pPayloadGroupItem->pPayload, pContext->wzLayoutDirectory ? pContext->wzLayoutDirectory : pPackage->sczCacheFolder, CacheMessageHandler, CacheProgressRoutine, &progress);
+        // Layout does not use the content store.
+        hr = CacheVerifyPayload(pContext->wzLayoutDirectory ? NULL : pContext->pCache, pPackage ? pPackage->fPerMachine : FALSE, pPayloadGroupItem->pPayload, pContext->wzLayoutDirectory ? pContext->wzLayoutDirectory : pPackage->sczCacheFolder, CacheMessageHandler, CacheProgressRoutine, &progress);
     }
 
     return hr;
@@ -1338,6 +1651,7 @@ static HRESULT ExtractContainer(
     LPWSTR sczStreamName = NULL;
     BURN_PAYLOAD* pExtract = NULL;
     BURN_CACHE_PROGRESS_CONTEXT progress = { };
+    DWORD cStreams = 0;
 
     progress.pCacheContext = pContext;
     progress.pContainer = pContainer;
@@ -1352,7 +1666,17 @@ static HRESULT ExtractContainer(
     hr = ContainerOpen(&context, pContainer, hContainerHandle, pContainer->sczUnverifiedPath);
     ExitOnFailure(hr, "Failed to open container: %ls.", pContainer->sczId);
 
-    while (S_OK == (hr = ContainerNextStream(&context, &sczStreamName)))
+    hr = CountStreamsToExtract(&context, pContainer, &cStreams);
+    if (FAILED(hr))
+    {
+        LogStringLine(REPORT_STANDARD, "Failed to read index of container: %ls, all streams will be read, error: 0x%x", pContainer->sczId, hr);
+
+        cStreams = DWORD_MAX;
+        hr = S_OK;
+    }
+
+    // Streams after the last one needed are never decompressed.
+    for (DWORD iStream = 0; iStream < cStreams && S_OK == (hr = ContainerNextStream(&context, &sczStreamName)); ++iStream)
     {
         BOOL fExtracted = FALSE;
 
@@ -1413,6 +1737,45 @@ LExit:
     return hr;
 }
 
+// Counts the streams up to and including the last one with a payload that still needs to be extracted.
+static HRESULT CountStreamsToExtract(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __in BURN_CONTAINER* pContainer,
+    __out DWORD* pcStreams
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR* rgsczStreamNames = NULL;
+    DWORD cStreamNames = 0;
+    BURN_PAYLOAD* pPayload = NULL;
+
+    *pcStreams = 0;
+
+    hr = ContainerReadStreamNames(pContext, &rgsczStreamNames, &cStreamNames);
+    ExitOnFailure(hr, "Failed to read stream names from container: %ls", pContainer->sczId);
+
+    for (DWORD i = 0; i < cStreamNames; ++i)
+    {
+        hr = PayloadFindEmbeddedBySourcePath(pContainer->sdhPayloads, rgsczStreamNames[i], &pPayload);
+        if (E_NOTFOUND == hr)
+        {
+            hr = S_OK;
+            continue;
+        }
+        ExitOnFailure(hr, "Failed to find embedded payload by source path: %ls container: %ls", rgsczStreamNames[i], pContainer->sczId);
+
+        if (pPayload->sczUnverifiedPath && pPayload->cRemainingInstances)
+        {
+            *pcStreams = i + 1;
+        }
+    }
+
+LExit:
+    ReleaseStrArray(rgsczStreamNames, cStreamNames);
+
+    return hr;
+}
+
 static HRESULT LayoutBundle(
     __in BURN_CACHE_CONTEXT* pContext,
     __in_z LPCWSTR wzExecutableName,
@@ -1840,6 +2203,7 @@ static HRESULT LayoutOrCacheContainerOrPayload(
     __in_opt BURN_PACKAGE* pPackage,
     __in_opt BURN_PAYLOAD_GROUP_ITEM* pPayloadGroupItem,
     __in DWORD cTryAgainAttempts,
+    __in_opt BURN_CACHE_PENDING_PAYLOAD* pPending,
     __out BOOL* pfRetry
     )
 {
@@ -1901,6 +2265,20 @@ static HRESULT LayoutOrCacheContainerOrPayload(
                     hr = CacheLayoutPayload(pPayload, pContext->wzLayoutDirectory, wzUnverifiedPath, fMove, CacheMessageHandler, CacheProgressRoutine, &progress);
                 }
             }
+            else if (pPending) // the elevated process already completed the payload on a worker thread.
+            {
+                hr = CacheReplayRecording(&pPending->recording, CacheMessageHandler, CacheProgressRoutine, &progress);
+                if (SUCCEEDED(hr))
+                {
+                    hr = pPending->hr;
+                }
+                else if (!progress.fCancel && FAILED(progress.hrError))
+                {
+                    hr = progress.hrError;
+                }
+
+                pPending = NULL; // retrying verification goes back to the elevated process.
+            }
             else if (INVALID_HANDLE_VALUE != pContext->hPipe) // pass the decision off to the elevated process.
             {
                 hr = ElevationCacheCompletePayload(pContext->hPipe, pPackage, pPayload, wzUnverifiedPath, fMove, CacheMessageHandler, CacheProgressRoutine, &progress);
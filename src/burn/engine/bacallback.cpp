@@ -2,6 +2,9 @@
 
 #include "precomp.h"
 
+// While set, messages sent on this thread are recorded instead of sent to the BA.
+__declspec(thread) static BURN_BA_DEFERRED_MESSAGES* vpDeferredMessages = NULL;
+
 // internal function declarations
 
 static HRESULT FilterExecuteResult(
@@ -25,14 +28,89 @@ static HRESULT SendBAMessageFromInactiveEngine(
     __in BUFF_BUFFER* pBufferResults,
     __in PIPE_RPC_RESULT* pResult
     );
+static HRESULT SendTimedBAMessage(
+    __in BURN_USER_EXPERIENCE* pUserExperience,
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in_bcount(cbArgs) LPVOID pvArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult
+    );
 static HRESULT CombineArgsAndResults(
     __in BUFF_BUFFER* pBufferArgs,
     __in BUFF_BUFFER* pBufferResults,
     __in BUFF_BUFFER* pBufferCombined
     );
+static HRESULT DeferBAMessage(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in BUFF_BUFFER* pBufferArgs,
+    __in BUFF_BUFFER* pBufferResults
+    );
+static HRESULT ReadDeferredMessageResult(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in PIPE_RPC_RESULT* pRpc
+    );
 
 // function definitions
 
+// Only messages whose results carry nothing but cancel can be deferred since the
+// callbacks return as if the BA was not loaded while their messages are recorded.
+EXTERN_C void BACallbackDeferMessages(
+    __in_opt BURN_BA_DEFERRED_MESSAGES* pMessages
+    )
+{
+    vpDeferredMessages = pMessages;
+}
+
+// Stops at the first message that fails or is cancelled by the BA and returns its index.
+EXTERN_C HRESULT BACallbackSendDeferredMessages(
+    __in BURN_USER_EXPERIENCE* pUserExperience,
+    __in BURN_BA_DEFERRED_MESSAGES* pMessages,
+    __out DWORD* piFailedMessage
+    )
+{
+    HRESULT hr = S_OK;
+    PIPE_RPC_RESULT rpc = { };
+    DWORD i = 0;
+
+    if (!PipeRpcInitialized(&pUserExperience->hBARpcPipe))
+    {
+        ExitFunction();
+    }
+
+    for (; i < pMessages->cMessages; ++i)
+    {
+        BURN_BA_DEFERRED_MESSAGE* pMessage = pMessages->rgMessages + i;
+
+        hr = SendTimedBAMessage(pUserExperience, pMessage->message, pMessage->buffer.pbData, pMessage->buffer.cbData, &rpc);
+        ExitOnFailure(hr, "BA deferred message %u failed.", pMessage->message);
+
+        hr = ReadDeferredMessageResult(pMessage->message, &rpc);
+        ExitOnFailure(hr, "BA cancelled or failed deferred message %u.", pMessage->message);
+
+        PipeFreeRpcResult(&rpc);
+    }
+
+LExit:
+    PipeFreeRpcResult(&rpc);
+
+    *piFailedMessage = i;
+
+    return hr;
+}
+
+EXTERN_C void BACallbackReleaseDeferredMessages(
+    __in BURN_BA_DEFERRED_MESSAGES* pMessages
+    )
+{
+    for (DWORD i = 0; i < pMessages->cMessages; ++i)
+    {
+        ReleaseBuffer(pMessages->rgMessages[i].buffer);
+    }
+
+    ReleaseMem(pMessages->rgMessages);
+    memset(pMessages, 0, sizeof(BURN_BA_DEFERRED_MESSAGES));
+}
+
 EXTERN_C HRESULT BACallbackOnApplyBegin(
     __in BURN_USER_EXPERIENCE* pUserExperience,
     __in DWORD dwPhaseCount
@@ -5821,13 +5899,22 @@ static HRESULT SendBAMessage(
     HRESULT hr = S_OK;
     BUFF_BUFFER buffer = { };
 
-    if (PipeRpcInitialized(&pUserExperience->hBARpcPipe))
+    if (vpDeferredMessages)
+    {
+        // Recorded messages are sent later so this looks like the BA was not loaded.
+        hr = DeferBAMessage(message, pBufferArgs, pBufferResults);
+        if (SUCCEEDED(hr))
+        {
+            hr = S_FALSE;
+        }
+    }
+    else if (PipeRpcInitialized(&pUserExperience->hBARpcPipe))
     {
         // Send the combined counted args and results buffer to the BA.
         hr = CombineArgsAndResults(pBufferArgs, pBufferResults, &buffer);
         if (SUCCEEDED(hr))
         {
-            hr = PipeRpcRequest(&pUserExperience->hBARpcPipe, message, buffer.pbData, buffer.cbData, pResult);
+            hr = SendTimedBAMessage(pUserExperience, message, buffer.pbData, buffer.cbData, pResult);
         }
     }
     else
@@ -5858,7 +5945,7 @@ static HRESULT SendBAMessageFromInactiveEngine(
         hr = CombineArgsAndResults(pBufferArgs, pBufferResults, &buffer);
         if (SUCCEEDED(hr))
         {
-            hr = PipeRpcRequest(&pUserExperience->hBARpcPipe, message, buffer.pbData, buffer.cbData, pResult);
+            hr = SendTimedBAMessage(pUserExperience, message, buffer.pbData, buffer.cbData, pResult);
         }
 
         BootstrapperApplicationActivateEngine(pUserExperience);
@@ -5872,6 +5959,27 @@ static HRESULT SendBAMessageFromInactiveEngine(
     return hr;
 }
 
+// The pipe times the request itself so time spent waiting on a message from another
+// thread isn't charged to this one.
+static HRESULT SendTimedBAMessage(
+    __in BURN_USER_EXPERIENCE* pUserExperience,
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in_bcount(cbArgs) LPVOID pvArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_TIMER timer = { };
+    LARGE_INTEGER liStop = { };
+
+    hr = PipeRpcTimedRequest(&pUserExperience->hBARpcPipe, message, pvArgs, cbArgs, pResult, &timer.liStart, &liStop);
+
+    TimingStopBAMessage(&timer, &liStop, message);
+
+    return hr;
+}
+
 static HRESULT CombineArgsAndResults(
     __in BUFF_BUFFER* pBufferArgs,
     __in BUFF_BUFFER* pBufferResults,
@@ -5891,3 +5999,71 @@ static HRESULT CombineArgsAndResults(
 LExit:
     return hr;
 }
+
+static HRESULT DeferBAMessage(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in BUFF_BUFFER* pBufferArgs,
+    __in BUFF_BUFFER* pBufferResults
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_BA_DEFERRED_MESSAGE* pMessage = NULL;
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&vpDeferredMessages->rgMessages), vpDeferredMessages->cMessages, 1, sizeof(BURN_BA_DEFERRED_MESSAGE), 5);
+    ExitOnFailure(hr, "Failed to grow deferred BA messages.");
+
+    pMessage = vpDeferredMessages->rgMessages + vpDeferredMessages->cMessages;
+
+    hr = CombineArgsAndResults(pBufferArgs, pBufferResults, &pMessage->buffer);
+    ExitOnFailure(hr, "Failed to record deferred BA message.");
+
+    pMessage->message = message;
+    ++vpDeferredMessages->cMessages;
+
+LExit:
+    if (FAILED(hr) && pMessage)
+    {
+        ReleaseBuffer(pMessage->buffer);
+    }
+
+    return hr;
+}
+
+static HRESULT ReadDeferredMessageResult(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message,
+    __in PIPE_RPC_RESULT* pRpc
+    )
+{
+    HRESULT hr = S_OK;
+    SIZE_T iBuffer = 0;
+    DWORD dwApiVersion = 0;
+    BOOL fCancel = FALSE;
+
+    switch (message)
+    {
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPACKAGEBEGIN: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTRELATEDMSIPACKAGE: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTMSIFEATURE: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPATCHTARGET: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPATIBLEMSIPACKAGE: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTRELATEDBUNDLEPACKAGE:
+        hr = BuffReadNumber(pRpc->pbData, pRpc->cbData, &iBuffer, &dwApiVersion);
+        ExitOnFailure(hr, "Failed to read API version of deferred result.");
+
+        hr = BuffReadNumber(pRpc->pbData, pRpc->cbData, &iBuffer, reinterpret_cast<DWORD*>(&fCancel));
+        ExitOnFailure(hr, "Failed to read cancel of deferred result.");
+
+        if (fCancel)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT);
+        }
+        break;
+
+    default:
+        // The remaining results are ignored, like the callbacks for these messages do.
+        break;
+    }
+
+LExit:
+    return hr;
+}
@@ -8,9 +8,31 @@ extern "C" {
 
 // structs
 
+typedef struct _BURN_BA_DEFERRED_MESSAGE
+{
+    BOOTSTRAPPER_APPLICATION_MESSAGE message;
+    BUFF_BUFFER buffer;
+} BURN_BA_DEFERRED_MESSAGE;
+
+typedef struct _BURN_BA_DEFERRED_MESSAGES
+{
+    BURN_BA_DEFERRED_MESSAGE* rgMessages;
+    DWORD cMessages;
+} BURN_BA_DEFERRED_MESSAGES;
 
 // function declarations
 
+void BACallbackDeferMessages(
+    __in_opt BURN_BA_DEFERRED_MESSAGES* pMessages
+    );
+HRESULT BACallbackSendDeferredMessages(
+    __in BURN_USER_EXPERIENCE* pUserExperience,
+    __in BURN_BA_DEFERRED_MESSAGES* pMessages,
+    __out DWORD* piFailedMessage
+    );
+void BACallbackReleaseDeferredMessages(
+    __in BURN_BA_DEFERRED_MESSAGES* pMessages
+    );
 HRESULT BACallbackOnApplyBegin(
     __in BURN_USER_EXPERIENCE* pUserExperience,
     __in DWORD dwPhaseCount
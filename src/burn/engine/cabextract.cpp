@@ -243,6 +243,41 @@ LExit:
     return hr;
 }
 
+extern "C" HRESULT CabExtractReadStreamNames(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __deref_out_ecount(*pcStreamNames) LPWSTR** prgsczStreamNames,
+    __out DWORD* pcStreamNames
+    )
+{
+    HRESULT hr = S_OK;
+    CAB_INDEX index = { };
+
+    // The file table is mapped rather than read so the extraction thread's file pointer is left alone.
+    hr = CabReadIndexFromHandle(pContext->hFile, pContext->qwOffset, &index);
+    ExitOnFailure(hr, "Failed to read cabinet index.");
+
+    if (!index.cFiles)
+    {
+        ExitFunction();
+    }
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(prgsczStreamNames), sizeof(LPWSTR), index.cFiles);
+    ExitOnFailure(hr, "Failed to allocate stream names.");
+
+    for (DWORD i = 0; i < index.cFiles; ++i)
+    {
+        (*prgsczStreamNames)[i] = index.rgFiles[i].sczName;
+        index.rgFiles[i].sczName = NULL;
+    }
+
+    *pcStreamNames = index.cFiles;
+
+LExit:
+    CabReleaseIndex(&index);
+
+    return hr;
+}
+
 extern "C" HRESULT CabExtractClose(
     __in BURN_CONTAINER_CONTEXT* pContext
     )
@@ -30,6 +30,11 @@ HRESULT CabExtractStreamToBuffer(
 HRESULT CabExtractSkipStream(
     __in BURN_CONTAINER_CONTEXT* pContext
     );
+HRESULT CabExtractReadStreamNames(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __deref_out_ecount(*pcStreamNames) LPWSTR** prgsczStreamNames,
+    __out DWORD* pcStreamNames
+    );
 HRESULT CabExtractClose(
     __in BURN_CONTAINER_CONTEXT* pContext
     );
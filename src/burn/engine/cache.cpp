@@ -4,9 +4,19 @@
 
 static const LPCWSTR BUNDLE_WORKING_FOLDER_NAME = L".be";
 static const LPCWSTR UNVERIFIED_CACHE_FOLDER_NAME = L".unverified";
+static const LPCWSTR CONTENT_STORE_FOLDER_NAME = L".content";
 static const LPCWSTR PACKAGE_CACHE_FOLDER_NAME = L"Package Cache";
 static const DWORD FILE_OPERATION_RETRY_COUNT = 3;
 static const DWORD FILE_OPERATION_RETRY_WAIT = 2000;
+static const DWORD VERIFY_CHUNKS_PROGRESS_INTERVAL = 100;
+
+typedef struct _CACHE_VERIFY_CHUNKS_CONTEXT
+{
+    BURN_CONTAINER* pContainer;
+    LPCWSTR wzVerifyPath;
+    LONG volatile iNextChunk;
+    LONGLONG volatile llHashedBytes;
+} CACHE_VERIFY_CHUNKS_CONTEXT;
 
 static HRESULT CacheVerifyPayloadSignature(
     __in BURN_PAYLOAD* pPayload,
@@ -127,6 +137,41 @@ static HRESULT RemoveBundleOrPackage(
     __in_z LPCWSTR wzBundleOrPackageId,
     __in_z LPCWSTR wzCacheId
     );
+static HRESULT GetContentStorePath(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __deref_out_z_opt LPWSTR* psczStoreFolder,
+    __deref_out_z LPWSTR* psczStorePath
+    );
+static HRESULT LinkFromContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __in_z LPCWSTR wzCachedPath,
+    __in BURN_CACHE_STEP cacheStep,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext
+    );
+static BOOL IsContentStoreEntryVerified(
+    __in BURN_CACHE* pCache,
+    __in_z LPCWSTR wzStorePath
+    );
+static void MarkContentStoreEntryVerified(
+    __in BURN_CACHE* pCache,
+    __in_z LPCWSTR wzStorePath
+    );
+static void AddToContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __in_z LPCWSTR wzCachedPath
+    );
+static void PruneContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine
+    );
 static HRESULT VerifyFileSize(
     __in HANDLE hFile,
     __in DWORD64 qwFileSize,
@@ -144,9 +189,19 @@ static HRESULT VerifyHash(
     __in LPPROGRESS_ROUTINE pfnProgress,
     __in LPVOID pContext
     );
-static HRESULT VerifyPayloadAgainstCertChain(
-    __in BURN_PAYLOAD* pPayload,
-    __in PCCERT_CHAIN_CONTEXT pChainContext
+static HRESULT VerifyContainerChunks(
+    __in BURN_CONTAINER* pContainer,
+    __in_z LPCWSTR wzUnverifiedContainerPath,
+    __in HANDLE hFile,
+    __in BURN_CACHE_STEP cacheStep,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext,
+    __out_opt DWORD64* pqwVerifiedSize
+    );
+static HRESULT CALLBACK HashContainerChunks(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
     );
 static HRESULT SendCacheBeginMessage(
     __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
@@ -230,6 +285,8 @@ extern "C" HRESULT CacheInitialize(
 
     hr = CalculateWorkingFolders(pCache, pInternalCommand);
 
+    ::InitializeCriticalSection(&pCache->csContentStore);
+
     pCache->fInitializedCache = TRUE;
 
 LExit:
@@ -887,6 +944,118 @@ extern "C" void CacheSendErrorCallback(
     }
 }
 
+extern "C" HRESULT CALLBACK CacheRecordMessage(
+    __in BURN_CACHE_MESSAGE* pMessage,
+    __in LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_CACHE_RECORDING* pRecording = static_cast<BURN_CACHE_RECORDING*>(pvContext);
+    BURN_CACHE_RECORDED_EVENT* pEvent = NULL;
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pRecording->rgEvents), pRecording->cEvents, 1, sizeof(BURN_CACHE_RECORDED_EVENT), 5);
+    ExitOnFailure(hr, "Failed to grow recorded cache events.");
+
+    pEvent = pRecording->rgEvents + pRecording->cEvents;
+    ++pRecording->cEvents;
+
+    pEvent->fProgress = FALSE;
+    pEvent->message = *pMessage;
+
+LExit:
+    return hr;
+}
+
+extern "C" DWORD CALLBACK CacheRecordProgress(
+    __in LARGE_INTEGER TotalFileSize,
+    __in LARGE_INTEGER TotalBytesTransferred,
+    __in LARGE_INTEGER /*StreamSize*/,
+    __in LARGE_INTEGER /*StreamBytesTransferred*/,
+    __in DWORD /*dwStreamNumber*/,
+    __in DWORD /*dwCallbackReason*/,
+    __in HANDLE /*hSourceFile*/,
+    __in HANDLE /*hDestinationFile*/,
+    __in_opt LPVOID lpData
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_CACHE_RECORDING* pRecording = static_cast<BURN_CACHE_RECORDING*>(lpData);
+    BURN_CACHE_RECORDED_EVENT* pEvent = pRecording->cEvents ? pRecording->rgEvents + pRecording->cEvents - 1 : NULL;
+
+    // The recording is replayed all at once so only the latest of consecutive progress matters.
+    if (!pEvent || !pEvent->fProgress)
+    {
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pRecording->rgEvents), pRecording->cEvents, 1, sizeof(BURN_CACHE_RECORDED_EVENT), 5);
+        ExitOnFailure(hr, "Failed to grow recorded cache events.");
+
+        pEvent = pRecording->rgEvents + pRecording->cEvents;
+        ++pRecording->cEvents;
+
+        pEvent->fProgress = TRUE;
+    }
+
+    pEvent->liTotalFileSize = TotalFileSize;
+    pEvent->liTotalBytesTransferred = TotalBytesTransferred;
+
+LExit:
+    return FAILED(hr) ? PROGRESS_CANCEL : PROGRESS_CONTINUE;
+}
+
+extern "C" HRESULT CacheReplayRecording(
+    __in BURN_CACHE_RECORDING* pRecording,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext
+    )
+{
+    static LARGE_INTEGER LARGE_INTEGER_ZERO = { };
+
+    HRESULT hr = S_OK;
+    DWORD dwResult = PROGRESS_CONTINUE;
+
+    for (DWORD i = 0; i < pRecording->cEvents; ++i)
+    {
+        BURN_CACHE_RECORDED_EVENT* pEvent = pRecording->rgEvents + i;
+
+        if (!pEvent->fProgress)
+        {
+            hr = pfnCacheMessageHandler(&pEvent->message, pContext);
+            ExitOnFailure(hr, "Failed to replay recorded cache message.");
+        }
+        else if (pfnProgress)
+        {
+            dwResult = pfnProgress(pEvent->liTotalFileSize, pEvent->liTotalBytesTransferred, LARGE_INTEGER_ZERO, LARGE_INTEGER_ZERO, 1, CALLBACK_CHUNK_FINISHED, INVALID_HANDLE_VALUE, INVALID_HANDLE_VALUE, pContext);
+            switch (dwResult)
+            {
+            case PROGRESS_CONTINUE:
+                break;
+
+            case PROGRESS_CANCEL: __fallthrough;
+            case PROGRESS_STOP:
+                ExitWithRootFailure(hr, HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), "UX aborted on replayed cache progress.");
+
+            case PROGRESS_QUIET:
+                pfnProgress = NULL;
+                break;
+
+            default:
+                ExitWithRootFailure(hr, E_UNEXPECTED, "Invalid return code from progress routine.");
+            }
+        }
+    }
+
+LExit:
+    return hr;
+}
+
+extern "C" void CacheReleaseRecording(
+    __in BURN_CACHE_RECORDING* pRecording
+    )
+{
+    ReleaseNullMem(pRecording->rgEvents);
+    pRecording->cEvents = 0;
+}
+
 extern "C" BOOL CacheBundleRunningFromCache(
     __in BURN_CACHE* pCache
     )
@@ -1109,6 +1278,15 @@ extern "C" HRESULT CacheCompletePayload(
         ExitFunction();
     }
 
+    // If another package already cached the same content, link to it instead of copying and verifying it again.
+    hr = LinkFromContentStore(pCache, fPerMachine, pPayload, sczCachedPath, BURN_CACHE_STEP_HASH_TO_SKIP_VERIFY, pfnCacheMessageHandler, pfnProgress, pContext);
+    ExitOnFailure(hr, "Failed to link payload from content store: %ls", pPayload->sczKey);
+
+    if (S_OK == hr)
+    {
+        ExitFunction();
+    }
+
     hr = CreateUnverifiedPath(pCache, fPerMachine, pPayload->sczKey, &sczUnverifiedPayloadPath);
     ExitOnFailure(hr, "Failed to create unverified path.");
 
@@ -1147,6 +1325,8 @@ extern "C" HRESULT CacheCompletePayload(
 
     ::DecryptFileW(sczCachedPath, 0);  // Let's try to make sure it's not encrypted.
 
+    AddToContentStore(pCache, fPerMachine, pPayload, sczCachedPath);
+
 LExit:
     ReleaseStr(sczUnverifiedPayloadPath);
     ReleaseStr(sczCachedPath);
@@ -1177,6 +1357,8 @@ LExit:
 }
 
 extern "C" HRESULT CacheVerifyPayload(
+    __in_opt BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
     __in BURN_PAYLOAD* pPayload,
     __in_z LPCWSTR wzCachedDirectory,
     __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
@@ -1185,6 +1367,7 @@ extern "C" HRESULT CacheVerifyPayload(
     )
 {
     HRESULT hr = S_OK;
+    HRESULT hrLink = S_OK;
     LPWSTR sczCachedPath = NULL;
 
     hr = PathConcatRelativeToFullyQualifiedBase(wzCachedDirectory, pPayload->sczFilePath, &sczCachedPath);
@@ -1192,12 +1375,86 @@ extern "C" HRESULT CacheVerifyPayload(
 
     hr = VerifyFileAgainstPayload(pPayload, sczCachedPath, TRUE, BURN_CACHE_STEP_HASH_TO_SKIP_ACQUIRE, pfnCacheMessageHandler, pfnProgress, pContext);
 
+    // When another package already cached the same content, link to it so the payload is not acquired at all.
+    if (FAILED(hr) && pCache)
+    {
+        hrLink = LinkFromContentStore(pCache, fPerMachine, pPayload, sczCachedPath, BURN_CACHE_STEP_HASH_TO_SKIP_ACQUIRE, pfnCacheMessageHandler, pfnProgress, pContext);
+        if (S_OK == hrLink)
+        {
+            hr = S_OK;
+        }
+    }
+
 LExit:
     ReleaseStr(sczCachedPath);
 
     return hr;
 }
 
+extern "C" HRESULT CacheVerifyPayloadAgainstCertChain(
+    __in BURN_PAYLOAD* pPayload,
+    __in PCCERT_CHAIN_CONTEXT pChainContext
+    )
+{
+    HRESULT hr = S_OK;
+    PCCERT_CONTEXT pChainElementCertContext = NULL;
+
+    BYTE rgbPublicKeyIdentifier[SHA1_HASH_LEN] = { };
+    DWORD cbPublicKeyIdentifier = sizeof(rgbPublicKeyIdentifier);
+    BYTE* pbThumbprint = NULL;
+    DWORD cbThumbprint = 0;
+
+    // Walk up the chain looking for a certificate in the chain that matches our expected public key identifier
+    // and thumbprint (if a thumbprint was provided).
+    HRESULT hrChainVerification = E_NOTFOUND; // assume we won't find a match.
+    for (DWORD i = 0; i < pChainContext->rgpChain[0]->cElement; ++i)
+    {
+        pChainElementCertContext = pChainContext->rgpChain[0]->rgpElement[i]->pCertContext;
+
+        // Get the certificate's public key identifier.
+        if (!::CryptHashPublicKeyInfo(NULL, CALG_SHA1, 0, X509_ASN_ENCODING, &pChainElementCertContext->pCertInfo->SubjectPublicKeyInfo, rgbPublicKeyIdentifier, &cbPublicKeyIdentifier))
+        {
+            ExitWithLastError(hr, "Failed to get certificate public key identifier.");
+        }
+
+        // Compare the certificate's public key identifier with the payload's public key identifier. If they
+        // match, we're one step closer to the a positive result.
+        if (pPayload->cbCertificateRootPublicKeyIdentifier == cbPublicKeyIdentifier &&
+            0 == memcmp(pPayload->pbCertificateRootPublicKeyIdentifier, rgbPublicKeyIdentifier, cbPublicKeyIdentifier))
+        {
+            // If the payload specified a thumbprint for the certificate, verify it.
+            if (pPayload->pbCertificateRootThumbprint)
+            {
+                hr = CertReadProperty(pChainElementCertContext, CERT_SHA1_HASH_PROP_ID, &pbThumbprint, &cbThumbprint);
+                ExitOnFailure(hr, "Failed to read certificate thumbprint.");
+
+                if (pPayload->cbCertificateRootThumbprint == cbThumbprint &&
+                    0 == memcmp(pPayload->pbCertificateRootThumbprint, pbThumbprint, cbThumbprint))
+                {
+                    // If we got here, we found that our payload public key identifier and thumbprint
+                    // matched an element in the certficate chain.
+                    hrChainVerification = S_OK;
+                    break;
+                }
+
+                ReleaseNullMem(pbThumbprint);
+            }
+            else // no thumbprint match necessary so we're good to go.
+            {
+                hrChainVerification = S_OK;
+                break;
+            }
+        }
+    }
+    hr = hrChainVerification;
+    ExitOnFailure(hr, "Failed to find expected public key in certificate chain.");
+
+LExit:
+    ReleaseMem(pbThumbprint);
+
+    return hr;
+}
+
 extern "C" HRESULT CacheRemoveBaseWorkingFolder(
     __in BURN_CACHE* pCache
     )
@@ -1298,7 +1555,7 @@ static HRESULT CacheVerifyPayloadSignature(
     pSigner = ::WTHelperGetProvSignerFromChain(pProviderData, 0, FALSE, 0);
     ExitOnNullWithLastError(pSigner, hr, "Failed to get signer chain from authenticode certificate.");
 
-    hr = VerifyPayloadAgainstCertChain(pPayload, pSigner->pChainContext);
+    hr = CacheVerifyPayloadAgainstCertChain(pPayload, pSigner->pChainContext);
     ExitOnFailure(hr, "Failed to verify expected payload against actual certificate chain.");
 
     fFailedVerification = FALSE;
@@ -1396,6 +1653,12 @@ extern "C" void CacheUninitialize(
     ReleaseStr(pCache->sczBaseWorkingFolder);
     ReleaseStr(pCache->sczAcquisitionFolder);
     ReleaseStr(pCache->sczSourceProcessFolder);
+    ReleaseDict(pCache->sdhVerifiedContentStore);
+
+    if (pCache->fInitializedCache)
+    {
+        ::DeleteCriticalSection(&pCache->csContentStore);
+    }
 
     memset(pCache, 0, sizeof(BURN_CACHE));
 }
@@ -1707,6 +1970,8 @@ static HRESULT VerifyThenTransferContainer(
 {
     HRESULT hr = S_OK;
     HANDLE hFile = INVALID_HANDLE_VALUE;
+    DWORD64 qwVerifiedSize = 0;
+    HRESULT hrResume = S_OK;
 
     // Get the container on disk actual hash.
     hFile = ::CreateFileW(wzUnverifiedContainerPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
@@ -1719,7 +1984,14 @@ static HRESULT VerifyThenTransferContainer(
     switch (pContainer->verification)
     {
     case BURN_CONTAINER_VERIFICATION_HASH:
-        hr = VerifyHash(pContainer->pbHash, pContainer->cbHash, pContainer->qwFileSize, TRUE, wzUnverifiedContainerPath, hFile, BURN_CACHE_STEP_HASH, pfnCacheMessageHandler, pfnProgress, pContext);
+        if (pContainer->cChunks)
+        {
+            hr = VerifyContainerChunks(pContainer, wzUnverifiedContainerPath, hFile, BURN_CACHE_STEP_HASH, pfnCacheMessageHandler, pfnProgress, pContext, &qwVerifiedSize);
+        }
+        else
+        {
+            hr = VerifyHash(pContainer->pbHash, pContainer->cbHash, pContainer->qwFileSize, TRUE, wzUnverifiedContainerPath, hFile, BURN_CACHE_STEP_HASH, pfnCacheMessageHandler, pfnProgress, pContext);
+        }
         ExitOnFailure(hr, "Failed to verify container hash: %ls", wzCachedPath);
         break;
     default:
@@ -1734,6 +2006,22 @@ static HRESULT VerifyThenTransferContainer(
 LExit:
     ReleaseFileHandle(hFile);
 
+    // Keep the chunks that verified so downloading the container again only fetches from the first bad chunk.
+    // Only layout verifies a whole container. When caching packages, each payload extracted from the
+    // container is verified on its own, so the container is never checked chunk by chunk there.
+    if (CRYPT_E_HASH_VALUE == hr && qwVerifiedSize && pContainer->downloadSource.sczUrl && *pContainer->downloadSource.sczUrl)
+    {
+        hrResume = DownloadPrepareResume(wzUnverifiedContainerPath, qwVerifiedSize);
+        if (SUCCEEDED(hrResume))
+        {
+            LogStringLine(REPORT_STANDARD, "Container '%ls' will resume download at offset: %llu", pContainer->sczId, qwVerifiedSize);
+        }
+        else
+        {
+            LogStringLine(REPORT_STANDARD, "Ignoring failure to prepare container '%ls' to resume download, error: 0x%x", pContainer->sczId, hrResume);
+        }
+    }
+
     return hr;
 }
 
@@ -1847,7 +2135,14 @@ static HRESULT VerifyFileAgainstContainer(
     switch (pContainer->verification)
     {
     case BURN_CONTAINER_VERIFICATION_HASH:
-        hr = VerifyHash(pContainer->pbHash, pContainer->cbHash, pContainer->qwFileSize, TRUE, wzVerifyPath, hFile, cacheStep, pfnCacheMessageHandler, pfnProgress, pContext);
+        if (pContainer->cChunks)
+        {
+            hr = VerifyContainerChunks(pContainer, wzVerifyPath, hFile, cacheStep, pfnCacheMessageHandler, pfnProgress, pContext, NULL);
+        }
+        else
+        {
+            hr = VerifyHash(pContainer->pbHash, pContainer->cbHash, pContainer->qwFileSize, TRUE, wzVerifyPath, hFile, cacheStep, pfnCacheMessageHandler, pfnProgress, pContext);
+        }
         ExitOnFailure(hr, "Failed to verify hash of container: %ls", pContainer->sczId);
         break;
     default:
@@ -2247,6 +2542,12 @@ static HRESULT RemoveBundleOrPackage(
     }
     else
     {
+        // Free any content that only the removed package was using.
+        if (!fBundle)
+        {
+            PruneContentStore(pCache, fPerMachine);
+        }
+
         // Try to remove root package cache in the off chance it is now empty.
         hr = GetRootPath(pCache, fPerMachine, TRUE, &sczRootCacheDirectory);
         ExitOnFailure(hr, "Failed to get %hs package cache root directory.", fPerMachine ? "per-machine" : "per-user");
@@ -2268,6 +2569,280 @@ LExit:
     return hr;
 }
 
+static HRESULT GetContentStorePath(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __deref_out_z_opt LPWSTR* psczStoreFolder,
+    __deref_out_z LPWSTR* psczStorePath
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczStoreFolder = NULL;
+    LPWSTR sczHash = NULL;
+
+    // Only content identified by its hash can be shared.
+    if (BURN_PAYLOAD_VERIFICATION_HASH != pPayload->verification || !pPayload->cbHash)
+    {
+        ExitFunction1(hr = S_FALSE);
+    }
+
+    hr = CacheGetCompletedPath(pCache, fPerMachine, CONTENT_STORE_FOLDER_NAME, &sczStoreFolder);
+    ExitOnFailure(hr, "Failed to get content store directory.");
+
+    hr = StrAllocHexEncode(pPayload->pbHash, pPayload->cbHash, &sczHash);
+    ExitOnFailure(hr, "Failed to hex encode hash of payload: %ls", pPayload->sczKey);
+
+    hr = PathConcat(sczStoreFolder, sczHash, psczStorePath);
+    ExitOnFailure(hr, "Failed to concat hash to content store path.");
+
+    if (psczStoreFolder)
+    {
+        *psczStoreFolder = sczStoreFolder;
+        sczStoreFolder = NULL;
+    }
+
+LExit:
+    ReleaseStr(sczHash);
+    ReleaseStr(sczStoreFolder);
+
+    return hr;
+}
+
+static HRESULT LinkFromContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __in_z LPCWSTR wzCachedPath,
+    __in BURN_CACHE_STEP cacheStep,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczStorePath = NULL;
+    LPWSTR sczCachedDirectory = NULL;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+    hr = GetContentStorePath(pCache, fPerMachine, pPayload, NULL, &sczStorePath);
+    ExitOnFailure(hr, "Failed to get content store path for payload: %ls", pPayload->sczKey);
+
+    if (S_FALSE == hr)
+    {
+        ExitFunction();
+    }
+
+    // Keep writers out of the store entry until it has been verified and linked.
+    hFile = ::CreateFileW(sczStorePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        ExitFunction1(hr = S_FALSE);
+    }
+
+    // The store entry is shared by hard links so anything could have changed it since it was added, verify it like an existing
+    // cached file the first time this process links from it.
+    if (IsContentStoreEntryVerified(pCache, sczStorePath))
+    {
+        hr = SendCacheBeginMessage(pfnCacheMessageHandler, pContext, cacheStep);
+        if (SUCCEEDED(hr))
+        {
+            hr = SendCacheSuccessMessage(pfnCacheMessageHandler, pContext, pPayload->qwFileSize);
+        }
+        SendCacheCompleteMessage(pfnCacheMessageHandler, pContext, hr);
+        ExitOnFailure(hr, "Aborted linking payload from content store: %ls", pPayload->sczKey);
+    }
+    else
+    {
+        hr = VerifyHash(pPayload->pbHash, pPayload->cbHash, pPayload->qwFileSize, TRUE, sczStorePath, hFile, cacheStep, pfnCacheMessageHandler, pfnProgress, pContext);
+        if (FAILED(hr))
+        {
+            LogStringLine(REPORT_STANDARD, "Content store entry '%ls' for payload '%ls' failed verification, error: 0x%x", sczStorePath, pPayload->sczKey, hr);
+
+            ReleaseFileHandle(hFile);
+            FileEnsureDelete(sczStorePath);
+            ExitFunction1(hr = S_FALSE);
+        }
+
+        MarkContentStoreEntryVerified(pCache, sczStorePath);
+    }
+
+    hr = PathGetDirectory(wzCachedPath, &sczCachedDirectory);
+    ExitOnFailure(hr, "Failed to get directory of cached path: %ls", wzCachedPath);
+
+    hr = DirEnsureExists(sczCachedDirectory, NULL);
+    ExitOnFailure(hr, "Failed to create cache directory: %ls", sczCachedDirectory);
+
+    if (::CreateHardLinkW(wzCachedPath, sczStorePath, NULL))
+    {
+        LogStringLine(REPORT_STANDARD, "Linked payload '%ls' from content store '%ls' to path '%ls'", pPayload->sczKey, sczStorePath, wzCachedPath);
+    }
+    else
+    {
+        LogStringLine(REPORT_VERBOSE, "Unable to link payload '%ls' from content store, error: 0x%x", pPayload->sczKey, HRESULT_FROM_WIN32(::GetLastError()));
+
+        // The verification was already reported, so copy the verified content rather than acquiring it again.
+        hr = FileEnsureCopyWithRetry(sczStorePath, wzCachedPath, TRUE, FILE_OPERATION_RETRY_COUNT, FILE_OPERATION_RETRY_WAIT);
+        ExitOnFailure(hr, "Failed to copy payload from content store: %ls to path: %ls", sczStorePath, wzCachedPath);
+    }
+
+LExit:
+    ReleaseFileHandle(hFile);
+    ReleaseStr(sczCachedDirectory);
+    ReleaseStr(sczStorePath);
+
+    return hr;
+}
+
+static void AddToContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
+    __in BURN_PAYLOAD* pPayload,
+    __in_z LPCWSTR wzCachedPath
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczStoreFolder = NULL;
+    LPWSTR sczStorePath = NULL;
+    DWORD er = ERROR_SUCCESS;
+
+    hr = GetContentStorePath(pCache, fPerMachine, pPayload, &sczStoreFolder, &sczStorePath);
+    if (S_OK != hr)
+    {
+        ExitFunction();
+    }
+
+    hr = DirEnsureExists(sczStoreFolder, NULL);
+    ExitOnFailure(hr, "Failed to create content store directory: %ls", sczStoreFolder);
+
+    // The store holds one more link to the cached file. The link count is the reference count.
+    if (::CreateHardLinkW(sczStorePath, wzCachedPath, NULL))
+    {
+        // The content was just verified on its way into the cache.
+        MarkContentStoreEntryVerified(pCache, sczStorePath);
+    }
+    else
+    {
+        er = ::GetLastError();
+        if (ERROR_ALREADY_EXISTS != er)
+        {
+            LogStringLine(REPORT_VERBOSE, "Unable to add payload '%ls' to content store, error: 0x%x", pPayload->sczKey, HRESULT_FROM_WIN32(er));
+        }
+    }
+
+LExit:
+    ReleaseStr(sczStorePath);
+    ReleaseStr(sczStoreFolder);
+}
+
+static BOOL IsContentStoreEntryVerified(
+    __in BURN_CACHE* pCache,
+    __in_z LPCWSTR wzStorePath
+    )
+{
+    BOOL fVerified = FALSE;
+
+    ::EnterCriticalSection(&pCache->csContentStore);
+
+    fVerified = pCache->sdhVerifiedContentStore && S_OK == DictKeyExists(pCache->sdhVerifiedContentStore, wzStorePath);
+
+    ::LeaveCriticalSection(&pCache->csContentStore);
+
+    return fVerified;
+}
+
+static void MarkContentStoreEntryVerified(
+    __in BURN_CACHE* pCache,
+    __in_z LPCWSTR wzStorePath
+    )
+{
+    HRESULT hr = S_OK;
+
+    ::EnterCriticalSection(&pCache->csContentStore);
+
+    if (!pCache->sdhVerifiedContentStore)
+    {
+        hr = DictCreateStringList(&pCache->sdhVerifiedContentStore, 0, DICT_FLAG_CASEINSENSITIVE);
+        ExitOnFailure(hr, "Failed to create verified content store dictionary.");
+    }
+
+    if (E_NOTFOUND == DictKeyExists(pCache->sdhVerifiedContentStore, wzStorePath))
+    {
+        hr = DictAddKey(pCache->sdhVerifiedContentStore, wzStorePath);
+        ExitOnFailure(hr, "Failed to remember verified content store entry: %ls", wzStorePath);
+    }
+
+LExit:
+    ::LeaveCriticalSection(&pCache->csContentStore);
+}
+
+static void PruneContentStore(
+    __in BURN_CACHE* pCache,
+    __in BOOL fPerMachine
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczStoreFolder = NULL;
+    LPWSTR sczFiles = NULL;
+    LPWSTR sczStorePath = NULL;
+    HANDLE hFind = INVALID_HANDLE_VALUE;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    WIN32_FIND_DATAW wfd = { };
+    BY_HANDLE_FILE_INFORMATION fileInfo = { };
+    BOOL fUnreferenced = FALSE;
+
+    hr = CacheGetCompletedPath(pCache, fPerMachine, CONTENT_STORE_FOLDER_NAME, &sczStoreFolder);
+    ExitOnFailure(hr, "Failed to get content store directory.");
+
+    hr = PathConcat(sczStoreFolder, L"*", &sczFiles);
+    ExitOnFailure(hr, "Failed to allocate content store search path.");
+
+    hFind = ::FindFirstFileW(sczFiles, &wfd);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        ExitFunction();
+    }
+
+    do
+    {
+        if (wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            continue;
+        }
+
+        hr = PathConcat(sczStoreFolder, wfd.cFileName, &sczStorePath);
+        ExitOnFailure(hr, "Failed to allocate content store path.");
+
+        // Content with no links left outside the store is no longer referenced by any package.
+        hFile = ::CreateFileW(sczStorePath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        fUnreferenced = INVALID_HANDLE_VALUE != hFile && ::GetFileInformationByHandle(hFile, &fileInfo) && 1 == fileInfo.nNumberOfLinks;
+        ReleaseFileHandle(hFile);
+
+        if (fUnreferenced)
+        {
+            LogStringLine(REPORT_STANDARD, "Removing unreferenced content from content store: %ls", sczStorePath);
+
+            FileEnsureDelete(sczStorePath);
+        }
+    } while (::FindNextFileW(hFind, &wfd));
+
+    ::FindClose(hFind);
+    hFind = INVALID_HANDLE_VALUE;
+
+    // Remove the store in the off chance it is now empty.
+    DirEnsureDeleteEx(sczStoreFolder, DIR_DELETE_SCHEDULE);
+
+LExit:
+    if (INVALID_HANDLE_VALUE != hFind)
+    {
+        ::FindClose(hFind);
+    }
+
+    ReleaseStr(sczStorePath);
+    ReleaseStr(sczFiles);
+    ReleaseStr(sczStoreFolder);
+}
+
 static HRESULT VerifyFileSize(
     __in HANDLE hFile,
     __in DWORD64 qwFileSize,
@@ -2360,66 +2935,179 @@ LExit:
     return hr;
 }
 
-static HRESULT VerifyPayloadAgainstCertChain(
-    __in BURN_PAYLOAD* pPayload,
-    __in PCCERT_CHAIN_CONTEXT pChainContext
+static HRESULT VerifyContainerChunks(
+    __in BURN_CONTAINER* pContainer,
+    __in_z LPCWSTR wzUnverifiedContainerPath,
+    __in HANDLE hFile,
+    __in BURN_CACHE_STEP cacheStep,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext,
+    __out_opt DWORD64* pqwVerifiedSize
     )
 {
     HRESULT hr = S_OK;
-    PCCERT_CONTEXT pChainElementCertContext = NULL;
+    BOOL fFailedVerification = FALSE;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+    CACHE_VERIFY_CHUNKS_CONTEXT context = { };
+    DWORD cWorkers = 0;
+    DWORD cBadChunks = 0;
+    DWORD64 qwVerifiedSize = 0;
+    DOWNLOAD_CACHE_CALLBACK progress = { };
 
-    BYTE rgbPublicKeyIdentifier[SHA1_HASH_LEN] = { };
-    DWORD cbPublicKeyIdentifier = sizeof(rgbPublicKeyIdentifier);
-    BYTE* pbThumbprint = NULL;
-    DWORD cbThumbprint = 0;
+    progress.pfnProgress = pfnProgress;
+    progress.pv = pContext;
 
-    // Walk up the chain looking for a certificate in the chain that matches our expected public key identifier
-    // and thumbprint (if a thumbprint was provided).
-    HRESULT hrChainVerification = E_NOTFOUND; // assume we won't find a match.
-    for (DWORD i = 0; i < pChainContext->rgpChain[0]->cElement; ++i)
+    hr = SendCacheBeginMessage(pfnCacheMessageHandler, pContext, cacheStep);
+    ExitOnFailure(hr, "Aborted cache verify hash begin.");
+
+    fFailedVerification = TRUE;
+
+    hr = VerifyFileSize(hFile, pContainer->qwFileSize, wzUnverifiedContainerPath);
+    ExitOnFailure(hr, "Failed to verify file size for path: %ls", wzUnverifiedContainerPath);
+
+    for (DWORD i = 0; i < pContainer->cChunks; ++i)
     {
-        pChainElementCertContext = pChainContext->rgpChain[0]->rgpElement[i]->pCertContext;
+        pContainer->rgChunks[i].fVerified = FALSE;
+    }
 
-        // Get the certificate's public key identifier.
-        if (!::CryptHashPublicKeyInfo(NULL, CALG_SHA1, 0, X509_ASN_ENCODING, &pChainElementCertContext->pCertInfo->SubjectPublicKeyInfo, rgbPublicKeyIdentifier, &cbPublicKeyIdentifier))
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize thread pool to hash container chunks.");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create group to hash container chunks.");
+
+    // Each worker reads with its own handle and takes the next unhashed chunk until none are left.
+    context.pContainer = pContainer;
+    context.wzVerifyPath = wzUnverifiedContainerPath;
+
+    cWorkers = min(ThrdPoolGetThreadCount(NULL), pContainer->cChunks);
+
+    for (DWORD i = 0; i < cWorkers; ++i)
+    {
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, HashContainerChunks, &context);
+        ExitOnFailure(hr, "Failed to queue hashing of container chunks.");
+    }
+
+    // Progress goes to the BA from this thread while the workers hash.
+    for (;;)
+    {
+        hr = ThrdGroupWait(hGroup, VERIFY_CHUNKS_PROGRESS_INTERVAL);
+        if (HRESULT_FROM_WIN32(WAIT_TIMEOUT) != hr)
         {
-            ExitWithLastError(hr, "Failed to get certificate public key identifier.");
+            break;
         }
 
-        // Compare the certificate's public key identifier with the payload's public key identifier. If they
-        // match, we're one step closer to the a positive result.
-        if (pPayload->cbCertificateRootPublicKeyIdentifier == cbPublicKeyIdentifier &&
-            0 == memcmp(pPayload->pbCertificateRootPublicKeyIdentifier, rgbPublicKeyIdentifier, cbPublicKeyIdentifier))
+        hr = CacheSendProgressCallback(&progress, static_cast<DWORD64>(context.llHashedBytes), pContainer->qwFileSize, INVALID_HANDLE_VALUE);
+        if (FAILED(hr))
         {
-            // If the payload specified a thumbprint for the certificate, verify it.
-            if (pPayload->pbCertificateRootThumbprint)
-            {
-                hr = CertReadProperty(pChainElementCertContext, CERT_SHA1_HASH_PROP_ID, &pbThumbprint, &cbThumbprint);
-                ExitOnFailure(hr, "Failed to read certificate thumbprint.");
+            ThrdGroupCancel(hGroup);
+            ExitOnFailure(hr, "Failed to report progress hashing chunks for path: %ls", wzUnverifiedContainerPath);
+        }
+    }
+    ExitOnFailure(hr, "Failed to calculate chunk hashes for path: %ls", wzUnverifiedContainerPath);
 
-                if (pPayload->cbCertificateRootThumbprint == cbThumbprint &&
-                    0 == memcmp(pPayload->pbCertificateRootThumbprint, pbThumbprint, cbThumbprint))
-                {
-                    // If we got here, we found that our payload public key identifier and thumbprint
-                    // matched an element in the certficate chain.
-                    hrChainVerification = S_OK;
-                    break;
-                }
+    hr = CacheSendProgressCallback(&progress, pContainer->qwFileSize, pContainer->qwFileSize, INVALID_HANDLE_VALUE);
+    ExitOnFailure(hr, "Failed to report progress hashing chunks for path: %ls", wzUnverifiedContainerPath);
 
-                ReleaseNullMem(pbThumbprint);
-            }
-            else // no thumbprint match necessary so we're good to go.
+    // Everything before the first bad chunk can be kept.
+    for (DWORD i = 0; i < pContainer->cChunks; ++i)
+    {
+        if (!pContainer->rgChunks[i].fVerified)
+        {
+            if (!cBadChunks)
             {
-                hrChainVerification = S_OK;
-                break;
+                qwVerifiedSize = i * pContainer->qwChunkSize;
             }
+
+            ++cBadChunks;
+            LogStringLine(REPORT_VERBOSE, "Hash mismatch for chunk %u of container: %ls", i, pContainer->sczId);
         }
     }
-    hr = hrChainVerification;
-    ExitOnFailure(hr, "Failed to find expected public key in certificate chain.");
+
+    if (cBadChunks)
+    {
+        ExitOnFailure(hr = CRYPT_E_HASH_VALUE, "Hash mismatch for %u of %u chunks for path: %ls, first bad chunk starts at: %llu", cBadChunks, pContainer->cChunks, wzUnverifiedContainerPath, qwVerifiedSize);
+    }
+
+    fFailedVerification = FALSE;
+
+    hr = SendCacheSuccessMessage(pfnCacheMessageHandler, pContext, pContainer->qwFileSize);
 
 LExit:
-    ReleaseMem(pbThumbprint);
+    // The workers use the context on the stack so they must all finish first.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    if (fFailedVerification)
+    {
+        // Make sure the BA process marks this container as having failed verification.
+        SendCacheFailureMessage(pfnCacheMessageHandler, pContext, cacheStep);
+    }
+
+    SendCacheCompleteMessage(pfnCacheMessageHandler, pContext, hr);
+
+    if (pqwVerifiedSize)
+    {
+        *pqwVerifiedSize = qwVerifiedSize;
+    }
+
+    return hr;
+}
+
+static HRESULT CALLBACK HashContainerChunks(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    CACHE_VERIFY_CHUNKS_CONTEXT* pVerifyContext = static_cast<CACHE_VERIFY_CHUNKS_CONTEXT*>(pvContext);
+    BURN_CONTAINER* pContainer = pVerifyContext->pContainer;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    BYTE rgbActualHash[SHA512_HASH_LEN] = { };
+    DWORD iChunk = 0;
+    DWORD64 qwOffset = 0;
+    DWORD64 qwLength = 0;
+
+    hFile = ::CreateFileW(pVerifyContext->wzVerifyPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        ExitWithLastError(hr, "Failed to open container to hash chunks: %ls", pVerifyContext->wzVerifyPath);
+    }
+
+    for (;;)
+    {
+        iChunk = static_cast<DWORD>(::InterlockedIncrement(&pVerifyContext->iNextChunk) - 1);
+        if (iChunk >= pContainer->cChunks || ThrdGroupIsCancelled(hGroup))
+        {
+            break;
+        }
+
+        BURN_CONTAINER_CHUNK* pChunk = &pContainer->rgChunks[iChunk];
+        qwOffset = iChunk * pContainer->qwChunkSize;
+        qwLength = min(pContainer->qwChunkSize, pContainer->qwFileSize - qwOffset);
+
+        hr = CrypHashFileRange(hFile, qwOffset, qwLength, PROV_RSA_AES, CALG_SHA_512, rgbActualHash, sizeof(rgbActualHash));
+        ExitOnFailure(hr, "Failed to calculate hash of chunk %u for path: %ls", iChunk, pVerifyContext->wzVerifyPath);
+
+        pChunk->fVerified = pChunk->cbHash == sizeof(rgbActualHash) && 0 == memcmp(pChunk->pbHash, rgbActualHash, sizeof(rgbActualHash));
+
+        ::InterlockedExchangeAdd64(&pVerifyContext->llHashedBytes, static_cast<LONGLONG>(qwLength));
+    }
+
+LExit:
+    ReleaseFileHandle(hFile);
 
     return hr;
 }
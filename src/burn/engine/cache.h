@@ -49,6 +49,10 @@ typedef struct _BURN_CACHE
     // Only valid after CacheEnsureBaseWorkingFolder
     BOOL fInitializedBaseWorkingFolder;
     LPWSTR sczBaseWorkingFolder;
+
+    // Content store entries already hashed by this process, so linking more payloads to them does not hash them again.
+    CRITICAL_SECTION csContentStore;
+    STRINGDICT_HANDLE sdhVerifiedContentStore;
 } BURN_CACHE;
 
 typedef struct _BURN_CACHE_MESSAGE
@@ -81,6 +85,21 @@ typedef HRESULT(CALLBACK* PFN_BURNCACHEMESSAGEHANDLER)(
     __in LPVOID pvContext
     );
 
+typedef struct _BURN_CACHE_RECORDED_EVENT
+{
+    BOOL fProgress;
+    BURN_CACHE_MESSAGE message;
+    LARGE_INTEGER liTotalFileSize;
+    LARGE_INTEGER liTotalBytesTransferred;
+} BURN_CACHE_RECORDED_EVENT;
+
+// Cache messages and progress recorded on one thread so they can be sent from another.
+typedef struct _BURN_CACHE_RECORDING
+{
+    BURN_CACHE_RECORDED_EVENT* rgEvents;
+    DWORD cEvents;
+} BURN_CACHE_RECORDING;
+
 // functions
 
 HRESULT CacheInitialize(
@@ -164,6 +183,30 @@ void CacheSendErrorCallback(
     __in_z_opt LPCWSTR wzError,
     __out_opt BOOL* pfRetry
     );
+HRESULT CALLBACK CacheRecordMessage(
+    __in BURN_CACHE_MESSAGE* pMessage,
+    __in LPVOID pvContext
+    );
+DWORD CALLBACK CacheRecordProgress(
+    __in LARGE_INTEGER TotalFileSize,
+    __in LARGE_INTEGER TotalBytesTransferred,
+    __in LARGE_INTEGER StreamSize,
+    __in LARGE_INTEGER StreamBytesTransferred,
+    __in DWORD dwStreamNumber,
+    __in DWORD dwCallbackReason,
+    __in HANDLE hSourceFile,
+    __in HANDLE hDestinationFile,
+    __in_opt LPVOID lpData
+    );
+HRESULT CacheReplayRecording(
+    __in BURN_CACHE_RECORDING* pRecording,
+    __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
+    __in LPPROGRESS_ROUTINE pfnProgress,
+    __in LPVOID pContext
+    );
+void CacheReleaseRecording(
+    __in BURN_CACHE_RECORDING* pRecording
+    );
 BOOL CacheBundleRunningFromCache(
     __in BURN_CACHE* pCache
     );
@@ -234,12 +277,18 @@ HRESULT CacheVerifyContainer(
     __in LPVOID pContext
     );
 HRESULT CacheVerifyPayload(
+    __in_opt BURN_CACHE* pCache,
+    __in BOOL fPerMachine,
     __in BURN_PAYLOAD* pPayload,
     __in_z LPCWSTR wzCachedDirectory,
     __in PFN_BURNCACHEMESSAGEHANDLER pfnCacheMessageHandler,
     __in LPPROGRESS_ROUTINE pfnProgress,
     __in LPVOID pContext
     );
+HRESULT CacheVerifyPayloadAgainstCertChain(
+    __in BURN_PAYLOAD* pPayload,
+    __in PCCERT_CHAIN_CONTEXT pChainContext
+    );
 HRESULT CacheRemoveBaseWorkingFolder(
     __in BURN_CACHE* pCache
     );
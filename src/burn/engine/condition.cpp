@@ -67,6 +67,7 @@ struct BURN_SYMBOL
 struct BURN_CONDITION_PARSE_CONTEXT
 {
     BURN_VARIABLES* pVariables;
+    BURN_CONDITION_INPUTS* pInputs;
     LPCWSTR wzCondition;
     LPCWSTR wzRead;
     BURN_SYMBOL NextSymbol;
@@ -102,6 +103,11 @@ static HRESULT ParseOperand(
     __in BURN_CONDITION_PARSE_CONTEXT* pContext,
     __out BURN_CONDITION_OPERAND* pOperand
     );
+static HRESULT AddInput(
+    __in BURN_CONDITION_INPUTS* pInputs,
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzVariable
+    );
 static HRESULT Expect(
     __in BURN_CONDITION_PARSE_CONTEXT* pContext,
     __in BURN_SYMBOL_TYPE symbolType
@@ -142,12 +148,23 @@ extern "C" HRESULT ConditionEvaluate(
     __in_z LPCWSTR wzCondition,
     __out BOOL* pf
     )
+{
+    return ConditionEvaluateWithInputs(pVariables, wzCondition, NULL, pf);
+}
+
+extern "C" HRESULT ConditionEvaluateWithInputs(
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzCondition,
+    __in_opt BURN_CONDITION_INPUTS* pInputs,
+    __out BOOL* pf
+    )
 {
     HRESULT hr = S_OK;
     BURN_CONDITION_PARSE_CONTEXT context = { };
     BOOL f = FALSE;
 
     context.pVariables = pVariables;
+    context.pInputs = pInputs;
     context.wzCondition = wzCondition;
     context.wzRead = wzCondition;
 
@@ -175,6 +192,45 @@ LExit:
     return hr;
 }
 
+extern "C" HRESULT ConditionInputsChanged(
+    __in BURN_VARIABLES* pVariables,
+    __in BURN_CONDITION_INPUTS* pInputs,
+    __out BOOL* pfChanged
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwChangeStamp = 0;
+
+    *pfChanged = pInputs->fUntracked;
+
+    for (DWORD i = 0; !*pfChanged && i < pInputs->cInputs; ++i)
+    {
+        BURN_CONDITION_INPUT* pInput = pInputs->rgInputs + i;
+
+        hr = VariableGetChangeStamp(pVariables, pInput->sczVariable, &dwChangeStamp);
+        ExitOnFailure(hr, "Failed to get change stamp of condition input: %ls", pInput->sczVariable);
+
+        *pfChanged = dwChangeStamp != pInput->dwChangeStamp;
+    }
+
+LExit:
+    return hr;
+}
+
+extern "C" void ConditionInputsUninitialize(
+    __in BURN_CONDITION_INPUTS* pInputs
+    )
+{
+    for (DWORD i = 0; i < pInputs->cInputs; ++i)
+    {
+        ReleaseStr(pInputs->rgInputs[i].sczVariable);
+    }
+
+    ReleaseMem(pInputs->rgInputs);
+
+    memset(pInputs, 0, sizeof(BURN_CONDITION_INPUTS));
+}
+
 extern "C" HRESULT ConditionGlobalCheck(
     __in BURN_VARIABLES* pVariables,
     __in BURN_CONDITION* pCondition,
@@ -435,6 +491,13 @@ static HRESULT ParseOperand(
     case BURN_SYMBOL_TYPE_IDENTIFIER:
         Assert(BURN_VARIANT_TYPE_STRING == pContext->NextSymbol.Value.Type);
 
+        // remember the variable before reading it so a change made while reading is not missed
+        if (pContext->pInputs)
+        {
+            hr = AddInput(pContext->pInputs, pContext->pVariables, pContext->NextSymbol.Value.sczValue);
+            ExitOnFailure(hr, "Failed to remember variable '%ls' for condition '%ls'", pContext->NextSymbol.Value.sczValue, pContext->wzCondition);
+        }
+
         // find variable
         hr = VariableGetVariant(pContext->pVariables, pContext->NextSymbol.Value.sczValue, &pOperand->Value);
         if (E_NOTFOUND != hr)
@@ -447,6 +510,11 @@ static HRESULT ParseOperand(
 
         if (BURN_VARIANT_TYPE_FORMATTED == pOperand->Value.Type)
         {
+            if (pContext->pInputs)
+            {
+                pContext->pInputs->fUntracked = TRUE;
+            }
+
             hr = VariableGetFormatted(pContext->pVariables, pContext->NextSymbol.Value.sczValue, &sczFormatted, &pOperand->fHidden);
             ExitOnRootFailure(hr, "Failed to format variable '%ls' for condition '%ls'", pContext->NextSymbol.Value.sczValue, pContext->wzCondition);
 
@@ -483,6 +551,40 @@ LExit:
 //
 // Expect - expects a symbol.
 //
+static HRESULT AddInput(
+    __in BURN_CONDITION_INPUTS* pInputs,
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzVariable
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_CONDITION_INPUT* pInput = NULL;
+
+    for (DWORD i = 0; i < pInputs->cInputs; ++i)
+    {
+        if (CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, pInputs->rgInputs[i].sczVariable, -1, wzVariable, -1))
+        {
+            ExitFunction();
+        }
+    }
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pInputs->rgInputs), pInputs->cInputs, 1, sizeof(BURN_CONDITION_INPUT), 5);
+    ExitOnFailure(hr, "Failed to grow condition inputs.");
+
+    pInput = pInputs->rgInputs + pInputs->cInputs;
+
+    hr = StrAllocString(&pInput->sczVariable, wzVariable, 0);
+    ExitOnFailure(hr, "Failed to copy condition input name.");
+
+    ++pInputs->cInputs;
+
+    hr = VariableGetChangeStamp(pVariables, wzVariable, &pInput->dwChangeStamp);
+    ExitOnFailure(hr, "Failed to get change stamp of condition input: %ls", wzVariable);
+
+LExit:
+    return hr;
+}
+
 static HRESULT Expect(
     __in BURN_CONDITION_PARSE_CONTEXT* pContext,
     __in BURN_SYMBOL_TYPE symbolType
@@ -717,7 +819,7 @@ static HRESULT NextSymbol(
                          pContext->wzRead[n] == L'-' ||
                          pContext->wzRead[n] == L'.');
 
-                hr = VerParseVersion(&pContext->wzRead[1], n - 1, FALSE, &pContext->NextSymbol.Value.pValue);
+                hr = VerCacheParseVersion(&pContext->wzRead[1], n - 1, FALSE, &pContext->NextSymbol.Value.pValue);
                 if (FAILED(hr))
                 {
                     pContext->fError = TRUE;
@@ -13,6 +13,20 @@ typedef struct _BURN_CONDITION
     LPWSTR sczConditionString;
 } BURN_CONDITION;
 
+typedef struct _BURN_CONDITION_INPUT
+{
+    LPWSTR sczVariable;
+    DWORD dwChangeStamp;
+} BURN_CONDITION_INPUT;
+
+// The variables conditions read, so a result can be reused until one of them is set again.
+typedef struct _BURN_CONDITION_INPUTS
+{
+    BOOL fUntracked; // a formatted variable was read so its value can change without its stamp changing.
+    BURN_CONDITION_INPUT* rgInputs;
+    DWORD cInputs;
+} BURN_CONDITION_INPUTS;
+
 
 // function declarations
 
@@ -21,6 +35,20 @@ HRESULT ConditionEvaluate(
     __in_z LPCWSTR wzCondition,
     __out BOOL* pf
     );
+HRESULT ConditionEvaluateWithInputs(
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzCondition,
+    __in_opt BURN_CONDITION_INPUTS* pInputs,
+    __out BOOL* pf
+    );
+HRESULT ConditionInputsChanged(
+    __in BURN_VARIABLES* pVariables,
+    __in BURN_CONDITION_INPUTS* pInputs,
+    __out BOOL* pfChanged
+    );
+void ConditionInputsUninitialize(
+    __in BURN_CONDITION_INPUTS* pInputs
+    );
 HRESULT ConditionGlobalCheck(
     __in BURN_VARIABLES* pVariables,
     __in BURN_CONDITION* pBlock,
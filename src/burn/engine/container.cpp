@@ -3,6 +3,14 @@
 #include "precomp.h"
 
 
+// internal function declarations
+
+static HRESULT ParseChunksFromXml(
+    __in BURN_CONTAINER* pContainer,
+    __in IXMLDOMNode* pixnContainer
+    );
+
+
 // function definitions
 
 extern "C" HRESULT ContainersParseFromXml(
@@ -107,6 +115,19 @@ extern "C" HRESULT ContainersParseFromXml(
 
         pContainer->verification = BURN_CONTAINER_VERIFICATION_HASH;
 
+        // @ChunkSize
+        hr = XmlGetAttributeEx(pixnNode, L"ChunkSize", &scz);
+        ExitOnOptionalXmlQueryFailure(hr, fXmlFound, "Failed to get @ChunkSize.");
+
+        if (fXmlFound)
+        {
+            hr = StrStringToUInt64(scz, 0, &pContainer->qwChunkSize);
+            ExitOnFailure(hr, "Failed to parse @ChunkSize.");
+
+            hr = ParseChunksFromXml(pContainer, pixnNode);
+            ExitOnFailure(hr, "Failed to parse chunks for container: %ls", pContainer->sczId);
+        }
+
         // prepare next iteration
         ReleaseNullObject(pixnNode);
     }
@@ -169,6 +190,11 @@ extern "C" void ContainersUninitialize(
             ReleaseStr(pContainer->sczSourcePath);
             ReleaseStr(pContainer->sczFilePath);
             ReleaseMem(pContainer->pbHash);
+            for (DWORD j = 0; j < pContainer->cChunks; ++j)
+            {
+                ReleaseMem(pContainer->rgChunks[j].pbHash);
+            }
+            ReleaseMem(pContainer->rgChunks);
             ReleaseStr(pContainer->downloadSource.sczUrl);
             ReleaseStr(pContainer->downloadSource.sczUser);
             ReleaseStr(pContainer->downloadSource.sczPassword);
@@ -343,6 +369,33 @@ extern "C" HRESULT ContainerSkipStream(
     return hr;
 }
 
+// Lists the streams in the order ContainerNextStream returns them without moving through the container.
+extern "C" HRESULT ContainerReadStreamNames(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __deref_out_ecount(*pcStreamNames) LPWSTR** prgsczStreamNames,
+    __out DWORD* pcStreamNames
+    )
+{
+    HRESULT hr = S_OK;
+
+    *prgsczStreamNames = NULL;
+    *pcStreamNames = 0;
+
+    switch (pContext->type)
+    {
+    case BURN_CONTAINER_TYPE_CABINET:
+        hr = CabExtractReadStreamNames(pContext, prgsczStreamNames, pcStreamNames);
+        break;
+
+    default:
+        hr = E_NOTIMPL;
+        break;
+    }
+
+//LExit:
+    return hr;
+}
+
 extern "C" HRESULT ContainerClose(
     __in BURN_CONTAINER_CONTEXT* pContext
     )
@@ -394,3 +447,67 @@ extern "C" HRESULT ContainerFindById(
 LExit:
     return hr;
 }
+
+
+// internal function definitions
+
+static HRESULT ParseChunksFromXml(
+    __in BURN_CONTAINER* pContainer,
+    __in IXMLDOMNode* pixnContainer
+    )
+{
+    HRESULT hr = S_OK;
+    IXMLDOMNodeList* pixnNodes = NULL;
+    IXMLDOMNode* pixnNode = NULL;
+    DWORD cNodes = 0;
+    LPWSTR scz = NULL;
+    DWORD64 qwExpectedChunks = 0;
+
+    if (!pContainer->qwChunkSize)
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Chunk size must be greater than zero.");
+    }
+
+    hr = XmlSelectNodes(pixnContainer, L"Chunk", &pixnNodes);
+    ExitOnFailure(hr, "Failed to select chunk nodes.");
+
+    hr = pixnNodes->get_length((long*)&cNodes);
+    ExitOnFailure(hr, "Failed to get chunk node count.");
+
+    // Every byte of the container must be covered by exactly one chunk.
+    qwExpectedChunks = (pContainer->qwFileSize + pContainer->qwChunkSize - 1) / pContainer->qwChunkSize;
+    if (qwExpectedChunks != cNodes)
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Expected %llu chunks for size %llu and chunk size %llu but found %u.", qwExpectedChunks, pContainer->qwFileSize, pContainer->qwChunkSize, cNodes);
+    }
+
+    pContainer->rgChunks = (BURN_CONTAINER_CHUNK*)MemAlloc(sizeof(BURN_CONTAINER_CHUNK) * cNodes, TRUE);
+    ExitOnNull(pContainer->rgChunks, hr, E_OUTOFMEMORY, "Failed to allocate memory for container chunks.");
+
+    pContainer->cChunks = cNodes;
+
+    for (DWORD i = 0; i < cNodes; ++i)
+    {
+        BURN_CONTAINER_CHUNK* pChunk = &pContainer->rgChunks[i];
+
+        hr = XmlNextElement(pixnNodes, &pixnNode, NULL);
+        ExitOnFailure(hr, "Failed to get next chunk node.");
+
+        // @Hash
+        hr = XmlGetAttributeEx(pixnNode, L"Hash", &scz);
+        ExitOnRequiredXmlQueryFailure(hr, "Failed to get Chunk/@Hash.");
+
+        hr = StrAllocHexDecode(scz, &pChunk->pbHash, &pChunk->cbHash);
+        ExitOnFailure(hr, "Failed to hex decode the Chunk/@Hash.");
+
+        // prepare next iteration
+        ReleaseNullObject(pixnNode);
+    }
+
+LExit:
+    ReleaseObject(pixnNodes);
+    ReleaseObject(pixnNode);
+    ReleaseStr(scz);
+
+    return hr;
+}
@@ -61,6 +61,13 @@ enum BURN_CONTAINER_VERIFICATION
 
 // structs
 
+typedef struct _BURN_CONTAINER_CHUNK
+{
+    BYTE* pbHash;
+    DWORD cbHash;
+    BOOL fVerified;
+} BURN_CONTAINER_CHUNK;
+
 typedef struct _BURN_CONTAINER
 {
     LPWSTR sczId;
@@ -78,6 +85,9 @@ typedef struct _BURN_CONTAINER
     BYTE* pbHash;
     DWORD cbHash;
     BURN_CONTAINER_VERIFICATION verification;
+    DWORD64 qwChunkSize;        // size of each chunk when the container is verified a chunk at a time.
+    BURN_CONTAINER_CHUNK* rgChunks;
+    DWORD cChunks;
     DWORD64 qwAttachedOffset;
     BOOL fActuallyAttached;     // indicates whether an attached container is attached or missing.
 
@@ -187,6 +197,11 @@ HRESULT ContainerStreamToBuffer(
 HRESULT ContainerSkipStream(
     __in BURN_CONTAINER_CONTEXT* pContext
     );
+HRESULT ContainerReadStreamNames(
+    __in BURN_CONTAINER_CONTEXT* pContext,
+    __deref_out_ecount(*pcStreamNames) LPWSTR** prgsczStreamNames,
+    __out DWORD* pcStreamNames
+    );
 HRESULT ContainerClose(
     __in BURN_CONTAINER_CONTEXT* pContext
     );
@@ -11,6 +11,16 @@ struct BURN_CACHE_THREAD_CONTEXT
     BURN_APPLY_CONTEXT* pApplyContext;
 };
 
+struct BURN_DETECT_PACKAGE_CONTEXT
+{
+    BURN_ENGINE_STATE* pEngineState;
+    BURN_PACKAGE* pPackage;
+    HANDLE hCompletedEvent;
+    HRESULT hrDetect;
+    BURN_BA_DEFERRED_MESSAGES messages;
+    LONG volatile fCompleted;
+};
+
 
 static PFN_CREATEPROCESSW vpfnCreateProcessW = ::CreateProcessW;
 static PFN_PROCWAITFORCOMPLETION vpfnProcWaitForCompletion = ProcWaitForCompletion;
@@ -53,6 +63,21 @@ static HRESULT ParsePipeConnection(
     __in_ecount(3) LPWSTR* rgArgs,
     __in BURN_PIPE_CONNECTION* pConnection
     );
+static HRESULT CALLBACK DetectPackageWithDeferredMessages(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT SendDetectPackageMessages(
+    __in BURN_ENGINE_STATE* pEngineState,
+    __in BURN_DETECT_PACKAGE_CONTEXT* pContext,
+    __in THRD_GROUP_HANDLE hGroup,
+    __out BOOL* pfCancelled
+    );
+static void RecordDetectPackageResult(
+    __in BURN_PACKAGE* pPackage,
+    __in HRESULT hrDetect,
+    __inout HRESULT* phrFirstPackageFailure
+    );
 static HRESULT DetectPackage(
     __in BURN_ENGINE_STATE* pEngineState,
     __in BURN_PACKAGE* pPackage
@@ -294,6 +319,10 @@ extern "C" HRESULT CoreDetect(
     BOOL fDetectBegan = FALSE;
     BURN_PACKAGE* pPackage = NULL;
     HRESULT hrFirstPackageFailure = S_OK;
+    BURN_TIMER detectTimer = { };
+    BURN_TIMER timer = { };
+
+    TimingStart(&detectTimer);
 
     LogId(REPORT_STANDARD, MSG_DETECT_BEGIN, pEngineState->packages.cPackages);
 
@@ -301,7 +330,10 @@ extern "C" HRESULT CoreDetect(
     pEngineState->fDetected = FALSE;
     pEngineState->fPlanned = FALSE;
     DetectReset(&pEngineState->registration, &pEngineState->packages);
-    PlanReset(&pEngineState->plan, &pEngineState->variables, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
+    PlanReset(&pEngineState->plan, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
+
+    hr = PlanSetVariables(BOOTSTRAPPER_ACTION_UNKNOWN, &pEngineState->variables);
+    ExitOnFailure(hr, "Failed to reset the action during detect.");
 
     hr = RegistrationSetDynamicVariables(&pEngineState->registration, &pEngineState->variables);
     ExitOnFailure(hr, "Failed to reset the dynamic registration variables during detect.");
@@ -312,16 +344,24 @@ extern "C" HRESULT CoreDetect(
 
     pEngineState->userExperience.hwndDetect = hwndParent;
 
+    TimingStart(&timer);
+
     hr = SearchesExecute(&pEngineState->searches, &pEngineState->variables);
     ExitOnFailure(hr, "Failed to execute searches.");
 
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"SearchesExecute", NULL);
+
     hr = DependencyDetectBundle(&pEngineState->dependencies, &pEngineState->registration);
     ExitOnFailure(hr, "Failed to detect the dependencies.");
 
     // Load all of the related bundles.
+    TimingStart(&timer);
+
     hr = RegistrationDetectRelatedBundles(&pEngineState->registration);
     ExitOnFailure(hr, "Failed to detect related bundles.");
 
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"RegistrationDetectRelatedBundles", NULL);
+
     hr = DetectForwardCompatibleBundles(&pEngineState->userExperience, &pEngineState->registration);
     ExitOnFailure(hr, "Failed to detect forward compatible bundle.");
 
@@ -345,26 +385,12 @@ extern "C" HRESULT CoreDetect(
         ExitOnFailure(hr, "Failed to initialize MSI engine detection.");
     }
 
-    for (DWORD i = 0; i < pEngineState->packages.cPackages; ++i)
-    {
-        pPackage = pEngineState->packages.rgPackages + i;
+    TimingStart(&timer);
 
-        hr = DetectPackage(pEngineState, pPackage);
-
-        // If the package detection failed, ensure the package state is set to unknown.
-        if (FAILED(hr))
-        {
-            if (SUCCEEDED(hrFirstPackageFailure))
-            {
-                hrFirstPackageFailure = hr;
-            }
+    hr = CoreDetectPackages(pEngineState, &hrFirstPackageFailure);
+    ExitOnFailure(hr, "Failed to detect packages.");
 
-            pPackage->currentState = BOOTSTRAPPER_PACKAGE_STATE_UNKNOWN;
-            pPackage->cacheRegistrationState = BURN_PACKAGE_REGISTRATION_STATE_UNKNOWN;
-            pPackage->installRegistrationState = BURN_PACKAGE_REGISTRATION_STATE_UNKNOWN;
-            pPackage->compatiblePackage.fDetected = FALSE;
-        }
-    }
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"DetectPackages", NULL);
 
     // Log the detected states.
     for (DWORD iPackage = 0; iPackage < pEngineState->packages.cPackages; ++iPackage)
@@ -417,11 +443,139 @@ LExit:
 
     pEngineState->userExperience.hwndDetect = NULL;
 
+    TimingStop(&detectTimer, BURN_TIMING_CATEGORY_PHASE, L"CoreDetect", NULL);
+
     LogId(REPORT_STANDARD, MSG_DETECT_COMPLETE, hr, !fDetectBegan ? "(failed)" : LoggingRegistrationTypeToString(pEngineState->registration.detectedRegistrationType), !fDetectBegan ? "(failed)" : LoggingBoolToString(pEngineState->registration.fCached), FAILED(hr) ? "(failed)" : LoggingBoolToString(pEngineState->registration.fEligibleForCleanup));
 
     return hr;
 }
 
+extern "C" HRESULT CoreDetectPackages(
+    __in BURN_ENGINE_STATE* pEngineState,
+    __out HRESULT* phrFirstPackageFailure
+    )
+{
+    HRESULT hr = S_OK;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+    HANDLE hCompletedEvent = NULL;
+    BURN_DETECT_PACKAGE_CONTEXT* rgContexts = NULL;
+    DWORD cPackages = pEngineState->packages.cPackages;
+    BOOL fCancelled = FALSE;
+
+    *phrFirstPackageFailure = S_OK;
+
+    if (!cPackages)
+    {
+        ExitFunction();
+    }
+
+    // A parallel detect sends the BA messages after the package was detected, so variables the BA
+    // sets from a detect package callback are not seen by later packages. Bundles must opt in.
+    if (!pEngineState->fParallelDetect)
+    {
+        for (DWORD i = 0; i < cPackages; ++i)
+        {
+            BURN_PACKAGE* pPackage = pEngineState->packages.rgPackages + i;
+
+            hr = DetectPackage(pEngineState, pPackage);
+            RecordDetectPackageResult(pPackage, hr, phrFirstPackageFailure);
+        }
+
+        ExitFunction1(hr = S_OK);
+    }
+
+    rgContexts = static_cast<BURN_DETECT_PACKAGE_CONTEXT*>(MemAlloc(sizeof(BURN_DETECT_PACKAGE_CONTEXT) * cPackages, TRUE));
+    ExitOnNull(rgContexts, hr, E_OUTOFMEMORY, "Failed to allocate package detect contexts.");
+
+    hCompletedEvent = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+    ExitOnNullWithLastError(hCompletedEvent, hr, "Failed to create package detect completion event.");
+
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize thread pool to detect packages.");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create group to detect packages.");
+
+    // Packages are detected in parallel with their BA messages recorded, then the messages are
+    // sent in chain order so the BA sees the same sequence of callbacks as a serial detect.
+    for (DWORD i = 0; i < cPackages; ++i)
+    {
+        BURN_DETECT_PACKAGE_CONTEXT* pContext = rgContexts + i;
+
+        pContext->pEngineState = pEngineState;
+        pContext->pPackage = pEngineState->packages.rgPackages + i;
+        pContext->hCompletedEvent = hCompletedEvent;
+
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, DetectPackageWithDeferredMessages, pContext);
+        ExitOnFailure(hr, "Failed to queue detect of package: %ls", pContext->pPackage->sczId);
+    }
+
+    for (DWORD i = 0; i < cPackages; ++i)
+    {
+        BURN_DETECT_PACKAGE_CONTEXT* pContext = rgContexts + i;
+        BURN_PACKAGE* pPackage = pContext->pPackage;
+
+        if (fCancelled && !pContext->fCompleted)
+        {
+            // The package never started after the BA cancelled, so detect it serially against the BA's current state.
+            hr = DetectPackage(pEngineState, pPackage);
+        }
+        else
+        {
+            while (!pContext->fCompleted)
+            {
+                if (WAIT_OBJECT_0 != ::WaitForSingleObject(hCompletedEvent, INFINITE))
+                {
+                    ExitWithLastError(hr, "Failed to wait for detect of package: %ls", pPackage->sczId);
+                }
+            }
+
+            hr = SendDetectPackageMessages(pEngineState, pContext, hGroup, &fCancelled);
+
+            // Let the packages that were already running finish so the packages that never
+            // started can be told apart from them.
+            if (fCancelled)
+            {
+                ThrdGroupWait(hGroup, INFINITE);
+            }
+        }
+
+        RecordDetectPackageResult(pPackage, hr, phrFirstPackageFailure);
+    }
+
+    hr = S_OK;
+
+LExit:
+    // The workers use the contexts so they must all finish first.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    if (rgContexts)
+    {
+        for (DWORD i = 0; i < cPackages; ++i)
+        {
+            BACallbackReleaseDeferredMessages(&rgContexts[i].messages);
+        }
+
+        MemFree(rgContexts);
+    }
+
+    ReleaseHandle(hCompletedEvent);
+
+    return hr;
+}
+
 extern "C" HRESULT CorePlan(
     __in BURN_ENGINE_STATE* pEngineState,
     __in BOOTSTRAPPER_ACTION action
@@ -432,6 +586,10 @@ extern "C" HRESULT CorePlan(
     BURN_PACKAGE* pUpgradeBundlePackage = NULL;
     BURN_PACKAGE* pForwardCompatibleBundlePackage = NULL;
     BOOL fContinuePlanning = TRUE; // assume we won't skip planning due to dependencies.
+    BURN_TIMER planTimer = { };
+    BURN_TIMER timer = { };
+
+    TimingStart(&planTimer);
 
     LogId(REPORT_STANDARD, MSG_PLAN_BEGIN, pEngineState->packages.cPackages, LoggingBurnActionToString(action));
 
@@ -450,8 +608,10 @@ extern "C" HRESULT CorePlan(
 
     // Always reset the plan.
     pEngineState->fPlanned = FALSE;
-    PlanReset(&pEngineState->plan, &pEngineState->variables, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
+    PlanReset(&pEngineState->plan, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
 
+    // Setting the action without first resetting it leaves its stamp alone when
+    // the BA plans the same action again, so the plan cache can be reused.
     hr = PlanSetVariables(action, &pEngineState->variables);
     ExitOnFailure(hr, "Failed to update action.");
 
@@ -466,6 +626,7 @@ extern "C" HRESULT CorePlan(
     pEngineState->plan.wzBundleProviderKey = pEngineState->registration.sczId;
     pEngineState->plan.fDisableRollback = pEngineState->fDisableRollback || BOOTSTRAPPER_ACTION_UNSAFE_UNINSTALL == pEngineState->plan.action;
     pEngineState->plan.fPlanPackageCacheRollback = BOOTSTRAPPER_REGISTRATION_TYPE_NONE == pEngineState->registration.detectedRegistrationType;
+    pEngineState->plan.fIncrementalPlan = pEngineState->fIncrementalPlan;
 
     // Set resume commandline
     hr = PlanSetResumeCommand(&pEngineState->plan, &pEngineState->registration, &pEngineState->log);
@@ -537,15 +698,25 @@ extern "C" HRESULT CorePlan(
                 DWORD dwExecuteActionEarlyIndex = pEngineState->plan.cExecuteActions;
 
                 // Plan the related bundles first to support downgrades with ref-counting.
+                TimingStart(&timer);
+
                 hr = PlanRelatedBundlesBegin(&pEngineState->userExperience, &pEngineState->registration, pEngineState->command.relationType, &pEngineState->plan);
                 ExitOnFailure(hr, "Failed to plan related bundles.");
 
+                TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"PlanRelatedBundlesBegin", NULL);
+                TimingStart(&timer);
+
                 hr = PlanPackages(&pEngineState->userExperience, &pEngineState->packages, &pEngineState->plan, &pEngineState->log, &pEngineState->variables);
                 ExitOnFailure(hr, "Failed to plan packages.");
 
+                TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"PlanPackages", NULL);
+                TimingStart(&timer);
+
                 // Schedule the update of related bundles last.
                 hr = PlanRelatedBundlesComplete(&pEngineState->userExperience, &pEngineState->registration, &pEngineState->plan, &pEngineState->log, &pEngineState->variables, dwExecuteActionEarlyIndex);
                 ExitOnFailure(hr, "Failed to schedule related bundles.");
+
+                TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"PlanRelatedBundlesComplete", NULL);
             }
         }
     }
@@ -569,6 +740,8 @@ LExit:
         BACallbackOnPlanComplete(&pEngineState->userExperience, hr);
     }
 
+    TimingStop(&planTimer, BURN_TIMING_CATEGORY_PHASE, L"CorePlan", NULL);
+
     LogId(REPORT_STANDARD, MSG_PLAN_COMPLETE, hr);
 
     return hr;
@@ -693,6 +866,7 @@ extern "C" HRESULT CoreApply(
 
     fDeleteApplyCs = TRUE;
     ::InitializeCriticalSection(&applyContext.csApply);
+    applyContext.fParallelCache = pEngineState->fParallelCacheAndExecute;
 
     // Ensure the engine is cached to the working path.
     if (!pEngineState->sczBundleEngineWorkingPath)
@@ -707,7 +881,7 @@ extern "C" HRESULT CoreApply(
         hr = CoreElevate(pEngineState, WM_BURN_APPLY, pEngineState->userExperience.hwndApply);
         ExitOnFailure(hr, "Failed to elevate.");
 
-        hr = ElevationApplyInitialize(pEngineState->companionConnection.hPipe, &pEngineState->userExperience, &pEngineState->variables, &pEngineState->plan);
+        hr = ElevationApplyInitialize(pEngineState->companionConnection.hPipe, &pEngineState->userExperience, &pEngineState->variables, &pEngineState->packages, &pEngineState->plan);
         ExitOnFailure(hr, "Failed to initialize apply in elevated process.");
 
         fElevated = TRUE;
@@ -1518,6 +1692,19 @@ extern "C" HRESULT CoreParseCommandLine(
 
                 pInternalCommand->dwLoggingAttributes |= BURN_LOGGING_ATTRIBUTE_APPEND;
             }
+            else if (CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, &argv[i][1], -1, BURN_COMMANDLINE_SWITCH_TIMING_TRACE, -1))
+            {
+                if (i + 1 >= argc)
+                {
+                    fInvalidCommandLine = TRUE;
+                    ExitOnRootFailure(hr = E_INVALIDARG, "Must specify a path for timing trace.");
+                }
+
+                ++i;
+
+                hr = PathExpand(&pInternalCommand->sczTimingTraceFile, argv[i], PATH_EXPAND_FULLPATH);
+                ExitOnFailure(hr, "Failed to copy timing trace file path.");
+            }
             else if (CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, &argv[i][1], lstrlenW(BURN_COMMANDLINE_SWITCH_LOG_MODE), BURN_COMMANDLINE_SWITCH_LOG_MODE, -1))
             {
                 // Get a pointer to the next character after the switch.
@@ -2153,6 +2340,85 @@ LExit:
     return hr;
 }
 
+static HRESULT CALLBACK DetectPackageWithDeferredMessages(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    UNREFERENCED_PARAMETER(hGroup);
+
+    BURN_DETECT_PACKAGE_CONTEXT* pContext = static_cast<BURN_DETECT_PACKAGE_CONTEXT*>(pvContext);
+
+    BACallbackDeferMessages(&pContext->messages);
+
+    pContext->hrDetect = DetectPackage(pContext->pEngineState, pContext->pPackage);
+
+    BACallbackDeferMessages(NULL);
+
+    ::InterlockedExchange(&pContext->fCompleted, TRUE);
+    ::SetEvent(pContext->hCompletedEvent);
+
+    // A failed package must not stop the other packages from being detected.
+    return S_OK;
+}
+
+static HRESULT SendDetectPackageMessages(
+    __in BURN_ENGINE_STATE* pEngineState,
+    __in BURN_DETECT_PACKAGE_CONTEXT* pContext,
+    __in THRD_GROUP_HANDLE hGroup,
+    __out BOOL* pfCancelled
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_PACKAGE* pPackage = pContext->pPackage;
+    DWORD iFailedMessage = 0;
+
+    hr = BACallbackSendDeferredMessages(&pEngineState->userExperience, &pContext->messages, &iFailedMessage);
+
+    // The last recorded message is detect complete whose result is ignored. Otherwise the BA
+    // cancelled detection of the package, so finish the package with that error like a serial
+    // detect would have.
+    if (FAILED(hr) && iFailedMessage + 1 < pContext->messages.cMessages)
+    {
+        *pfCancelled = TRUE;
+
+        // Once the BA cancels a package it may be changing state the remaining packages depend on,
+        // so drop the queued work before the BA hears the package completed.
+        ThrdGroupCancel(hGroup);
+
+        LogErrorId(hr, MSG_FAILED_DETECT_PACKAGE, pPackage->sczId, NULL, NULL);
+
+        BACallbackOnDetectPackageComplete(&pEngineState->userExperience, pPackage->sczId, hr, pPackage->currentState, pPackage->fCached);
+    }
+    else
+    {
+        hr = pContext->hrDetect;
+    }
+
+    return hr;
+}
+
+static void RecordDetectPackageResult(
+    __in BURN_PACKAGE* pPackage,
+    __in HRESULT hrDetect,
+    __inout HRESULT* phrFirstPackageFailure
+    )
+{
+    // If the package detection failed, ensure the package state is set to unknown.
+    if (FAILED(hrDetect))
+    {
+        if (SUCCEEDED(*phrFirstPackageFailure))
+        {
+            *phrFirstPackageFailure = hrDetect;
+        }
+
+        pPackage->currentState = BOOTSTRAPPER_PACKAGE_STATE_UNKNOWN;
+        pPackage->cacheRegistrationState = BURN_PACKAGE_REGISTRATION_STATE_UNKNOWN;
+        pPackage->installRegistrationState = BURN_PACKAGE_REGISTRATION_STATE_UNKNOWN;
+        pPackage->compatiblePackage.fDetected = FALSE;
+    }
+}
+
 static HRESULT DetectPackage(
     __in BURN_ENGINE_STATE* pEngineState,
     __in BURN_PACKAGE* pPackage
@@ -2160,6 +2426,9 @@ static HRESULT DetectPackage(
 {
     HRESULT hr = S_OK;
     BOOL fBegan = FALSE;
+    BURN_TIMER timer = { };
+
+    TimingStart(&timer);
 
     fBegan = TRUE;
     hr = BACallbackOnDetectPackageBegin(&pEngineState->userExperience, pPackage->sczId);
@@ -2207,6 +2476,8 @@ LExit:
         BACallbackOnDetectPackageComplete(&pEngineState->userExperience, pPackage->sczId, hr, pPackage->currentState, pPackage->fCached);
     }
 
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PACKAGE, L"DetectPackage", pPackage->sczId);
+
     return hr;
 }
 
@@ -35,6 +35,7 @@ const LPCWSTR BURN_COMMANDLINE_SWITCH_FILEHANDLE_ATTACHED = L"burn.filehandle.at
 const LPCWSTR BURN_COMMANDLINE_SWITCH_FILEHANDLE_SELF = L"burn.filehandle.self";
 const LPCWSTR BURN_COMMANDLINE_SWITCH_SPLASH_SCREEN = L"burn.splash.screen";
 const LPCWSTR BURN_COMMANDLINE_SWITCH_SYSTEM_COMPONENT = L"burn.system.component";
+const LPCWSTR BURN_COMMANDLINE_SWITCH_TIMING_TRACE = L"burn.timing.trace";
 const LPCWSTR BURN_COMMANDLINE_SWITCH_PREFIX = L"burn.";
 
 const LPCWSTR BURN_BUNDLE_ACTION = L"WixBundleAction";
@@ -116,6 +117,8 @@ typedef struct _BURN_ENGINE_COMMAND
 
     DWORD dwLoggingAttributes;
     LPWSTR sczLogFile;
+
+    LPWSTR sczTimingTraceFile;
 } BURN_ENGINE_COMMAND;
 
 typedef struct _BURN_REDIRECTED_LOGGING_CONTEXT
@@ -162,6 +165,8 @@ typedef struct _BURN_ENGINE_STATE
 
     BOOL fDisableRollback;
     BOOL fParallelCacheAndExecute;
+    BOOL fParallelDetect;
+    BOOL fIncrementalPlan;
 
     BURN_LOGGING log;
 
@@ -193,6 +198,7 @@ typedef struct _BURN_APPLY_CONTEXT
     DWORD cOverallProgressTicks;
     HANDLE hCacheThread;
     DWORD dwCacheCheckpoint;
+    BOOL fParallelCache;
 } BURN_APPLY_CONTEXT;
 
 typedef BOOL (STDAPICALLTYPE *PFN_CREATEPROCESSW)(
@@ -240,6 +246,10 @@ HRESULT CoreDetect(
     __in BURN_ENGINE_STATE* pEngineState,
     __in_opt HWND hwndParent
     );
+HRESULT CoreDetectPackages(
+    __in BURN_ENGINE_STATE* pEngineState,
+    __out HRESULT* phrFirstPackageFailure
+    );
 HRESULT CorePlan(
     __in BURN_ENGINE_STATE* pEngineState,
     __in BOOTSTRAPPER_ACTION action
@@ -62,6 +62,9 @@ extern "C" void DetectReset(
 
         pPackage->fCached = FALSE;
 
+        // Detect can change anything a previous plan decided from, so plan every package from scratch again.
+        PackageResetPlanCache(pPackage);
+
         if (BURN_PACKAGE_TYPE_MSI == pPackage->type)
         {
             pPackage->Msi.operation = BOOTSTRAPPER_RELATED_OPERATION_NONE;
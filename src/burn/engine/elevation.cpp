@@ -180,6 +180,7 @@ static HRESULT OnApplyInitialize(
     __in BURN_VARIABLES* pVariables,
     __in BURN_REGISTRATION* pRegistration,
     __in BURN_PACKAGES* pPackages,
+    __in BURN_PAYLOADS* pPayloads,
     __in HANDLE* phLock,
     __in BOOL* pfDisabledWindowsUpdate,
     __in BOOL* pfApplying,
@@ -232,6 +233,7 @@ static HRESULT OnCacheCompletePayload(
     );
 static HRESULT OnCacheVerifyPayload(
     __in HANDLE hPipe,
+    __in BURN_CACHE* pCache,
     __in BURN_PACKAGES* pPackages,
     __in BURN_PAYLOADS* pPayloads,
     __in BYTE* pbData,
@@ -398,6 +400,31 @@ static HRESULT ElevatedOnExecuteActionComplete(
     __in HANDLE hPipe,
     __in BOOTSTRAPPER_APPLY_RESTART restart
     );
+static HRESULT WritePackageReference(
+    __inout BYTE** ppbData,
+    __inout SIZE_T* pcbData,
+    __in_opt BURN_PACKAGE* pPackage
+    );
+static HRESULT ReadPackageReference(
+    __in BURN_PACKAGES* pPackages,
+    __in BYTE* pbData,
+    __in SIZE_T cbData,
+    __inout SIZE_T* piData,
+    __out BURN_PACKAGE** ppPackage,
+    __deref_opt_out_z_opt LPWSTR* psczId
+    );
+static HRESULT WritePayloadReference(
+    __inout BYTE** ppbData,
+    __inout SIZE_T* pcbData,
+    __in BURN_PAYLOAD* pPayload
+    );
+static HRESULT ReadPayloadReference(
+    __in BURN_PAYLOADS* pPayloads,
+    __in BYTE* pbData,
+    __in SIZE_T cbData,
+    __inout SIZE_T* piData,
+    __out BURN_PAYLOAD** ppPayload
+    );
 
 
 // function definitions
@@ -478,6 +505,7 @@ extern "C" HRESULT ElevationApplyInitialize(
     __in HANDLE hPipe,
     __in BURN_USER_EXPERIENCE* pBA,
     __in BURN_VARIABLES* pVariables,
+    __in BURN_PACKAGES* pPackages,
     __in BURN_PLAN* pPlan
     )
 {
@@ -499,6 +527,13 @@ extern "C" HRESULT ElevationApplyInitialize(
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)!pPlan->pInternalCommand->fDisableSystemRestore);
     ExitOnFailure(hr, "Failed to write system restore point action to message buffer.");
 
+    // Later messages refer to packages and payloads by their index in the manifest, so both processes must agree on it.
+    hr = BuffWriteNumber(&pbData, &cbData, pPackages->cPackages);
+    ExitOnFailure(hr, "Failed to write package count to message buffer.");
+
+    hr = BuffWriteNumber(&pbData, &cbData, pPlan->pPayloads->cPayloads);
+    ExitOnFailure(hr, "Failed to write payload count to message buffer.");
+
     hr = VariableSerialize(pVariables, FALSE, &pbData, &cbData);
     ExitOnFailure(hr, "Failed to write variables.");
 
@@ -683,7 +718,7 @@ extern "C" HRESULT ElevationCachePreparePackage(
     DWORD dwResult = 0;
 
     // Serialize message data.
-    hr = BuffWriteString(&pbData, &cbData, pPackage ? pPackage->sczId : NULL);
+    hr = WritePackageReference(&pbData, &cbData, pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     // Send message.
@@ -724,10 +759,10 @@ extern "C" HRESULT ElevationCacheCompletePayload(
     context.pvContext = pContext;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
-    hr = BuffWriteString(&pbData, &cbData, pPayload->sczKey);
+    hr = WritePayloadReference(&pbData, &cbData, pPayload);
     ExitOnFailure(hr, "Failed to write payload id to message buffer.");
 
     hr = BuffWriteString(&pbData, &cbData, wzUnverifiedPath);
@@ -768,10 +803,10 @@ extern "C" HRESULT ElevationCacheVerifyPayload(
     context.pvContext = pContext;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
-    hr = BuffWriteString(&pbData, &cbData, pPayload->sczKey);
+    hr = WritePayloadReference(&pbData, &cbData, pPayload);
     ExitOnFailure(hr, "Failed to write payload id to message buffer.");
 
     // send message
@@ -921,7 +956,7 @@ extern "C" HRESULT ElevationExecuteBundlePackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->bundlePackage.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->bundlePackage.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)pExecuteAction->bundlePackage.action);
@@ -985,7 +1020,7 @@ extern "C" HRESULT ElevationExecuteExePackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->exePackage.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->exePackage.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)pExecuteAction->exePackage.action);
@@ -1148,7 +1183,7 @@ extern "C" HRESULT ElevationExecuteMsiPackage(
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)fRollback);
     ExitOnFailure(hr, "Failed to write rollback flag to message buffer.");
 
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->msiPackage.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->msiPackage.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWritePointer(&pbData, &cbData, (DWORD_PTR)hwndParent);
@@ -1230,7 +1265,7 @@ extern "C" HRESULT ElevationExecuteMspPackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->mspTarget.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->mspTarget.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWritePointer(&pbData, &cbData, (DWORD_PTR)hwndParent);
@@ -1262,7 +1297,7 @@ extern "C" HRESULT ElevationExecuteMspPackage(
 
     for (DWORD i = 0; i < pExecuteAction->mspTarget.cOrderedPatches; ++i)
     {
-        hr = BuffWriteString(&pbData, &cbData, pExecuteAction->mspTarget.rgOrderedPatches[i].pPackage->sczId);
+        hr = WritePackageReference(&pbData, &cbData, pExecuteAction->mspTarget.rgOrderedPatches[i].pPackage);
         ExitOnFailure(hr, "Failed to write ordered patch id to message buffer.");
     }
 
@@ -1309,7 +1344,7 @@ extern "C" HRESULT ElevationExecuteMsuPackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->msuPackage.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->msuPackage.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteString(&pbData, &cbData, pExecuteAction->msuPackage.sczLogPath);
@@ -1361,7 +1396,7 @@ extern "C" HRESULT ElevationUninstallMsiCompatiblePackage(
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)fRollback);
     ExitOnFailure(hr, "Failed to write rollback flag to message buffer.");
 
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->uninstallMsiCompatiblePackage.pParentPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->uninstallMsiCompatiblePackage.pParentPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteString(&pbData, &cbData, pExecuteAction->uninstallMsiCompatiblePackage.pParentPackage->compatiblePackage.compatibleEntry.sczId);
@@ -1405,7 +1440,7 @@ extern "C" HRESULT ElevationExecutePackageProviderAction(
     DWORD dwResult = 0;
 
     // Serialize the message data.
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->packageProvider.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->packageProvider.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)fRollback);
@@ -1442,7 +1477,7 @@ extern "C" HRESULT ElevationExecutePackageDependencyAction(
     DWORD dwResult = 0;
 
     // Serialize the message data.
-    hr = BuffWriteString(&pbData, &cbData, pExecuteAction->packageDependency.pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pExecuteAction->packageDependency.pPackage);
     ExitOnFailure(hr, "Failed to write package id to message buffer.");
 
     hr = BuffWriteNumber(&pbData, &cbData, (DWORD)fRollback);
@@ -1481,7 +1516,7 @@ extern "C" HRESULT ElevationCleanCompatiblePackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pPackage);
     ExitOnFailure(hr, "Failed to write clean package id to message buffer.");
 
     hr = BuffWriteString(&pbData, &cbData, pPackage->compatiblePackage.compatibleEntry.sczId);
@@ -1514,7 +1549,7 @@ extern "C" HRESULT ElevationCleanPackage(
     DWORD dwResult = 0;
 
     // serialize message data
-    hr = BuffWriteString(&pbData, &cbData, pPackage->sczId);
+    hr = WritePackageReference(&pbData, &cbData, pPackage);
     ExitOnFailure(hr, "Failed to write clean package id to message buffer.");
 
     // send message
@@ -2184,7 +2219,7 @@ static HRESULT ProcessElevatedChildMessage(
         break;
 
     case BURN_ELEVATION_MESSAGE_TYPE_APPLY_INITIALIZE:
-        hrResult = OnApplyInitialize(pContext->hPipe, pContext->pVariables, pContext->pRegistration, pContext->pPackages, pContext->phLock, pContext->pfDisabledAutomaticUpdates, pContext->pfApplying, (BYTE*)pMsg->pvData, pMsg->cbData);
+        hrResult = OnApplyInitialize(pContext->hPipe, pContext->pVariables, pContext->pRegistration, pContext->pPackages, pContext->pPayloads, pContext->phLock, pContext->pfDisabledAutomaticUpdates, pContext->pfApplying, (BYTE*)pMsg->pvData, pMsg->cbData);
         break;
 
     case BURN_ELEVATION_MESSAGE_TYPE_APPLY_UNINITIALIZE:
@@ -2299,7 +2334,7 @@ static HRESULT ProcessElevatedChildCacheMessage(
         break;
 
     case BURN_ELEVATION_MESSAGE_TYPE_CACHE_VERIFY_PAYLOAD:
-        hrResult = OnCacheVerifyPayload(pContext->hPipe, pContext->pPackages, pContext->pPayloads, (BYTE*)pMsg->pvData, pMsg->cbData);
+        hrResult = OnCacheVerifyPayload(pContext->hPipe, pContext->pCache, pContext->pPackages, pContext->pPayloads, (BYTE*)pMsg->pvData, pMsg->cbData);
         break;
 
     case BURN_ELEVATION_MESSAGE_TYPE_CACHE_CLEANUP:
@@ -2346,6 +2381,7 @@ static HRESULT OnApplyInitialize(
     __in BURN_VARIABLES* pVariables,
     __in BURN_REGISTRATION* pRegistration,
     __in BURN_PACKAGES* pPackages,
+    __in BURN_PAYLOADS* pPayloads,
     __in HANDLE* phLock,
     __in BOOL* pfDisabledWindowsUpdate,
     __in BOOL* pfApplying,
@@ -2358,6 +2394,8 @@ static HRESULT OnApplyInitialize(
     DWORD dwAction = 0;
     DWORD dwAUAction = 0;
     DWORD dwTakeSystemRestorePoint = 0;
+    DWORD cPackages = 0;
+    DWORD cPayloads = 0;
     LPWSTR sczBundleName = NULL;
     HRESULT hrStatus = S_OK;
 
@@ -2371,6 +2409,17 @@ static HRESULT OnApplyInitialize(
     hr = BuffReadNumber(pbData, cbData, &iData, &dwTakeSystemRestorePoint);
     ExitOnFailure(hr, "Failed to read system restore point action.");
 
+    hr = BuffReadNumber(pbData, cbData, &iData, &cPackages);
+    ExitOnFailure(hr, "Failed to read package count.");
+
+    hr = BuffReadNumber(pbData, cbData, &iData, &cPayloads);
+    ExitOnFailure(hr, "Failed to read payload count.");
+
+    if (cPackages != pPackages->cPackages || cPayloads != pPayloads->cPayloads)
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Per-user and per-machine processes disagree on the manifest, packages: %u/%u, payloads: %u/%u", cPackages, pPackages->cPackages, cPayloads, pPayloads->cPayloads);
+    }
+
     hr = VariableDeserialize(pVariables, FALSE, pbData, cbData, &iData);
     ExitOnFailure(hr, "Failed to read variables.");
 
@@ -2646,19 +2695,13 @@ static HRESULT OnCachePreparePackage(
 {
     HRESULT hr = S_OK;
     SIZE_T iData = 0;
-    LPWSTR scz = NULL;
     BURN_PACKAGE* pPackage = NULL;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &scz);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, NULL);
     ExitOnFailure(hr, "Failed to read package id.");
 
-    if (scz && *scz)
-    {
-        hr = PackageFindById(pPackages, scz, &pPackage);
-        ExitOnFailure(hr, "Failed to find package: %ls", scz);
-    }
-    else
+    if (!pPackage)
     {
         hr = E_INVALIDARG;
         ExitOnRootFailure(hr, "Invalid data passed to cache prepare package.");
@@ -2668,8 +2711,6 @@ static HRESULT OnCachePreparePackage(
     ExitOnFailure(hr, "Failed to prepare cache package.");
 
 LExit:
-    ReleaseStr(scz);
-
     return hr;
 }
 
@@ -2684,31 +2725,18 @@ static HRESULT OnCacheCompletePayload(
 {
     HRESULT hr = S_OK;
     SIZE_T iData = 0;
-    LPWSTR scz = NULL;
     BURN_PACKAGE* pPackage = NULL;
     BURN_PAYLOAD* pPayload = NULL;
     LPWSTR sczUnverifiedPath = NULL;
     BOOL fMove = FALSE;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &scz);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, NULL);
     ExitOnFailure(hr, "Failed to read package id.");
 
-    if (scz && *scz)
-    {
-        hr = PackageFindById(pPackages, scz, &pPackage);
-        ExitOnFailure(hr, "Failed to find package: %ls", scz);
-    }
-
-    hr = BuffReadString(pbData, cbData, &iData, &scz);
+    hr = ReadPayloadReference(pPayloads, pbData, cbData, &iData, &pPayload);
     ExitOnFailure(hr, "Failed to read payload id.");
 
-    if (scz && *scz)
-    {
-        hr = PayloadFindById(pPayloads, scz, &pPayload);
-        ExitOnFailure(hr, "Failed to find payload: %ls", scz);
-    }
-
     hr = BuffReadString(pbData, cbData, &iData, &sczUnverifiedPath);
     ExitOnFailure(hr, "Failed to read unverified path.");
 
@@ -2728,13 +2756,13 @@ static HRESULT OnCacheCompletePayload(
 
 LExit:
     ReleaseStr(sczUnverifiedPath);
-    ReleaseStr(scz);
 
     return hr;
 }
 
 static HRESULT OnCacheVerifyPayload(
     __in HANDLE hPipe,
+    __in BURN_CACHE* pCache,
     __in BURN_PACKAGES* pPackages,
     __in BURN_PAYLOADS* pPayloads,
     __in BYTE* pbData,
@@ -2743,29 +2771,16 @@ static HRESULT OnCacheVerifyPayload(
 {
     HRESULT hr = S_OK;
     SIZE_T iData = 0;
-    LPWSTR scz = NULL;
     BURN_PACKAGE* pPackage = NULL;
     BURN_PAYLOAD* pPayload = NULL;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &scz);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, NULL);
     ExitOnFailure(hr, "Failed to read package id.");
 
-    if (scz && *scz)
-    {
-        hr = PackageFindById(pPackages, scz, &pPackage);
-        ExitOnFailure(hr, "Failed to find package: %ls", scz);
-    }
-
-    hr = BuffReadString(pbData, cbData, &iData, &scz);
+    hr = ReadPayloadReference(pPayloads, pbData, cbData, &iData, &pPayload);
     ExitOnFailure(hr, "Failed to read payload id.");
 
-    if (scz && *scz)
-    {
-        hr = PayloadFindById(pPayloads, scz, &pPayload);
-        ExitOnFailure(hr, "Failed to find payload: %ls", scz);
-    }
-
     if (pPackage && pPayload)
     {
         if (!pPackage->sczCacheFolder)
@@ -2774,7 +2789,7 @@ static HRESULT OnCacheVerifyPayload(
             ExitOnRootFailure(hr, "Cache verify payload called without starting its package.");
         }
 
-        hr = CacheVerifyPayload(pPayload, pPackage->sczCacheFolder, BurnCacheMessageHandler, ElevatedProgressRoutine, hPipe);
+        hr = CacheVerifyPayload(pCache, pPackage->fPerMachine, pPayload, pPackage->sczCacheFolder, BurnCacheMessageHandler, ElevatedProgressRoutine, hPipe);
     }
     else
     {
@@ -2784,8 +2799,6 @@ static HRESULT OnCacheVerifyPayload(
     // Nothing should be logged on failure.
 
 LExit:
-    ReleaseStr(scz);
-
     return hr;
 }
 
@@ -2940,7 +2953,7 @@ static HRESULT OnExecuteBundlePackage(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_BUNDLE_PACKAGE;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.bundlePackage.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read BUNDLE package id.");
 
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&executeAction.bundlePackage.action);
@@ -2967,12 +2980,11 @@ static HRESULT OnExecuteBundlePackage(
     hr = VariableDeserialize(pVariables, FALSE, pbData, cbData, &iData);
     ExitOnFailure(hr, "Failed to read variables.");
 
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.bundlePackage.pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(executeAction.bundlePackage.pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     if (BURN_PACKAGE_TYPE_BUNDLE != executeAction.bundlePackage.pPackage->type)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not a BUNDLE package: %ls", sczPackage);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not a BUNDLE package: %ls", executeAction.bundlePackage.pPackage->sczId);
     }
 
     // Pass the list of dependencies to ignore, if any, to the related bundle.
@@ -3031,7 +3043,7 @@ static HRESULT OnExecuteExePackage(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_EXE_PACKAGE;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.exePackage.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read EXE package id.");
 
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&executeAction.exePackage.action);
@@ -3049,12 +3061,11 @@ static HRESULT OnExecuteExePackage(
     hr = VariableDeserialize(pVariables, FALSE, pbData, cbData, &iData);
     ExitOnFailure(hr, "Failed to read variables.");
 
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.exePackage.pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(executeAction.exePackage.pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     if (BURN_PACKAGE_TYPE_EXE != executeAction.exePackage.pPackage->type)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an EXE package: %ls", sczPackage);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an EXE package: %ls", executeAction.exePackage.pPackage->sczId);
     }
 
     // Pass the list of ancestors, if any, to the related bundle.
@@ -3107,11 +3118,10 @@ static HRESULT OnExecuteMsiPackage(
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&fRollback);
     ExitOnFailure(hr, "Failed to read rollback flag.");
 
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.msiPackage.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read MSI package id.");
 
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.msiPackage.pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(executeAction.msiPackage.pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     hr = BuffReadPointer(pbData, cbData, &iData, (DWORD_PTR*)&hwndParent);
     ExitOnFailure(hr, "Failed to read parent hwnd.");
@@ -3164,7 +3174,7 @@ static HRESULT OnExecuteMsiPackage(
 
     if (BURN_PACKAGE_TYPE_MSI != executeAction.msiPackage.pPackage->type)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSI package: %ls", sczPackage);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSI package: %ls", executeAction.msiPackage.pPackage->sczId);
     }
 
     // Execute MSI package.
@@ -3199,11 +3209,10 @@ static HRESULT OnExecuteMspPackage(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_MSP_TARGET;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.mspTarget.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read MSP package id.");
 
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.mspTarget.pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(executeAction.mspTarget.pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     hr = BuffReadPointer(pbData, cbData, &iData, (DWORD_PTR*)&hwndParent);
     ExitOnFailure(hr, "Failed to read parent hwnd.");
@@ -3241,11 +3250,9 @@ static HRESULT OnExecuteMspPackage(
 
         for (DWORD i = 0; i < executeAction.mspTarget.cOrderedPatches; ++i)
         {
-            hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+            hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.mspTarget.rgOrderedPatches[i].pPackage, &sczPackage);
             ExitOnFailure(hr, "Failed to read ordered patch package id.");
-
-            hr = PackageFindById(pPackages, sczPackage, &executeAction.mspTarget.rgOrderedPatches[i].pPackage);
-            ExitOnFailure(hr, "Failed to find ordered patch package: %ls", sczPackage);
+            ExitOnNull(executeAction.mspTarget.rgOrderedPatches[i].pPackage, hr, E_NOTFOUND, "Failed to find ordered patch package: %ls", sczPackage);
         }
     }
 
@@ -3257,7 +3264,7 @@ static HRESULT OnExecuteMspPackage(
 
     if (BURN_PACKAGE_TYPE_MSP != executeAction.mspTarget.pPackage->type)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSP package: %ls", sczPackage);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSP package: %ls", executeAction.mspTarget.pPackage->sczId);
     }
 
     // Execute MSP package.
@@ -3292,7 +3299,7 @@ static HRESULT OnExecuteMsuPackage(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_MSU_PACKAGE;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.msuPackage.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read MSU package id.");
 
     hr = BuffReadString(pbData, cbData, &iData, &executeAction.msuPackage.sczLogPath);
@@ -3307,12 +3314,11 @@ static HRESULT OnExecuteMsuPackage(
     hr = BuffReadNumber(pbData, cbData, &iData, &dwStopWusaService);
     ExitOnFailure(hr, "Failed to read StopWusaService.");
 
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.msuPackage.pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(executeAction.msuPackage.pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     if (BURN_PACKAGE_TYPE_MSU != executeAction.msuPackage.pPackage->type)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSU package: %ls", sczPackage);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package is not an MSU package: %ls", executeAction.msuPackage.pPackage->sczId);
     }
 
     // execute MSU package
@@ -3353,7 +3359,7 @@ static HRESULT OnUninstallMsiCompatiblePackage(
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&fRollback);
     ExitOnFailure(hr, "Failed to read rollback flag.");
 
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackageId);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, &sczPackageId);
     ExitOnFailure(hr, "Failed to read MSI package id.");
 
     hr = BuffReadString(pbData, cbData, &iData, &sczCompatiblePackageId);
@@ -3368,21 +3374,20 @@ static HRESULT OnUninstallMsiCompatiblePackage(
     hr = VariableDeserialize(pVariables, FALSE, pbData, cbData, &iData);
     ExitOnFailure(hr, "Failed to read variables.");
 
-    hr = PackageFindById(pPackages, sczPackageId, &pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackageId);
+    ExitOnNull(pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackageId);
 
     executeAction.uninstallMsiCompatiblePackage.pParentPackage = pPackage;
     pCompatiblePackage = &pPackage->compatiblePackage;
 
     if (!pCompatiblePackage->fDetected || BURN_PACKAGE_TYPE_MSI != pCompatiblePackage->type || !pCompatiblePackage->compatibleEntry.sczId)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible MSI package", sczPackageId);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible MSI package", pPackage->sczId);
     }
 
     if (!sczCompatiblePackageId || !*sczCompatiblePackageId ||
         CSTR_EQUAL != ::CompareStringW(LOCALE_NEUTRAL, NORM_IGNORECASE, pCompatiblePackage->compatibleEntry.sczId, -1, sczCompatiblePackageId, -1))
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package with id: %ls", sczPackageId, sczCompatiblePackageId);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package with id: %ls", pPackage->sczId, sczCompatiblePackageId);
     }
 
     // Uninstall MSI compatible package.
@@ -3413,16 +3418,15 @@ static HRESULT OnExecutePackageProviderAction(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_PACKAGE_PROVIDER;
 
     // Deserialize the message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.packageProvider.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read package id from message buffer.");
 
-    // Find the package again.
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.packageProvider.pPackage);
-    if (E_NOTFOUND == hr)
+    // Anything not in the chain is a related bundle, which is only known by id.
+    if (!executeAction.packageProvider.pPackage)
     {
         hr = PackageFindRelatedById(pRelatedBundles, sczPackage, &executeAction.packageProvider.pPackage);
+        ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
     }
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
 
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&fRollback);
     ExitOnFailure(hr, "Failed to read rollback flag.");
@@ -3468,16 +3472,15 @@ static HRESULT OnExecutePackageDependencyAction(
     executeAction.type = BURN_EXECUTE_ACTION_TYPE_PACKAGE_DEPENDENCY;
 
     // Deserialize the message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &executeAction.packageDependency.pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read package id from message buffer.");
 
-    // Find the package again.
-    hr = PackageFindById(pPackages, sczPackage, &executeAction.packageDependency.pPackage);
-    if (E_NOTFOUND == hr)
+    // Anything not in the chain is a related bundle, which is only known by id.
+    if (!executeAction.packageDependency.pPackage)
     {
         hr = PackageFindRelatedById(pRelatedBundles, sczPackage, &executeAction.packageDependency.pPackage);
+        ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
     }
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
 
     hr = BuffReadNumber(pbData, cbData, &iData, (DWORD*)&fRollback);
     ExitOnFailure(hr, "Failed to read rollback flag.");
@@ -3775,26 +3778,25 @@ static HRESULT OnCleanCompatiblePackage(
     BURN_COMPATIBLE_PACKAGE* pCompatiblePackage = NULL;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackageId);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, &sczPackageId);
     ExitOnFailure(hr, "Failed to read package id.");
 
     hr = BuffReadString(pbData, cbData, &iData, &sczCompatiblePackageId);
     ExitOnFailure(hr, "Failed to read compatible package id.");
 
-    hr = PackageFindById(pPackages, sczPackageId, &pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackageId);
+    ExitOnNull(pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackageId);
 
     pCompatiblePackage = &pPackage->compatiblePackage;
 
     if (!pCompatiblePackage->fDetected || !pCompatiblePackage->compatibleEntry.sczId || !pCompatiblePackage->sczCacheId || !*pCompatiblePackage->sczCacheId)
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package to clean.", sczPackageId);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package to clean.", pPackage->sczId);
     }
 
     if (!sczCompatiblePackageId || !*sczCompatiblePackageId ||
         CSTR_EQUAL != ::CompareStringW(LOCALE_NEUTRAL, NORM_IGNORECASE, pCompatiblePackage->compatibleEntry.sczId, -1, sczCompatiblePackageId, -1))
     {
-        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package with id: %ls", sczPackageId, sczCompatiblePackageId);
+        ExitWithRootFailure(hr, E_INVALIDARG, "Package '%ls' has no compatible package with id: %ls", pPackage->sczId, sczCompatiblePackageId);
     }
 
     // Remove the package from the cache.
@@ -3820,11 +3822,10 @@ static HRESULT OnCleanPackage(
     BURN_PACKAGE* pPackage = NULL;
 
     // Deserialize message data.
-    hr = BuffReadString(pbData, cbData, &iData, &sczPackage);
+    hr = ReadPackageReference(pPackages, pbData, cbData, &iData, &pPackage, &sczPackage);
     ExitOnFailure(hr, "Failed to read package id.");
 
-    hr = PackageFindById(pPackages, sczPackage, &pPackage);
-    ExitOnFailure(hr, "Failed to find package: %ls", sczPackage);
+    ExitOnNull(pPackage, hr, E_NOTFOUND, "Failed to find package: %ls", sczPackage);
 
     // Remove the package from the cache.
     hr = CacheRemovePackage(pCache, TRUE, pPackage->sczId, pPackage->sczCacheId);
@@ -4118,3 +4119,152 @@ LExit:
 
     return hr;
 }
+
+// Packages and payloads from the manifest are sent as their 1-based index in the manifest since both
+// processes parse the same manifest. Anything else, like a related bundle, is sent as index 0 followed
+// by its id. Debug builds always send the id so the receiver can verify the index resolves to it.
+static HRESULT WritePackageReference(
+    __inout BYTE** ppbData,
+    __inout SIZE_T* pcbData,
+    __in_opt BURN_PACKAGE* pPackage
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwIndex = pPackage ? pPackage->dwManifestIndex : 0;
+
+    hr = BuffWriteNumber(ppbData, pcbData, dwIndex);
+    ExitOnFailure(hr, "Failed to write package index to message buffer.");
+
+#ifndef DEBUG
+    if (!dwIndex)
+#endif
+    {
+        hr = BuffWriteString(ppbData, pcbData, pPackage ? pPackage->sczId : NULL);
+        ExitOnFailure(hr, "Failed to write package id to message buffer.");
+    }
+
+LExit:
+    return hr;
+}
+
+static HRESULT ReadPackageReference(
+    __in BURN_PACKAGES* pPackages,
+    __in BYTE* pbData,
+    __in SIZE_T cbData,
+    __inout SIZE_T* piData,
+    __out BURN_PACKAGE** ppPackage,
+    __deref_opt_out_z_opt LPWSTR* psczId
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwIndex = 0;
+    LPWSTR sczId = NULL;
+
+    *ppPackage = NULL;
+
+    hr = BuffReadNumber(pbData, cbData, piData, &dwIndex);
+    ExitOnFailure(hr, "Failed to read package index.");
+
+    if (dwIndex > pPackages->cPackages)
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Package index is out of range: %u", dwIndex);
+    }
+
+#ifndef DEBUG
+    if (!dwIndex)
+#endif
+    {
+        hr = BuffReadString(pbData, cbData, piData, &sczId);
+        ExitOnFailure(hr, "Failed to read package id.");
+    }
+
+    if (dwIndex)
+    {
+        *ppPackage = pPackages->rgPackages + dwIndex - 1;
+
+#ifdef DEBUG
+        if (CSTR_EQUAL != ::CompareStringW(LOCALE_INVARIANT, 0, (*ppPackage)->sczId, -1, sczId, -1))
+        {
+            ExitWithRootFailure(hr, E_INVALIDDATA, "Package index %u is %ls in the per-machine process but %ls in the per-user process.", dwIndex, (*ppPackage)->sczId, sczId);
+        }
+#endif
+
+        ReleaseNullStr(sczId);
+    }
+
+    if (psczId)
+    {
+        ReleaseStr(*psczId);
+        *psczId = sczId;
+        sczId = NULL;
+    }
+
+LExit:
+    ReleaseStr(sczId);
+
+    return hr;
+}
+
+static HRESULT WritePayloadReference(
+    __inout BYTE** ppbData,
+    __inout SIZE_T* pcbData,
+    __in BURN_PAYLOAD* pPayload
+    )
+{
+    HRESULT hr = S_OK;
+
+    hr = BuffWriteNumber(ppbData, pcbData, pPayload->dwManifestIndex);
+    ExitOnFailure(hr, "Failed to write payload index to message buffer.");
+
+#ifdef DEBUG
+    hr = BuffWriteString(ppbData, pcbData, pPayload->sczKey);
+    ExitOnFailure(hr, "Failed to write payload id to message buffer.");
+#endif
+
+LExit:
+    return hr;
+}
+
+static HRESULT ReadPayloadReference(
+    __in BURN_PAYLOADS* pPayloads,
+    __in BYTE* pbData,
+    __in SIZE_T cbData,
+    __inout SIZE_T* piData,
+    __out BURN_PAYLOAD** ppPayload
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwIndex = 0;
+#ifdef DEBUG
+    LPWSTR sczKey = NULL;
+#endif
+
+    *ppPayload = NULL;
+
+    hr = BuffReadNumber(pbData, cbData, piData, &dwIndex);
+    ExitOnFailure(hr, "Failed to read payload index.");
+
+    if (!dwIndex || dwIndex > pPayloads->cPayloads)
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Payload index is out of range: %u", dwIndex);
+    }
+
+    *ppPayload = pPayloads->rgPayloads + dwIndex - 1;
+
+#ifdef DEBUG
+    hr = BuffReadString(pbData, cbData, piData, &sczKey);
+    ExitOnFailure(hr, "Failed to read payload id.");
+
+    if (CSTR_EQUAL != ::CompareStringW(LOCALE_INVARIANT, 0, (*ppPayload)->sczKey, -1, sczKey, -1))
+    {
+        ExitWithRootFailure(hr, E_INVALIDDATA, "Payload index %u is %ls in the per-machine process but %ls in the per-user process.", dwIndex, (*ppPayload)->sczKey, sczKey);
+    }
+#endif
+
+LExit:
+#ifdef DEBUG
+    ReleaseStr(sczKey);
+#endif
+
+    return hr;
+}
@@ -17,6 +17,7 @@ HRESULT ElevationApplyInitialize(
     __in HANDLE hPipe,
     __in BURN_USER_EXPERIENCE* pBA,
     __in BURN_VARIABLES* pVariables,
+    __in BURN_PACKAGES* pPackages,
     __in BURN_PLAN* pPlan
     );
 HRESULT ElevationApplyUninitialize(
@@ -91,6 +91,10 @@ extern "C" HRESULT EngineRun(
     BOOL fRegInitialized = FALSE;
     BOOL fWiuInitialized = FALSE;
     BOOL fXmlInitialized = FALSE;
+    BOOL fVerCacheInitialized = FALSE;
+    BOOL fBundleIndexInitialized = FALSE;
+    BOOL fTimingInitialized = FALSE;
+    BOOL fThrdPoolInitialized = FALSE;
     SYSTEM_INFO si = { };
     RTL_OSVERSIONINFOEXW ovix = { };
     LPWSTR sczExePath = NULL;
@@ -154,6 +158,22 @@ extern "C" HRESULT EngineRun(
     ExitOnFailure(hr, "Failed to initialize XML util.");
     fXmlInitialized = TRUE;
 
+    hr = VerCacheInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize version cache.");
+    fVerCacheInitialized = TRUE;
+
+    hr = BundleIndexInitialize();
+    ExitOnFailure(hr, "Failed to initialize bundle registration index.");
+    fBundleIndexInitialized = TRUE;
+
+    hr = TimingInitialize(engineState.internalCommand.sczTimingTraceFile);
+    ExitOnFailure(hr, "Failed to initialize timing.");
+    fTimingInitialized = TRUE;
+
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize shared thread pool.");
+    fThrdPoolInitialized = TRUE;
+
     hr = OsRtlGetVersion(&ovix);
     ExitOnFailure(hr, "Failed to get OS info.");
 
@@ -262,6 +282,11 @@ LExit:
         LogId(REPORT_STANDARD, MSG_EXITING_RUN_ONCE, FAILED(hr) ? (int)hr : *pdwExitCode);
     }
 
+    if (fTimingInitialized)
+    {
+        TimingReport();
+    }
+
     if (fLogInitialized)
     {
         // Leave the log open before calling restart so messages can be logged from there.
@@ -314,6 +339,26 @@ LExit:
 
     UninitializeEngineState(&engineState);
 
+    if (fThrdPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    if (fTimingInitialized)
+    {
+        TimingUninitialize();
+    }
+
+    if (fBundleIndexInitialized)
+    {
+        BundleIndexUninitialize();
+    }
+
+    if (fVerCacheInitialized)
+    {
+        VerCacheUninitialize();
+    }
+
     if (fXmlInitialized)
     {
         XmlUninitialize();
@@ -429,6 +474,7 @@ static void UninitializeEngineState(
     VariablesUninitialize(&pEngineState->variables);
     SearchesUninitialize(&pEngineState->searches);
     RegistrationUninitialize(&pEngineState->registration);
+    PlanUninitialize(&pEngineState->plan);
     PayloadsUninitialize(&pEngineState->payloads);
     PackagesUninitialize(&pEngineState->packages);
     SectionUninitialize(&pEngineState->section);
@@ -443,6 +489,7 @@ static void UninitializeEngineState(
     ReleaseStr(pEngineState->internalCommand.sczAncestors);
     ReleaseStr(pEngineState->internalCommand.sczIgnoreDependencies);
     ReleaseStr(pEngineState->internalCommand.sczLogFile);
+    ReleaseStr(pEngineState->internalCommand.sczTimingTraceFile);
     ReleaseStr(pEngineState->internalCommand.sczOriginalSource);
     ReleaseStr(pEngineState->internalCommand.sczEngineWorkingDirectory);
 
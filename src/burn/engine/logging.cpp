@@ -443,6 +443,185 @@ LPCSTR LoggingBurnMessageToString(
     }
 }
 
+extern "C" LPCSTR LoggingBAMessageToString(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message
+    )
+{
+    switch (message)
+    {
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCREATE:
+        return "OnCreate";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDESTROY:
+        return "OnDestroy";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONSTARTUP:
+        return "OnStartup";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONSHUTDOWN:
+        return "OnShutdown";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTBEGIN:
+        return "OnDetectBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPLETE:
+        return "OnDetectComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTFORWARDCOMPATIBLEBUNDLE:
+        return "OnDetectForwardCompatibleBundle";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTMSIFEATURE:
+        return "OnDetectMsiFeature";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPACKAGEBEGIN:
+        return "OnDetectPackageBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPACKAGECOMPLETE:
+        return "OnDetectPackageComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPATCHTARGET:
+        return "OnDetectPatchTarget";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTRELATEDBUNDLE:
+        return "OnDetectRelatedBundle";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTRELATEDMSIPACKAGE:
+        return "OnDetectRelatedMsiPackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTUPDATEBEGIN:
+        return "OnDetectUpdateBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTUPDATE:
+        return "OnDetectUpdate";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTUPDATECOMPLETE:
+        return "OnDetectUpdateComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANBEGIN:
+        return "OnPlanBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANCOMPLETE:
+        return "OnPlanComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANMSIFEATURE:
+        return "OnPlanMsiFeature";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANPACKAGEBEGIN:
+        return "OnPlanPackageBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANPACKAGECOMPLETE:
+        return "OnPlanPackageComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANPATCHTARGET:
+        return "OnPlanPatchTarget";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANRELATEDBUNDLE:
+        return "OnPlanRelatedBundle";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONAPPLYBEGIN:
+        return "OnApplyBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONELEVATEBEGIN:
+        return "OnElevateBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONELEVATECOMPLETE:
+        return "OnElevateComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPROGRESS:
+        return "OnProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONERROR:
+        return "OnError";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONREGISTERBEGIN:
+        return "OnRegisterBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONREGISTERCOMPLETE:
+        return "OnRegisterComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEBEGIN:
+        return "OnCacheBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPACKAGEBEGIN:
+        return "OnCachePackageBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREBEGIN:
+        return "OnCacheAcquireBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREPROGRESS:
+        return "OnCacheAcquireProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIRERESOLVING:
+        return "OnCacheAcquireResolving";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIRECOMPLETE:
+        return "OnCacheAcquireComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYBEGIN:
+        return "OnCacheVerifyBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYCOMPLETE:
+        return "OnCacheVerifyComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPACKAGECOMPLETE:
+        return "OnCachePackageComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHECOMPLETE:
+        return "OnCacheComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEBEGIN:
+        return "OnExecuteBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPACKAGEBEGIN:
+        return "OnExecutePackageBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPATCHTARGET:
+        return "OnExecutePatchTarget";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPROGRESS:
+        return "OnExecuteProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEMSIMESSAGE:
+        return "OnExecuteMsiMessage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEFILESINUSE:
+        return "OnExecuteFilesInUse";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPACKAGECOMPLETE:
+        return "OnExecutePackageComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTECOMPLETE:
+        return "OnExecuteComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONUNREGISTERBEGIN:
+        return "OnUnregisterBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONUNREGISTERCOMPLETE:
+        return "OnUnregisterComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONAPPLYCOMPLETE:
+        return "OnApplyComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONLAUNCHAPPROVEDEXEBEGIN:
+        return "OnLaunchApprovedExeBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONLAUNCHAPPROVEDEXECOMPLETE:
+        return "OnLaunchApprovedExeComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANMSIPACKAGE:
+        return "OnPlanMsiPackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONBEGINMSITRANSACTIONBEGIN:
+        return "OnBeginMsiTransactionBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONBEGINMSITRANSACTIONCOMPLETE:
+        return "OnBeginMsiTransactionComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCOMMITMSITRANSACTIONBEGIN:
+        return "OnCommitMsiTransactionBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCOMMITMSITRANSACTIONCOMPLETE:
+        return "OnCommitMsiTransactionComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONROLLBACKMSITRANSACTIONBEGIN:
+        return "OnRollbackMsiTransactionBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONROLLBACKMSITRANSACTIONCOMPLETE:
+        return "OnRollbackMsiTransactionComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPAUSEAUTOMATICUPDATESBEGIN:
+        return "OnPauseAutomaticUpdatesBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPAUSEAUTOMATICUPDATESCOMPLETE:
+        return "OnPauseAutomaticUpdatesComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONSYSTEMRESTOREPOINTBEGIN:
+        return "OnSystemRestorePointBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONSYSTEMRESTOREPOINTCOMPLETE:
+        return "OnSystemRestorePointComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANNEDPACKAGE:
+        return "OnPlannedPackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANFORWARDCOMPATIBLEBUNDLE:
+        return "OnPlanForwardCompatibleBundle";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYPROGRESS:
+        return "OnCacheVerifyProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHECONTAINERORPAYLOADVERIFYBEGIN:
+        return "OnCacheContainerOrPayloadVerifyBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHECONTAINERORPAYLOADVERIFYCOMPLETE:
+        return "OnCacheContainerOrPayloadVerifyComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHECONTAINERORPAYLOADVERIFYPROGRESS:
+        return "OnCacheContainerOrPayloadVerifyProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPAYLOADEXTRACTBEGIN:
+        return "OnCachePayloadExtractBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPAYLOADEXTRACTCOMPLETE:
+        return "OnCachePayloadExtractComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPAYLOADEXTRACTPROGRESS:
+        return "OnCachePayloadExtractProgress";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANROLLBACKBOUNDARY:
+        return "OnPlanRollbackBoundary";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPATIBLEMSIPACKAGE:
+        return "OnDetectCompatibleMsiPackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANCOMPATIBLEMSIPACKAGEBEGIN:
+        return "OnPlanCompatibleMsiPackageBegin";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANCOMPATIBLEMSIPACKAGECOMPLETE:
+        return "OnPlanCompatibleMsiPackageComplete";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANNEDCOMPATIBLEPACKAGE:
+        return "OnPlannedCompatiblePackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANRESTORERELATEDBUNDLE:
+        return "OnPlanRestoreRelatedBundle";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONPLANRELATEDBUNDLETYPE:
+        return "OnPlanRelatedBundleType";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONAPPLYDOWNGRADE:
+        return "OnApplyDowngrade";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPROCESSCANCEL:
+        return "OnExecuteProcessCancel";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTRELATEDBUNDLEPACKAGE:
+        return "OnDetectRelatedBundlePackage";
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPACKAGENONVITALVALIDATIONFAILURE:
+        return "OnCachePackageNonvitalValidationFailure";
+    default:
+        return "Invalid";
+    }
+}
+
 extern "C" LPCSTR LoggingActionStateToString(
     __in BOOTSTRAPPER_ACTION_STATE actionState
     )
@@ -88,6 +88,10 @@ LPCSTR LoggingBurnMessageToString(
     __in UINT message
     );
 
+LPCSTR LoggingBAMessageToString(
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message
+    );
+
 LPCSTR LoggingActionStateToString(
     __in BOOTSTRAPPER_ACTION_STATE actionState
     );
@@ -102,6 +102,20 @@ static HRESULT ParseFromXml(
         {
             ExitOnFailure(hr, "Failed to get Chain/@ParallelCache");
         }
+
+        // parse parallel detect
+        hr = XmlGetYesNoAttribute(pixnChain, L"ParallelDetect", &pEngineState->fParallelDetect);
+        if (E_NOTFOUND != hr)
+        {
+            ExitOnFailure(hr, "Failed to get Chain/@ParallelDetect");
+        }
+
+        // parse incremental plan
+        hr = XmlGetYesNoAttribute(pixnChain, L"IncrementalPlan", &pEngineState->fIncrementalPlan);
+        if (E_NOTFOUND != hr)
+        {
+            ExitOnFailure(hr, "Failed to get Chain/@IncrementalPlan");
+        }
     }
 
     // parse built-in condition
@@ -21,6 +21,7 @@ static HRESULT EvaluateActionStateConditions(
     __in_z_opt LPCWSTR sczAddLocalCondition,
     __in_z_opt LPCWSTR sczAddSourceCondition,
     __in_z_opt LPCWSTR sczAdvertiseCondition,
+    __in_opt BURN_CONDITION_INPUTS* pInputs,
     __out BOOTSTRAPPER_FEATURE_STATE* pState
     );
 static HRESULT CalculateFeatureAction(
@@ -457,7 +458,7 @@ extern "C" HRESULT MsiEngineDetectPackage(
     {
         fDetectFeatures = TRUE;
 
-        hr = VerParseVersion(sczInstalledVersion, 0, FALSE, &pVersion);
+        hr = VerCacheParseVersion(sczInstalledVersion, 0, FALSE, &pVersion);
         ExitOnFailure(hr, "Failed to parse installed version: '%ls' for ProductCode: %ls", sczInstalledVersion, pPackage->Msi.sczProductCode);
 
         if (pVersion->fInvalid)
@@ -550,7 +551,7 @@ extern "C" HRESULT MsiEngineDetectPackage(
                 }
             }
 
-            hr = VerParseVersion(sczInstalledVersion, 0, FALSE, &pVersion);
+            hr = VerCacheParseVersion(sczInstalledVersion, 0, FALSE, &pVersion);
             ExitOnFailure(hr, "Failed to parse related installed version: '%ls' for ProductCode: %ls", sczInstalledVersion, wzProductCode);
 
             if (pVersion->fInvalid)
@@ -726,7 +727,7 @@ extern "C" HRESULT MsiEngineDetectPackage(
             ReleaseVerutilVersion(pVersion);
             pVersion = NULL;
 
-            hr = VerParseVersion(wzCompatibleInstalledVersion, 0, FALSE, &pVersion);
+            hr = VerCacheParseVersion(wzCompatibleInstalledVersion, 0, FALSE, &pVersion);
             ExitOnFailure(hr, "Failed to parse dependency version: '%ls' for ProductCode: %ls", wzCompatibleInstalledVersion, wzCompatibleProductCode);
 
             if (pVersion->fInvalid)
@@ -804,11 +805,13 @@ LExit:
 extern "C" HRESULT MsiEnginePlanInitializePackage(
     __in BURN_PACKAGE* pPackage,
     __in BOOTSTRAPPER_ACTION overallAction,
+    __in BOOL fIncrementalPlan,
     __in BURN_VARIABLES* pVariables,
     __in BURN_USER_EXPERIENCE* pUserExperience
     )
 {
     HRESULT hr = S_OK;
+    BURN_CONDITION_INPUTS* pConditionInputs = fIncrementalPlan ? &pPackage->planCache.conditionInputs : NULL;
 
     if (pPackage->Msi.cFeatures)
     {
@@ -817,12 +820,18 @@ extern "C" HRESULT MsiEnginePlanInitializePackage(
         {
             BURN_MSIFEATURE* pFeature = &pPackage->Msi.rgFeatures[i];
 
-            // Evaluate feature conditions.
-            hr = EvaluateActionStateConditions(pVariables, pFeature->sczAddLocalCondition, pFeature->sczAddSourceCondition, pFeature->sczAdvertiseCondition, &pFeature->defaultRequested);
-            ExitOnFailure(hr, "Failed to evaluate requested state conditions.");
+            // Evaluate feature conditions unless nothing they read changed since the package was last planned.
+            if (!pPackage->planCache.fValid)
+            {
+                hr = EvaluateActionStateConditions(pVariables, pFeature->sczAddLocalCondition, pFeature->sczAddSourceCondition, pFeature->sczAdvertiseCondition, pConditionInputs, &pFeature->cachedDefaultRequested);
+                ExitOnFailure(hr, "Failed to evaluate requested state conditions.");
+
+                hr = EvaluateActionStateConditions(pVariables, pFeature->sczRollbackAddLocalCondition, pFeature->sczRollbackAddSourceCondition, pFeature->sczRollbackAdvertiseCondition, pConditionInputs, &pFeature->cachedExpectedState);
+                ExitOnFailure(hr, "Failed to evaluate expected state conditions.");
+            }
 
-            hr = EvaluateActionStateConditions(pVariables, pFeature->sczRollbackAddLocalCondition, pFeature->sczRollbackAddSourceCondition, pFeature->sczRollbackAdvertiseCondition, &pFeature->expectedState);
-            ExitOnFailure(hr, "Failed to evaluate expected state conditions.");
+            pFeature->defaultRequested = pFeature->cachedDefaultRequested;
+            pFeature->expectedState = pFeature->cachedExpectedState;
 
             // Remember the default feature requested state so the engine doesn't get blamed for planning the wrong thing if the BA changes it.
             pFeature->requested = pFeature->defaultRequested;
@@ -1878,6 +1887,7 @@ static HRESULT EvaluateActionStateConditions(
     __in_z_opt LPCWSTR sczAddLocalCondition,
     __in_z_opt LPCWSTR sczAddSourceCondition,
     __in_z_opt LPCWSTR sczAdvertiseCondition,
+    __in_opt BURN_CONDITION_INPUTS* pInputs,
     __out BOOTSTRAPPER_FEATURE_STATE* pState
     )
 {
@@ -1893,7 +1903,7 @@ static HRESULT EvaluateActionStateConditions(
 
     if (sczAddLocalCondition)
     {
-        hr = ConditionEvaluate(pVariables, sczAddLocalCondition, &fCondition);
+        hr = ConditionEvaluateWithInputs(pVariables, sczAddLocalCondition, pInputs, &fCondition);
         ExitOnFailure(hr, "Failed to evaluate add local condition.");
 
         if (fCondition)
@@ -1905,7 +1915,7 @@ static HRESULT EvaluateActionStateConditions(
 
     if (sczAddSourceCondition)
     {
-        hr = ConditionEvaluate(pVariables, sczAddSourceCondition, &fCondition);
+        hr = ConditionEvaluateWithInputs(pVariables, sczAddSourceCondition, pInputs, &fCondition);
         ExitOnFailure(hr, "Failed to evaluate add source condition.");
 
         if (fCondition)
@@ -1917,7 +1927,7 @@ static HRESULT EvaluateActionStateConditions(
 
     if (sczAdvertiseCondition)
     {
-        hr = ConditionEvaluate(pVariables, sczAdvertiseCondition, &fCondition);
+        hr = ConditionEvaluateWithInputs(pVariables, sczAdvertiseCondition, pInputs, &fCondition);
         ExitOnFailure(hr, "Failed to evaluate advertise condition.");
 
         if (fCondition)
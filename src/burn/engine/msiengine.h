@@ -41,6 +41,7 @@ HRESULT MsiEngineDetectCompatiblePackage(
 HRESULT MsiEnginePlanInitializePackage(
     __in BURN_PACKAGE* pPackage,
     __in BOOTSTRAPPER_ACTION overallAction,
+    __in BOOL fIncrementalPlan,
     __in BURN_VARIABLES* pVariables,
     __in BURN_USER_EXPERIENCE* pUserExperience
     );
@@ -15,6 +15,16 @@ struct POSSIBLE_TARGETPRODUCT
     MSIINSTALLCONTEXT context;
 };
 
+struct PATCH_APPLICABILITY_CONTEXT
+{
+    const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct;
+    LPWSTR sczCacheKey;
+    MSIPATCHSEQUENCEINFOW* rgPatchInfo;
+    DWORD cPatchInfo;
+    BOOL fCached;
+    HRESULT hr;
+};
+
 // internal function declarations
 
 static HRESULT GetPossibleTargetProductCodes(
@@ -29,6 +39,19 @@ static HRESULT AddPossibleTargetProduct(
     __deref_inout_ecount_opt(*pcPossibleTargetProducts) POSSIBLE_TARGETPRODUCT** prgPossibleTargetProducts,
     __inout DWORD* pcPossibleTargetProducts
     );
+static HRESULT InitializePatchApplicability(
+    __in BURN_PACKAGES* pPackages,
+    __in const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct,
+    __in PATCH_APPLICABILITY_CONTEXT* pContext
+    );
+static HRESULT CALLBACK DeterminePatchApplicability(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT CachePatchApplicability(
+    __in BURN_PACKAGES* pPackages,
+    __in PATCH_APPLICABILITY_CONTEXT* pContext
+    );
 static HRESULT AddDetectedTargetProduct(
     __in BURN_PACKAGE* pPackage,
     __in DWORD dwOrder,
@@ -124,6 +147,9 @@ extern "C" HRESULT MspEngineDetectInitialize(
     HRESULT hr = S_OK;
     POSSIBLE_TARGETPRODUCT* rgPossibleTargetProducts = NULL;
     DWORD cPossibleTargetProducts = 0;
+    PATCH_APPLICABILITY_CONTEXT* rgContexts = NULL;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
 
 #ifdef DEBUG
     // All patch info should be initialized to zero.
@@ -140,37 +166,66 @@ extern "C" HRESULT MspEngineDetectInitialize(
     hr = GetPossibleTargetProductCodes(pPackages, &rgPossibleTargetProducts, &cPossibleTargetProducts);
     ExitOnFailure(hr, "Failed to get possible target product codes.");
 
-    // Loop through possible target products, testing the collective patch applicability against each product in
-    // the appropriate context. Store the result with the appropriate patch package.
+    if (!cPossibleTargetProducts)
+    {
+        ExitFunction();
+    }
+
+    rgContexts = static_cast<PATCH_APPLICABILITY_CONTEXT*>(MemAlloc(sizeof(PATCH_APPLICABILITY_CONTEXT) * cPossibleTargetProducts, TRUE));
+    ExitOnNull(rgContexts, hr, E_OUTOFMEMORY, "Failed to allocate patch applicability contexts.");
+
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize thread pool to determine patch applicability.");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create group to determine patch applicability.");
+
+    // Test the collective patch applicability against each possible target product concurrently, unless
+    // a previous detect already did for the same cached package of the target.
     for (DWORD iSearch = 0; iSearch < cPossibleTargetProducts; ++iSearch)
     {
-        const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct = rgPossibleTargetProducts + iSearch;
+        PATCH_APPLICABILITY_CONTEXT* pContext = rgContexts + iSearch;
 
-        LogId(REPORT_STANDARD, MSG_DETECT_CALCULATE_PATCH_APPLICABILITY, pPossibleTargetProduct->wzProductCode, LoggingMsiInstallContext(pPossibleTargetProduct->context));
+        hr = InitializePatchApplicability(pPackages, rgPossibleTargetProducts + iSearch, pContext);
+        ExitOnFailure(hr, "Failed to initialize patch applicability for product: %ls", rgPossibleTargetProducts[iSearch].wzProductCode);
 
-        if (pPossibleTargetProduct->pszLocalPackage)
+        if (!pContext->fCached)
         {
-            // Ignores current machine state to determine just patch applicability.
-            // Superseded and obsolesced patches will be planned separately.
-            hr = WiuDetermineApplicablePatches(pPossibleTargetProduct->pszLocalPackage, pPackages->rgPatchInfo, pPackages->cPatchInfo);
-        }
-        else
-        {
-            hr = WiuDeterminePatchSequence(pPossibleTargetProduct->wzProductCode, NULL, pPossibleTargetProduct->context, pPackages->rgPatchInfo, pPackages->cPatchInfo);
+            hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, DeterminePatchApplicability, pContext);
+            ExitOnFailure(hr, "Failed to queue patch applicability for product: %ls", rgPossibleTargetProducts[iSearch].wzProductCode);
         }
+    }
 
-        if (SUCCEEDED(hr))
+    hr = ThrdGroupWait(hGroup, INFINITE);
+    ExitOnFailure(hr, "Failed to determine patch applicability.");
+
+    // Store the results with the appropriate patch package in the same order as the possible target products.
+    for (DWORD iSearch = 0; iSearch < cPossibleTargetProducts; ++iSearch)
+    {
+        PATCH_APPLICABILITY_CONTEXT* pContext = rgContexts + iSearch;
+        const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct = pContext->pPossibleTargetProduct;
+
+        LogId(REPORT_STANDARD, MSG_DETECT_CALCULATE_PATCH_APPLICABILITY, pPossibleTargetProduct->wzProductCode, LoggingMsiInstallContext(pPossibleTargetProduct->context));
+
+        if (SUCCEEDED(pContext->hr))
         {
+            if (pContext->fCached)
+            {
+                LogStringLine(REPORT_VERBOSE, "Reusing patch applicability from a previous detect for product: %ls", pPossibleTargetProduct->wzProductCode);
+            }
+
             for (DWORD iPatchInfo = 0; iPatchInfo < pPackages->cPatchInfo; ++iPatchInfo)
             {
-                hr = HRESULT_FROM_WIN32(pPackages->rgPatchInfo[iPatchInfo].uStatus);
+                hr = HRESULT_FROM_WIN32(pContext->rgPatchInfo[iPatchInfo].uStatus);
                 BURN_PACKAGE* pMspPackage = pPackages->rgPatchInfoToPackage[iPatchInfo];
                 Assert(BURN_PACKAGE_TYPE_MSP == pMspPackage->type);
 
                 if (S_OK == hr)
                 {
                     // Note that we do add superseded and obsolete MSP packages. Package Detect and Plan will sort them out later.
-                    hr = MspEngineAddDetectedTargetProduct(pPackages, pMspPackage, pPackages->rgPatchInfo[iPatchInfo].dwOrder, pPossibleTargetProduct->wzProductCode, pPossibleTargetProduct->context);
+                    hr = MspEngineAddDetectedTargetProduct(pPackages, pMspPackage, pContext->rgPatchInfo[iPatchInfo].dwOrder, pPossibleTargetProduct->wzProductCode, pPossibleTargetProduct->context);
                     ExitOnFailure(hr, "Failed to add target product code to package: %ls", pMspPackage->sczId);
                 }
                 else
@@ -178,16 +233,44 @@ extern "C" HRESULT MspEngineDetectInitialize(
                     LogStringLine(REPORT_DEBUG, "      0x%x: Patch applicability failed for package: %ls", hr, pMspPackage->sczId);
                 }
             }
+
+            if (!pContext->fCached && pContext->sczCacheKey)
+            {
+                hr = CachePatchApplicability(pPackages, pContext);
+                ExitOnFailure(hr, "Failed to cache patch applicability for product: %ls", pPossibleTargetProduct->wzProductCode);
+            }
         }
         else
         {
-            LogId(REPORT_STANDARD, MSG_DETECT_FAILED_CALCULATE_PATCH_APPLICABILITY, pPossibleTargetProduct->wzProductCode, LoggingMsiInstallContext(pPossibleTargetProduct->context), hr);
+            LogId(REPORT_STANDARD, MSG_DETECT_FAILED_CALCULATE_PATCH_APPLICABILITY, pPossibleTargetProduct->wzProductCode, LoggingMsiInstallContext(pPossibleTargetProduct->context), pContext->hr);
         }
 
         hr = S_OK; // always reset so we test all possible target products.
     }
 
 LExit:
+    // The workers use the contexts so they must all finish first.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    if (rgContexts)
+    {
+        for (DWORD i = 0; i < cPossibleTargetProducts; ++i)
+        {
+            ReleaseStr(rgContexts[i].sczCacheKey);
+            ReleaseMem(rgContexts[i].rgPatchInfo);
+        }
+        MemFree(rgContexts);
+    }
+
     if (rgPossibleTargetProducts)
     {
         for (DWORD i = 0; i < cPossibleTargetProducts; ++i)
@@ -1000,6 +1083,118 @@ LExit:
     return hr;
 }
 
+static HRESULT InitializePatchApplicability(
+    __in BURN_PACKAGES* pPackages,
+    __in const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct,
+    __in PATCH_APPLICABILITY_CONTEXT* pContext
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczVersion = NULL;
+    BURN_PATCH_APPLICABILITY* pCached = NULL;
+
+    pContext->pPossibleTargetProduct = pPossibleTargetProduct;
+    pContext->cPatchInfo = pPackages->cPatchInfo;
+
+    // Applicability against the cached package ignores machine state so it can be reused until the
+    // target is reinstalled or upgraded. Sequencing against the installed product cannot.
+    if (pPossibleTargetProduct->pszLocalPackage)
+    {
+        hr = WiuGetProductInfoEx(pPossibleTargetProduct->wzProductCode, NULL, pPossibleTargetProduct->context, INSTALLPROPERTY_VERSIONSTRING, &sczVersion);
+        if (SUCCEEDED(hr))
+        {
+            hr = StrAllocFormatted(&pContext->sczCacheKey, L"%ls\t%u\t%ls\t%ls", pPossibleTargetProduct->wzProductCode, pPossibleTargetProduct->context, sczVersion, pPossibleTargetProduct->pszLocalPackage);
+            ExitOnFailure(hr, "Failed to format patch applicability cache key.");
+        }
+        else
+        {
+            hr = S_OK;
+        }
+    }
+
+    if (pContext->sczCacheKey && pPackages->sdhPatchApplicability)
+    {
+        hr = DictGetValue(pPackages->sdhPatchApplicability, pContext->sczCacheKey, reinterpret_cast<void**>(&pCached));
+        if (E_NOTFOUND == hr)
+        {
+            hr = S_OK;
+        }
+        ExitOnFailure(hr, "Failed to find cached patch applicability.");
+    }
+
+    // Each target gets its own copy since the Windows Installer writes the results into it.
+    pContext->rgPatchInfo = static_cast<MSIPATCHSEQUENCEINFOW*>(MemAlloc(sizeof(MSIPATCHSEQUENCEINFOW) * pContext->cPatchInfo, FALSE));
+    ExitOnNull(pContext->rgPatchInfo, hr, E_OUTOFMEMORY, "Failed to allocate patch sequence information.");
+
+    memcpy_s(pContext->rgPatchInfo, sizeof(MSIPATCHSEQUENCEINFOW) * pContext->cPatchInfo, pCached ? pCached->rgPatchInfo : pPackages->rgPatchInfo, sizeof(MSIPATCHSEQUENCEINFOW) * pContext->cPatchInfo);
+
+    pContext->fCached = NULL != pCached;
+
+LExit:
+    ReleaseStr(sczVersion);
+
+    return hr;
+}
+
+static HRESULT CALLBACK DeterminePatchApplicability(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    UNREFERENCED_PARAMETER(hGroup);
+
+    PATCH_APPLICABILITY_CONTEXT* pContext = static_cast<PATCH_APPLICABILITY_CONTEXT*>(pvContext);
+    const POSSIBLE_TARGETPRODUCT* pPossibleTargetProduct = pContext->pPossibleTargetProduct;
+
+    if (pPossibleTargetProduct->pszLocalPackage)
+    {
+        // Ignores current machine state to determine just patch applicability.
+        // Superseded and obsolesced patches will be planned separately.
+        pContext->hr = WiuDetermineApplicablePatches(pPossibleTargetProduct->pszLocalPackage, pContext->rgPatchInfo, pContext->cPatchInfo);
+    }
+    else
+    {
+        pContext->hr = WiuDeterminePatchSequence(pPossibleTargetProduct->wzProductCode, NULL, pPossibleTargetProduct->context, pContext->rgPatchInfo, pContext->cPatchInfo);
+    }
+
+    // A target that fails is logged and skipped so it must not cancel the others.
+    return S_OK;
+}
+
+static HRESULT CachePatchApplicability(
+    __in BURN_PACKAGES* pPackages,
+    __in PATCH_APPLICABILITY_CONTEXT* pContext
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_PATCH_APPLICABILITY* pCached = NULL;
+
+    if (!pPackages->sdhPatchApplicability)
+    {
+        hr = DictCreateWithEmbeddedKey(&pPackages->sdhPatchApplicability, 5, reinterpret_cast<void**>(&pPackages->rgPatchApplicability), offsetof(BURN_PATCH_APPLICABILITY, sczKey), DICT_FLAG_NONE);
+        ExitOnFailure(hr, "Failed to create patch applicability dictionary.");
+    }
+
+    hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&pPackages->rgPatchApplicability), pPackages->cPatchApplicability + 1, sizeof(BURN_PATCH_APPLICABILITY), 5);
+    ExitOnFailure(hr, "Failed to grow array of cached patch applicability.");
+
+    pCached = pPackages->rgPatchApplicability + pPackages->cPatchApplicability;
+
+    // The cache takes ownership of the key and results.
+    pCached->sczKey = pContext->sczCacheKey;
+    pContext->sczCacheKey = NULL;
+    pCached->rgPatchInfo = pContext->rgPatchInfo;
+    pContext->rgPatchInfo = NULL;
+
+    ++pPackages->cPatchApplicability;
+
+    hr = DictAddValue(pPackages->sdhPatchApplicability, pCached);
+    ExitOnFailure(hr, "Failed to add cached patch applicability to dictionary.");
+
+LExit:
+    return hr;
+}
+
 static HRESULT AddDetectedTargetProduct(
     __in BURN_PACKAGE* pPackage,
     __in DWORD dwOrder,
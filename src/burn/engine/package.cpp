@@ -105,6 +105,10 @@ extern "C" HRESULT PackagesParseFromXml(
 
     pPackages->cPackages = cNodes;
 
+    // create dictionary for packages
+    hr = DictCreateWithEmbeddedKey(&pPackages->sdhPackages, pPackages->cPackages, reinterpret_cast<void**>(&pPackages->rgPackages), offsetof(BURN_PACKAGE, sczId), DICT_FLAG_NONE);
+    ExitOnFailure(hr, "Failed to create dictionary for packages.");
+
     // parse package elements
     for (DWORD i = 0; i < cNodes; ++i)
     {
@@ -117,6 +121,11 @@ extern "C" HRESULT PackagesParseFromXml(
         hr = XmlGetAttributeEx(pixnNode, L"Id", &pPackage->sczId);
         ExitOnRequiredXmlQueryFailure(hr, "Failed to get @Id.");
 
+        pPackage->dwManifestIndex = i + 1;
+
+        hr = DictAddValue(pPackages->sdhPackages, pPackage);
+        ExitOnFailure(hr, "Failed to add package to packages dictionary.");
+
         // @Cache
         hr = XmlGetAttributeEx(pixnNode, L"Cache", &scz);
         ExitOnOptionalXmlQueryFailure(hr, fFoundXml, "Failed to get @Cache.");
@@ -388,6 +397,8 @@ extern "C" void PackageUninitialize(
 
     ReleaseMem(pPackage->payloads.rgItems);
 
+    PackageResetPlanCache(pPackage);
+
     switch (pPackage->type)
     {
     case BURN_PACKAGE_TYPE_BUNDLE:
@@ -410,6 +421,15 @@ extern "C" void PackageUninitialize(
     PackageUninitializeCompatible(&pPackage->compatiblePackage);
 }
 
+extern "C" void PackageResetPlanCache(
+    __in BURN_PACKAGE* pPackage
+    )
+{
+    ConditionInputsUninitialize(&pPackage->planCache.conditionInputs);
+
+    memset(&pPackage->planCache, 0, sizeof(BURN_PACKAGE_PLAN_CACHE));
+}
+
 extern "C" void PackageUninitializeCompatible(
     __in BURN_COMPATIBLE_PACKAGE* pCompatiblePackage
     )
@@ -469,6 +489,18 @@ extern "C" void PackagesUninitialize(
     ReleaseMem(pPackages->rgPatchInfo);
     ReleaseMem(pPackages->rgPatchInfoToPackage);
 
+    if (pPackages->rgPatchApplicability)
+    {
+        for (DWORD i = 0; i < pPackages->cPatchApplicability; ++i)
+        {
+            ReleaseStr(pPackages->rgPatchApplicability[i].sczKey);
+            ReleaseMem(pPackages->rgPatchApplicability[i].rgPatchInfo);
+        }
+        MemFree(pPackages->rgPatchApplicability);
+    }
+    ReleaseDict(pPackages->sdhPatchApplicability);
+    ReleaseDict(pPackages->sdhPackages);
+
     // clear struct
     memset(pPackages, 0, sizeof(BURN_PACKAGES));
 }
@@ -482,6 +514,12 @@ extern "C" HRESULT PackageFindById(
     HRESULT hr = S_OK;
     BURN_PACKAGE* pPackage = NULL;
 
+    if (pPackages->sdhPackages)
+    {
+        ExitFunction1(hr = DictGetValue(pPackages->sdhPackages, wzId, reinterpret_cast<void**>(ppPackage)));
+    }
+
+    // Packages that were not parsed from the manifest have no dictionary to look in.
     for (DWORD i = 0; i < pPackages->cPackages; ++i)
     {
         pPackage = &pPackages->rgPackages[i];
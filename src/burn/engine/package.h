@@ -161,6 +161,9 @@ typedef struct _BURN_MSIFEATURE
     BOOTSTRAPPER_FEATURE_STATE requested;          // only valid during Plan.
     BOOTSTRAPPER_FEATURE_ACTION execute;           // only valid during Plan.
     BOOTSTRAPPER_FEATURE_ACTION rollback;          // only valid during Plan.
+
+    BOOTSTRAPPER_FEATURE_STATE cachedDefaultRequested; // only valid while the package's plan cache is valid.
+    BOOTSTRAPPER_FEATURE_STATE cachedExpectedState;    // only valid while the package's plan cache is valid.
 } BURN_MSIFEATURE;
 
 typedef struct _BURN_COMPATIBLE_PROVIDER_ENTRY
@@ -237,6 +240,27 @@ typedef struct _BURN_PATCH_TARGETCODE
     BURN_PATCH_TARGETCODE_TYPE type;
 } BURN_PATCH_TARGETCODE;
 
+typedef struct _BURN_PATCH_APPLICABILITY
+{
+    LPWSTR sczKey;                      // target product code, context, version and local package.
+    MSIPATCHSEQUENCEINFOW* rgPatchInfo; // status and order of every patch against the target, parallel to BURN_PACKAGES::rgPatchInfo.
+} BURN_PATCH_APPLICABILITY;
+
+// The engine's own plan decisions for a package, reused by the next Plan while nothing they were made from has changed.
+typedef struct _BURN_PACKAGE_PLAN_CACHE
+{
+    BOOL fValid;
+    DWORD dwVariablesChangeStamp; // BURN_VARIABLES::dwChangeStamp when the conditions were last evaluated or found unchanged.
+    BOOTSTRAPPER_ACTION action;
+    BOOTSTRAPPER_RELATION_TYPE relationType;
+    BOOTSTRAPPER_PACKAGE_STATE currentState;
+    BURN_CONDITION_INPUTS conditionInputs;
+
+    BOOTSTRAPPER_PACKAGE_CONDITION_RESULT installCondition;
+    BOOTSTRAPPER_PACKAGE_CONDITION_RESULT repairCondition;
+    BOOTSTRAPPER_REQUEST_STATE defaultRequested;
+} BURN_PACKAGE_PLAN_CACHE;
+
 typedef struct _BURN_COMPATIBLE_PACKAGE
 {
     BOOL fDetected;
@@ -261,6 +285,7 @@ typedef struct _BURN_COMPATIBLE_PACKAGE
 typedef struct _BURN_PACKAGE
 {
     LPWSTR sczId;
+    DWORD dwManifestIndex;              // 1-based position in the chain so the elevated process can find the package without its id, 0 when not in the chain.
 
     LPWSTR sczLogPathVariable;          // name of the variable that will be set to the log path.
     LPWSTR sczRollbackLogPathVariable;  // name of the variable that will be set to the rollback path.
@@ -311,6 +336,8 @@ typedef struct _BURN_PACKAGE
     BURN_PACKAGE_REGISTRATION_STATE expectedInstallRegistrationState;// only valid after Plan.
     BURN_PACKAGE_REGISTRATION_STATE transactionRegistrationState;    // only valid during Apply inside an MSI transaction.
 
+    BURN_PACKAGE_PLAN_CACHE planCache;          // kept across Plan when the chain plans incrementally, cleared by Detect.
+
     BURN_PAYLOAD_GROUP payloads;
 
     BURN_DEPENDENCY_PROVIDER* rgDependencyProviders;
@@ -436,6 +463,7 @@ typedef struct _BURN_PACKAGES
 
     BURN_PACKAGE* rgPackages;
     DWORD cPackages;
+    STRINGDICT_HANDLE sdhPackages; // value is BURN_PACKAGE*
 
     BURN_PATCH_TARGETCODE* rgPatchTargetCodes;
     DWORD cPatchTargetCodes;
@@ -444,6 +472,10 @@ typedef struct _BURN_PACKAGES
     BURN_PACKAGE** rgPatchInfoToPackage; // direct lookup from patch information to the (MSP) package it describes.
                                          // Thus this array is the exact same size as rgPatchInfo.
     DWORD cPatchInfo;
+
+    BURN_PATCH_APPLICABILITY* rgPatchApplicability; // kept across detects since it only depends on the target's cached package.
+    DWORD cPatchApplicability;
+    STRINGDICT_HANDLE sdhPatchApplicability; // value is BURN_PATCH_APPLICABILITY*
 } BURN_PACKAGES;
 
 
@@ -457,6 +489,9 @@ HRESULT PackagesParseFromXml(
 void PackageUninitialize(
     __in BURN_PACKAGE* pPackage
     );
+void PackageResetPlanCache(
+    __in BURN_PACKAGE* pPackage
+    );
 void PackageUninitializeCompatible(
     __in BURN_COMPATIBLE_PACKAGE* pCompatiblePackage
     );
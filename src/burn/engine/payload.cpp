@@ -61,6 +61,8 @@ extern "C" HRESULT PayloadsParseFromXml(
         hr = XmlGetAttributeEx(pixnNode, L"Id", &pPayload->sczKey);
         ExitOnRequiredXmlQueryFailure(hr, "Failed to get @Id.");
 
+        pPayload->dwManifestIndex = i + 1;
+
         // @FilePath
         hr = XmlGetAttributeEx(pixnNode, L"FilePath", &pPayload->sczFilePath);
         ExitOnRequiredXmlQueryFailure(hr, "Failed to get @FilePath.");
@@ -37,6 +37,7 @@ enum BURN_PAYLOAD_VERIFICATION
 typedef struct _BURN_PAYLOAD
 {
     LPWSTR sczKey;
+    DWORD dwManifestIndex; // 1-based position in the manifest so the elevated process can find the payload without its id.
     BURN_PAYLOAD_PACKAGING packaging;
     BOOL fLayoutOnly;
     DWORD64 qwFileSize;
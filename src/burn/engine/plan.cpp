@@ -4,6 +4,12 @@
 
 #define PlanDumpLevel REPORT_DEBUG
 
+// Rough number of actions planned per package, used to size the action arrays before planning.
+static const DWORD PLAN_EXECUTE_ACTIONS_PER_PACKAGE = 6;
+static const DWORD PLAN_ROLLBACK_ACTIONS_PER_PACKAGE = 4;
+static const DWORD PLAN_CACHE_ACTIONS_PER_PACKAGE = 6;
+static const DWORD PLAN_ACTION_GROWTH = 5;
+
 // internal struct definitions
 
 
@@ -13,6 +19,21 @@ static void PlannedExecutePackage(
     __in BURN_PLAN* pPlan,
     __in BURN_PACKAGE* pPackage
     );
+static void ReleasePlan(
+    __in BURN_PLAN* pPlan,
+    __in BOOL fKeepActionStorage
+    );
+static void ReleaseActionStorage(
+    __in BOOL fKeep,
+    __inout LPVOID* ppvActions
+    );
+static HRESULT ReserveActions(
+    __in BURN_PLAN* pPlan,
+    __in DWORD cPackages
+    );
+static DWORD GetActionGrowth(
+    __in DWORD cActions
+    );
 static void UninitializeRegistrationAction(
     __in BURN_DEPENDENT_REGISTRATION_ACTION* pAction
     );
@@ -48,6 +69,12 @@ static HRESULT InitializePackage(
     __in BURN_VARIABLES* pVariables,
     __in BURN_PACKAGE* pPackage
     );
+static HRESULT CanReusePlanCache(
+    __in BURN_PLAN* pPlan,
+    __in BURN_VARIABLES* pVariables,
+    __in BURN_PACKAGE* pPackage,
+    __out BOOL* pfReuse
+    );
 static HRESULT ProcessPackage(
     __in BOOL fBundlePerMachine,
     __in BURN_USER_EXPERIENCE* pUX,
@@ -149,106 +176,18 @@ static BOOL ForceCache(
 
 extern "C" void PlanReset(
     __in BURN_PLAN* pPlan,
-    __in BURN_VARIABLES* pVariables,
     __in BURN_CONTAINERS* pContainers,
     __in BURN_PACKAGES* pPackages,
     __in BURN_PAYLOAD_GROUP* pLayoutPayloads
     )
 {
-    ReleaseNullStr(pPlan->sczLayoutDirectory);
-    PackageUninitialize(&pPlan->forwardCompatibleBundle);
-
-    if (pPlan->rgRegistrationActions)
-    {
-        for (DWORD i = 0; i < pPlan->cRegistrationActions; ++i)
-        {
-            UninitializeRegistrationAction(&pPlan->rgRegistrationActions[i]);
-        }
-        MemFree(pPlan->rgRegistrationActions);
-    }
-
-    if (pPlan->rgRollbackRegistrationActions)
-    {
-        for (DWORD i = 0; i < pPlan->cRollbackRegistrationActions; ++i)
-        {
-            UninitializeRegistrationAction(&pPlan->rgRollbackRegistrationActions[i]);
-        }
-        MemFree(pPlan->rgRollbackRegistrationActions);
-    }
-
-    if (pPlan->rgCacheActions)
-    {
-        for (DWORD i = 0; i < pPlan->cCacheActions; ++i)
-        {
-            UninitializeCacheAction(&pPlan->rgCacheActions[i]);
-        }
-        MemFree(pPlan->rgCacheActions);
-    }
-
-    if (pPlan->rgExecuteActions)
-    {
-        for (DWORD i = 0; i < pPlan->cExecuteActions; ++i)
-        {
-            PlanUninitializeExecuteAction(&pPlan->rgExecuteActions[i]);
-        }
-        MemFree(pPlan->rgExecuteActions);
-    }
-
-    if (pPlan->rgRollbackActions)
-    {
-        for (DWORD i = 0; i < pPlan->cRollbackActions; ++i)
-        {
-            PlanUninitializeExecuteAction(&pPlan->rgRollbackActions[i]);
-        }
-        MemFree(pPlan->rgRollbackActions);
-    }
-
-    if (pPlan->rgRestoreRelatedBundleActions)
-    {
-        for (DWORD i = 0; i < pPlan->cRestoreRelatedBundleActions; ++i)
-        {
-            PlanUninitializeExecuteAction(&pPlan->rgRestoreRelatedBundleActions[i]);
-        }
-        MemFree(pPlan->rgRestoreRelatedBundleActions);
-    }
-
-    if (pPlan->rgCleanActions)
-    {
-        // Nothing needs to be freed inside clean actions today.
-        MemFree(pPlan->rgCleanActions);
-    }
-
-    if (pPlan->rgPlannedProviders)
-    {
-        ReleaseDependencyArray(pPlan->rgPlannedProviders, pPlan->cPlannedProviders);
-    }
-
-    if (pPlan->rgContainerProgress)
-    {
-        MemFree(pPlan->rgContainerProgress);
-    }
-
-    if (pPlan->shContainerProgress)
-    {
-        ReleaseDict(pPlan->shContainerProgress);
-    }
-
-    if (pPlan->rgPayloadProgress)
-    {
-        MemFree(pPlan->rgPayloadProgress);
-    }
-
-    if (pPlan->shPayloadProgress)
-    {
-        ReleaseDict(pPlan->shPayloadProgress);
-    }
-
     if (pPlan->pPayloads)
     {
         ResetPlannedPayloadsState(pPlan->pPayloads);
     }
 
-    memset(pPlan, 0, sizeof(BURN_PLAN));
+    // The BA may re-plan many times so keep the action arrays for the next plan.
+    ReleasePlan(pPlan, TRUE);
 
     if (pContainers->rgContainers)
     {
@@ -277,8 +216,13 @@ extern "C" void PlanReset(
             ResetPlannedRollbackBoundaryState(&pPackages->rgRollbackBoundaries[i]);
         }
     }
+}
 
-    PlanSetVariables(BOOTSTRAPPER_ACTION_UNKNOWN, pVariables);
+extern "C" void PlanUninitialize(
+    __in BURN_PLAN* pPlan
+    )
+{
+    ReleasePlan(pPlan, FALSE);
 }
 
 extern "C" void PlanUninitializeExecuteAction(
@@ -561,8 +505,12 @@ extern "C" HRESULT PlanPackages(
 {
     HRESULT hr = S_OK;
 
+    hr = ReserveActions(pPlan, pPackages->cPackages);
+    ExitOnFailure(hr, "Failed to reserve plan actions.");
+
     hr = PlanPackagesHelper(pPackages->rgPackages, pPackages->cPackages, pUX, pPlan, pLog, pVariables);
 
+LExit:
     return hr;
 }
 
@@ -823,6 +771,7 @@ static HRESULT PlanPackagesHelper(
     BOOL fBundlePerMachine = pPlan->fPerMachine; // bundle is per-machine if plan starts per-machine.
     BURN_ROLLBACK_BOUNDARY* pRollbackBoundary = NULL;
     BOOL fReverseOrder = BOOTSTRAPPER_ACTION_UNINSTALL == pPlan->action || BOOTSTRAPPER_ACTION_UNSAFE_UNINSTALL == pPlan->action;
+    BURN_TIMER timer = { };
 
     // Initialize the packages.
     for (DWORD i = 0; i < cPackages; ++i)
@@ -853,8 +802,12 @@ static HRESULT PlanPackagesHelper(
         DWORD iPackage = fReverseOrder ? cPackages - 1 - i : i;
         BURN_PACKAGE* pPackage = rgPackages + iPackage;
 
+        TimingStart(&timer);
+
         hr = ProcessPackage(fBundlePerMachine, pUX, pPlan, pPackage, pLog, pVariables, &pRollbackBoundary);
         ExitOnFailure(hr, "Failed to process package.");
+
+        TimingStop(&timer, BURN_TIMING_CATEGORY_PACKAGE, L"PlanPackage", pPackage->sczId);
     }
 
     // If we still have an open rollback boundary, complete it.
@@ -881,9 +834,13 @@ static HRESULT PlanPackagesHelper(
     }
 
     // Remove unnecessary actions.
+    TimingStart(&timer);
+
     hr = PlanFinalizeActions(pPlan);
     ExitOnFailure(hr, "Failed to remove unnecessary actions from plan.");
 
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"PlanFinalizeActions", NULL);
+
     CalculateExpectedRegistrationStates(rgPackages, cPackages);
 
     // Let the BA know the actions that were planned.
@@ -915,8 +872,10 @@ static HRESULT InitializePackage(
     BOOTSTRAPPER_PACKAGE_CONDITION_RESULT installCondition = BOOTSTRAPPER_PACKAGE_CONDITION_DEFAULT;
     BOOTSTRAPPER_PACKAGE_CONDITION_RESULT repairCondition = BOOTSTRAPPER_PACKAGE_CONDITION_DEFAULT;
     BOOL fEvaluatedCondition = FALSE;
+    BOOL fReuse = FALSE;
     BOOL fBeginCalled = FALSE;
     BOOTSTRAPPER_RELATION_TYPE relationType = pPlan->pCommand->relationType;
+    BURN_CONDITION_INPUTS* pConditionInputs = pPlan->fIncrementalPlan ? &pPackage->planCache.conditionInputs : NULL;
 
     if (BURN_PACKAGE_TYPE_EXE == pPackage->type && pPackage->Exe.fPseudoPackage)
     {
@@ -934,25 +893,53 @@ static HRESULT InitializePackage(
         pPackage->expectedInstallRegistrationState = pPackage->installRegistrationState;
     }
 
-    if (pPackage->sczInstallCondition && *pPackage->sczInstallCondition)
+    if (pPlan->fIncrementalPlan)
     {
-        hr = ConditionEvaluate(pVariables, pPackage->sczInstallCondition, &fEvaluatedCondition);
-        ExitOnFailure(hr, "Failed to evaluate install condition.");
-
-        installCondition = fEvaluatedCondition ? BOOTSTRAPPER_PACKAGE_CONDITION_TRUE : BOOTSTRAPPER_PACKAGE_CONDITION_FALSE;
+        hr = CanReusePlanCache(pPlan, pVariables, pPackage, &fReuse);
+        ExitOnFailure(hr, "Failed to check whether the previous plan of package can be reused: %ls", pPackage->sczId);
     }
 
-    if (pPackage->sczRepairCondition && *pPackage->sczRepairCondition)
+    if (fReuse)
+    {
+        LogStringLine(REPORT_VERBOSE, "Reusing conditions and default requested state of package: %ls", pPackage->sczId);
+    }
+    else
     {
-        hr = ConditionEvaluate(pVariables, pPackage->sczRepairCondition, &fEvaluatedCondition);
-        ExitOnFailure(hr, "Failed to evaluate repair condition.");
+        // Without incremental planning the cache only holds this plan's results and is never reused.
+        PackageResetPlanCache(pPackage);
+
+        pPackage->planCache.dwVariablesChangeStamp = pVariables->dwChangeStamp;
+        pPackage->planCache.action = pPlan->action;
+        pPackage->planCache.relationType = relationType;
+        pPackage->planCache.currentState = pPackage->currentState;
+        pPackage->planCache.installCondition = BOOTSTRAPPER_PACKAGE_CONDITION_DEFAULT;
+        pPackage->planCache.repairCondition = BOOTSTRAPPER_PACKAGE_CONDITION_DEFAULT;
+
+        if (pPackage->sczInstallCondition && *pPackage->sczInstallCondition)
+        {
+            hr = ConditionEvaluateWithInputs(pVariables, pPackage->sczInstallCondition, pConditionInputs, &fEvaluatedCondition);
+            ExitOnFailure(hr, "Failed to evaluate install condition.");
+
+            pPackage->planCache.installCondition = fEvaluatedCondition ? BOOTSTRAPPER_PACKAGE_CONDITION_TRUE : BOOTSTRAPPER_PACKAGE_CONDITION_FALSE;
+        }
+
+        if (pPackage->sczRepairCondition && *pPackage->sczRepairCondition)
+        {
+            hr = ConditionEvaluateWithInputs(pVariables, pPackage->sczRepairCondition, pConditionInputs, &fEvaluatedCondition);
+            ExitOnFailure(hr, "Failed to evaluate repair condition.");
+
+            pPackage->planCache.repairCondition = fEvaluatedCondition ? BOOTSTRAPPER_PACKAGE_CONDITION_TRUE : BOOTSTRAPPER_PACKAGE_CONDITION_FALSE;
+        }
 
-        repairCondition = fEvaluatedCondition ? BOOTSTRAPPER_PACKAGE_CONDITION_TRUE : BOOTSTRAPPER_PACKAGE_CONDITION_FALSE;
+        hr = PlanDefaultPackageRequestState(pPackage->type, pPackage->currentState, pPlan->action, pPackage->planCache.installCondition, pPackage->planCache.repairCondition, relationType, &pPackage->planCache.defaultRequested);
+        ExitOnFailure(hr, "Failed to set default package state.");
     }
 
+    installCondition = pPackage->planCache.installCondition;
+    repairCondition = pPackage->planCache.repairCondition;
+
     // Remember the default requested state so the engine doesn't get blamed for planning the wrong thing if the BA changes it.
-    hr = PlanDefaultPackageRequestState(pPackage->type, pPackage->currentState, pPlan->action, installCondition, repairCondition, relationType, &pPackage->defaultRequested);
-    ExitOnFailure(hr, "Failed to set default package state.");
+    pPackage->defaultRequested = pPackage->planCache.defaultRequested;
 
     pPackage->requested = pPackage->defaultRequested;
     fBeginCalled = TRUE;
@@ -962,11 +949,19 @@ static HRESULT InitializePackage(
 
     if (BURN_PACKAGE_TYPE_MSI == pPackage->type)
     {
-        hr = MsiEnginePlanInitializePackage(pPackage, pPlan->action, pVariables, pUX);
+        hr = MsiEnginePlanInitializePackage(pPackage, pPlan->action, pPlan->fIncrementalPlan, pVariables, pUX);
         ExitOnFailure(hr, "Failed to initialize plan package: %ls", pPackage->sczId);
     }
 
+    // Only now is everything the engine decided for the package remembered.
+    pPackage->planCache.fValid = pPlan->fIncrementalPlan;
+
 LExit:
+    if (FAILED(hr))
+    {
+        PackageResetPlanCache(pPackage);
+    }
+
     if (fBeginCalled)
     {
         BACallbackOnPlanPackageComplete(pUX, pPackage->sczId, hr, pPackage->requested);
@@ -975,6 +970,46 @@ LExit:
     return hr;
 }
 
+static HRESULT CanReusePlanCache(
+    __in BURN_PLAN* pPlan,
+    __in BURN_VARIABLES* pVariables,
+    __in BURN_PACKAGE* pPackage,
+    __out BOOL* pfReuse
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_PACKAGE_PLAN_CACHE* pCache = &pPackage->planCache;
+    BOOL fChanged = TRUE;
+
+    *pfReuse = FALSE;
+
+    if (!pCache->fValid || pCache->action != pPlan->action || pCache->relationType != pPlan->pCommand->relationType || pCache->currentState != pPackage->currentState)
+    {
+        ExitFunction();
+    }
+
+    // No variable has changed since the conditions were last checked.
+    if (!pCache->conditionInputs.fUntracked && pCache->dwVariablesChangeStamp == pVariables->dwChangeStamp)
+    {
+        ExitFunction1(*pfReuse = TRUE);
+    }
+
+    hr = ConditionInputsChanged(pVariables, &pCache->conditionInputs, &fChanged);
+    ExitOnFailure(hr, "Failed to check condition inputs.");
+
+    // The conditions are still current as of now, so the next plan can take the fast path
+    // unless something changes in between.
+    if (!fChanged)
+    {
+        pCache->dwVariablesChangeStamp = pVariables->dwChangeStamp;
+    }
+
+    *pfReuse = !fChanged;
+
+LExit:
+    return hr;
+}
+
 static HRESULT ProcessPackage(
     __in BOOL fBundlePerMachine,
     __in BURN_USER_EXPERIENCE* pUX,
@@ -1872,7 +1907,7 @@ extern "C" HRESULT PlanInsertExecuteAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemInsertIntoArray((void**)&pPlan->rgExecuteActions, dwIndex, 1, pPlan->cExecuteActions + 1, sizeof(BURN_EXECUTE_ACTION), 5);
+    hr = MemInsertIntoArray((void**)&pPlan->rgExecuteActions, dwIndex, 1, pPlan->cExecuteActions, sizeof(BURN_EXECUTE_ACTION), GetActionGrowth(pPlan->cExecuteActions));
     ExitOnFailure(hr, "Failed to grow plan's array of execute actions.");
 
     *ppExecuteAction = pPlan->rgExecuteActions + dwIndex;
@@ -1890,7 +1925,7 @@ extern "C" HRESULT PlanInsertRollbackAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemInsertIntoArray((void**)&pPlan->rgRollbackActions, dwIndex, 1, pPlan->cRollbackActions + 1, sizeof(BURN_EXECUTE_ACTION), 5);
+    hr = MemInsertIntoArray((void**)&pPlan->rgRollbackActions, dwIndex, 1, pPlan->cRollbackActions, sizeof(BURN_EXECUTE_ACTION), GetActionGrowth(pPlan->cRollbackActions));
     ExitOnFailure(hr, "Failed to grow plan's array of rollback actions.");
 
     *ppRollbackAction = pPlan->rgRollbackActions + dwIndex;
@@ -1907,7 +1942,7 @@ extern "C" HRESULT PlanAppendExecuteAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySize((void**)&pPlan->rgExecuteActions, pPlan->cExecuteActions + 1, sizeof(BURN_EXECUTE_ACTION), 5);
+    hr = MemEnsureArraySize((void**)&pPlan->rgExecuteActions, pPlan->cExecuteActions + 1, sizeof(BURN_EXECUTE_ACTION), GetActionGrowth(pPlan->cExecuteActions));
     ExitOnFailure(hr, "Failed to grow plan's array of execute actions.");
 
     *ppExecuteAction = pPlan->rgExecuteActions + pPlan->cExecuteActions;
@@ -1924,7 +1959,7 @@ extern "C" HRESULT PlanAppendRollbackAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySize((void**)&pPlan->rgRollbackActions, pPlan->cRollbackActions + 1, sizeof(BURN_EXECUTE_ACTION), 5);
+    hr = MemEnsureArraySize((void**)&pPlan->rgRollbackActions, pPlan->cRollbackActions + 1, sizeof(BURN_EXECUTE_ACTION), GetActionGrowth(pPlan->cRollbackActions));
     ExitOnFailure(hr, "Failed to grow plan's array of rollback actions.");
 
     *ppRollbackAction = pPlan->rgRollbackActions + pPlan->cRollbackActions;
@@ -2093,6 +2128,159 @@ static void UninitializeCacheAction(
     }
 }
 
+static void ReleasePlan(
+    __in BURN_PLAN* pPlan,
+    __in BOOL fKeepActionStorage
+    )
+{
+    BURN_DEPENDENT_REGISTRATION_ACTION* rgRegistrationActions = NULL;
+    BURN_DEPENDENT_REGISTRATION_ACTION* rgRollbackRegistrationActions = NULL;
+    BURN_CACHE_ACTION* rgCacheActions = NULL;
+    BURN_CACHE_ACTION* rgRollbackCacheActions = NULL;
+    BURN_EXECUTE_ACTION* rgExecuteActions = NULL;
+    BURN_EXECUTE_ACTION* rgRollbackActions = NULL;
+    BURN_EXECUTE_ACTION* rgRestoreRelatedBundleActions = NULL;
+    BURN_CLEAN_ACTION* rgCleanActions = NULL;
+
+    ReleaseNullStr(pPlan->sczLayoutDirectory);
+    PackageUninitialize(&pPlan->forwardCompatibleBundle);
+
+    if (pPlan->rgRegistrationActions)
+    {
+        for (DWORD i = 0; i < pPlan->cRegistrationActions; ++i)
+        {
+            UninitializeRegistrationAction(&pPlan->rgRegistrationActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgRegistrationActions));
+    }
+
+    if (pPlan->rgRollbackRegistrationActions)
+    {
+        for (DWORD i = 0; i < pPlan->cRollbackRegistrationActions; ++i)
+        {
+            UninitializeRegistrationAction(&pPlan->rgRollbackRegistrationActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgRollbackRegistrationActions));
+    }
+
+    if (pPlan->rgCacheActions)
+    {
+        for (DWORD i = 0; i < pPlan->cCacheActions; ++i)
+        {
+            UninitializeCacheAction(&pPlan->rgCacheActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgCacheActions));
+    }
+
+    if (pPlan->rgRollbackCacheActions)
+    {
+        for (DWORD i = 0; i < pPlan->cRollbackCacheActions; ++i)
+        {
+            UninitializeCacheAction(&pPlan->rgRollbackCacheActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgRollbackCacheActions));
+    }
+
+    if (pPlan->rgExecuteActions)
+    {
+        for (DWORD i = 0; i < pPlan->cExecuteActions; ++i)
+        {
+            PlanUninitializeExecuteAction(&pPlan->rgExecuteActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgExecuteActions));
+    }
+
+    if (pPlan->rgRollbackActions)
+    {
+        for (DWORD i = 0; i < pPlan->cRollbackActions; ++i)
+        {
+            PlanUninitializeExecuteAction(&pPlan->rgRollbackActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgRollbackActions));
+    }
+
+    if (pPlan->rgRestoreRelatedBundleActions)
+    {
+        for (DWORD i = 0; i < pPlan->cRestoreRelatedBundleActions; ++i)
+        {
+            PlanUninitializeExecuteAction(&pPlan->rgRestoreRelatedBundleActions[i]);
+        }
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgRestoreRelatedBundleActions));
+    }
+
+    if (pPlan->rgCleanActions)
+    {
+        // Nothing needs to be freed inside clean actions today.
+        ReleaseActionStorage(fKeepActionStorage, reinterpret_cast<LPVOID*>(&pPlan->rgCleanActions));
+    }
+
+    if (pPlan->rgPlannedProviders)
+    {
+        ReleaseDependencyArray(pPlan->rgPlannedProviders, pPlan->cPlannedProviders);
+    }
+
+    if (pPlan->rgContainerProgress)
+    {
+        MemFree(pPlan->rgContainerProgress);
+    }
+
+    if (pPlan->shContainerProgress)
+    {
+        ReleaseDict(pPlan->shContainerProgress);
+    }
+
+    if (pPlan->rgPayloadProgress)
+    {
+        MemFree(pPlan->rgPayloadProgress);
+    }
+
+    if (pPlan->shPayloadProgress)
+    {
+        ReleaseDict(pPlan->shPayloadProgress);
+    }
+
+    if (fKeepActionStorage)
+    {
+        rgRegistrationActions = pPlan->rgRegistrationActions;
+        rgRollbackRegistrationActions = pPlan->rgRollbackRegistrationActions;
+        rgCacheActions = pPlan->rgCacheActions;
+        rgRollbackCacheActions = pPlan->rgRollbackCacheActions;
+        rgExecuteActions = pPlan->rgExecuteActions;
+        rgRollbackActions = pPlan->rgRollbackActions;
+        rgRestoreRelatedBundleActions = pPlan->rgRestoreRelatedBundleActions;
+        rgCleanActions = pPlan->rgCleanActions;
+    }
+
+    memset(pPlan, 0, sizeof(BURN_PLAN));
+
+    if (fKeepActionStorage)
+    {
+        pPlan->rgRegistrationActions = rgRegistrationActions;
+        pPlan->rgRollbackRegistrationActions = rgRollbackRegistrationActions;
+        pPlan->rgCacheActions = rgCacheActions;
+        pPlan->rgRollbackCacheActions = rgRollbackCacheActions;
+        pPlan->rgExecuteActions = rgExecuteActions;
+        pPlan->rgRollbackActions = rgRollbackActions;
+        pPlan->rgRestoreRelatedBundleActions = rgRestoreRelatedBundleActions;
+        pPlan->rgCleanActions = rgCleanActions;
+    }
+}
+
+static void ReleaseActionStorage(
+    __in BOOL fKeep,
+    __inout LPVOID* ppvActions
+    )
+{
+    if (fKeep)
+    {
+        memset(*ppvActions, 0, MemSize(*ppvActions));
+    }
+    else
+    {
+        ReleaseNullMem(*ppvActions);
+    }
+}
+
 static void ResetPlannedContainerState(
     __in BURN_CONTAINER* pContainer
     )
@@ -2279,7 +2467,7 @@ static HRESULT AddRegistrationAction(
     BURN_DEPENDENT_REGISTRATION_ACTION* pAction = NULL;
 
     // Create forward registration action.
-    hr = MemEnsureArraySize((void**)&pPlan->rgRegistrationActions, pPlan->cRegistrationActions + 1, sizeof(BURN_DEPENDENT_REGISTRATION_ACTION), 5);
+    hr = MemEnsureArraySize((void**)&pPlan->rgRegistrationActions, pPlan->cRegistrationActions + 1, sizeof(BURN_DEPENDENT_REGISTRATION_ACTION), GetActionGrowth(pPlan->cRegistrationActions));
     ExitOnFailure(hr, "Failed to grow plan's array of registration actions.");
 
     pAction = pPlan->rgRegistrationActions + pPlan->cRegistrationActions;
@@ -2294,7 +2482,7 @@ static HRESULT AddRegistrationAction(
     ExitOnFailure(hr, "Failed to copy dependent provider key to registration action.");
 
     // Create rollback registration action.
-    hr = MemEnsureArraySize((void**)&pPlan->rgRollbackRegistrationActions, pPlan->cRollbackRegistrationActions + 1, sizeof(BURN_DEPENDENT_REGISTRATION_ACTION), 5);
+    hr = MemEnsureArraySize((void**)&pPlan->rgRollbackRegistrationActions, pPlan->cRollbackRegistrationActions + 1, sizeof(BURN_DEPENDENT_REGISTRATION_ACTION), GetActionGrowth(pPlan->cRollbackRegistrationActions));
     ExitOnFailure(hr, "Failed to grow plan's array of rollback registration actions.");
 
     pAction = pPlan->rgRollbackRegistrationActions + pPlan->cRollbackRegistrationActions;
@@ -2438,6 +2626,41 @@ static DWORD GetNextCheckpointId(
     return ++pPlan->dwNextCheckpointId;
 }
 
+// Sizes the action arrays for the packages up front so planning them does not keep reallocating.
+static HRESULT ReserveActions(
+    __in BURN_PLAN* pPlan,
+    __in DWORD cPackages
+    )
+{
+    HRESULT hr = S_OK;
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgExecuteActions), pPlan->cExecuteActions, cPackages * PLAN_EXECUTE_ACTIONS_PER_PACKAGE, sizeof(BURN_EXECUTE_ACTION), PLAN_ACTION_GROWTH);
+    ExitOnFailure(hr, "Failed to reserve plan's array of execute actions.");
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgRollbackActions), pPlan->cRollbackActions, cPackages * PLAN_ROLLBACK_ACTIONS_PER_PACKAGE, sizeof(BURN_EXECUTE_ACTION), PLAN_ACTION_GROWTH);
+    ExitOnFailure(hr, "Failed to reserve plan's array of rollback actions.");
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgCacheActions), pPlan->cCacheActions, cPackages * PLAN_CACHE_ACTIONS_PER_PACKAGE, sizeof(BURN_CACHE_ACTION), PLAN_ACTION_GROWTH);
+    ExitOnFailure(hr, "Failed to reserve plan's array of cache actions.");
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgRollbackCacheActions), pPlan->cRollbackCacheActions, cPackages, sizeof(BURN_CACHE_ACTION), PLAN_ACTION_GROWTH);
+    ExitOnFailure(hr, "Failed to reserve plan's array of rollback cache actions.");
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgCleanActions), pPlan->cCleanActions, cPackages, sizeof(BURN_CLEAN_ACTION), PLAN_ACTION_GROWTH);
+    ExitOnFailure(hr, "Failed to reserve plan's array of clean actions.");
+
+LExit:
+    return hr;
+}
+
+// Grows by at least the current count so a plan larger than reserved doesn't reallocate per action.
+static DWORD GetActionGrowth(
+    __in DWORD cActions
+    )
+{
+    return max(PLAN_ACTION_GROWTH, cActions);
+}
+
 static HRESULT AppendCacheAction(
     __in BURN_PLAN* pPlan,
     __out BURN_CACHE_ACTION** ppCacheAction
@@ -2445,7 +2668,7 @@ static HRESULT AppendCacheAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&pPlan->rgCacheActions), pPlan->cCacheActions + 1, sizeof(BURN_CACHE_ACTION), 5);
+    hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&pPlan->rgCacheActions), pPlan->cCacheActions + 1, sizeof(BURN_CACHE_ACTION), GetActionGrowth(pPlan->cCacheActions));
     ExitOnFailure(hr, "Failed to grow plan's array of cache actions.");
 
     *ppCacheAction = pPlan->rgCacheActions + pPlan->cCacheActions;
@@ -2462,7 +2685,7 @@ static HRESULT AppendRollbackCacheAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&pPlan->rgRollbackCacheActions), pPlan->cRollbackCacheActions + 1, sizeof(BURN_CACHE_ACTION), 5);
+    hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&pPlan->rgRollbackCacheActions), pPlan->cRollbackCacheActions + 1, sizeof(BURN_CACHE_ACTION), GetActionGrowth(pPlan->cRollbackCacheActions));
     ExitOnFailure(hr, "Failed to grow plan's array of rollback cache actions.");
 
     *ppCacheAction = pPlan->rgRollbackCacheActions + pPlan->cRollbackCacheActions;
@@ -2479,7 +2702,7 @@ static HRESULT AppendCleanAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgCleanActions), pPlan->cCleanActions, 1, sizeof(BURN_CLEAN_ACTION), 5);
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgCleanActions), pPlan->cCleanActions, 1, sizeof(BURN_CLEAN_ACTION), GetActionGrowth(pPlan->cCleanActions));
     ExitOnFailure(hr, "Failed to grow plan's array of clean actions.");
 
 
@@ -2497,7 +2720,7 @@ static HRESULT AppendRestoreRelatedBundleAction(
 {
     HRESULT hr = S_OK;
 
-    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgRestoreRelatedBundleActions), pPlan->cRestoreRelatedBundleActions, 1, sizeof(BURN_EXECUTE_ACTION), 5);
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pPlan->rgRestoreRelatedBundleActions), pPlan->cRestoreRelatedBundleActions, 1, sizeof(BURN_EXECUTE_ACTION), GetActionGrowth(pPlan->cRestoreRelatedBundleActions));
     ExitOnFailure(hr, "Failed to grow plan's array of restore related bundle actions.");
 
     *ppExecuteAction = pPlan->rgRestoreRelatedBundleActions + pPlan->cRestoreRelatedBundleActions;
@@ -2737,6 +2960,9 @@ static HRESULT PlanDependencyActions(
     )
 {
     HRESULT hr = S_OK;
+    BURN_TIMER timer = { };
+
+    TimingStart(&timer);
 
     hr = DependencyPlanPackageBegin(fBundlePerMachine, pPackage, pPlan);
     ExitOnFailure(hr, "Failed to begin plan dependency actions for package: %ls", pPackage->sczId);
@@ -2748,6 +2974,8 @@ static HRESULT PlanDependencyActions(
     ExitOnFailure(hr, "Failed to complete plan dependency actions for package: %ls", pPackage->sczId);
 
 LExit:
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"PlanDependencyActions", NULL);
+
     return hr;
 }
 
@@ -2758,6 +2986,9 @@ static HRESULT CalculateExecuteActions(
 {
     HRESULT hr = S_OK;
     BOOL fInsideMsiTransaction = pActiveRollbackBoundary && pActiveRollbackBoundary->fTransaction;
+    BURN_TIMER timer = { };
+
+    TimingStart(&timer);
 
     // Calculate execute actions.
     switch (pPackage->type)
@@ -2790,6 +3021,8 @@ static HRESULT CalculateExecuteActions(
     pPackage->compatiblePackage.fRemove = pPackage->compatiblePackage.fPlannable && pPackage->compatiblePackage.fRequested;
 
 LExit:
+    TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"CalculateExecuteActions", NULL);
+
     return hr;
 }
 
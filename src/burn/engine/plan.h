@@ -263,6 +263,7 @@ typedef struct _BURN_PLAN
     BOOL fAffectedMachineState;
     LPWSTR sczLayoutDirectory;
     BOOL fPlanPackageCacheRollback;
+    BOOL fIncrementalPlan;      // reuse each package's condition results while nothing they read has changed.
     BOOL fDowngrade;
     BOOL fApplying;
 
@@ -318,11 +319,13 @@ typedef struct _BURN_PLAN
 
 void PlanReset(
     __in BURN_PLAN* pPlan,
-    __in BURN_VARIABLES* pVariables,
     __in BURN_CONTAINERS* pContainers,
     __in BURN_PACKAGES* pPackages,
     __in BURN_PAYLOAD_GROUP* pLayoutPayloads
     );
+void PlanUninitialize(
+    __in BURN_PLAN* pPlan
+    );
 void PlanUninitializeExecuteAction(
     __in BURN_EXECUTE_ACTION* pExecuteAction
     );
@@ -38,6 +38,7 @@
 #include <memutil.h>
 #include <osutil.h>
 #include <pathutil.h>
+#include <perfutil.h>
 #include <pipeutil.h>
 #include <polcutil.h>
 #include <procutil.h>
@@ -99,6 +100,7 @@
 #include "manifest.h"
 #include "splashscreen.h"
 #include "uithread.h"
+#include "timing.h"
 #include "netfxchainer.h"
 
 #include "externalengine.h"
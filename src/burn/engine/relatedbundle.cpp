@@ -347,7 +347,7 @@ static HRESULT LoadRelatedBundleFromKey(
     hr = RegReadString(hkBundleId, BURN_REGISTRATION_REGISTRY_BUNDLE_VERSION, &sczBundleVersion);
     ExitOnFailure(hr, "Failed to read version from registry for bundle: %ls", wzRelatedBundleId);
 
-    hr = VerParseVersion(sczBundleVersion, 0, FALSE, &pRelatedBundle->pVersion);
+    hr = VerCacheParseVersion(sczBundleVersion, 0, FALSE, &pRelatedBundle->pVersion);
     ExitOnFailure(hr, "Failed to parse pseudo bundle version: %ls", sczBundleVersion);
 
     if (pRelatedBundle->pVersion->fInvalid)
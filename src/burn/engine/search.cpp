@@ -3,8 +3,49 @@
 #include "precomp.h"
 
 
+// structs
+
+typedef struct _SEARCH_EXECUTE_CONTEXT
+{
+    BURN_SEARCH* pSearch;
+    BURN_VARIABLES* pVariables;
+    LPWSTR* rgsczReads;
+    UINT cReads;
+    BOOL fBarrier;
+    DWORD dwWave;
+    HRESULT hr;
+    LONGLONG llTicks;
+} SEARCH_EXECUTE_CONTEXT;
+
+
 // internal function declarations
 
+static HRESULT InitializeSearchExecuteContext(
+    __in SEARCH_EXECUTE_CONTEXT* pContext,
+    __in BURN_SEARCH* pSearch,
+    __in BURN_VARIABLES* pVariables
+    );
+static BOOL SearchDependsOn(
+    __in const SEARCH_EXECUTE_CONTEXT* pContext,
+    __in const SEARCH_EXECUTE_CONTEXT* pEarlierContext
+    );
+static BOOL SearchReadsVariable(
+    __in const SEARCH_EXECUTE_CONTEXT* pContext,
+    __in_z_opt LPCWSTR wzVariable
+    );
+static HRESULT CALLBACK ExecuteSearchWork(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static void ExecuteSearch(
+    __in SEARCH_EXECUTE_CONTEXT* pContext
+    );
+static void LogSearchTimings(
+    __in const SEARCH_EXECUTE_CONTEXT* rgContexts,
+    __in DWORD cSearches,
+    __in DWORD cWaves
+    );
+
 static HRESULT DirectorySearchExists(
     __in BURN_SEARCH* pSearch,
     __in BURN_VARIABLES* pVariables
@@ -419,100 +460,121 @@ extern "C" HRESULT SearchesExecute(
     )
 {
     HRESULT hr = S_OK;
-    BOOL f = FALSE;
+    SEARCH_EXECUTE_CONTEXT* rgContexts = NULL;
+    DWORD cSearches = pSearches->cSearches;
+    DWORD cWaves = 0;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
 
-    for (DWORD i = 0; i < pSearches->cSearches; ++i)
+    if (!cSearches)
     {
-        BURN_SEARCH* pSearch = &pSearches->rgSearches[i];
+        ExitFunction();
+    }
+
+    rgContexts = static_cast<SEARCH_EXECUTE_CONTEXT*>(MemAlloc(sizeof(SEARCH_EXECUTE_CONTEXT) * cSearches, TRUE));
+    ExitOnNull(rgContexts, hr, E_OUTOFMEMORY, "Failed to allocate search execute contexts.");
 
-        // evaluate condition
-        if (pSearch->sczCondition && *pSearch->sczCondition)
+    // A search runs in the wave after the last earlier search it depends on, so searches in the
+    // same wave see the same variables they would have seen if all searches ran in order.
+    for (DWORD i = 0; i < cSearches; ++i)
+    {
+        SEARCH_EXECUTE_CONTEXT* pContext = rgContexts + i;
+
+        hr = InitializeSearchExecuteContext(pContext, pSearches->rgSearches + i, pVariables);
+        ExitOnFailure(hr, "Failed to analyze search. Id = '%ls'", pContext->pSearch->sczKey);
+
+        for (DWORD j = 0; j < i; ++j)
         {
-            hr = ConditionEvaluate(pVariables, pSearch->sczCondition, &f);
-            if (E_INVALIDDATA == hr)
+            if (pContext->dwWave <= rgContexts[j].dwWave && SearchDependsOn(pContext, rgContexts + j))
             {
-                TraceError(hr, "Failed to parse search condition. Id = '%ls', Condition = '%ls'", pSearch->sczKey, pSearch->sczCondition);
-                hr = S_OK;
-                continue;
+                pContext->dwWave = rgContexts[j].dwWave + 1;
             }
-            ExitOnFailure(hr, "Failed to evaluate search condition. Id = '%ls', Condition = '%ls'", pSearch->sczKey, pSearch->sczCondition);
+        }
+
+        cWaves = max(cWaves, pContext->dwWave + 1);
+    }
 
-            if (!f)
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize thread pool to execute searches.");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create group to execute searches.");
+
+    for (DWORD dwWave = 0; dwWave < cWaves; ++dwWave)
+    {
+        SEARCH_EXECUTE_CONTEXT* pOnlyContext = NULL;
+        DWORD cWaveSearches = 0;
+
+        for (DWORD i = 0; i < cSearches; ++i)
+        {
+            if (dwWave == rgContexts[i].dwWave)
             {
-                continue; // condition evaluated to false, skip
+                pOnlyContext = rgContexts + i;
+                ++cWaveSearches;
             }
         }
 
-        switch (pSearch->Type)
+        // A wave of one search, which includes every extension search, runs on this thread.
+        if (1 == cWaveSearches)
         {
-        case BURN_SEARCH_TYPE_DIRECTORY:
-            switch (pSearch->DirectorySearch.Type)
-            {
-            case BURN_DIRECTORY_SEARCH_TYPE_EXISTS:
-                hr = DirectorySearchExists(pSearch, pVariables);
-                break;
-            case BURN_DIRECTORY_SEARCH_TYPE_PATH:
-                hr = DirectorySearchPath(pSearch, pVariables);
-                break;
-            default:
-                hr = E_UNEXPECTED;
-            }
-            break;
-        case BURN_SEARCH_TYPE_FILE:
-            switch (pSearch->FileSearch.Type)
-            {
-            case BURN_FILE_SEARCH_TYPE_EXISTS:
-                hr = FileSearchExists(pSearch, pVariables);
-                break;
-            case BURN_FILE_SEARCH_TYPE_VERSION:
-                hr = FileSearchVersion(pSearch, pVariables);
-                break;
-            case BURN_FILE_SEARCH_TYPE_PATH:
-                hr = FileSearchPath(pSearch, pVariables);
-                break;
-            default:
-                hr = E_UNEXPECTED;
-            }
-            break;
-        case BURN_SEARCH_TYPE_REGISTRY:
-            switch (pSearch->RegistrySearch.Type)
+            ExecuteSearch(pOnlyContext);
+        }
+        else
+        {
+            for (DWORD i = 0; i < cSearches; ++i)
             {
-            case BURN_REGISTRY_SEARCH_TYPE_EXISTS:
-                hr = RegistrySearchExists(pSearch, pVariables);
-                break;
-            case BURN_REGISTRY_SEARCH_TYPE_VALUE:
-                hr = RegistrySearchValue(pSearch, pVariables);
-                break;
-            default:
-                hr = E_UNEXPECTED;
+                if (dwWave == rgContexts[i].dwWave)
+                {
+                    hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ExecuteSearchWork, rgContexts + i);
+                    ExitOnFailure(hr, "Failed to queue search. Id = '%ls'", rgContexts[i].pSearch->sczKey);
+                }
             }
-            break;
-        case BURN_SEARCH_TYPE_MSI_COMPONENT:
-            hr = MsiComponentSearch(pSearch, pVariables);
-            break;
-        case BURN_SEARCH_TYPE_MSI_PRODUCT:
-            hr = MsiProductSearch(pSearch, pVariables);
-            break;
-        case BURN_SEARCH_TYPE_EXTENSION:
-            hr = PerformExtensionSearch(pSearch);
-            break;
-        case BURN_SEARCH_TYPE_SET_VARIABLE:
-            hr = PerformSetVariable(pSearch, pVariables);
-            break;
-        default:
-            hr = E_UNEXPECTED;
+
+            hr = ThrdGroupWait(hGroup, INFINITE);
+            ExitOnFailure(hr, "Failed to wait for searches.");
         }
 
-        if (FAILED(hr))
+        for (DWORD i = 0; i < cSearches; ++i)
         {
-            TraceError(hr, "Search failed. Id = '%ls'", pSearch->sczKey);
-            continue;
+            SEARCH_EXECUTE_CONTEXT* pContext = rgContexts + i;
+
+            if (dwWave == pContext->dwWave)
+            {
+                hr = pContext->hr;
+                ExitOnFailure(hr, "Failed to evaluate search condition. Id = '%ls', Condition = '%ls'", pContext->pSearch->sczKey, pContext->pSearch->sczCondition);
+            }
         }
     }
 
+    LogSearchTimings(rgContexts, cSearches, cWaves);
+
     hr = S_OK;
 
 LExit:
+    // The searches use the contexts so they must all finish first.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    if (rgContexts)
+    {
+        for (DWORD i = 0; i < cSearches; ++i)
+        {
+            ReleaseStrArray(rgContexts[i].rgsczReads, rgContexts[i].cReads);
+        }
+
+        MemFree(rgContexts);
+    }
+
     return hr;
 }
 
@@ -559,6 +621,257 @@ extern "C" void SearchesUninitialize(
 }
 
 
+static HRESULT InitializeSearchExecuteContext(
+    __in SEARCH_EXECUTE_CONTEXT* pContext,
+    __in BURN_SEARCH* pSearch,
+    __in BURN_VARIABLES* pVariables
+    )
+{
+    HRESULT hr = S_OK;
+    LPCWSTR rgwzReads[3] = { pSearch->sczCondition };
+
+    pContext->pSearch = pSearch;
+    pContext->pVariables = pVariables;
+
+    switch (pSearch->Type)
+    {
+    case BURN_SEARCH_TYPE_DIRECTORY:
+        rgwzReads[1] = pSearch->DirectorySearch.sczPath;
+        break;
+    case BURN_SEARCH_TYPE_FILE:
+        rgwzReads[1] = pSearch->FileSearch.sczPath;
+        break;
+    case BURN_SEARCH_TYPE_REGISTRY:
+        rgwzReads[1] = pSearch->RegistrySearch.sczKey;
+        rgwzReads[2] = pSearch->RegistrySearch.sczValue;
+
+        // The variable would be formatted with variables that are not known until the search runs.
+        pContext->fBarrier = BURN_REGISTRY_SEARCH_TYPE_VALUE == pSearch->RegistrySearch.Type && BURN_VARIANT_TYPE_FORMATTED == pSearch->RegistrySearch.VariableType;
+        break;
+    case BURN_SEARCH_TYPE_MSI_COMPONENT:
+        rgwzReads[1] = pSearch->MsiComponentSearch.sczProductCode;
+        rgwzReads[2] = pSearch->MsiComponentSearch.sczComponentId;
+        break;
+    case BURN_SEARCH_TYPE_MSI_PRODUCT:
+        rgwzReads[1] = pSearch->MsiProductSearch.sczGuid;
+        break;
+    case BURN_SEARCH_TYPE_EXTENSION:
+        // Extensions can read and set any variable.
+        pContext->fBarrier = TRUE;
+        break;
+    case BURN_SEARCH_TYPE_SET_VARIABLE:
+        rgwzReads[1] = pSearch->SetVariable.sczValue;
+        pContext->fBarrier = BURN_VARIANT_TYPE_FORMATTED == pSearch->SetVariable.targetType;
+        break;
+    }
+
+    for (DWORD i = 0; i < countof(rgwzReads); ++i)
+    {
+        if (rgwzReads[i] && *rgwzReads[i])
+        {
+            hr = StrArrayAllocString(&pContext->rgsczReads, &pContext->cReads, rgwzReads[i], 0);
+            ExitOnFailure(hr, "Failed to copy text read by search.");
+        }
+    }
+
+    hr = VariableExpandFormattedReferences(pVariables, &pContext->rgsczReads, &pContext->cReads);
+    ExitOnFailure(hr, "Failed to expand formatted variables read by search.");
+
+LExit:
+    return hr;
+}
+
+static BOOL SearchDependsOn(
+    __in const SEARCH_EXECUTE_CONTEXT* pContext,
+    __in const SEARCH_EXECUTE_CONTEXT* pEarlierContext
+    )
+{
+    LPCWSTR wzVariable = pContext->pSearch->sczVariable;
+    LPCWSTR wzEarlierVariable = pEarlierContext->pSearch->sczVariable;
+
+    if (pContext->fBarrier || pEarlierContext->fBarrier)
+    {
+        return TRUE;
+    }
+
+    // Order matters when either search reads what the other one sets or both set the same variable.
+    if (wzVariable && wzEarlierVariable && CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, wzVariable, -1, wzEarlierVariable, -1))
+    {
+        return TRUE;
+    }
+
+    return SearchReadsVariable(pContext, wzEarlierVariable) || SearchReadsVariable(pEarlierContext, wzVariable);
+}
+
+static BOOL SearchReadsVariable(
+    __in const SEARCH_EXECUTE_CONTEXT* pContext,
+    __in_z_opt LPCWSTR wzVariable
+    )
+{
+    if (wzVariable && *wzVariable)
+    {
+        // Matching the name anywhere can only add dependencies, never miss one.
+        for (UINT i = 0; i < pContext->cReads; ++i)
+        {
+            if (wcsstr(pContext->rgsczReads[i], wzVariable))
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static HRESULT CALLBACK ExecuteSearchWork(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    UNREFERENCED_PARAMETER(hGroup);
+
+    ExecuteSearch(static_cast<SEARCH_EXECUTE_CONTEXT*>(pvContext));
+
+    // Failures are kept in the context so the first one in search order is reported.
+    return S_OK;
+}
+
+static void ExecuteSearch(
+    __in SEARCH_EXECUTE_CONTEXT* pContext
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_SEARCH* pSearch = pContext->pSearch;
+    BURN_VARIABLES* pVariables = pContext->pVariables;
+    BOOL f = FALSE;
+    LARGE_INTEGER liStart = { };
+    LARGE_INTEGER liEnd = { };
+
+    ::QueryPerformanceCounter(&liStart);
+
+    // evaluate condition
+    if (pSearch->sczCondition && *pSearch->sczCondition)
+    {
+        hr = ConditionEvaluate(pVariables, pSearch->sczCondition, &f);
+        if (E_INVALIDDATA == hr)
+        {
+            TraceError(hr, "Failed to parse search condition. Id = '%ls', Condition = '%ls'", pSearch->sczKey, pSearch->sczCondition);
+            ExitFunction1(hr = S_OK);
+        }
+        else if (FAILED(hr))
+        {
+            pContext->hr = hr;
+            ExitFunction();
+        }
+
+        if (!f)
+        {
+            ExitFunction(); // condition evaluated to false, skip
+        }
+    }
+
+    switch (pSearch->Type)
+    {
+    case BURN_SEARCH_TYPE_DIRECTORY:
+        switch (pSearch->DirectorySearch.Type)
+        {
+        case BURN_DIRECTORY_SEARCH_TYPE_EXISTS:
+            hr = DirectorySearchExists(pSearch, pVariables);
+            break;
+        case BURN_DIRECTORY_SEARCH_TYPE_PATH:
+            hr = DirectorySearchPath(pSearch, pVariables);
+            break;
+        default:
+            hr = E_UNEXPECTED;
+        }
+        break;
+    case BURN_SEARCH_TYPE_FILE:
+        switch (pSearch->FileSearch.Type)
+        {
+        case BURN_FILE_SEARCH_TYPE_EXISTS:
+            hr = FileSearchExists(pSearch, pVariables);
+            break;
+        case BURN_FILE_SEARCH_TYPE_VERSION:
+            hr = FileSearchVersion(pSearch, pVariables);
+            break;
+        case BURN_FILE_SEARCH_TYPE_PATH:
+            hr = FileSearchPath(pSearch, pVariables);
+            break;
+        default:
+            hr = E_UNEXPECTED;
+        }
+        break;
+    case BURN_SEARCH_TYPE_REGISTRY:
+        switch (pSearch->RegistrySearch.Type)
+        {
+        case BURN_REGISTRY_SEARCH_TYPE_EXISTS:
+            hr = RegistrySearchExists(pSearch, pVariables);
+            break;
+        case BURN_REGISTRY_SEARCH_TYPE_VALUE:
+            hr = RegistrySearchValue(pSearch, pVariables);
+            break;
+        default:
+            hr = E_UNEXPECTED;
+        }
+        break;
+    case BURN_SEARCH_TYPE_MSI_COMPONENT:
+        hr = MsiComponentSearch(pSearch, pVariables);
+        break;
+    case BURN_SEARCH_TYPE_MSI_PRODUCT:
+        hr = MsiProductSearch(pSearch, pVariables);
+        break;
+    case BURN_SEARCH_TYPE_EXTENSION:
+        hr = PerformExtensionSearch(pSearch);
+        break;
+    case BURN_SEARCH_TYPE_SET_VARIABLE:
+        hr = PerformSetVariable(pSearch, pVariables);
+        break;
+    default:
+        hr = E_UNEXPECTED;
+    }
+
+    if (FAILED(hr))
+    {
+        TraceError(hr, "Search failed. Id = '%ls'", pSearch->sczKey);
+    }
+
+LExit:
+    ::QueryPerformanceCounter(&liEnd);
+    pContext->llTicks = liEnd.QuadPart - liStart.QuadPart;
+}
+
+static void LogSearchTimings(
+    __in const SEARCH_EXECUTE_CONTEXT* rgContexts,
+    __in DWORD cSearches,
+    __in DWORD cWaves
+    )
+{
+    LARGE_INTEGER liFrequency = { };
+    const SEARCH_EXECUTE_CONTEXT* pSlowest = rgContexts;
+    double dMilliseconds = 0;
+
+    if (!::QueryPerformanceFrequency(&liFrequency) || !liFrequency.QuadPart)
+    {
+        return;
+    }
+
+    for (DWORD i = 0; i < cSearches; ++i)
+    {
+        const SEARCH_EXECUTE_CONTEXT* pContext = rgContexts + i;
+
+        dMilliseconds = pContext->llTicks * 1000.0 / liFrequency.QuadPart;
+        LogStringLine(REPORT_VERBOSE, "Search '%ls' ran in wave %u and took %.3f ms.", pContext->pSearch->sczKey, pContext->dwWave + 1, dMilliseconds);
+
+        if (pSlowest->llTicks < pContext->llTicks)
+        {
+            pSlowest = pContext;
+        }
+    }
+
+    dMilliseconds = pSlowest->llTicks * 1000.0 / liFrequency.QuadPart;
+    LogStringLine(REPORT_STANDARD, "Executed %u searches in %u waves, slowest search: '%ls' took %.3f ms.", cSearches, cWaves, pSlowest->pSearch->sczKey, dMilliseconds);
+}
+
 // internal function definitions
 
 #if !defined(_WIN64)
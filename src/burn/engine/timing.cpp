@@ -0,0 +1,600 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+
+static const DWORD TIMING_GROW_STATS = 32;
+static const DWORD TIMING_GROW_EVENTS = 256;
+
+// Bucket 0 counts durations under a microsecond, bucket i durations under 2^i microseconds
+// and the last bucket everything longer.
+static const DWORD TIMING_HISTOGRAM_BUCKETS = 32;
+
+static const DWORD TIMING_SLOW_BA_MESSAGE_MILLISECONDS = 250;
+
+static const DWORD TIMING_BA_MESSAGES = BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEPACKAGENONVITALVALIDATIONFAILURE - BOOTSTRAPPER_APPLICATION_MESSAGE_UNKNOWN + 1;
+
+// structs
+
+typedef struct _BURN_TIMING_STATS
+{
+    LPWSTR sczKey;
+    BURN_TIMING_CATEGORY category;
+    LPWSTR sczName;
+
+    // Updated with interlocked operations so recording doesn't need the lock.
+    volatile LONG cCalls;
+    volatile LONGLONG llTotal;
+    volatile LONGLONG llMax;
+    volatile LONG rgcHistogram[TIMING_HISTOGRAM_BUCKETS];
+} BURN_TIMING_STATS;
+
+typedef struct _BURN_TIMING_EVENT
+{
+    BURN_TIMING_STATS* pStats;
+    DWORD dwThreadId;
+    LONGLONG llStart;
+    LONGLONG llDuration;
+} BURN_TIMING_EVENT;
+
+typedef struct _BURN_TIMING
+{
+    CRITICAL_SECTION cs;
+    LARGE_INTEGER liStart;
+
+    STRINGDICT_HANDLE sdStats;
+    BURN_TIMING_STATS** rgpStats;
+    DWORD cStats;
+
+    // Messages to the BA are by far the most frequent so they are indexed by message
+    // instead of looked up by name.
+    BURN_TIMING_STATS rgBAMessageStats[TIMING_BA_MESSAGES];
+
+    // Individual events are only kept when they will be written to a trace file.
+    LPWSTR sczTraceFile;
+    BURN_TIMING_EVENT* rgEvents;
+    DWORD cEvents;
+} BURN_TIMING;
+
+static BOOL vfTimingInitialized = FALSE;
+static BURN_TIMING vTiming = { };
+
+
+// internal function declarations
+
+static HRESULT FindStats(
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail,
+    __out BURN_TIMING_STATS** ppStats
+    );
+static LONGLONG RecordTiming(
+    __in const BURN_TIMER* pTimer,
+    __in const LARGE_INTEGER* pliStop,
+    __in BURN_TIMING_STATS* pStats
+    );
+static HRESULT AddStats(
+    __in_z LPCWSTR wzKey,
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail,
+    __out BURN_TIMING_STATS** ppStats
+    );
+static __callback int __cdecl CompareStats(
+    __in void* pvContext,
+    __in const void* pvLeft,
+    __in const void* pvRight
+    );
+static HRESULT WriteTrace();
+static LPCSTR CategoryToString(
+    __in BURN_TIMING_CATEGORY category
+    );
+static double ConvertToMilliseconds(
+    __in LONGLONG llTicks
+    );
+static DWORD GetHistogramBucket(
+    __in LONGLONG llTicks
+    );
+static double GetPercentileMilliseconds(
+    __in const BURN_TIMING_STATS* pStats,
+    __in DWORD dwPercentile
+    );
+
+
+// function definitions
+
+extern "C" HRESULT TimingInitialize(
+    __in_z_opt LPCWSTR wzTraceFile
+    )
+{
+    HRESULT hr = S_OK;
+
+    PerfInitialize();
+
+    ::InitializeCriticalSection(&vTiming.cs);
+
+    hr = DictCreateWithEmbeddedKey(&vTiming.sdStats, 0, NULL, offsetof(BURN_TIMING_STATS, sczKey), DICT_FLAG_NONE);
+    ExitOnFailure(hr, "Failed to create timing dictionary.");
+
+    for (DWORD i = 0; i < TIMING_BA_MESSAGES; ++i)
+    {
+        BURN_TIMING_STATS* pStats = vTiming.rgBAMessageStats + i;
+        BOOTSTRAPPER_APPLICATION_MESSAGE message = static_cast<BOOTSTRAPPER_APPLICATION_MESSAGE>(BOOTSTRAPPER_APPLICATION_MESSAGE_UNKNOWN + i);
+
+        hr = StrAllocFormatted(&pStats->sczName, L"%hs", LoggingBAMessageToString(message));
+        ExitOnFailure(hr, "Failed to allocate timing name for BA message: %u", message);
+
+        pStats->category = BURN_TIMING_CATEGORY_BA_MESSAGE;
+    }
+
+    if (wzTraceFile && *wzTraceFile)
+    {
+        hr = StrAllocString(&vTiming.sczTraceFile, wzTraceFile, 0);
+        ExitOnFailure(hr, "Failed to copy timing trace file path.");
+    }
+
+    PerfQueryTime(&vTiming.liStart);
+
+    vfTimingInitialized = TRUE;
+
+LExit:
+    if (FAILED(hr))
+    {
+        for (DWORD i = 0; i < TIMING_BA_MESSAGES; ++i)
+        {
+            ReleaseNullStr(vTiming.rgBAMessageStats[i].sczName);
+        }
+
+        ReleaseNullStr(vTiming.sczTraceFile);
+        ReleaseNullDict(vTiming.sdStats);
+        ::DeleteCriticalSection(&vTiming.cs);
+    }
+
+    return hr;
+}
+
+extern "C" void TimingUninitialize()
+{
+    if (!vfTimingInitialized)
+    {
+        return;
+    }
+
+    vfTimingInitialized = FALSE;
+
+    for (DWORD i = 0; i < vTiming.cStats; ++i)
+    {
+        BURN_TIMING_STATS* pStats = vTiming.rgpStats[i];
+
+        ReleaseStr(pStats->sczKey);
+        ReleaseStr(pStats->sczName);
+        MemFree(pStats);
+    }
+
+    for (DWORD i = 0; i < TIMING_BA_MESSAGES; ++i)
+    {
+        ReleaseStr(vTiming.rgBAMessageStats[i].sczName);
+    }
+
+    ReleaseMem(vTiming.rgpStats);
+    ReleaseMem(vTiming.rgEvents);
+    ReleaseStr(vTiming.sczTraceFile);
+    ReleaseDict(vTiming.sdStats);
+
+    ::DeleteCriticalSection(&vTiming.cs);
+
+    memset(&vTiming, 0, sizeof(vTiming));
+}
+
+extern "C" void TimingStart(
+    __out BURN_TIMER* pTimer
+    )
+{
+    PerfQueryTime(&pTimer->liStart);
+}
+
+extern "C" void TimingStop(
+    __in const BURN_TIMER* pTimer,
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail
+    )
+{
+    HRESULT hr = S_OK;
+    LARGE_INTEGER liStop = { };
+    BURN_TIMING_STATS* pStats = NULL;
+
+    if (!vfTimingInitialized)
+    {
+        ExitFunction();
+    }
+
+    PerfQueryTime(&liStop);
+
+    hr = FindStats(category, wzName, wzDetail, &pStats);
+    ExitOnFailure(hr, "Failed to find timing statistics for: %ls", wzName);
+
+    RecordTiming(pTimer, &liStop, pStats);
+
+LExit:
+    return;
+}
+
+// The BA message is timed by the pipe, so the stop time is passed in.
+extern "C" void TimingStopBAMessage(
+    __in const BURN_TIMER* pTimer,
+    __in const LARGE_INTEGER* pliStop,
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message
+    )
+{
+    DWORD iMessage = static_cast<DWORD>(message - BOOTSTRAPPER_APPLICATION_MESSAGE_UNKNOWN);
+    LONGLONG llDuration = 0;
+    DWORD dwMilliseconds = 0;
+
+    if (!vfTimingInitialized)
+    {
+        return;
+    }
+
+    // Messages this engine doesn't know of are counted as unknown.
+    if (TIMING_BA_MESSAGES <= iMessage)
+    {
+        iMessage = 0;
+    }
+
+    llDuration = RecordTiming(pTimer, pliStop, vTiming.rgBAMessageStats + iMessage);
+
+    dwMilliseconds = static_cast<DWORD>(ConvertToMilliseconds(llDuration));
+
+    // The BA is expected to wait on the user for these so they are not its fault.
+    if (TIMING_SLOW_BA_MESSAGE_MILLISECONDS <= dwMilliseconds &&
+        BOOTSTRAPPER_APPLICATION_MESSAGE_ONERROR != message &&
+        BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEFILESINUSE != message &&
+        BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIRERESOLVING != message &&
+        BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPROCESSCANCEL != message)
+    {
+        LogId(REPORT_WARNING, MSG_BA_SLOW_MESSAGE, LoggingBAMessageToString(message), dwMilliseconds);
+    }
+}
+
+// Logs the summary table and writes the trace file, if one was requested.
+extern "C" void TimingReport()
+{
+    HRESULT hr = S_OK;
+    BURN_TIMING_STATS** rgpSorted = NULL;
+    DWORD cSorted = 0;
+
+    if (!vfTimingInitialized)
+    {
+        ExitFunction();
+    }
+
+    ::EnterCriticalSection(&vTiming.cs);
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&rgpSorted), sizeof(BURN_TIMING_STATS*), vTiming.cStats + TIMING_BA_MESSAGES);
+    if (SUCCEEDED(hr))
+    {
+        for (DWORD i = 0; i < vTiming.cStats; ++i)
+        {
+            rgpSorted[cSorted++] = vTiming.rgpStats[i];
+        }
+
+        for (DWORD i = 0; i < TIMING_BA_MESSAGES; ++i)
+        {
+            if (vTiming.rgBAMessageStats[i].cCalls)
+            {
+                rgpSorted[cSorted++] = vTiming.rgBAMessageStats + i;
+            }
+        }
+    }
+
+    ::LeaveCriticalSection(&vTiming.cs);
+
+    ExitOnFailure(hr, "Failed to allocate sorted timing statistics.");
+
+    if (cSorted)
+    {
+        qsort_s(rgpSorted, cSorted, sizeof(BURN_TIMING_STATS*), CompareStats, NULL);
+
+        LogStringLine(REPORT_STANDARD, "Timing summary:");
+        LogStringLine(REPORT_STANDARD, "  %-10hs %8hs %12hs %12hs %12hs %12hs  %hs", "Category", "Calls", "Total (ms)", "p50 (ms)", "p99 (ms)", "Max (ms)", "Name");
+
+        for (DWORD i = 0; i < cSorted; ++i)
+        {
+            const BURN_TIMING_STATS* pStats = rgpSorted[i];
+
+            LogStringLine(REPORT_STANDARD, "  %-10hs %8u %12.3f %12.3f %12.3f %12.3f  %ls", CategoryToString(pStats->category), pStats->cCalls, ConvertToMilliseconds(pStats->llTotal), GetPercentileMilliseconds(pStats, 50), GetPercentileMilliseconds(pStats, 99), ConvertToMilliseconds(pStats->llMax), pStats->sczName);
+        }
+    }
+
+    if (vTiming.sczTraceFile)
+    {
+        hr = WriteTrace();
+        if (FAILED(hr))
+        {
+            LogStringLine(REPORT_STANDARD, "Failed to write timing trace file: %ls, error: 0x%x", vTiming.sczTraceFile, hr);
+        }
+        else
+        {
+            LogStringLine(REPORT_VERBOSE, "Wrote timing trace file: %ls", vTiming.sczTraceFile);
+        }
+    }
+
+LExit:
+    ReleaseMem(rgpSorted);
+}
+
+// Finds the statistics of a phase or package, adding them the first time they are timed.
+static HRESULT FindStats(
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail,
+    __out BURN_TIMING_STATS** ppStats
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczKey = NULL;
+
+    hr = StrAllocFormatted(&sczKey, L"%u\t%ls\t%ls", category, wzName, wzDetail ? wzDetail : L"");
+    ExitOnFailure(hr, "Failed to allocate timing key.");
+
+    ::EnterCriticalSection(&vTiming.cs);
+
+    hr = DictGetValue(vTiming.sdStats, sczKey, reinterpret_cast<void**>(ppStats));
+    if (E_NOTFOUND == hr)
+    {
+        hr = AddStats(sczKey, category, wzName, wzDetail, ppStats);
+    }
+
+    ::LeaveCriticalSection(&vTiming.cs);
+
+    ExitOnFailure(hr, "Failed to find timing statistics for: %ls", sczKey);
+
+LExit:
+    ReleaseStr(sczKey);
+
+    return hr;
+}
+
+// Returns the duration so the caller can act on it.
+static LONGLONG RecordTiming(
+    __in const BURN_TIMER* pTimer,
+    __in const LARGE_INTEGER* pliStop,
+    __in BURN_TIMING_STATS* pStats
+    )
+{
+    HRESULT hr = S_OK;
+    LONGLONG llDuration = 0;
+    LONGLONG llMax = 0;
+    BOOL fLocked = FALSE;
+
+    llDuration = pliStop->QuadPart - pTimer->liStart.QuadPart;
+
+    ::InterlockedIncrement(&pStats->cCalls);
+    ::InterlockedExchangeAdd64(&pStats->llTotal, llDuration);
+    ::InterlockedIncrement(pStats->rgcHistogram + GetHistogramBucket(llDuration));
+
+    llMax = pStats->llMax;
+    while (llMax < llDuration)
+    {
+        LONGLONG llPrevious = ::InterlockedCompareExchange64(&pStats->llMax, llDuration, llMax);
+        if (llPrevious == llMax)
+        {
+            break;
+        }
+
+        llMax = llPrevious;
+    }
+
+    if (vTiming.sczTraceFile)
+    {
+        ::EnterCriticalSection(&vTiming.cs);
+        fLocked = TRUE;
+
+        // Grow by the current size so a long apply doesn't copy the events over and over.
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&vTiming.rgEvents), vTiming.cEvents, 1, sizeof(BURN_TIMING_EVENT), max(TIMING_GROW_EVENTS, vTiming.cEvents));
+        ExitOnFailure(hr, "Failed to grow timing events.");
+
+        BURN_TIMING_EVENT* pEvent = vTiming.rgEvents + vTiming.cEvents;
+        pEvent->pStats = pStats;
+        pEvent->dwThreadId = ::GetCurrentThreadId();
+        pEvent->llStart = pTimer->liStart.QuadPart - vTiming.liStart.QuadPart;
+        pEvent->llDuration = llDuration;
+
+        ++vTiming.cEvents;
+    }
+
+LExit:
+    if (fLocked)
+    {
+        ::LeaveCriticalSection(&vTiming.cs);
+    }
+
+    return llDuration;
+}
+
+static HRESULT AddStats(
+    __in_z LPCWSTR wzKey,
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail,
+    __out BURN_TIMING_STATS** ppStats
+    )
+{
+    HRESULT hr = S_OK;
+    BURN_TIMING_STATS* pStats = NULL;
+
+    pStats = reinterpret_cast<BURN_TIMING_STATS*>(MemAlloc(sizeof(BURN_TIMING_STATS), TRUE));
+    ExitOnNull(pStats, hr, E_OUTOFMEMORY, "Failed to allocate timing statistics.");
+
+    hr = StrAllocString(&pStats->sczKey, wzKey, 0);
+    ExitOnFailure(hr, "Failed to copy timing key.");
+
+    if (wzDetail)
+    {
+        hr = StrAllocFormatted(&pStats->sczName, L"%ls: %ls", wzName, wzDetail);
+    }
+    else
+    {
+        hr = StrAllocString(&pStats->sczName, wzName, 0);
+    }
+    ExitOnFailure(hr, "Failed to copy timing name.");
+
+    pStats->category = category;
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&vTiming.rgpStats), vTiming.cStats, 1, sizeof(BURN_TIMING_STATS*), TIMING_GROW_STATS);
+    ExitOnFailure(hr, "Failed to grow timing statistics.");
+
+    hr = DictAddValue(vTiming.sdStats, pStats);
+    ExitOnFailure(hr, "Failed to add timing statistics to dictionary.");
+
+    vTiming.rgpStats[vTiming.cStats] = pStats;
+    ++vTiming.cStats;
+
+    *ppStats = pStats;
+    pStats = NULL;
+
+LExit:
+    if (pStats)
+    {
+        ReleaseStr(pStats->sczKey);
+        ReleaseStr(pStats->sczName);
+        MemFree(pStats);
+    }
+
+    return hr;
+}
+
+// Sorts by category and then by the most total time.
+static __callback int __cdecl CompareStats(
+    __in void* pvContext,
+    __in const void* pvLeft,
+    __in const void* pvRight
+    )
+{
+    UNREFERENCED_PARAMETER(pvContext);
+
+    const BURN_TIMING_STATS* pLeft = *static_cast<BURN_TIMING_STATS* const*>(pvLeft);
+    const BURN_TIMING_STATS* pRight = *static_cast<BURN_TIMING_STATS* const*>(pvRight);
+
+    if (pLeft->category != pRight->category)
+    {
+        return pLeft->category < pRight->category ? -1 : 1;
+    }
+
+    return pLeft->llTotal > pRight->llTotal ? -1 : pLeft->llTotal < pRight->llTotal ? 1 : 0;
+}
+
+// Writes the events in the Chrome trace event format, which chrome://tracing and Perfetto load.
+static HRESULT WriteTrace()
+{
+    HRESULT hr = S_OK;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    LPSTR sczLine = NULL;
+    DWORD dwProcessId = ::GetCurrentProcessId();
+
+    hFile = ::CreateFileW(vTiming.sczTraceFile, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ExitOnInvalidHandleWithLastError(hFile, hr, "Failed to create timing trace file: %ls", vTiming.sczTraceFile);
+
+    hr = StrAnsiAllocStringAnsi(&sczLine, "{\"traceEvents\":[\n", 0);
+    ExitOnFailure(hr, "Failed to allocate timing trace header.");
+
+    hr = FileWriteHandle(hFile, reinterpret_cast<LPCBYTE>(sczLine), lstrlenA(sczLine));
+    ExitOnFailure(hr, "Failed to write timing trace header.");
+
+    ::EnterCriticalSection(&vTiming.cs);
+
+    for (DWORD i = 0; SUCCEEDED(hr) && i < vTiming.cEvents; ++i)
+    {
+        const BURN_TIMING_EVENT* pEvent = vTiming.rgEvents + i;
+
+        // Names are engine function names, package ids and message numbers so none need escaping.
+        hr = StrAnsiAllocFormatted(&sczLine, "%hs{\"name\":\"%ls\",\"cat\":\"%hs\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}\n", i ? "," : "", pEvent->pStats->sczName, CategoryToString(pEvent->pStats->category), ConvertToMilliseconds(pEvent->llStart) * 1000, ConvertToMilliseconds(pEvent->llDuration) * 1000, dwProcessId, pEvent->dwThreadId);
+        if (SUCCEEDED(hr))
+        {
+            hr = FileWriteHandle(hFile, reinterpret_cast<LPCBYTE>(sczLine), lstrlenA(sczLine));
+        }
+    }
+
+    ::LeaveCriticalSection(&vTiming.cs);
+
+    ExitOnFailure(hr, "Failed to write timing trace events.");
+
+    hr = FileWriteHandle(hFile, reinterpret_cast<LPCBYTE>("]}\n"), 3);
+    ExitOnFailure(hr, "Failed to write timing trace footer.");
+
+LExit:
+    ReleaseStr(sczLine);
+    ReleaseFile(hFile);
+
+    return hr;
+}
+
+static LPCSTR CategoryToString(
+    __in BURN_TIMING_CATEGORY category
+    )
+{
+    switch (category)
+    {
+    case BURN_TIMING_CATEGORY_PHASE:
+        return "phase";
+    case BURN_TIMING_CATEGORY_PACKAGE:
+        return "package";
+    case BURN_TIMING_CATEGORY_BA_MESSAGE:
+        return "ba";
+    default:
+        return "unknown";
+    }
+}
+
+static double ConvertToMilliseconds(
+    __in LONGLONG llTicks
+    )
+{
+    LARGE_INTEGER li = { };
+    li.QuadPart = llTicks;
+
+    return PerfConvertToSeconds(&li) * 1000;
+}
+
+static DWORD GetHistogramBucket(
+    __in LONGLONG llTicks
+    )
+{
+    DWORD iBucket = 0;
+    ULONGLONG ullMicroseconds = static_cast<ULONGLONG>(ConvertToMilliseconds(llTicks) * 1000);
+
+    while (ullMicroseconds && iBucket < TIMING_HISTOGRAM_BUCKETS - 1)
+    {
+        ullMicroseconds >>= 1;
+        ++iBucket;
+    }
+
+    return iBucket;
+}
+
+// Estimates the percentile as the upper bound of the bucket it falls in, which is never
+// more than double the real value and never more than the max.
+static double GetPercentileMilliseconds(
+    __in const BURN_TIMING_STATS* pStats,
+    __in DWORD dwPercentile
+    )
+{
+    ULONGLONG ullRank = (static_cast<ULONGLONG>(pStats->cCalls) * dwPercentile + 99) / 100;
+    ULONGLONG ullCount = 0;
+    double dMax = ConvertToMilliseconds(pStats->llMax);
+    double dBucket = dMax;
+
+    for (DWORD i = 0; i < TIMING_HISTOGRAM_BUCKETS - 1; ++i)
+    {
+        ullCount += pStats->rgcHistogram[i];
+
+        if (ullRank <= ullCount)
+        {
+            dBucket = static_cast<double>(1ull << i) / 1000;
+            break;
+        }
+    }
+
+    return dBucket < dMax ? dBucket : dMax;
+}
@@ -0,0 +1,51 @@
+#pragma once
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// constants
+
+enum BURN_TIMING_CATEGORY
+{
+    BURN_TIMING_CATEGORY_PHASE,
+    BURN_TIMING_CATEGORY_PACKAGE,
+    BURN_TIMING_CATEGORY_BA_MESSAGE,
+};
+
+
+// structs
+
+typedef struct _BURN_TIMER
+{
+    LARGE_INTEGER liStart;
+} BURN_TIMER;
+
+
+// functions
+
+HRESULT TimingInitialize(
+    __in_z_opt LPCWSTR wzTraceFile
+    );
+void TimingUninitialize();
+void TimingStart(
+    __out BURN_TIMER* pTimer
+    );
+void TimingStop(
+    __in const BURN_TIMER* pTimer,
+    __in BURN_TIMING_CATEGORY category,
+    __in_z LPCWSTR wzName,
+    __in_z_opt LPCWSTR wzDetail
+    );
+void TimingStopBAMessage(
+    __in const BURN_TIMER* pTimer,
+    __in const LARGE_INTEGER* pliStop,
+    __in BOOTSTRAPPER_APPLICATION_MESSAGE message
+    );
+void TimingReport();
+
+#if defined(__cplusplus)
+}
+#endif
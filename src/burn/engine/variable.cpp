@@ -1130,6 +1130,30 @@ LExit:
     return hr;
 }
 
+extern "C" HRESULT VariableGetChangeStamp(
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzVariable,
+    __out DWORD* pdwChangeStamp
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD iVariable = 0;
+
+    ::EnterCriticalSection(&pVariables->csAccess);
+
+    hr = FindVariableIndexByName(pVariables, wzVariable, &iVariable);
+    ExitOnFailure(hr, "Failed to find variable: %ls", wzVariable);
+
+    // A variable that does not exist yet gets a new stamp when it is set so 0 works for it too.
+    *pdwChangeStamp = S_FALSE == hr ? 0 : pVariables->rgVariables[iVariable].dwChangeStamp;
+    hr = S_OK;
+
+LExit:
+    ::LeaveCriticalSection(&pVariables->csAccess);
+
+    return hr;
+}
+
 extern "C" BOOL VariableIsHiddenCommandLine(
     __in BURN_VARIABLES* pVariables,
     __in_z LPCWSTR wzVariable
@@ -1156,6 +1180,64 @@ extern "C" BOOL VariableIsHiddenCommandLine(
     return fHidden;
 }
 
+extern "C" HRESULT VariableExpandFormattedReferences(
+    __in BURN_VARIABLES* pVariables,
+    __deref_inout_ecount_opt(*pcText) LPWSTR** prgsczText,
+    __inout UINT* pcText
+    )
+{
+    HRESULT hr = S_OK;
+    BOOL* rgfAppended = NULL;
+    BOOL fAppended = TRUE;
+
+    ::EnterCriticalSection(&pVariables->csAccess);
+
+    if (!pVariables->cVariables)
+    {
+        ExitFunction();
+    }
+
+    rgfAppended = static_cast<BOOL*>(MemAlloc(sizeof(BOOL) * pVariables->cVariables, TRUE));
+    ExitOnNull(rgfAppended, hr, E_OUTOFMEMORY, "Failed to allocate formatted variable references.");
+
+    // A value appended for one variable can mention another formatted variable, so repeat until nothing is added.
+    // Names are matched anywhere in the text which may append more than formatting would read but never less.
+    while (fAppended)
+    {
+        fAppended = FALSE;
+
+        for (DWORD i = 0; i < pVariables->cVariables; ++i)
+        {
+            BURN_VARIABLE* pVariable = pVariables->rgVariables + i;
+
+            if (rgfAppended[i] || BURN_VARIANT_TYPE_FORMATTED != pVariable->Value.Type || !pVariable->Value.sczValue)
+            {
+                continue;
+            }
+
+            for (UINT j = 0; j < *pcText; ++j)
+            {
+                if (wcsstr((*prgsczText)[j], pVariable->sczName))
+                {
+                    hr = StrArrayAllocString(prgsczText, pcText, pVariable->Value.sczValue, 0);
+                    ExitOnFailure(hr, "Failed to append value of formatted variable: %ls", pVariable->sczName);
+
+                    rgfAppended[i] = TRUE;
+                    fAppended = TRUE;
+                    break;
+                }
+            }
+        }
+    }
+
+LExit:
+    ::LeaveCriticalSection(&pVariables->csAccess);
+
+    ReleaseMem(rgfAppended);
+
+    return hr;
+}
+
 
 // internal function definitions
 
@@ -1197,7 +1279,7 @@ static HRESULT FormatString(
     for (;;)
     {
         // scan for opening '['
-        wzOpen = wcschr(wzRead, L'[');
+        wzOpen = StrFindChar(wzRead, cchIn - (wzRead - wzIn), L'[');
         if (!wzOpen)
         {
             // end reached, append the remainder of the string and end loop
@@ -1207,7 +1289,7 @@ static HRESULT FormatString(
         }
 
         // scan for closing ']'
-        wzClose = wcschr(wzOpen + 1, L']');
+        wzClose = StrFindChar(wzOpen + 1, cchIn - (wzOpen + 1 - wzIn), L']');
         if (!wzClose)
         {
             // end reached, treat unterminated expander as literal
@@ -1669,6 +1751,7 @@ static HRESULT SetVariableValue(
 {
     HRESULT hr = S_OK;
     DWORD iVariable = 0;
+    BOOL fChanged = FALSE;
 
     ::EnterCriticalSection(&pVariables->csAccess);
 
@@ -1762,9 +1845,17 @@ static HRESULT SetVariableValue(
     }
 
     // Update variable value.
+    fChanged = !BVariantEquals(&pVariables->rgVariables[iVariable].Value, pVariant);
+
     hr = BVariantSetValue(&pVariables->rgVariables[iVariable].Value, pVariant);
     ExitOnFailure(hr, "Failed to set value of variable: %ls", wzVariable);
 
+    // Setting the value a variable already has keeps its stamp so plans that read it stay valid.
+    if (fChanged)
+    {
+        pVariables->rgVariables[iVariable].dwChangeStamp = ++pVariables->dwChangeStamp;
+    }
+
 LExit:
     ::LeaveCriticalSection(&pVariables->csAccess);
 
@@ -43,6 +43,7 @@ typedef struct _BURN_VARIABLE
     BURN_VARIANT Value;
     BOOL fHidden;
     BOOL fPersisted;
+    DWORD dwChangeStamp; // 0 until the value first changes.
 
     // used for late initialization of built-in variables
     BURN_VARIABLE_INTERNAL_TYPE internalType;
@@ -56,6 +57,7 @@ typedef struct _BURN_VARIABLES
     DWORD dwMaxVariables;
     DWORD cVariables;
     BURN_VARIABLE* rgVariables;
+    DWORD dwChangeStamp; // last stamp given to a variable whose value changed.
 } BURN_VARIABLES;
 
 
@@ -181,10 +183,20 @@ HRESULT VariableIsHidden(
     __in_z LPCWSTR wzVariable,
     __out BOOL* pfHidden
     );
+HRESULT VariableGetChangeStamp(
+    __in BURN_VARIABLES* pVariables,
+    __in_z LPCWSTR wzVariable,
+    __out DWORD* pdwChangeStamp
+    );
 BOOL VariableIsHiddenCommandLine(
     __in BURN_VARIABLES* pVariables,
     __in_z LPCWSTR wzVariable
     );
+HRESULT VariableExpandFormattedReferences(
+    __in BURN_VARIABLES* pVariables,
+    __deref_inout_ecount_opt(*pcText) LPWSTR** prgsczText,
+    __inout UINT* pcText
+    );
 
 #if defined(__cplusplus)
 }
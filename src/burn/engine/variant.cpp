@@ -10,6 +10,10 @@ static HRESULT GetVersionInternal(
     __in BOOL fSilent,
     __out VERUTIL_VERSION** ppValue
     );
+static BOOL StringsEqual(
+    __in_z_opt LPCWSTR wzLeft,
+    __in_z_opt LPCWSTR wzRight
+    );
 
 // function definitions
 
@@ -133,7 +137,16 @@ static HRESULT GetVersionInternal(
         break;
     case BURN_VARIANT_TYPE_FORMATTED: __fallthrough;
     case BURN_VARIANT_TYPE_STRING:
-        hr = VerParseVersion(pVariant->sczValue, 0, FALSE, ppValue);
+        // Don't keep hidden values alive in the shared version cache.
+        if (fHidden)
+        {
+            hr = VerParseVersion(pVariant->sczValue, 0, FALSE, ppValue);
+        }
+        else
+        {
+            hr = VerCacheParseVersion(pVariant->sczValue, 0, FALSE, ppValue);
+        }
+
         if (SUCCEEDED(hr) && !fSilent && (*ppValue)->fInvalid)
         {
             LogId(REPORT_WARNING, MSG_INVALID_VERSION_COERSION, fHidden ? L"*****" : pVariant->sczValue);
@@ -319,3 +332,44 @@ extern "C" HRESULT BVariantChangeType(
 LExit:
     return hr;
 }
+
+extern "C" BOOL BVariantEquals(
+    __in BURN_VARIANT* pLeft,
+    __in BURN_VARIANT* pRight
+    )
+{
+    if (pLeft->Type != pRight->Type)
+    {
+        return FALSE;
+    }
+
+    switch (pLeft->Type)
+    {
+    case BURN_VARIANT_TYPE_NONE:
+        return TRUE;
+    case BURN_VARIANT_TYPE_NUMERIC:
+        return pLeft->llValue == pRight->llValue;
+    case BURN_VARIANT_TYPE_FORMATTED: __fallthrough;
+    case BURN_VARIANT_TYPE_STRING:
+        return StringsEqual(pLeft->sczValue, pRight->sczValue);
+    case BURN_VARIANT_TYPE_VERSION:
+        return StringsEqual(pLeft->pValue ? pLeft->pValue->sczVersion : NULL, pRight->pValue ? pRight->pValue->sczVersion : NULL);
+    default:
+        return FALSE;
+    }
+}
+
+// internal function definitions
+
+static BOOL StringsEqual(
+    __in_z_opt LPCWSTR wzLeft,
+    __in_z_opt LPCWSTR wzRight
+    )
+{
+    if (!wzLeft || !wzRight)
+    {
+        return wzLeft == wzRight;
+    }
+
+    return CSTR_EQUAL == ::CompareStringOrdinal(wzLeft, -1, wzRight, -1, FALSE);
+}
@@ -94,6 +94,14 @@ HRESULT BVariantChangeType(
     __in BURN_VARIANT* pVariant,
     __in BURN_VARIANT_TYPE type
     );
+/********************************************************************
+BVariantEquals - returns TRUE when both variants have the same type and
+                 the same value. Strings and versions compare ordinally.
+********************************************************************/
+BOOL BVariantEquals(
+    __in BURN_VARIANT* pLeft,
+    __in BURN_VARIANT* pRight
+    );
 
 #if defined(__cplusplus)
 }
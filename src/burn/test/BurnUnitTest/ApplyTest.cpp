@@ -0,0 +1,611 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+namespace Microsoft
+{
+namespace Tools
+{
+namespace WindowsInstallerXml
+{
+namespace Test
+{
+namespace Bootstrapper
+{
+    using namespace System;
+    using namespace Xunit;
+
+static LPCWSTR APPLY_TEST_PIPE_NAME = L"BurnUnitTest.ApplyTest";
+
+// The elevated process parses its own copy of the manifest.
+static LPWSTR vsczApplyTestElevatedManifest = NULL;
+
+struct APPLY_TEST_BA
+{
+    LPCWSTR wzCancelPayloadId;
+    BOOL fCanceled;
+    DWORD dwOverallPercentage;
+    BOOL fProgressWentBackwards;
+    LPWSTR sczMessages;
+};
+
+static BOOL STDAPICALLTYPE ApplyTest_ShellExecuteExW(
+    __inout LPSHELLEXECUTEINFOW lpExecInfo
+    );
+static DWORD CALLBACK ApplyTest_ElevationThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static DWORD CALLBACK ApplyTest_BAThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static HRESULT ApplyTest_ProcessBAMessage(
+    __in APPLY_TEST_BA* pBA,
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in PIPE_MESSAGE* pMsg
+    );
+static void LoadEngineState(
+    __in LPCWSTR wzDocument,
+    __in BURN_ENGINE_STATE* pEngineState
+    );
+
+    public ref class ApplyTest : BurnUnitTest
+    {
+    public:
+        ApplyTest(BurnTestFixture^ fixture) : BurnUnitTest(fixture)
+        {
+        }
+
+        [Fact]
+        void ApplyCacheCompletesPayloadsInOrderTest()
+        {
+            HRESULT hr = S_OK;
+            APPLY_TEST_BA ba = { };
+
+            try
+            {
+                hr = CachePerMachinePackage(L"Bootstrapper.ApplyTest.InOrder", FALSE, &ba);
+                NativeAssert::Succeeded(hr, "Failed to cache package.");
+
+                // Without Chain/@ParallelCache each payload is acquired and completed before the next one.
+                NativeAssert::StringEqual(
+                    L"acquire first.exe;verify first.exe;complete first.exe 0x0;"
+                    L"acquire second.exe;verify second.exe;complete second.exe 0x0;"
+                    L"acquire third.exe;verify third.exe;complete third.exe 0x0;",
+                    ba.sczMessages);
+                Assert::False(ba.fProgressWentBackwards, "Cache progress went backwards.");
+                Assert::Equal<DWORD>(100, ba.dwOverallPercentage);
+            }
+            finally
+            {
+                ReleaseStr(ba.sczMessages);
+            }
+        }
+
+        [Fact]
+        void ApplyCachePipelinesPayloadsTest()
+        {
+            HRESULT hr = S_OK;
+            APPLY_TEST_BA ba = { };
+
+            try
+            {
+                hr = CachePerMachinePackage(L"Bootstrapper.ApplyTest.Pipelined", TRUE, &ba);
+                NativeAssert::Succeeded(hr, "Failed to cache package.");
+
+                // Each payload is acquired while the elevated process completes the one before it,
+                // then the recorded completion is replayed to the BA.
+                NativeAssert::StringEqual(
+                    L"acquire first.exe;acquire second.exe;verify first.exe;complete first.exe 0x0;"
+                    L"acquire third.exe;verify second.exe;complete second.exe 0x0;"
+                    L"verify third.exe;complete third.exe 0x0;",
+                    ba.sczMessages);
+                Assert::False(ba.fProgressWentBackwards, "Cache progress went backwards.");
+                Assert::Equal<DWORD>(100, ba.dwOverallPercentage);
+            }
+            finally
+            {
+                ReleaseStr(ba.sczMessages);
+            }
+        }
+
+        [Fact]
+        void ApplyCacheCancelDuringReplayTest()
+        {
+            HRESULT hr = S_OK;
+            APPLY_TEST_BA ba = { };
+            String^ messages = nullptr;
+
+            try
+            {
+                // The first verify progress of the first payload only comes from replaying its recording.
+                ba.wzCancelPayloadId = L"first.exe";
+
+                hr = CachePerMachinePackage(L"Bootstrapper.ApplyTest.Cancel", TRUE, &ba);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), hr, "Cache after cancel during replay.");
+
+                messages = gcnew String(ba.sczMessages);
+                Assert::StartsWith("acquire first.exe;acquire second.exe;verify first.exe;complete first.exe 0x80070642;", messages);
+                Assert::DoesNotContain("verify second.exe", messages);
+                Assert::DoesNotContain("third.exe", messages);
+            }
+            finally
+            {
+                ReleaseStr(ba.sczMessages);
+            }
+        }
+
+    private:
+        // The package is per-machine here so its payloads are completed by the elevated process.
+        // That process parses it as per-user so the test can cache without being elevated.
+        HRESULT CachePerMachinePackage(LPCWSTR wzCacheId, BOOL fParallelCache, APPLY_TEST_BA* pBA)
+        {
+            HRESULT hr = S_OK;
+            HRESULT hrCache = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            BURN_PIPE_CONNECTION* pConnection = &engineState.companionConnection;
+            BURN_APPLY_CONTEXT applyContext = { };
+            BURN_PACKAGE* pPackage = NULL;
+            LPCWSTR rgwzPayloadIds[] = { L"first.exe", L"second.exe", L"third.exe" };
+            LPWSTR rgsczPayloadPaths[countof(rgwzPayloadIds)] = { };
+            LPWSTR rgsczPayloadHashes[countof(rgwzPayloadIds)] = { };
+            DWORD rgcbPayloads[countof(rgwzPayloadIds)] = { };
+            LPWSTR sczTempDirectory = NULL;
+            LPWSTR sczManifest = NULL;
+            HANDLE hBAThread = NULL;
+
+            engineState.sczBundleEngineWorkingPath = L"tests\\ignore\\this\\path\\to\\burn.exe";
+            engineState.registration.sczId = L"{D6E2C3F1-4E0B-4A4B-9C3E-2B7A1F6E8D20}";
+            engineState.registration.sczExecutableName = L"setup.exe";
+            engineState.userExperience.fEngineActive = TRUE;
+
+            ::InitializeCriticalSection(&engineState.userExperience.csEngineActive);
+            ::InitializeCriticalSection(&applyContext.csApply);
+
+            try
+            {
+                ShelFunctionOverride(ApplyTest_ShellExecuteExW);
+
+                hr = PathCreateTempDirectory(NULL, L"ApplyTest%05d", 10000, &sczTempDirectory);
+                NativeAssert::Succeeded(hr, "Failed to create temp directory.");
+
+                for (DWORD i = 0; i < countof(rgwzPayloadIds); ++i)
+                {
+                    CreatePayload(sczTempDirectory, rgwzPayloadIds[i], rgsczPayloadPaths + i, rgsczPayloadHashes + i, rgcbPayloads + i);
+                }
+
+                FormatManifest(wzCacheId, L"no", rgsczPayloadPaths, rgsczPayloadHashes, rgcbPayloads, &vsczApplyTestElevatedManifest);
+                FormatManifest(wzCacheId, L"yes", rgsczPayloadPaths, rgsczPayloadHashes, rgcbPayloads, &sczManifest);
+
+                LoadEngineState(sczManifest, &engineState);
+
+                hr = CacheInitializeSources(&engineState.cache, &engineState.registration, &engineState.variables);
+                NativeAssert::Succeeded(hr, "Failed to initialize cache sources.");
+
+                hBAThread = ConnectTestBA(&engineState, pBA);
+
+                hr = ElevationElevate(&engineState, WM_BURN_ELEVATE, NULL);
+                TestThrowOnFailure(hr, L"Failed to elevate.");
+
+                hr = PackageFindById(&engineState.packages, L"Package", &pPackage);
+                NativeAssert::Succeeded(hr, "Failed to find package.");
+
+                engineState.plan.pCache = &engineState.cache;
+                engineState.plan.pPayloads = &engineState.payloads;
+
+                hr = PlanLayoutPackage(&engineState.plan, pPackage, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to plan cache package.");
+
+                applyContext.fParallelCache = fParallelCache;
+
+                hrCache = ApplyCache(INVALID_HANDLE_VALUE, &engineState.userExperience, &engineState.variables, &engineState.plan, pConnection->hCachePipe, &applyContext);
+
+                hr = BurnPipeTerminateChildProcess(pConnection, 0, FALSE);
+                TestThrowOnFailure(hr, L"Failed to terminate elevated process.");
+
+                DisconnectTestBA(&engineState, hBAThread);
+            }
+            finally
+            {
+                if (engineState.cache.fInitializedCache)
+                {
+                    CacheRemovePackage(&engineState.cache, FALSE, L"Package", wzCacheId);
+                }
+
+                if (sczTempDirectory)
+                {
+                    DirEnsureDelete(sczTempDirectory, TRUE, TRUE);
+                }
+
+                for (DWORD i = 0; i < countof(rgwzPayloadIds); ++i)
+                {
+                    ReleaseStr(rgsczPayloadPaths[i]);
+                    ReleaseStr(rgsczPayloadHashes[i]);
+                }
+
+                ReleaseHandle(hBAThread);
+                ReleaseNullStr(vsczApplyTestElevatedManifest);
+                ReleaseStr(sczManifest);
+                ReleaseStr(sczTempDirectory);
+
+                PlanUninitialize(&engineState.plan);
+                PipeRpcUninitiailize(&engineState.userExperience.hBARpcPipe);
+                PackagesUninitialize(&engineState.packages);
+                PayloadsUninitialize(&engineState.payloads);
+                VariablesUninitialize(&engineState.variables);
+                CacheUninitialize(&engineState.cache);
+                BurnPipeConnectionUninitialize(pConnection);
+
+                ::DeleteCriticalSection(&applyContext.csApply);
+                ::DeleteCriticalSection(&engineState.userExperience.csEngineActive);
+            }
+
+            return hrCache;
+        }
+
+        void CreatePayload(LPCWSTR wzDirectory, LPCWSTR wzPayloadId, LPWSTR* psczPath, LPWSTR* psczHash, DWORD* pcbPayload)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczGuid = NULL;
+            LPWSTR sczContent = NULL;
+            BYTE rgbHash[SHA512_HASH_LEN] = { };
+
+            try
+            {
+                // Unique content keeps an earlier run's content store entry from satisfying the payload.
+                hr = GuidCreate(&sczGuid);
+                NativeAssert::Succeeded(hr, "Failed to create guid.");
+
+                hr = StrAllocFormatted(&sczContent, L"%ls %ls", wzPayloadId, sczGuid);
+                NativeAssert::Succeeded(hr, "Failed to format payload content.");
+
+                *pcbPayload = lstrlenW(sczContent) * sizeof(WCHAR);
+
+                hr = PathConcat(wzDirectory, wzPayloadId, psczPath);
+                NativeAssert::Succeeded(hr, "Failed to get payload path.");
+
+                hr = FileWrite(*psczPath, FILE_ATTRIBUTE_NORMAL, reinterpret_cast<LPCBYTE>(sczContent), *pcbPayload, NULL);
+                NativeAssert::Succeeded(hr, "Failed to write payload.");
+
+                hr = CrypHashBuffer(reinterpret_cast<LPCBYTE>(sczContent), *pcbPayload, PROV_RSA_AES, CALG_SHA_512, rgbHash, sizeof(rgbHash));
+                NativeAssert::Succeeded(hr, "Failed to hash payload.");
+
+                hr = StrAllocHexEncode(rgbHash, sizeof(rgbHash), psczHash);
+                NativeAssert::Succeeded(hr, "Failed to encode payload hash.");
+            }
+            finally
+            {
+                ReleaseStr(sczContent);
+                ReleaseStr(sczGuid);
+            }
+        }
+
+        void FormatManifest(LPCWSTR wzCacheId, LPCWSTR wzPerMachine, LPWSTR* rgsczPayloadPaths, LPWSTR* rgsczPayloadHashes, DWORD* rgcbPayloads, LPWSTR* psczManifest)
+        {
+            HRESULT hr = S_OK;
+
+            hr = StrAllocFormatted(psczManifest,
+                L"<BurnManifest>"
+                L"    <Payload Id='first.exe' FilePath='first.exe' Packaging='external' SourcePath='%ls' Hash='%ls' FileSize='%u' />"
+                L"    <Payload Id='second.exe' FilePath='second.exe' Packaging='external' SourcePath='%ls' Hash='%ls' FileSize='%u' />"
+                L"    <Payload Id='third.exe' FilePath='third.exe' Packaging='external' SourcePath='%ls' Hash='%ls' FileSize='%u' />"
+                L"    <Chain>"
+                L"        <ExePackage Id='Package' Cache='keep' CacheId='%ls' InstallSize='1' Size='1' PerMachine='%ls' Permanent='yes' Vital='yes' DetectCondition='' InstallArguments='' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+                L"            <PayloadRef Id='first.exe' />"
+                L"            <PayloadRef Id='second.exe' />"
+                L"            <PayloadRef Id='third.exe' />"
+                L"        </ExePackage>"
+                L"    </Chain>"
+                L"</BurnManifest>",
+                rgsczPayloadPaths[0], rgsczPayloadHashes[0], rgcbPayloads[0],
+                rgsczPayloadPaths[1], rgsczPayloadHashes[1], rgcbPayloads[1],
+                rgsczPayloadPaths[2], rgsczPayloadHashes[2], rgcbPayloads[2],
+                wzCacheId, wzPerMachine);
+            NativeAssert::Succeeded(hr, "Failed to format manifest.");
+        }
+
+        HANDLE ConnectTestBA(BURN_ENGINE_STATE* pEngineState, APPLY_TEST_BA* pBA)
+        {
+            HRESULT hr = S_OK;
+            HANDLE hPipe = INVALID_HANDLE_VALUE;
+            HANDLE hBAThread = NULL;
+
+            hr = PipeCreate(APPLY_TEST_PIPE_NAME, NULL, &hPipe);
+            NativeAssert::Succeeded(hr, "Failed to create BA pipe.");
+
+            PipeRpcInitialize(&pEngineState->userExperience.hBARpcPipe, hPipe, TRUE);
+
+            hBAThread = ::CreateThread(NULL, 0, ApplyTest_BAThreadProc, pBA, 0, NULL);
+            Assert::True(NULL != hBAThread, "Failed to create BA thread.");
+
+            hr = PipeServerWaitForClientConnect(hBAThread, hPipe);
+            NativeAssert::Succeeded(hr, "Failed to wait for BA to connect to pipe.");
+
+            return hBAThread;
+        }
+
+        void DisconnectTestBA(BURN_ENGINE_STATE* pEngineState, HANDLE hBAThread)
+        {
+            HRESULT hr = S_OK;
+            DWORD dwExitCode = 0;
+
+            hr = PipeWriteDisconnect(pEngineState->userExperience.hBARpcPipe.hPipe);
+            NativeAssert::Succeeded(hr, "Failed to disconnect BA.");
+
+            hr = ThrdWaitForCompletion(hBAThread, INFINITE, &dwExitCode);
+            NativeAssert::Succeeded(hr, "Failed to wait for BA thread.");
+            NativeAssert::Succeeded(static_cast<HRESULT>(dwExitCode), "BA thread failed.");
+        }
+    };
+
+
+static BOOL STDAPICALLTYPE ApplyTest_ShellExecuteExW(
+    __inout LPSHELLEXECUTEINFOW lpExecInfo
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR scz = NULL;
+
+    hr = StrAllocString(&scz, lpExecInfo->lpParameters, 0);
+    ExitOnFailure(hr, "Failed to copy arguments.");
+
+    // Pretend this thread is the elevated process.
+    lpExecInfo->hProcess = ::CreateThread(NULL, 0, ApplyTest_ElevationThreadProc, scz, 0, NULL);
+    ExitOnNullWithLastError(lpExecInfo->hProcess, hr, "Failed to create thread.");
+    scz = NULL;
+
+LExit:
+    ReleaseStr(scz);
+
+    return SUCCEEDED(hr);
+}
+
+static DWORD CALLBACK ApplyTest_ElevationThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczArguments = (LPWSTR)lpThreadParameter;
+    BURN_ENGINE_STATE engineState = { };
+    BURN_PIPE_CONNECTION* pConnection = &engineState.companionConnection;
+    HANDLE hLock = NULL;
+    DWORD dwChildExitCode = 0;
+    BOOL fRestart = FALSE;
+    BOOL fApplying = FALSE;
+
+    LoadEngineState(vsczApplyTestElevatedManifest, &engineState);
+
+    StrAlloc(&pConnection->sczName, MAX_PATH);
+    StrAlloc(&pConnection->sczSecret, MAX_PATH);
+
+    // parse command line arguments
+    if (3 != swscanf_s(sczArguments, L"-q -burn.elevated %s %s %u", pConnection->sczName, MAX_PATH, pConnection->sczSecret, MAX_PATH, &pConnection->dwProcessId))
+    {
+        hr = E_INVALIDARG;
+        ExitOnFailure(hr, "Failed to parse argument string.");
+    }
+
+    // set up connection with per-user process
+    hr = BurnPipeChildConnect(pConnection, TRUE);
+    ExitOnFailure(hr, "Failed to connect to per-user process.");
+
+    hr = ElevationChildPumpMessages(pConnection->hPipe, pConnection->hCachePipe, &engineState.approvedExes, &engineState.cache, &engineState.containers, &engineState.packages, &engineState.payloads, &engineState.variables, &engineState.registration, &engineState.userExperience, &hLock, &dwChildExitCode, &fRestart, &fApplying);
+    ExitOnFailure(hr, "Failed while pumping messages in child 'process'.");
+
+LExit:
+    BurnPipeConnectionUninitialize(pConnection);
+    PackagesUninitialize(&engineState.packages);
+    PayloadsUninitialize(&engineState.payloads);
+    VariablesUninitialize(&engineState.variables);
+    CacheUninitialize(&engineState.cache);
+    ReleaseStr(sczArguments);
+
+    return FAILED(hr) ? (DWORD)hr : dwChildExitCode;
+}
+
+static DWORD CALLBACK ApplyTest_BAThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    APPLY_TEST_BA* pBA = reinterpret_cast<APPLY_TEST_BA*>(lpThreadParameter);
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    PIPE_RPC_HANDLE hRpcPipe = { INVALID_HANDLE_VALUE };
+    PIPE_MESSAGE msg = { };
+
+    hr = PipeClientConnect(APPLY_TEST_PIPE_NAME, &hPipe);
+    ExitOnFailure(hr, "Failed to connect BA to pipe.");
+
+    PipeRpcInitialize(&hRpcPipe, hPipe, TRUE);
+    hPipe = INVALID_HANDLE_VALUE;
+
+    while (S_OK == (hr = PipeRpcReadMessage(&hRpcPipe, &msg)))
+    {
+        hr = ApplyTest_ProcessBAMessage(pBA, &hRpcPipe, &msg);
+        ExitOnFailure(hr, "Failed to process message %u.", msg.dwMessageType);
+
+        ReleasePipeMessage(&msg);
+    }
+    ExitOnFailure(hr, "Failed to read message from pipe.");
+
+    hr = S_OK;
+
+LExit:
+    ReleasePipeMessage(&msg);
+    PipeRpcUninitiailize(&hRpcPipe);
+    ReleasePipeHandle(hPipe);
+
+    return static_cast<DWORD>(hr);
+}
+
+static HRESULT ApplyTest_ProcessBAMessage(
+    __in APPLY_TEST_BA* pBA,
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in PIPE_MESSAGE* pMsg
+    )
+{
+    HRESULT hr = S_OK;
+    HRESULT hrResponse = S_FALSE;
+    const BYTE* pbData = static_cast<const BYTE*>(pMsg->pvData);
+    SIZE_T iData = 0;
+    DWORD cbArgs = 0;
+    DWORD dwApiVersion = 0;
+    LPWSTR sczPackageId = NULL;
+    LPWSTR sczPayloadId = NULL;
+    DWORD64 qwProgress = 0;
+    DWORD64 qwTotal = 0;
+    DWORD dwOverallPercentage = 0;
+    DWORD dwStatus = 0;
+    BUFF_BUFFER bufferResponse = { };
+
+    switch (pMsg->dwMessageType)
+    {
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREBEGIN: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREPROGRESS: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYBEGIN: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYPROGRESS: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYCOMPLETE:
+        // The args start right after their size.
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &cbArgs);
+        ExitOnFailure(hr, "Failed to read size of args.");
+
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwApiVersion);
+        ExitOnFailure(hr, "Failed to read API version of args.");
+
+        hr = BuffReadString(pbData, pMsg->cbData, &iData, &sczPackageId);
+        ExitOnFailure(hr, "Failed to read package id of args.");
+
+        hr = BuffReadString(pbData, pMsg->cbData, &iData, &sczPayloadId);
+        ExitOnFailure(hr, "Failed to read payload id of args.");
+        break;
+
+    default:
+        // Everything else gets the engine's defaults.
+        break;
+    }
+
+    switch (pMsg->dwMessageType)
+    {
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREBEGIN:
+        hr = StrAllocConcatFormatted(&pBA->sczMessages, L"acquire %ls;", sczPayloadId);
+        ExitOnFailure(hr, "Failed to record acquire begin.");
+
+        if (pBA->fCanceled)
+        {
+            hr = BuffWriteNumberToBuffer(&bufferResponse, sizeof(BA_ONCACHEACQUIREBEGIN_RESULTS));
+            ExitOnFailure(hr, "Failed to write size of OnCacheAcquireBegin results.");
+
+            hr = BuffWriteNumberToBuffer(&bufferResponse, TRUE);
+            ExitOnFailure(hr, "Failed to write cancel of OnCacheAcquireBegin results.");
+
+            hr = BuffWriteNumberToBuffer(&bufferResponse, BOOTSTRAPPER_CACHE_OPERATION_NONE);
+            ExitOnFailure(hr, "Failed to write action of OnCacheAcquireBegin results.");
+
+            hrResponse = S_OK;
+        }
+        break;
+
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYBEGIN:
+        hr = StrAllocConcatFormatted(&pBA->sczMessages, L"verify %ls;", sczPayloadId);
+        ExitOnFailure(hr, "Failed to record verify begin.");
+
+        if (pBA->fCanceled)
+        {
+            hr = BuffWriteNumberToBuffer(&bufferResponse, sizeof(BA_ONCACHEVERIFYBEGIN_RESULTS));
+            ExitOnFailure(hr, "Failed to write size of OnCacheVerifyBegin results.");
+
+            hr = BuffWriteNumberToBuffer(&bufferResponse, TRUE);
+            ExitOnFailure(hr, "Failed to write cancel of OnCacheVerifyBegin results.");
+
+            hrResponse = S_OK;
+        }
+        break;
+
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIREPROGRESS: __fallthrough;
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYPROGRESS:
+        hr = BuffReadNumber64(pbData, pMsg->cbData, &iData, &qwProgress);
+        ExitOnFailure(hr, "Failed to read progress of args.");
+
+        hr = BuffReadNumber64(pbData, pMsg->cbData, &iData, &qwTotal);
+        ExitOnFailure(hr, "Failed to read total of args.");
+
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwOverallPercentage);
+        ExitOnFailure(hr, "Failed to read overall percentage of args.");
+
+        if (dwOverallPercentage < pBA->dwOverallPercentage)
+        {
+            pBA->fProgressWentBackwards = TRUE;
+        }
+
+        pBA->dwOverallPercentage = dwOverallPercentage;
+
+        // Once cancelled, the BA keeps cancelling so a retried acquisition stops too.
+        if (BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYPROGRESS == pMsg->dwMessageType && pBA->wzCancelPayloadId && CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, pBA->wzCancelPayloadId, -1, sczPayloadId, -1))
+        {
+            pBA->fCanceled = TRUE;
+        }
+
+        if (pBA->fCanceled)
+        {
+            // Both progress results are just a cancel.
+            hr = BuffWriteNumberToBuffer(&bufferResponse, BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYPROGRESS == pMsg->dwMessageType ? sizeof(BA_ONCACHEVERIFYPROGRESS_RESULTS) : sizeof(BA_ONCACHEACQUIREPROGRESS_RESULTS));
+            ExitOnFailure(hr, "Failed to write size of progress results.");
+
+            hr = BuffWriteNumberToBuffer(&bufferResponse, TRUE);
+            ExitOnFailure(hr, "Failed to write cancel of progress results.");
+
+            hrResponse = S_OK;
+        }
+        break;
+
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEVERIFYCOMPLETE:
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwStatus);
+        ExitOnFailure(hr, "Failed to read status of OnCacheVerifyComplete args.");
+
+        hr = StrAllocConcatFormatted(&pBA->sczMessages, L"complete %ls 0x%x;", sczPayloadId, dwStatus);
+        ExitOnFailure(hr, "Failed to record verify complete.");
+        break;
+    }
+
+    hr = PipeRpcResponse(phRpcPipe, pMsg->dwMessageType, hrResponse, bufferResponse.pbData, bufferResponse.cbData);
+    ExitOnFailure(hr, "Failed to send response to engine.");
+
+LExit:
+    ReleaseBuffer(bufferResponse);
+    ReleaseStr(sczPayloadId);
+    ReleaseStr(sczPackageId);
+
+    return hr;
+}
+
+static void LoadEngineState(
+    __in LPCWSTR wzDocument,
+    __in BURN_ENGINE_STATE* pEngineState
+    )
+{
+    HRESULT hr = S_OK;
+    IXMLDOMElement* pixeBundle = NULL;
+
+    hr = VariableInitialize(&pEngineState->variables);
+    TestThrowOnFailure(hr, L"Failed to initialize variables.");
+
+    BurnPipeConnectionInitialize(&pEngineState->companionConnection);
+
+    hr = CacheInitialize(&pEngineState->cache, &pEngineState->internalCommand);
+    TestThrowOnFailure(hr, L"Failed to initialize cache.");
+
+    // load XML document
+    LoadBundleXmlHelper(wzDocument, &pixeBundle);
+
+    hr = PayloadsParseFromXml(&pEngineState->payloads, &pEngineState->containers, &pEngineState->layoutPayloads, pixeBundle);
+    TestThrowOnFailure(hr, L"Failed to parse payloads from manifest.");
+
+    hr = PackagesParseFromXml(&pEngineState->packages, &pEngineState->payloads, pixeBundle);
+    TestThrowOnFailure(hr, L"Failed to parse packages from manifest.");
+
+    ReleaseObject(pixeBundle);
+}
+}
+}
+}
+}
+}
@@ -19,6 +19,11 @@ static DWORD CALLBACK CacheTestProgressRoutine(
     __in_opt LPVOID lpData
     );
 
+static const DWORD CACHE_TEST_CHUNK_SIZE = 4096;
+
+// SHA-512 of TestData\CacheTest\CacheSignatureTest.File, which is also the name of its content store entry.
+static const LPCWSTR CACHE_TEST_SIGNATURE_FILE_HASH = L"25E61CD83485062B70713AEBDDD3FE4992826CB121466FDDC8DE3EACB1E42F39D4BDD8455D95EEC8C9529CED4C0296AB861931FE2C86DF2F2B4E8D259A6D9223";
+
 typedef struct _CACHE_TEST_CONTEXT
 {
 } CACHE_TEST_CONTEXT;
@@ -144,28 +149,14 @@ namespace Bootstrapper
             BURN_PACKAGE package = { };
             BURN_PAYLOAD payload = { };
             LPWSTR sczPayloadPath = NULL;
-            BYTE* pb = NULL;
-            DWORD cb = NULL;
             CACHE_TEST_CONTEXT context = { };
 
             try
             {
-                pin_ptr<const wchar_t> dataDirectory = PtrToStringChars(this->TestContext->TestDirectory);
-                hr = PathConcat(dataDirectory, L"TestData\\CacheTest\\CacheSignatureTest.File", &sczPayloadPath);
-                Assert::True(S_OK == hr, "Failed to get path to test file.");
-                Assert::True(FileExistsEx(sczPayloadPath, NULL), "Test file does not exist.");
-
-                hr = StrAllocHexDecode(L"25e61cd83485062b70713aebddd3fe4992826cb121466fddc8de3eacb1e42f39d4bdd8455d95eec8c9529ced4c0296ab861931fe2c86df2f2b4e8d259a6d9223", &pb, &cb);
-                Assert::Equal(S_OK, hr);
+                InitializeSignatureTestPayload(L"CacheSignatureTest.PayloadKey", &payload, &sczPayloadPath);
 
                 package.fPerMachine = FALSE;
                 package.sczCacheId = L"Bootstrapper.CacheTest.CacheSignatureTest";
-                payload.sczKey = L"CacheSignatureTest.PayloadKey";
-                payload.sczFilePath = L"CacheSignatureTest.File";
-                payload.pbHash = pb;
-                payload.cbHash = cb;
-                payload.qwFileSize = 27;
-                payload.verification = BURN_PAYLOAD_VERIFICATION_HASH;
 
                 hr = CacheInitialize(&cache, &internalCommand);
                 TestThrowOnFailure(hr, L"Failed initialize cache.");
@@ -175,19 +166,438 @@ namespace Bootstrapper
             }
             finally
             {
-                ReleaseMem(pb);
+                ReleaseMem(payload.pbHash);
+                ReleaseStr(sczPayloadPath);
+
+                DeleteTestFile(Path::Combine(Environment::GetFolderPath(Environment::SpecialFolder::LocalApplicationData), "Package Cache\\Bootstrapper.CacheTest.CacheSignatureTest\\CacheSignatureTest.File"));
+                DeleteTestFile(GetSignatureTestStorePath());
+
+                CacheUninitialize(&cache);
+            }
+        }
+
+        [Fact]
+        void CacheCertificateChainTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_PAYLOAD payload = { };
+            LPWSTR sczSignedPath = NULL;
+            HCERTSTORE hStore = NULL;
+            HCRYPTMSG hMsg = NULL;
+            CMSG_SIGNER_INFO* pSignerInfo = NULL;
+            DWORD cbSignerInfo = 0;
+            CERT_INFO certInfo = { };
+            PCCERT_CONTEXT pCertContext = NULL;
+            CERT_CHAIN_PARA chainPara = { };
+            PCCERT_CHAIN_CONTEXT pChainContext = NULL;
+
+            try
+            {
+                pin_ptr<const wchar_t> dataDirectory = PtrToStringChars(this->TestContext->TestDirectory);
+                hr = PathConcat(dataDirectory, L"TestData\\CacheTest\\CacheCertificateTest.cab", &sczSignedPath);
+                Assert::True(S_OK == hr, "Failed to get path to signed test file.");
+
+                // Build the signer's chain from the certificates embedded in the signature so the
+                // comparison does not depend on the test certificate being trusted on the machine.
+                Assert::True(::CryptQueryObject(CERT_QUERY_OBJECT_FILE, sczSignedPath, CERT_QUERY_CONTENT_FLAG_PKCS7_SIGNED_EMBED, CERT_QUERY_FORMAT_FLAG_BINARY, 0, NULL, NULL, NULL, &hStore, &hMsg, NULL) ? true : false, "Failed to read signature from test file.");
+                Assert::True(::CryptMsgGetParam(hMsg, CMSG_SIGNER_INFO_PARAM, 0, NULL, &cbSignerInfo) ? true : false, "Failed to get size of signer info.");
+
+                pSignerInfo = static_cast<CMSG_SIGNER_INFO*>(MemAlloc(cbSignerInfo, TRUE));
+                Assert::True(NULL != pSignerInfo, "Failed to allocate signer info.");
+                Assert::True(::CryptMsgGetParam(hMsg, CMSG_SIGNER_INFO_PARAM, 0, pSignerInfo, &cbSignerInfo) ? true : false, "Failed to get signer info.");
+
+                certInfo.Issuer = pSignerInfo->Issuer;
+                certInfo.SerialNumber = pSignerInfo->SerialNumber;
+
+                pCertContext = ::CertFindCertificateInStore(hStore, X509_ASN_ENCODING | PKCS_7_ASN_ENCODING, 0, CERT_FIND_SUBJECT_CERT, &certInfo, NULL);
+                Assert::True(NULL != pCertContext, "Failed to find signer certificate.");
+
+                chainPara.cbSize = sizeof(chainPara);
+                Assert::True(::CertGetCertificateChain(NULL, pCertContext, NULL, hStore, &chainPara, 0, NULL, &pChainContext) ? true : false, "Failed to build signer certificate chain.");
+
+                hr = StrAllocHexDecode(L"7EC90B3FC3D580EB571210011F1095E149DCC6BB", &payload.pbCertificateRootPublicKeyIdentifier, &payload.cbCertificateRootPublicKeyIdentifier);
+                Assert::Equal(S_OK, hr);
+
+                hr = StrAllocHexDecode(L"0B13494DB50BC185A34389BBBAA01EDD1CF56350", &payload.pbCertificateRootThumbprint, &payload.cbCertificateRootThumbprint);
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheVerifyPayloadAgainstCertChain(&payload, pChainContext);
+                Assert::Equal(S_OK, hr);
+
+                // Same public key, different thumbprint.
+                payload.pbCertificateRootThumbprint[0] ^= 0xFF;
+
+                hr = CacheVerifyPayloadAgainstCertChain(&payload, pChainContext);
+                Assert::Equal(E_NOTFOUND, hr);
+            }
+            finally
+            {
+                if (pChainContext)
+                {
+                    ::CertFreeCertificateChain(pChainContext);
+                }
+
+                if (pCertContext)
+                {
+                    ::CertFreeCertificateContext(pCertContext);
+                }
+
+                if (hMsg)
+                {
+                    ::CryptMsgClose(hMsg);
+                }
+
+                if (hStore)
+                {
+                    ::CertCloseStore(hStore, 0);
+                }
+
+                ReleaseMem(pSignerInfo);
+                ReleaseMem(payload.pbCertificateRootThumbprint);
+                ReleaseMem(payload.pbCertificateRootPublicKeyIdentifier);
+                ReleaseStr(sczSignedPath);
+            }
+        }
+
+        [Fact]
+        void CacheContentStoreTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_CACHE cache = { };
+            BURN_ENGINE_COMMAND internalCommand = { };
+            BURN_PAYLOAD payload = { };
+            LPWSTR sczPayloadPath = NULL;
+            LPWSTR sczCachedPath = NULL;
+            HANDLE hFile = INVALID_HANDLE_VALUE;
+            BY_HANDLE_FILE_INFORMATION fileInfo = { };
+            CACHE_TEST_CONTEXT context = { };
+            String^ storePath = nullptr;
+
+            try
+            {
+                InitializeSignatureTestPayload(L"CacheContentStoreTest.PayloadKey", &payload, &sczPayloadPath);
+                storePath = GetSignatureTestStorePath();
+
+                hr = CacheInitialize(&cache, &internalCommand);
+                TestThrowOnFailure(hr, L"Failed initialize cache.");
+
+                hr = CacheCompletePayload(&cache, FALSE, &payload, L"Bootstrapper.CacheTest.CacheContentStoreTest.A", sczPayloadPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+                Assert::True(File::Exists(storePath), "Content store entry was not created.");
+
+                hr = CacheCompletePayload(&cache, FALSE, &payload, L"Bootstrapper.CacheTest.CacheContentStoreTest.B", sczPayloadPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheGetCompletedPath(&cache, FALSE, L"Bootstrapper.CacheTest.CacheContentStoreTest.B\\CacheSignatureTest.File", &sczCachedPath);
+                Assert::Equal(S_OK, hr);
+
+                // Both packages and the store share one copy of the content.
+                hFile = ::CreateFileW(sczCachedPath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                Assert::True(INVALID_HANDLE_VALUE != hFile, "Failed to open cached payload.");
+                Assert::True(::GetFileInformationByHandle(hFile, &fileInfo) ? true : false, "Failed to get cached payload information.");
+                Assert::Equal<DWORD>(3, fileInfo.nNumberOfLinks);
+                ReleaseFileHandle(hFile);
+
+                hr = CacheRemovePackage(&cache, FALSE, L"A", L"Bootstrapper.CacheTest.CacheContentStoreTest.A");
+                Assert::Equal(S_OK, hr);
+                Assert::True(File::Exists(storePath), "Content store entry was removed while still referenced.");
+
+                hr = CacheRemovePackage(&cache, FALSE, L"B", L"Bootstrapper.CacheTest.CacheContentStoreTest.B");
+                Assert::Equal(S_OK, hr);
+                Assert::False(File::Exists(storePath), "Unreferenced content store entry was not removed.");
+            }
+            finally
+            {
+                ReleaseFileHandle(hFile);
+                ReleaseMem(payload.pbHash);
+                ReleaseStr(sczCachedPath);
+                ReleaseStr(sczPayloadPath);
+
+                DeleteTestFile(storePath);
+
+                CacheUninitialize(&cache);
+            }
+        }
+
+        [Fact]
+        void CacheContentStoreMismatchTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_CACHE cache = { };
+            BURN_ENGINE_COMMAND internalCommand = { };
+            BURN_PAYLOAD payload = { };
+            LPWSTR sczPayloadPath = NULL;
+            LPWSTR sczCachedPath = NULL;
+            CACHE_TEST_CONTEXT context = { };
+            String^ storePath = nullptr;
+
+            try
+            {
+                InitializeSignatureTestPayload(L"CacheContentStoreMismatchTest.PayloadKey", &payload, &sczPayloadPath);
+                storePath = GetSignatureTestStorePath();
+
+                // Same size as the payload but different content.
+                Directory::CreateDirectory(Path::GetDirectoryName(storePath));
+                File::WriteAllText(storePath, "This file has a wrong hash.");
+                Assert::Equal<Int64>(27, (gcnew FileInfo(storePath))->Length);
+
+                hr = CacheInitialize(&cache, &internalCommand);
+                TestThrowOnFailure(hr, L"Failed initialize cache.");
+
+                hr = CacheCompletePayload(&cache, FALSE, &payload, L"Bootstrapper.CacheTest.CacheContentStoreMismatchTest", sczPayloadPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheGetCompletedPath(&cache, FALSE, L"Bootstrapper.CacheTest.CacheContentStoreMismatchTest\\CacheSignatureTest.File", &sczCachedPath);
+                Assert::Equal(S_OK, hr);
+
+                // The bad store entry was replaced by the verified payload instead of being linked.
+                WixAssert::StringEqual(File::ReadAllText(gcnew String(sczPayloadPath)), File::ReadAllText(gcnew String(sczCachedPath)), false);
+                WixAssert::StringEqual(File::ReadAllText(gcnew String(sczPayloadPath)), File::ReadAllText(storePath), false);
+
+                hr = CacheRemovePackage(&cache, FALSE, L"A", L"Bootstrapper.CacheTest.CacheContentStoreMismatchTest");
+                Assert::Equal(S_OK, hr);
+            }
+            finally
+            {
+                ReleaseMem(payload.pbHash);
+                ReleaseStr(sczCachedPath);
                 ReleaseStr(sczPayloadPath);
 
-                String^ filePath = Path::Combine(Environment::GetFolderPath(Environment::SpecialFolder::LocalApplicationData), "Package Cache\\Bootstrapper.CacheTest.CacheSignatureTest\\CacheSignatureTest.File");
-                if (File::Exists(filePath))
+                DeleteTestFile(storePath);
+
+                CacheUninitialize(&cache);
+            }
+        }
+
+        [Fact]
+        void CacheContentStoreSkipsAcquireTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_CACHE cache = { };
+            BURN_ENGINE_COMMAND internalCommand = { };
+            BURN_PAYLOAD payload = { };
+            LPWSTR sczPayloadPath = NULL;
+            LPWSTR sczCacheFolder = NULL;
+            LPWSTR sczCachedPath = NULL;
+            CACHE_TEST_CONTEXT context = { };
+            String^ storePath = nullptr;
+
+            try
+            {
+                InitializeSignatureTestPayload(L"CacheContentStoreSkipsAcquireTest.PayloadKey", &payload, &sczPayloadPath);
+                storePath = GetSignatureTestStorePath();
+
+                hr = CacheInitialize(&cache, &internalCommand);
+                TestThrowOnFailure(hr, L"Failed initialize cache.");
+
+                hr = CacheCompletePayload(&cache, FALSE, &payload, L"Bootstrapper.CacheTest.CacheContentStoreSkipsAcquireTest.A", sczPayloadPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+                Assert::True(File::Exists(storePath), "Content store entry was not created.");
+
+                // Change the shared content without changing its size, so only hashing it again would notice.
+                File::SetAttributes(storePath, FileAttributes::Normal);
+                File::WriteAllText(storePath, "This file has a wrong hash.");
+
+                // The check before acquisition links the entry this process already verified, so nothing needs to be acquired or hashed.
+                hr = CacheGetCompletedPath(&cache, FALSE, L"Bootstrapper.CacheTest.CacheContentStoreSkipsAcquireTest.B", &sczCacheFolder);
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheVerifyPayload(&cache, FALSE, &payload, sczCacheFolder, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+
+                hr = PathConcat(sczCacheFolder, L"CacheSignatureTest.File", &sczCachedPath);
+                Assert::Equal(S_OK, hr);
+                WixAssert::StringEqual("This file has a wrong hash.", File::ReadAllText(gcnew String(sczCachedPath)), false);
+
+                // A new process hashes the entry before using it, rejects it and falls back to acquisition.
+                CacheUninitialize(&cache);
+
+                hr = CacheInitialize(&cache, &internalCommand);
+                TestThrowOnFailure(hr, L"Failed initialize cache.");
+
+                ReleaseNullStr(sczCacheFolder);
+                hr = CacheGetCompletedPath(&cache, FALSE, L"Bootstrapper.CacheTest.CacheContentStoreSkipsAcquireTest.C", &sczCacheFolder);
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheVerifyPayload(&cache, FALSE, &payload, sczCacheFolder, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::True(FAILED(hr), "Tampered content store entry was linked.");
+                Assert::False(File::Exists(storePath), "Tampered content store entry was not removed.");
+
+                hr = CacheRemovePackage(&cache, FALSE, L"A", L"Bootstrapper.CacheTest.CacheContentStoreSkipsAcquireTest.A");
+                Assert::Equal(S_OK, hr);
+
+                hr = CacheRemovePackage(&cache, FALSE, L"B", L"Bootstrapper.CacheTest.CacheContentStoreSkipsAcquireTest.B");
+                Assert::Equal(S_OK, hr);
+            }
+            finally
+            {
+                ReleaseMem(payload.pbHash);
+                ReleaseStr(sczCachedPath);
+                ReleaseStr(sczCacheFolder);
+                ReleaseStr(sczPayloadPath);
+
+                DeleteTestFile(storePath);
+
+                CacheUninitialize(&cache);
+            }
+        }
+
+        [Fact]
+        void CacheContainerChunksTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_CONTAINER container = { };
+            BURN_CACHE cache = { };
+            BURN_ENGINE_COMMAND internalCommand = { };
+            BYTE rgbContainer[CACHE_TEST_CHUNK_SIZE * 2 + 1000] = { };
+            LPWSTR sczTempDirectory = NULL;
+            LPWSTR sczUnverifiedPath = NULL;
+            LPWSTR sczLayoutPath = NULL;
+            LPWSTR sczResumePath = NULL;
+            BYTE* pbResume = NULL;
+            SIZE_T cbResume = 0;
+            LONGLONG llSize = 0;
+            CACHE_TEST_CONTEXT context = { };
+
+            try
+            {
+                hr = PathCreateTempDirectory(NULL, L"CacheContainerChunksTest%05d", 10000, &sczTempDirectory);
+                NativeAssert::Succeeded(hr, "Failed to create temp directory.");
+
+                hr = PathConcat(sczTempDirectory, L"container.unverified", &sczUnverifiedPath);
+                NativeAssert::Succeeded(hr, "Failed to get unverified container path.");
+
+                hr = PathConcat(sczTempDirectory, L"layout", &sczLayoutPath);
+                NativeAssert::Succeeded(hr, "Failed to get layout path.");
+
+                hr = StrAllocFormatted(&sczResumePath, L"%ls.R", sczUnverifiedPath);
+                NativeAssert::Succeeded(hr, "Failed to get resume path.");
+
+                for (DWORD i = 0; i < sizeof(rgbContainer); ++i)
+                {
+                    rgbContainer[i] = static_cast<BYTE>(i * 31 + 7);
+                }
+
+                // Three chunks, the last one short.
+                container.sczId = L"CacheContainerChunksTest";
+                container.sczFilePath = L"container.cab";
+                container.downloadSource.sczUrl = L"https://localhost/CacheContainerChunksTest/container.cab";
+                container.verification = BURN_CONTAINER_VERIFICATION_HASH;
+                container.qwFileSize = sizeof(rgbContainer);
+                container.qwChunkSize = CACHE_TEST_CHUNK_SIZE;
+                container.cChunks = 3;
+                container.rgChunks = static_cast<BURN_CONTAINER_CHUNK*>(MemAlloc(sizeof(BURN_CONTAINER_CHUNK) * container.cChunks, TRUE));
+                Assert::True(NULL != container.rgChunks, "Failed to allocate chunks.");
+
+                for (DWORD i = 0; i < container.cChunks; ++i)
+                {
+                    DWORD64 qwOffset = i * container.qwChunkSize;
+                    DWORD64 qwLength = min(container.qwChunkSize, container.qwFileSize - qwOffset);
+
+                    container.rgChunks[i].cbHash = SHA512_HASH_LEN;
+                    container.rgChunks[i].pbHash = static_cast<BYTE*>(MemAlloc(SHA512_HASH_LEN, TRUE));
+                    Assert::True(NULL != container.rgChunks[i].pbHash, "Failed to allocate chunk hash.");
+
+                    hr = CrypHashBuffer(rgbContainer + qwOffset, static_cast<SIZE_T>(qwLength), PROV_RSA_AES, CALG_SHA_512, container.rgChunks[i].pbHash, SHA512_HASH_LEN);
+                    NativeAssert::Succeeded(hr, "Failed to hash chunk.");
+                }
+
+                hr = CacheInitialize(&cache, &internalCommand);
+                TestThrowOnFailure(hr, L"Failed initialize cache.");
+
+                // An intact container is laid out.
+                hr = FileWrite(sczUnverifiedPath, FILE_ATTRIBUTE_NORMAL, rgbContainer, sizeof(rgbContainer), NULL);
+                NativeAssert::Succeeded(hr, "Failed to write intact container.");
+
+                hr = CacheLayoutContainer(&container, sczLayoutPath, sczUnverifiedPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(S_OK, hr);
+
+                for (DWORD i = 0; i < container.cChunks; ++i)
                 {
-                    File::SetAttributes(filePath, FileAttributes::Normal);
-                    File::Delete(filePath);
+                    Assert::True(container.rgChunks[i].fVerified ? true : false, "Intact chunk was not verified.");
                 }
 
+                // Corrupting the middle chunk rejects the container and keeps only the first chunk for the resumed download.
+                rgbContainer[CACHE_TEST_CHUNK_SIZE + 1] ^= 0xFF;
+
+                hr = FileWrite(sczUnverifiedPath, FILE_ATTRIBUTE_NORMAL, rgbContainer, sizeof(rgbContainer), NULL);
+                NativeAssert::Succeeded(hr, "Failed to write corrupted container.");
+
+                hr = CacheLayoutContainer(&container, sczLayoutPath, sczUnverifiedPath, FALSE, CacheTestEventRoutine, CacheTestProgressRoutine, &context);
+                Assert::Equal(CRYPT_E_HASH_VALUE, hr);
+
+                Assert::True(container.rgChunks[0].fVerified ? true : false, "First chunk should have verified.");
+                Assert::False(container.rgChunks[1].fVerified ? true : false, "Corrupted chunk should not have verified.");
+                Assert::True(container.rgChunks[2].fVerified ? true : false, "Last chunk should have verified.");
+
+                hr = FileSize(sczUnverifiedPath, &llSize);
+                NativeAssert::Succeeded(hr, "Failed to get size of unverified container.");
+                Assert::Equal<LONGLONG>(CACHE_TEST_CHUNK_SIZE, llSize);
+
+                hr = FileRead(&pbResume, &cbResume, sczResumePath);
+                NativeAssert::Succeeded(hr, "Failed to read resume file.");
+                Assert::Equal<SIZE_T>(sizeof(DWORD64), cbResume);
+                Assert::Equal<DWORD64>(CACHE_TEST_CHUNK_SIZE, *reinterpret_cast<DWORD64*>(pbResume));
+            }
+            finally
+            {
+                if (container.rgChunks)
+                {
+                    for (DWORD i = 0; i < container.cChunks; ++i)
+                    {
+                        ReleaseMem(container.rgChunks[i].pbHash);
+                    }
+
+                    MemFree(container.rgChunks);
+                }
+
+                if (sczTempDirectory)
+                {
+                    DirEnsureDelete(sczTempDirectory, TRUE, TRUE);
+                }
+
+                ReleaseMem(pbResume);
+                ReleaseStr(sczResumePath);
+                ReleaseStr(sczLayoutPath);
+                ReleaseStr(sczUnverifiedPath);
+                ReleaseStr(sczTempDirectory);
+
                 CacheUninitialize(&cache);
             }
         }
+
+    private:
+        void InitializeSignatureTestPayload(LPCWSTR wzPayloadKey, BURN_PAYLOAD* pPayload, LPWSTR* psczPayloadPath)
+        {
+            HRESULT hr = S_OK;
+
+            pin_ptr<const wchar_t> dataDirectory = PtrToStringChars(this->TestContext->TestDirectory);
+            hr = PathConcat(dataDirectory, L"TestData\\CacheTest\\CacheSignatureTest.File", psczPayloadPath);
+            NativeAssert::Succeeded(hr, "Failed to get path to test file.");
+            Assert::True(FileExistsEx(*psczPayloadPath, NULL), "Test file does not exist.");
+
+            hr = StrAllocHexDecode(CACHE_TEST_SIGNATURE_FILE_HASH, &pPayload->pbHash, &pPayload->cbHash);
+            NativeAssert::Succeeded(hr, "Failed to decode test file hash.");
+
+            pPayload->sczKey = const_cast<LPWSTR>(wzPayloadKey);
+            pPayload->sczFilePath = L"CacheSignatureTest.File";
+            pPayload->qwFileSize = 27;
+            pPayload->verification = BURN_PAYLOAD_VERIFICATION_HASH;
+        }
+
+        static String^ GetSignatureTestStorePath()
+        {
+            return Path::Combine(Environment::GetFolderPath(Environment::SpecialFolder::LocalApplicationData), "Package Cache\\.content", gcnew String(CACHE_TEST_SIGNATURE_FILE_HASH));
+        }
+
+        static void DeleteTestFile(String^ filePath)
+        {
+            if (filePath && File::Exists(filePath))
+            {
+                File::SetAttributes(filePath, FileAttributes::Normal);
+                File::Delete(filePath);
+            }
+        }
     };
 }
 }
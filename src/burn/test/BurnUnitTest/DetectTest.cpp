@@ -0,0 +1,628 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+namespace Microsoft
+{
+namespace Tools
+{
+namespace WindowsInstallerXml
+{
+namespace Test
+{
+namespace Bootstrapper
+{
+    using namespace System;
+    using namespace Xunit;
+
+static LPCWSTR DETECT_TEST_PIPE_NAME = L"BurnUnitTest.DetectTest";
+
+struct DETECT_TEST_BA
+{
+    BURN_VARIABLES* pVariables;
+    LPCWSTR wzCancelPackageId;
+    BOOL fHoldVariables;
+    BURN_PACKAGE* pStalledPackage;
+    DWORD cBegins;
+    LPWSTR sczMessages;
+};
+
+static DWORD CALLBACK DetectTest_BAThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static HRESULT DetectTest_ProcessBAMessage(
+    __in DETECT_TEST_BA* pBA,
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in PIPE_MESSAGE* pMsg,
+    __inout BOOL* pfHoldingVariables
+    );
+static void LoadEngineState(
+    __in BURN_ENGINE_STATE* pEngineState
+    );
+
+// What the fake Windows Installer reports about the one product related to the patch's upgrade code.
+struct DETECT_TEST_PATCH_TARGET
+{
+    LPCWSTR wzProductCode;
+    MSIINSTALLCONTEXT context;
+    LPCWSTR wzVersion;
+    LPCWSTR wzLocalPackage;
+    LONG cDetermineApplicablePatches;
+};
+
+static DETECT_TEST_PATCH_TARGET vPatchTarget = { };
+
+static UINT WINAPI DetectTest_MsiEnumRelatedProductsW(
+    __in LPCWSTR lpUpgradeCode,
+    __reserved DWORD dwReserved,
+    __in DWORD iProductIndex,
+    __out_ecount(MAX_GUID_CHARS + 1) LPWSTR lpProductBuf
+    );
+static UINT WINAPI DetectTest_MsiEnumProductsExW(
+    __in_z_opt LPCWSTR wzProductCode,
+    __in_z_opt LPCWSTR wzUserSid,
+    __in DWORD dwContext,
+    __in DWORD dwIndex,
+    __out_opt WCHAR wzInstalledProductCode[39],
+    __out_opt MSIINSTALLCONTEXT *pdwInstalledContext,
+    __out_opt LPWSTR wzSid,
+    __inout_opt LPDWORD pcchSid
+    );
+static UINT WINAPI DetectTest_MsiGetProductInfoExW(
+    __in LPCWSTR szProductCode,
+    __in_opt LPCWSTR szUserSid,
+    __in MSIINSTALLCONTEXT dwContext,
+    __in LPCWSTR szProperty,
+    __out_ecount_opt(*pcchValue) LPWSTR szValue,
+    __inout_opt LPDWORD pcchValue
+    );
+static UINT WINAPI DetectTest_MsiDetermineApplicablePatchesW(
+    __in_z LPCWSTR wzProductPackagePath,
+    __in DWORD cPatchInfo,
+    __in PMSIPATCHSEQUENCEINFOW pPatchInfo
+    );
+
+    public ref class DetectTest : BurnUnitTest
+    {
+    public:
+        DetectTest(BurnTestFixture^ fixture) : BurnUnitTest(fixture)
+        {
+        }
+
+        [Fact]
+        void DetectParallelSendsMessagesInChainOrderTest()
+        {
+            HRESULT hr = S_OK;
+            HRESULT hrFirstPackageFailure = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            DETECT_TEST_BA ba = { };
+            HANDLE hBAThread = NULL;
+
+            try
+            {
+                LoadEngineState(&engineState);
+                Assert::True(engineState.fParallelDetect);
+
+                ba.pVariables = &engineState.variables;
+
+                hBAThread = ConnectTestBA(&engineState, &ba);
+
+                hr = CoreDetectPackages(&engineState, &hrFirstPackageFailure);
+                NativeAssert::Succeeded(hr, "Failed to detect packages.");
+                NativeAssert::Succeeded(hrFirstPackageFailure, "A package failed to detect.");
+
+                DisconnectTestBA(&engineState, hBAThread);
+
+                // Every package was detected before the BA heard of it, so none of them are present.
+                NativeAssert::StringEqual(
+                    L"begin A;complete A 0x0 2;"
+                    L"begin B;complete B 0x0 2;"
+                    L"begin C;complete C 0x0 2;"
+                    L"begin D;complete D 0x0 2;", ba.sczMessages);
+            }
+            finally
+            {
+                ReleaseHandle(hBAThread);
+                ReleaseStr(ba.sczMessages);
+                UninitializeEngineState(&engineState);
+            }
+        }
+
+        [Fact]
+        void DetectParallelCancelDetectsUnstartedPackagesSeriallyTest()
+        {
+            HRESULT hr = S_OK;
+            HRESULT hrFirstPackageFailure = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            DETECT_TEST_BA ba = { };
+            HANDLE hBAThread = NULL;
+            BOOL fPoolInitialized = FALSE;
+
+            try
+            {
+                // Detect takes a reference on the shared pool, so a single worker makes it run the
+                // packages one at a time in chain order.
+                hr = ThrdPoolInitialize(1);
+                NativeAssert::Succeeded(hr, "Failed to initialize thread pool.");
+
+                fPoolInitialized = TRUE;
+
+                LoadEngineState(&engineState);
+
+                // The BA holds the variables until A completes, so the worker is stuck evaluating
+                // B's detect condition while C and D are still queued when the BA cancels A.
+                ba.pVariables = &engineState.variables;
+                ba.wzCancelPackageId = L"A";
+                ba.fHoldVariables = TRUE;
+                ba.pStalledPackage = engineState.packages.rgPackages + 1;
+
+                hBAThread = ConnectTestBA(&engineState, &ba);
+
+                hr = CoreDetectPackages(&engineState, &hrFirstPackageFailure);
+                NativeAssert::Succeeded(hr, "Failed to detect packages.");
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), hrFirstPackageFailure, "Expected the BA to cancel package A.");
+
+                DisconnectTestBA(&engineState, hBAThread);
+
+                // B was already running so it finishes before the BA hears of it and stays absent.
+                // C and D never started, so they are detected serially after their begin was sent.
+                NativeAssert::StringEqual(
+                    L"begin A;complete A 0x80070642 2;"
+                    L"begin B;complete B 0x0 2;"
+                    L"begin C;complete C 0x0 3;"
+                    L"begin D;complete D 0x0 3;", ba.sczMessages);
+
+                Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_STATE_UNKNOWN, engineState.packages.rgPackages[0].currentState);
+                Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_STATE_ABSENT, engineState.packages.rgPackages[1].currentState);
+                Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_STATE_PRESENT, engineState.packages.rgPackages[2].currentState);
+                Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_STATE_PRESENT, engineState.packages.rgPackages[3].currentState);
+            }
+            finally
+            {
+                ReleaseHandle(hBAThread);
+                ReleaseStr(ba.sczMessages);
+                UninitializeEngineState(&engineState);
+
+                if (fPoolInitialized)
+                {
+                    ThrdPoolUninitialize();
+                }
+            }
+        }
+
+        [Fact]
+        void MspDetectReusesPatchApplicabilityUntilTargetChangesTest()
+        {
+            HRESULT hr = S_OK;
+            IXMLDOMElement* pixeBundle = NULL;
+            BURN_PACKAGES packages = { };
+            BURN_PAYLOADS payloads = { };
+            BURN_PACKAGE* pMspPackage = NULL;
+
+            LPCWSTR wzDocument =
+                L"<BurnManifest>"
+                L"    <PatchTargetCode TargetCode='{4C2A1B7E-8F3D-4E6A-9B5C-1D0E2F3A4B5C}' Product='no' />"
+                L"    <Chain>"
+                L"        <MspPackage Id='PatchA' Cache='keep' CacheId='{0A5113E3-06A5-4CE0-8E83-9EB42F6764A6}' InstallSize='1' Size='1' PerMachine='yes' Permanent='no' Vital='yes' PatchCode='{0A5113E3-06A5-4CE0-8E83-9EB42F6764A6}' PatchXml='&lt;MsiPatch /&gt;' />"
+                L"    </Chain>"
+                L"</BurnManifest>";
+
+            try
+            {
+                vPatchTarget.wzProductCode = L"{5FF7F534-3FFC-41E0-80CD-E6361E5E7B7B}";
+                vPatchTarget.context = MSIINSTALLCONTEXT_MACHINE;
+                vPatchTarget.wzVersion = L"1.0.0.0";
+                vPatchTarget.wzLocalPackage = L"C:\\Windows\\Installer\\1a2b3c.msi";
+                vPatchTarget.cDetermineApplicablePatches = 0;
+
+                WiuFunctionOverride(NULL, NULL, NULL, NULL, NULL, DetectTest_MsiGetProductInfoExW, NULL, NULL, NULL, NULL, DetectTest_MsiEnumRelatedProductsW, NULL, NULL);
+                WiuPatchFunctionOverride(DetectTest_MsiEnumProductsExW, DetectTest_MsiDetermineApplicablePatchesW, NULL);
+
+                LoadBundleXmlHelper(wzDocument, &pixeBundle);
+
+                hr = PackagesParseFromXml(&packages, &payloads, pixeBundle);
+                NativeAssert::Succeeded(hr, "Failed to parse packages from manifest.");
+
+                pMspPackage = packages.rgPackages;
+
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(1, vPatchTarget.cDetermineApplicablePatches);
+
+                // Nothing about the target changed so its cached package isn't opened again.
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(1, vPatchTarget.cDetermineApplicablePatches);
+
+                vPatchTarget.wzVersion = L"1.0.1.0";
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(2, vPatchTarget.cDetermineApplicablePatches);
+
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(2, vPatchTarget.cDetermineApplicablePatches);
+
+                vPatchTarget.wzLocalPackage = L"C:\\Windows\\Installer\\4d5e6f.msi";
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(3, vPatchTarget.cDetermineApplicablePatches);
+
+                vPatchTarget.context = MSIINSTALLCONTEXT_USERUNMANAGED;
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(4, vPatchTarget.cDetermineApplicablePatches);
+
+                vPatchTarget.wzProductCode = L"{7A8B9C0D-1E2F-4A3B-8C4D-5E6F7A8B9C0D}";
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(5, vPatchTarget.cDetermineApplicablePatches);
+
+                DetectPatchApplicability(&packages, pMspPackage);
+                Assert::Equal<LONG>(5, vPatchTarget.cDetermineApplicablePatches);
+            }
+            finally
+            {
+                WiuPatchFunctionOverride(NULL, NULL, NULL);
+                WiuFunctionOverride(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+                ReleaseObject(pixeBundle);
+                PackagesUninitialize(&packages);
+                PayloadsUninitialize(&payloads);
+            }
+        }
+
+    private:
+        // Detect clears each patch's targets before initializing the MSP engine, so this does too.
+        void DetectPatchApplicability(BURN_PACKAGES* pPackages, BURN_PACKAGE* pMspPackage)
+        {
+            HRESULT hr = S_OK;
+
+            ReleaseNullMem(pMspPackage->Msp.rgTargetProducts);
+            pMspPackage->Msp.cTargetProductCodes = 0;
+
+            hr = MspEngineDetectInitialize(pPackages);
+            NativeAssert::Succeeded(hr, "Failed to initialize MSP engine detection.");
+
+            // Whether computed or reused, the patch targets the product as it is now.
+            Assert::Equal<DWORD>(1, pMspPackage->Msp.cTargetProductCodes);
+            NativeAssert::StringEqual(vPatchTarget.wzProductCode, pMspPackage->Msp.rgTargetProducts[0].wzTargetProductCode);
+            Assert::Equal<DWORD>(vPatchTarget.context, pMspPackage->Msp.rgTargetProducts[0].context);
+        }
+
+        HANDLE ConnectTestBA(BURN_ENGINE_STATE* pEngineState, DETECT_TEST_BA* pBA)
+        {
+            HRESULT hr = S_OK;
+            HANDLE hPipe = INVALID_HANDLE_VALUE;
+            HANDLE hBAThread = NULL;
+
+            hr = PipeCreate(DETECT_TEST_PIPE_NAME, NULL, &hPipe);
+            NativeAssert::Succeeded(hr, "Failed to create BA pipe.");
+
+            PipeRpcInitialize(&pEngineState->userExperience.hBARpcPipe, hPipe, TRUE);
+
+            hBAThread = ::CreateThread(NULL, 0, DetectTest_BAThreadProc, pBA, 0, NULL);
+            Assert::True(NULL != hBAThread, "Failed to create BA thread.");
+
+            hr = PipeServerWaitForClientConnect(hBAThread, hPipe);
+            NativeAssert::Succeeded(hr, "Failed to wait for BA to connect to pipe.");
+
+            return hBAThread;
+        }
+
+        void DisconnectTestBA(BURN_ENGINE_STATE* pEngineState, HANDLE hBAThread)
+        {
+            HRESULT hr = S_OK;
+            DWORD dwExitCode = 0;
+
+            hr = PipeWriteDisconnect(pEngineState->userExperience.hBARpcPipe.hPipe);
+            NativeAssert::Succeeded(hr, "Failed to disconnect BA.");
+
+            hr = ThrdWaitForCompletion(hBAThread, INFINITE, &dwExitCode);
+            NativeAssert::Succeeded(hr, "Failed to wait for BA thread.");
+            NativeAssert::Succeeded(static_cast<HRESULT>(dwExitCode), "BA thread failed.");
+        }
+
+        void UninitializeEngineState(BURN_ENGINE_STATE* pEngineState)
+        {
+            PipeRpcUninitiailize(&pEngineState->userExperience.hBARpcPipe);
+            PackagesUninitialize(&pEngineState->packages);
+            PayloadsUninitialize(&pEngineState->payloads);
+            RegistrationUninitialize(&pEngineState->registration);
+            VariablesUninitialize(&pEngineState->variables);
+            CacheUninitialize(&pEngineState->cache);
+        }
+    };
+
+static DWORD CALLBACK DetectTest_BAThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    DETECT_TEST_BA* pBA = reinterpret_cast<DETECT_TEST_BA*>(lpThreadParameter);
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    PIPE_RPC_HANDLE hRpcPipe = { INVALID_HANDLE_VALUE };
+    PIPE_MESSAGE msg = { };
+    BOOL fHoldingVariables = FALSE;
+
+    // Taken before connecting so the engine can't start detecting until the variables are held.
+    if (pBA->fHoldVariables)
+    {
+        ::EnterCriticalSection(&pBA->pVariables->csAccess);
+        fHoldingVariables = TRUE;
+    }
+
+    hr = PipeClientConnect(DETECT_TEST_PIPE_NAME, &hPipe);
+    ExitOnFailure(hr, "Failed to connect BA to pipe.");
+
+    PipeRpcInitialize(&hRpcPipe, hPipe, TRUE);
+    hPipe = INVALID_HANDLE_VALUE;
+
+    while (S_OK == (hr = PipeRpcReadMessage(&hRpcPipe, &msg)))
+    {
+        hr = DetectTest_ProcessBAMessage(pBA, &hRpcPipe, &msg, &fHoldingVariables);
+        ExitOnFailure(hr, "Failed to process message %u.", msg.dwMessageType);
+
+        ReleasePipeMessage(&msg);
+    }
+    ExitOnFailure(hr, "Failed to read message from pipe.");
+
+    hr = S_OK;
+
+LExit:
+    if (fHoldingVariables)
+    {
+        ::LeaveCriticalSection(&pBA->pVariables->csAccess);
+    }
+
+    ReleasePipeMessage(&msg);
+    PipeRpcUninitiailize(&hRpcPipe);
+    ReleasePipeHandle(hPipe);
+
+    return static_cast<DWORD>(hr);
+}
+
+static HRESULT DetectTest_ProcessBAMessage(
+    __in DETECT_TEST_BA* pBA,
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in PIPE_MESSAGE* pMsg,
+    __inout BOOL* pfHoldingVariables
+    )
+{
+    HRESULT hr = S_OK;
+    const BYTE* pbData = static_cast<const BYTE*>(pMsg->pvData);
+    SIZE_T iData = 0;
+    DWORD cbArgs = 0;
+    DWORD dwApiVersion = 0;
+    LPWSTR sczPackageId = NULL;
+    DWORD dwStatus = 0;
+    DWORD dwState = 0;
+    BOOL fCancel = FALSE;
+    BUFF_BUFFER bufferResponse = { };
+
+    // The args start right after their size.
+    hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &cbArgs);
+    ExitOnFailure(hr, "Failed to read size of args.");
+
+    hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwApiVersion);
+    ExitOnFailure(hr, "Failed to read API version of args.");
+
+    hr = BuffReadString(pbData, pMsg->cbData, &iData, &sczPackageId);
+    ExitOnFailure(hr, "Failed to read package id of args.");
+
+    switch (pMsg->dwMessageType)
+    {
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPACKAGEBEGIN:
+        ++pBA->cBegins;
+
+        // The packages' detect conditions read this to show whether they were detected before or after the BA heard of them.
+        hr = VariableSetNumeric(pBA->pVariables, L"DetectBegins", pBA->cBegins, FALSE);
+        ExitOnFailure(hr, "Failed to set number of detect begins.");
+
+        hr = StrAllocConcatFormatted(&pBA->sczMessages, L"begin %ls;", sczPackageId);
+        ExitOnFailure(hr, "Failed to record detect begin.");
+
+        fCancel = pBA->wzCancelPackageId && CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, pBA->wzCancelPackageId, -1, sczPackageId, -1);
+
+        // The stalled package's cache state is detected before its detect condition, so once it is
+        // set the worker has started the package and is waiting on the variables.
+        while (fCancel && pBA->pStalledPackage && BURN_PACKAGE_REGISTRATION_STATE_UNKNOWN == ::ReadAcquire(reinterpret_cast<volatile LONG*>(&pBA->pStalledPackage->cacheRegistrationState)))
+        {
+            ::Sleep(1);
+        }
+
+        hr = BuffWriteNumberToBuffer(&bufferResponse, sizeof(BA_ONDETECTPACKAGEBEGIN_RESULTS));
+        ExitOnFailure(hr, "Failed to write size of OnDetectPackageBegin results.");
+
+        hr = BuffWriteNumberToBuffer(&bufferResponse, fCancel);
+        ExitOnFailure(hr, "Failed to write cancel of OnDetectPackageBegin results.");
+        break;
+
+    case BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTPACKAGECOMPLETE:
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwStatus);
+        ExitOnFailure(hr, "Failed to read status of OnDetectPackageComplete args.");
+
+        hr = BuffReadNumber(pbData, pMsg->cbData, &iData, &dwState);
+        ExitOnFailure(hr, "Failed to read state of OnDetectPackageComplete args.");
+
+        hr = StrAllocConcatFormatted(&pBA->sczMessages, L"complete %ls 0x%x %u;", sczPackageId, dwStatus, dwState);
+        ExitOnFailure(hr, "Failed to record detect complete.");
+
+        // The engine drops the queued packages before it reports a cancelled package complete,
+        // so the stalled package can be let go without racing the cancel.
+        if (*pfHoldingVariables)
+        {
+            ::LeaveCriticalSection(&pBA->pVariables->csAccess);
+            *pfHoldingVariables = FALSE;
+        }
+
+        hr = BuffWriteNumberToBuffer(&bufferResponse, sizeof(BA_ONDETECTPACKAGECOMPLETE_RESULTS));
+        ExitOnFailure(hr, "Failed to write size of OnDetectPackageComplete results.");
+        break;
+
+    default:
+        ExitWithRootFailure(hr, E_NOTIMPL, "Unexpected BA message: %u", pMsg->dwMessageType);
+    }
+
+    hr = PipeRpcResponse(phRpcPipe, pMsg->dwMessageType, S_OK, bufferResponse.pbData, bufferResponse.cbData);
+    ExitOnFailure(hr, "Failed to send response to engine.");
+
+LExit:
+    ReleaseBuffer(bufferResponse);
+    ReleaseStr(sczPackageId);
+
+    return hr;
+}
+
+static void LoadEngineState(
+    __in BURN_ENGINE_STATE* pEngineState
+    )
+{
+    HRESULT hr = S_OK;
+
+    // A detects without reading the variables, the others detect by how many begins the BA has seen.
+    // B isn't permanent so its cache registration state shows when it started.
+    LPCSTR szDocument =
+        "<BurnManifest EngineVersion='" szVerMajorMinorBuild "' ProtocolVersion='1' Win64='"
+#if !defined(_WIN64)
+        "no"
+#else
+        "yes"
+#endif
+        "'>"
+        "    <UX PrimaryPayloadId='ux.exe'>"
+        "        <Payload Id='ux.exe' FilePath='ux.exe' Packaging='embedded' SourcePath='u0' />"
+        "    </UX>"
+        "    <Registration Id='{3B2F8C0A-6A3E-4C7E-9E0B-52D1B7F2C9A4}' Tag='foo' ProviderKey='foo' Version='1.0.0.0' ExecutableName='setup.exe' PerMachine='no' />"
+        "    <Payload Id='test.exe' FilePath='test.exe' Packaging='external' SourcePath='test.exe' Hash='000000000000' FileSize='1' />"
+        "    <Chain ParallelDetect='yes'>"
+        "        <ExePackage Id='A' Cache='remove' CacheId='A' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='' InstallArguments='' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        "            <PayloadRef Id='test.exe' />"
+        "        </ExePackage>"
+        "        <ExePackage Id='B' Cache='remove' CacheId='B' InstallSize='1' Size='1' PerMachine='no' Permanent='no' Vital='yes' DetectCondition='DetectBegins &gt;= 2' InstallArguments='' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        "            <PayloadRef Id='test.exe' />"
+        "        </ExePackage>"
+        "        <ExePackage Id='C' Cache='remove' CacheId='C' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='DetectBegins &gt;= 3' InstallArguments='' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        "            <PayloadRef Id='test.exe' />"
+        "        </ExePackage>"
+        "        <ExePackage Id='D' Cache='remove' CacheId='D' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='DetectBegins &gt;= 4' InstallArguments='' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        "            <PayloadRef Id='test.exe' />"
+        "        </ExePackage>"
+        "    </Chain>"
+        "</BurnManifest>";
+
+    hr = CacheInitialize(&pEngineState->cache, &pEngineState->internalCommand);
+    TestThrowOnFailure(hr, L"Failed to initialize cache.");
+
+    hr = VariableInitialize(&pEngineState->variables);
+    TestThrowOnFailure(hr, L"Failed to initialize variables.");
+
+    hr = ManifestLoadXmlFromBuffer((BYTE*)szDocument, lstrlenA(szDocument), pEngineState);
+    TestThrowOnFailure(hr, L"Failed to parse manifest from XML.");
+}
+
+static UINT WINAPI DetectTest_MsiEnumRelatedProductsW(
+    __in LPCWSTR /*lpUpgradeCode*/,
+    __reserved DWORD /*dwReserved*/,
+    __in DWORD iProductIndex,
+    __out_ecount(MAX_GUID_CHARS + 1) LPWSTR lpProductBuf
+    )
+{
+    if (0 < iProductIndex)
+    {
+        return ERROR_NO_MORE_ITEMS;
+    }
+
+    ::StringCchCopyW(lpProductBuf, MAX_GUID_CHARS + 1, vPatchTarget.wzProductCode);
+
+    return ERROR_SUCCESS;
+}
+
+static UINT WINAPI DetectTest_MsiEnumProductsExW(
+    __in_z_opt LPCWSTR wzProductCode,
+    __in_z_opt LPCWSTR /*wzUserSid*/,
+    __in DWORD /*dwContext*/,
+    __in DWORD dwIndex,
+    __out_opt WCHAR wzInstalledProductCode[39],
+    __out_opt MSIINSTALLCONTEXT *pdwInstalledContext,
+    __out_opt LPWSTR /*wzSid*/,
+    __inout_opt LPDWORD /*pcchSid*/
+    )
+{
+    if (0 < dwIndex || (wzProductCode && CSTR_EQUAL != ::CompareStringW(LOCALE_INVARIANT, 0, wzProductCode, -1, vPatchTarget.wzProductCode, -1)))
+    {
+        return ERROR_NO_MORE_ITEMS;
+    }
+
+    if (wzInstalledProductCode)
+    {
+        ::StringCchCopyW(wzInstalledProductCode, 39, vPatchTarget.wzProductCode);
+    }
+
+    if (pdwInstalledContext)
+    {
+        *pdwInstalledContext = vPatchTarget.context;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static UINT WINAPI DetectTest_MsiGetProductInfoExW(
+    __in LPCWSTR szProductCode,
+    __in_opt LPCWSTR /*szUserSid*/,
+    __in MSIINSTALLCONTEXT dwContext,
+    __in LPCWSTR szProperty,
+    __out_ecount_opt(*pcchValue) LPWSTR szValue,
+    __inout_opt LPDWORD pcchValue
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD er = ERROR_UNKNOWN_PROPERTY;
+    LPCWSTR wzValue = NULL;
+
+    if (dwContext != vPatchTarget.context || CSTR_EQUAL != ::CompareStringW(LOCALE_INVARIANT, 0, szProductCode, -1, vPatchTarget.wzProductCode, -1))
+    {
+        return ERROR_UNKNOWN_PRODUCT;
+    }
+
+    if (CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, szProperty, -1, INSTALLPROPERTY_VERSIONSTRING, -1))
+    {
+        wzValue = vPatchTarget.wzVersion;
+    }
+    else if (CSTR_EQUAL == ::CompareStringW(LOCALE_INVARIANT, 0, szProperty, -1, INSTALLPROPERTY_LOCALPACKAGE, -1))
+    {
+        wzValue = vPatchTarget.wzLocalPackage;
+    }
+
+    if (wzValue)
+    {
+        hr = ::StringCchCopyW(szValue, *pcchValue, wzValue);
+        if (STRSAFE_E_INSUFFICIENT_BUFFER == hr)
+        {
+            *pcchValue = lstrlenW(wzValue);
+            er = ERROR_MORE_DATA;
+        }
+        else if (SUCCEEDED(hr))
+        {
+            er = ERROR_SUCCESS;
+        }
+    }
+
+    return er;
+}
+
+static UINT WINAPI DetectTest_MsiDetermineApplicablePatchesW(
+    __in_z LPCWSTR /*wzProductPackagePath*/,
+    __in DWORD cPatchInfo,
+    __in PMSIPATCHSEQUENCEINFOW pPatchInfo
+    )
+{
+    // Called on the thread pool.
+    ::InterlockedIncrement(&vPatchTarget.cDetermineApplicablePatches);
+
+    for (DWORD i = 0; i < cPatchInfo; ++i)
+    {
+        pPatchInfo[i].uStatus = ERROR_SUCCESS;
+        pPatchInfo[i].dwOrder = i;
+    }
+
+    return ERROR_SUCCESS;
+}
+}
+}
+}
+}
+}
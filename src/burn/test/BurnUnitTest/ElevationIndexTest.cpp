@@ -0,0 +1,400 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+namespace Microsoft
+{
+namespace Tools
+{
+namespace WindowsInstallerXml
+{
+namespace Test
+{
+namespace Bootstrapper
+{
+    using namespace System;
+    using namespace Xunit;
+
+static BOOL STDAPICALLTYPE ElevationIndexTest_ShellExecuteExW(
+    __inout LPSHELLEXECUTEINFOW lpExecInfo
+    );
+static DWORD CALLBACK ElevationIndexTest_ElevationThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static BOOL STDAPICALLTYPE ElevationIndexTest_CreateProcessW(
+    __in_opt LPCWSTR lpApplicationName,
+    __inout_opt LPWSTR lpCommandLine,
+    __in_opt LPSECURITY_ATTRIBUTES lpProcessAttributes,
+    __in_opt LPSECURITY_ATTRIBUTES lpThreadAttributes,
+    __in BOOL bInheritHandles,
+    __in DWORD dwCreationFlags,
+    __in_opt LPVOID lpEnvironment,
+    __in_opt LPCWSTR lpCurrentDirectory,
+    __in LPSTARTUPINFOW lpStartupInfo,
+    __out LPPROCESS_INFORMATION lpProcessInformation
+    );
+static DWORD CALLBACK ElevationIndexTest_PackageThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static int ElevationIndexTest_GenericMessageHandler(
+    __in GENERIC_EXECUTE_MESSAGE* pMessage,
+    __in LPVOID pvContext
+    );
+static void LoadEngineState(
+    __in BURN_ENGINE_STATE* pEngineState
+    );
+
+    public ref class ElevationIndexTest : BurnUnitTest
+    {
+    public:
+        ElevationIndexTest(BurnTestFixture^ fixture) : BurnUnitTest(fixture)
+        {
+        }
+
+        [Fact]
+        void ElevationResolvesPackagesByManifestIndexTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            BURN_PIPE_CONNECTION* pConnection = &engineState.companionConnection;
+            LPCWSTR rgwzPackageIds[] = { L"First", L"Second", L"Third" };
+            HRESULT rghrResults[countof(rgwzPackageIds)] = { };
+
+            engineState.sczBundleEngineWorkingPath = L"tests\\ignore\\this\\path\\to\\burn.exe";
+
+            try
+            {
+                ShelFunctionOverride(ElevationIndexTest_ShellExecuteExW);
+                CoreFunctionOverride(ElevationIndexTest_CreateProcessW, ThrdWaitForCompletion);
+
+                LoadEngineState(&engineState);
+
+                hr = ElevationElevate(&engineState, WM_BURN_ELEVATE, NULL);
+                TestThrowOnFailure(hr, L"Failed to elevate.");
+
+                // Execute the packages out of manifest order so an off-by-one index cannot line up by accident.
+                rghrResults[2] = ExecuteExePackage(&engineState, rgwzPackageIds[2]);
+                rghrResults[0] = ExecuteExePackage(&engineState, rgwzPackageIds[0]);
+                rghrResults[1] = ExecuteExePackage(&engineState, rgwzPackageIds[1]);
+
+                hr = BurnPipeTerminateChildProcess(pConnection, 0, FALSE);
+                TestThrowOnFailure(hr, L"Failed to terminate elevated process.");
+
+                // Each package's install arguments make the package exit with 101 + its manifest position.
+                for (DWORD i = 0; i < countof(rgwzPackageIds); ++i)
+                {
+                    NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(101 + i), rghrResults[i], "Per-machine package: {0}", rgwzPackageIds[i]);
+                }
+            }
+            finally
+            {
+                PackagesUninitialize(&engineState.packages);
+                PayloadsUninitialize(&engineState.payloads);
+                VariablesUninitialize(&engineState.variables);
+                BurnPipeConnectionUninitialize(pConnection);
+            }
+        }
+
+        [Fact]
+        void ElevationApplyInitializeRejectsManifestCountMismatchTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            BURN_PIPE_CONNECTION* pConnection = &engineState.companionConnection;
+            BURN_PACKAGES packages = { };
+            BURN_PAYLOADS payloads = { };
+            BURN_PLAN plan = { };
+
+            engineState.sczBundleEngineWorkingPath = L"tests\\ignore\\this\\path\\to\\burn.exe";
+
+            try
+            {
+                ShelFunctionOverride(ElevationIndexTest_ShellExecuteExW);
+                CoreFunctionOverride(ElevationIndexTest_CreateProcessW, ThrdWaitForCompletion);
+
+                LoadEngineState(&engineState);
+
+                hr = ElevationElevate(&engineState, WM_BURN_ELEVATE, NULL);
+                TestThrowOnFailure(hr, L"Failed to elevate.");
+
+                plan.action = BOOTSTRAPPER_ACTION_INSTALL;
+                plan.pInternalCommand = &engineState.internalCommand;
+
+                // Only the counts are sent, so shallow copies with one count off stand in for a different manifest.
+                packages = engineState.packages;
+                packages.cPackages += 1;
+                plan.pPayloads = &engineState.payloads;
+
+                hr = ElevationApplyInitialize(pConnection->hPipe, &engineState.userExperience, &engineState.variables, &packages, &plan);
+                NativeAssert::SpecificReturnCode(E_INVALIDDATA, hr, "ElevationApplyInitialize with an extra package.");
+
+                payloads = engineState.payloads;
+                payloads.cPayloads -= 1;
+                plan.pPayloads = &payloads;
+
+                hr = ElevationApplyInitialize(pConnection->hPipe, &engineState.userExperience, &engineState.variables, &engineState.packages, &plan);
+                NativeAssert::SpecificReturnCode(E_INVALIDDATA, hr, "ElevationApplyInitialize with a missing payload.");
+
+                hr = BurnPipeTerminateChildProcess(pConnection, 0, FALSE);
+                TestThrowOnFailure(hr, L"Failed to terminate elevated process.");
+            }
+            finally
+            {
+                PackagesUninitialize(&engineState.packages);
+                PayloadsUninitialize(&engineState.payloads);
+                VariablesUninitialize(&engineState.variables);
+                BurnPipeConnectionUninitialize(pConnection);
+            }
+        }
+
+        [Fact]
+        void PackageFindByIdTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            BURN_PACKAGE* pPackage = NULL;
+
+            try
+            {
+                LoadEngineState(&engineState);
+
+                Assert::True(NULL != engineState.packages.sdhPackages);
+
+                for (DWORD i = 0; i < engineState.packages.cPackages; ++i)
+                {
+                    BURN_PACKAGE* pExpected = engineState.packages.rgPackages + i;
+
+                    Assert::Equal<DWORD>(i + 1, pExpected->dwManifestIndex);
+
+                    hr = PackageFindById(&engineState.packages, pExpected->sczId, &pPackage);
+                    NativeAssert::Succeeded(hr, "Failed to find package {0} in the dictionary.", pExpected->sczId);
+                    Assert::True(pExpected == pPackage);
+                }
+
+                hr = PackageFindById(&engineState.packages, L"first", &pPackage);
+                NativeAssert::SpecificReturnCode(E_NOTFOUND, hr, "Package ids are case sensitive.");
+
+                hr = PackageFindById(&engineState.packages, L"Missing", &pPackage);
+                NativeAssert::SpecificReturnCode(E_NOTFOUND, hr, "Found a package that is not in the manifest.");
+
+                // Without the dictionary the packages are searched one by one.
+                ReleaseNullDict(engineState.packages.sdhPackages);
+
+                for (DWORD i = 0; i < engineState.packages.cPackages; ++i)
+                {
+                    BURN_PACKAGE* pExpected = engineState.packages.rgPackages + i;
+
+                    hr = PackageFindById(&engineState.packages, pExpected->sczId, &pPackage);
+                    NativeAssert::Succeeded(hr, "Failed to find package {0} without the dictionary.", pExpected->sczId);
+                    Assert::True(pExpected == pPackage);
+                }
+
+                hr = PackageFindById(&engineState.packages, L"Missing", &pPackage);
+                NativeAssert::SpecificReturnCode(E_NOTFOUND, hr, "Found a package that is not in the manifest without the dictionary.");
+            }
+            finally
+            {
+                PackagesUninitialize(&engineState.packages);
+                PayloadsUninitialize(&engineState.payloads);
+                VariablesUninitialize(&engineState.variables);
+                BurnPipeConnectionUninitialize(&engineState.companionConnection);
+            }
+        }
+
+    private:
+        HRESULT ExecuteExePackage(
+            __in BURN_ENGINE_STATE* pEngineState,
+            __in LPCWSTR wzPackageId
+            )
+        {
+            HRESULT hr = S_OK;
+            BURN_PACKAGE* pPackage = NULL;
+            BURN_EXECUTE_ACTION executeAction = { };
+            BOOTSTRAPPER_APPLY_RESTART restart = BOOTSTRAPPER_APPLY_RESTART_NONE;
+
+            hr = PackageFindById(&pEngineState->packages, wzPackageId, &pPackage);
+            TestThrowOnFailure(hr, L"Failed to find package.");
+
+            executeAction.type = BURN_EXECUTE_ACTION_TYPE_EXE_PACKAGE;
+            executeAction.exePackage.action = BOOTSTRAPPER_ACTION_STATE_INSTALL;
+            executeAction.exePackage.pPackage = pPackage;
+
+            return ElevationExecuteExePackage(pEngineState->companionConnection.hPipe, &executeAction, &pEngineState->variables, FALSE, ElevationIndexTest_GenericMessageHandler, NULL, &restart);
+        }
+    };
+
+
+static BOOL STDAPICALLTYPE ElevationIndexTest_ShellExecuteExW(
+    __inout LPSHELLEXECUTEINFOW lpExecInfo
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR scz = NULL;
+
+    hr = StrAllocString(&scz, lpExecInfo->lpParameters, 0);
+    ExitOnFailure(hr, "Failed to copy arguments.");
+
+    // Pretend this thread is the elevated process.
+    lpExecInfo->hProcess = ::CreateThread(NULL, 0, ElevationIndexTest_ElevationThreadProc, scz, 0, NULL);
+    ExitOnNullWithLastError(lpExecInfo->hProcess, hr, "Failed to create thread.");
+    scz = NULL;
+
+LExit:
+    ReleaseStr(scz);
+
+    return SUCCEEDED(hr);
+}
+
+static DWORD CALLBACK ElevationIndexTest_ElevationThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczArguments = (LPWSTR)lpThreadParameter;
+    BURN_ENGINE_STATE engineState = { };
+    BURN_PIPE_CONNECTION* pConnection = &engineState.companionConnection;
+    HANDLE hLock = NULL;
+    DWORD dwChildExitCode = 0;
+    BOOL fRestart = FALSE;
+    BOOL fApplying = FALSE;
+
+    // The elevated process parses the same manifest, so its packages and payloads are in the same order.
+    LoadEngineState(&engineState);
+
+    StrAlloc(&pConnection->sczName, MAX_PATH);
+    StrAlloc(&pConnection->sczSecret, MAX_PATH);
+
+    // parse command line arguments
+    if (3 != swscanf_s(sczArguments, L"-q -burn.elevated %s %s %u", pConnection->sczName, MAX_PATH, pConnection->sczSecret, MAX_PATH, &pConnection->dwProcessId))
+    {
+        hr = E_INVALIDARG;
+        ExitOnFailure(hr, "Failed to parse argument string.");
+    }
+
+    // set up connection with per-user process
+    hr = BurnPipeChildConnect(pConnection, TRUE);
+    ExitOnFailure(hr, "Failed to connect to per-user process.");
+
+    hr = ElevationChildPumpMessages(pConnection->hPipe, pConnection->hCachePipe, &engineState.approvedExes, &engineState.cache, &engineState.containers, &engineState.packages, &engineState.payloads, &engineState.variables, &engineState.registration, &engineState.userExperience, &hLock, &dwChildExitCode, &fRestart, &fApplying);
+    ExitOnFailure(hr, "Failed while pumping messages in child 'process'.");
+
+LExit:
+    BurnPipeConnectionUninitialize(pConnection);
+    PackagesUninitialize(&engineState.packages);
+    PayloadsUninitialize(&engineState.payloads);
+    VariablesUninitialize(&engineState.variables);
+    ReleaseStr(sczArguments);
+
+    return FAILED(hr) ? (DWORD)hr : dwChildExitCode;
+}
+
+static BOOL STDAPICALLTYPE ElevationIndexTest_CreateProcessW(
+    __in_opt LPCWSTR /*lpApplicationName*/,
+    __inout_opt LPWSTR lpCommandLine,
+    __in_opt LPSECURITY_ATTRIBUTES /*lpProcessAttributes*/,
+    __in_opt LPSECURITY_ATTRIBUTES /*lpThreadAttributes*/,
+    __in BOOL /*bInheritHandles*/,
+    __in DWORD /*dwCreationFlags*/,
+    __in_opt LPVOID /*lpEnvironment*/,
+    __in_opt LPCWSTR /*lpCurrentDirectory*/,
+    __in LPSTARTUPINFOW /*lpStartupInfo*/,
+    __out LPPROCESS_INFORMATION lpProcessInformation
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR scz = NULL;
+
+    hr = StrAllocString(&scz, lpCommandLine, 0);
+    ExitOnFailure(hr, "Failed to copy arguments.");
+
+    // Pretend this thread is the package process.
+    lpProcessInformation->hProcess = ::CreateThread(NULL, 0, ElevationIndexTest_PackageThreadProc, scz, 0, NULL);
+    ExitOnNullWithLastError(lpProcessInformation->hProcess, hr, "Failed to create thread.");
+
+    scz = NULL;
+
+LExit:
+    ReleaseStr(scz);
+
+    return SUCCEEDED(hr);
+}
+
+static DWORD CALLBACK ElevationIndexTest_PackageThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczArguments = (LPWSTR)lpThreadParameter;
+    int argc = 0;
+    LPWSTR* argv = NULL;
+    DWORD dwResult = 0;
+
+    hr = AppParseCommandLine(sczArguments, &argc, &argv);
+    ExitOnFailure(hr, "Failed to parse command line: %ls", sczArguments);
+
+    hr = StrStringToUInt32(argv[1], 0, reinterpret_cast<UINT*>(&dwResult));
+    ExitOnFailure(hr, "Failed to convert %ls to DWORD.", argv[1]);
+
+LExit:
+    AppFreeCommandLineArgs(argv);
+    ReleaseStr(sczArguments);
+
+    return FAILED(hr) ? (DWORD)hr : dwResult;
+}
+
+static int ElevationIndexTest_GenericMessageHandler(
+    __in GENERIC_EXECUTE_MESSAGE* /*pMessage*/,
+    __in LPVOID /*pvContext*/
+    )
+{
+    return IDNOACTION;
+}
+
+static void LoadEngineState(
+    __in BURN_ENGINE_STATE* pEngineState
+    )
+{
+    HRESULT hr = S_OK;
+    IXMLDOMElement* pixeBundle = NULL;
+
+    LPCWSTR wzDocument =
+        L"<BurnManifest>"
+        L"    <Payload Id='first.exe' FilePath='first.exe' Packaging='external' SourcePath='first.exe' Hash='000000000000' FileSize='1' />"
+        L"    <Payload Id='second.exe' FilePath='second.exe' Packaging='external' SourcePath='second.exe' Hash='000000000000' FileSize='1' />"
+        L"    <Payload Id='third.exe' FilePath='third.exe' Packaging='external' SourcePath='third.exe' Hash='000000000000' FileSize='1' />"
+        L"    <Chain>"
+        L"        <ExePackage Id='First' Cache='remove' CacheId='first.exe' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='' InstallArguments='101' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        L"            <PayloadRef Id='first.exe' />"
+        L"        </ExePackage>"
+        L"        <ExePackage Id='Second' Cache='remove' CacheId='second.exe' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='' InstallArguments='102' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        L"            <PayloadRef Id='second.exe' />"
+        L"        </ExePackage>"
+        L"        <ExePackage Id='Third' Cache='remove' CacheId='third.exe' InstallSize='1' Size='1' PerMachine='no' Permanent='yes' Vital='yes' DetectCondition='' InstallArguments='103' UninstallArguments='' Uninstallable='no' RepairArguments='' Repairable='no' Protocol='none' DetectionType='condition'>"
+        L"            <PayloadRef Id='third.exe' />"
+        L"        </ExePackage>"
+        L"    </Chain>"
+        L"</BurnManifest>";
+
+    VariableInitialize(&pEngineState->variables);
+
+    BurnPipeConnectionInitialize(&pEngineState->companionConnection);
+
+    hr = CacheInitialize(&pEngineState->cache, &pEngineState->internalCommand);
+    TestThrowOnFailure(hr, "CacheInitialize failed.");
+
+    // load XML document
+    LoadBundleXmlHelper(wzDocument, &pixeBundle);
+
+    hr = PayloadsParseFromXml(&pEngineState->payloads, &pEngineState->containers, &pEngineState->layoutPayloads, pixeBundle);
+    TestThrowOnFailure(hr, "Failed to parse payloads from manifest.");
+
+    hr = PackagesParseFromXml(&pEngineState->packages, &pEngineState->payloads, pixeBundle);
+    TestThrowOnFailure(hr, "Failed to parse packages from manifest.");
+
+    ReleaseObject(pixeBundle);
+}
+}
+}
+}
+}
+}
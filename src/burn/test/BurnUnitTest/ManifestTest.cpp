@@ -43,6 +43,7 @@ namespace Bootstrapper
                     "    <Registration Id='{D54F896D-1952-43e6-9C67-B5652240618C}' Tag='foo' ProviderKey='foo' Version='1.0.0.0' ExecutableName='setup.exe' PerMachine='no' />"
                     "    <Variable Id='Variable1' Type='numeric' Value='1' Hidden='no' Persisted='no' />"
                     "    <RegistrySearch Id='Search1' Type='exists' Root='HKLM' Key='SOFTWARE\\Microsoft' Variable='Variable1' Condition='0' />"
+                    "    <Chain IncrementalPlan='yes' />"
                     "</BurnManifest>";
 
                 hr = CacheInitialize(&engineState.cache, &engineState.internalCommand);
@@ -57,6 +58,10 @@ namespace Bootstrapper
 
                 // check variable values
                 Assert::True(VariableExistsHelper(&engineState.variables, L"Variable1"));
+
+                // check chain attributes
+                Assert::True(engineState.fIncrementalPlan);
+                Assert::False(engineState.fParallelDetect);
             }
             finally
             {
@@ -475,6 +475,121 @@ namespace Bootstrapper
             ValidateNonPermanentPackageExpectedStates(&pEngineState->packages.rgPackages[2], L"PackageC", BURN_PACKAGE_REGISTRATION_STATE_PRESENT, BURN_PACKAGE_REGISTRATION_STATE_PRESENT);
         }
 
+        [Fact]
+        void MsiTransactionReplanAfterConditionChangeTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_ENGINE_STATE engineState = { };
+            BURN_ENGINE_STATE* pEngineState = &engineState;
+            BURN_ENGINE_STATE fullEngineState = { };
+            BURN_PACKAGE* pPackageA = NULL;
+            BURN_PACKAGE* pPackageC = NULL;
+            DWORD dwVariablesChangeStamp = 0;
+            DWORD dwPackageAVariablesChangeStamp = 0;
+            DWORD dwPackageAInputChangeStamp = 0;
+
+            InitializeEngineStateForCorePlan(wzMsiTransactionManifestFileName, pEngineState);
+            DetectPackagesAsAbsent(pEngineState);
+            DetectRelatedBundle(pEngineState, L"{FD9920AD-DBCA-4C6C-8CD5-B47431CE8D21}", L"1.0.0.0", BOOTSTRAPPER_RELATION_UPGRADE);
+
+            pEngineState->fIncrementalPlan = TRUE;
+
+            pPackageA = pEngineState->packages.rgPackages;
+            pPackageC = pEngineState->packages.rgPackages + 2;
+            NativeAssert::StringEqual(L"PackageA", pPackageA->sczId);
+            NativeAssert::StringEqual(L"PackageC", pPackageC->sczId);
+
+            hr = StrAllocString(&pPackageA->sczInstallCondition, L"InstallPackageA", 0);
+            NativeAssert::Succeeded(hr, "Failed to set install condition");
+
+            hr = StrAllocString(&pPackageC->sczInstallCondition, L"InstallPackageC", 0);
+            NativeAssert::Succeeded(hr, "Failed to set install condition");
+
+            hr = VariableSetNumeric(&pEngineState->variables, L"InstallPackageA", 1, FALSE);
+            NativeAssert::Succeeded(hr, "Failed to set variable");
+
+            hr = CorePlan(pEngineState, BOOTSTRAPPER_ACTION_INSTALL);
+            NativeAssert::Succeeded(hr, "CorePlan failed");
+
+            Assert::Equal<DWORD>(BOOTSTRAPPER_REQUEST_STATE_PRESENT, pPackageA->requested);
+            Assert::Equal<DWORD>(BOOTSTRAPPER_REQUEST_STATE_ABSENT, pPackageC->requested);
+            Assert::Equal<BOOL>(TRUE, pPackageA->planCache.fValid);
+            Assert::Equal<BOOL>(TRUE, pPackageC->planCache.fValid);
+            Assert::Equal(1ul, pPackageA->planCache.conditionInputs.cInputs);
+            Assert::Equal(1ul, pPackageC->planCache.conditionInputs.cInputs);
+            NativeAssert::StringEqual(L"InstallPackageA", pPackageA->planCache.conditionInputs.rgInputs[0].sczVariable);
+
+            dwPackageAInputChangeStamp = pPackageA->planCache.conditionInputs.rgInputs[0].dwChangeStamp;
+
+            // Planning the same action again changes no variable, so each cache is found current
+            // and given the latest stamp, which is what lets the next plan take the fast path.
+            dwVariablesChangeStamp = pEngineState->variables.dwChangeStamp;
+
+            hr = CorePlan(pEngineState, BOOTSTRAPPER_ACTION_INSTALL);
+            NativeAssert::Succeeded(hr, "CorePlan failed");
+
+            Assert::Equal(dwVariablesChangeStamp, pEngineState->variables.dwChangeStamp);
+            Assert::Equal(dwVariablesChangeStamp, pPackageA->planCache.dwVariablesChangeStamp);
+            Assert::Equal(dwVariablesChangeStamp, pPackageC->planCache.dwVariablesChangeStamp);
+            Assert::Equal(dwPackageAInputChangeStamp, pPackageA->planCache.conditionInputs.rgInputs[0].dwChangeStamp);
+            Assert::Equal<DWORD>(BOOTSTRAPPER_REQUEST_STATE_PRESENT, pPackageA->requested);
+            Assert::Equal<DWORD>(BOOTSTRAPPER_REQUEST_STATE_ABSENT, pPackageC->requested);
+
+            dwPackageAVariablesChangeStamp = pPackageA->planCache.dwVariablesChangeStamp;
+
+            // Only the variable PackageC's condition reads changes so only PackageC is planned from scratch.
+            hr = VariableSetNumeric(&pEngineState->variables, L"InstallPackageC", 1, FALSE);
+            NativeAssert::Succeeded(hr, "Failed to set variable");
+
+            hr = CorePlan(pEngineState, BOOTSTRAPPER_ACTION_INSTALL);
+            NativeAssert::Succeeded(hr, "CorePlan failed");
+
+            Assert::Equal<DWORD>(BOOTSTRAPPER_REQUEST_STATE_PRESENT, pPackageC->requested);
+            Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_CONDITION_TRUE, pPackageC->planCache.installCondition);
+            Assert::True(dwPackageAVariablesChangeStamp < pPackageC->planCache.dwVariablesChangeStamp);
+
+            // PackageA's cache was reused after checking its input and is current again.
+            Assert::Equal<BOOL>(TRUE, pPackageA->planCache.fValid);
+            Assert::Equal(dwPackageAVariablesChangeStamp + 1, pPackageA->planCache.dwVariablesChangeStamp);
+            Assert::Equal(1ul, pPackageA->planCache.conditionInputs.cInputs);
+            NativeAssert::StringEqual(L"InstallPackageA", pPackageA->planCache.conditionInputs.rgInputs[0].sczVariable);
+            Assert::Equal(dwPackageAInputChangeStamp, pPackageA->planCache.conditionInputs.rgInputs[0].dwChangeStamp);
+            Assert::Equal<DWORD>(BOOTSTRAPPER_PACKAGE_CONDITION_TRUE, pPackageA->planCache.installCondition);
+
+            InitializeEngineStateForCorePlan(wzMsiTransactionManifestFileName, &fullEngineState);
+            DetectPackagesAsAbsent(&fullEngineState);
+            DetectRelatedBundle(&fullEngineState, L"{FD9920AD-DBCA-4C6C-8CD5-B47431CE8D21}", L"1.0.0.0", BOOTSTRAPPER_RELATION_UPGRADE);
+
+            hr = StrAllocString(&fullEngineState.packages.rgPackages[0].sczInstallCondition, L"InstallPackageA", 0);
+            NativeAssert::Succeeded(hr, "Failed to set install condition");
+
+            hr = StrAllocString(&fullEngineState.packages.rgPackages[2].sczInstallCondition, L"InstallPackageC", 0);
+            NativeAssert::Succeeded(hr, "Failed to set install condition");
+
+            hr = VariableSetNumeric(&fullEngineState.variables, L"InstallPackageA", 1, FALSE);
+            NativeAssert::Succeeded(hr, "Failed to set variable");
+
+            hr = VariableSetNumeric(&fullEngineState.variables, L"InstallPackageC", 1, FALSE);
+            NativeAssert::Succeeded(hr, "Failed to set variable");
+
+            hr = CorePlan(&fullEngineState, BOOTSTRAPPER_ACTION_INSTALL);
+            NativeAssert::Succeeded(hr, "CorePlan failed");
+
+            // Without incremental planning nothing is kept for the next plan.
+            for (DWORD i = 0; i < fullEngineState.packages.cPackages; ++i)
+            {
+                Assert::Equal<BOOL>(FALSE, fullEngineState.packages.rgPackages[i].planCache.fValid);
+                Assert::Equal(0ul, fullEngineState.packages.rgPackages[i].planCache.conditionInputs.cInputs);
+            }
+
+            ValidatePlansEqual(&fullEngineState, pEngineState);
+
+            // Detect forgets everything the previous plans decided.
+            DetectPackagesAsAbsent(pEngineState);
+            Assert::Equal<BOOL>(FALSE, pPackageA->planCache.fValid);
+            Assert::Equal<BOOL>(FALSE, pPackageC->planCache.fValid);
+        }
+
         [Fact]
         void MsiTransactionUninstallTest()
         {
@@ -3042,8 +3157,13 @@ namespace Bootstrapper
 
         void PlanTestDetect(BURN_ENGINE_STATE* pEngineState)
         {
+            HRESULT hr = S_OK;
+
             DetectReset(&pEngineState->registration, &pEngineState->packages);
-            PlanReset(&pEngineState->plan, &pEngineState->variables, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
+            PlanReset(&pEngineState->plan, &pEngineState->containers, &pEngineState->packages, &pEngineState->layoutPayloads);
+
+            hr = PlanSetVariables(BOOTSTRAPPER_ACTION_UNKNOWN, &pEngineState->variables);
+            NativeAssert::Succeeded(hr, "PlanSetVariables failed");
 
             pEngineState->userExperience.fEngineActive = TRUE;
             pEngineState->fDetected = TRUE;
@@ -3758,6 +3878,93 @@ namespace Bootstrapper
             NativeAssert::StringEqual(wzName, pProvider->sczName);
         }
 
+        LPCWSTR GetExecuteActionPackageId(
+            __in BURN_EXECUTE_ACTION* pAction
+            )
+        {
+            BURN_PACKAGE* pPackage = NULL;
+
+            switch (pAction->type)
+            {
+            case BURN_EXECUTE_ACTION_TYPE_WAIT_CACHE_PACKAGE:
+                pPackage = pAction->waitCachePackage.pPackage;
+                break;
+            case BURN_EXECUTE_ACTION_TYPE_UNCACHE_PACKAGE:
+                pPackage = pAction->uncachePackage.pPackage;
+                break;
+            case BURN_EXECUTE_ACTION_TYPE_MSI_PACKAGE:
+                pPackage = pAction->msiPackage.pPackage;
+                break;
+            case BURN_EXECUTE_ACTION_TYPE_PACKAGE_PROVIDER:
+                pPackage = pAction->packageProvider.pPackage;
+                break;
+            case BURN_EXECUTE_ACTION_TYPE_PACKAGE_DEPENDENCY:
+                pPackage = pAction->packageDependency.pPackage;
+                break;
+            }
+
+            return pPackage ? pPackage->sczId : NULL;
+        }
+
+        void ValidatePlansEqual(
+            __in BURN_ENGINE_STATE* pExpectedEngineState,
+            __in BURN_ENGINE_STATE* pActualEngineState
+            )
+        {
+            BURN_PLAN* pExpected = &pExpectedEngineState->plan;
+            BURN_PLAN* pActual = &pActualEngineState->plan;
+
+            Assert::Equal(pExpected->cCacheActions, pActual->cCacheActions);
+            for (DWORD i = 0; i < pExpected->cCacheActions; ++i)
+            {
+                Assert::Equal<DWORD>(pExpected->rgCacheActions[i].type, pActual->rgCacheActions[i].type);
+            }
+
+            Assert::Equal(pExpected->cRollbackCacheActions, pActual->cRollbackCacheActions);
+            for (DWORD i = 0; i < pExpected->cRollbackCacheActions; ++i)
+            {
+                Assert::Equal<DWORD>(pExpected->rgRollbackCacheActions[i].type, pActual->rgRollbackCacheActions[i].type);
+            }
+
+            Assert::Equal(pExpected->cExecuteActions, pActual->cExecuteActions);
+            for (DWORD i = 0; i < pExpected->cExecuteActions; ++i)
+            {
+                Assert::Equal<DWORD>(pExpected->rgExecuteActions[i].type, pActual->rgExecuteActions[i].type);
+                Assert::Equal<BOOL>(pExpected->rgExecuteActions[i].fDeleted, pActual->rgExecuteActions[i].fDeleted);
+                NativeAssert::StringEqual(GetExecuteActionPackageId(pExpected->rgExecuteActions + i), GetExecuteActionPackageId(pActual->rgExecuteActions + i));
+            }
+
+            Assert::Equal(pExpected->cRollbackActions, pActual->cRollbackActions);
+            for (DWORD i = 0; i < pExpected->cRollbackActions; ++i)
+            {
+                Assert::Equal<DWORD>(pExpected->rgRollbackActions[i].type, pActual->rgRollbackActions[i].type);
+                Assert::Equal<BOOL>(pExpected->rgRollbackActions[i].fDeleted, pActual->rgRollbackActions[i].fDeleted);
+                NativeAssert::StringEqual(GetExecuteActionPackageId(pExpected->rgRollbackActions + i), GetExecuteActionPackageId(pActual->rgRollbackActions + i));
+            }
+
+            Assert::Equal(pExpected->cCleanActions, pActual->cCleanActions);
+            Assert::Equal(pExpected->cRegistrationActions, pActual->cRegistrationActions);
+            Assert::Equal(pExpected->cRestoreRelatedBundleActions, pActual->cRestoreRelatedBundleActions);
+            Assert::Equal(pExpected->qwCacheSizeTotal, pActual->qwCacheSizeTotal);
+            Assert::Equal(pExpected->cExecutePackagesTotal, pActual->cExecutePackagesTotal);
+            Assert::Equal(pExpected->cOverallProgressTicksTotal, pActual->cOverallProgressTicksTotal);
+
+            Assert::Equal(pExpectedEngineState->packages.cPackages, pActualEngineState->packages.cPackages);
+            for (DWORD i = 0; i < pExpectedEngineState->packages.cPackages; ++i)
+            {
+                BURN_PACKAGE* pExpectedPackage = pExpectedEngineState->packages.rgPackages + i;
+                BURN_PACKAGE* pActualPackage = pActualEngineState->packages.rgPackages + i;
+
+                NativeAssert::StringEqual(pExpectedPackage->sczId, pActualPackage->sczId);
+                Assert::Equal<DWORD>(pExpectedPackage->defaultRequested, pActualPackage->defaultRequested);
+                Assert::Equal<DWORD>(pExpectedPackage->requested, pActualPackage->requested);
+                Assert::Equal<DWORD>(pExpectedPackage->execute, pActualPackage->execute);
+                Assert::Equal<DWORD>(pExpectedPackage->rollback, pActualPackage->rollback);
+                Assert::Equal<DWORD>(pExpectedPackage->expectedCacheRegistrationState, pActualPackage->expectedCacheRegistrationState);
+                Assert::Equal<DWORD>(pExpectedPackage->expectedInstallRegistrationState, pActualPackage->expectedInstallRegistrationState);
+            }
+        }
+
         void ValidateRestoreRelatedBundle(
             __in BURN_PLAN* pPlan,
             __in DWORD dwIndex,
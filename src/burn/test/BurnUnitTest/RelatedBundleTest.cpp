@@ -2,6 +2,26 @@
 
 #include "precomp.h"
 
+typedef struct _RELATED_BUNDLE_QUERY_EXPECTATION
+{
+    LPCWSTR wzBundleId;
+    BUNDLE_RELATION_TYPE relationType;
+    BUNDLE_RELATION_TYPE actualRelationType;
+    DWORD cReported;
+} RELATED_BUNDLE_QUERY_EXPECTATION;
+
+typedef struct _RELATED_BUNDLE_QUERY_CONTEXT
+{
+    RELATED_BUNDLE_QUERY_EXPECTATION* rgExpected;
+    DWORD cExpected;
+    DWORD cUnexpected;
+} RELATED_BUNDLE_QUERY_CONTEXT;
+
+static BUNDLE_QUERY_CALLBACK_RESULT CALLBACK QueryRelatedBundleCallback(
+    __in const BUNDLE_QUERY_RELATED_BUNDLE_RESULT* pBundle,
+    __in_opt LPVOID pvContext
+    );
+
 
 namespace Microsoft
 {
@@ -132,6 +152,113 @@ namespace Bootstrapper
             }
         }
 
+        [Fact]
+        void RelatedBundleQueryRelationTypesTest()
+        {
+            this->QueryRelationTypesTest(FALSE);
+        }
+
+        [Fact]
+        void RelatedBundleQueryRelationTypesIndexedTest()
+        {
+            this->QueryRelationTypesTest(TRUE);
+        }
+
+        void QueryRelationTypesTest(BOOL fIndexed)
+        {
+            HRESULT hr = S_OK;
+            BOOL fIndexInitialized = FALSE;
+            LPCWSTR rgwzDetectCodes[] = { L"{2F9F8C4A-3C6B-4E58-8E0B-6D0E1B7A7D11}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}" };
+            LPCWSTR rgwzUpgradeCodes[] = { L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}" };
+            LPCWSTR rgwzAddonCodes[] = { L"{6B1D2E3F-4A5B-4C6D-8E7F-9A0B1C2D3E4F}" };
+            LPCWSTR rgwzPatchCodes[] = { L"{7E8F9A0B-1C2D-4E3F-9A4B-5C6D7E8F9A0B}" };
+            RELATED_BUNDLE_QUERY_EXPECTATION rgExpected[] =
+            {
+                // Their upgrade code is both our upgrade and detect code, upgrade wins.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F01}", BUNDLE_RELATION_UPGRADE },
+                // A second registration with the same upgrade code is related too.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F02}", BUNDLE_RELATION_UPGRADE },
+                // Their upgrade code only matches our detect code, in lower case.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F03}", BUNDLE_RELATION_DETECT },
+                // Their upgrade code matches our addon code, which wins over their addon code matching our upgrade code.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F04}", BUNDLE_RELATION_DEPENDENT_ADDON },
+                // Their upgrade code is unrelated so their addon code is considered.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F05}", BUNDLE_RELATION_ADDON },
+                // Their addon and patch codes both match, addon wins.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F06}", BUNDLE_RELATION_ADDON },
+                // Their patch code matches our detect code in lower case, which wins over their detect code.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F07}", BUNDLE_RELATION_PATCH },
+                // Their detect code matches our detect code.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F08}", BUNDLE_RELATION_DETECT },
+                // Their detect code matches our patch code.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F09}", BUNDLE_RELATION_DEPENDENT_PATCH },
+                // Their upgrade code matches our patch code and is listed twice.
+                { L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F0A}", BUNDLE_RELATION_DEPENDENT_PATCH },
+            };
+            RELATED_BUNDLE_QUERY_CONTEXT context = { };
+
+            context.rgExpected = rgExpected;
+            context.cExpected = countof(rgExpected);
+
+            try
+            {
+                this->testRegistry->SetUp();
+
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F01}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}", NULL, NULL, NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F02}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}", NULL, NULL, NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F03}", L"{2f9f8c4a-3c6b-4e58-8e0b-6d0e1b7a7d11}", NULL, NULL, NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F04}", L"{6B1D2E3F-4A5B-4C6D-8E7F-9A0B1C2D3E4F}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}", NULL, NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F05}", L"{9D8C7B6A-5F4E-4D3C-8B2A-1F0E9D8C7B6A}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}", NULL, NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F06}", NULL, L"{2F9F8C4A-3C6B-4E58-8E0B-6D0E1B7A7D11}", L"{1C0A6F5E-8A0B-4B6E-9F3A-2E5D4C3B2A10}", NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F07}", NULL, NULL, L"{2f9f8c4a-3c6b-4e58-8e0b-6d0e1b7a7d11}", L"{2F9F8C4A-3C6B-4E58-8E0B-6D0E1B7A7D11}");
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F08}", NULL, NULL, NULL, L"{9D8C7B6A-5F4E-4D3C-8B2A-1F0E9D8C7B6A};{2F9F8C4A-3C6B-4E58-8E0B-6D0E1B7A7D11}");
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F09}", NULL, NULL, NULL, L"{7e8f9a0b-1c2d-4e3f-9a4b-5c6d7e8f9a0b}");
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F0A}", L"{7E8F9A0B-1C2D-4E3F-9A4B-5C6D7E8F9A0B};{7E8F9A0B-1C2D-4E3F-9A4B-5C6D7E8F9A0B}", NULL, NULL, NULL);
+
+                // Unrelated registrations must not be reported.
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F0B}", L"{9D8C7B6A-5F4E-4D3C-8B2A-1F0E9D8C7B6A}", L"{6B1D2E3F-4A5B-4C6D-8E7F-9A0B1C2D3E4F}", L"{7E8F9A0B-1C2D-4E3F-9A4B-5C6D7E8F9A0B}", NULL);
+                this->RegisterFakeBundleCodes(L"{0A6C5C1E-1D4B-4C43-9B8A-7A1E7E0C0F0C}", NULL, NULL, NULL, NULL);
+
+                if (fIndexed)
+                {
+                    hr = BundleIndexInitialize();
+                    NativeAssert::Succeeded(hr, "Failed to initialize bundle index.");
+
+                    fIndexInitialized = TRUE;
+                }
+
+                // The second query reuses the index when there is one.
+                for (DWORD iQuery = 0; iQuery < 2; ++iQuery)
+                {
+                    for (DWORD i = 0; i < context.cExpected; ++i)
+                    {
+                        rgExpected[i].cReported = 0;
+                    }
+                    context.cUnexpected = 0;
+
+                    hr = BundleQueryRelatedBundles(BUNDLE_INSTALL_CONTEXT_USER, rgwzDetectCodes, countof(rgwzDetectCodes), rgwzUpgradeCodes, countof(rgwzUpgradeCodes), rgwzAddonCodes, countof(rgwzAddonCodes), rgwzPatchCodes, countof(rgwzPatchCodes), QueryRelatedBundleCallback, &context);
+                    NativeAssert::Succeeded(hr, "Failed to query related bundles.");
+
+                    Assert::Equal(0lu, context.cUnexpected);
+
+                    for (DWORD i = 0; i < context.cExpected; ++i)
+                    {
+                        Assert::Equal(1lu, rgExpected[i].cReported);
+                        Assert::Equal<int>(rgExpected[i].relationType, rgExpected[i].actualRelationType);
+                    }
+                }
+            }
+            finally
+            {
+                if (fIndexInitialized)
+                {
+                    BundleIndexUninitialize();
+                }
+
+                this->testRegistry->TearDown();
+            }
+        }
+
         void RegisterFakeBundles()
         {
             this->RegisterFakeBundle(L"{D54F896D-1952-43E6-9C67-B5652240618C}", L"{89FDAE1F-8CC1-48B9-B930-3945E0D3E7F0}", NULL, L"1.0.0.0", TRUE);
@@ -191,9 +318,85 @@ namespace Bootstrapper
                 ReleaseRegKey(hkRegistration);
             }
         }
+
+        void RegisterFakeBundleCodes(LPCWSTR wzBundleId, LPCWSTR wzUpgradeCodes, LPCWSTR wzAddonCodes, LPCWSTR wzPatchCodes, LPCWSTR wzDetectCodes)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczRegistrationKey = NULL;
+            HKEY hkRegistration = NULL;
+
+            try
+            {
+                hr = StrAllocFormatted(&sczRegistrationKey, L"%s\\%s", BURN_REGISTRATION_REGISTRY_UNINSTALL_KEY, wzBundleId);
+                NativeAssert::Succeeded(hr, "Failed to build uninstall registry key path.");
+
+                hr = RegCreate(HKEY_CURRENT_USER, sczRegistrationKey, KEY_WRITE, &hkRegistration);
+                NativeAssert::Succeeded(hr, "Failed to create registration key.");
+
+                this->WriteFakeBundleCodes(hkRegistration, BURN_REGISTRATION_REGISTRY_BUNDLE_UPGRADE_CODE, wzUpgradeCodes);
+                this->WriteFakeBundleCodes(hkRegistration, BURN_REGISTRATION_REGISTRY_BUNDLE_ADDON_CODE, wzAddonCodes);
+                this->WriteFakeBundleCodes(hkRegistration, BURN_REGISTRATION_REGISTRY_BUNDLE_PATCH_CODE, wzPatchCodes);
+                this->WriteFakeBundleCodes(hkRegistration, BURN_REGISTRATION_REGISTRY_BUNDLE_DETECT_CODE, wzDetectCodes);
+            }
+            finally
+            {
+                ReleaseStr(sczRegistrationKey);
+                ReleaseRegKey(hkRegistration);
+            }
+        }
+
+        void WriteFakeBundleCodes(HKEY hkRegistration, LPCWSTR wzName, LPCWSTR wzCodes)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR* rgsczCodes = NULL;
+            DWORD cCodes = 0;
+
+            if (!wzCodes)
+            {
+                return;
+            }
+
+            try
+            {
+                hr = StrSplitAllocArray(&rgsczCodes, reinterpret_cast<UINT*>(&cCodes), wzCodes, L";");
+                NativeAssert::Succeeded(hr, "Failed to split codes.");
+
+                hr = RegWriteStringArray(hkRegistration, wzName, rgsczCodes, cCodes);
+                NativeAssert::Succeeded(hr, "Failed to write %ls value.", wzName);
+            }
+            finally
+            {
+                ReleaseStrArray(rgsczCodes, cCodes);
+            }
+        }
     };
 }
 }
 }
 }
 }
+
+static BUNDLE_QUERY_CALLBACK_RESULT CALLBACK QueryRelatedBundleCallback(
+    __in const BUNDLE_QUERY_RELATED_BUNDLE_RESULT* pBundle,
+    __in_opt LPVOID pvContext
+    )
+{
+    RELATED_BUNDLE_QUERY_CONTEXT* pContext = reinterpret_cast<RELATED_BUNDLE_QUERY_CONTEXT*>(pvContext);
+
+    for (DWORD i = 0; i < pContext->cExpected; ++i)
+    {
+        RELATED_BUNDLE_QUERY_EXPECTATION* pExpected = pContext->rgExpected + i;
+
+        if (CSTR_EQUAL == ::CompareStringOrdinal(pExpected->wzBundleId, -1, pBundle->wzBundleId, -1, TRUE))
+        {
+            pExpected->actualRelationType = pBundle->relationType;
+            ++pExpected->cReported;
+
+            return BUNDLE_QUERY_CALLBACK_RESULT_CONTINUE;
+        }
+    }
+
+    ++pContext->cUnexpected;
+
+    return BUNDLE_QUERY_CALLBACK_RESULT_CONTINUE;
+}
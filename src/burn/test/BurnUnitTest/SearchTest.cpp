@@ -480,6 +480,55 @@ namespace Bootstrapper
                 SearchesUninitialize(&searches);
             }
         }
+
+        [Fact]
+        void DependentSearchTest()
+        {
+            HRESULT hr = S_OK;
+            IXMLDOMElement* pixeBundle = NULL;
+            BURN_VARIABLES variables = { };
+            BURN_SEARCHES searches = { };
+            BURN_EXTENSIONS burnExtensions = { };
+            try
+            {
+                LPCWSTR wzDocument =
+                    L"<Bundle>"
+                    L"    <SetVariable Id='Search1' Type='numeric' Value='1' Variable='Flag' />"
+                    L"    <SetVariable Id='Search2' Type='string' Value='A' Variable='Result' Condition='Flag' />"
+                    L"    <SetVariable Id='Search3' Type='numeric' Value='3' Variable='Independent' />"
+                    L"    <SetVariable Id='Search4' Type='string' Value='[Indirect]' Variable='Combined' />"
+                    L"    <SetVariable Id='Search5' Type='string' Value='B' Variable='Result' Condition='Combined = \"A-x\"' />"
+                    L"</Bundle>";
+
+                hr = VariableInitialize(&variables);
+                TestThrowOnFailure(hr, L"Failed to initialize variables.");
+
+                // Search4 only reads Result through this formatted variable.
+                VariableSetStringHelper(&variables, L"Indirect", L"[Result]-x", TRUE);
+
+                // load XML document
+                LoadBundleXmlHelper(wzDocument, &pixeBundle);
+
+                hr = SearchesParseFromXml(&searches, &burnExtensions, pixeBundle);
+                TestThrowOnFailure(hr, L"Failed to parse searches from XML.");
+
+                // execute searches
+                hr = SearchesExecute(&searches, &variables);
+                TestThrowOnFailure(hr, L"Failed to execute searches.");
+
+                // check variable values
+                Assert::Equal<String^>(gcnew String(L"A-x"), VariableGetStringHelper(&variables, L"Combined"));
+                Assert::Equal<String^>(gcnew String(L"B"), VariableGetStringHelper(&variables, L"Result"));
+                Assert::Equal(3ll, VariableGetNumericHelper(&variables, L"Independent"));
+            }
+            finally
+            {
+                ReleaseObject(pixeBundle);
+                VariablesUninitialize(&variables);
+                SearchesUninitialize(&searches);
+            }
+        }
+
         [Fact]
         void NoSearchesTest()
         {
@@ -0,0 +1,223 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+namespace Microsoft
+{
+namespace Tools
+{
+namespace WindowsInstallerXml
+{
+namespace Test
+{
+namespace Bootstrapper
+{
+    using namespace System;
+    using namespace System::IO;
+    using namespace System::Text::RegularExpressions;
+    using namespace Xunit;
+
+static HRESULT DAPI TimingTest_LogString(
+    __in_z LPCSTR szString,
+    __in_opt LPVOID pvContext
+    );
+
+    public ref class TimingTest : BurnUnitTest
+    {
+    public:
+        TimingTest(BurnTestFixture^ fixture) : BurnUnitTest(fixture)
+        {
+        }
+
+        [Fact]
+        void TimingTraceTest()
+        {
+            HRESULT hr = S_OK;
+            BOOL fTimingInitialized = FALSE;
+            BURN_TIMER timer = { };
+            String^ traceFile = Path::Combine(Path::GetTempPath(), "Bootstrapper.TimingTest.TimingTraceTest.json");
+
+            try
+            {
+                pin_ptr<const wchar_t> wzTraceFile = PtrToStringChars(traceFile);
+
+                hr = TimingInitialize(wzTraceFile);
+                NativeAssert::Succeeded(hr, "Failed to initialize timing.");
+
+                fTimingInitialized = TRUE;
+
+                for (DWORD i = 0; i < 3; ++i)
+                {
+                    TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTBEGIN, 1);
+                }
+
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPLETE, 1);
+
+                // Messages outside the known range are still counted.
+                TimeBAMessage(static_cast<BOOTSTRAPPER_APPLICATION_MESSAGE>(BOOTSTRAPPER_APPLICATION_MESSAGE_UNKNOWN - 1), 1);
+
+                for (DWORD i = 0; i < 2; ++i)
+                {
+                    TimingStart(&timer);
+                    TimingStop(&timer, BURN_TIMING_CATEGORY_PACKAGE, L"DetectPackage", L"PackageA");
+                }
+
+                TimingStart(&timer);
+                TimingStop(&timer, BURN_TIMING_CATEGORY_PACKAGE, L"DetectPackage", L"PackageB");
+
+                TimingStart(&timer);
+                TimingStop(&timer, BURN_TIMING_CATEGORY_PHASE, L"CoreDetect", NULL);
+
+                TimingReport();
+
+                String^ trace = File::ReadAllText(traceFile);
+
+                Assert::StartsWith("{\"traceEvents\":[", trace);
+                Assert::Equal(3, Regex::Matches(trace, "\"name\":\"OnDetectBegin\",\"cat\":\"ba\"")->Count);
+                Assert::Equal(1, Regex::Matches(trace, "\"name\":\"OnDetectComplete\",\"cat\":\"ba\"")->Count);
+                Assert::Equal(5, Regex::Matches(trace, "\"cat\":\"ba\"")->Count);
+                Assert::Equal(2, Regex::Matches(trace, "\"name\":\"DetectPackage: PackageA\",\"cat\":\"package\"")->Count);
+                Assert::Equal(1, Regex::Matches(trace, "\"name\":\"DetectPackage: PackageB\",\"cat\":\"package\"")->Count);
+                Assert::Equal(1, Regex::Matches(trace, "\"name\":\"CoreDetect\",\"cat\":\"phase\"")->Count);
+            }
+            finally
+            {
+                if (fTimingInitialized)
+                {
+                    TimingUninitialize();
+                }
+
+                File::Delete(traceFile);
+            }
+        }
+
+        [Fact]
+        void TimingReportsPercentilesFromHistogramTest()
+        {
+            HRESULT hr = S_OK;
+            BOOL fTimingInitialized = FALSE;
+            LPSTR sczLog = NULL;
+
+            try
+            {
+                hr = TimingInitialize(NULL);
+                NativeAssert::Succeeded(hr, "Failed to initialize timing.");
+
+                fTimingInitialized = TRUE;
+
+                // 1ms falls in the bucket up to 1.024ms, 100ms in the one up to 131.072ms.
+                for (DWORD i = 0; i < 98; ++i)
+                {
+                    TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTBEGIN, 1000);
+                }
+
+                for (DWORD i = 0; i < 2; ++i)
+                {
+                    TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTBEGIN, 100000);
+                }
+
+                // A single call reports its bucket's bound capped at the max.
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPLETE, 3000);
+
+                LogRedirect(TimingTest_LogString, &sczLog);
+
+                TimingReport();
+
+                LogRedirect(NULL, NULL);
+
+                String^ log = gcnew String(sczLog);
+
+                // p50 is the bound of the 1ms bucket and p99 the 100ms max, below its bucket's bound.
+                Assert::Matches("ba +100 +298\\.000 +1\\.024 +100\\.000 +100\\.000  OnDetectBegin", log);
+                Assert::Matches("ba +1 +3\\.000 +3\\.000 +3\\.000 +3\\.000  OnDetectComplete", log);
+            }
+            finally
+            {
+                LogRedirect(NULL, NULL);
+
+                if (fTimingInitialized)
+                {
+                    TimingUninitialize();
+                }
+
+                ReleaseStr(sczLog);
+            }
+        }
+
+        [Fact]
+        void TimingWarnsOfSlowBAMessagesTest()
+        {
+            HRESULT hr = S_OK;
+            BOOL fTimingInitialized = FALSE;
+            LPSTR sczLog = NULL;
+
+            try
+            {
+                hr = TimingInitialize(NULL);
+                NativeAssert::Succeeded(hr, "Failed to initialize timing.");
+
+                fTimingInitialized = TRUE;
+
+                LogRedirect(TimingTest_LogString, &sczLog);
+
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTBEGIN, 249000);
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONDETECTCOMPLETE, 251000);
+
+                // These wait on the user so they are never the BA's fault.
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONERROR, 1000000);
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEFILESINUSE, 1000000);
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONCACHEACQUIRERESOLVING, 1000000);
+                TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE_ONEXECUTEPROCESSCANCEL, 1000000);
+
+                LogRedirect(NULL, NULL);
+
+                String^ log = gcnew String(sczLog);
+
+                Assert::Matches("took 25[01] ms to handle message: OnDetectComplete", log);
+                Assert::Equal(1, Regex::Matches(log, "to handle message:")->Count);
+            }
+            finally
+            {
+                LogRedirect(NULL, NULL);
+
+                if (fTimingInitialized)
+                {
+                    TimingUninitialize();
+                }
+
+                ReleaseStr(sczLog);
+            }
+        }
+
+    private:
+        // Records a BA message that took exactly the given time instead of waiting for it.
+        void TimeBAMessage(BOOTSTRAPPER_APPLICATION_MESSAGE message, DWORD dwMicroseconds)
+        {
+            BURN_TIMER timer = { };
+            LARGE_INTEGER liFrequency = { };
+            LARGE_INTEGER liStop = { };
+
+            ::QueryPerformanceFrequency(&liFrequency);
+
+            TimingStart(&timer);
+
+            liStop.QuadPart = timer.liStart.QuadPart + liFrequency.QuadPart * dwMicroseconds / 1000000;
+
+            TimingStopBAMessage(&timer, &liStop, message);
+        }
+    };
+
+static HRESULT DAPI TimingTest_LogString(
+    __in_z LPCSTR szString,
+    __in_opt LPVOID pvContext
+    )
+{
+    LPSTR* psczLog = reinterpret_cast<LPSTR*>(pvContext);
+
+    return StrAnsiAllocConcat(psczLog, szString, 0);
+}
+}
+}
+}
+}
+}
@@ -74,6 +74,61 @@ namespace Bootstrapper
             }
         }
 
+        [Fact]
+        void VariablesChangeStampTest()
+        {
+            HRESULT hr = S_OK;
+            BURN_VARIABLES variables = { };
+            DWORD dwStamp = 0;
+            DWORD dwVariablesStamp = 0;
+            try
+            {
+                hr = VariableInitialize(&variables);
+                TestThrowOnFailure(hr, L"Failed to initialize variables.");
+
+                VariableSetStringHelper(&variables, L"PROP1", L"VAL1", FALSE);
+                VariableSetNumericHelper(&variables, L"PROP2", 2);
+                VariableSetVersionHelper(&variables, L"PROP3", L"1.1.0.0");
+
+                hr = VariableGetChangeStamp(&variables, L"PROP1", &dwStamp);
+                TestThrowOnFailure(hr, L"Failed to get change stamp.");
+                Assert::NotEqual(0ul, dwStamp);
+
+                dwVariablesStamp = variables.dwChangeStamp;
+
+                // setting the values the variables already have keeps every stamp
+                VariableSetStringHelper(&variables, L"PROP1", L"VAL1", FALSE);
+                VariableSetNumericHelper(&variables, L"PROP2", 2);
+                VariableSetVersionHelper(&variables, L"PROP3", L"1.1.0.0");
+                Assert::Equal(dwVariablesStamp, variables.dwChangeStamp);
+
+                hr = VariableGetChangeStamp(&variables, L"PROP1", &dwStamp);
+                TestThrowOnFailure(hr, L"Failed to get change stamp.");
+                Assert::True(dwStamp < dwVariablesStamp);
+
+                // a different value, case or type is a change
+                VariableSetStringHelper(&variables, L"PROP1", L"val1", FALSE);
+                Assert::Equal(dwVariablesStamp + 1, variables.dwChangeStamp);
+
+                VariableSetStringHelper(&variables, L"PROP1", L"val1", TRUE);
+                Assert::Equal(dwVariablesStamp + 2, variables.dwChangeStamp);
+
+                VariableSetNumericHelper(&variables, L"PROP2", 3);
+                Assert::Equal(dwVariablesStamp + 3, variables.dwChangeStamp);
+
+                VariableSetStringHelper(&variables, L"PROP3", L"1.1.0.0", FALSE);
+                Assert::Equal(dwVariablesStamp + 4, variables.dwChangeStamp);
+
+                hr = VariableGetChangeStamp(&variables, L"PROP1", &dwStamp);
+                TestThrowOnFailure(hr, L"Failed to get change stamp.");
+                Assert::Equal(dwVariablesStamp + 2, dwStamp);
+            }
+            finally
+            {
+                VariablesUninitialize(&variables);
+            }
+        }
+
         [Fact]
         void VariablesParseXmlTest()
         {
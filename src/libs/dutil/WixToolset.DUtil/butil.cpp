@@ -34,6 +34,21 @@ enum INTERNAL_BUNDLE_STATUS
     INTERNAL_BUNDLE_STATUS_UNKNOWN_PROPERTY,
 };
 
+enum BUNDLE_QUERY_CODE_LIST
+{
+    BUNDLE_QUERY_CODE_LIST_DETECT = 0x1,
+    BUNDLE_QUERY_CODE_LIST_UPGRADE = 0x2,
+    BUNDLE_QUERY_CODE_LIST_ADDON = 0x4,
+    BUNDLE_QUERY_CODE_LIST_PATCH = 0x8,
+};
+
+// A code from the query and the BUNDLE_QUERY_CODE_LIST flags of the lists it was passed in.
+typedef struct _BUNDLE_QUERY_CODE
+{
+    LPCWSTR wzCode;
+    DWORD dwLists;
+} BUNDLE_QUERY_CODE;
+
 typedef struct _BUNDLE_QUERY_CONTEXT
 {
     BUNDLE_INSTALL_CONTEXT installContext;
@@ -41,32 +56,118 @@ typedef struct _BUNDLE_QUERY_CONTEXT
     PFNBUNDLE_QUERY_RELATED_BUNDLE_CALLBACK pfnCallback;
     LPVOID pvContext;
 
-    LPCWSTR* rgwzDetectCodes;
-    DWORD cDetectCodes;
+    // Every code from the query, so each code a registration lists is matched with one lookup.
+    STRINGDICT_HANDLE sdCodes;
+    BUNDLE_QUERY_CODE* rgCodes;
+    DWORD cCodes;
+} BUNDLE_QUERY_CONTEXT;
+
+// The codes listed by a bundle registration under the Uninstall key.
+typedef struct _BUNDLE_REGISTRATION_CODES
+{
+    LPWSTR sczBundleId;
 
-    LPCWSTR* rgwzUpgradeCodes;
+    LPWSTR* rgsczUpgradeCodes;
     DWORD cUpgradeCodes;
 
-    LPCWSTR* rgwzAddonCodes;
+    LPWSTR* rgsczAddonCodes;
     DWORD cAddonCodes;
 
-    LPCWSTR* rgwzPatchCodes;
+    LPWSTR* rgsczPatchCodes;
     DWORD cPatchCodes;
-} BUNDLE_QUERY_CONTEXT;
+
+    LPWSTR* rgsczDetectCodes;
+    DWORD cDetectCodes;
+} BUNDLE_REGISTRATION_CODES;
+
+// The bundle registrations in one registry view of one Uninstall key.
+typedef struct _BUNDLE_INDEX
+{
+    BOOL fBuilt;
+    HKEY hkUninstall;
+    HANDLE hChanged;
+
+    BUNDLE_REGISTRATION_CODES* rgRegistrations;
+    DWORD cRegistrations;
+} BUNDLE_INDEX;
+
+typedef struct _BUNDLE_QUERY_MATCH
+{
+    LPWSTR sczBundleId;
+    BUNDLE_RELATION_TYPE relationType;
+} BUNDLE_QUERY_MATCH;
+
+// globals
+static volatile LONG vcBundleIndexInitialized = 0;
+static INIT_ONCE vInitOnceBundleIndex = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION vcsBundleIndex = { };
+static BUNDLE_INDEX vrgBundleIndex[2][2] = { }; // by install context, then 32-bit and 64-bit registry view.
 
 // Forward declarations.
+static HRESULT InitializeQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_z_opt LPCWSTR* rgwzDetectCodes,
+    __in DWORD cDetectCodes,
+    __in_z_opt LPCWSTR* rgwzUpgradeCodes,
+    __in DWORD cUpgradeCodes,
+    __in_z_opt LPCWSTR* rgwzAddonCodes,
+    __in DWORD cAddonCodes,
+    __in_z_opt LPCWSTR* rgwzPatchCodes,
+    __in DWORD cPatchCodes
+    );
+static HRESULT AddQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_z_opt LPCWSTR* rgwzCodes,
+    __in DWORD cCodes,
+    __in DWORD dwList
+    );
+static void UninitializeQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext
+    );
 static HRESULT QueryRelatedBundlesForScopeAndBitness(
     __in BUNDLE_QUERY_CONTEXT* pQueryContext
     );
+static HRESULT QueryIndexedRelatedBundles(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __deref_out_ecount(*pcMatches) BUNDLE_QUERY_MATCH** prgMatches,
+    __out DWORD* pcMatches
+    );
+static BOOL CALLBACK InitializeBundleIndexLock(
+    __inout PINIT_ONCE pInitOnce,
+    __inout_opt PVOID pvParameter,
+    __deref_opt_out PVOID* ppvContext
+    );
+static HRESULT EnsureBundleIndex(
+    __in BUNDLE_INDEX* pIndex,
+    __in HKEY hkRoot,
+    __in REG_KEY_BITNESS regBitness
+    );
+static void ReleaseBundleIndex(
+    __in BUNDLE_INDEX* pIndex
+    );
 static HRESULT QueryPotentialRelatedBundle(
     __in BUNDLE_QUERY_CONTEXT* pQueryContext,
     __in HKEY hkUninstallKey,
     __in_z LPCWSTR wzRelatedBundleId,
+    __in BUNDLE_RELATION_TYPE relationType,
     __inout BUNDLE_QUERY_CALLBACK_RESULT* pResult
     );
+static HRESULT ReadRegistrationCodes(
+    __in HKEY hkBundleId,
+    __inout BUNDLE_REGISTRATION_CODES* pCodes
+    );
+static void ReleaseRegistrationCodes(
+    __in BUNDLE_REGISTRATION_CODES* pCodes
+    );
+static HRESULT MatchQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_ecount(cCodes) LPWSTR* rgsczCodes,
+    __in DWORD cCodes,
+    __out DWORD* pdwLists
+    );
 static HRESULT DetermineRelationType(
     __in BUNDLE_QUERY_CONTEXT* pQueryContext,
-    __in HKEY hkBundleId,
+    __in const BUNDLE_REGISTRATION_CODES* pCodes,
     __out BUNDLE_RELATION_TYPE* pRelationType
     );
 /********************************************************************
@@ -187,17 +288,19 @@ DAPI_(HRESULT) BundleEnumRelatedBundle(
     LPWSTR sczUninstallSubKeyPath = NULL;
     HKEY hkRoot = BUNDLE_INSTALL_CONTEXT_USER == context ? HKEY_CURRENT_USER : HKEY_LOCAL_MACHINE;
     BUNDLE_QUERY_CONTEXT queryContext = { };
+    BUNDLE_REGISTRATION_CODES codes = { };
     BUNDLE_RELATION_TYPE relationType = BUNDLE_RELATION_NONE;
 
     queryContext.installContext = context;
-    queryContext.rgwzUpgradeCodes = &wzUpgradeCode;
-    queryContext.cUpgradeCodes = 1;
 
     if (!wzUpgradeCode || !pdwStartIndex)
     {
         ButilExitOnFailure(hr = E_INVALIDARG, "An invalid parameter was passed to the function.");
     }
 
+    hr = InitializeQueryCodes(&queryContext, NULL, 0, &wzUpgradeCode, 1, NULL, 0, NULL, 0);
+    ButilExitOnFailure(hr, "Failed to initialize upgrade code to match.");
+
     hr = RegOpenEx(hkRoot, BUNDLE_REGISTRATION_REGISTRY_UNINSTALL_KEY, KEY_READ, kbKeyBitness, &hkUninstall);
     ButilExitOnFailure(hr, "Failed to open bundle uninstall key path.");
 
@@ -212,7 +315,12 @@ DAPI_(HRESULT) BundleEnumRelatedBundle(
         hr = RegOpenEx(hkRoot, sczUninstallSubKeyPath, KEY_READ, kbKeyBitness, &hkBundle);
         ButilExitOnFailure(hr, "Failed to open uninstall key path.");
 
-        hr = DetermineRelationType(&queryContext, hkBundle, &relationType);
+        hr = ReadRegistrationCodes(hkBundle, &codes);
+        if (SUCCEEDED(hr))
+        {
+            hr = DetermineRelationType(&queryContext, &codes, &relationType);
+        }
+
         if (SUCCEEDED(hr) && BUNDLE_RELATION_UPGRADE == relationType)
         {
             fUpgradeCodeFound = TRUE;
@@ -228,10 +336,13 @@ DAPI_(HRESULT) BundleEnumRelatedBundle(
         }
 
         // Cleanup before next iteration
+        ReleaseRegistrationCodes(&codes);
         ReleaseRegKey(hkBundle);
     }
 
 LExit:
+    ReleaseRegistrationCodes(&codes);
+    UninitializeQueryCodes(&queryContext);
     ReleaseStr(sczUninstallSubKey);
     ReleaseStr(sczUninstallSubKeyPath);
     ReleaseRegKey(hkBundle);
@@ -345,6 +456,44 @@ LExit:
     return hr;
 }
 
+DAPI_(HRESULT) BundleIndexInitialize()
+{
+    HRESULT hr = S_OK;
+
+    // The lock must be ready before the count lets a query use the index, and it lives for the rest of
+    // the process so a query that saw the count never enters a deleted lock.
+    if (!::InitOnceExecuteOnce(&vInitOnceBundleIndex, InitializeBundleIndexLock, NULL, NULL))
+    {
+        ButilExitWithLastError(hr, "Failed to initialize lock for index of bundle registrations.");
+    }
+
+    ::InterlockedIncrement(&vcBundleIndexInitialized);
+
+LExit:
+    return hr;
+}
+
+DAPI_(void) BundleIndexUninitialize()
+{
+    AssertSz(vcBundleIndexInitialized, "BundleIndexUninitialize called when not initialized");
+
+    LONG cInitialized = ::InterlockedDecrement(&vcBundleIndexInitialized);
+    if (0 == cInitialized)
+    {
+        ::EnterCriticalSection(&vcsBundleIndex);
+
+        for (DWORD i = 0; i < countof(vrgBundleIndex); ++i)
+        {
+            for (DWORD j = 0; j < countof(vrgBundleIndex[i]); ++j)
+            {
+                ReleaseBundleIndex(&vrgBundleIndex[i][j]);
+            }
+        }
+
+        ::LeaveCriticalSection(&vcsBundleIndex);
+    }
+}
+
 DAPI_(HRESULT) BundleQueryRelatedBundles(
     __in BUNDLE_INSTALL_CONTEXT installContext,
     __in_z_opt LPCWSTR* rgwzDetectCodes,
@@ -369,17 +518,12 @@ DAPI_(HRESULT) BundleQueryRelatedBundles(
 #endif
 
     queryContext.installContext = installContext;
-    queryContext.rgwzDetectCodes = rgwzDetectCodes;
-    queryContext.cDetectCodes = cDetectCodes;
-    queryContext.rgwzUpgradeCodes = rgwzUpgradeCodes;
-    queryContext.cUpgradeCodes = cUpgradeCodes;
-    queryContext.rgwzAddonCodes = rgwzAddonCodes;
-    queryContext.cAddonCodes = cAddonCodes;
-    queryContext.rgwzPatchCodes = rgwzPatchCodes;
-    queryContext.cPatchCodes = cPatchCodes;
     queryContext.pfnCallback = pfnCallback;
     queryContext.pvContext = pvContext;
 
+    hr = InitializeQueryCodes(&queryContext, rgwzDetectCodes, cDetectCodes, rgwzUpgradeCodes, cUpgradeCodes, rgwzAddonCodes, cAddonCodes, rgwzPatchCodes, cPatchCodes);
+    ButilExitOnFailure(hr, "Failed to initialize codes to match related bundles.");
+
     queryContext.regBitness = REG_KEY_32BIT;
 
     hr = QueryRelatedBundlesForScopeAndBitness(&queryContext);
@@ -394,9 +538,103 @@ DAPI_(HRESULT) BundleQueryRelatedBundles(
     }
 
 LExit:
+    UninitializeQueryCodes(&queryContext);
+
     return hr;
 }
 
+static HRESULT InitializeQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_z_opt LPCWSTR* rgwzDetectCodes,
+    __in DWORD cDetectCodes,
+    __in_z_opt LPCWSTR* rgwzUpgradeCodes,
+    __in DWORD cUpgradeCodes,
+    __in_z_opt LPCWSTR* rgwzAddonCodes,
+    __in DWORD cAddonCodes,
+    __in_z_opt LPCWSTR* rgwzPatchCodes,
+    __in DWORD cPatchCodes
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD cCodes = 0;
+
+    hr = ::DWordAdd(cDetectCodes, cUpgradeCodes, &cCodes);
+    ButilExitOnRootFailure(hr, "Too many codes to match related bundles.");
+
+    hr = ::DWordAdd(cCodes, cAddonCodes, &cCodes);
+    ButilExitOnRootFailure(hr, "Too many codes to match related bundles.");
+
+    hr = ::DWordAdd(cCodes, cPatchCodes, &cCodes);
+    ButilExitOnRootFailure(hr, "Too many codes to match related bundles.");
+
+    if (!cCodes)
+    {
+        ExitFunction();
+    }
+
+    // Sized for every code up front since the dictionary points into the array.
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&pQueryContext->rgCodes), sizeof(BUNDLE_QUERY_CODE), cCodes);
+    ButilExitOnFailure(hr, "Failed to allocate codes to match related bundles.");
+
+    hr = DictCreateWithEmbeddedKey(&pQueryContext->sdCodes, cCodes, NULL, offsetof(BUNDLE_QUERY_CODE, wzCode), DICT_FLAG_CASEINSENSITIVE);
+    ButilExitOnFailure(hr, "Failed to create dictionary of codes to match related bundles.");
+
+    hr = AddQueryCodes(pQueryContext, rgwzDetectCodes, cDetectCodes, BUNDLE_QUERY_CODE_LIST_DETECT);
+    ButilExitOnFailure(hr, "Failed to add %hs to match related bundles.", "detect codes");
+
+    hr = AddQueryCodes(pQueryContext, rgwzUpgradeCodes, cUpgradeCodes, BUNDLE_QUERY_CODE_LIST_UPGRADE);
+    ButilExitOnFailure(hr, "Failed to add %hs to match related bundles.", "upgrade codes");
+
+    hr = AddQueryCodes(pQueryContext, rgwzAddonCodes, cAddonCodes, BUNDLE_QUERY_CODE_LIST_ADDON);
+    ButilExitOnFailure(hr, "Failed to add %hs to match related bundles.", "addon codes");
+
+    hr = AddQueryCodes(pQueryContext, rgwzPatchCodes, cPatchCodes, BUNDLE_QUERY_CODE_LIST_PATCH);
+    ButilExitOnFailure(hr, "Failed to add %hs to match related bundles.", "patch codes");
+
+LExit:
+    return hr;
+}
+
+static HRESULT AddQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_z_opt LPCWSTR* rgwzCodes,
+    __in DWORD cCodes,
+    __in DWORD dwList
+    )
+{
+    HRESULT hr = S_OK;
+    BUNDLE_QUERY_CODE* pCode = NULL;
+
+    for (DWORD i = 0; i < cCodes; ++i)
+    {
+        hr = DictGetValue(pQueryContext->sdCodes, rgwzCodes[i], reinterpret_cast<void**>(&pCode));
+        if (E_NOTFOUND == hr)
+        {
+            pCode = pQueryContext->rgCodes + pQueryContext->cCodes;
+            pCode->wzCode = rgwzCodes[i];
+
+            hr = DictAddValue(pQueryContext->sdCodes, pCode);
+            ButilExitOnFailure(hr, "Failed to add code to match related bundles: %ls", rgwzCodes[i]);
+
+            ++pQueryContext->cCodes;
+        }
+        ButilExitOnFailure(hr, "Failed to find code to match related bundles: %ls", rgwzCodes[i]);
+
+        pCode->dwLists |= dwList;
+    }
+
+LExit:
+    return hr;
+}
+
+static void UninitializeQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext
+    )
+{
+    ReleaseDict(pQueryContext->sdCodes);
+    ReleaseMem(pQueryContext->rgCodes);
+}
+
 static HRESULT QueryRelatedBundlesForScopeAndBitness(
     __in BUNDLE_QUERY_CONTEXT* pQueryContext
     )
@@ -406,6 +644,8 @@ static HRESULT QueryRelatedBundlesForScopeAndBitness(
     HKEY hkUninstallKey = NULL;
     BOOL fExists = FALSE;
     LPWSTR sczRelatedBundleId = NULL;
+    BUNDLE_QUERY_MATCH* rgMatches = NULL;
+    DWORD cMatches = 0;
     BUNDLE_QUERY_CALLBACK_RESULT result = BUNDLE_QUERY_CALLBACK_RESULT_CONTINUE;
 
     hr = RegOpenEx(hkRoot, BUNDLE_REGISTRATION_REGISTRY_UNINSTALL_KEY, KEY_READ, pQueryContext->regBitness, &hkUninstallKey);
@@ -416,6 +656,24 @@ static HRESULT QueryRelatedBundlesForScopeAndBitness(
         ExitFunction1(hr = S_OK);
     }
 
+    if (vcBundleIndexInitialized)
+    {
+        hr = QueryIndexedRelatedBundles(pQueryContext, &rgMatches, &cMatches);
+        ButilExitOnFailure(hr, "Failed to query index of bundle registrations for related bundles.");
+
+        for (DWORD i = 0; i < cMatches; ++i)
+        {
+            // Ignore failures here since the bundle may have been removed after it was indexed.
+            HRESULT hrRelatedBundle = QueryPotentialRelatedBundle(pQueryContext, hkUninstallKey, rgMatches[i].sczBundleId, rgMatches[i].relationType, &result);
+            if (SUCCEEDED(hrRelatedBundle) && BUNDLE_QUERY_CALLBACK_RESULT_CONTINUE != result)
+            {
+                ExitFunction1(hr = HRESULT_FROM_WIN32(ERROR_REQUEST_ABORTED));
+            }
+        }
+
+        ExitFunction();
+    }
+
     for (DWORD dwIndex = 0; /* exit via break below */; ++dwIndex)
     {
         hr = RegKeyEnum(hkUninstallKey, dwIndex, &sczRelatedBundleId);
@@ -428,7 +686,7 @@ static HRESULT QueryRelatedBundlesForScopeAndBitness(
 
         // Ignore failures here since we'll often find products that aren't actually
         // related bundles (or even bundles at all).
-        HRESULT hrRelatedBundle = QueryPotentialRelatedBundle(pQueryContext, hkUninstallKey, sczRelatedBundleId, &result);
+        HRESULT hrRelatedBundle = QueryPotentialRelatedBundle(pQueryContext, hkUninstallKey, sczRelatedBundleId, BUNDLE_RELATION_NONE, &result);
         if (SUCCEEDED(hrRelatedBundle) && BUNDLE_QUERY_CALLBACK_RESULT_CONTINUE != result)
         {
             ExitFunction1(hr = HRESULT_FROM_WIN32(ERROR_REQUEST_ABORTED));
@@ -436,31 +694,210 @@ static HRESULT QueryRelatedBundlesForScopeAndBitness(
     }
 
 LExit:
+    for (DWORD i = 0; i < cMatches; ++i)
+    {
+        ReleaseStr(rgMatches[i].sczBundleId);
+    }
+    ReleaseMem(rgMatches);
     ReleaseStr(sczRelatedBundleId);
     ReleaseRegKey(hkUninstallKey);
 
     return hr;
 }
 
+// Matches the indexed registrations while holding the lock but returns the matches so
+// the callback runs without it.
+static HRESULT QueryIndexedRelatedBundles(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __deref_out_ecount(*pcMatches) BUNDLE_QUERY_MATCH** prgMatches,
+    __out DWORD* pcMatches
+    )
+{
+    HRESULT hr = S_OK;
+    BOOL fUser = BUNDLE_INSTALL_CONTEXT_USER == pQueryContext->installContext;
+    BUNDLE_INDEX* pIndex = &vrgBundleIndex[fUser ? 1 : 0][REG_KEY_64BIT == pQueryContext->regBitness ? 1 : 0];
+    BUNDLE_RELATION_TYPE relationType = BUNDLE_RELATION_NONE;
+
+    ::EnterCriticalSection(&vcsBundleIndex);
+
+    hr = EnsureBundleIndex(pIndex, fUser ? HKEY_CURRENT_USER : HKEY_LOCAL_MACHINE, pQueryContext->regBitness);
+    ButilExitOnFailure(hr, "Failed to index bundle registrations.");
+
+    for (DWORD i = 0; i < pIndex->cRegistrations; ++i)
+    {
+        const BUNDLE_REGISTRATION_CODES* pCodes = pIndex->rgRegistrations + i;
+
+        hr = DetermineRelationType(pQueryContext, pCodes, &relationType);
+        if (E_NOTFOUND == hr)
+        {
+            hr = S_OK;
+            continue;
+        }
+        ButilExitOnFailure(hr, "Failed to determine relation type of bundle: %ls", pCodes->sczBundleId);
+
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(prgMatches), *pcMatches, 1, sizeof(BUNDLE_QUERY_MATCH), 4);
+        ButilExitOnFailure(hr, "Failed to grow array of related bundle matches.");
+
+        BUNDLE_QUERY_MATCH* pMatch = *prgMatches + *pcMatches;
+
+        hr = StrAllocString(&pMatch->sczBundleId, pCodes->sczBundleId, 0);
+        ButilExitOnFailure(hr, "Failed to copy related bundle id.");
+
+        pMatch->relationType = relationType;
+        ++*pcMatches;
+    }
+
+LExit:
+    ::LeaveCriticalSection(&vcsBundleIndex);
+
+    return hr;
+}
+
+static BOOL CALLBACK InitializeBundleIndexLock(
+    __inout PINIT_ONCE /*pInitOnce*/,
+    __inout_opt PVOID /*pvParameter*/,
+    __deref_opt_out PVOID* /*ppvContext*/
+    )
+{
+    ::InitializeCriticalSection(&vcsBundleIndex);
+
+    return TRUE;
+}
+
+static HRESULT EnsureBundleIndex(
+    __in BUNDLE_INDEX* pIndex,
+    __in HKEY hkRoot,
+    __in REG_KEY_BITNESS regBitness
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD er = ERROR_SUCCESS;
+    BOOL fExists = FALSE;
+    LPWSTR sczBundleId = NULL;
+    HKEY hkBundle = NULL;
+    BUNDLE_REGISTRATION_CODES codes = { };
+
+    // The index stays valid until the Uninstall key or a key below it changes.
+    if (pIndex->fBuilt && WAIT_TIMEOUT == ::WaitForSingleObject(pIndex->hChanged, 0))
+    {
+        ExitFunction();
+    }
+
+    ReleaseBundleIndex(pIndex);
+
+    hr = RegOpenEx(hkRoot, BUNDLE_REGISTRATION_REGISTRY_UNINSTALL_KEY, KEY_READ | KEY_NOTIFY, regBitness, &pIndex->hkUninstall);
+    ButilExitOnPathFailure(hr, fExists, "Failed to open uninstall registry key to index bundle registrations.");
+
+    if (!fExists)
+    {
+        // Nothing to watch, so leave the index unbuilt and look again on the next query.
+        ExitFunction1(hr = S_OK);
+    }
+
+    pIndex->hChanged = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+    ButilExitOnNullWithLastError(pIndex->hChanged, hr, "Failed to create event to watch bundle registrations.");
+
+    // Watch before enumerating so a change made while enumerating rebuilds the index on the next query.
+    // The watch is thread agnostic so the exit of the thread that built the index doesn't signal it.
+    // Before Windows 8 that flag is rejected and the thread's exit only costs a rebuild.
+    er = ::RegNotifyChangeKeyValue(pIndex->hkUninstall, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC, pIndex->hChanged, TRUE);
+    if (ERROR_INVALID_PARAMETER == er)
+    {
+        er = ::RegNotifyChangeKeyValue(pIndex->hkUninstall, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, pIndex->hChanged, TRUE);
+    }
+    ButilExitOnWin32Error(er, hr, "Failed to watch uninstall registry key for bundle registrations.");
+
+    for (DWORD dwIndex = 0; /* exit via break below */; ++dwIndex)
+    {
+        hr = RegKeyEnum(pIndex->hkUninstall, dwIndex, &sczBundleId);
+        if (E_NOMOREITEMS == hr)
+        {
+            hr = S_OK;
+            break;
+        }
+        ButilExitOnFailure(hr, "Failed to enumerate uninstall key to index bundle registrations.");
+
+        // Only keys that list codes are indexed, failures are ignored since most keys are not bundles.
+        hr = RegOpenEx(pIndex->hkUninstall, sczBundleId, KEY_READ, regBitness, &hkBundle);
+        if (SUCCEEDED(hr) && S_OK == ReadRegistrationCodes(hkBundle, &codes))
+        {
+            hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pIndex->rgRegistrations), pIndex->cRegistrations, 1, sizeof(BUNDLE_REGISTRATION_CODES), 16);
+            ButilExitOnFailure(hr, "Failed to grow index of bundle registrations.");
+
+            codes.sczBundleId = sczBundleId;
+            sczBundleId = NULL;
+
+            pIndex->rgRegistrations[pIndex->cRegistrations] = codes;
+            ++pIndex->cRegistrations;
+
+            memset(&codes, 0, sizeof(codes));
+        }
+
+        ReleaseRegistrationCodes(&codes);
+        ReleaseRegKey(hkBundle);
+    }
+
+    pIndex->fBuilt = TRUE;
+
+LExit:
+    if (FAILED(hr))
+    {
+        ReleaseBundleIndex(pIndex);
+    }
+
+    ReleaseRegistrationCodes(&codes);
+    ReleaseRegKey(hkBundle);
+    ReleaseStr(sczBundleId);
+
+    return hr;
+}
+
+static void ReleaseBundleIndex(
+    __in BUNDLE_INDEX* pIndex
+    )
+{
+    for (DWORD i = 0; i < pIndex->cRegistrations; ++i)
+    {
+        ReleaseRegistrationCodes(pIndex->rgRegistrations + i);
+    }
+
+    ReleaseMem(pIndex->rgRegistrations);
+    ReleaseHandle(pIndex->hChanged);
+    ReleaseRegKey(pIndex->hkUninstall);
+
+    memset(pIndex, 0, sizeof(BUNDLE_INDEX));
+}
+
+// relationType is BUNDLE_RELATION_NONE when it has to be determined from the bundle's key.
 static HRESULT QueryPotentialRelatedBundle(
     __in BUNDLE_QUERY_CONTEXT* pQueryContext,
     __in HKEY hkUninstallKey,
     __in_z LPCWSTR wzRelatedBundleId,
+    __in BUNDLE_RELATION_TYPE relationType,
     __inout BUNDLE_QUERY_CALLBACK_RESULT* pResult
     )
 {
     HRESULT hr = S_OK;
     HKEY hkBundleId = NULL;
-    BUNDLE_RELATION_TYPE relationType = BUNDLE_RELATION_NONE;
+    BUNDLE_REGISTRATION_CODES codes = { };
     BUNDLE_QUERY_RELATED_BUNDLE_RESULT bundle = { };
 
     hr = RegOpenEx(hkUninstallKey, wzRelatedBundleId, KEY_READ, pQueryContext->regBitness, &hkBundleId);
     ButilExitOnFailure(hr, "Failed to open uninstall key for potential related bundle: %ls", wzRelatedBundleId);
 
-    hr = DetermineRelationType(pQueryContext, hkBundleId, &relationType);
-    if (FAILED(hr))
+    if (BUNDLE_RELATION_NONE == relationType)
     {
-        ExitFunction();
+        hr = ReadRegistrationCodes(hkBundleId, &codes);
+        if (FAILED(hr))
+        {
+            ExitFunction();
+        }
+
+        hr = DetermineRelationType(pQueryContext, &codes, &relationType);
+        if (FAILED(hr))
+        {
+            ExitFunction();
+        }
     }
 
     bundle.installContext = pQueryContext->installContext;
@@ -472,243 +909,168 @@ static HRESULT QueryPotentialRelatedBundle(
     *pResult = pQueryContext->pfnCallback(&bundle, pQueryContext->pvContext);
 
 LExit:
+    ReleaseRegistrationCodes(&codes);
     ReleaseRegKey(hkBundleId);
 
     return hr;
 }
 
-static HRESULT DetermineRelationType(
-    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+// Returns S_FALSE when the key lists no codes, which is the case for most keys under Uninstall.
+static HRESULT ReadRegistrationCodes(
     __in HKEY hkBundleId,
-    __out BUNDLE_RELATION_TYPE* pRelationType
+    __inout BUNDLE_REGISTRATION_CODES* pCodes
     )
 {
     HRESULT hr = S_OK;
-    LPWSTR* rgsczUpgradeCodes = NULL;
-    DWORD cUpgradeCodes = 0;
-    STRINGDICT_HANDLE sdUpgradeCodes = NULL;
-    LPWSTR* rgsczAddonCodes = NULL;
-    DWORD cAddonCodes = 0;
-    STRINGDICT_HANDLE sdAddonCodes = NULL;
-    LPWSTR* rgsczDetectCodes = NULL;
-    DWORD cDetectCodes = 0;
-    STRINGDICT_HANDLE sdDetectCodes = NULL;
-    LPWSTR* rgsczPatchCodes = NULL;
-    DWORD cPatchCodes = 0;
-    STRINGDICT_HANDLE sdPatchCodes = NULL;
-
-    *pRelationType = BUNDLE_RELATION_NONE;
 
-    hr = RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_UPGRADE_CODE, &rgsczUpgradeCodes, &cUpgradeCodes);
+    hr = RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_UPGRADE_CODE, &pCodes->rgsczUpgradeCodes, &pCodes->cUpgradeCodes);
     if (HRESULT_FROM_WIN32(ERROR_INVALID_DATATYPE) == hr)
     {
         TraceError(hr, "Failed to read upgrade codes as REG_MULTI_SZ. Trying again as REG_SZ in case of older bundles.");
 
-        rgsczUpgradeCodes = reinterpret_cast<LPWSTR*>(MemAlloc(sizeof(LPWSTR), TRUE));
-        ButilExitOnNull(rgsczUpgradeCodes, hr, E_OUTOFMEMORY, "Failed to allocate list for a single upgrade code from older bundle.");
+        pCodes->rgsczUpgradeCodes = reinterpret_cast<LPWSTR*>(MemAlloc(sizeof(LPWSTR), TRUE));
+        ButilExitOnNull(pCodes->rgsczUpgradeCodes, hr, E_OUTOFMEMORY, "Failed to allocate list for a single upgrade code from older bundle.");
 
-        hr = RegReadString(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_UPGRADE_CODE, &rgsczUpgradeCodes[0]);
+        hr = RegReadString(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_UPGRADE_CODE, &pCodes->rgsczUpgradeCodes[0]);
         if (SUCCEEDED(hr))
         {
-            cUpgradeCodes = 1;
+            pCodes->cUpgradeCodes = 1;
         }
     }
 
-    // Compare upgrade codes.
-    if (SUCCEEDED(hr))
-    {
-        hr = DictCreateStringListFromArray(&sdUpgradeCodes, rgsczUpgradeCodes, cUpgradeCodes, DICT_FLAG_CASEINSENSITIVE);
-        ButilExitOnFailure(hr, "Failed to create string dictionary for %hs.", "upgrade codes");
+    // Codes that are missing or can't be read don't relate the bundle.
+    RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_ADDON_CODE, &pCodes->rgsczAddonCodes, &pCodes->cAddonCodes);
+    RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_PATCH_CODE, &pCodes->rgsczPatchCodes, &pCodes->cPatchCodes);
+    RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_DETECT_CODE, &pCodes->rgsczDetectCodes, &pCodes->cDetectCodes);
 
-        // Upgrade relationship: when their upgrade codes match our upgrade codes.
-        hr = DictCompareStringListToArray(sdUpgradeCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzUpgradeCodes), pQueryContext->cUpgradeCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for upgrade code match.");
+    hr = (pCodes->cUpgradeCodes || pCodes->cAddonCodes || pCodes->cPatchCodes || pCodes->cDetectCodes) ? S_OK : S_FALSE;
 
-            *pRelationType = BUNDLE_RELATION_UPGRADE;
-            ExitFunction();
-        }
-
-        // Detect relationship: when their upgrade codes match our detect codes.
-        hr = DictCompareStringListToArray(sdUpgradeCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzDetectCodes), pQueryContext->cDetectCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for detect code match.");
+LExit:
+    return hr;
+}
 
-            *pRelationType = BUNDLE_RELATION_DETECT;
-            ExitFunction();
-        }
+static void ReleaseRegistrationCodes(
+    __in BUNDLE_REGISTRATION_CODES* pCodes
+    )
+{
+    ReleaseStr(pCodes->sczBundleId);
+    ReleaseStrArray(pCodes->rgsczUpgradeCodes, pCodes->cUpgradeCodes);
+    ReleaseStrArray(pCodes->rgsczAddonCodes, pCodes->cAddonCodes);
+    ReleaseStrArray(pCodes->rgsczPatchCodes, pCodes->cPatchCodes);
+    ReleaseStrArray(pCodes->rgsczDetectCodes, pCodes->cDetectCodes);
 
-        // Dependent relationship: when their upgrade codes match our addon codes.
-        hr = DictCompareStringListToArray(sdUpgradeCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzAddonCodes), pQueryContext->cAddonCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for addon code match.");
+    memset(pCodes, 0, sizeof(BUNDLE_REGISTRATION_CODES));
+}
 
-            *pRelationType = BUNDLE_RELATION_DEPENDENT_ADDON;
-            ExitFunction();
-        }
+// Returns the BUNDLE_QUERY_CODE_LIST flags of every query list that shares a code with rgsczCodes.
+static HRESULT MatchQueryCodes(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in_ecount(cCodes) LPWSTR* rgsczCodes,
+    __in DWORD cCodes,
+    __out DWORD* pdwLists
+    )
+{
+    HRESULT hr = S_OK;
+    BUNDLE_QUERY_CODE* pCode = NULL;
 
-        // Dependent relationship: when their upgrade codes match our patch codes.
-        hr = DictCompareStringListToArray(sdUpgradeCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzPatchCodes), pQueryContext->cPatchCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for patch code match.");
+    *pdwLists = 0;
 
-            *pRelationType = BUNDLE_RELATION_DEPENDENT_PATCH;
-            ExitFunction();
-        }
-
-        ReleaseNullDict(sdUpgradeCodes);
-        ReleaseNullStrArray(rgsczUpgradeCodes, cUpgradeCodes);
+    if (!pQueryContext->cCodes)
+    {
+        ExitFunction();
     }
 
-    // Compare addon codes.
-    hr = RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_ADDON_CODE, &rgsczAddonCodes, &cAddonCodes);
-    if (SUCCEEDED(hr))
+    for (DWORD i = 0; i < cCodes; ++i)
     {
-        hr = DictCreateStringListFromArray(&sdAddonCodes, rgsczAddonCodes, cAddonCodes, DICT_FLAG_CASEINSENSITIVE);
-        ButilExitOnFailure(hr, "Failed to create string dictionary for %hs.", "addon codes");
-
-        // Addon relationship: when their addon codes match our detect codes.
-        hr = DictCompareStringListToArray(sdAddonCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzDetectCodes), pQueryContext->cDetectCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
+        hr = DictGetValue(pQueryContext->sdCodes, rgsczCodes[i], reinterpret_cast<void**>(&pCode));
+        if (E_NOTFOUND == hr)
         {
             hr = S_OK;
+            continue;
         }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for addon code match.");
+        ButilExitOnFailure(hr, "Failed to look up code: %ls", rgsczCodes[i]);
 
-            *pRelationType = BUNDLE_RELATION_ADDON;
-            ExitFunction();
-        }
+        *pdwLists |= pCode->dwLists;
+    }
 
-        // Addon relationship: when their addon codes match our upgrade codes.
-        hr = DictCompareStringListToArray(sdAddonCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzUpgradeCodes), pQueryContext->cUpgradeCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for addon code match.");
+LExit:
+    return hr;
+}
 
-            *pRelationType = BUNDLE_RELATION_ADDON;
-            ExitFunction();
-        }
+static HRESULT DetermineRelationType(
+    __in BUNDLE_QUERY_CONTEXT* pQueryContext,
+    __in const BUNDLE_REGISTRATION_CODES* pCodes,
+    __out BUNDLE_RELATION_TYPE* pRelationType
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwLists = 0;
 
-        ReleaseNullDict(sdAddonCodes);
-        ReleaseNullStrArray(rgsczAddonCodes, cAddonCodes);
-    }
+    *pRelationType = BUNDLE_RELATION_NONE;
 
-    // Compare patch codes.
-    hr = RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_PATCH_CODE, &rgsczPatchCodes, &cPatchCodes);
-    if (SUCCEEDED(hr))
-    {
-        hr = DictCreateStringListFromArray(&sdPatchCodes, rgsczPatchCodes, cPatchCodes, DICT_FLAG_CASEINSENSITIVE);
-        ButilExitOnFailure(hr, "Failed to create string dictionary for %hs.", "patch codes");
+    // Compare upgrade codes.
+    hr = MatchQueryCodes(pQueryContext, pCodes->rgsczUpgradeCodes, pCodes->cUpgradeCodes, &dwLists);
+    ButilExitOnFailure(hr, "Failed to match %hs.", "upgrade codes");
 
-        // Patch relationship: when their patch codes match our detect codes.
-        hr = DictCompareStringListToArray(sdPatchCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzDetectCodes), pQueryContext->cDetectCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for patch code match.");
+    if (BUNDLE_QUERY_CODE_LIST_UPGRADE & dwLists)
+    {
+        // Upgrade relationship: when their upgrade codes match our upgrade codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_UPGRADE);
+    }
+    else if (BUNDLE_QUERY_CODE_LIST_DETECT & dwLists)
+    {
+        // Detect relationship: when their upgrade codes match our detect codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DETECT);
+    }
+    else if (BUNDLE_QUERY_CODE_LIST_ADDON & dwLists)
+    {
+        // Dependent relationship: when their upgrade codes match our addon codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DEPENDENT_ADDON);
+    }
+    else if (BUNDLE_QUERY_CODE_LIST_PATCH & dwLists)
+    {
+        // Dependent relationship: when their upgrade codes match our patch codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DEPENDENT_PATCH);
+    }
 
-            *pRelationType = BUNDLE_RELATION_PATCH;
-            ExitFunction();
-        }
+    // Compare addon codes.
+    hr = MatchQueryCodes(pQueryContext, pCodes->rgsczAddonCodes, pCodes->cAddonCodes, &dwLists);
+    ButilExitOnFailure(hr, "Failed to match %hs.", "addon codes");
 
-        // Patch relationship: when their patch codes match our upgrade codes.
-        hr = DictCompareStringListToArray(sdPatchCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzUpgradeCodes), pQueryContext->cUpgradeCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for patch code match.");
+    if ((BUNDLE_QUERY_CODE_LIST_DETECT | BUNDLE_QUERY_CODE_LIST_UPGRADE) & dwLists)
+    {
+        // Addon relationship: when their addon codes match our detect or upgrade codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_ADDON);
+    }
 
-            *pRelationType = BUNDLE_RELATION_PATCH;
-            ExitFunction();
-        }
+    // Compare patch codes.
+    hr = MatchQueryCodes(pQueryContext, pCodes->rgsczPatchCodes, pCodes->cPatchCodes, &dwLists);
+    ButilExitOnFailure(hr, "Failed to match %hs.", "patch codes");
 
-        ReleaseNullDict(sdPatchCodes);
-        ReleaseNullStrArray(rgsczPatchCodes, cPatchCodes);
+    if ((BUNDLE_QUERY_CODE_LIST_DETECT | BUNDLE_QUERY_CODE_LIST_UPGRADE) & dwLists)
+    {
+        // Patch relationship: when their patch codes match our detect or upgrade codes.
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_PATCH);
     }
 
     // Compare detect codes.
-    hr = RegReadStringArray(hkBundleId, BUNDLE_REGISTRATION_REGISTRY_BUNDLE_DETECT_CODE, &rgsczDetectCodes, &cDetectCodes);
-    if (SUCCEEDED(hr))
-    {
-        hr = DictCreateStringListFromArray(&sdDetectCodes, rgsczDetectCodes, cDetectCodes, DICT_FLAG_CASEINSENSITIVE);
-        ButilExitOnFailure(hr, "Failed to create string dictionary for %hs.", "detect codes");
+    hr = MatchQueryCodes(pQueryContext, pCodes->rgsczDetectCodes, pCodes->cDetectCodes, &dwLists);
+    ButilExitOnFailure(hr, "Failed to match %hs.", "detect codes");
 
+    if (BUNDLE_QUERY_CODE_LIST_DETECT & dwLists)
+    {
         // Detect relationship: when their detect codes match our detect codes.
-        hr = DictCompareStringListToArray(sdDetectCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzDetectCodes), pQueryContext->cDetectCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for detect code match.");
-
-            *pRelationType = BUNDLE_RELATION_DETECT;
-            ExitFunction();
-        }
-
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DETECT);
+    }
+    else if (BUNDLE_QUERY_CODE_LIST_ADDON & dwLists)
+    {
         // Dependent relationship: when their detect codes match our addon codes.
-        hr = DictCompareStringListToArray(sdDetectCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzAddonCodes), pQueryContext->cAddonCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for addon code match.");
-
-            *pRelationType = BUNDLE_RELATION_DEPENDENT_ADDON;
-            ExitFunction();
-        }
-
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DEPENDENT_ADDON);
+    }
+    else if (BUNDLE_QUERY_CODE_LIST_PATCH & dwLists)
+    {
         // Dependent relationship: when their detect codes match our patch codes.
-        hr = DictCompareStringListToArray(sdDetectCodes, const_cast<LPCWSTR*>(pQueryContext->rgwzPatchCodes), pQueryContext->cPatchCodes);
-        if (HRESULT_FROM_WIN32(ERROR_NO_MATCH) == hr)
-        {
-            hr = S_OK;
-        }
-        else
-        {
-            ButilExitOnFailure(hr, "Failed to do array search for patch code match.");
-
-            *pRelationType = BUNDLE_RELATION_DEPENDENT_PATCH;
-            ExitFunction();
-        }
-
-        ReleaseNullDict(sdDetectCodes);
-        ReleaseNullStrArray(rgsczDetectCodes, cDetectCodes);
+        ExitFunction1(*pRelationType = BUNDLE_RELATION_DEPENDENT_PATCH);
     }
 
 LExit:
@@ -717,15 +1079,6 @@ LExit:
         hr = E_NOTFOUND;
     }
 
-    ReleaseDict(sdUpgradeCodes);
-    ReleaseStrArray(rgsczUpgradeCodes, cUpgradeCodes);
-    ReleaseDict(sdAddonCodes);
-    ReleaseStrArray(rgsczAddonCodes, cAddonCodes);
-    ReleaseDict(sdDetectCodes);
-    ReleaseStrArray(rgsczDetectCodes, cDetectCodes);
-    ReleaseDict(sdPatchCodes);
-    ReleaseStrArray(rgsczPatchCodes, cPatchCodes);
-
     return hr;
 }
 
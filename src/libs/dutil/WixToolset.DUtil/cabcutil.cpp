@@ -1,6 +1,7 @@
 // Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
 
 #include "precomp.h"
+#include "cabformat.h"
 
 
 // Exit macros
@@ -20,6 +21,10 @@
 
 static const WCHAR CABC_MAGIC_UNICODE_STRING_MARKER = '?';
 static const DWORD MAX_CABINET_HEADER_SIZE = 16 * 1024 * 1024;
+static const DWORD CABC_HASH_CACHE_VERSION = 1;
+
+// Size of each of the two buffers a file stream reads ahead into or writes behind from.
+static const DWORD CABC_STREAM_BUFFER_SIZE = 512 * 1024;
 
 // The minimum number of uncompressed bytes between FciFlushFolder() calls - if we call FciFlushFolder()
 // too often (because of duplicates too close together) we theoretically ruin our compression ratio -
@@ -29,37 +34,11 @@ static const DWORD MAX_CABINET_HEADER_SIZE = 16 * 1024 * 1024;
 static const DWORD MINFLUSHTHRESHHOLD = 0;
 
 // structs
-struct MS_CABINET_HEADER
-{
-    DWORD sig;
-    DWORD csumHeader;
-    DWORD cbCabinet;
-    DWORD csumFolders;
-    DWORD coffFiles;
-    DWORD csumFiles;
-    WORD version;
-    WORD cFolders;
-    WORD cFiles;
-    WORD flags;
-    WORD setID;
-    WORD iCabinet;
-};
-
-
-struct MS_CABINET_ITEM
-{
-    DWORD cbFile;
-    DWORD uoffFolderStart;
-    WORD iFolder;
-    WORD date;
-    WORD time;
-    WORD attribs;
-};
-
 struct CABC_INTERNAL_ADDFILEINFO
 {
     LPCWSTR wzSourcePath;
     LPCWSTR wzEmptyPath;
+    LPCWSTR wzNextSourcePath;
 };
 
 struct CABC_DUPLICATEFILE
@@ -82,6 +61,65 @@ struct CABC_FILE
 };
 
 
+struct CABC_PENDINGFILE
+{
+    LPWSTR pwzSourcePath;
+    LPWSTR pwzToken;
+    LONGLONG llFileSize;
+    DWORD64 qwLastWriteTime;
+    MSIFILEHASHINFO mfHash; // dwFileHashInfoSize is zero until the file is hashed.
+    BOOL fHashCandidate;
+};
+
+
+struct CABC_HASHCACHE_ENTRY
+{
+    LPWSTR pwzSourcePath;
+    LONGLONG llFileSize;
+    DWORD64 qwLastWriteTime;
+    DWORD rgdwHash[4];
+};
+
+
+struct CABC_HASHCACHE
+{
+    STRINGDICT_HANDLE shDictHandle;
+    DWORD cEntries;
+    CABC_HASHCACHE_ENTRY* rgEntries;
+    BOOL fDirty;
+};
+
+
+struct CABC_STREAM_BUFFER
+{
+    BYTE* pb;
+    DWORD cbData;
+    LONGLONG llOffset;
+    OVERLAPPED overlapped;
+    BOOL fPending;
+};
+
+
+// Every file FCI opens is a stream over an overlapped handle. A read-only stream keeps both
+// buffers reading ahead of FCI, a writable stream fills one buffer while the other is written.
+// A synchronous stream has no buffers and reads and writes the handle directly.
+struct CABC_STREAM
+{
+    HANDLE hFile;
+    BOOL fWritable;
+    BOOL fSynchronous;
+    LONGLONG llPosition;
+    LONGLONG llSize;
+    LONGLONG llNextRead;
+    LONGLONG llWaitTicks;
+
+    DWORD cbBuffer;
+    DWORD iBuffer;
+    DWORD cbConsumed;
+    CABC_STREAM_BUFFER rgBuffers[2];
+};
+
+
 struct CABC_DATA
 {
     LONGLONG llBytesSinceLastFlush;
@@ -102,6 +140,23 @@ struct CABC_DATA
     DWORD cMaxDuplicates;
     CABC_DUPLICATEFILE *prgDuplicates;
 
+    // Smart cabbing defers duplicate detection to CabCFinish so files that may be duplicates
+    // can be hashed together.
+    DWORD cPendingFiles;
+    CABC_PENDINGFILE *prgPendingFiles;
+    LPWSTR sczHashCachePath;
+
+    // The next file to be added is opened and read ahead while FCI compresses the current one.
+    LPCWSTR wzNextSourcePath;
+    CABC_STREAM* pNextSourceStream;
+
+    // Streaming can be turned off to measure it against plain synchronous I/O.
+    BOOL fSynchronousIo;
+
+    CABC_STATISTICS* pStatistics;
+    DWORD64 qwSourceBytes;
+    LONGLONG llStreamWaitTicks;
+
     HRESULT hrLastError;
     BOOL fGoodCab;
 
@@ -124,6 +179,42 @@ const int CABC_HANDLE_BYTES = sizeof(CABC_DATA);
 static void FreeCabCData(
     __in CABC_DATA* pcd
     );
+static HRESULT AddPendingFile(
+    __in CABC_DATA *pcd,
+    __in_z LPCWSTR wzFile,
+    __in_z_opt LPCWSTR wzToken,
+    __in_opt const MSIFILEHASHINFO* pmfHash
+    );
+static HRESULT ResolvePendingFiles(
+    __in CABC_DATA *pcd
+    );
+static HRESULT HashDuplicateCandidates(
+    __in CABC_DATA *pcd
+    );
+static HRESULT CALLBACK HashPendingFile(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static int __cdecl ComparePendingFileSize(
+    __in void* pvContext,
+    __in const void* pvLeft,
+    __in const void* pvRight
+    );
+static HRESULT LoadHashCache(
+    __in_z LPCWSTR wzPath,
+    __in CABC_HASHCACHE* pCache
+    );
+static HRESULT SaveHashCache(
+    __in_z LPCWSTR wzPath,
+    __in const CABC_HASHCACHE* pCache
+    );
+static HRESULT UpdateHashCache(
+    __in CABC_HASHCACHE* pCache,
+    __in const CABC_PENDINGFILE* pFile
+    );
+static void ReleaseHashCache(
+    __in CABC_HASHCACHE* pCache
+    );
 static HRESULT CheckForDuplicateFile(
     __in CABC_DATA *pcd,
     __out CABC_FILE **ppcf,
@@ -159,6 +250,54 @@ static HRESULT UtcFileTimeToLocalDosDateTime(
     __out USHORT* pDate,
     __out USHORT* pTime
     );
+static HRESULT CreateStream(
+    __in HANDLE hFile,
+    __in BOOL fWritable,
+    __in BOOL fSynchronous,
+    __out CABC_STREAM** ppStream
+    );
+static void OpenNextSourceStream(
+    __in CABC_DATA* pcd,
+    __in_z LPCWSTR wzPath
+    );
+static HRESULT ReadStream(
+    __in CABC_STREAM* pStream,
+    __out_bcount_part(cb, *pcbRead) BYTE* pb,
+    __in DWORD cb,
+    __out DWORD* pcbRead
+    );
+static HRESULT WriteStream(
+    __in CABC_STREAM* pStream,
+    __in_bcount(cb) const BYTE* pb,
+    __in DWORD cb
+    );
+static HRESULT SeekStream(
+    __in CABC_STREAM* pStream,
+    __in LONGLONG llDistance,
+    __in DWORD dwMoveMethod,
+    __out LONGLONG* pllPosition
+    );
+static HRESULT FlushStream(
+    __in CABC_STREAM* pStream
+    );
+static HRESULT CloseStream(
+    __in CABC_STREAM* pStream
+    );
+static void CancelStreamReads(
+    __in CABC_STREAM* pStream
+    );
+static HRESULT IssueStreamRead(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
+    );
+static HRESULT IssueStreamWrite(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
+    );
+static HRESULT WaitForStreamBuffer(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
+    );
 
 static __callback int DIAMONDAPI CabCFilePlaced(__in PCCAB pccab, __in_z PSTR szFile, __in long cbFile, __in BOOL fContinuation, __inout_bcount(CABC_HANDLE_BYTES) void *pv);
 static __callback void * DIAMONDAPI CabCAlloc(__in ULONG cb);
@@ -374,50 +513,98 @@ extern "C" HRESULT DAPI CabCAddFile(
 
     HRESULT hr = S_OK;
     CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(hContext);
-    CABC_FILE *pcfDuplicate = NULL;
-    LONGLONG llFileSize = 0;
-    PMSIFILEHASHINFO pmfLocalHash = pmfHash;
 
     // Use Smart Cabbing if there are duplicates and if Cabinet Splitting is not desired
     // For Cabinet Spliting avoid hashing as Smart Cabbing is disabled
-    if(!pcd->fCabinetSplittingEnabled)
-    {
-        // Store file size, primarily used to determine which files to hash for duplicates
-        hr = FileSize(wzFile, &llFileSize);
-        CabcExitOnFailure(hr, "Failed to check size of file %ls", wzFile);
-
-        hr = CheckForDuplicateFile(pcd, &pcfDuplicate, wzFile, &pmfLocalHash, llFileSize);
-        CabcExitOnFailure(hr, "Failed while checking for duplicate of file: %ls", wzFile);
-    }
-
-    if (pcfDuplicate) // This will be null for smart cabbing case
+    if (!pcd->fCabinetSplittingEnabled)
     {
-        DWORD index;
-        hr = ::PtrdiffTToDWord(pcfDuplicate - pcd->prgFiles, &index);
-        CabcExitOnFailure(hr, "Failed to calculate index of file name: %ls", pcfDuplicate->pwzSourcePath);
-
-        hr = AddDuplicateFile(pcd, index, wzFile, wzToken, pcd->dwLastFileIndex);
-        CabcExitOnFailure(hr, "Failed to add duplicate of file name: %ls", pcfDuplicate->pwzSourcePath);
+        // Duplicates are found in CabCFinish once all the files that might need hashing are known.
+        hr = AddPendingFile(pcd, wzFile, wzToken, pmfHash);
+        CabcExitOnFailure(hr, "Failed to add file for duplicate checking: %ls", wzFile);
     }
     else
     {
-        hr = AddNonDuplicateFile(pcd, wzFile, wzToken, pmfLocalHash, llFileSize, pcd->dwLastFileIndex);
+        hr = AddNonDuplicateFile(pcd, wzFile, wzToken, pmfHash, 0, pcd->dwLastFileIndex);
         CabcExitOnFailure(hr, "Failed to add non-duplicated file: %ls", wzFile);
     }
 
     ++pcd->dwLastFileIndex;
 
 LExit:
-    // If we allocated a hash struct ourselves, free it
-    if (pmfHash != pmfLocalHash)
+    return hr;
+}
+
+
+/********************************************************************
+CabCSetHashCachePath - sets a file used to remember the hashes of files
+checked for duplicates, so a later cabinet does not hash them again
+unless their size or last write time changed.
+
+NOTE: hContext must be the same used in Begin and AddFile
+********************************************************************/
+extern "C" HRESULT DAPI CabCSetHashCachePath(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in_z_opt LPCWSTR wzCachePath
+    )
+{
+    Assert(hContext);
+
+    HRESULT hr = S_OK;
+    CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(hContext);
+
+    if (wzCachePath && *wzCachePath)
     {
-        ReleaseMem(pmfLocalHash);
+        hr = StrAllocString(&pcd->sczHashCachePath, wzCachePath, 0);
+        CabcExitOnFailure(hr, "Failed to copy hash cache path: %ls", wzCachePath);
+    }
+    else
+    {
+        ReleaseNullStr(pcd->sczHashCachePath);
     }
 
+LExit:
     return hr;
 }
 
 
+/********************************************************************
+CabCSetSynchronousIo - reads and writes files synchronously on the
+                       compressing thread instead of reading ahead
+                       and writing behind
+
+NOTE: Not declared in cabcutil.h. Only the unit tests use it, to check
+      that the file streams produce the same cabinet as plain I/O.
+*********************************************************************/
+extern "C" void DAPI CabCSetSynchronousIo(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in BOOL fSynchronousIo
+    )
+{
+    Assert(hContext);
+
+    CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(hContext);
+    pcd->fSynchronousIo = fSynchronousIo;
+}
+
+
+/********************************************************************
+CabCCollectStatistics - asks CabCFinish to fill in statistics about
+                        building the cabinet
+
+NOTE: pStatistics must remain valid until CabCFinish returns.
+*********************************************************************/
+extern "C" void DAPI CabCCollectStatistics(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in_opt CABC_STATISTICS* pStatistics
+    )
+{
+    Assert(hContext);
+
+    CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(hContext);
+    pcd->pStatistics = pStatistics;
+}
+
+
 /********************************************************************
 CabcFinish - finishes making a cabinet
 
@@ -458,6 +645,12 @@ extern "C" HRESULT DAPI CabCFinish(
     BOOL fFlushBefore = FALSE;
     BOOL fFlushAfter = FALSE;
 
+    if (pcd->cPendingFiles)
+    {
+        hr = ResolvePendingFiles(pcd);
+        CabcExitOnFailure(hr, "Failed to check for duplicate files in cabinet: %ls", pcd->sczCabinetPath);
+    }
+
     ReleaseDict(pcd->shDictHandle);
 
     // We need to go through all the files, duplicates and non-duplicates, sequentially in the order they were added
@@ -538,6 +731,9 @@ extern "C" HRESULT DAPI CabCFinish(
             CabcExitOnRootFailure(hr, "Internal inconsistency in data structures while creating CAB file - a non-standard, non-duplicate file was encountered");
         }
 
+        // The next non-duplicate file is the next one with data to read ahead.
+        fileInfo.wzNextSourcePath = dwArrayFileIndex < pcd->cFilePaths ? pcd->prgFiles[dwArrayFileIndex].pwzSourcePath : NULL;
+
         if (fFlushBefore && pcd->llBytesSinceLastFlush > pcd->llFlushThreshhold)
         {
             if (!::FCIFlushFolder(pcd->hfci, CabCGetNextCabinet, CabCStatus))
@@ -624,6 +820,17 @@ extern "C" HRESULT DAPI CabCFinish(
 
 LExit:
     ::FCIDestroy(pcd->hfci);
+
+    if (pcd->pStatistics)
+    {
+        LARGE_INTEGER liFrequency = { };
+
+        ::QueryPerformanceFrequency(&liFrequency);
+
+        pcd->pStatistics->qwSourceBytes = pcd->qwSourceBytes;
+        pcd->pStatistics->dwStreamWaitMilliseconds = liFrequency.QuadPart ? static_cast<DWORD>(pcd->llStreamWaitTicks * 1000 / liFrequency.QuadPart) : 0;
+    }
+
     FreeCabCData(pcd);
     ReleaseNullStr(pszFileToken);
 
@@ -660,6 +867,11 @@ static void FreeCabCData(
     {
         ReleaseFileHandle(pcd->hEmptyFile);
 
+        if (pcd->pNextSourceStream)
+        {
+            CloseStream(pcd->pNextSourceStream);
+        }
+
         for (DWORD i = 0; i < pcd->cFilePaths; ++i)
         {
             ReleaseStr(pcd->prgFiles[i].pwzSourcePath);
@@ -668,6 +880,15 @@ static void FreeCabCData(
         ReleaseMem(pcd->prgFiles);
         ReleaseMem(pcd->prgDuplicates);
 
+        for (DWORD i = 0; i < pcd->cPendingFiles; ++i)
+        {
+            ReleaseStr(pcd->prgPendingFiles[i].pwzSourcePath);
+            ReleaseStr(pcd->prgPendingFiles[i].pwzToken);
+        }
+        ReleaseMem(pcd->prgPendingFiles);
+
+        ReleaseStr(pcd->sczHashCachePath);
+
         ReleaseStr(pcd->sczCabinetPath);
         ReleaseStr(pcd->sczEmptyFile);
 
@@ -680,358 +901,1388 @@ static void FreeCabCData(
 
 ********************************************************************/
 
-static HRESULT CheckForDuplicateFile(
+static HRESULT AddPendingFile(
     __in CABC_DATA *pcd,
-    __out CABC_FILE **ppcf,
-    __in LPCWSTR wzFileName,
-    __in PMSIFILEHASHINFO *ppmfHash,
-    __in LONGLONG llFileSize
+    __in_z LPCWSTR wzFile,
+    __in_z_opt LPCWSTR wzToken,
+    __in_opt const MSIFILEHASHINFO* pmfHash
     )
 {
-    DWORD i = 0;
     HRESULT hr = S_OK;
-    UINT er = ERROR_SUCCESS;
-
-    CabcExitOnNull(ppcf, hr, E_INVALIDARG, "No file structure sent while checking for duplicate file");
-    CabcExitOnNull(ppmfHash, hr, E_INVALIDARG, "No file hash structure pointer sent while checking for duplicate file");
-
-    *ppcf = NULL; // By default, we'll set our output to NULL
+    WIN32_FILE_ATTRIBUTE_DATA fad = { };
+    CABC_PENDINGFILE* pFile = NULL;
 
-    hr = DictGetValue(pcd->shDictHandle, wzFileName, reinterpret_cast<void **>(ppcf));
-    // If we found it in the hash of previously added source paths, return our match immediately
-    if (SUCCEEDED(hr))
-    {
-        ExitFunction1(hr = S_OK);
-    }
-    else if (E_NOTFOUND == hr)
+    // Store file size, primarily used to determine which files to hash for duplicates, and
+    // the last write time to know whether a cached hash still applies.
+    if (!::GetFileAttributesExW(wzFile, GetFileExInfoStandard, &fad))
     {
-        hr = S_OK;
+        CabcExitWithLastError(hr, "Failed to check size of file %ls", wzFile);
     }
-    CabcExitOnFailure(hr, "Failed while searching for file in dictionary of previously added files");
 
-    for (i = 0; i < pcd->cFilePaths; ++i)
-    {
-        // If two files have the same size, use hashing to check if they're a match
-        if (llFileSize == pcd->prgFiles[i].llFileSize)
-        {
-            // If pcd->prgFiles[i], our potential match, hasn't been hashed yet, hash it
-            if (pcd->prgFiles[i].pmfHash == NULL)
-            {
-                pcd->prgFiles[i].pmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
-                CabcExitOnNull(pcd->prgFiles[i].pmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for candidate duplicate file's MSI file hash");
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pcd->prgPendingFiles), pcd->cPendingFiles, 1, sizeof(CABC_PENDINGFILE), 100);
+    CabcExitOnFailure(hr, "Failed to allocate memory for file.");
 
-                pcd->prgFiles[i].pmfHash->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
-                er = ::MsiGetFileHashW(pcd->prgFiles[i].pwzSourcePath, 0, pcd->prgFiles[i].pmfHash);
-                CabcExitOnWin32Error(er, hr, "Failed while getting MSI file hash of candidate duplicate file: %ls", pcd->prgFiles[i].pwzSourcePath);
-            }
+    pFile = pcd->prgPendingFiles + pcd->cPendingFiles;
+    ++pcd->cPendingFiles;
 
-            // If our own file hasn't yet been hashed, hash it
-            if (NULL == *ppmfHash)
-            {
-                *ppmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
-                CabcExitOnNull(*ppmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for file's MSI file hash");
+    pFile->llFileSize = (static_cast<LONGLONG>(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+    pFile->qwLastWriteTime = (static_cast<DWORD64>(fad.ftLastWriteTime.dwHighDateTime) << 32) | fad.ftLastWriteTime.dwLowDateTime;
 
-                (*ppmfHash)->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
-                er = ::MsiGetFileHashW(wzFileName, 0, *ppmfHash);
-                CabcExitOnWin32Error(er, hr, "Failed while getting MSI file hash of file: %ls", pcd->prgFiles[i].pwzSourcePath);
-            }
+    if (pmfHash && sizeof(MSIFILEHASHINFO) == pmfHash->dwFileHashInfoSize)
+    {
+        pFile->mfHash = *pmfHash;
+    }
 
-            // If the two file hashes are both of the expected size, and they match, we've got a match, so return it!
-            if (pcd->prgFiles[i].pmfHash->dwFileHashInfoSize == (*ppmfHash)->dwFileHashInfoSize &&
-                sizeof(MSIFILEHASHINFO) == (*ppmfHash)->dwFileHashInfoSize &&
-                pcd->prgFiles[i].pmfHash->dwData[0] == (*ppmfHash)->dwData[0] &&
-                pcd->prgFiles[i].pmfHash->dwData[1] == (*ppmfHash)->dwData[1] &&
-                pcd->prgFiles[i].pmfHash->dwData[2] == (*ppmfHash)->dwData[2] && 
-                pcd->prgFiles[i].pmfHash->dwData[3] == (*ppmfHash)->dwData[3])
-             {
-                 *ppcf = pcd->prgFiles + i;
-                 ExitFunction1(hr = S_OK);
-             }
-        }
+    hr = StrAllocString(&pFile->pwzSourcePath, wzFile, 0);
+    CabcExitOnFailure(hr, "Failed to copy file path: %ls", wzFile);
+
+    if (wzToken)
+    {
+        hr = StrAllocString(&pFile->pwzToken, wzToken, 0);
+        CabcExitOnFailure(hr, "Failed to copy file token: %ls", wzToken);
     }
 
 LExit:
-
     return hr;
 }
 
 
-static HRESULT AddDuplicateFile(
-    __in CABC_DATA *pcd,
-    __in DWORD dwFileArrayIndex,
-    __in_z LPCWSTR wzSourcePath,
-    __in_opt LPCWSTR wzToken,
-    __in DWORD dwDuplicateCabFileIndex
+// Sorts the files added to the cabinet into duplicates and non-duplicates in the order they
+// were added, exactly as if each had been checked when it was added.
+static HRESULT ResolvePendingFiles(
+    __in CABC_DATA *pcd
     )
 {
     HRESULT hr = S_OK;
-    LPVOID pv = NULL;
+    CABC_FILE *pcfDuplicate = NULL;
+    PMSIFILEHASHINFO pmfHash = NULL;
+    PMSIFILEHASHINFO pmfLocalHash = NULL;
 
-    // Ensure there is enough memory to store this duplicate file index.
-    if (pcd->cDuplicates == pcd->cMaxDuplicates)
+    hr = HashDuplicateCandidates(pcd);
+    CabcExitOnFailure(hr, "Failed to hash candidate duplicate files.");
+
+    for (DWORD i = 0; i < pcd->cPendingFiles; ++i)
     {
-        pcd->cMaxDuplicates += 20; // grow by a reasonable number (20 is reasonable, right?)
-        size_t cbDuplicates = 0;
+        CABC_PENDINGFILE* pFile = pcd->prgPendingFiles + i;
 
-        hr = ::SizeTMult(pcd->cMaxDuplicates, sizeof(CABC_DUPLICATEFILE), &cbDuplicates);
-        CabcExitOnFailure(hr, "Maximum allocation exceeded.");
+        pmfHash = pFile->mfHash.dwFileHashInfoSize ? &pFile->mfHash : NULL;
+        pmfLocalHash = pmfHash;
 
-        if (pcd->cDuplicates)
+        hr = CheckForDuplicateFile(pcd, &pcfDuplicate, pFile->pwzSourcePath, &pmfLocalHash, pFile->llFileSize);
+        CabcExitOnFailure(hr, "Failed while checking for duplicate of file: %ls", pFile->pwzSourcePath);
+
+        if (pcfDuplicate)
         {
-            pv = MemReAlloc(pcd->prgDuplicates, cbDuplicates, FALSE);
-            CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to reallocate memory for duplicate file.");
+            DWORD index;
+            hr = ::PtrdiffTToDWord(pcfDuplicate - pcd->prgFiles, &index);
+            CabcExitOnFailure(hr, "Failed to calculate index of file name: %ls", pcfDuplicate->pwzSourcePath);
+
+            hr = AddDuplicateFile(pcd, index, pFile->pwzSourcePath, pFile->pwzToken, i);
+            CabcExitOnFailure(hr, "Failed to add duplicate of file name: %ls", pcfDuplicate->pwzSourcePath);
         }
         else
         {
-            pv = MemAlloc(cbDuplicates, FALSE);
-            CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to allocate memory for duplicate file.");
+            hr = AddNonDuplicateFile(pcd, pFile->pwzSourcePath, pFile->pwzToken, pmfLocalHash, pFile->llFileSize, i);
+            CabcExitOnFailure(hr, "Failed to add non-duplicated file: %ls", pFile->pwzSourcePath);
         }
 
-        ZeroMemory(reinterpret_cast<BYTE*>(pv) + (pcd->cDuplicates * sizeof(CABC_DUPLICATEFILE)), (pcd->cMaxDuplicates - pcd->cDuplicates) * sizeof(CABC_DUPLICATEFILE));
-
-        pcd->prgDuplicates = static_cast<CABC_DUPLICATEFILE*>(pv);
-        pv = NULL;
+        // If we allocated a hash struct ourselves, free it
+        if (pmfHash != pmfLocalHash)
+        {
+            ReleaseNullMem(pmfLocalHash);
+        }
     }
 
-    // Store the duplicate file index.
-    pcd->prgDuplicates[pcd->cDuplicates].dwFileArrayIndex = dwFileArrayIndex;
-    pcd->prgDuplicates[pcd->cDuplicates].dwDuplicateCabFileIndex = dwDuplicateCabFileIndex;
-    pcd->prgFiles[dwFileArrayIndex].fHasDuplicates = TRUE; // Mark original file as having duplicates
-
-    hr = StrAllocString(&pcd->prgDuplicates[pcd->cDuplicates].pwzSourcePath, wzSourcePath, 0);
-    CabcExitOnFailure(hr, "Failed to copy duplicate file path: %ls", wzSourcePath);
-
-    if (wzToken && *wzToken)
+LExit:
+    if (pmfHash != pmfLocalHash)
     {
-        hr = StrAllocString(&pcd->prgDuplicates[pcd->cDuplicates].pwzToken, wzToken, 0);
-        CabcExitOnFailure(hr, "Failed to copy duplicate file token: %ls", wzToken);
+        ReleaseMem(pmfLocalHash);
     }
 
-    ++pcd->cDuplicates;
-
-LExit:
-    ReleaseMem(pv);
     return hr;
 }
 
 
-static HRESULT AddNonDuplicateFile(
-    __in CABC_DATA *pcd,
-    __in LPCWSTR wzFile,
-    __in_opt LPCWSTR wzToken,
-    __in_opt const MSIFILEHASHINFO* pmfHash,
-    __in LONGLONG llFileSize,
-    __in DWORD dwCabFileIndex
+static HRESULT HashDuplicateCandidates(
+    __in CABC_DATA *pcd
     )
 {
     HRESULT hr = S_OK;
-    LPVOID pv = NULL;
+    DWORD* rgdwBySize = NULL;
+    CABC_HASHCACHE cache = { };
+    BOOL fCache = FALSE;
+    THRD_POOL_HANDLE hPool = NULL;
+    THRD_GROUP_HANDLE hGroup = NULL;
 
-    // Ensure there is enough memory to store this file index.
-    if (pcd->cFilePaths == pcd->cMaxFilePaths)
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&rgdwBySize), sizeof(DWORD), pcd->cPendingFiles);
+    CabcExitOnFailure(hr, "Failed to allocate memory to sort files by size.");
+
+    for (DWORD i = 0; i < pcd->cPendingFiles; ++i)
     {
-        pcd->cMaxFilePaths += 100; // grow by a reasonable number (100 is reasonable, right?)
+        rgdwBySize[i] = i;
+    }
+
+    qsort_s(rgdwBySize, pcd->cPendingFiles, sizeof(DWORD), ComparePendingFileSize, pcd->prgPendingFiles);
+
+    // Only files that share their size with another file can be duplicates, so only those
+    // that were not already given a hash need to be hashed.
+    for (DWORD i = 0; i < pcd->cPendingFiles;)
+    {
+        LONGLONG llFileSize = pcd->prgPendingFiles[rgdwBySize[i]].llFileSize;
+        DWORD iEnd = i + 1;
+
+        while (iEnd < pcd->cPendingFiles && llFileSize == pcd->prgPendingFiles[rgdwBySize[iEnd]].llFileSize)
+        {
+            ++iEnd;
+        }
+
+        for (DWORD j = i; 1 < iEnd - i && j < iEnd; ++j)
+        {
+            CABC_PENDINGFILE* pFile = pcd->prgPendingFiles + rgdwBySize[j];
+
+            pFile->fHashCandidate = !pFile->mfHash.dwFileHashInfoSize;
+        }
+
+        i = iEnd;
+    }
+
+    if (pcd->sczHashCachePath)
+    {
+        hr = LoadHashCache(pcd->sczHashCachePath, &cache);
+        if (FAILED(hr))
+        {
+            TraceError(hr, "Failed to load file hash cache: %ls", pcd->sczHashCachePath);
+            ReleaseHashCache(&cache);
+        }
+        else
+        {
+            fCache = TRUE;
+        }
+    }
+
+    for (DWORD i = 0; i < pcd->cPendingFiles; ++i)
+    {
+        CABC_PENDINGFILE* pFile = pcd->prgPendingFiles + i;
+
+        if (!pFile->fHashCandidate)
+        {
+            continue;
+        }
+
+        if (fCache)
+        {
+            CABC_HASHCACHE_ENTRY* pEntry = NULL;
+
+            hr = DictGetValue(cache.shDictHandle, pFile->pwzSourcePath, reinterpret_cast<void**>(&pEntry));
+            if (SUCCEEDED(hr) && pEntry->llFileSize == pFile->llFileSize && pEntry->qwLastWriteTime == pFile->qwLastWriteTime)
+            {
+                pFile->mfHash.dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
+                memcpy(pFile->mfHash.dwData, pEntry->rgdwHash, sizeof(pEntry->rgdwHash));
+                continue;
+            }
+            else if (SUCCEEDED(hr) || E_NOTFOUND == hr)
+            {
+                hr = S_OK;
+            }
+            CabcExitOnFailure(hr, "Failed to look up file in hash cache: %ls", pFile->pwzSourcePath);
+        }
+
+        if (!hGroup)
+        {
+            // Prefer the shared pool so cabinets created at the same time share its threads.
+            hr = ThrdGroupCreate(NULL, &hGroup);
+            if (HRESULT_FROM_WIN32(ERROR_INVALID_STATE) == hr)
+            {
+                hr = ThrdPoolCreate(0, &hPool);
+                CabcExitOnFailure(hr, "Failed to create thread pool to hash files.");
+
+                hr = ThrdGroupCreate(hPool, &hGroup);
+            }
+            CabcExitOnFailure(hr, "Failed to create thread group to hash files.");
+        }
+
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, HashPendingFile, pFile);
+        CabcExitOnFailure(hr, "Failed to queue hash of candidate duplicate file: %ls", pFile->pwzSourcePath);
+    }
+
+    if (hGroup)
+    {
+        hr = ThrdGroupWait(hGroup, INFINITE);
+        CabcExitOnFailure(hr, "Failed to hash candidate duplicate files.");
+    }
+
+    if (fCache)
+    {
+        for (DWORD i = 0; i < pcd->cPendingFiles; ++i)
+        {
+            if (pcd->prgPendingFiles[i].fHashCandidate)
+            {
+                hr = UpdateHashCache(&cache, pcd->prgPendingFiles + i);
+                CabcExitOnFailure(hr, "Failed to update hash cache with file: %ls", pcd->prgPendingFiles[i].pwzSourcePath);
+            }
+        }
+
+        if (cache.fDirty)
+        {
+            // The cache only saves work for the next cabinet so failing to write it is not an error.
+            hr = SaveHashCache(pcd->sczHashCachePath, &cache);
+            if (FAILED(hr))
+            {
+                TraceError(hr, "Failed to save file hash cache: %ls", pcd->sczHashCachePath);
+                hr = S_OK;
+            }
+        }
+    }
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+    ReleaseThreadPool(hPool);
+    ReleaseHashCache(&cache);
+    ReleaseMem(rgdwBySize);
+
+    return hr;
+}
+
+
+static HRESULT CALLBACK HashPendingFile(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    UNREFERENCED_PARAMETER(hGroup);
+
+    HRESULT hr = S_OK;
+    UINT er = ERROR_SUCCESS;
+    CABC_PENDINGFILE* pFile = static_cast<CABC_PENDINGFILE*>(pvContext);
+
+    pFile->mfHash.dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
+
+    er = ::MsiGetFileHashW(pFile->pwzSourcePath, 0, &pFile->mfHash);
+    CabcExitOnWin32Error(er, hr, "Failed while getting MSI file hash of candidate duplicate file: %ls", pFile->pwzSourcePath);
+
+LExit:
+    return hr;
+}
+
+
+static int __cdecl ComparePendingFileSize(
+    __in void* pvContext,
+    __in const void* pvLeft,
+    __in const void* pvRight
+    )
+{
+    const CABC_PENDINGFILE* rgFiles = static_cast<const CABC_PENDINGFILE*>(pvContext);
+    LONGLONG llLeft = rgFiles[*static_cast<const DWORD*>(pvLeft)].llFileSize;
+    LONGLONG llRight = rgFiles[*static_cast<const DWORD*>(pvRight)].llFileSize;
+
+    return llLeft < llRight ? -1 : llLeft > llRight ? 1 : 0;
+}
+
+
+// A cache that is missing or cannot be read only costs rehashing its files, so any entries
+// read before a problem are kept and the cache is rewritten.
+static HRESULT LoadHashCache(
+    __in_z LPCWSTR wzPath,
+    __in CABC_HASHCACHE* pCache
+    )
+{
+    HRESULT hr = S_OK;
+    BYTE* pbData = NULL;
+    SIZE_T cbData = 0;
+    SIZE_T iData = 0;
+    DWORD dwVersion = 0;
+    DWORD cEntries = 0;
+    LPWSTR sczSourcePath = NULL;
+    CABC_HASHCACHE_ENTRY* pEntry = NULL;
+
+    hr = DictCreateWithEmbeddedKey(&pCache->shDictHandle, 0, reinterpret_cast<void**>(&pCache->rgEntries), offsetof(CABC_HASHCACHE_ENTRY, pwzSourcePath), DICT_FLAG_CASEINSENSITIVE);
+    CabcExitOnFailure(hr, "Failed to create dictionary for file hash cache.");
+
+    hr = FileRead(&pbData, &cbData, wzPath);
+    if (E_FILENOTFOUND == hr || E_PATHNOTFOUND == hr)
+    {
+        ExitFunction1(hr = S_OK);
+    }
+    CabcExitOnFailure(hr, "Failed to read file hash cache: %ls", wzPath);
+
+    hr = BuffReadNumber(pbData, cbData, &iData, &dwVersion);
+    CabcExitOnFailure(hr, "Failed to read file hash cache version.");
+
+    if (CABC_HASH_CACHE_VERSION != dwVersion)
+    {
+        pCache->fDirty = TRUE;
+        ExitFunction();
+    }
+
+    hr = BuffReadNumber(pbData, cbData, &iData, &cEntries);
+    CabcExitOnFailure(hr, "Failed to read file hash cache count.");
+
+    for (DWORD i = 0; i < cEntries; ++i)
+    {
+        DWORD64 qwFileSize = 0;
+        DWORD64 qwLastWriteTime = 0;
+        DWORD rgdwHash[4] = { };
+
+        hr = BuffReadString(pbData, cbData, &iData, &sczSourcePath);
+        CabcExitOnFailure(hr, "Failed to read file hash cache path.");
+
+        hr = BuffReadNumber64(pbData, cbData, &iData, &qwFileSize);
+        CabcExitOnFailure(hr, "Failed to read file hash cache size.");
+
+        hr = BuffReadNumber64(pbData, cbData, &iData, &qwLastWriteTime);
+        CabcExitOnFailure(hr, "Failed to read file hash cache time.");
+
+        for (DWORD j = 0; j < countof(rgdwHash); ++j)
+        {
+            hr = BuffReadNumber(pbData, cbData, &iData, rgdwHash + j);
+            CabcExitOnFailure(hr, "Failed to read file hash cache hash.");
+        }
+
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pCache->rgEntries), pCache->cEntries, 1, sizeof(CABC_HASHCACHE_ENTRY), cEntries);
+        CabcExitOnFailure(hr, "Failed to allocate memory for file hash cache.");
+
+        pEntry = pCache->rgEntries + pCache->cEntries;
+        pEntry->pwzSourcePath = sczSourcePath;
+        sczSourcePath = NULL;
+        pEntry->llFileSize = static_cast<LONGLONG>(qwFileSize);
+        pEntry->qwLastWriteTime = qwLastWriteTime;
+        memcpy(pEntry->rgdwHash, rgdwHash, sizeof(rgdwHash));
+        ++pCache->cEntries;
+
+        hr = DictAddValue(pCache->shDictHandle, pEntry);
+        CabcExitOnFailure(hr, "Failed to add file to hash cache dictionary: %ls", pEntry->pwzSourcePath);
+    }
+
+LExit:
+    if (FAILED(hr) && pCache->shDictHandle)
+    {
+        TraceError(hr, "Ignoring the rest of file hash cache: %ls", wzPath);
+        pCache->fDirty = TRUE;
+        hr = S_OK;
+    }
+
+    ReleaseStr(sczSourcePath);
+    ReleaseMem(pbData);
+
+    return hr;
+}
+
+
+static HRESULT SaveHashCache(
+    __in_z LPCWSTR wzPath,
+    __in const CABC_HASHCACHE* pCache
+    )
+{
+    HRESULT hr = S_OK;
+    BYTE* pbData = NULL;
+    SIZE_T cbData = 0;
+    LPWSTR sczTempPath = NULL;
+
+    hr = BuffWriteNumber(&pbData, &cbData, CABC_HASH_CACHE_VERSION);
+    CabcExitOnFailure(hr, "Failed to write file hash cache version.");
+
+    hr = BuffWriteNumber(&pbData, &cbData, pCache->cEntries);
+    CabcExitOnFailure(hr, "Failed to write file hash cache count.");
+
+    for (DWORD i = 0; i < pCache->cEntries; ++i)
+    {
+        const CABC_HASHCACHE_ENTRY* pEntry = pCache->rgEntries + i;
+
+        hr = BuffWriteString(&pbData, &cbData, pEntry->pwzSourcePath);
+        CabcExitOnFailure(hr, "Failed to write file hash cache path.");
+
+        hr = BuffWriteNumber64(&pbData, &cbData, static_cast<DWORD64>(pEntry->llFileSize));
+        CabcExitOnFailure(hr, "Failed to write file hash cache size.");
+
+        hr = BuffWriteNumber64(&pbData, &cbData, pEntry->qwLastWriteTime);
+        CabcExitOnFailure(hr, "Failed to write file hash cache time.");
+
+        for (DWORD j = 0; j < countof(pEntry->rgdwHash); ++j)
+        {
+            hr = BuffWriteNumber(&pbData, &cbData, pEntry->rgdwHash[j]);
+            CabcExitOnFailure(hr, "Failed to write file hash cache hash.");
+        }
+    }
+
+    // Write beside the cache and move it into place so a cache shared by concurrent builds
+    // is never read half written.
+    hr = StrAllocFormatted(&sczTempPath, L"%ls.%x.%x.tmp", wzPath, ::GetCurrentProcessId(), ::GetCurrentThreadId());
+    CabcExitOnFailure(hr, "Failed to allocate temporary file hash cache path.");
+
+    hr = FileWrite(sczTempPath, FILE_ATTRIBUTE_NORMAL, pbData, cbData, NULL);
+    CabcExitOnFailure(hr, "Failed to write file hash cache: %ls", sczTempPath);
+
+    hr = FileEnsureMove(sczTempPath, wzPath, TRUE, FALSE);
+    CabcExitOnFailure(hr, "Failed to move file hash cache into place: %ls", wzPath);
+
+LExit:
+    if (FAILED(hr) && sczTempPath)
+    {
+        FileEnsureDelete(sczTempPath);
+    }
+
+    ReleaseStr(sczTempPath);
+    ReleaseMem(pbData);
+
+    return hr;
+}
+
+
+static HRESULT UpdateHashCache(
+    __in CABC_HASHCACHE* pCache,
+    __in const CABC_PENDINGFILE* pFile
+    )
+{
+    HRESULT hr = S_OK;
+    CABC_HASHCACHE_ENTRY* pEntry = NULL;
+
+    hr = DictGetValue(pCache->shDictHandle, pFile->pwzSourcePath, reinterpret_cast<void**>(&pEntry));
+    if (E_NOTFOUND == hr)
+    {
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pCache->rgEntries), pCache->cEntries, 1, sizeof(CABC_HASHCACHE_ENTRY), 100);
+        CabcExitOnFailure(hr, "Failed to allocate memory for file hash cache.");
+
+        pEntry = pCache->rgEntries + pCache->cEntries;
+
+        hr = StrAllocString(&pEntry->pwzSourcePath, pFile->pwzSourcePath, 0);
+        CabcExitOnFailure(hr, "Failed to copy file path: %ls", pFile->pwzSourcePath);
+
+        ++pCache->cEntries;
+
+        hr = DictAddValue(pCache->shDictHandle, pEntry);
+        CabcExitOnFailure(hr, "Failed to add file to hash cache dictionary: %ls", pFile->pwzSourcePath);
+    }
+    CabcExitOnFailure(hr, "Failed to look up file in hash cache: %ls", pFile->pwzSourcePath);
+
+    if (pEntry->llFileSize != pFile->llFileSize || pEntry->qwLastWriteTime != pFile->qwLastWriteTime || 0 != memcmp(pEntry->rgdwHash, pFile->mfHash.dwData, sizeof(pEntry->rgdwHash)))
+    {
+        pEntry->llFileSize = pFile->llFileSize;
+        pEntry->qwLastWriteTime = pFile->qwLastWriteTime;
+        memcpy(pEntry->rgdwHash, pFile->mfHash.dwData, sizeof(pEntry->rgdwHash));
+        pCache->fDirty = TRUE;
+    }
+
+LExit:
+    return hr;
+}
+
+
+static void ReleaseHashCache(
+    __in CABC_HASHCACHE* pCache
+    )
+{
+    ReleaseDict(pCache->shDictHandle);
+
+    for (DWORD i = 0; i < pCache->cEntries; ++i)
+    {
+        ReleaseStr(pCache->rgEntries[i].pwzSourcePath);
+    }
+    ReleaseMem(pCache->rgEntries);
+
+    memset(pCache, 0, sizeof(CABC_HASHCACHE));
+}
+
+
+static HRESULT CheckForDuplicateFile(
+    __in CABC_DATA *pcd,
+    __out CABC_FILE **ppcf,
+    __in LPCWSTR wzFileName,
+    __in PMSIFILEHASHINFO *ppmfHash,
+    __in LONGLONG llFileSize
+    )
+{
+    DWORD i = 0;
+    HRESULT hr = S_OK;
+    UINT er = ERROR_SUCCESS;
+
+    CabcExitOnNull(ppcf, hr, E_INVALIDARG, "No file structure sent while checking for duplicate file");
+    CabcExitOnNull(ppmfHash, hr, E_INVALIDARG, "No file hash structure pointer sent while checking for duplicate file");
+
+    *ppcf = NULL; // By default, we'll set our output to NULL
+
+    hr = DictGetValue(pcd->shDictHandle, wzFileName, reinterpret_cast<void **>(ppcf));
+    // If we found it in the hash of previously added source paths, return our match immediately
+    if (SUCCEEDED(hr))
+    {
+        ExitFunction1(hr = S_OK);
+    }
+    else if (E_NOTFOUND == hr)
+    {
+        hr = S_OK;
+    }
+    CabcExitOnFailure(hr, "Failed while searching for file in dictionary of previously added files");
+
+    for (i = 0; i < pcd->cFilePaths; ++i)
+    {
+        // If two files have the same size, use hashing to check if they're a match
+        if (llFileSize == pcd->prgFiles[i].llFileSize)
+        {
+            // If pcd->prgFiles[i], our potential match, hasn't been hashed yet, hash it
+            if (pcd->prgFiles[i].pmfHash == NULL)
+            {
+                pcd->prgFiles[i].pmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
+                CabcExitOnNull(pcd->prgFiles[i].pmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for candidate duplicate file's MSI file hash");
+
+                pcd->prgFiles[i].pmfHash->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
+                er = ::MsiGetFileHashW(pcd->prgFiles[i].pwzSourcePath, 0, pcd->prgFiles[i].pmfHash);
+                CabcExitOnWin32Error(er, hr, "Failed while getting MSI file hash of candidate duplicate file: %ls", pcd->prgFiles[i].pwzSourcePath);
+            }
+
+            // If our own file hasn't yet been hashed, hash it
+            if (NULL == *ppmfHash)
+            {
+                *ppmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
+                CabcExitOnNull(*ppmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for file's MSI file hash");
+
+                (*ppmfHash)->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
+                er = ::MsiGetFileHashW(wzFileName, 0, *ppmfHash);
+                CabcExitOnWin32Error(er, hr, "Failed while getting MSI file hash of file: %ls", pcd->prgFiles[i].pwzSourcePath);
+            }
+
+            // If the two file hashes are both of the expected size, and they match, we've got a match, so return it!
+            if (pcd->prgFiles[i].pmfHash->dwFileHashInfoSize == (*ppmfHash)->dwFileHashInfoSize &&
+                sizeof(MSIFILEHASHINFO) == (*ppmfHash)->dwFileHashInfoSize &&
+                pcd->prgFiles[i].pmfHash->dwData[0] == (*ppmfHash)->dwData[0] &&
+                pcd->prgFiles[i].pmfHash->dwData[1] == (*ppmfHash)->dwData[1] &&
+                pcd->prgFiles[i].pmfHash->dwData[2] == (*ppmfHash)->dwData[2] && 
+                pcd->prgFiles[i].pmfHash->dwData[3] == (*ppmfHash)->dwData[3])
+             {
+                 *ppcf = pcd->prgFiles + i;
+                 ExitFunction1(hr = S_OK);
+             }
+        }
+    }
+
+LExit:
+
+    return hr;
+}
+
+
+static HRESULT AddDuplicateFile(
+    __in CABC_DATA *pcd,
+    __in DWORD dwFileArrayIndex,
+    __in_z LPCWSTR wzSourcePath,
+    __in_opt LPCWSTR wzToken,
+    __in DWORD dwDuplicateCabFileIndex
+    )
+{
+    HRESULT hr = S_OK;
+    LPVOID pv = NULL;
+
+    // Ensure there is enough memory to store this duplicate file index.
+    if (pcd->cDuplicates == pcd->cMaxDuplicates)
+    {
+        pcd->cMaxDuplicates += 20; // grow by a reasonable number (20 is reasonable, right?)
+        size_t cbDuplicates = 0;
+
+        hr = ::SizeTMult(pcd->cMaxDuplicates, sizeof(CABC_DUPLICATEFILE), &cbDuplicates);
+        CabcExitOnFailure(hr, "Maximum allocation exceeded.");
+
+        if (pcd->cDuplicates)
+        {
+            pv = MemReAlloc(pcd->prgDuplicates, cbDuplicates, FALSE);
+            CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to reallocate memory for duplicate file.");
+        }
+        else
+        {
+            pv = MemAlloc(cbDuplicates, FALSE);
+            CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to allocate memory for duplicate file.");
+        }
+
+        ZeroMemory(reinterpret_cast<BYTE*>(pv) + (pcd->cDuplicates * sizeof(CABC_DUPLICATEFILE)), (pcd->cMaxDuplicates - pcd->cDuplicates) * sizeof(CABC_DUPLICATEFILE));
+
+        pcd->prgDuplicates = static_cast<CABC_DUPLICATEFILE*>(pv);
+        pv = NULL;
+    }
+
+    // Store the duplicate file index.
+    pcd->prgDuplicates[pcd->cDuplicates].dwFileArrayIndex = dwFileArrayIndex;
+    pcd->prgDuplicates[pcd->cDuplicates].dwDuplicateCabFileIndex = dwDuplicateCabFileIndex;
+    pcd->prgFiles[dwFileArrayIndex].fHasDuplicates = TRUE; // Mark original file as having duplicates
+
+    hr = StrAllocString(&pcd->prgDuplicates[pcd->cDuplicates].pwzSourcePath, wzSourcePath, 0);
+    CabcExitOnFailure(hr, "Failed to copy duplicate file path: %ls", wzSourcePath);
+
+    if (wzToken && *wzToken)
+    {
+        hr = StrAllocString(&pcd->prgDuplicates[pcd->cDuplicates].pwzToken, wzToken, 0);
+        CabcExitOnFailure(hr, "Failed to copy duplicate file token: %ls", wzToken);
+    }
+
+    ++pcd->cDuplicates;
+
+LExit:
+    ReleaseMem(pv);
+    return hr;
+}
+
+
+static HRESULT AddNonDuplicateFile(
+    __in CABC_DATA *pcd,
+    __in LPCWSTR wzFile,
+    __in_opt LPCWSTR wzToken,
+    __in_opt const MSIFILEHASHINFO* pmfHash,
+    __in LONGLONG llFileSize,
+    __in DWORD dwCabFileIndex
+    )
+{
+    HRESULT hr = S_OK;
+    LPVOID pv = NULL;
+
+    // Ensure there is enough memory to store this file index.
+    if (pcd->cFilePaths == pcd->cMaxFilePaths)
+    {
+        pcd->cMaxFilePaths += 100; // grow by a reasonable number (100 is reasonable, right?)
         size_t cbFilePaths = 0;
 
-        hr = ::SizeTMult(pcd->cMaxFilePaths, sizeof(CABC_FILE), &cbFilePaths);
-        CabcExitOnFailure(hr, "Maximum allocation exceeded.");
+        hr = ::SizeTMult(pcd->cMaxFilePaths, sizeof(CABC_FILE), &cbFilePaths);
+        CabcExitOnFailure(hr, "Maximum allocation exceeded.");
+
+        pv = MemReAlloc(pcd->prgFiles, cbFilePaths, FALSE);
+        CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to reallocate memory for file.");
+
+        ZeroMemory(reinterpret_cast<BYTE*>(pv) + (pcd->cFilePaths * sizeof(CABC_FILE)), (pcd->cMaxFilePaths - pcd->cFilePaths) * sizeof(CABC_FILE));
+
+        pcd->prgFiles = static_cast<CABC_FILE*>(pv);
+        pv = NULL;
+    }
+
+    // Store the file index information.
+    // TODO: add this to a sorted list so we can do a binary search later.
+    CABC_FILE *pcf = pcd->prgFiles + pcd->cFilePaths;
+    pcf->dwCabFileIndex = dwCabFileIndex;
+    pcf->llFileSize = llFileSize;
+
+    if (pmfHash && sizeof(MSIFILEHASHINFO) == pmfHash->dwFileHashInfoSize)
+    {
+        pcf->pmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
+        CabcExitOnNull(pcf->pmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for individual file's MSI file hash");
+
+        pcf->pmfHash->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
+        pcf->pmfHash->dwData[0] = pmfHash->dwData[0];
+        pcf->pmfHash->dwData[1] = pmfHash->dwData[1];
+        pcf->pmfHash->dwData[2] = pmfHash->dwData[2];
+        pcf->pmfHash->dwData[3] = pmfHash->dwData[3];
+    }
+
+    hr = StrAllocString(&pcf->pwzSourcePath, wzFile, 0);
+    CabcExitOnFailure(hr, "Failed to copy file path: %ls", wzFile);
+
+    if (wzToken && *wzToken)
+    {
+        hr = StrAllocString(&pcf->pwzToken, wzToken, 0);
+        CabcExitOnFailure(hr, "Failed to copy file token: %ls", wzToken);
+    }
+
+    ++pcd->cFilePaths;
+
+    hr = DictAddValue(pcd->shDictHandle, pcf);
+    CabcExitOnFailure(hr, "Failed to add file to dictionary of added files");
+
+LExit:
+    ReleaseMem(pv);
+    return hr;
+}
+
+
+static HRESULT UpdateDuplicateFiles(
+    __in const CABC_DATA *pcd
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD cbCabinet = 0;
+    LARGE_INTEGER liCabinetSize = { };
+    HANDLE hCabinet = INVALID_HANDLE_VALUE;
+    HANDLE hCabinetMapping = NULL;
+    LPVOID pv = NULL;
+    MS_CABINET_HEADER *pCabinetHeader = NULL;
+
+    hCabinet = ::CreateFileW(pcd->sczCabinetPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hCabinet)
+    {
+        CabcExitWithLastError(hr, "Failed to open cabinet: %ls", pcd->sczCabinetPath);
+    }
+
+    // Shouldn't need more than 16 MB to get the whole cabinet header into memory so use that as
+    // the upper bound for the memory map.
+    if (!::GetFileSizeEx(hCabinet, &liCabinetSize))
+    {
+        CabcExitWithLastError(hr, "Failed to get size of cabinet: %ls", pcd->sczCabinetPath);
+    }
+
+    if (0 == liCabinetSize.HighPart && liCabinetSize.LowPart < MAX_CABINET_HEADER_SIZE)
+    {
+        cbCabinet = liCabinetSize.LowPart;
+    }
+    else
+    {
+        cbCabinet = MAX_CABINET_HEADER_SIZE;
+    }
+
+    // CreateFileMapping() returns NULL on failure, not INVALID_HANDLE_VALUE
+    hCabinetMapping = ::CreateFileMappingW(hCabinet, NULL, PAGE_READWRITE | SEC_COMMIT, 0, cbCabinet, NULL);
+    if (NULL == hCabinetMapping || INVALID_HANDLE_VALUE == hCabinetMapping)
+    {
+        CabcExitWithLastError(hr, "Failed to memory map cabinet file: %ls", pcd->sczCabinetPath);
+    }
+
+    pv = ::MapViewOfFile(hCabinetMapping, FILE_MAP_WRITE, 0, 0, 0);
+    CabcExitOnNullWithLastError(pv, hr, "Failed to map view of cabinet file: %ls", pcd->sczCabinetPath);
+
+    pCabinetHeader = static_cast<MS_CABINET_HEADER*>(pv);
+
+    for (DWORD i = 0; i < pcd->cDuplicates; ++i)
+    {
+        const CABC_DUPLICATEFILE *pDuplicateFile = pcd->prgDuplicates + i;
+
+        hr = DuplicateFile(pCabinetHeader, pcd, pDuplicateFile);
+        CabcExitOnFailure(hr, "Failed to find cabinet file items at index: %d and %d", pDuplicateFile->dwFileArrayIndex, pDuplicateFile->dwDuplicateCabFileIndex);
+    }
+
+LExit:
+    if (pv)
+    {
+        ::UnmapViewOfFile(pv);
+    }
+    if (hCabinetMapping)
+    {
+        ::CloseHandle(hCabinetMapping);
+    }
+    ReleaseFileHandle(hCabinet);
+
+    return hr;
+}
+
+
+static HRESULT DuplicateFile(
+    __in MS_CABINET_HEADER *pHeader,
+    __in const CABC_DATA *pcd,
+    __in const CABC_DUPLICATEFILE *pDuplicate
+    )
+{
+    HRESULT hr = S_OK;
+    BYTE *pbHeader = reinterpret_cast<BYTE*>(pHeader);
+    BYTE* pbItem = pbHeader + pHeader->coffFiles;
+    const MS_CABINET_ITEM *pOriginalItem = NULL;
+    MS_CABINET_ITEM *pDuplicateItem = NULL;
+
+    if (pHeader->cFiles <= pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex ||
+        pHeader->cFiles <= pDuplicate->dwDuplicateCabFileIndex ||
+        pDuplicate->dwDuplicateCabFileIndex <= pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex)
+    {
+        hr = E_UNEXPECTED;
+        CabcExitOnFailure(hr, "Unexpected duplicate file indices, header cFiles: %d, file index: %d, duplicate index: %d", pHeader->cFiles, pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex, pDuplicate->dwDuplicateCabFileIndex);
+    }
+
+    // Step through each cabinet items until we get to the original
+    // file's index.  Notice that the name of the cabinet item is
+    // appended to the end of the MS_CABINET_INFO, that's why we can't
+    // index straight to the data we want.
+    for (DWORD i = 0; i < pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex; ++i)
+    {
+        LPCSTR szItemName = reinterpret_cast<LPCSTR>(pbItem + sizeof(MS_CABINET_ITEM));
+        pbItem = pbItem + sizeof(MS_CABINET_ITEM) + lstrlenA(szItemName) + 1;
+    }
+
+    pOriginalItem = reinterpret_cast<const MS_CABINET_ITEM*>(pbItem);
+
+    // Now pick up where we left off after the original file's index
+    // was found and loop until we find the duplicate file's index.
+    for (DWORD i = pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex; i < pDuplicate->dwDuplicateCabFileIndex; ++i)
+    {
+        LPCSTR szItemName = reinterpret_cast<LPCSTR>(pbItem + sizeof(MS_CABINET_ITEM));
+        pbItem = pbItem + sizeof(MS_CABINET_ITEM) + lstrlenA(szItemName) + 1;
+    }
+
+    pDuplicateItem = reinterpret_cast<MS_CABINET_ITEM*>(pbItem);
+
+    if (0 != pDuplicateItem->cbFile)
+    {
+        hr = E_UNEXPECTED;
+        CabcExitOnFailure(hr, "Failed because duplicate file does not have a file size of zero: %d", pDuplicateItem->cbFile);
+    }
+
+    pDuplicateItem->cbFile = pOriginalItem->cbFile;
+    pDuplicateItem->uoffFolderStart = pOriginalItem->uoffFolderStart;
+    pDuplicateItem->iFolder = pOriginalItem->iFolder;
+    // Note: we do *not* duplicate the date/time and attributes metadata from
+    // the original item to the duplicate. The following lines are commented
+    // so people are not tempted to put them back.
+    //pDuplicateItem->date = pOriginalItem->date;
+    //pDuplicateItem->time = pOriginalItem->time;
+    //pDuplicateItem->attribs = pOriginalItem->attribs;
+
+LExit:
+    return hr;
+}
+
+
+static HRESULT UtcFileTimeToLocalDosDateTime(
+    __in const FILETIME* pFileTime,
+    __out USHORT* pDate,
+    __out USHORT* pTime
+    )
+{
+    HRESULT hr = S_OK;
+    FILETIME ftLocal = { };
+
+    if (!::FileTimeToLocalFileTime(pFileTime, &ftLocal))
+    {
+        CabcExitWithLastError(hr, "Failed to convert file time to local file time.");
+    }
+
+    if (!::FileTimeToDosDateTime(&ftLocal, pDate, pTime))
+    {
+        CabcExitWithLastError(hr, "Failed to convert file time to DOS date time.");
+    }
+
+LExit:
+    return hr;
+}
+
+
+/********************************************************************
+ File stream functions
+
+*********************************************************************/
+
+// Takes ownership of hFile, which must have been opened for overlapped I/O, even on failure.
+static HRESULT CreateStream(
+    __in HANDLE hFile,
+    __in BOOL fWritable,
+    __in BOOL fSynchronous,
+    __out CABC_STREAM** ppStream
+    )
+{
+    HRESULT hr = S_OK;
+    CABC_STREAM* pStream = NULL;
+    LARGE_INTEGER liSize = { };
+
+    pStream = static_cast<CABC_STREAM*>(MemAlloc(sizeof(CABC_STREAM), TRUE));
+    if (!pStream)
+    {
+        ::CloseHandle(hFile);
+        CabcExitOnNull(pStream, hr, E_OUTOFMEMORY, "Failed to allocate cabinet file stream.");
+    }
+
+    pStream->hFile = hFile;
+    pStream->fWritable = fWritable;
+    pStream->fSynchronous = fSynchronous;
+
+    if (!::GetFileSizeEx(hFile, &liSize))
+    {
+        CabcExitWithLastError(hr, "Failed to get size of file for cabinet file stream.");
+    }
+
+    pStream->llSize = liSize.QuadPart;
+
+    // Reading a file never needs more buffer than the file itself.
+    if (!fSynchronous)
+    {
+        pStream->cbBuffer = (fWritable || CABC_STREAM_BUFFER_SIZE < liSize.QuadPart) ? CABC_STREAM_BUFFER_SIZE : static_cast<DWORD>(liSize.QuadPart);
+    }
+
+    for (DWORD i = 0; i < countof(pStream->rgBuffers) && !fSynchronous; ++i)
+    {
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + i;
+
+        pBuffer->overlapped.hEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+        CabcExitOnNullWithLastError(pBuffer->overlapped.hEvent, hr, "Failed to create event for cabinet file stream.");
+
+        if (pStream->cbBuffer)
+        {
+            pBuffer->pb = static_cast<BYTE*>(MemAlloc(pStream->cbBuffer, FALSE));
+            CabcExitOnNull(pBuffer->pb, hr, E_OUTOFMEMORY, "Failed to allocate cabinet file stream buffer.");
+        }
+    }
+
+    if (!fWritable && !fSynchronous)
+    {
+        for (DWORD i = 0; i < countof(pStream->rgBuffers); ++i)
+        {
+            hr = IssueStreamRead(pStream, pStream->rgBuffers + i);
+            CabcExitOnFailure(hr, "Failed to start reading cabinet file stream.");
+        }
+    }
+
+    *ppStream = pStream;
+    pStream = NULL;
+
+LExit:
+    if (pStream)
+    {
+        CloseStream(pStream);
+    }
+
+    return hr;
+}
+
+
+// Failing to open the next file early is not an error, FCI opens it again when it gets to
+// the file and reports any error then.
+static void OpenNextSourceStream(
+    __in CABC_DATA* pcd,
+    __in_z LPCWSTR wzPath
+    )
+{
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+    if (pcd->pNextSourceStream)
+    {
+        CloseStream(pcd->pNextSourceStream);
+        pcd->pNextSourceStream = NULL;
+    }
+
+    pcd->wzNextSourcePath = wzPath;
+
+    hFile = ::CreateFileW(wzPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE != hFile)
+    {
+        CreateStream(hFile, FALSE, FALSE, &pcd->pNextSourceStream);
+    }
+}
+
+
+static HRESULT ReadStream(
+    __in CABC_STREAM* pStream,
+    __out_bcount_part(cb, *pcbRead) BYTE* pb,
+    __in DWORD cb,
+    __out DWORD* pcbRead
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD cbRead = 0;
+    LARGE_INTEGER liStart = { };
+    LARGE_INTEGER liEnd = { };
+
+    if (pStream->fSynchronous)
+    {
+        ::QueryPerformanceCounter(&liStart);
+
+        if (!::ReadFile(pStream->hFile, pb, cb, &cbRead, NULL))
+        {
+            CabcExitWithLastError(hr, "Failed to read cabinet file stream.");
+        }
+
+        ::QueryPerformanceCounter(&liEnd);
+        pStream->llWaitTicks += liEnd.QuadPart - liStart.QuadPart;
+        pStream->llPosition += cbRead;
+        ExitFunction();
+    }
+
+    if (pStream->fWritable)
+    {
+        // FCI reads back its temporary files, so everything written must be on disk first.
+        hr = FlushStream(pStream);
+        CabcExitOnFailure(hr, "Failed to flush cabinet file stream before reading.");
+
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers;
+        pBuffer->overlapped.Offset = static_cast<DWORD>(pStream->llPosition);
+        pBuffer->overlapped.OffsetHigh = static_cast<DWORD>(pStream->llPosition >> 32);
+
+        if (!::ReadFile(pStream->hFile, pb, cb, NULL, &pBuffer->overlapped) && ERROR_IO_PENDING != ::GetLastError())
+        {
+            CabcExitWithLastError(hr, "Failed to read cabinet file stream.");
+        }
+
+        if (!::GetOverlappedResult(pStream->hFile, &pBuffer->overlapped, &cbRead, TRUE))
+        {
+            if (ERROR_HANDLE_EOF != ::GetLastError())
+            {
+                CabcExitWithLastError(hr, "Failed to complete read of cabinet file stream.");
+            }
+
+            cbRead = 0;
+        }
+
+        pStream->llPosition += cbRead;
+        ExitFunction();
+    }
+
+    while (cbRead < cb && pStream->llPosition < pStream->llSize)
+    {
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + pStream->iBuffer;
+
+        hr = WaitForStreamBuffer(pStream, pBuffer);
+        CabcExitOnFailure(hr, "Failed to read ahead in cabinet file stream.");
+
+        if (!pBuffer->cbData)
+        {
+            // The file got shorter since it was opened.
+            break;
+        }
+
+        DWORD cbCopy = min(cb - cbRead, pBuffer->cbData - pStream->cbConsumed);
+        memcpy_s(pb + cbRead, cb - cbRead, pBuffer->pb + pStream->cbConsumed, cbCopy);
 
-        pv = MemReAlloc(pcd->prgFiles, cbFilePaths, FALSE);
-        CabcExitOnNull(pv, hr, E_OUTOFMEMORY, "Failed to reallocate memory for file.");
+        cbRead += cbCopy;
+        pStream->cbConsumed += cbCopy;
+        pStream->llPosition += cbCopy;
 
-        ZeroMemory(reinterpret_cast<BYTE*>(pv) + (pcd->cFilePaths * sizeof(CABC_FILE)), (pcd->cMaxFilePaths - pcd->cFilePaths) * sizeof(CABC_FILE));
+        if (pStream->cbConsumed == pBuffer->cbData)
+        {
+            hr = IssueStreamRead(pStream, pBuffer);
+            CabcExitOnFailure(hr, "Failed to continue reading ahead in cabinet file stream.");
 
-        pcd->prgFiles = static_cast<CABC_FILE*>(pv);
-        pv = NULL;
+            pStream->iBuffer = (pStream->iBuffer + 1) % countof(pStream->rgBuffers);
+            pStream->cbConsumed = 0;
+        }
     }
 
-    // Store the file index information.
-    // TODO: add this to a sorted list so we can do a binary search later.
-    CABC_FILE *pcf = pcd->prgFiles + pcd->cFilePaths;
-    pcf->dwCabFileIndex = dwCabFileIndex;
-    pcf->llFileSize = llFileSize;
+LExit:
+    *pcbRead = cbRead;
 
-    if (pmfHash && sizeof(MSIFILEHASHINFO) == pmfHash->dwFileHashInfoSize)
-    {
-        pcf->pmfHash = (PMSIFILEHASHINFO)MemAlloc(sizeof(MSIFILEHASHINFO), FALSE);
-        CabcExitOnNull(pcf->pmfHash, hr, E_OUTOFMEMORY, "Failed to allocate memory for individual file's MSI file hash");
+    return hr;
+}
 
-        pcf->pmfHash->dwFileHashInfoSize = sizeof(MSIFILEHASHINFO);
-        pcf->pmfHash->dwData[0] = pmfHash->dwData[0];
-        pcf->pmfHash->dwData[1] = pmfHash->dwData[1];
-        pcf->pmfHash->dwData[2] = pmfHash->dwData[2];
-        pcf->pmfHash->dwData[3] = pmfHash->dwData[3];
-    }
 
-    hr = StrAllocString(&pcf->pwzSourcePath, wzFile, 0);
-    CabcExitOnFailure(hr, "Failed to copy file path: %ls", wzFile);
+static HRESULT WriteStream(
+    __in CABC_STREAM* pStream,
+    __in_bcount(cb) const BYTE* pb,
+    __in DWORD cb
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD cbWritten = 0;
+    LARGE_INTEGER liStart = { };
+    LARGE_INTEGER liEnd = { };
 
-    if (wzToken && *wzToken)
+    if (!pStream->fWritable)
     {
-        hr = StrAllocString(&pcf->pwzToken, wzToken, 0);
-        CabcExitOnFailure(hr, "Failed to copy file token: %ls", wzToken);
+        hr = HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED);
+        CabcExitOnRootFailure(hr, "Cannot write to a read-only cabinet file stream.");
     }
 
-    ++pcd->cFilePaths;
+    if (pStream->fSynchronous)
+    {
+        ::QueryPerformanceCounter(&liStart);
 
-    hr = DictAddValue(pcd->shDictHandle, pcf);
-    CabcExitOnFailure(hr, "Failed to add file to dictionary of added files");
+        if (!::WriteFile(pStream->hFile, pb, cb, &cbWritten, NULL))
+        {
+            CabcExitWithLastError(hr, "Failed to write cabinet file stream.");
+        }
+
+        ::QueryPerformanceCounter(&liEnd);
+        pStream->llWaitTicks += liEnd.QuadPart - liStart.QuadPart;
+        pStream->llPosition += cbWritten;
+        cbWritten = cb;
+    }
+
+    while (cbWritten < cb)
+    {
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + pStream->iBuffer;
+
+        if (!pBuffer->cbData)
+        {
+            pBuffer->llOffset = pStream->llPosition;
+        }
+
+        DWORD cbCopy = min(cb - cbWritten, pStream->cbBuffer - pBuffer->cbData);
+        memcpy_s(pBuffer->pb + pBuffer->cbData, pStream->cbBuffer - pBuffer->cbData, pb + cbWritten, cbCopy);
+
+        cbWritten += cbCopy;
+        pBuffer->cbData += cbCopy;
+        pStream->llPosition += cbCopy;
+
+        if (pBuffer->cbData == pStream->cbBuffer)
+        {
+            hr = IssueStreamWrite(pStream, pBuffer);
+            CabcExitOnFailure(hr, "Failed to write behind cabinet file stream.");
+
+            // Fill the other buffer once its last write is done.
+            pStream->iBuffer = (pStream->iBuffer + 1) % countof(pStream->rgBuffers);
+
+            hr = WaitForStreamBuffer(pStream, pStream->rgBuffers + pStream->iBuffer);
+            CabcExitOnFailure(hr, "Failed to write behind cabinet file stream.");
+        }
+    }
+
+    if (pStream->llSize < pStream->llPosition)
+    {
+        pStream->llSize = pStream->llPosition;
+    }
 
 LExit:
-    ReleaseMem(pv);
     return hr;
 }
 
 
-static HRESULT UpdateDuplicateFiles(
-    __in const CABC_DATA *pcd
+static HRESULT SeekStream(
+    __in CABC_STREAM* pStream,
+    __in LONGLONG llDistance,
+    __in DWORD dwMoveMethod,
+    __out LONGLONG* pllPosition
     )
 {
     HRESULT hr = S_OK;
-    DWORD cbCabinet = 0;
-    LARGE_INTEGER liCabinetSize = { };
-    HANDLE hCabinet = INVALID_HANDLE_VALUE;
-    HANDLE hCabinetMapping = NULL;
-    LPVOID pv = NULL;
-    MS_CABINET_HEADER *pCabinetHeader = NULL;
+    LONGLONG llPosition = 0;
 
-    hCabinet = ::CreateFileW(pcd->sczCabinetPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (INVALID_HANDLE_VALUE == hCabinet)
+    switch (dwMoveMethod)
     {
-        CabcExitWithLastError(hr, "Failed to open cabinet: %ls", pcd->sczCabinetPath);
+    case FILE_BEGIN:
+        llPosition = llDistance;
+        break;
+    case FILE_CURRENT:
+        llPosition = pStream->llPosition + llDistance;
+        break;
+    case FILE_END:
+        llPosition = pStream->llSize + llDistance;
+        break;
     }
 
-    // Shouldn't need more than 16 MB to get the whole cabinet header into memory so use that as
-    // the upper bound for the memory map.
-    if (!::GetFileSizeEx(hCabinet, &liCabinetSize))
+    if (0 > llPosition)
     {
-        CabcExitWithLastError(hr, "Failed to get size of cabinet: %ls", pcd->sczCabinetPath);
+        hr = HRESULT_FROM_WIN32(ERROR_NEGATIVE_SEEK);
+        CabcExitOnRootFailure(hr, "Cannot seek before the start of a cabinet file stream.");
     }
 
-    if (0 == liCabinetSize.HighPart && liCabinetSize.LowPart < MAX_CABINET_HEADER_SIZE)
+    if (llPosition != pStream->llPosition)
     {
-        cbCabinet = liCabinetSize.LowPart;
+        if (pStream->fSynchronous)
+        {
+            LARGE_INTEGER liPosition = { };
+            liPosition.QuadPart = llPosition;
+
+            if (!::SetFilePointerEx(pStream->hFile, liPosition, NULL, FILE_BEGIN))
+            {
+                CabcExitWithLastError(hr, "Failed to move cabinet file stream pointer.");
+            }
+        }
+        else if (pStream->fWritable)
+        {
+            // Write behind only ever writes contiguous data.
+            hr = FlushStream(pStream);
+            CabcExitOnFailure(hr, "Failed to flush cabinet file stream before seeking.");
+        }
+        else
+        {
+            // Read ahead is only useful from the new position.
+            CancelStreamReads(pStream);
+
+            pStream->llNextRead = llPosition;
+            pStream->iBuffer = 0;
+            pStream->cbConsumed = 0;
+
+            for (DWORD i = 0; i < countof(pStream->rgBuffers); ++i)
+            {
+                hr = IssueStreamRead(pStream, pStream->rgBuffers + i);
+                CabcExitOnFailure(hr, "Failed to start reading cabinet file stream after seeking.");
+            }
+        }
+
+        pStream->llPosition = llPosition;
     }
-    else
+
+    *pllPosition = llPosition;
+
+LExit:
+    return hr;
+}
+
+
+static HRESULT FlushStream(
+    __in CABC_STREAM* pStream
+    )
+{
+    HRESULT hr = S_OK;
+    CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + pStream->iBuffer;
+
+    if (pBuffer->cbData && !pBuffer->fPending)
     {
-        cbCabinet = MAX_CABINET_HEADER_SIZE;
+        hr = IssueStreamWrite(pStream, pBuffer);
+        CabcExitOnFailure(hr, "Failed to write cabinet file stream.");
     }
 
-    // CreateFileMapping() returns NULL on failure, not INVALID_HANDLE_VALUE
-    hCabinetMapping = ::CreateFileMappingW(hCabinet, NULL, PAGE_READWRITE | SEC_COMMIT, 0, cbCabinet, NULL);
-    if (NULL == hCabinetMapping || INVALID_HANDLE_VALUE == hCabinetMapping)
+    for (DWORD i = 0; i < countof(pStream->rgBuffers); ++i)
     {
-        CabcExitWithLastError(hr, "Failed to memory map cabinet file: %ls", pcd->sczCabinetPath);
+        hr = WaitForStreamBuffer(pStream, pStream->rgBuffers + i);
+        CabcExitOnFailure(hr, "Failed to finish writing cabinet file stream.");
     }
 
-    pv = ::MapViewOfFile(hCabinetMapping, FILE_MAP_WRITE, 0, 0, 0);
-    CabcExitOnNullWithLastError(pv, hr, "Failed to map view of cabinet file: %ls", pcd->sczCabinetPath);
+LExit:
+    return hr;
+}
 
-    pCabinetHeader = static_cast<MS_CABINET_HEADER*>(pv);
 
-    for (DWORD i = 0; i < pcd->cDuplicates; ++i)
-    {
-        const CABC_DUPLICATEFILE *pDuplicateFile = pcd->prgDuplicates + i;
+// Always frees the stream. Returns the first failure to write any data still held back.
+static HRESULT CloseStream(
+    __in CABC_STREAM* pStream
+    )
+{
+    HRESULT hr = S_OK;
 
-        hr = DuplicateFile(pCabinetHeader, pcd, pDuplicateFile);
-        CabcExitOnFailure(hr, "Failed to find cabinet file items at index: %d and %d", pDuplicateFile->dwFileArrayIndex, pDuplicateFile->dwDuplicateCabFileIndex);
+    if (pStream->fSynchronous)
+    {
+        // Nothing is held back or read ahead.
+    }
+    else if (pStream->fWritable)
+    {
+        hr = FlushStream(pStream);
+    }
+    else
+    {
+        CancelStreamReads(pStream);
     }
 
-LExit:
-    if (pv)
+    for (DWORD i = 0; i < countof(pStream->rgBuffers); ++i)
     {
-        ::UnmapViewOfFile(pv);
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + i;
+
+        // A buffer must not be freed while a read or write still targets it.
+        if (pBuffer->fPending)
+        {
+            DWORD cbTransferred = 0;
+            ::GetOverlappedResult(pStream->hFile, &pBuffer->overlapped, &cbTransferred, TRUE);
+        }
+
+        ReleaseHandle(pBuffer->overlapped.hEvent);
+        ReleaseMem(pBuffer->pb);
     }
-    if (hCabinetMapping)
+
+    if (!::CloseHandle(pStream->hFile) && SUCCEEDED(hr))
     {
-        ::CloseHandle(hCabinetMapping);
+        hr = HRESULT_FROM_WIN32(::GetLastError());
+        if (SUCCEEDED(hr))
+        {
+            hr = E_FAIL;
+        }
     }
-    ReleaseFileHandle(hCabinet);
+
+    MemFree(pStream);
 
     return hr;
 }
 
 
-static HRESULT DuplicateFile(
-    __in MS_CABINET_HEADER *pHeader,
-    __in const CABC_DATA *pcd,
-    __in const CABC_DUPLICATEFILE *pDuplicate
+static void CancelStreamReads(
+    __in CABC_STREAM* pStream
     )
 {
-    HRESULT hr = S_OK;
-    BYTE *pbHeader = reinterpret_cast<BYTE*>(pHeader);
-    BYTE* pbItem = pbHeader + pHeader->coffFiles;
-    const MS_CABINET_ITEM *pOriginalItem = NULL;
-    MS_CABINET_ITEM *pDuplicateItem = NULL;
+    DWORD cbTransferred = 0;
 
-    if (pHeader->cFiles <= pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex ||
-        pHeader->cFiles <= pDuplicate->dwDuplicateCabFileIndex ||
-        pDuplicate->dwDuplicateCabFileIndex <= pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex)
+    ::CancelIo(pStream->hFile);
+
+    for (DWORD i = 0; i < countof(pStream->rgBuffers); ++i)
     {
-        hr = E_UNEXPECTED;
-        CabcExitOnFailure(hr, "Unexpected duplicate file indices, header cFiles: %d, file index: %d, duplicate index: %d", pHeader->cFiles, pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex, pDuplicate->dwDuplicateCabFileIndex);
+        CABC_STREAM_BUFFER* pBuffer = pStream->rgBuffers + i;
+
+        if (pBuffer->fPending)
+        {
+            // Completes with ERROR_OPERATION_ABORTED unless the read finished first, either way the data is unwanted.
+            ::GetOverlappedResult(pStream->hFile, &pBuffer->overlapped, &cbTransferred, TRUE);
+            pBuffer->fPending = FALSE;
+        }
+
+        pBuffer->cbData = 0;
     }
+}
 
-    // Step through each cabinet items until we get to the original
-    // file's index.  Notice that the name of the cabinet item is
-    // appended to the end of the MS_CABINET_INFO, that's why we can't
-    // index straight to the data we want.
-    for (DWORD i = 0; i < pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex; ++i)
+
+static HRESULT IssueStreamRead(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD cbRead = 0;
+
+    pBuffer->llOffset = pStream->llNextRead;
+    pBuffer->cbData = 0;
+
+    if (pStream->llNextRead >= pStream->llSize)
     {
-        LPCSTR szItemName = reinterpret_cast<LPCSTR>(pbItem + sizeof(MS_CABINET_ITEM));
-        pbItem = pbItem + sizeof(MS_CABINET_ITEM) + lstrlenA(szItemName) + 1;
+        ExitFunction();
     }
 
-    pOriginalItem = reinterpret_cast<const MS_CABINET_ITEM*>(pbItem);
+    cbRead = (pStream->llSize - pStream->llNextRead < pStream->cbBuffer) ? static_cast<DWORD>(pStream->llSize - pStream->llNextRead) : pStream->cbBuffer;
 
-    // Now pick up where we left off after the original file's index
-    // was found and loop until we find the duplicate file's index.
-    for (DWORD i = pcd->prgFiles[pDuplicate->dwFileArrayIndex].dwCabFileIndex; i < pDuplicate->dwDuplicateCabFileIndex; ++i)
+    pBuffer->overlapped.Offset = static_cast<DWORD>(pBuffer->llOffset);
+    pBuffer->overlapped.OffsetHigh = static_cast<DWORD>(pBuffer->llOffset >> 32);
+
+    if (!::ReadFile(pStream->hFile, pBuffer->pb, cbRead, NULL, &pBuffer->overlapped) && ERROR_IO_PENDING != ::GetLastError())
     {
-        LPCSTR szItemName = reinterpret_cast<LPCSTR>(pbItem + sizeof(MS_CABINET_ITEM));
-        pbItem = pbItem + sizeof(MS_CABINET_ITEM) + lstrlenA(szItemName) + 1;
+        CabcExitWithLastError(hr, "Failed to start read of cabinet file stream.");
     }
 
-    pDuplicateItem = reinterpret_cast<MS_CABINET_ITEM*>(pbItem);
+    pBuffer->fPending = TRUE;
+    pStream->llNextRead += cbRead;
 
-    if (0 != pDuplicateItem->cbFile)
+LExit:
+    return hr;
+}
+
+
+static HRESULT IssueStreamWrite(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
+    )
+{
+    HRESULT hr = S_OK;
+
+    pBuffer->overlapped.Offset = static_cast<DWORD>(pBuffer->llOffset);
+    pBuffer->overlapped.OffsetHigh = static_cast<DWORD>(pBuffer->llOffset >> 32);
+
+    if (!::WriteFile(pStream->hFile, pBuffer->pb, pBuffer->cbData, NULL, &pBuffer->overlapped) && ERROR_IO_PENDING != ::GetLastError())
     {
-        hr = E_UNEXPECTED;
-        CabcExitOnFailure(hr, "Failed because duplicate file does not have a file size of zero: %d", pDuplicateItem->cbFile);
+        CabcExitWithLastError(hr, "Failed to start write of cabinet file stream.");
     }
 
-    pDuplicateItem->cbFile = pOriginalItem->cbFile;
-    pDuplicateItem->uoffFolderStart = pOriginalItem->uoffFolderStart;
-    pDuplicateItem->iFolder = pOriginalItem->iFolder;
-    // Note: we do *not* duplicate the date/time and attributes metadata from
-    // the original item to the duplicate. The following lines are commented
-    // so people are not tempted to put them back.
-    //pDuplicateItem->date = pOriginalItem->date;
-    //pDuplicateItem->time = pOriginalItem->time;
-    //pDuplicateItem->attribs = pOriginalItem->attribs;
+    pBuffer->fPending = TRUE;
 
 LExit:
     return hr;
 }
 
 
-static HRESULT UtcFileTimeToLocalDosDateTime(
-    __in const FILETIME* pFileTime,
-    __out USHORT* pDate,
-    __out USHORT* pTime
+// Waits for the buffer's read or write to complete. A completed read leaves the bytes read
+// in the buffer, a completed write leaves the buffer empty.
+static HRESULT WaitForStreamBuffer(
+    __in CABC_STREAM* pStream,
+    __in CABC_STREAM_BUFFER* pBuffer
     )
 {
     HRESULT hr = S_OK;
-    FILETIME ftLocal = { };
+    DWORD cbTransferred = 0;
+    LARGE_INTEGER liStart = { };
+    LARGE_INTEGER liEnd = { };
 
-    if (!::FileTimeToLocalFileTime(pFileTime, &ftLocal))
+    if (!pBuffer->fPending)
     {
-        CabcExitWithLastError(hr, "Failed to convert file time to local file time.");
+        ExitFunction();
     }
 
-    if (!::FileTimeToDosDateTime(&ftLocal, pDate, pTime))
+    pBuffer->fPending = FALSE;
+
+    ::QueryPerformanceCounter(&liStart);
+
+    if (!::GetOverlappedResult(pStream->hFile, &pBuffer->overlapped, &cbTransferred, TRUE))
     {
-        CabcExitWithLastError(hr, "Failed to convert file time to DOS date time.");
+        if (ERROR_HANDLE_EOF != ::GetLastError())
+        {
+            pBuffer->cbData = 0;
+            CabcExitWithLastError(hr, "Failed to complete I/O on cabinet file stream.");
+        }
+
+        cbTransferred = 0;
+    }
+
+    ::QueryPerformanceCounter(&liEnd);
+    pStream->llWaitTicks += liEnd.QuadPart - liStart.QuadPart;
+
+    if (pStream->fWritable)
+    {
+        if (cbTransferred != pBuffer->cbData)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+            CabcExitOnRootFailure(hr, "Failed to write all %u bytes of cabinet file stream, wrote: %u", pBuffer->cbData, cbTransferred);
+        }
+
+        pBuffer->cbData = 0;
+    }
+    else
+    {
+        pBuffer->cbData = cbTransferred;
     }
 
 LExit:
@@ -1086,6 +2337,8 @@ static __callback INT_PTR DIAMONDAPI CabCOpen(
     CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(pv);
     HRESULT hr = S_OK;
     INT_PTR pFile = -1;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    CABC_STREAM* pStream = NULL;
     DWORD dwAccess = 0;
     DWORD dwDisposition = 0;
     DWORD dwAttributes = 0;
@@ -1119,24 +2372,35 @@ static __callback INT_PTR DIAMONDAPI CabCOpen(
     if (!dwAttributes)
         dwAttributes = FILE_ATTRIBUTE_NORMAL;
 
+    // All I/O goes through a file stream so FCI never waits on the disk for more than a buffer.
+    if (!pcd->fSynchronousIo)
+        dwAttributes |= FILE_FLAG_OVERLAPPED;
+    if (!(dwAccess & GENERIC_WRITE))
+        dwAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+
     // Check to see if we were passed the magic character that says 'Unicode string follows'.
     if (pszFile && CABC_MAGIC_UNICODE_STRING_MARKER == *pszFile)
     {
-        pFile = reinterpret_cast<INT_PTR>(::CreateFileW(reinterpret_cast<LPCWSTR>(pszFile + 1), dwAccess, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, dwDisposition, dwAttributes, NULL));
+        hFile = ::CreateFileW(reinterpret_cast<LPCWSTR>(pszFile + 1), dwAccess, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, dwDisposition, dwAttributes, NULL);
     }
     else
     {
 #pragma prefast(push)
 #pragma prefast(disable:25068) // We intentionally don't use the unicode API here
-        pFile = reinterpret_cast<INT_PTR>(::CreateFileA(pszFile, dwAccess, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, dwDisposition, dwAttributes, NULL));
+        hFile = ::CreateFileA(pszFile, dwAccess, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, dwDisposition, dwAttributes, NULL);
 #pragma prefast(pop)
     }
 
-    if (INVALID_HANDLE_VALUE == reinterpret_cast<HANDLE>(pFile))
+    if (INVALID_HANDLE_VALUE == hFile)
     {
         CabcExitOnLastError(hr, "failed to open file: %hs", pszFile);
     }
 
+    hr = CreateStream(hFile, (dwAccess & GENERIC_WRITE) ? TRUE : FALSE, pcd->fSynchronousIo, &pStream);
+    CabcExitOnFailure(hr, "failed to create stream for file: %hs", pszFile);
+
+    pFile = reinterpret_cast<INT_PTR>(pStream);
+
 LExit:
     if (FAILED(hr))
         pcd->hrLastError = *err = hr;
@@ -1157,11 +2421,17 @@ static __callback UINT FAR DIAMONDAPI CabCRead(
     HRESULT hr = S_OK;
     DWORD cbRead = 0;
 
+    CABC_STREAM* pStream = reinterpret_cast<CABC_STREAM*>(hf);
+
     CabcExitOnNull(hf, *err, E_INVALIDARG, "Failed to read during cabinet extraction because no file handle was provided");
-    if (!::ReadFile(reinterpret_cast<HANDLE>(hf), memory, cb, &cbRead, NULL))
+
+    hr = ReadStream(pStream, static_cast<BYTE*>(memory), cb, &cbRead);
+    CabcExitOnFailure(hr, "failed to read during cabinet extraction");
+
+    // Only the files added to the cabinet are opened read-only.
+    if (!pStream->fWritable)
     {
-        *err = ::GetLastError();
-        CabcExitOnLastError(hr, "failed to read during cabinet extraction");
+        pcd->qwSourceBytes += cbRead;
     }
 
 LExit:
@@ -1187,11 +2457,11 @@ static __callback UINT FAR DIAMONDAPI CabCWrite(
     DWORD cbWrite = 0;
 
     CabcExitOnNull(hf, *err, E_INVALIDARG, "Failed to write during cabinet extraction because no file handle was provided");
-    if (!::WriteFile(reinterpret_cast<HANDLE>(hf), memory, cb, &cbWrite, NULL))
-    {
-        *err = ::GetLastError();
-        CabcExitOnLastError(hr, "failed to write during cabinet extraction");
-    }
+
+    hr = WriteStream(reinterpret_cast<CABC_STREAM*>(hf), static_cast<const BYTE*>(memory), cb);
+    CabcExitOnFailure(hr, "failed to write during cabinet extraction");
+
+    cbWrite = cb;
 
 LExit:
     if (FAILED(hr))
@@ -1212,7 +2482,7 @@ static __callback long FAR DIAMONDAPI CabCSeek(
     CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(pv);
     HRESULT hr = S_OK;
     DWORD dwMoveMethod;
-    LONG lMove = 0;
+    LONGLONG llMove = 0;
 
     switch (seektype)
     {
@@ -1231,15 +2501,9 @@ static __callback long FAR DIAMONDAPI CabCSeek(
         CabcExitOnFailure(hr, "unexpected seektype in FCISeek(): %d", seektype);
     }
 
-    // SetFilePointer returns -1 if it fails (this will cause FDI to quit with an FDIERROR_USER_ABORT error.
-    // (Unless this happens while working on a cabinet, in which case FDI returns FDIERROR_CORRUPT_CABINET)
-    // Todo: update these comments for FCI (are they accurate for FCI as well?)
-    lMove = ::SetFilePointer(reinterpret_cast<HANDLE>(hf), dist, NULL, dwMoveMethod);
-    if (DWORD_MAX == lMove)
-    {
-        *err = ::GetLastError();
-        CabcExitOnLastError(hr, "failed to move file pointer %d bytes", dist);
-    }
+    // Returning -1 on failure causes FCI to quit.
+    hr = SeekStream(reinterpret_cast<CABC_STREAM*>(hf), dist, dwMoveMethod, &llMove);
+    CabcExitOnFailure(hr, "failed to move file pointer %d bytes", dist);
 
 LExit:
     if (FAILED(hr))
@@ -1247,7 +2511,7 @@ LExit:
         pcd->hrLastError = *err = hr;
     }
 
-    return FAILED(hr) ? -1 : lMove;
+    return FAILED(hr) ? -1 : static_cast<long>(llMove);
 }
 
 
@@ -1259,12 +2523,12 @@ static __callback int FAR DIAMONDAPI CabCClose(
 {
     CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(pv);
     HRESULT hr = S_OK;
+    CABC_STREAM* pStream = reinterpret_cast<CABC_STREAM*>(hf);
 
-    if (!::CloseHandle(reinterpret_cast<HANDLE>(hf)))
-    {
-        *err = ::GetLastError();
-        CabcExitOnLastError(hr, "failed to close file during cabinet extraction");
-    }
+    pcd->llStreamWaitTicks += pStream->llWaitTicks;
+
+    hr = CloseStream(pStream);
+    CabcExitOnFailure(hr, "failed to close file during cabinet extraction");
 
 LExit:
     if (FAILED(hr))
@@ -1455,6 +2719,7 @@ static __callback INT_PTR DIAMONDAPI CabCGetOpenInfo(
     )
 {
     HRESULT hr = S_OK;
+    CABC_DATA *pcd = reinterpret_cast<CABC_DATA*>(pv);
     CABC_INTERNAL_ADDFILEINFO* pFileInfo = reinterpret_cast<CABC_INTERNAL_ADDFILEINFO*>(pszName);
     LPCWSTR wzFile = NULL;
     DWORD cbFile = 0;
@@ -1503,7 +2768,21 @@ static __callback INT_PTR DIAMONDAPI CabCGetOpenInfo(
         }
     }
 
-    iResult = CabCOpen(pszFilePlusMagic, _O_BINARY|_O_RDONLY, 0, err, pv);
+    if (pcd->pNextSourceStream && wzFile == pcd->wzNextSourcePath)
+    {
+        iResult = reinterpret_cast<INT_PTR>(pcd->pNextSourceStream);
+        pcd->pNextSourceStream = NULL;
+    }
+    else
+    {
+        iResult = CabCOpen(pszFilePlusMagic, _O_BINARY|_O_RDONLY, 0, err, pv);
+    }
+
+    // Start reading the next file while FCI compresses this one.
+    if (-1 != iResult && !pcd->fSynchronousIo && pFileInfo->wzNextSourcePath && pFileInfo->wzNextSourcePath != pcd->wzNextSourcePath)
+    {
+        OpenNextSourceStream(pcd, pFileInfo->wzNextSourcePath);
+    }
 
 LExit:
     ReleaseMem(pszFilePlusMagic);
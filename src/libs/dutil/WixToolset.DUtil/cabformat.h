@@ -0,0 +1,36 @@
+#pragma once
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+
+// On-disk layout of the cabinet header (CFHEADER) and file entries (CFFILE), shared by
+// cabutil, which reads the file table directly, and cabcutil, which patches duplicate
+// file entries after FCI writes the cabinet.
+static const DWORD CAB_SIGNATURE = 0x4643534D; // "MSCF"
+static const WORD CAB_VERSION = 0x0103;
+static const DWORD CAB_MAX_FILE_NAME = 256;
+
+struct MS_CABINET_HEADER
+{
+    DWORD sig;
+    DWORD csumHeader;
+    DWORD cbCabinet;
+    DWORD csumFolders;
+    DWORD coffFiles;
+    DWORD csumFiles;
+    WORD version;
+    WORD cFolders;
+    WORD cFiles;
+    WORD flags;
+    WORD setID;
+    WORD iCabinet;
+};
+
+struct MS_CABINET_ITEM
+{
+    DWORD cbFile;
+    DWORD uoffFolderStart;
+    WORD iFolder;
+    WORD date;
+    WORD time;
+    WORD attribs;
+};
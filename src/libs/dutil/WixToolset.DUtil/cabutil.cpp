@@ -1,6 +1,7 @@
 // Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
 
 #include "precomp.h"
+#include "cabformat.h"
 
 
 // Exit macros
@@ -30,14 +31,10 @@ typedef BOOL (FAR DIAMONDAPI *PFNFDICOPY)(HFDI, char *, char *, int, PFNFDINOTIF
 //
 static HMODULE vhCabinetDll = NULL;
 
-static HFDI vhfdi = NULL;
 static PFNFDICREATE vpfnFDICreate = NULL;
 static PFNFDICOPY vpfnFDICopy = NULL;
 static PFNFDIISCABINET vpfnFDIIsCabinet = NULL;
 static PFNFDIDESTROY vpfnFDIDestroy = NULL;
-static ERF verf;
-
-static DWORD64 vdw64EmbeddedOffset = 0;
 
 //
 // structs
@@ -48,11 +45,38 @@ struct CAB_CALLBACK_STRUCT
     LPCWSTR pwzExtract;         // file to extract ("*" means extract all)
     LPCWSTR pwzExtractDir;      // directory to extract files to
 
+    // only files in folders where (iFolder % cFolderPartitions) == iFolderPartition are extracted when cFolderPartitions is not zero
+    USHORT cFolderPartitions;
+    USHORT iFolderPartition;
+
     // possible user data
     CAB_CALLBACK_PROGRESS pfnProgress;
     LPVOID pvContext;
 };
 
+// Each operation has its own FDI context so cabinets can be read on several threads at once.
+struct CAB_OPERATION
+{
+    HFDI hfdi;
+    ERF erf;
+    DWORD64 dw64EmbeddedOffset;
+    STDCALL_PFNFDINOTIFY pfnNotify;
+};
+
+struct CAB_FOLDER_PARTITION
+{
+    LPCWSTR wzCabinet;
+    LPCWSTR wzExtractDir;
+    CAB_CALLBACK_PROGRESS pfnProgress;
+    LPVOID pvContext;
+    DWORD64 dw64EmbeddedOffset;
+    USHORT cFolderPartitions;
+    USHORT iFolderPartition;
+};
+
+// FDI's file callbacks do not take a context so each thread tracks the operation it is running.
+__declspec(thread) static CAB_OPERATION* vpOperation = NULL;
+
 //
 // prototypes
 //
@@ -64,9 +88,13 @@ static __callback UINT FAR DIAMONDAPI CabExtractWrite(__in INT_PTR hf, __in void
 static __callback int FAR DIAMONDAPI CabExtractClose(__in INT_PTR hf);
 static __callback long FAR DIAMONDAPI CabExtractSeek(__in INT_PTR hf, __in long dist, __in int seektype);
 static __callback INT_PTR DIAMONDAPI CabExtractCallback(__in FDINOTIFICATIONTYPE iNotification, __inout FDINOTIFICATION *pFDINotify);
-static HRESULT DAPI CabOperation(__in LPCWSTR wzCabinet, __in LPCWSTR wzExtractFile, __in_opt LPCWSTR wzExtractDir, __in_opt CAB_CALLBACK_PROGRESS pfnProgress, __in_opt LPVOID pvContext, __in_opt STDCALL_PFNFDINOTIFY pfnNotify, __in DWORD64 dw64EmbeddedOffset);
-
-static STDCALL_PFNFDINOTIFY v_pfnNetFx11Notify = NULL;
+static HRESULT DAPI CabOperation(__in LPCWSTR wzCabinet, __in LPCWSTR wzExtractFile, __in_opt LPCWSTR wzExtractDir, __in_opt CAB_CALLBACK_PROGRESS pfnProgress, __in_opt LPVOID pvContext, __in_opt STDCALL_PFNFDINOTIFY pfnNotify, __in DWORD64 dw64EmbeddedOffset, __in USHORT cFolderPartitions, __in USHORT iFolderPartition);
+static HRESULT BeginOperation(__in CAB_OPERATION* pOperation, __in DWORD64 dw64EmbeddedOffset, __out CAB_OPERATION** ppPreviousOperation);
+static void EndOperation(__in CAB_OPERATION* pOperation, __in_opt CAB_OPERATION* pPreviousOperation);
+static HRESULT GetFolderCount(__in_z LPCWSTR wzCabinet, __in DWORD64 dw64EmbeddedOffset, __out USHORT* pcFolders);
+static HRESULT CALLBACK ExtractFolderPartition(__in THRD_GROUP_HANDLE hGroup, __in_opt LPVOID pvContext);
+static HRESULT MapCabinetView(__in HANDLE hMapping, __in DWORD64 qwFileSize, __in DWORD64 dw64EmbeddedOffset, __in DWORD cbView, __out LPVOID* ppvView, __out const BYTE** ppbCabinet, __out DWORD* pcbCabinet);
+static HRESULT ReadIndexFiles(__in_bcount(cbCabinet) const BYTE* pbCabinet, __in DWORD cbCabinet, __in const MS_CABINET_HEADER* pHeader, __inout CAB_INDEX* pIndex);
 
 
 inline HRESULT LoadCabinetDll()
@@ -86,9 +114,6 @@ inline HRESULT LoadCabinetDll()
         CabExitOnNullWithLastError(vpfnFDIIsCabinet, hr, "failed to import FDIIsCabinetfrom CABINET.DLL");
         vpfnFDIDestroy = reinterpret_cast<PFNFDIDESTROY>(::GetProcAddress(vhCabinetDll, "FDIDestroy"));
         CabExitOnNullWithLastError(vpfnFDIDestroy, hr, "failed to import FDIDestroyfrom CABINET.DLL");
-
-        vhfdi = vpfnFDICreate(CabExtractAlloc, CabExtractFree, CabExtractOpen, CabExtractRead, CabExtractWrite, CabExtractClose, CabExtractSeek, cpuUNKNOWN, &verf);
-        CabExitOnNull(vhfdi, hr, E_FAIL, "failed to initialize cabinet.dll");
     }
 
 LExit:
@@ -128,6 +153,8 @@ static HANDLE OpenFileWithRetry(
 /********************************************************************
  CabInitialize - initializes internal static variables
 
+ NOTE: call with fDelayLoad FALSE before using cabinets on more than
+       one thread so CABINET.DLL is not loaded by two threads at once.
 ********************************************************************/
 extern "C" HRESULT DAPI CabInitialize(
     __in BOOL fDelayLoad
@@ -153,15 +180,6 @@ LExit:
 extern "C" void DAPI CabUninitialize(
     )
 {
-    if (vhfdi)
-    {
-        if (vpfnFDIDestroy)
-        {
-            vpfnFDIDestroy(vhfdi);
-        }
-        vhfdi = NULL;
-    }
-
     vpfnFDICreate = NULL;
     vpfnFDICopy =NULL;
     vpfnFDIIsCabinet = NULL;
@@ -188,7 +206,138 @@ extern "C" HRESULT DAPI CabEnumerate(
     __in DWORD64 dw64EmbeddedOffset
     )
 {
-    return CabOperation(wzCabinet, wzEnumerateFile, NULL, NULL, NULL, pfnNotify, dw64EmbeddedOffset);
+    return CabOperation(wzCabinet, wzEnumerateFile, NULL, NULL, NULL, pfnNotify, dw64EmbeddedOffset, 0, 0);
+}
+
+/********************************************************************
+ CabReadIndex - reads the file table of a cabinet without CABINET.DLL
+
+ NOTE: files are returned in the order they are stored in the cabinet,
+       which is the order FDI enumerates them.
+       Release pIndex with CabReleaseIndex.
+********************************************************************/
+extern "C" HRESULT DAPI CabReadIndex(
+    __in_z LPCWSTR wzCabinet,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out CAB_INDEX* pIndex
+    )
+{
+    HRESULT hr = S_OK;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+    hFile = OpenFileWithRetry(wzCabinet, GENERIC_READ, OPEN_EXISTING);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        CabExitWithLastError(hr, "failed to open cabinet: %ls", wzCabinet);
+    }
+
+    hr = CabReadIndexFromHandle(hFile, dw64EmbeddedOffset, pIndex);
+    CabExitOnFailure(hr, "failed to read index of cabinet: %ls", wzCabinet);
+
+LExit:
+    ReleaseFileHandle(hFile);
+
+    return hr;
+}
+
+/********************************************************************
+ CabReadIndexFromHandle - reads the file table of a cabinet that starts
+                          at an offset in an open file
+
+ NOTE: hCabinet must be open for read access. Its file pointer is not
+       used or moved.
+       Release pIndex with CabReleaseIndex.
+********************************************************************/
+extern "C" HRESULT DAPI CabReadIndexFromHandle(
+    __in HANDLE hCabinet,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out CAB_INDEX* pIndex
+    )
+{
+    HRESULT hr = S_OK;
+    LARGE_INTEGER liFileSize = { };
+    HANDLE hMapping = NULL;
+    LPVOID pvView = NULL;
+    const BYTE* pbCabinet = NULL;
+    DWORD cbCabinet = 0;
+    MS_CABINET_HEADER header = { };
+    DWORD64 qwTableEnd = 0;
+
+    memset(pIndex, 0, sizeof(CAB_INDEX));
+
+    if (!::GetFileSizeEx(hCabinet, &liFileSize))
+    {
+        CabExitWithLastError(hr, "failed to get size of cabinet file");
+    }
+
+    hMapping = ::CreateFileMappingW(hCabinet, NULL, PAGE_READONLY, 0, 0, NULL);
+    CabExitOnNullWithLastError(hMapping, hr, "failed to map cabinet file");
+
+    // Map just the header first, then only as much as the file table can span, so a
+    // large cabinet never needs to fit in the address space.
+    hr = MapCabinetView(hMapping, liFileSize.QuadPart, dw64EmbeddedOffset, sizeof(MS_CABINET_HEADER), &pvView, &pbCabinet, &cbCabinet);
+    CabExitOnFailure(hr, "failed to map cabinet header");
+
+    memcpy_s(&header, sizeof(header), pbCabinet, sizeof(MS_CABINET_HEADER));
+
+    ::UnmapViewOfFile(pvView);
+    pvView = NULL;
+
+    if (CAB_SIGNATURE != header.sig || CAB_VERSION != header.version || header.coffFiles < sizeof(MS_CABINET_HEADER))
+    {
+        hr = E_INVALIDDATA;
+        CabExitOnRootFailure(hr, "not a cabinet, signature: 0x%x version: 0x%x", header.sig, header.version);
+    }
+
+    qwTableEnd = static_cast<DWORD64>(header.coffFiles) + static_cast<DWORD64>(header.cFiles) * (sizeof(MS_CABINET_ITEM) + CAB_MAX_FILE_NAME + 1);
+    if (qwTableEnd > header.cbCabinet)
+    {
+        qwTableEnd = header.cbCabinet;
+    }
+
+    hr = MapCabinetView(hMapping, liFileSize.QuadPart, dw64EmbeddedOffset, static_cast<DWORD>(qwTableEnd), &pvView, &pbCabinet, &cbCabinet);
+    CabExitOnFailure(hr, "failed to map cabinet file table");
+
+    pIndex->cFolders = header.cFolders;
+    pIndex->iCabinet = header.iCabinet;
+
+    hr = ReadIndexFiles(pbCabinet, cbCabinet, &header, pIndex);
+    CabExitOnFailure(hr, "failed to read cabinet file table");
+
+LExit:
+    if (pvView)
+    {
+        ::UnmapViewOfFile(pvView);
+    }
+    ReleaseHandle(hMapping);
+
+    if (FAILED(hr))
+    {
+        CabReleaseIndex(pIndex);
+    }
+
+    return hr;
+}
+
+/********************************************************************
+ CabReleaseIndex - frees the files read by CabReadIndex
+
+********************************************************************/
+extern "C" void DAPI CabReleaseIndex(
+    __in CAB_INDEX* pIndex
+    )
+{
+    if (pIndex->rgFiles)
+    {
+        for (DWORD i = 0; i < pIndex->cFiles; ++i)
+        {
+            ReleaseStr(pIndex->rgFiles[i].sczName);
+        }
+
+        MemFree(pIndex->rgFiles);
+    }
+
+    memset(pIndex, 0, sizeof(CAB_INDEX));
 }
 
 /********************************************************************
@@ -208,7 +357,85 @@ extern "C" HRESULT DAPI CabExtract(
     __in DWORD64 dw64EmbeddedOffset
     )
 {
-    return CabOperation(wzCabinet, wzExtractFile, wzExtractDir, pfnProgress, pvContext, NULL, dw64EmbeddedOffset);
+    return CabOperation(wzCabinet, wzExtractFile, wzExtractDir, pfnProgress, pvContext, NULL, dw64EmbeddedOffset, 0, 0);
+}
+
+/********************************************************************
+ CabExtractParallel - extracts all files from a cabinet, extracting the
+                      cabinet's folders on several threads
+
+ NOTE: wzCabinet must be full path to cabinet file
+       wzExttractDir must be normalized (end in a "\")
+       pfnProgress may be called on several threads at once and files
+       from different folders are reported in no particular order
+       Uses the shared thread pool if it is initialized.
+********************************************************************/
+extern "C" HRESULT DAPI CabExtractParallel(
+    __in_z LPCWSTR wzCabinet,
+    __in_z LPCWSTR wzExtractDir,
+    __in_opt CAB_CALLBACK_PROGRESS pfnProgress,
+    __in_opt LPVOID pvContext,
+    __in DWORD64 dw64EmbeddedOffset
+    )
+{
+    HRESULT hr = S_OK;
+    USHORT cFolders = 0;
+    DWORD cPartitions = 0;
+    CAB_FOLDER_PARTITION* rgPartitions = NULL;
+    THRD_POOL_HANDLE hPool = NULL;
+    THRD_GROUP_HANDLE hGroup = NULL;
+
+    hr = GetFolderCount(wzCabinet, dw64EmbeddedOffset, &cFolders);
+    CabExitOnFailure(hr, "failed to read folders in cabinet: %ls", wzCabinet);
+
+    if (1 < cFolders)
+    {
+        hr = ThrdGroupCreate(NULL, &hGroup);
+        if (HRESULT_FROM_WIN32(ERROR_INVALID_STATE) == hr)
+        {
+            hr = ThrdPoolCreate(0, &hPool);
+            CabExitOnFailure(hr, "failed to create thread pool to extract cabinet: %ls", wzCabinet);
+
+            hr = ThrdGroupCreate(hPool, &hGroup);
+        }
+        CabExitOnFailure(hr, "failed to create thread group to extract cabinet: %ls", wzCabinet);
+
+        cPartitions = min(static_cast<DWORD>(cFolders), ThrdPoolGetThreadCount(hPool));
+    }
+
+    if (1 >= cPartitions)
+    {
+        ExitFunction1(hr = CabOperation(wzCabinet, L"*", wzExtractDir, pfnProgress, pvContext, NULL, dw64EmbeddedOffset, 0, 0));
+    }
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&rgPartitions), sizeof(CAB_FOLDER_PARTITION), cPartitions);
+    CabExitOnFailure(hr, "failed to allocate cabinet folder partitions");
+
+    for (DWORD i = 0; i < cPartitions; ++i)
+    {
+        CAB_FOLDER_PARTITION* pPartition = rgPartitions + i;
+
+        pPartition->wzCabinet = wzCabinet;
+        pPartition->wzExtractDir = wzExtractDir;
+        pPartition->pfnProgress = pfnProgress;
+        pPartition->pvContext = pvContext;
+        pPartition->dw64EmbeddedOffset = dw64EmbeddedOffset;
+        pPartition->cFolderPartitions = static_cast<USHORT>(cPartitions);
+        pPartition->iFolderPartition = static_cast<USHORT>(i);
+
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ExtractFolderPartition, pPartition);
+        CabExitOnFailure(hr, "failed to queue extraction of cabinet folders: %ls", wzCabinet);
+    }
+
+    hr = ThrdGroupWait(hGroup, INFINITE);
+    CabExitOnFailure(hr, "failed to extract cabinet file: %ls", wzCabinet);
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+    ReleaseThreadPool(hPool);
+    ReleaseMem(rgPartitions);
+
+    return hr;
 }
 
 //
@@ -228,9 +455,9 @@ static __callback INT_PTR DIAMONDAPI FDINotify(
     __inout FDINOTIFICATION *pFDINotify
     )
 {
-    if (NULL != v_pfnNetFx11Notify)
+    if (vpOperation && NULL != vpOperation->pfnNotify)
     {
-        return v_pfnNetFx11Notify(iNotification, pFDINotify);
+        return vpOperation->pfnNotify(iNotification, pFDINotify);
     }
     else
     {
@@ -257,11 +484,15 @@ static HRESULT DAPI CabOperation(
     __in_opt CAB_CALLBACK_PROGRESS pfnProgress,
     __in_opt LPVOID pvContext,
     __in_opt STDCALL_PFNFDINOTIFY pfnNotify,
-    __in DWORD64 dw64EmbeddedOffset
+    __in DWORD64 dw64EmbeddedOffset,
+    __in USHORT cFolderPartitions,
+    __in USHORT iFolderPartition
     )
 {
     HRESULT hr = S_OK;
     BOOL fResult = FALSE;
+    CAB_OPERATION operation = { };
+    CAB_OPERATION* pPreviousOperation = NULL;
 
     LPWSTR sczCabinet = NULL;
     LPWSTR pwz = NULL;
@@ -271,14 +502,8 @@ static HRESULT DAPI CabOperation(
     CAB_CALLBACK_STRUCT ccs = { };
     PFNFDINOTIFY pfnFdiNotify = NULL;
 
-    //
-    // ensure the cabinet.dll is loaded
-    //
-    if (!vhfdi)
-    {
-        hr = LoadCabinetDll();
-        CabExitOnFailure(hr, "failed to load CABINET.DLL");
-    }
+    hr = BeginOperation(&operation, dw64EmbeddedOffset, &pPreviousOperation);
+    CabExitOnFailure(hr, "failed to begin cabinet operation");
 
     hr = StrAllocString(&sczCabinet, wzCabinet, 0);
     CabExitOnFailure(hr, "Failed to make copy of cabinet name:%ls", wzCabinet);
@@ -314,11 +539,11 @@ static HRESULT DAPI CabOperation(
     ccs.fStopExtracting = FALSE;
     ccs.pwzExtract = wzExtractFile;
     ccs.pwzExtractDir = wzExtractDir;
+    ccs.cFolderPartitions = cFolderPartitions;
+    ccs.iFolderPartition = iFolderPartition;
     ccs.pfnProgress = pfnProgress;
     ccs.pvContext = pvContext;
 
-    vdw64EmbeddedOffset = dw64EmbeddedOffset;
-
     // if pfnNotify is given, use it, otherwise use default callback
     if (NULL == pfnNotify)
     {
@@ -326,10 +551,10 @@ static HRESULT DAPI CabOperation(
     }
     else
     {
-        v_pfnNetFx11Notify = pfnNotify;
+        operation.pfnNotify = pfnNotify;
         pfnFdiNotify = FDINotify;
     }
-    fResult = vpfnFDICopy(vhfdi, szCabFile, pszCabDirectory, 0, pfnFdiNotify, NULL, static_cast<void*>(&ccs));
+    fResult = vpfnFDICopy(operation.hfdi, szCabFile, pszCabDirectory, 0, pfnFdiNotify, NULL, static_cast<void*>(&ccs));
     if (!fResult && !ccs.fStopExtracting)   // if something went wrong and it wasn't us just stopping the extraction, then return a failure
     {
         CabExitWithLastError(hr, "failed to extract cabinet file: %ls", sczCabinet);
@@ -338,7 +563,232 @@ static HRESULT DAPI CabOperation(
 LExit:
     ReleaseStr(sczCabinet);
     ReleaseStr(pszCabDirectory);
-    v_pfnNetFx11Notify = NULL;
+    EndOperation(&operation, pPreviousOperation);
+
+    return hr;
+}
+
+/********************************************************************
+ BeginOperation - creates the FDI context for an operation and makes it
+                  the current thread's operation
+
+********************************************************************/
+static HRESULT BeginOperation(
+    __in CAB_OPERATION* pOperation,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out CAB_OPERATION** ppPreviousOperation
+    )
+{
+    HRESULT hr = S_OK;
+
+    //
+    // ensure the cabinet.dll is loaded
+    //
+    if (!vhCabinetDll)
+    {
+        hr = LoadCabinetDll();
+        CabExitOnFailure(hr, "failed to load CABINET.DLL");
+    }
+
+    pOperation->dw64EmbeddedOffset = dw64EmbeddedOffset;
+
+    pOperation->hfdi = vpfnFDICreate(CabExtractAlloc, CabExtractFree, CabExtractOpen, CabExtractRead, CabExtractWrite, CabExtractClose, CabExtractSeek, cpuUNKNOWN, &pOperation->erf);
+    CabExitOnNull(pOperation->hfdi, hr, E_FAIL, "failed to initialize cabinet.dll");
+
+    // A callback may start another operation on the same thread so remember the one it interrupted.
+    *ppPreviousOperation = vpOperation;
+    vpOperation = pOperation;
+
+LExit:
+    return hr;
+}
+
+static void EndOperation(
+    __in CAB_OPERATION* pOperation,
+    __in_opt CAB_OPERATION* pPreviousOperation
+    )
+{
+    if (pOperation->hfdi)
+    {
+        vpfnFDIDestroy(pOperation->hfdi);
+        pOperation->hfdi = NULL;
+
+        vpOperation = pPreviousOperation;
+    }
+}
+
+/********************************************************************
+ GetFolderCount - reads the number of folders in a cabinet
+
+********************************************************************/
+static HRESULT GetFolderCount(
+    __in_z LPCWSTR wzCabinet,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out USHORT* pcFolders
+    )
+{
+    HRESULT hr = S_OK;
+    CAB_OPERATION operation = { };
+    CAB_OPERATION* pPreviousOperation = NULL;
+    LPSTR pszCabinet = NULL;
+    INT_PTR pFile = -1;
+    FDICABINETINFO fdici = { };
+
+    hr = BeginOperation(&operation, dw64EmbeddedOffset, &pPreviousOperation);
+    CabExitOnFailure(hr, "failed to begin cabinet operation");
+
+    hr = StrAnsiAllocString(&pszCabinet, wzCabinet, 0, CP_UTF8);
+    CabExitOnFailure(hr, "failed to convert cabinet path to UTF-8: %ls", wzCabinet);
+
+    pFile = CabExtractOpen(pszCabinet, /*_O_BINARY*/ 0x8000 | /*_O_RDONLY*/ 0x0000, _S_IREAD | _S_IWRITE);
+    if (-1 == pFile)
+    {
+        hr = E_FAIL;
+        CabExitOnRootFailure(hr, "failed to open cabinet: %ls", wzCabinet);
+    }
+
+    if (!vpfnFDIIsCabinet(operation.hfdi, pFile, &fdici))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        CabExitOnRootFailure(hr, "not a cabinet: %ls", wzCabinet);
+    }
+
+    *pcFolders = fdici.cFolders;
+
+LExit:
+    if (-1 != pFile)
+    {
+        CabExtractClose(pFile);
+    }
+    ReleaseStr(pszCabinet);
+    EndOperation(&operation, pPreviousOperation);
+
+    return hr;
+}
+
+// Views must start on the allocation granularity, so the view may begin before the cabinet.
+// Returns the cabinet's bytes within the view, which may be fewer than asked for if the file
+// ends first.
+static HRESULT MapCabinetView(
+    __in HANDLE hMapping,
+    __in DWORD64 qwFileSize,
+    __in DWORD64 dw64EmbeddedOffset,
+    __in DWORD cbView,
+    __out LPVOID* ppvView,
+    __out const BYTE** ppbCabinet,
+    __out DWORD* pcbCabinet
+    )
+{
+    HRESULT hr = S_OK;
+    SYSTEM_INFO si = { };
+    DWORD64 qwViewOffset = 0;
+    DWORD cbSkip = 0;
+    DWORD64 qwViewSize = 0;
+    LPVOID pvView = NULL;
+
+    ::GetSystemInfo(&si);
+
+    qwViewOffset = dw64EmbeddedOffset - (dw64EmbeddedOffset % si.dwAllocationGranularity);
+    cbSkip = static_cast<DWORD>(dw64EmbeddedOffset - qwViewOffset);
+
+    if (qwFileSize < dw64EmbeddedOffset + sizeof(MS_CABINET_HEADER))
+    {
+        hr = E_INVALIDDATA;
+        CabExitOnRootFailure(hr, "cabinet is too small, file size: %I64u offset: %I64u", qwFileSize, dw64EmbeddedOffset);
+    }
+
+    qwViewSize = static_cast<DWORD64>(cbSkip) + cbView;
+    if (qwViewSize > qwFileSize - qwViewOffset)
+    {
+        qwViewSize = qwFileSize - qwViewOffset;
+    }
+
+    pvView = ::MapViewOfFile(hMapping, FILE_MAP_READ, static_cast<DWORD>(qwViewOffset >> 32), static_cast<DWORD>(qwViewOffset), static_cast<SIZE_T>(qwViewSize));
+    CabExitOnNullWithLastError(pvView, hr, "failed to map view of cabinet at offset: %I64u", qwViewOffset);
+
+    *ppvView = pvView;
+    *ppbCabinet = static_cast<const BYTE*>(pvView) + cbSkip;
+    *pcbCabinet = static_cast<DWORD>(qwViewSize - cbSkip);
+
+LExit:
+    return hr;
+}
+
+static HRESULT ReadIndexFiles(
+    __in_bcount(cbCabinet) const BYTE* pbCabinet,
+    __in DWORD cbCabinet,
+    __in const MS_CABINET_HEADER* pHeader,
+    __inout CAB_INDEX* pIndex
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD iOffset = pHeader->coffFiles;
+    MS_CABINET_ITEM item = { };
+    LPCSTR szName = NULL;
+    size_t cchName = 0;
+
+    if (!pHeader->cFiles)
+    {
+        ExitFunction();
+    }
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&pIndex->rgFiles), sizeof(CAB_INDEX_FILE), pHeader->cFiles);
+    CabExitOnFailure(hr, "failed to allocate %u cabinet files", pHeader->cFiles);
+
+    for (WORD i = 0; i < pHeader->cFiles; ++i)
+    {
+        CAB_INDEX_FILE* pFile = pIndex->rgFiles + i;
+
+        if (cbCabinet < iOffset || cbCabinet - iOffset < sizeof(MS_CABINET_ITEM))
+        {
+            hr = E_INVALIDDATA;
+            CabExitOnRootFailure(hr, "cabinet file table is truncated at file: %u", i);
+        }
+
+        memcpy_s(&item, sizeof(item), pbCabinet + iOffset, sizeof(MS_CABINET_ITEM));
+        iOffset += sizeof(MS_CABINET_ITEM);
+
+        szName = reinterpret_cast<LPCSTR>(pbCabinet + iOffset);
+        cchName = ::strnlen(szName, min(cbCabinet - iOffset, CAB_MAX_FILE_NAME + 1));
+        if (!cchName || CAB_MAX_FILE_NAME < cchName || cchName == cbCabinet - iOffset)
+        {
+            hr = E_INVALIDDATA;
+            CabExitOnRootFailure(hr, "cabinet file table has an invalid name at file: %u", i);
+        }
+
+        hr = StrAllocStringAnsi(&pFile->sczName, szName, cchName, (item.attribs & _A_NAME_IS_UTF) ? CP_UTF8 : CP_ACP);
+        CabExitOnFailure(hr, "failed to convert name of cabinet file: %u", i);
+
+        iOffset += static_cast<DWORD>(cchName) + 1;
+
+        pFile->cbFile = item.cbFile;
+        pFile->uoffFolderStart = item.uoffFolderStart;
+        pFile->iFolder = item.iFolder;
+        pFile->date = item.date;
+        pFile->time = item.time;
+        pFile->attribs = item.attribs;
+
+        ++pIndex->cFiles;
+    }
+
+LExit:
+    return hr;
+}
+
+static HRESULT CALLBACK ExtractFolderPartition(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    CAB_FOLDER_PARTITION* pPartition = static_cast<CAB_FOLDER_PARTITION*>(pvContext);
+
+    hr = CabOperation(pPartition->wzCabinet, L"*", pPartition->wzExtractDir, pPartition->pfnProgress, pPartition->pvContext, NULL, pPartition->dw64EmbeddedOffset, pPartition->cFolderPartitions, pPartition->iFolderPartition);
+    if (FAILED(hr))
+    {
+        // The other folders are not worth extracting once one fails.
+        ThrdGroupCancel(hGroup);
+    }
 
     return hr;
 }
@@ -384,10 +834,10 @@ static __callback INT_PTR FAR DIAMONDAPI CabExtractOpen(__in_z PSTR pszFile, __i
 
     pFile = reinterpret_cast<INT_PTR>(hFile);
 
-    if (vdw64EmbeddedOffset)
+    if (vpOperation->dw64EmbeddedOffset)
     {
         hr = CabExtractSeek(pFile, 0, 0);
-        CabExitOnFailure(hr, "Failed to seek to embedded offset %I64d", vdw64EmbeddedOffset);
+        CabExitOnFailure(hr, "Failed to seek to embedded offset %I64d", vpOperation->dw64EmbeddedOffset);
     }
 
     hFile = INVALID_HANDLE_VALUE;
@@ -442,7 +892,7 @@ static __callback long FAR DIAMONDAPI CabExtractSeek(__in INT_PTR hf, __in long
     {
     case 0:   // SEEK_SET
         dwMoveMethod = FILE_BEGIN;
-        dist += static_cast<long>(vdw64EmbeddedOffset);
+        dist += static_cast<long>(vpOperation->dw64EmbeddedOffset);
         break;
     case 1:   /// SEEK_CUR
         dwMoveMethod = FILE_CURRENT;
@@ -465,7 +915,7 @@ static __callback long FAR DIAMONDAPI CabExtractSeek(__in INT_PTR hf, __in long
     }
 
 LExit:
-    return FAILED(hr) ? -1 : lMove - static_cast<long>(vdw64EmbeddedOffset);
+    return FAILED(hr) ? -1 : lMove - static_cast<long>(vpOperation->dw64EmbeddedOffset);
 }
 
 
@@ -508,6 +958,11 @@ static __callback INT_PTR DIAMONDAPI CabExtractCallback(__in FDINOTIFICATIONTYPE
             ExitFunction1(hr = S_FALSE);   // no more extracting
         }
 
+        if (pccs->cFolderPartitions && pccs->iFolderPartition != pFDINotify->iFolder % pccs->cFolderPartitions)
+        {
+            ExitFunction1(ipResult = 0);   // another partition extracts this folder
+        }
+
         // convert params to useful variables
         sz = static_cast<LPCSTR>(pFDINotify->psz1);
         CabExitOnNull(sz, hr, E_INVALIDARG, "No cabinet file ID given to convert");
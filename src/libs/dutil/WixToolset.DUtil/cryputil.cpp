@@ -279,6 +279,84 @@ LExit:
     return hr;
 }
 
+extern "C" HRESULT DAPI CrypHashFileRange(
+    __in HANDLE hFile,
+    __in DWORD64 qwOffset,
+    __in DWORD64 qwLength,
+    __in DWORD dwProvType,
+    __in ALG_ID algid,
+    __out_bcount(cbHash) BYTE* pbHash,
+    __in DWORD cbHash
+    )
+{
+    HRESULT hr = S_OK;
+    HCRYPTPROV hProv = NULL;
+    HCRYPTHASH hHash = NULL;
+    DWORD cbRead = 0;
+    DWORD64 qwRemaining = qwLength;
+    BYTE rgbBuffer[4096] = { };
+    LARGE_INTEGER liOffset = { };
+
+    liOffset.QuadPart = qwOffset;
+
+    // get handle to the crypto provider
+    if (!::CryptAcquireContextW(&hProv, NULL, NULL, dwProvType, CRYPT_VERIFYCONTEXT | CRYPT_SILENT))
+    {
+        CrypExitWithLastError(hr, "Failed to acquire crypto context.");
+    }
+
+    // initiate hash
+    if (!::CryptCreateHash(hProv, algid, 0, 0, &hHash))
+    {
+        CrypExitWithLastError(hr, "Failed to initiate hash.");
+    }
+
+    if (!::SetFilePointerEx(hFile, liOffset, NULL, FILE_BEGIN))
+    {
+        CrypExitWithLastError(hr, "Failed to seek to start of range.");
+    }
+
+    while (qwRemaining)
+    {
+        // read data block
+        if (!::ReadFile(hFile, rgbBuffer, static_cast<DWORD>(min(sizeof(rgbBuffer), qwRemaining)), &cbRead, NULL))
+        {
+            CrypExitWithLastError(hr, "Failed to read data block.");
+        }
+
+        if (!cbRead)
+        {
+            CrypExitOnRootFailure(hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF), "File ended before the end of the range.");
+        }
+
+        // hash data block
+        if (!::CryptHashData(hHash, rgbBuffer, cbRead, 0))
+        {
+            CrypExitWithLastError(hr, "Failed to hash data block.");
+        }
+
+        qwRemaining -= cbRead;
+    }
+
+    // get hash value
+    if (!::CryptGetHashParam(hHash, HP_HASHVAL, pbHash, &cbHash, 0))
+    {
+        CrypExitWithLastError(hr, "Failed to get hash value.");
+    }
+
+LExit:
+    if (hHash)
+    {
+        ::CryptDestroyHash(hHash);
+    }
+    if (hProv)
+    {
+        ::CryptReleaseContext(hProv, 0);
+    }
+
+    return hr;
+}
+
 HRESULT DAPI CrypHashBuffer(
     __in_bcount(cbBuffer) const BYTE* pbBuffer,
     __in SIZE_T cbBuffer,
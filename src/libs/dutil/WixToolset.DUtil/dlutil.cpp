@@ -186,6 +186,52 @@ LExit:
 }
 
 
+extern "C" HRESULT DAPI DownloadPrepareResume(
+    __in_z LPCWSTR wzDestinationPath,
+    __in DWORD64 dw64ResumeOffset
+    )
+{
+    HRESULT hr = S_OK;
+    HANDLE hDestinationFile = INVALID_HANDLE_VALUE;
+    LPWSTR sczResumePath = NULL;
+    HANDLE hResumeFile = INVALID_HANDLE_VALUE;
+
+    // Drop everything after the offset so a resumed download cannot leave stale bytes behind.
+    hDestinationFile = ::CreateFileW(wzDestinationPath, GENERIC_WRITE, FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hDestinationFile)
+    {
+        DlExitWithLastError(hr, "Failed to open download destination file: %ls", wzDestinationPath);
+    }
+
+    hr = FileSetPointer(hDestinationFile, dw64ResumeOffset, NULL, FILE_BEGIN);
+    DlExitOnFailure(hr, "Failed to seek to resume offset in file: %ls", wzDestinationPath);
+
+    if (!::SetEndOfFile(hDestinationFile))
+    {
+        DlExitWithLastError(hr, "Failed to truncate download destination file: %ls", wzDestinationPath);
+    }
+
+    hr = DownloadGetResumePath(wzDestinationPath, &sczResumePath);
+    DlExitOnFailure(hr, "Failed to get resume path.");
+
+    hResumeFile = ::CreateFileW(sczResumePath, GENERIC_WRITE, FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hResumeFile)
+    {
+        DlExitWithLastError(hr, "Failed to create resume file: %ls", sczResumePath);
+    }
+
+    hr = FileWriteHandle(hResumeFile, reinterpret_cast<LPCBYTE>(&dw64ResumeOffset), sizeof(dw64ResumeOffset));
+    DlExitOnFailure(hr, "Failed to write resume file: %ls", sczResumePath);
+
+LExit:
+    ReleaseFileHandle(hResumeFile);
+    ReleaseStr(sczResumePath);
+    ReleaseFileHandle(hDestinationFile);
+
+    return hr;
+}
+
+
 // internal helper functions
 
 static HRESULT InitializeResume(
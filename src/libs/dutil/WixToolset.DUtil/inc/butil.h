@@ -186,6 +186,20 @@ HRESULT DAPI BundleGetBundleVariableFixed(
     __inout SIZE_T* pcchValue
     );
 
+/********************************************************************
+BundleIndexInitialize - initializes the process-wide index of bundle registrations
+                        used by BundleQueryRelatedBundles. Each registry view is
+                        indexed on first use and again after its Uninstall key changes.
+                        BundleQueryRelatedBundles reads the registry directly when
+                        the index is not initialized.
+********************************************************************/
+HRESULT DAPI BundleIndexInitialize();
+
+/********************************************************************
+BundleIndexUninitialize - releases the index of bundle registrations.
+********************************************************************/
+void DAPI BundleIndexUninitialize();
+
 /********************************************************************
 BundleQueryRelatedBundles - Queries the bundle installation metadata for installs with the given detect, upgrade, addon, and patch codes.
                             Passes each related bundle to the callback function.
@@ -30,6 +30,13 @@ typedef enum COMPRESSION_TYPE
     COMPRESSION_TYPE_MSZIP
 } COMPRESSION_TYPE;
 
+// filled in by CabCFinish when requested with CabCCollectStatistics
+typedef struct CABC_STATISTICS
+{
+    DWORD64 qwSourceBytes; // uncompressed bytes read from the files added to the cabinet
+    DWORD dwStreamWaitMilliseconds; // time spent waiting on file reads and writes
+} CABC_STATISTICS;
+
 // functions
 HRESULT DAPI CabCBegin(
     __in_z LPCWSTR wzCab,
@@ -49,6 +56,14 @@ HRESULT DAPI CabCAddFile(
     __in_opt PMSIFILEHASHINFO pmfHash,
     __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext
     );
+HRESULT DAPI CabCSetHashCachePath(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in_z_opt LPCWSTR wzCachePath
+    );
+void DAPI CabCCollectStatistics(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in_opt CABC_STATISTICS* pStatistics
+    );
 HRESULT DAPI CabCFinish(
     __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
     __in_opt FileSplitCabNamesCallback fileSplitCabNamesCallback
@@ -10,7 +10,24 @@ extern "C" {
 #endif
 
 // structs
+typedef struct _CAB_INDEX_FILE
+{
+    LPWSTR sczName;
+    DWORD cbFile;
+    DWORD uoffFolderStart;
+    USHORT iFolder; // may be one of the ifoldCONTINUED_* values for a file that spans cabinets
+    USHORT date;
+    USHORT time;
+    USHORT attribs;
+} CAB_INDEX_FILE;
 
+typedef struct _CAB_INDEX
+{
+    USHORT cFolders;
+    USHORT iCabinet;
+    CAB_INDEX_FILE* rgFiles;
+    DWORD cFiles;
+} CAB_INDEX;
 
 // callback function prototypes
 typedef HRESULT (*CAB_CALLBACK_OPEN_FILE)(LPCWSTR wzFile, INT_PTR* ppFile);
@@ -44,6 +61,14 @@ HRESULT DAPI CabExtract(
     __in DWORD64 dw64EmbeddedOffset
     );
 
+HRESULT DAPI CabExtractParallel(
+    __in_z LPCWSTR wzCabinet,
+    __in_z LPCWSTR wzExtractDir,
+    __in_opt CAB_CALLBACK_PROGRESS pfnProgress,
+    __in_opt LPVOID pvContext,
+    __in DWORD64 dw64EmbeddedOffset
+    );
+
 HRESULT DAPI CabEnumerate(
     __in_z LPCWSTR wzCabinet,
     __in_z LPCWSTR wzEnumerateFile,
@@ -51,6 +76,22 @@ HRESULT DAPI CabEnumerate(
     __in DWORD64 dw64EmbeddedOffset
     );
 
+HRESULT DAPI CabReadIndex(
+    __in_z LPCWSTR wzCabinet,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out CAB_INDEX* pIndex
+    );
+
+HRESULT DAPI CabReadIndexFromHandle(
+    __in HANDLE hCabinet,
+    __in DWORD64 dw64EmbeddedOffset,
+    __out CAB_INDEX* pIndex
+    );
+
+void DAPI CabReleaseIndex(
+    __in CAB_INDEX* pIndex
+    );
+
 #ifdef __cplusplus
 }
 #endif
@@ -80,6 +80,16 @@ HRESULT DAPI CrypHashFileHandle(
     __out_opt DWORD64* pqwBytesHashed
     );
 
+HRESULT DAPI CrypHashFileRange(
+    __in HANDLE hFile,
+    __in DWORD64 qwOffset,
+    __in DWORD64 qwLength,
+    __in DWORD dwProvType,
+    __in ALG_ID algid,
+    __out_bcount(cbHash) BYTE* pbHash,
+    __in DWORD cbHash
+    );
+
 HRESULT DAPI CrypHashBuffer(
     __in_bcount(cbBuffer) const BYTE* pbBuffer,
     __in SIZE_T cbBuffer,
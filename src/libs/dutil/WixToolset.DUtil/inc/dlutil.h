@@ -54,6 +54,11 @@ HRESULT DAPI DownloadUrl(
     __in_opt DOWNLOAD_AUTHENTICATION_CALLBACK* pAuthenticate
     );
 
+HRESULT DAPI DownloadPrepareResume(
+    __in_z LPCWSTR wzDestinationPath,
+    __in DWORD64 dw64ResumeOffset
+    );
+
 
 #ifdef __cplusplus
 }
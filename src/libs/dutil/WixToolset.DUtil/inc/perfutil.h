@@ -15,6 +15,9 @@ void DAPI PerfInitialize(
 void DAPI PerfClickTime(
     __out_opt LARGE_INTEGER* pliElapsed
     );
+void DAPI PerfQueryTime(
+    __out LARGE_INTEGER* pliTime
+    );
 double DAPI PerfConvertToSeconds(
     __in const LARGE_INTEGER* pli
     );
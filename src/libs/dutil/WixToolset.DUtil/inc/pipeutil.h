@@ -139,6 +139,23 @@ DAPI_(HRESULT) PipeRpcRequest(
     __in PIPE_RPC_RESULT* pResult
 );
 
+/*******************************************************************
+ PipeRpcTimedRequest - sends message and reads a response over the pipe,
+    returning the PerfQueryTime() when the request was sent and when
+    its response was read. Time spent waiting for another request on
+    the pipe is not included. Free with PipeFreeRpcResult().
+
+*******************************************************************/
+DAPI_(HRESULT) PipeRpcTimedRequest(
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in DWORD dwMessageType,
+    __in_bcount(cbArgs) LPVOID pbArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult,
+    __out LARGE_INTEGER* pliStart,
+    __out LARGE_INTEGER* pliStop
+);
+
 /*******************************************************************
  PipeRpcResponse - sends response over the pipe.
 
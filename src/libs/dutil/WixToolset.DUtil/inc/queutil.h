@@ -8,8 +8,14 @@ extern "C" {
 
 #define ReleaseQueue(qh, pfn, pv) if (qh) { QueDestroy(qh, pfn, pv); }
 #define ReleaseNullQue(qh, pfv, pv) if (qh) { QueDestroy(qh, pfn, pv); qh = NULL; }
+#define ReleaseRing(rh, pfn, pv) if (rh) { QueRingDestroy(rh, pfn, pv); }
+#define ReleaseNullRing(rh, pfn, pv) if (rh) { QueRingDestroy(rh, pfn, pv); rh = NULL; }
+#define ReleaseSegmentedQueue(sh, pfn, pv) if (sh) { QueSegmentedDestroy(sh, pfn, pv); }
+#define ReleaseNullSegmentedQueue(sh, pfn, pv) if (sh) { QueSegmentedDestroy(sh, pfn, pv); sh = NULL; }
 
 typedef void* QUEUTIL_QUEUE_HANDLE;
+typedef void* QUEUTIL_RING_HANDLE;
+typedef void* QUEUTIL_SEGMENTED_HANDLE;
 
 typedef void(CALLBACK* PFNQUEUTIL_QUEUE_RELEASE_VALUE)(
     __in void* pvValue,
@@ -47,6 +53,132 @@ void DAPI QueDestroy(
     __in_opt void* pvContext
     );
 
+/********************************************************************
+QueRingCreate - Creates a bounded queue that any number of threads can
+                enqueue to and dequeue from at the same time without
+                taking a lock. The capacity is rounded up to a power
+                of two.
+
+********************************************************************/
+HRESULT DAPI QueRingCreate(
+    __in DWORD cCapacity,
+    __out QUEUTIL_RING_HANDLE* phRing
+    );
+
+/********************************************************************
+QueRingTryEnqueue - Adds the value to the end of the ring, or returns
+                    HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) if
+                    the ring is full.
+
+********************************************************************/
+HRESULT DAPI QueRingTryEnqueue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt void* pvValue
+    );
+
+/********************************************************************
+QueRingEnqueue - Adds the value to the end of the ring, waiting up to
+                 dwTimeout milliseconds for room. Returns
+                 HRESULT_FROM_WIN32(WAIT_TIMEOUT) if the ring stayed
+                 full.
+
+********************************************************************/
+HRESULT DAPI QueRingEnqueue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt void* pvValue,
+    __in DWORD dwTimeout
+    );
+
+/********************************************************************
+QueRingTryDequeue - Returns the value from the beginning of the ring,
+                    or E_NOMOREITEMS if the ring is empty.
+
+********************************************************************/
+HRESULT DAPI QueRingTryDequeue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __out void** ppvValue
+    );
+
+/********************************************************************
+QueRingDequeue - Returns the value from the beginning of the ring,
+                 waiting up to dwTimeout milliseconds for one. Returns
+                 HRESULT_FROM_WIN32(WAIT_TIMEOUT) if the ring stayed
+                 empty.
+
+********************************************************************/
+HRESULT DAPI QueRingDequeue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __out void** ppvValue,
+    __in DWORD dwTimeout
+    );
+
+/********************************************************************
+QueRingDestroy - Releases any values left in the ring and frees it.
+                 No other thread may be using the ring.
+
+********************************************************************/
+void DAPI QueRingDestroy(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt PFNQUEUTIL_QUEUE_RELEASE_VALUE pfnReleaseValue,
+    __in_opt void* pvContext
+    );
+
+/********************************************************************
+QueSegmentedCreate - Creates an unbounded queue that any number of
+                     threads can use at the same time. Values are
+                     stored in segments of cSegmentCapacity values and
+                     a new segment is added whenever the last one fills.
+
+********************************************************************/
+HRESULT DAPI QueSegmentedCreate(
+    __in DWORD cSegmentCapacity,
+    __out QUEUTIL_SEGMENTED_HANDLE* phQueue
+    );
+
+/********************************************************************
+QueSegmentedEnqueue - Adds the value to the end of the queue. Only
+                      fails if a new segment cannot be allocated.
+
+********************************************************************/
+HRESULT DAPI QueSegmentedEnqueue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __in_opt void* pvValue
+    );
+
+/********************************************************************
+QueSegmentedTryDequeue - Returns the value from the beginning of the
+                         queue, or E_NOMOREITEMS if the queue is empty.
+
+********************************************************************/
+HRESULT DAPI QueSegmentedTryDequeue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __out void** ppvValue
+    );
+
+/********************************************************************
+QueSegmentedDequeue - Returns the value from the beginning of the
+                      queue, waiting up to dwTimeout milliseconds for
+                      one. Returns HRESULT_FROM_WIN32(WAIT_TIMEOUT) if
+                      the queue stayed empty.
+
+********************************************************************/
+HRESULT DAPI QueSegmentedDequeue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __out void** ppvValue,
+    __in DWORD dwTimeout
+    );
+
+/********************************************************************
+QueSegmentedDestroy - Releases any values left in the queue and frees
+                      it. No other thread may be using the queue.
+
+********************************************************************/
+void DAPI QueSegmentedDestroy(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __in_opt PFNQUEUTIL_QUEUE_RELEASE_VALUE pfnReleaseValue,
+    __in_opt void* pvContext
+    );
+
 #ifdef __cplusplus
 }
 #endif
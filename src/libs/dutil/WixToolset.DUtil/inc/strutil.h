@@ -17,6 +17,13 @@ extern "C" {
 #define DeclareConstBSTR(bstr_const, wz) const WCHAR bstr_const[] = { 0x00, 0x00, sizeof(wz)-sizeof(WCHAR), 0x00, wz }
 #define UseConstBSTR(bstr_const) const_cast<BSTR>(bstr_const + 4)
 
+typedef enum STR_SIMD_LEVEL
+{
+    STR_SIMD_LEVEL_NONE,
+    STR_SIMD_LEVEL_SSE2,
+    STR_SIMD_LEVEL_AVX2,
+} STR_SIMD_LEVEL;
+
 HRESULT DAPI StrAlloc(
     __deref_out_ecount_part(cch, 0) LPWSTR* ppwz,
     __in SIZE_T cch
@@ -242,6 +249,35 @@ LPCWSTR DAPI wcsistr(
     __in_z LPCWSTR wzCharSet
     );
 
+STR_SIMD_LEVEL DAPI StrGetSimdLevel(
+    );
+STR_SIMD_LEVEL DAPI StrSetSimdLevel(
+    __in STR_SIMD_LEVEL level
+    );
+LPCWSTR DAPI StrFindChar(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in WCHAR wch
+    );
+LPCWSTR DAPI StrFindCharInSet(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchSet) LPCWSTR wzSet,
+    __in SIZE_T cchSet
+    );
+LPCWSTR DAPI StrFindString(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchFind) LPCWSTR wzFind,
+    __in SIZE_T cchFind
+    );
+LPCWSTR DAPI StrFindStringIgnoreCase(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchFind) LPCWSTR wzFind,
+    __in SIZE_T cchFind
+    );
+
 HRESULT DAPI StrStringToInt16(
     __in_z LPCWSTR wzIn,
     __in DWORD cchIn,
@@ -6,6 +6,26 @@
 extern "C" {
 #endif
 
+#define ReleaseThreadPool(p) if (p) { ThrdPoolDestroy(p); }
+#define ReleaseNullThreadPool(p) if (p) { ThrdPoolDestroy(p); p = NULL; }
+#define ReleaseThreadGroup(g) if (g) { ThrdGroupDestroy(g); }
+#define ReleaseNullThreadGroup(g) if (g) { ThrdGroupDestroy(g); g = NULL; }
+
+typedef void* THRD_POOL_HANDLE;
+typedef void* THRD_GROUP_HANDLE;
+
+typedef enum THRD_PRIORITY
+{
+    THRD_PRIORITY_HIGH,
+    THRD_PRIORITY_NORMAL,
+    THRD_PRIORITY_LOW,
+} THRD_PRIORITY;
+
+typedef HRESULT(CALLBACK* PFN_THRDPOOL_WORK)(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+
 /********************************************************************
  ThrdWaitForCompletion - waits for thread to complete and gets return code.
 
@@ -16,6 +36,119 @@ HRESULT DAPI ThrdWaitForCompletion(
     __out_opt DWORD* pdwReturnCode
     );
 
+/********************************************************************
+ ThrdPoolInitialize - creates the shared thread pool used when a group
+                      is created without a pool. Calls are reference
+                      counted and must be balanced with
+                      ThrdPoolUninitialize. A thread count of zero
+                      sizes the pool to the number of processors.
+
+ *******************************************************************/
+HRESULT DAPI ThrdPoolInitialize(
+    __in DWORD cThreads
+    );
+
+/********************************************************************
+ ThrdPoolUninitialize - destroys the shared thread pool when the last
+                        ThrdPoolInitialize is balanced.
+
+ *******************************************************************/
+void DAPI ThrdPoolUninitialize(
+    );
+
+/********************************************************************
+ ThrdPoolCreate - creates a thread pool. Each worker has its own deque
+                  per priority and idle workers steal from the others.
+                  A thread count of zero sizes the pool to the number
+                  of processors.
+
+ *******************************************************************/
+HRESULT DAPI ThrdPoolCreate(
+    __in DWORD cThreads,
+    __out THRD_POOL_HANDLE* phPool
+    );
+
+/********************************************************************
+ ThrdPoolGetThreadCount - returns the number of worker threads in the
+                          pool, or the shared pool if hPool is NULL.
+
+ *******************************************************************/
+DWORD DAPI ThrdPoolGetThreadCount(
+    __in_opt THRD_POOL_HANDLE hPool
+    );
+
+/********************************************************************
+ ThrdPoolDestroy - stops the worker threads and frees the pool. Work
+                   that has not started is completed without running
+                   and its group reports that it was cancelled.
+
+ *******************************************************************/
+void DAPI ThrdPoolDestroy(
+    __in THRD_POOL_HANDLE hPool
+    );
+
+/********************************************************************
+ ThrdGroupCreate - creates a group to submit related work to and wait
+                   on. Uses the shared pool if hPool is NULL.
+
+ *******************************************************************/
+HRESULT DAPI ThrdGroupCreate(
+    __in_opt THRD_POOL_HANDLE hPool,
+    __out THRD_GROUP_HANDLE* phGroup
+    );
+
+/********************************************************************
+ ThrdGroupSubmit - queues work to run on the group's pool. Work
+                   submitted from a worker thread goes to that
+                   worker's own deque, so nested work stays local
+                   until another worker steals it. Higher priority
+                   work is always taken before lower priority work.
+
+ *******************************************************************/
+HRESULT DAPI ThrdGroupSubmit(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in THRD_PRIORITY priority,
+    __in PFN_THRDPOOL_WORK pfnWork,
+    __in_opt LPVOID pvContext
+    );
+
+/********************************************************************
+ ThrdGroupWait - waits for all work in the group to complete. Returns
+                 the first failure returned by the group's work,
+                 HRESULT_FROM_WIN32(ERROR_CANCELLED) if the group was
+                 cancelled, or HRESULT_FROM_WIN32(WAIT_TIMEOUT).
+                 A worker thread waiting on a group runs queued work
+                 while it waits instead of blocking.
+
+ *******************************************************************/
+HRESULT DAPI ThrdGroupWait(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in DWORD dwTimeout
+    );
+
+/********************************************************************
+ ThrdGroupCancel - prevents work in the group that has not started
+                   from running. Running work can poll
+                   ThrdGroupIsCancelled to stop early.
+
+ *******************************************************************/
+void DAPI ThrdGroupCancel(
+    __in THRD_GROUP_HANDLE hGroup
+    );
+
+BOOL DAPI ThrdGroupIsCancelled(
+    __in THRD_GROUP_HANDLE hGroup
+    );
+
+/********************************************************************
+ ThrdGroupDestroy - cancels work that has not started, waits for
+                    running work and frees the group.
+
+ *******************************************************************/
+void DAPI ThrdGroupDestroy(
+    __in THRD_GROUP_HANDLE hGroup
+    );
+
 #ifdef __cplusplus
 }
 #endif
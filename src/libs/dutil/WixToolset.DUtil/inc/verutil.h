@@ -32,8 +32,48 @@ typedef struct _VERUTIL_VERSION
     BOOL fHasMinor;
     BOOL fHasPatch;
     BOOL fHasRevision;
+
+    // Set when the version has no release labels, is valid and every part fits in 16 bits,
+    // so that it can be compared to other packed versions with a single integer compare.
+    BOOL fPacked;
+    DWORD64 qwPacked;
+
+    // Non-zero only for versions owned by the version cache, see VerCacheParseVersion.
+    volatile LONG cReferences;
 } VERUTIL_VERSION;
 
+/********************************************************************
+ VerCacheInitialize - initializes the process-wide cache of parsed versions
+                      used by VerCacheParseVersion.
+
+*******************************************************************/
+HRESULT DAPI VerCacheInitialize(
+    __in DWORD cExpectedVersions
+    );
+
+/********************************************************************
+ VerCacheUninitialize - releases the cache's reference to every cached version.
+                        Versions still referenced by callers remain valid.
+
+*******************************************************************/
+void DAPI VerCacheUninitialize(
+    );
+
+/*******************************************************************
+ VerCacheParseVersion - returns a shared, immutable Verutil version for the string,
+                        parsing it only the first time it is seen. The returned
+                        version must still be freed with VerFreeVersion and
+                        must not be modified. Falls back to VerParseVersion
+                        when the cache is not initialized.
+
+*******************************************************************/
+HRESULT DAPI VerCacheParseVersion(
+    __in_z LPCWSTR wzVersion,
+    __in SIZE_T cchVersion,
+    __in BOOL fStrict,
+    __out VERUTIL_VERSION** ppVersion
+    );
+
 /*******************************************************************
  VerCompareParsedVersions - compares the Verutil versions.
 
@@ -57,7 +97,8 @@ HRESULT DAPI VerCompareStringVersions(
     );
 
 /********************************************************************
- VerCopyVersion - copies the given Verutil version.
+ VerCopyVersion - copies the given Verutil version. Cached versions are
+                  shared by reference instead of copied.
 
 *******************************************************************/
 HRESULT DAPI VerCopyVersion(
@@ -66,7 +107,8 @@ HRESULT DAPI VerCopyVersion(
     );
 
 /********************************************************************
- VerFreeVersion - frees any memory associated with a Verutil version.
+ VerFreeVersion - frees any memory associated with a Verutil version, or
+                  releases a reference to a cached version.
 
 *******************************************************************/
 void DAPI VerFreeVersion(
@@ -256,6 +256,11 @@ void DAPI WiuFunctionOverride(
     __in_opt PFN_MSISETEXTERNALUIRECORD pfnMsiSetExternalUIRecord,
     __in_opt PFN_MSISOURCELISTADDSOURCEEXW pfnMsiSourceListAddSourceExW
     );
+void DAPI WiuPatchFunctionOverride(
+    __in_opt PFN_MSIENUMPRODUCTSEXW pfnMsiEnumProductsExW,
+    __in_opt PFN_MSIDETERMINEAPPLICABLEPATCHESW pfnMsiDetermineApplicablePatchesW,
+    __in_opt PFN_MSIDETERMINEPATCHSEQUENCEW pfnMsiDeterminePatchSequenceW
+    );
 HRESULT DAPI WiuGetComponentPath(
     __in_z LPCWSTR wzProductCode,
     __in_z LPCWSTR wzComponentId,
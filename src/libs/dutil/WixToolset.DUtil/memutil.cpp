@@ -252,7 +252,6 @@ extern "C" HRESULT DAPI MemInsertIntoArray(
     )
 {
     HRESULT hr = S_OK;
-    DWORD i;
     BYTE *pbArray = NULL;
 
     if (0 == cInsertItems)
@@ -264,9 +263,11 @@ extern "C" HRESULT DAPI MemInsertIntoArray(
     MemExitOnFailure(hr, "Failed to resize array while inserting items");
 
     pbArray = reinterpret_cast<BYTE *>(*ppvArray);
-    for (i = cExistingArray + cInsertItems - 1; i > dwInsertIndex; --i)
+
+    // Shift everything after the insert point in one move.
+    if (dwInsertIndex < cExistingArray)
     {
-        memcpy_s(pbArray + i * cbArrayType, cbArrayType, pbArray + (i - 1) * cbArrayType, cbArrayType);
+        memmove_s(pbArray + (dwInsertIndex + cInsertItems) * cbArrayType, (cExistingArray - dwInsertIndex) * cbArrayType, pbArray + dwInsertIndex * cbArrayType, (cExistingArray - dwInsertIndex) * cbArrayType);
     }
 
     // Zero out the newly-inserted items
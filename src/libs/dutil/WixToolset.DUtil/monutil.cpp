@@ -27,6 +27,7 @@ const int MON_THREAD_INIT_RETRY_PERIOD_IN_MS = 10;
 const int MON_THREAD_NETWORK_FAIL_RETRY_IN_MS = 1000*60; // if we know we failed to connect, retry every minute
 const int MON_THREAD_NETWORK_SUCCESSFUL_RETRY_IN_MS = 1000*60*20; // if we're just checking for remote servers dieing, check much less frequently
 const int MON_THREAD_WAIT_REMOVE_DEVICE = 5000;
+const DWORD MON_WAITER_MESSAGE_SEGMENT_SIZE = 64;
 const LPCWSTR MONUTIL_WINDOW_CLASS = L"MonUtilClass";
 
 enum MON_MESSAGE
@@ -34,6 +35,7 @@ enum MON_MESSAGE
     MON_MESSAGE_ADD = WM_APP + 1,
     MON_MESSAGE_REMOVE,
     MON_MESSAGE_REMOVED, // Sent by waiter thread back to coordinator thread to indicate a remove occurred
+    MON_MESSAGE_WAITER_STOPPED, // Sent by waiter thread back to coordinator thread as the last thing it does before exiting, so the coordinator can free its context without blocking
     MON_MESSAGE_NETWORK_WAIT_FAILED, // Sent by waiter thread back to coordinator thread to indicate a network wait failed. Coordinator thread will periodically trigger retries (via MON_MESSAGE_NETWORK_STATUS_UPDATE messages).
     MON_MESSAGE_NETWORK_WAIT_SUCCEEDED, // Sent by waiter thread back to coordinator thread to indicate a previously failing network wait is now succeeding. Coordinator thread will stop triggering retries if no other failing waits exist.
     MON_MESSAGE_NETWORK_STATUS_UPDATE, // Some change to network connectivity occurred (a network connection was connected or disconnected for example)
@@ -123,13 +125,25 @@ struct MON_REMOVE_MESSAGE
     };
 };
 
+// Message sent from the coordinator thread to a waiter thread through the waiter's message queue
+struct MON_WAITER_MESSAGE
+{
+    UINT uMessage;
+    WPARAM wParam;
+    LPARAM lParam;
+};
+
 struct MON_WAITER_CONTEXT
 {
     DWORD dwCoordinatorThreadId;
 
     HANDLE hWaiterThread;
     DWORD dwWaiterThreadId;
-    BOOL fWaiterThreadMessageQueueInitialized;
+
+    // Messages from the coordinator thread, the first handle in rgHandles is set after each one is queued
+    QUEUTIL_SEGMENTED_HANDLE hMessages;
+    // Number of queued messages of each type, so repeated status updates can be collapsed into the last one
+    volatile LONG rgcQueuedMessages[MON_MESSAGE_STOP - MON_MESSAGE_ADD + 1];
 
     // Callbacks
     PFN_MONGENERAL vpfMonGeneral;
@@ -209,6 +223,10 @@ struct MON_STRUCT
     // Waiter thread array
     MON_WAITER_INFO *rgWaiterThreads;
     DWORD cWaiterThreads;
+
+    // Waiters that were told to stop but haven't reported MON_MESSAGE_WAITER_STOPPED yet
+    MON_WAITER_CONTEXT **rgpStoppingWaiters;
+    DWORD cStoppingWaiters;
 };
 
 const int MON_HANDLE_BYTES = sizeof(MON_STRUCT);
@@ -281,6 +299,20 @@ static HRESULT UpdateWaitStatus(
     __in DWORD dwRequestIndex,
     __out_opt DWORD *pdwNewRequestIndex
     );
+static HRESULT SendWaiterMessage(
+    __in MON_WAITER_CONTEXT *pWaiterContext,
+    __in UINT uMessage,
+    __in WPARAM wParam,
+    __in LPARAM lParam
+    );
+static void CALLBACK WaiterMessageRelease(
+    __in void *pvValue,
+    __in void *pvContext
+    );
+// Waits for the waiter thread to exit (it must already have been told to stop) and frees the context
+static void WaiterContextDestroy(
+    __in_opt MON_WAITER_CONTEXT *pWaiterContext
+    );
 
 extern "C" HRESULT DAPI MonCreate(
     __out_bcount(MON_HANDLE_BYTES) MON_HANDLE *pHandle,
@@ -640,9 +672,9 @@ static DWORD WINAPI CoordinatorThread(
     )
 {
     HRESULT hr = S_OK;
+    HRESULT hrTemp = S_OK;
     MSG msg = { };
     DWORD dwThreadIndex = DWORD_MAX;
-    DWORD dwRetries;
     DWORD dwFailingNetworkWaits = 0;
     MON_WAITER_CONTEXT *pWaiterContext = NULL;
     MON_REMOVE_MESSAGE *pRemoveMessage = NULL;
@@ -721,36 +753,20 @@ static DWORD WINAPI CoordinatorThread(
                     pWaiterContext->rgHandles[0] = ::CreateEventW(NULL, FALSE, FALSE, NULL);
                     MonExitOnNullWithLastError(pWaiterContext->rgHandles[0], hr, "Failed to create general event");
 
+                    // The queue exists before the thread does, so unlike a thread message queue there's nothing to wait for
+                    hr = QueSegmentedCreate(MON_WAITER_MESSAGE_SEGMENT_SIZE, &pWaiterContext->hMessages);
+                    MonExitOnFailure(hr, "Failed to create waiter thread message queue");
+
                     pWaiterContext->hWaiterThread = ::CreateThread(NULL, 0, WaiterThread, pWaiterContext, 0, &pWaiterContext->dwWaiterThreadId);
                     if (!pWaiterContext->hWaiterThread)
                     {
                         MonExitWithLastError(hr, "Failed to create waiter thread.");
                     }
-
-                    dwRetries = MON_THREAD_INIT_RETRIES;
-                    while (!pWaiterContext->fWaiterThreadMessageQueueInitialized && 0 < dwRetries)
-                    {
-                        ::Sleep(MON_THREAD_INIT_RETRY_PERIOD_IN_MS);
-                        --dwRetries;
-                    }
-
-                    if (0 == dwRetries)
-                    {
-                        hr = E_UNEXPECTED;
-                        MonExitOnFailure(hr, "Waiter thread apparently never initialized its message queue.");
-                    }
                 }
 
                 ++pm->rgWaiterThreads[dwThreadIndex].cMonitorCount;
-                if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_ADD, msg.wParam, 0))
-                {
-                    MonExitWithLastError(hr, "Failed to send message to waiter thread to add monitor");
-                }
-
-                if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                {
-                    MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming message");
-                }
+                hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_ADD, msg.wParam, 0);
+                MonExitOnFailure(hr, "Failed to send message to waiter thread to add monitor");
                 break;
 
             case MON_MESSAGE_REMOVE:
@@ -765,16 +781,9 @@ static DWORD WINAPI CoordinatorThread(
                     hr = DuplicateRemoveMessage(pRemoveMessage, &pTempRemoveMessage);
                     MonExitOnFailure(hr, "Failed to duplicate remove message");
 
-                    if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_REMOVE, reinterpret_cast<WPARAM>(pTempRemoveMessage), msg.lParam))
-                    {
-                        MonExitWithLastError(hr, "Failed to send message to waiter thread to add monitor");
-                    }
+                    hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_REMOVE, reinterpret_cast<WPARAM>(pTempRemoveMessage), msg.lParam);
+                    MonExitOnFailure(hr, "Failed to send message to waiter thread to remove monitor");
                     pTempRemoveMessage = NULL;
-
-                    if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                    {
-                        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming remove message");
-                    }
                 }
                 MonRemoveMessageDestroy(pRemoveMessage);
                 pRemoveMessage = NULL;
@@ -789,10 +798,20 @@ static DWORD WINAPI CoordinatorThread(
                         --pm->rgWaiterThreads[i].cMonitorCount;
                         if (0 == pm->rgWaiterThreads[i].cMonitorCount)
                         {
-                            if (!::PostThreadMessageW(pm->rgWaiterThreads[i].pWaiterContext->dwWaiterThreadId, MON_MESSAGE_STOP, msg.wParam, msg.lParam))
-                            {
-                                MonExitWithLastError(hr, "Failed to send message to waiter thread to stop");
-                            }
+                            pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
+
+                            // Joining the waiter here would stop this thread from serving every other waiter until it exits,
+                            // so remember it and free it when it reports that it stopped
+                            hr = MemEnsureArraySizeForNewItems(reinterpret_cast<void **>(&pm->rgpStoppingWaiters), pm->cStoppingWaiters, 1, sizeof(MON_WAITER_CONTEXT *), MON_THREAD_GROWTH);
+                            MonExitOnFailure(hr, "Failed to allocate array of stopping waiter threads");
+
+                            hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_STOP, msg.wParam, msg.lParam);
+                            MonExitOnFailure(hr, "Failed to send message to waiter thread to stop");
+
+                            pm->rgpStoppingWaiters[pm->cStoppingWaiters] = pWaiterContext;
+                            ++pm->cStoppingWaiters;
+                            pWaiterContext = NULL;
+
                             MemRemoveFromArray(reinterpret_cast<LPVOID>(pm->rgWaiterThreads), i, 1, pm->cWaiterThreads, sizeof(MON_WAITER_INFO), TRUE);
                             --pm->cWaiterThreads;
                             --i; // reprocess this index in the for loop, which will now contain the item after the one we removed
@@ -801,6 +820,21 @@ static DWORD WINAPI CoordinatorThread(
                 }
                 break;
 
+            case MON_MESSAGE_WAITER_STOPPED:
+                for (DWORD i = 0; i < pm->cStoppingWaiters; ++i)
+                {
+                    if (pm->rgpStoppingWaiters[i] == reinterpret_cast<MON_WAITER_CONTEXT *>(msg.wParam))
+                    {
+                        // The waiter posted this right before returning, so this doesn't wait for long
+                        WaiterContextDestroy(pm->rgpStoppingWaiters[i]);
+
+                        MemRemoveFromArray(reinterpret_cast<LPVOID>(pm->rgpStoppingWaiters), i, 1, pm->cStoppingWaiters, sizeof(MON_WAITER_CONTEXT *), TRUE);
+                        --pm->cStoppingWaiters;
+                        break;
+                    }
+                }
+                break;
+
             case MON_MESSAGE_NETWORK_WAIT_FAILED:
                 if (0 == dwFailingNetworkWaits)
                 {
@@ -834,15 +868,8 @@ static DWORD WINAPI CoordinatorThread(
                 {
                     pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
 
-                    if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_NETWORK_STATUS_UPDATE, 0, 0))
-                    {
-                        MonExitWithLastError(hr, "Failed to send message to waiter thread to notify of network status update");
-                    }
-
-                    if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                    {
-                        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming network status update message");
-                    }
+                    hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_NETWORK_STATUS_UPDATE, 0, 0);
+                    MonExitOnFailure(hr, "Failed to send message to waiter thread to notify of network status update");
                 }
                 break;
 
@@ -852,15 +879,8 @@ static DWORD WINAPI CoordinatorThread(
                 {
                     pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
 
-                    if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, msg.wParam == uTimerFailedNetworkRetry ? MON_MESSAGE_NETWORK_RETRY_FAILED_NETWORK_WAITS : MON_MESSAGE_NETWORK_RETRY_SUCCESSFUL_NETWORK_WAITS, 0, 0))
-                    {
-                        MonExitWithLastError(hr, "Failed to send message to waiter thread to notify of network status update");
-                    }
-
-                    if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                    {
-                        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming network status update message");
-                    }
+                    hr = SendWaiterMessage(pWaiterContext, msg.wParam == uTimerFailedNetworkRetry ? MON_MESSAGE_NETWORK_RETRY_FAILED_NETWORK_WAITS : MON_MESSAGE_NETWORK_RETRY_SUCCESSFUL_NETWORK_WAITS, 0, 0);
+                    MonExitOnFailure(hr, "Failed to send message to waiter thread to notify of network status update");
                 }
                 break;
 
@@ -876,15 +896,8 @@ static DWORD WINAPI CoordinatorThread(
                 {
                     pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
 
-                    if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_DRIVE_STATUS_UPDATE, msg.wParam, msg.lParam))
-                    {
-                        MonExitWithLastError(hr, "Failed to send message to waiter thread to notify of drive status update");
-                    }
-
-                    if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                    {
-                        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming drive status update message");
-                    }
+                    hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_DRIVE_STATUS_UPDATE, msg.wParam, msg.lParam);
+                    MonExitOnFailure(hr, "Failed to send message to waiter thread to notify of drive status update");
                 }
                 break;
 
@@ -919,16 +932,12 @@ LExit:
     for (DWORD i = 0; i < pm->cWaiterThreads; ++i)
     {
         pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
-        if (NULL != pWaiterContext->rgHandles[0])
+        if (pWaiterContext && pWaiterContext->hWaiterThread)
         {
-            if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_STOP, msg.wParam, msg.lParam))
+            hrTemp = SendWaiterMessage(pWaiterContext, MON_MESSAGE_STOP, msg.wParam, msg.lParam);
+            if (FAILED(hrTemp))
             {
-                TraceError(HRESULT_FROM_WIN32(::GetLastError()), "Failed to send message to waiter thread to stop");
-            }
-
-            if (!::SetEvent(pWaiterContext->rgHandles[0]))
-            {
-                TraceError(HRESULT_FROM_WIN32(::GetLastError()), "Failed to set event to notify waiter thread of incoming message");
+                TraceError(hrTemp, "Failed to send message to waiter thread to stop");
             }
         }
     }
@@ -941,19 +950,16 @@ LExit:
     // Now confirm they're actually shut down before returning
     for (DWORD i = 0; i < pm->cWaiterThreads; ++i)
     {
-        pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
-        if (NULL != pWaiterContext->hWaiterThread)
-        {
-            ::WaitForSingleObject(pWaiterContext->hWaiterThread, INFINITE);
-            ::CloseHandle(pWaiterContext->hWaiterThread);
-        }
-
-        // Waiter thread can't release these, because coordinator thread uses it to try communicating with waiter thread
-        ReleaseHandle(pWaiterContext->rgHandles[0]);
-        ReleaseMem(pWaiterContext->rgHandles);
+        WaiterContextDestroy(pm->rgWaiterThreads[i].pWaiterContext);
+    }
 
-        ReleaseMem(pWaiterContext);
+    // Including the ones that were already stopping
+    for (DWORD i = 0; i < pm->cStoppingWaiters; ++i)
+    {
+        WaiterContextDestroy(pm->rgpStoppingWaiters[i]);
     }
+    ReleaseNullMem(pm->rgpStoppingWaiters);
+    pm->cStoppingWaiters = 0;
 
     if (FAILED(hr))
     {
@@ -1105,10 +1111,10 @@ static DWORD WINAPI WaiterThread(
     BOOL fAgain = FALSE;
     BOOL fContinue = TRUE;
     BOOL fNotify = FALSE;
-    BOOL fRet = FALSE;
     BOOL fTimedOut = FALSE;
     DWORD dwSignaledIndex = 0;
-    MSG msg = { };
+    MON_WAITER_MESSAGE *pMessage = NULL;
+    LONG cQueuedAfterMessage = 0;
     MON_ADD_MESSAGE *pAddMessage = NULL;
     MON_REMOVE_MESSAGE *pRemoveMessage = NULL;
     MON_WAITER_CONTEXT *pWaiterContext = reinterpret_cast<MON_WAITER_CONTEXT *>(pvContext);
@@ -1124,10 +1130,6 @@ static DWORD WINAPI WaiterThread(
     bool rgfProcessedIndex[MON_MAX_MONITORS_PER_THREAD + 1] = { };
     MON_INTERNAL_TEMPORARY_WAIT * pInternalWait = NULL;
 
-    // Ensure the thread has a message queue
-    ::PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
-    pWaiterContext->fWaiterThreadMessageQueueInitialized = TRUE;
-
     do
     {
         hr = AppWaitForMultipleObjects(pWaiterContext->cHandles - pWaiterContext->cRequestsFailing, pWaiterContext->rgHandles, FALSE, pWaiterContext->cRequestsPending > 0 ? dwWait : INFINITE, &dwSignaledIndex);
@@ -1141,14 +1143,24 @@ static DWORD WINAPI WaiterThread(
         {
             do
             {
-                fRet = ::PeekMessage(&msg, reinterpret_cast<HWND>(-1), 0, 0, PM_REMOVE);
-                fAgain = fRet;
-                if (fRet)
+                ReleaseNullMem(pMessage);
+
+                hr = QueSegmentedTryDequeue(pWaiterContext->hMessages, reinterpret_cast<void **>(&pMessage));
+                if (E_NOMOREITEMS == hr)
                 {
-                    switch (msg.message)
+                    hr = S_OK;
+                }
+                MonExitOnFailure(hr, "Failed to read message from coordinator thread");
+
+                fAgain = NULL != pMessage;
+                if (fAgain)
+                {
+                    cQueuedAfterMessage = ::InterlockedDecrement(pWaiterContext->rgcQueuedMessages + (pMessage->uMessage - MON_MESSAGE_ADD));
+
+                    switch (pMessage->uMessage)
                     {
                         case MON_MESSAGE_ADD:
-                            pAddMessage = reinterpret_cast<MON_ADD_MESSAGE *>(msg.wParam);
+                            pAddMessage = reinterpret_cast<MON_ADD_MESSAGE *>(pMessage->wParam);
 
                             // Don't just blindly put it at the end of the array - it must be before any failing requests
                             // for WaitForMultipleObjects() to succeed
@@ -1179,7 +1191,7 @@ static DWORD WINAPI WaiterThread(
                             break;
 
                         case MON_MESSAGE_REMOVE:
-                            pRemoveMessage = reinterpret_cast<MON_REMOVE_MESSAGE *>(msg.wParam);
+                            pRemoveMessage = reinterpret_cast<MON_REMOVE_MESSAGE *>(pMessage->wParam);
 
                             // Find the request to remove
                             hr = FindRequestIndex(pWaiterContext, pRemoveMessage, &dwRequestIndex);
@@ -1201,7 +1213,7 @@ static DWORD WINAPI WaiterThread(
                             break;
 
                         case MON_MESSAGE_NETWORK_RETRY_FAILED_NETWORK_WAITS:
-                            if (::PeekMessage(&msg, NULL, MON_MESSAGE_NETWORK_RETRY_FAILED_NETWORK_WAITS, MON_MESSAGE_NETWORK_RETRY_FAILED_NETWORK_WAITS, PM_NOREMOVE))
+                            if (0 < cQueuedAfterMessage)
                             {
                                 // If there is another a pending retry failed wait message, skip this one
                                 continue;
@@ -1236,7 +1248,7 @@ static DWORD WINAPI WaiterThread(
                         break;
 
                         case MON_MESSAGE_NETWORK_RETRY_SUCCESSFUL_NETWORK_WAITS:
-                            if (::PeekMessage(&msg, NULL, MON_MESSAGE_NETWORK_RETRY_SUCCESSFUL_NETWORK_WAITS, MON_MESSAGE_NETWORK_RETRY_SUCCESSFUL_NETWORK_WAITS, PM_NOREMOVE))
+                            if (0 < cQueuedAfterMessage)
                             {
                                 // If there is another a pending retry successful wait message, skip this one
                                 continue;
@@ -1271,7 +1283,7 @@ static DWORD WINAPI WaiterThread(
                             break;
 
                         case MON_MESSAGE_NETWORK_STATUS_UPDATE:
-                            if (::PeekMessage(&msg, NULL, MON_MESSAGE_NETWORK_STATUS_UPDATE, MON_MESSAGE_NETWORK_STATUS_UPDATE, PM_NOREMOVE))
+                            if (0 < cQueuedAfterMessage)
                             {
                                 // If there is another a pending network status update message, skip this one
                                 continue;
@@ -1315,10 +1327,10 @@ static DWORD WINAPI WaiterThread(
                                     continue;
                                 }
 
-                                if (MON_DIRECTORY == pWaiterContext->rgRequests[i].type && pWaiterContext->rgRequests[i].sczOriginalPathRequest[0] == static_cast<WCHAR>(msg.wParam))
+                                if (MON_DIRECTORY == pWaiterContext->rgRequests[i].type && pWaiterContext->rgRequests[i].sczOriginalPathRequest[0] == static_cast<WCHAR>(pMessage->wParam))
                                 {
                                     // Failures here get recorded in the request's status
-                                    if (static_cast<BOOL>(msg.lParam))
+                                    if (static_cast<BOOL>(pMessage->lParam))
                                     {
                                         hrTemp = InitiateWait(pWaiterContext->rgRequests + i, pWaiterContext->rgHandles + i + 1);
                                     }
@@ -1343,10 +1355,10 @@ static DWORD WINAPI WaiterThread(
                             break;
 
                         case MON_MESSAGE_DRIVE_QUERY_REMOVE:
-                            pInternalWait = reinterpret_cast<MON_INTERNAL_TEMPORARY_WAIT *>(msg.wParam);
+                            pInternalWait = reinterpret_cast<MON_INTERNAL_TEMPORARY_WAIT *>(pMessage->wParam);
                             // Only do any work if message is not yet out of date
                             // While it could become out of date while doing this processing, sending thread will check response to guard against this
-                            if (pInternalWait->dwSendIteration == static_cast<DWORD>(msg.lParam))
+                            if (pInternalWait->dwSendIteration == static_cast<DWORD>(pMessage->lParam))
                             {
                                 for (DWORD i = 0; i < pWaiterContext->cRequests; ++i)
                                 {
@@ -1362,7 +1374,7 @@ static DWORD WINAPI WaiterThread(
                                         pWaiterContext->rgHandles[i + 1] = INVALID_HANDLE_VALUE;
 
                                         // Reply to unblock our reply to the remove request
-                                        pInternalWait->dwReceiveIteration = static_cast<DWORD>(msg.lParam);
+                                        pInternalWait->dwReceiveIteration = static_cast<DWORD>(pMessage->lParam);
                                         if (!::SetEvent(pInternalWait->hWait))
                                         {
                                             TraceError(HRESULT_FROM_WIN32(::GetLastError()), "Failed to set event to notify coordinator thread that removable device handle was released, this could be due to wndproc no longer waiting for waiter thread's response");
@@ -1385,7 +1397,7 @@ static DWORD WINAPI WaiterThread(
                             Trace(REPORT_DEBUG, "Waiter thread was told to stop");
                             fAgain = FALSE;
                             fContinue = FALSE;
-                            ExitFunction1(hr = static_cast<HRESULT>(msg.wParam));
+                            ExitFunction1(hr = static_cast<HRESULT>(pMessage->wParam));
 
                         default:
                             Assert(false);
@@ -1499,6 +1511,7 @@ static DWORD WINAPI WaiterThread(
 
 LExit:
     ReleaseStr(sczDirectory);
+    ReleaseMem(pMessage);
     MonAddMessageDestroy(pAddMessage);
     MonRemoveMessageDestroy(pRemoveMessage);
 
@@ -1535,6 +1548,12 @@ LExit:
         }
     }
 
+    // Must be last, the coordinator frees the context once it gets this message
+    if (!::PostThreadMessageW(pWaiterContext->dwCoordinatorThreadId, MON_MESSAGE_WAITER_STOPPED, reinterpret_cast<WPARAM>(pWaiterContext), 0))
+    {
+        TraceError(HRESULT_FROM_WIN32(::GetLastError()), "Failed to send message to coordinator thread that waiter thread stopped.");
+    }
+
     return hr;
 }
 
@@ -1809,15 +1828,8 @@ static LRESULT CALLBACK MonWndProc(
                 {
                     pWaiterContext = pm->rgWaiterThreads[i].pWaiterContext;
 
-                    if (!::PostThreadMessageW(pWaiterContext->dwWaiterThreadId, MON_MESSAGE_DRIVE_QUERY_REMOVE, reinterpret_cast<WPARAM>(&pm->internalWait), static_cast<LPARAM>(pm->internalWait.dwSendIteration)))
-                    {
-                        MonExitWithLastError(hr, "Failed to send message to waiter thread to notify of drive query remove");
-                    }
-
-                    if (!::SetEvent(pWaiterContext->rgHandles[0]))
-                    {
-                        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming drive query remove message");
-                    }
+                    hr = SendWaiterMessage(pWaiterContext, MON_MESSAGE_DRIVE_QUERY_REMOVE, reinterpret_cast<WPARAM>(&pm->internalWait), static_cast<LPARAM>(pm->internalWait.dwSendIteration));
+                    MonExitOnFailure(hr, "Failed to send message to waiter thread to notify of drive query remove");
                 }
 
                 hr = AppWaitForSingleObject(pm->internalWait.hWait, MON_THREAD_WAIT_REMOVE_DEVICE);
@@ -2004,3 +2016,88 @@ static HRESULT UpdateWaitStatus(
 LExit:
     return hr;
 }
+
+static HRESULT SendWaiterMessage(
+    __in MON_WAITER_CONTEXT *pWaiterContext,
+    __in UINT uMessage,
+    __in WPARAM wParam,
+    __in LPARAM lParam
+    )
+{
+    HRESULT hr = S_OK;
+    MON_WAITER_MESSAGE *pMessage = NULL;
+
+    pMessage = reinterpret_cast<MON_WAITER_MESSAGE *>(MemAlloc(sizeof(MON_WAITER_MESSAGE), TRUE));
+    MonExitOnNull(pMessage, hr, E_OUTOFMEMORY, "Failed to allocate memory for waiter message");
+
+    pMessage->uMessage = uMessage;
+    pMessage->wParam = wParam;
+    pMessage->lParam = lParam;
+
+    // Count the message before it can be seen so the waiter never decrements below zero
+    ::InterlockedIncrement(pWaiterContext->rgcQueuedMessages + (uMessage - MON_MESSAGE_ADD));
+
+    hr = QueSegmentedEnqueue(pWaiterContext->hMessages, pMessage);
+    if (FAILED(hr))
+    {
+        ::InterlockedDecrement(pWaiterContext->rgcQueuedMessages + (uMessage - MON_MESSAGE_ADD));
+        MonExitOnFailure(hr, "Failed to queue message for waiter thread");
+    }
+    pMessage = NULL;
+
+    if (!::SetEvent(pWaiterContext->rgHandles[0]))
+    {
+        MonExitWithLastError(hr, "Failed to set event to notify waiter thread of incoming message");
+    }
+
+LExit:
+    ReleaseMem(pMessage);
+
+    return hr;
+}
+
+static void CALLBACK WaiterMessageRelease(
+    __in void *pvValue,
+    __in void * /*pvContext*/
+    )
+{
+    MON_WAITER_MESSAGE *pMessage = reinterpret_cast<MON_WAITER_MESSAGE *>(pvValue);
+
+    // Messages that were never processed still own what they point to
+    switch (pMessage->uMessage)
+    {
+    case MON_MESSAGE_ADD:
+        MonAddMessageDestroy(reinterpret_cast<MON_ADD_MESSAGE *>(pMessage->wParam));
+        break;
+    case MON_MESSAGE_REMOVE:
+        MonRemoveMessageDestroy(reinterpret_cast<MON_REMOVE_MESSAGE *>(pMessage->wParam));
+        break;
+    }
+
+    MemFree(pMessage);
+}
+
+static void WaiterContextDestroy(
+    __in_opt MON_WAITER_CONTEXT *pWaiterContext
+    )
+{
+    if (pWaiterContext)
+    {
+        if (pWaiterContext->hWaiterThread)
+        {
+            ::WaitForSingleObject(pWaiterContext->hWaiterThread, INFINITE);
+            ::CloseHandle(pWaiterContext->hWaiterThread);
+        }
+
+        // Waiter thread can't release these, because coordinator thread uses them to try communicating with waiter thread
+        ReleaseSegmentedQueue(pWaiterContext->hMessages, WaiterMessageRelease, NULL);
+
+        if (pWaiterContext->rgHandles)
+        {
+            ReleaseHandle(pWaiterContext->rgHandles[0]);
+            MemFree(pWaiterContext->rgHandles);
+        }
+
+        MemFree(pWaiterContext);
+    }
+}
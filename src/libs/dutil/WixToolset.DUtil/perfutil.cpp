@@ -63,18 +63,31 @@ extern "C" void DAPI PerfClickTime(
         pli = &liStart;
     }
 
-    if (vfHighPerformanceCounter)
+    PerfQueryTime(pli);
+
+    if (pliElapsed)
     {
-        ::QueryPerformanceCounter(pli);
+        pliElapsed->QuadPart -= liStart.QuadPart;
     }
-    else
+}
+
+
+/********************************************************************
+ PerfQueryTime - returns the current perf number, so callers can keep
+                 their own start times instead of sharing PerfClickTime's
+
+********************************************************************/
+extern "C" void DAPI PerfQueryTime(
+    __out LARGE_INTEGER* pliTime
+    )
+{
+    if (vfHighPerformanceCounter)
     {
-        pli->QuadPart = ::GetTickCount();
+        ::QueryPerformanceCounter(pliTime);
     }
-
-    if (pliElapsed)
+    else
     {
-        pliElapsed->QuadPart -= liStart.QuadPart;
+        pliTime->QuadPart = ::GetTickCount();
     }
 }
 
@@ -29,6 +29,15 @@ static HRESULT AllocatePipeMessage(
     __out_bcount(cb) LPVOID* ppvMessage,
     __out SIZE_T* pcbMessage
 );
+static HRESULT RpcRequest(
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in DWORD dwMessageType,
+    __in_bcount(cbArgs) LPVOID pvArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult,
+    __out_opt LARGE_INTEGER* pliStart,
+    __out_opt LARGE_INTEGER* pliStop
+);
 
 
 DAPI_(HRESULT) PipeClientConnect(
@@ -283,6 +292,32 @@ DAPI_(HRESULT) PipeRpcRequest(
     __in SIZE_T cbArgs,
     __in PIPE_RPC_RESULT* pResult
 )
+{
+    return RpcRequest(phRpcPipe, dwMessageType, pvArgs, cbArgs, pResult, NULL, NULL);
+}
+
+DAPI_(HRESULT) PipeRpcTimedRequest(
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in DWORD dwMessageType,
+    __in_bcount(cbArgs) LPVOID pvArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult,
+    __out LARGE_INTEGER* pliStart,
+    __out LARGE_INTEGER* pliStop
+)
+{
+    return RpcRequest(phRpcPipe, dwMessageType, pvArgs, cbArgs, pResult, pliStart, pliStop);
+}
+
+static HRESULT RpcRequest(
+    __in PIPE_RPC_HANDLE* phRpcPipe,
+    __in DWORD dwMessageType,
+    __in_bcount(cbArgs) LPVOID pvArgs,
+    __in SIZE_T cbArgs,
+    __in PIPE_RPC_RESULT* pResult,
+    __out_opt LARGE_INTEGER* pliStart,
+    __out_opt LARGE_INTEGER* pliStop
+)
 {
     HRESULT hr = S_OK;
     HANDLE hPipe = phRpcPipe->hPipe;
@@ -291,6 +326,11 @@ DAPI_(HRESULT) PipeRpcRequest(
     DWORD cbData = 0;
     LPBYTE pbData = NULL;
 
+    if (pliStart)
+    {
+        PerfQueryTime(pliStart);
+    }
+
     if (hPipe == INVALID_HANDLE_VALUE)
     {
         ExitFunction();
@@ -301,6 +341,12 @@ DAPI_(HRESULT) PipeRpcRequest(
     ::EnterCriticalSection(&phRpcPipe->cs);
     fLocked = TRUE;
 
+    // Waiting on another thread's request isn't part of this one.
+    if (pliStart)
+    {
+        PerfQueryTime(pliStart);
+    }
+
     // Send the message.
     hr = PipeRpcWriteMessage(phRpcPipe, dwMessageType, pvArgs, cbArgs);
     PipeExitOnFailure(hr, "Failed to send RPC pipe request.");
@@ -332,6 +378,11 @@ DAPI_(HRESULT) PipeRpcRequest(
     PipeExitOnFailure(hr, "RPC pipe client reported failure.");
 
 LExit:
+    if (pliStop)
+    {
+        PerfQueryTime(pliStop);
+    }
+
     ReleaseMem(pbData);
 
     if (fLocked)
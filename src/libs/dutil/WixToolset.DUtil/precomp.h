@@ -40,6 +40,7 @@
 #include <commctrl.h>
 #include <dbt.h>
 #include <ShellScalingApi.h>
+#include <intrin.h>
 
 #include "dutilsources.h"
 #include "dutil.h"
@@ -16,6 +16,12 @@
 #define QueExitOnInvalidHandleWithLastError(p, x, s, ...) ExitOnInvalidHandleWithLastErrorSource(DUTIL_SOURCE_QUEUTIL, p, x, s, __VA_ARGS__)
 #define QueExitOnWin32Error(e, x, s, ...) ExitOnWin32ErrorSource(DUTIL_SOURCE_QUEUTIL, e, x, s, __VA_ARGS__)
 #define QueExitOnGdipFailure(g, x, s, ...) ExitOnGdipFailureSource(DUTIL_SOURCE_QUEUTIL, g, x, s, __VA_ARGS__)
+#define QueExitOnWaitObjectFailure(x, b, s, ...) ExitOnWaitObjectFailureSource(DUTIL_SOURCE_QUEUTIL, x, b, s, __VA_ARGS__)
+
+// Positions written by producers and by consumers are kept this far apart so they never share a cache line.
+#define QUEUTIL_CACHE_LINE_SIZE 64
+
+const DWORD QUEUTIL_RING_MAX_CAPACITY = 1 << 30;
 
 
 struct QUEUTIL_QUEUE_ITEM
@@ -30,8 +36,122 @@ struct QUEUTIL_QUEUE_STRUCT
     QUEUTIL_QUEUE_ITEM* pLast;
 };
 
+// Threads blocked waiting for a ring or segmented queue to change. The semaphore is only
+// released while cWaiting is non-zero so the uncontended path never enters the kernel.
+struct QUEUTIL_WAIT_LIST
+{
+    volatile LONG cWaiting;
+    HANDLE hSemaphore;
+};
+
+struct QUEUTIL_RING_CELL
+{
+    volatile LONG lSequence;
+    void* pvValue;
+};
+
+struct QUEUTIL_RING_STRUCT
+{
+    BYTE rgbPadStart[QUEUTIL_CACHE_LINE_SIZE];
+    volatile LONG lEnqueuePosition;
+    BYTE rgbPadEnqueue[QUEUTIL_CACHE_LINE_SIZE - sizeof(LONG)];
+    volatile LONG lDequeuePosition;
+    BYTE rgbPadDequeue[QUEUTIL_CACHE_LINE_SIZE - sizeof(LONG)];
+
+    DWORD dwMask;
+    QUEUTIL_RING_CELL* rgCells;
+
+    QUEUTIL_WAIT_LIST enqueueWaiters;
+    QUEUTIL_WAIT_LIST dequeueWaiters;
+};
+
+struct QUEUTIL_SEGMENT_SLOT
+{
+    void* pvValue;
+    volatile LONG fReady;
+};
+
+struct QUEUTIL_SEGMENT
+{
+    volatile LONG lEnqueueIndex;
+    BYTE rgbPadEnqueue[QUEUTIL_CACHE_LINE_SIZE - sizeof(LONG)];
+    volatile LONG lDequeueIndex;
+    BYTE rgbPadDequeue[QUEUTIL_CACHE_LINE_SIZE - sizeof(LONG)];
+
+    QUEUTIL_SEGMENT* volatile pNext;
+    QUEUTIL_SEGMENT* pNextRetired;
+
+    QUEUTIL_SEGMENT_SLOT rgSlots[1];
+};
+
+struct QUEUTIL_SEGMENTED_STRUCT
+{
+    BYTE rgbPadStart[QUEUTIL_CACHE_LINE_SIZE];
+    QUEUTIL_SEGMENT* volatile pHead;
+    BYTE rgbPadHead[QUEUTIL_CACHE_LINE_SIZE - sizeof(void*)];
+    QUEUTIL_SEGMENT* volatile pTail;
+    BYTE rgbPadTail[QUEUTIL_CACHE_LINE_SIZE - sizeof(void*)];
+
+    // Segments that have been unlinked from the queue are freed once no thread is inside the queue.
+    volatile LONG cActive;
+    QUEUTIL_SEGMENT* volatile pRetired;
+
+    DWORD cSegmentSlots;
+    QUEUTIL_WAIT_LIST dequeueWaiters;
+};
+
+typedef BOOL(*PFN_QUEUTIL_TRY_OPERATION)(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    );
+
 const int QUEUTIL_QUEUE_HANDLE_BYTES = sizeof(QUEUTIL_QUEUE_STRUCT);
 
+static HRESULT WaitListInitialize(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    );
+static void WaitListUninitialize(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    );
+static void WaitListWake(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    );
+static HRESULT WaitListWaitForOperation(
+    __in QUEUTIL_WAIT_LIST* pWaitList,
+    __in PFN_QUEUTIL_TRY_OPERATION pfnTryOperation,
+    __in void* pvQueue,
+    __inout void** ppvValue,
+    __in DWORD dwTimeout
+    );
+static BOOL RingTryEnqueue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    );
+static BOOL RingTryDequeue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    );
+static BOOL SegmentedTryDequeue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    );
+static QUEUTIL_SEGMENT* SegmentCreate(
+    __in DWORD cSlots
+    );
+static QUEUTIL_SEGMENT* ReadSegmentPointer(
+    __in QUEUTIL_SEGMENT* volatile* ppSegment
+    );
+static void SegmentedEnter(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue
+    );
+static void SegmentedLeave(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue
+    );
+static void SegmentedRetire(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue,
+    __in QUEUTIL_SEGMENT* pFirst
+    );
+
 extern "C" HRESULT DAPI QueCreate(
     __out_bcount(QUEUTIL_QUEUE_HANDLE_BYTES) QUEUTIL_QUEUE_HANDLE* phQueue
     )
@@ -142,3 +262,660 @@ extern "C" void DAPI QueDestroy(
 
     ReleaseMem(hQueue);
 }
+
+extern "C" HRESULT DAPI QueRingCreate(
+    __in DWORD cCapacity,
+    __out QUEUTIL_RING_HANDLE* phRing
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_RING_STRUCT* pRing = NULL;
+    DWORD cCells = 2;
+
+    QueExitOnNull(phRing, hr, E_INVALIDARG, "Handle not specified while creating ring.");
+
+    if (QUEUTIL_RING_MAX_CAPACITY < cCapacity)
+    {
+        hr = E_INVALIDARG;
+        QueExitOnRootFailure(hr, "Ring capacity %u is larger than the maximum of %u.", cCapacity, QUEUTIL_RING_MAX_CAPACITY);
+    }
+
+    while (cCells < cCapacity)
+    {
+        cCells <<= 1;
+    }
+
+    pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(MemAlloc(sizeof(QUEUTIL_RING_STRUCT), TRUE));
+    QueExitOnNull(pRing, hr, E_OUTOFMEMORY, "Failed to allocate ring object.");
+
+    pRing->rgCells = reinterpret_cast<QUEUTIL_RING_CELL*>(MemAlloc(sizeof(QUEUTIL_RING_CELL) * cCells, TRUE));
+    QueExitOnNull(pRing->rgCells, hr, E_OUTOFMEMORY, "Failed to allocate %u ring cells.", cCells);
+
+    // Each cell's sequence is the position it can next be enqueued at.
+    for (DWORD i = 0; i < cCells; ++i)
+    {
+        pRing->rgCells[i].lSequence = static_cast<LONG>(i);
+    }
+
+    pRing->dwMask = cCells - 1;
+
+    hr = WaitListInitialize(&pRing->enqueueWaiters);
+    QueExitOnFailure(hr, "Failed to initialize ring enqueue waiters.");
+
+    hr = WaitListInitialize(&pRing->dequeueWaiters);
+    QueExitOnFailure(hr, "Failed to initialize ring dequeue waiters.");
+
+    *phRing = pRing;
+    pRing = NULL;
+
+LExit:
+    if (pRing)
+    {
+        QueRingDestroy(pRing, NULL, NULL);
+    }
+
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueRingTryEnqueue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt void* pvValue
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(hRing);
+
+    QueExitOnNull(pRing, hr, E_INVALIDARG, "Handle not specified while enqueing value.");
+
+    if (!RingTryEnqueue(pRing, &pvValue))
+    {
+        ExitFunction1(hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+    }
+
+    WaitListWake(&pRing->dequeueWaiters);
+
+LExit:
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueRingEnqueue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt void* pvValue,
+    __in DWORD dwTimeout
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(hRing);
+
+    QueExitOnNull(pRing, hr, E_INVALIDARG, "Handle not specified while enqueing value.");
+
+    hr = WaitListWaitForOperation(&pRing->enqueueWaiters, RingTryEnqueue, pRing, &pvValue, dwTimeout);
+    if (HRESULT_FROM_WIN32(WAIT_TIMEOUT) == hr)
+    {
+        ExitFunction();
+    }
+    QueExitOnFailure(hr, "Failed to wait for room in ring.");
+
+    WaitListWake(&pRing->dequeueWaiters);
+
+LExit:
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueRingTryDequeue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __out void** ppvValue
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(hRing);
+
+    QueExitOnNull(pRing, hr, E_INVALIDARG, "Handle not specified while dequeing value.");
+
+    if (!RingTryDequeue(pRing, ppvValue))
+    {
+        *ppvValue = NULL;
+        ExitFunction1(hr = E_NOMOREITEMS);
+    }
+
+    WaitListWake(&pRing->enqueueWaiters);
+
+LExit:
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueRingDequeue(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __out void** ppvValue,
+    __in DWORD dwTimeout
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(hRing);
+
+    QueExitOnNull(pRing, hr, E_INVALIDARG, "Handle not specified while dequeing value.");
+
+    hr = WaitListWaitForOperation(&pRing->dequeueWaiters, RingTryDequeue, pRing, ppvValue, dwTimeout);
+    if (HRESULT_FROM_WIN32(WAIT_TIMEOUT) == hr)
+    {
+        *ppvValue = NULL;
+        ExitFunction();
+    }
+    QueExitOnFailure(hr, "Failed to wait for value in ring.");
+
+    WaitListWake(&pRing->enqueueWaiters);
+
+LExit:
+    return hr;
+}
+
+extern "C" void DAPI QueRingDestroy(
+    __in QUEUTIL_RING_HANDLE hRing,
+    __in_opt PFNQUEUTIL_QUEUE_RELEASE_VALUE pfnReleaseValue,
+    __in_opt void* pvContext
+    )
+{
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(hRing);
+    void* pvValue = NULL;
+
+    if (pRing)
+    {
+        while (pRing->rgCells && RingTryDequeue(pRing, &pvValue))
+        {
+            if (pfnReleaseValue)
+            {
+                pfnReleaseValue(pvValue, pvContext);
+            }
+        }
+
+        WaitListUninitialize(&pRing->enqueueWaiters);
+        WaitListUninitialize(&pRing->dequeueWaiters);
+
+        ReleaseMem(pRing->rgCells);
+        MemFree(pRing);
+    }
+}
+
+extern "C" HRESULT DAPI QueSegmentedCreate(
+    __in DWORD cSegmentCapacity,
+    __out QUEUTIL_SEGMENTED_HANDLE* phQueue
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = NULL;
+
+    QueExitOnNull(phQueue, hr, E_INVALIDARG, "Handle not specified while creating segmented queue.");
+
+    if (!cSegmentCapacity || QUEUTIL_RING_MAX_CAPACITY < cSegmentCapacity)
+    {
+        hr = E_INVALIDARG;
+        QueExitOnRootFailure(hr, "Invalid segment capacity: %u", cSegmentCapacity);
+    }
+
+    pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(MemAlloc(sizeof(QUEUTIL_SEGMENTED_STRUCT), TRUE));
+    QueExitOnNull(pQueue, hr, E_OUTOFMEMORY, "Failed to allocate segmented queue object.");
+
+    pQueue->cSegmentSlots = cSegmentCapacity;
+
+    pQueue->pHead = SegmentCreate(cSegmentCapacity);
+    QueExitOnNull(pQueue->pHead, hr, E_OUTOFMEMORY, "Failed to allocate first queue segment.");
+
+    pQueue->pTail = pQueue->pHead;
+
+    hr = WaitListInitialize(&pQueue->dequeueWaiters);
+    QueExitOnFailure(hr, "Failed to initialize segmented queue dequeue waiters.");
+
+    *phQueue = pQueue;
+    pQueue = NULL;
+
+LExit:
+    if (pQueue)
+    {
+        QueSegmentedDestroy(pQueue, NULL, NULL);
+    }
+
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueSegmentedEnqueue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __in_opt void* pvValue
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(hQueue);
+    QUEUTIL_SEGMENT* pSegment = NULL;
+    QUEUTIL_SEGMENT* pNext = NULL;
+    QUEUTIL_SEGMENT* pNew = NULL;
+    BOOL fEntered = FALSE;
+
+    QueExitOnNull(pQueue, hr, E_INVALIDARG, "Handle not specified while enqueing value.");
+
+    SegmentedEnter(pQueue);
+    fEntered = TRUE;
+
+    for (;;)
+    {
+        pSegment = ReadSegmentPointer(&pQueue->pTail);
+
+        // Claiming an index past the end of the segment is what closes it to further enqueues.
+        LONG lIndex = ::InterlockedIncrement(&pSegment->lEnqueueIndex) - 1;
+        if (static_cast<DWORD>(lIndex) < pQueue->cSegmentSlots)
+        {
+            pSegment->rgSlots[lIndex].pvValue = pvValue;
+            ::WriteRelease(&pSegment->rgSlots[lIndex].fReady, TRUE);
+            break;
+        }
+
+        pNext = ReadSegmentPointer(&pSegment->pNext);
+        if (!pNext)
+        {
+            pNew = SegmentCreate(pQueue->cSegmentSlots);
+            QueExitOnNull(pNew, hr, E_OUTOFMEMORY, "Failed to allocate queue segment.");
+
+            pNext = static_cast<QUEUTIL_SEGMENT*>(::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&pSegment->pNext), pNew, NULL));
+            if (pNext)
+            {
+                // Another producer linked a segment first.
+                MemFree(pNew);
+            }
+            else
+            {
+                pNext = pNew;
+            }
+
+            pNew = NULL;
+        }
+
+        ::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&pQueue->pTail), pNext, pSegment);
+    }
+
+    WaitListWake(&pQueue->dequeueWaiters);
+
+LExit:
+    if (fEntered)
+    {
+        SegmentedLeave(pQueue);
+    }
+
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueSegmentedTryDequeue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __out void** ppvValue
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(hQueue);
+
+    QueExitOnNull(pQueue, hr, E_INVALIDARG, "Handle not specified while dequeing value.");
+
+    if (!SegmentedTryDequeue(pQueue, ppvValue))
+    {
+        *ppvValue = NULL;
+        ExitFunction1(hr = E_NOMOREITEMS);
+    }
+
+LExit:
+    return hr;
+}
+
+extern "C" HRESULT DAPI QueSegmentedDequeue(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __out void** ppvValue,
+    __in DWORD dwTimeout
+    )
+{
+    HRESULT hr = S_OK;
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(hQueue);
+
+    QueExitOnNull(pQueue, hr, E_INVALIDARG, "Handle not specified while dequeing value.");
+
+    hr = WaitListWaitForOperation(&pQueue->dequeueWaiters, SegmentedTryDequeue, pQueue, ppvValue, dwTimeout);
+    if (HRESULT_FROM_WIN32(WAIT_TIMEOUT) == hr)
+    {
+        *ppvValue = NULL;
+        ExitFunction();
+    }
+    QueExitOnFailure(hr, "Failed to wait for value in segmented queue.");
+
+LExit:
+    return hr;
+}
+
+extern "C" void DAPI QueSegmentedDestroy(
+    __in QUEUTIL_SEGMENTED_HANDLE hQueue,
+    __in_opt PFNQUEUTIL_QUEUE_RELEASE_VALUE pfnReleaseValue,
+    __in_opt void* pvContext
+    )
+{
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(hQueue);
+    QUEUTIL_SEGMENT* pSegment = NULL;
+    void* pvValue = NULL;
+
+    if (pQueue)
+    {
+        while (pQueue->pHead && SegmentedTryDequeue(pQueue, &pvValue))
+        {
+            if (pfnReleaseValue)
+            {
+                pfnReleaseValue(pvValue, pvContext);
+            }
+        }
+
+        while (pQueue->pHead)
+        {
+            pSegment = pQueue->pHead;
+            pQueue->pHead = pSegment->pNext;
+
+            MemFree(pSegment);
+        }
+
+        while (pQueue->pRetired)
+        {
+            pSegment = pQueue->pRetired;
+            pQueue->pRetired = pSegment->pNextRetired;
+
+            MemFree(pSegment);
+        }
+
+        WaitListUninitialize(&pQueue->dequeueWaiters);
+
+        MemFree(pQueue);
+    }
+}
+
+static HRESULT WaitListInitialize(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    )
+{
+    HRESULT hr = S_OK;
+
+    pWaitList->hSemaphore = ::CreateSemaphoreW(NULL, 0, LONG_MAX, NULL);
+    QueExitOnNullWithLastError(pWaitList->hSemaphore, hr, "Failed to create queue wait semaphore.");
+
+LExit:
+    return hr;
+}
+
+static void WaitListUninitialize(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    )
+{
+    ReleaseHandle(pWaitList->hSemaphore);
+}
+
+static void WaitListWake(
+    __in QUEUTIL_WAIT_LIST* pWaitList
+    )
+{
+    // The value just published must be visible before cWaiting is read, otherwise a waiter
+    // that registered and re-checked the queue in between could sleep through it.
+    ::MemoryBarrier();
+
+    if (::ReadNoFence(&pWaitList->cWaiting))
+    {
+        // Extra releases only cause a waiter to loop and try again.
+        ::ReleaseSemaphore(pWaitList->hSemaphore, 1, NULL);
+    }
+}
+
+static HRESULT WaitListWaitForOperation(
+    __in QUEUTIL_WAIT_LIST* pWaitList,
+    __in PFN_QUEUTIL_TRY_OPERATION pfnTryOperation,
+    __in void* pvQueue,
+    __inout void** ppvValue,
+    __in DWORD dwTimeout
+    )
+{
+    HRESULT hr = S_OK;
+    DWORD dwStart = ::GetTickCount();
+    DWORD dwRemaining = dwTimeout;
+    DWORD dwElapsed = 0;
+    BOOL fTimedOut = FALSE;
+    BOOL fDone = pfnTryOperation(pvQueue, ppvValue);
+
+    while (!fDone)
+    {
+        ::InterlockedIncrement(&pWaitList->cWaiting);
+
+        // Try again now that wakes will be sent so a change that happened in between isn't missed.
+        fDone = pfnTryOperation(pvQueue, ppvValue);
+        if (!fDone)
+        {
+            hr = AppWaitForSingleObject(pWaitList->hSemaphore, dwRemaining);
+        }
+
+        ::InterlockedDecrement(&pWaitList->cWaiting);
+
+        if (!fDone)
+        {
+            QueExitOnWaitObjectFailure(hr, fTimedOut, "Failed to wait for queue.");
+
+            if (fTimedOut)
+            {
+                ExitFunction1(hr = HRESULT_FROM_WIN32(WAIT_TIMEOUT));
+            }
+
+            if (INFINITE != dwTimeout)
+            {
+                dwElapsed = ::GetTickCount() - dwStart;
+                dwRemaining = dwElapsed < dwTimeout ? dwTimeout - dwElapsed : 0;
+            }
+
+            fDone = pfnTryOperation(pvQueue, ppvValue);
+        }
+    }
+
+LExit:
+    return hr;
+}
+
+static BOOL RingTryEnqueue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    )
+{
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(pvQueue);
+    DWORD dwPosition = static_cast<DWORD>(::ReadNoFence(&pRing->lEnqueuePosition));
+
+    for (;;)
+    {
+        QUEUTIL_RING_CELL* pCell = pRing->rgCells + (dwPosition & pRing->dwMask);
+        LONG lDifference = static_cast<LONG>(static_cast<DWORD>(::ReadAcquire(&pCell->lSequence)) - dwPosition);
+
+        if (0 == lDifference)
+        {
+            // The cell is free for this position, try to claim the position.
+            DWORD dwPrevious = static_cast<DWORD>(::InterlockedCompareExchange(&pRing->lEnqueuePosition, static_cast<LONG>(dwPosition + 1), static_cast<LONG>(dwPosition)));
+            if (dwPrevious == dwPosition)
+            {
+                pCell->pvValue = *ppvValue;
+                ::WriteRelease(&pCell->lSequence, static_cast<LONG>(dwPosition + 1));
+
+                return TRUE;
+            }
+
+            dwPosition = dwPrevious;
+        }
+        else if (0 > lDifference)
+        {
+            // The cell still holds the value from one lap ago so the ring is full.
+            return FALSE;
+        }
+        else
+        {
+            dwPosition = static_cast<DWORD>(::ReadNoFence(&pRing->lEnqueuePosition));
+        }
+    }
+}
+
+static BOOL RingTryDequeue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    )
+{
+    QUEUTIL_RING_STRUCT* pRing = reinterpret_cast<QUEUTIL_RING_STRUCT*>(pvQueue);
+    DWORD dwPosition = static_cast<DWORD>(::ReadNoFence(&pRing->lDequeuePosition));
+
+    for (;;)
+    {
+        QUEUTIL_RING_CELL* pCell = pRing->rgCells + (dwPosition & pRing->dwMask);
+        LONG lDifference = static_cast<LONG>(static_cast<DWORD>(::ReadAcquire(&pCell->lSequence)) - (dwPosition + 1));
+
+        if (0 == lDifference)
+        {
+            // The cell holds the value for this position, try to claim the position.
+            DWORD dwPrevious = static_cast<DWORD>(::InterlockedCompareExchange(&pRing->lDequeuePosition, static_cast<LONG>(dwPosition + 1), static_cast<LONG>(dwPosition)));
+            if (dwPrevious == dwPosition)
+            {
+                *ppvValue = pCell->pvValue;
+
+                // Hand the cell to the producer one lap ahead.
+                ::WriteRelease(&pCell->lSequence, static_cast<LONG>(dwPosition + pRing->dwMask + 1));
+
+                return TRUE;
+            }
+
+            dwPosition = dwPrevious;
+        }
+        else if (0 > lDifference)
+        {
+            // Nothing has been enqueued at this position yet so the ring is empty.
+            return FALSE;
+        }
+        else
+        {
+            dwPosition = static_cast<DWORD>(::ReadNoFence(&pRing->lDequeuePosition));
+        }
+    }
+}
+
+static BOOL SegmentedTryDequeue(
+    __in void* pvQueue,
+    __inout void** ppvValue
+    )
+{
+    QUEUTIL_SEGMENTED_STRUCT* pQueue = reinterpret_cast<QUEUTIL_SEGMENTED_STRUCT*>(pvQueue);
+    QUEUTIL_SEGMENT* pSegment = NULL;
+    QUEUTIL_SEGMENT* pNext = NULL;
+    BOOL fDequeued = FALSE;
+
+    SegmentedEnter(pQueue);
+
+    for (;;)
+    {
+        pSegment = ReadSegmentPointer(&pQueue->pHead);
+
+        LONG lIndex = ::ReadAcquire(&pSegment->lDequeueIndex);
+        if (static_cast<DWORD>(lIndex) >= pQueue->cSegmentSlots)
+        {
+            // Every slot in this segment has been consumed, move on to the next segment if there is one.
+            pNext = ReadSegmentPointer(&pSegment->pNext);
+            if (!pNext)
+            {
+                break;
+            }
+
+            // The tail must never point at a retired segment, so help it forward before unlinking.
+            ::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&pQueue->pTail), pNext, pSegment);
+
+            if (pSegment == ::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&pQueue->pHead), pNext, pSegment))
+            {
+                pSegment->pNextRetired = NULL;
+                SegmentedRetire(pQueue, pSegment);
+            }
+
+            continue;
+        }
+
+        // An unpublished slot is either past the end of the queue or an enqueue still in flight, both look empty.
+        if (!::ReadAcquire(&pSegment->rgSlots[lIndex].fReady))
+        {
+            break;
+        }
+
+        if (lIndex == ::InterlockedCompareExchange(&pSegment->lDequeueIndex, lIndex + 1, lIndex))
+        {
+            *ppvValue = pSegment->rgSlots[lIndex].pvValue;
+            fDequeued = TRUE;
+            break;
+        }
+    }
+
+    SegmentedLeave(pQueue);
+
+    return fDequeued;
+}
+
+static QUEUTIL_SEGMENT* SegmentCreate(
+    __in DWORD cSlots
+    )
+{
+    return reinterpret_cast<QUEUTIL_SEGMENT*>(MemAlloc(sizeof(QUEUTIL_SEGMENT) + sizeof(QUEUTIL_SEGMENT_SLOT) * (static_cast<SIZE_T>(cSlots) - 1), TRUE));
+}
+
+static QUEUTIL_SEGMENT* ReadSegmentPointer(
+    __in QUEUTIL_SEGMENT* volatile* ppSegment
+    )
+{
+    return static_cast<QUEUTIL_SEGMENT*>(::ReadPointerAcquire(reinterpret_cast<PVOID volatile*>(ppSegment)));
+}
+
+static void SegmentedEnter(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue
+    )
+{
+    ::InterlockedIncrement(&pQueue->cActive);
+}
+
+static void SegmentedLeave(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue
+    )
+{
+    QUEUTIL_SEGMENT* pRetired = NULL;
+    QUEUTIL_SEGMENT* pSegment = NULL;
+
+    if (0 == ::InterlockedDecrement(&pQueue->cActive) && ReadSegmentPointer(&pQueue->pRetired))
+    {
+        pRetired = static_cast<QUEUTIL_SEGMENT*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&pQueue->pRetired), NULL));
+
+        // Retired segments were unlinked before they were retired, so if the queue is still idle
+        // after taking the list then no thread can be holding a pointer to any of them.
+        if (0 == ::InterlockedCompareExchange(&pQueue->cActive, 0, 0))
+        {
+            while (pRetired)
+            {
+                pSegment = pRetired;
+                pRetired = pSegment->pNextRetired;
+
+                MemFree(pSegment);
+            }
+        }
+        else if (pRetired)
+        {
+            SegmentedRetire(pQueue, pRetired);
+        }
+    }
+}
+
+static void SegmentedRetire(
+    __in QUEUTIL_SEGMENTED_STRUCT* pQueue,
+    __in QUEUTIL_SEGMENT* pFirst
+    )
+{
+    QUEUTIL_SEGMENT* pLast = pFirst;
+    PVOID pvRetired = NULL;
+
+    while (pLast->pNextRetired)
+    {
+        pLast = pLast->pNextRetired;
+    }
+
+    do
+    {
+        pvRetired = ::ReadPointerAcquire(reinterpret_cast<PVOID volatile*>(&pQueue->pRetired));
+        pLast->pNextRetired = static_cast<QUEUTIL_SEGMENT*>(pvRetired);
+    } while (pvRetired != ::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&pQueue->pRetired), pFirst, pvRetired));
+}
@@ -19,6 +19,16 @@
 
 #define ARRAY_GROWTH_SIZE 5
 
+#if defined(_M_IX86) || defined(_M_X64)
+#define STR_SIMD_X86
+#endif
+
+// Largest character set that is matched with vector compares, larger sets are scanned one character at a time.
+const DWORD STR_SIMD_MAX_CHAR_SET = 8;
+
+static volatile LONG vnStrSimdLevelSupported = -1;
+static volatile LONG vnStrSimdLevel = -1;
+
 // Forward declarations.
 static HRESULT AllocHelper(
     __deref_out_ecount_part(cch, 0) LPWSTR* ppwz,
@@ -49,6 +59,60 @@ static HRESULT StrAllocStringMapInvariant(
     __in SIZE_T cchSource,
     __in DWORD dwMapFlags
     );
+static STR_SIMD_LEVEL DetectSimdLevel(
+    );
+static SIZE_T FindCharSet(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    );
+static SIZE_T FindCharSetScalar(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    );
+#ifdef STR_SIMD_X86
+static SIZE_T FindCharSetSse2(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    );
+static SIZE_T FindCharSetAvx2(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    );
+#endif
+static BOOL IsMatchIgnoreCase(
+    __in_ecount(cch) LPCWSTR wz1,
+    __in_ecount(cch) LPCWSTR wz2,
+    __in SIZE_T cch
+    );
+#ifdef STR_SIMD_X86
+static SIZE_T HexEncodeSse2(
+    __in_ecount(cbSource) const BYTE* pbSource,
+    __in SIZE_T cbSource,
+    __out_ecount(2 * cbSource) LPWSTR wzDest
+    );
+static SIZE_T HexDecodeSse2(
+    __in_ecount(2 * cbDest) LPCWSTR wzSource,
+    __out_bcount(cbDest) BYTE* pbDest,
+    __in SIZE_T cbDest
+    );
+static BOOL HexCharsToNibblesSse2(
+    __in __m128i vChars,
+    __out __m128i* pvNibbles
+    );
+static SIZE_T Base85EncodeSse2(
+    __in_ecount(cbSource) const BYTE* pbSource,
+    __in SIZE_T cbSource,
+    __out_ecount(cbSource / 4 * 5) LPWSTR wzDest
+    );
+#endif
 
 /********************************************************************
 StrAlloc - allocates or reuses dynamic string memory
@@ -1327,19 +1391,87 @@ extern "C" HRESULT DAPI StrReplaceStringAll(
     __in_z LPCWSTR wzNewSubString
     )
 {
-    HRESULT hr = S_OK;
-    DWORD dwStartIndex = 0;
+    Assert(ppwzOriginal && wzOldSubString && wzNewSubString);
 
-    do
+    HRESULT hr = S_FALSE;
+    LPWSTR sczResult = NULL;
+    LPWSTR wzWrite = NULL;
+    LPCWSTR wzRead = NULL;
+    LPCWSTR wzEnd = NULL;
+    LPCWSTR wzFound = NULL;
+    size_t cchOriginal = 0;
+    size_t cchOldSubString = 0;
+    size_t cchNewSubString = 0;
+    SIZE_T cReplacements = 0;
+    SIZE_T cchResult = 0;
+
+    if (!*ppwzOriginal)
     {
-        hr = StrReplaceString(ppwzOriginal, &dwStartIndex, wzOldSubString, wzNewSubString);
-        StrExitOnFailure(hr, "Failed to replace substring");
+        ExitFunction();
     }
-    while (S_OK == hr);
 
-    hr = (0 == dwStartIndex) ? S_FALSE : S_OK;
+    hr = ::StringCchLengthW(*ppwzOriginal, STRSAFE_MAX_CCH, &cchOriginal);
+    StrExitOnRootFailure(hr, "Failed to get original string length.");
+
+    hr = ::StringCchLengthW(wzOldSubString, STRSAFE_MAX_CCH, &cchOldSubString);
+    StrExitOnRootFailure(hr, "Failed to get old string length.");
+
+    hr = ::StringCchLengthW(wzNewSubString, STRSAFE_MAX_CCH, &cchNewSubString);
+    StrExitOnRootFailure(hr, "Failed to get new string length.");
+
+    hr = S_FALSE;
+
+    if (!cchOldSubString)
+    {
+        ExitFunction();
+    }
+
+    // Count the replacements up front so the result is only allocated once.
+    wzEnd = *ppwzOriginal + cchOriginal;
+
+    for (wzRead = *ppwzOriginal; NULL != (wzFound = StrFindString(wzRead, wzEnd - wzRead, wzOldSubString, cchOldSubString)); wzRead = wzFound + cchOldSubString)
+    {
+        ++cReplacements;
+    }
+
+    if (!cReplacements)
+    {
+        ExitFunction();
+    }
+
+    hr = ::SIZETMult(cReplacements, cchNewSubString, &cchResult);
+    StrExitOnRootFailure(hr, "Replaced string is too large.");
+
+    hr = ::SIZETAdd(cchResult, cchOriginal - cReplacements * cchOldSubString, &cchResult);
+    StrExitOnRootFailure(hr, "Replaced string is too large.");
+
+    hr = StrAlloc(&sczResult, cchResult + 1);
+    StrExitOnFailure(hr, "Failed to allocate replaced string.");
+
+    wzWrite = sczResult;
+
+    for (wzRead = *ppwzOriginal; NULL != (wzFound = StrFindString(wzRead, wzEnd - wzRead, wzOldSubString, cchOldSubString)); wzRead = wzFound + cchOldSubString)
+    {
+        ::CopyMemory(wzWrite, wzRead, (wzFound - wzRead) * sizeof(WCHAR));
+        wzWrite += wzFound - wzRead;
+
+        ::CopyMemory(wzWrite, wzNewSubString, cchNewSubString * sizeof(WCHAR));
+        wzWrite += cchNewSubString;
+    }
+
+    ::CopyMemory(wzWrite, wzRead, (wzEnd - wzRead) * sizeof(WCHAR));
+    sczResult[cchResult] = L'\0';
+
+    hr = StrFree(*ppwzOriginal);
+    StrExitOnFailure(hr, "Failed to free original string.");
+
+    *ppwzOriginal = sczResult;
+    sczResult = NULL;
+    hr = S_OK;
 
 LExit:
+    ReleaseStr(sczResult);
+
     return hr;
 }
 
@@ -1453,7 +1585,7 @@ extern "C" HRESULT DAPI StrHexEncode(
     Assert(pbSource && wzDest);
 
     HRESULT hr = S_OK;
-    DWORD i;
+    SIZE_T i = 0;
     BYTE b;
 
     if (cchDest < 2 * cbSource + 1)
@@ -1461,7 +1593,16 @@ extern "C" HRESULT DAPI StrHexEncode(
         ExitFunction1(hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
     }
 
-    for (i = 0; i < cbSource; ++i)
+#ifdef STR_SIMD_X86
+    if (STR_SIMD_LEVEL_NONE != StrGetSimdLevel())
+    {
+        i = HexEncodeSse2(pbSource, cbSource, wzDest);
+        pbSource += i;
+        wzDest += 2 * i;
+    }
+#endif
+
+    for (/* i already initialized */; i < cbSource; ++i)
     {
         b = (*pbSource) >> 4;
         *(wzDest++) = (WCHAR)(L'0' + b + ((b < 10) ? 0 : L'A'-L'9'-1));
@@ -1530,7 +1671,17 @@ extern "C" HRESULT DAPI StrHexDecode(
         StrExitOnRootFailure(hr, "Insufficient buffer to decode string '%ls' len: %Iu into %Iu bytes.", wzSource, cchSource, cbDest);
     }
 
-    for (i = 0; i < cchSource / 2; ++i)
+#ifdef STR_SIMD_X86
+    if (STR_SIMD_LEVEL_NONE != StrGetSimdLevel())
+    {
+        // Stops early at the first block with a non-hex character so the scalar loop handles it exactly as before.
+        i = HexDecodeSse2(wzSource, pbDest, cchSource / 2);
+        wzSource += 2 * i;
+        pbDest += i;
+    }
+#endif
+
+    for (/* i already initialized */; i < cchSource / 2; ++i)
     {
         b = HexCharToByte(*wzSource++);
         (*pbDest) = b << 4;
@@ -1659,8 +1810,16 @@ extern "C" HRESULT DAPI StrAllocBase85Encode(
 
     wzDest = *pwzDest;
 
+#ifdef STR_SIMD_X86
+    if (STR_SIMD_LEVEL_NONE != StrGetSimdLevel())
+    {
+        iSource = Base85EncodeSse2(pbSource, cbSource, wzDest);
+        iDest = iSource / 4 * 5;
+    }
+#endif
+
     // first, encode full words
-    for (iSource = 0, iDest = 0; (iSource + 4 < cbSource) && (iDest + 5 < cchDest); iSource += 4, iDest += 5)
+    for (/* iSource and iDest already initialized */; (iSource + 4 < cbSource) && (iDest + 5 < cchDest); iSource += 4, iDest += 5)
     {
         DWORD n = pbSource[iSource] + (pbSource[iSource + 1] << 8) + (pbSource[iSource + 2] << 16) + (pbSource[iSource + 3] << 24);
         DWORD k = n / 85;
@@ -1769,44 +1928,26 @@ extern "C" HRESULT DAPI StrAllocBase85Decode(
     // decode full words first
     while (5 <= cchSource)
     {
-        k = Base85DecodeTable[wzSource[0]];
-        if (85 == k)
-        {
-            // illegal symbol
-            return E_UNEXPECTED;
-        }
-        n = k;
-
-        k = Base85DecodeTable[wzSource[1]];
-        if (85 == k)
+        // Characters outside the table are illegal symbols, check all five at once before indexing.
+        if (0xFF < (wzSource[0] | wzSource[1] | wzSource[2] | wzSource[3] | wzSource[4]))
         {
             // illegal symbol
             return E_UNEXPECTED;
         }
-        n += k * 85;
 
-        k = Base85DecodeTable[wzSource[2]];
-        if (85 == k)
-        {
-            // illegal symbol
-            return E_UNEXPECTED;
-        }
-        n += k * (85 * 85);
+        DWORD_PTR k0 = Base85DecodeTable[wzSource[0]];
+        DWORD_PTR k1 = Base85DecodeTable[wzSource[1]];
+        DWORD_PTR k2 = Base85DecodeTable[wzSource[2]];
+        DWORD_PTR k3 = Base85DecodeTable[wzSource[3]];
+        k = Base85DecodeTable[wzSource[4]];
 
-        k = Base85DecodeTable[wzSource[3]];
-        if (85 == k)
+        if ((85 == k0) | (85 == k1) | (85 == k2) | (85 == k3) | (85 == k))
         {
             // illegal symbol
             return E_UNEXPECTED;
         }
-        n += k * (85 * 85 * 85);
 
-        k = Base85DecodeTable[wzSource[4]];
-        if (85 == k)
-        {
-            // illegal symbol
-            return E_UNEXPECTED;
-        }
+        n = k0 + k1 * 85 + k2 * (85 * 85) + k3 * (85 * 85 * 85);
         k *= (85 * 85 * 85 * 85);
 
         // if (k + n > (1u << 32)) <=> (k > ~n) then decode error
@@ -1833,6 +1974,12 @@ extern "C" HRESULT DAPI StrAllocBase85Decode(
         n = 0;
         for (i = 0; i < cchSource; ++i)
         {
+            if (0xFF < wzSource[i])
+            {
+                // illegal symbol
+                return E_UNEXPECTED;
+            }
+
             k = Base85DecodeTable[wzSource[i]];
             if (85 == k)
             {
@@ -1878,30 +2025,32 @@ extern "C" HRESULT DAPI MultiSzLen(
 
     HRESULT hr = S_OK;
     LPCWSTR wz = pwzMultiSz;
+    LPCWSTR wzEnd = NULL;
     DWORD_PTR dwMaxSize = 0;
 
     hr = StrMaxLength(pwzMultiSz, &dwMaxSize);
     StrExitOnFailure(hr, "failed to get the max size of a string while calculating MULTISZ length");
 
+    // Jump from null to null looking for two in a row. If we walk off the end then the length is 0.
     *pcch = 0;
-    while (*pcch < dwMaxSize)
+    wzEnd = pwzMultiSz + dwMaxSize;
+
+    while (wz < wzEnd)
     {
-        if (L'\0' == *wz && L'\0' == *(wz + 1))
+        wz = StrFindChar(wz, wzEnd - wz, L'\0');
+        if (!wz || wz + 1 >= wzEnd)
         {
             break;
         }
 
-        ++wz;
-        *pcch = *pcch + 1;
-    }
-
-    // Add two for the last 2 NULLs (that we looked ahead at)
-    *pcch = *pcch + 2;
+        if (L'\0' == *(wz + 1))
+        {
+            // Add two for the last 2 NULLs
+            *pcch = wz - pwzMultiSz + 2;
+            break;
+        }
 
-    // If we've walked off the end then the length is 0
-    if (*pcch > dwMaxSize)
-    {
-        *pcch = 0;
+        wz += 2;
     }
 
 LExit:
@@ -2000,6 +2149,7 @@ extern "C" HRESULT DAPI MultiSzFindSubstring(
 
     HRESULT hr = S_FALSE; // Assume we won't find it (the glass is half empty)
     LPCWSTR wz = pwzMultiSz;
+    LPCWSTR wzEnd = NULL;
     DWORD_PTR dwIndex = 0;
     SIZE_T cchMultiSz = 0;
     SIZE_T cchProgress = 0;
@@ -2012,19 +2162,18 @@ extern "C" HRESULT DAPI MultiSzFindSubstring(
     while (NULL == wcsistr(wz, pwzSubstring))
     {
         // Slide through to the end of the current string
-        while (L'\0' != *wz && cchProgress < cchMultiSz)
-        {
-            ++wz;
-            ++cchProgress;
-        }
+        wzEnd = StrFindChar(wz, cchMultiSz > cchProgress ? cchMultiSz - cchProgress : 0, L'\0');
 
         // If we're done, we're done
-        if (L'\0' == *(wz + 1) || cchProgress >= cchMultiSz)
+        if (!wzEnd || L'\0' == *(wzEnd + 1))
         {
             hr = S_FALSE;
             break;
         }
 
+        cchProgress = wzEnd - pwzMultiSz + 1;
+        wz = wzEnd;
+
         // Move on to the next string
         ++wz;
         ++dwIndex;
@@ -2066,6 +2215,7 @@ extern "C" HRESULT DAPI MultiSzFindString(
 
     HRESULT hr = S_FALSE; // Assume we won't find it
     LPCWSTR wz = pwzMultiSz;
+    LPCWSTR wzEnd = NULL;
     DWORD_PTR dwIndex = 0;
     SIZE_T cchMutliSz = 0;
     SIZE_T cchProgress = 0;
@@ -2078,19 +2228,18 @@ extern "C" HRESULT DAPI MultiSzFindString(
     while (0 != lstrcmpW(wz, pwzString))
     {
         // Slide through to the end of the current string
-        while (L'\0' != *wz && cchProgress < cchMutliSz)
-        {
-            ++wz;
-            ++cchProgress;
-        }
+        wzEnd = StrFindChar(wz, cchMutliSz > cchProgress ? cchMutliSz - cchProgress : 0, L'\0');
 
         // If we're done, we're done
-        if (L'\0' == *(wz + 1) || cchProgress >= cchMutliSz)
+        if (!wzEnd || L'\0' == *(wzEnd + 1))
         {
             hr = S_FALSE;
             break;
         }
 
+        cchProgress = wzEnd - pwzMultiSz + 1;
+        wz = wzEnd;
+
         // Move on to the next string
         ++wz;
         ++dwIndex;
@@ -2325,31 +2474,214 @@ extern "C" LPCWSTR DAPI wcsistr(
     __in_z LPCWSTR wzCharSet
     )
 {
-    LPCWSTR wzSource = wzString;
-    LPCWSTR wzSearch = NULL;
-    SIZE_T cchSourceIndex = 0;
+    SIZE_T cchString = wcslen(wzString);
+
+    // An empty source never matches, not even an empty substring.
+    if (!cchString)
+    {
+        return NULL;
+    }
+
+    return StrFindStringIgnoreCase(wzString, cchString, wzCharSet, wcslen(wzCharSet));
+}
+
+/****************************************************************************
+StrGetSimdLevel - gets the vector instruction set used by the StrFind
+functions, detecting what the processor supports the first time.
+
+****************************************************************************/
+extern "C" STR_SIMD_LEVEL DAPI StrGetSimdLevel(
+    )
+{
+    LONG nLevel = vnStrSimdLevel;
 
-    // Walk through wzString (the source string) one character at a time
-    while (*wzSource)
+    if (0 > nLevel)
     {
-        cchSourceIndex = 0;
-        wzSearch = wzCharSet;
+        nLevel = DetectSimdLevel();
+
+        ::InterlockedCompareExchange(&vnStrSimdLevelSupported, nLevel, -1);
+        ::InterlockedCompareExchange(&vnStrSimdLevel, nLevel, -1);
+
+        nLevel = vnStrSimdLevel;
+    }
+
+    return static_cast<STR_SIMD_LEVEL>(nLevel);
+}
+
+/****************************************************************************
+StrSetSimdLevel - limits the vector instruction set used by the StrFind
+functions, primarily so tests can compare against the scalar code. The
+level is capped at what the processor supports. Returns the previous level.
+
+****************************************************************************/
+extern "C" STR_SIMD_LEVEL DAPI StrSetSimdLevel(
+    __in STR_SIMD_LEVEL level
+    )
+{
+    STR_SIMD_LEVEL previousLevel = StrGetSimdLevel();
+    LONG nLevel = min(max(static_cast<LONG>(level), static_cast<LONG>(STR_SIMD_LEVEL_NONE)), vnStrSimdLevelSupported);
 
-        // Look ahead in the source string until we get a full match or we hit the end of the source
-        while (L'\0' != wzSource[cchSourceIndex] && L'\0' != *wzSearch && towlower(wzSource[cchSourceIndex]) == towlower(*wzSearch))
+    ::InterlockedExchange(&vnStrSimdLevel, nLevel);
+
+    return previousLevel;
+}
+
+/****************************************************************************
+StrFindChar - finds the first occurrence of a character in the first cch
+characters of a string. Embedded nulls are searched like any other character.
+
+NOTE: returns NULL if the character is not found
+****************************************************************************/
+extern "C" LPCWSTR DAPI StrFindChar(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in WCHAR wch
+    )
+{
+    SIZE_T iFound = FindCharSet(wz, cch, &wch, 1);
+
+    return iFound < cch ? wz + iFound : NULL;
+}
+
+/****************************************************************************
+StrFindCharInSet - finds the first character in the first cch characters of
+a string that matches any of the characters in the set.
+
+NOTE: returns NULL if no character in the set is found
+****************************************************************************/
+extern "C" LPCWSTR DAPI StrFindCharInSet(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchSet) LPCWSTR wzSet,
+    __in SIZE_T cchSet
+    )
+{
+    SIZE_T iFound = cch;
+
+    if (cchSet && DWORD_MAX >= cchSet)
+    {
+        iFound = FindCharSet(wz, cch, wzSet, static_cast<DWORD>(cchSet));
+    }
+
+    return iFound < cch ? wz + iFound : NULL;
+}
+
+/****************************************************************************
+StrFindString - case sensitive find of a substring within the first cch
+characters of a string.
+
+NOTE: returns NULL if the substring is not found
+****************************************************************************/
+extern "C" LPCWSTR DAPI StrFindString(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchFind) LPCWSTR wzFind,
+    __in SIZE_T cchFind
+    )
+{
+    SIZE_T cchCandidates = 0;
+    SIZE_T i = 0;
+
+    if (!cchFind)
+    {
+        return wz;
+    }
+    else if (cchFind > cch)
+    {
+        return NULL;
+    }
+
+    // Scan for the first character then compare the rest of the substring.
+    cchCandidates = cch - cchFind + 1;
+
+    while (i < cchCandidates)
+    {
+        i += FindCharSet(wz + i, cchCandidates - i, wzFind, 1);
+        if (i >= cchCandidates)
         {
-            ++cchSourceIndex;
-            ++wzSearch;
+            break;
         }
 
-        // If we found it, return the point that we found it at
-        if (L'\0' == *wzSearch)
+        if (0 == memcmp(wz + i + 1, wzFind + 1, (cchFind - 1) * sizeof(WCHAR)))
         {
-            return wzSource;
+            return wz + i;
         }
 
-        // Walk ahead one character
-        ++wzSource;
+        ++i;
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+StrFindStringIgnoreCase - case insensitive find of a substring within the
+first cch characters of a string. Characters are compared with towlower.
+
+NOTE: returns NULL if the substring is not found
+****************************************************************************/
+extern "C" LPCWSTR DAPI StrFindStringIgnoreCase(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cchFind) LPCWSTR wzFind,
+    __in SIZE_T cchFind
+    )
+{
+    WCHAR rgwchFirst[2] = { };
+    DWORD cwchFirst = 0;
+    SIZE_T cchCandidates = 0;
+    SIZE_T i = 0;
+
+    if (!cchFind)
+    {
+        return wz;
+    }
+    else if (cchFind > cch)
+    {
+        return NULL;
+    }
+
+    cchCandidates = cch - cchFind + 1;
+
+    // Non-ASCII first characters may have any number of case mappings so check every position.
+    if (0x80 <= wzFind[0])
+    {
+        for (i = 0; i < cchCandidates; ++i)
+        {
+            if (IsMatchIgnoreCase(wz + i, wzFind, cchFind))
+            {
+                return wz + i;
+            }
+        }
+
+        return NULL;
+    }
+
+    // Otherwise scan for either case of the first character then compare the rest of the substring.
+    rgwchFirst[cwchFirst++] = wzFind[0];
+
+    if (L'a' <= wzFind[0] && L'z' >= wzFind[0])
+    {
+        rgwchFirst[cwchFirst++] = static_cast<WCHAR>(wzFind[0] - L'a' + L'A');
+    }
+    else if (L'A' <= wzFind[0] && L'Z' >= wzFind[0])
+    {
+        rgwchFirst[cwchFirst++] = static_cast<WCHAR>(wzFind[0] - L'A' + L'a');
+    }
+
+    while (i < cchCandidates)
+    {
+        i += FindCharSet(wz + i, cchCandidates - i, rgwchFirst, cwchFirst);
+        if (i >= cchCandidates)
+        {
+            break;
+        }
+
+        if (IsMatchIgnoreCase(wz + i + 1, wzFind + 1, cchFind - 1))
+        {
+            return wz + i;
+        }
+
+        ++i;
     }
 
     return NULL;
@@ -2793,3 +3125,336 @@ extern "C" DAPI_(HRESULT) StrSecureZeroFreeString(
 
     return hr;
 }
+
+static STR_SIMD_LEVEL DetectSimdLevel(
+    )
+{
+    STR_SIMD_LEVEL level = STR_SIMD_LEVEL_NONE;
+
+#ifdef STR_SIMD_X86
+    int rgnInfo[4] = { };
+    int nMaxLeaf = 0;
+
+    __cpuid(rgnInfo, 0);
+    nMaxLeaf = rgnInfo[0];
+
+    __cpuid(rgnInfo, 1);
+
+    // EDX bit 26 is SSE2.
+    if (rgnInfo[3] & (1 << 26))
+    {
+        level = STR_SIMD_LEVEL_SSE2;
+
+        // AVX2 needs the processor to support AVX (ECX bit 28) and the OS to save the YMM registers (ECX bit 27 and XCR0).
+        if ((rgnInfo[2] & (1 << 27)) && (rgnInfo[2] & (1 << 28)) && 6 == (_xgetbv(0) & 6) && 7 <= nMaxLeaf)
+        {
+            __cpuidex(rgnInfo, 7, 0);
+
+            // EBX bit 5 is AVX2.
+            if (rgnInfo[1] & (1 << 5))
+            {
+                level = STR_SIMD_LEVEL_AVX2;
+            }
+        }
+    }
+#endif
+
+    return level;
+}
+
+static SIZE_T FindCharSet(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    )
+{
+#ifdef STR_SIMD_X86
+    if (STR_SIMD_MAX_CHAR_SET >= cwch)
+    {
+        switch (StrGetSimdLevel())
+        {
+        case STR_SIMD_LEVEL_AVX2:
+            return FindCharSetAvx2(wz, cch, rgwch, cwch);
+        case STR_SIMD_LEVEL_SSE2:
+            return FindCharSetSse2(wz, cch, rgwch, cwch);
+        }
+    }
+#endif
+
+    return FindCharSetScalar(wz, cch, rgwch, cwch);
+}
+
+static SIZE_T FindCharSetScalar(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    )
+{
+    for (SIZE_T i = 0; i < cch; ++i)
+    {
+        for (DWORD j = 0; j < cwch; ++j)
+        {
+            if (wz[i] == rgwch[j])
+            {
+                return i;
+            }
+        }
+    }
+
+    return cch;
+}
+
+#ifdef STR_SIMD_X86
+static SIZE_T FindCharSetSse2(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    )
+{
+    const SIZE_T cchVector = sizeof(__m128i) / sizeof(WCHAR);
+    __m128i rgvSet[STR_SIMD_MAX_CHAR_SET];
+    SIZE_T i = 0;
+
+    for (DWORD j = 0; j < cwch; ++j)
+    {
+        rgvSet[j] = _mm_set1_epi16(static_cast<short>(rgwch[j]));
+    }
+
+    for (; i + cchVector <= cch; i += cchVector)
+    {
+        __m128i vData = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wz + i));
+        __m128i vMatch = _mm_cmpeq_epi16(vData, rgvSet[0]);
+
+        for (DWORD j = 1; j < cwch; ++j)
+        {
+            vMatch = _mm_or_si128(vMatch, _mm_cmpeq_epi16(vData, rgvSet[j]));
+        }
+
+        DWORD dwMask = static_cast<DWORD>(_mm_movemask_epi8(vMatch));
+        if (dwMask)
+        {
+            DWORD iBit = 0;
+            _BitScanForward(&iBit, dwMask);
+
+            return i + iBit / sizeof(WCHAR);
+        }
+    }
+
+    return i + FindCharSetScalar(wz + i, cch - i, rgwch, cwch);
+}
+
+static SIZE_T FindCharSetAvx2(
+    __in_ecount(cch) LPCWSTR wz,
+    __in SIZE_T cch,
+    __in_ecount(cwch) const WCHAR* rgwch,
+    __in DWORD cwch
+    )
+{
+    const SIZE_T cchVector = sizeof(__m256i) / sizeof(WCHAR);
+    __m256i rgvSet[STR_SIMD_MAX_CHAR_SET];
+    SIZE_T i = 0;
+
+    for (DWORD j = 0; j < cwch; ++j)
+    {
+        rgvSet[j] = _mm256_set1_epi16(static_cast<short>(rgwch[j]));
+    }
+
+    for (; i + cchVector <= cch; i += cchVector)
+    {
+        __m256i vData = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wz + i));
+        __m256i vMatch = _mm256_cmpeq_epi16(vData, rgvSet[0]);
+
+        for (DWORD j = 1; j < cwch; ++j)
+        {
+            vMatch = _mm256_or_si256(vMatch, _mm256_cmpeq_epi16(vData, rgvSet[j]));
+        }
+
+        DWORD dwMask = static_cast<DWORD>(_mm256_movemask_epi8(vMatch));
+        if (dwMask)
+        {
+            DWORD iBit = 0;
+            _BitScanForward(&iBit, dwMask);
+
+            return i + iBit / sizeof(WCHAR);
+        }
+    }
+
+    // Finish the tail with the narrower vectors.
+    return i + FindCharSetSse2(wz + i, cch - i, rgwch, cwch);
+}
+#endif
+
+static BOOL IsMatchIgnoreCase(
+    __in_ecount(cch) LPCWSTR wz1,
+    __in_ecount(cch) LPCWSTR wz2,
+    __in SIZE_T cch
+    )
+{
+    for (SIZE_T i = 0; i < cch; ++i)
+    {
+        if (towlower(wz1[i]) != towlower(wz2[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+#ifdef STR_SIMD_X86
+static SIZE_T HexEncodeSse2(
+    __in_ecount(cbSource) const BYTE* pbSource,
+    __in SIZE_T cbSource,
+    __out_ecount(2 * cbSource) LPWSTR wzDest
+    )
+{
+    const __m128i vNibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i vNine = _mm_set1_epi8(9);
+    const __m128i vDigitBase = _mm_set1_epi8('0');
+    const __m128i vLetterOffset = _mm_set1_epi8('A' - '9' - 1);
+    const __m128i vZero = _mm_setzero_si128();
+    SIZE_T i = 0;
+
+    for (; i + sizeof(__m128i) <= cbSource; i += sizeof(__m128i))
+    {
+        __m128i vData = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbSource + i));
+        __m128i vHigh = _mm_and_si128(_mm_srli_epi16(vData, 4), vNibbleMask);
+        __m128i vLow = _mm_and_si128(vData, vNibbleMask);
+
+        // '0' + nibble, plus the gap between '9' and 'A' for nibbles above nine.
+        vHigh = _mm_add_epi8(_mm_add_epi8(vHigh, vDigitBase), _mm_and_si128(_mm_cmpgt_epi8(vHigh, vNine), vLetterOffset));
+        vLow = _mm_add_epi8(_mm_add_epi8(vLow, vDigitBase), _mm_and_si128(_mm_cmpgt_epi8(vLow, vNine), vLetterOffset));
+
+        // Interleave the high and low characters of each byte then widen them to WCHARs.
+        __m128i vFirst = _mm_unpacklo_epi8(vHigh, vLow);
+        __m128i vSecond = _mm_unpackhi_epi8(vHigh, vLow);
+        __m128i* pvDest = reinterpret_cast<__m128i*>(wzDest + 2 * i);
+
+        _mm_storeu_si128(pvDest, _mm_unpacklo_epi8(vFirst, vZero));
+        _mm_storeu_si128(pvDest + 1, _mm_unpackhi_epi8(vFirst, vZero));
+        _mm_storeu_si128(pvDest + 2, _mm_unpacklo_epi8(vSecond, vZero));
+        _mm_storeu_si128(pvDest + 3, _mm_unpackhi_epi8(vSecond, vZero));
+    }
+
+    return i;
+}
+
+static SIZE_T HexDecodeSse2(
+    __in_ecount(2 * cbDest) LPCWSTR wzSource,
+    __out_bcount(cbDest) BYTE* pbDest,
+    __in SIZE_T cbDest
+    )
+{
+    const __m128i vLowByte = _mm_set1_epi16(0x00FF);
+    SIZE_T i = 0;
+
+    for (; i + sizeof(__m128i) <= cbDest; i += sizeof(__m128i))
+    {
+        const __m128i* pvSource = reinterpret_cast<const __m128i*>(wzSource + 2 * i);
+        __m128i vNibbles1;
+        __m128i vNibbles2;
+
+        // Narrow to bytes, characters above 0xFF saturate to 0x00 or 0xFF which are rejected as non-hex below.
+        __m128i vChars1 = _mm_packus_epi16(_mm_loadu_si128(pvSource), _mm_loadu_si128(pvSource + 1));
+        __m128i vChars2 = _mm_packus_epi16(_mm_loadu_si128(pvSource + 2), _mm_loadu_si128(pvSource + 3));
+
+        if (!HexCharsToNibblesSse2(vChars1, &vNibbles1) || !HexCharsToNibblesSse2(vChars2, &vNibbles2))
+        {
+            break;
+        }
+
+        // Each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte.
+        __m128i vBytes1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(vNibbles1, vLowByte), 4), _mm_srli_epi16(vNibbles1, 8));
+        __m128i vBytes2 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(vNibbles2, vLowByte), 4), _mm_srli_epi16(vNibbles2, 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pbDest + i), _mm_packus_epi16(vBytes1, vBytes2));
+    }
+
+    return i;
+}
+
+static BOOL HexCharsToNibblesSse2(
+    __in __m128i vChars,
+    __out __m128i* pvNibbles
+    )
+{
+    // SSE2 only has signed byte compares, so flip the top bit to do the unsigned range checks.
+    const __m128i vBias = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i vDigit = _mm_sub_epi8(vChars, _mm_set1_epi8('0'));
+    __m128i vIsDigit = _mm_cmplt_epi8(_mm_xor_si128(vDigit, vBias), _mm_set1_epi8(static_cast<char>(0x80 + 10)));
+    __m128i vLetter = _mm_sub_epi8(_mm_or_si128(vChars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i vIsLetter = _mm_cmplt_epi8(_mm_xor_si128(vLetter, vBias), _mm_set1_epi8(static_cast<char>(0x80 + 6)));
+
+    if (0xFFFF != _mm_movemask_epi8(_mm_or_si128(vIsDigit, vIsLetter)))
+    {
+        return FALSE;
+    }
+
+    *pvNibbles = _mm_or_si128(_mm_and_si128(vIsDigit, vDigit), _mm_and_si128(vIsLetter, _mm_add_epi8(vLetter, _mm_set1_epi8(10))));
+    return TRUE;
+}
+
+static SIZE_T Base85EncodeSse2(
+    __in_ecount(cbSource) const BYTE* pbSource,
+    __in SIZE_T cbSource,
+    __out_ecount(cbSource / 4 * 5) LPWSTR wzDest
+    )
+{
+    // n / 85 == (n * 0xC0C0C0C1) >> 38 for every 32-bit n.
+    const __m128i vReciprocal = _mm_set1_epi32(static_cast<int>(0xC0C0C0C1));
+    const __m128i vLowDword = _mm_set_epi32(0, -1, 0, -1);
+    const __m128i vThree = _mm_set1_epi32(3);
+    const __m128i vOne = _mm_set1_epi32(1);
+    const __m128i vFirstChar = _mm_set1_epi32('!');
+    DWORD rgdwChars[5][4];
+    SIZE_T iSource = 0;
+    SIZE_T iDest = 0;
+
+    // Like the scalar loop, always leave at least one byte for the remainder.
+    for (; iSource + 4 * sizeof(DWORD) < cbSource; iSource += 4 * sizeof(DWORD), iDest += 4 * 5)
+    {
+        __m128i vWords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbSource + iSource));
+
+        for (DWORD iDigit = 0; iDigit < 5; ++iDigit)
+        {
+            __m128i vDigits = vWords;
+
+            if (iDigit < 4)
+            {
+                __m128i vEven = _mm_srli_epi64(_mm_mul_epu32(vWords, vReciprocal), 38);
+                __m128i vOdd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(vWords, 32), vReciprocal), 38);
+                __m128i vQuotient = _mm_or_si128(_mm_and_si128(vEven, vLowDword), _mm_slli_epi64(vOdd, 32));
+
+                // quotient * 85 == quotient * (64 + 16 + 4 + 1)
+                __m128i vProduct = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(vQuotient, 6), _mm_slli_epi32(vQuotient, 4)), _mm_add_epi32(_mm_slli_epi32(vQuotient, 2), vQuotient));
+
+                vDigits = _mm_sub_epi32(vWords, vProduct);
+                vWords = vQuotient;
+            }
+
+            // Map digits to Base85EncodeTable by skipping the gaps before '%', '\'', '?', ']' and 'a'.
+            __m128i vChars = _mm_add_epi32(vDigits, vFirstChar);
+            vChars = _mm_add_epi32(vChars, _mm_and_si128(_mm_cmpgt_epi32(vDigits, _mm_setzero_si128()), vThree));
+            vChars = _mm_add_epi32(vChars, _mm_and_si128(_mm_cmpgt_epi32(vDigits, _mm_set1_epi32(1)), vOne));
+            vChars = _mm_add_epi32(vChars, _mm_and_si128(_mm_cmpgt_epi32(vDigits, _mm_set1_epi32(22)), vThree));
+            vChars = _mm_add_epi32(vChars, _mm_and_si128(_mm_cmpgt_epi32(vDigits, _mm_set1_epi32(51)), vOne));
+            vChars = _mm_add_epi32(vChars, _mm_and_si128(_mm_cmpgt_epi32(vDigits, _mm_set1_epi32(54)), vOne));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgdwChars[iDigit]), vChars);
+        }
+
+        for (DWORD iWord = 0; iWord < 4; ++iWord)
+        {
+            for (DWORD iDigit = 0; iDigit < 5; ++iDigit)
+            {
+                wzDest[iDest + iWord * 5 + iDigit] = static_cast<WCHAR>(rgdwChars[iDigit][iWord]);
+            }
+        }
+    }
+
+    return iSource;
+}
+#endif
@@ -19,6 +19,115 @@
 #define ThrdExitOnGdipFailure(g, x, s, ...) ExitOnGdipFailureSource(DUTIL_SOURCE_THRDUTIL, g, x, s, __VA_ARGS__)
 #define ThrdExitOnWaitObjectFailure(x, b, s, ...) ExitOnWaitObjectFailureSource(DUTIL_SOURCE_THRDUTIL, x, b, s, __VA_ARGS__)
 
+#define THRD_PRIORITY_LANES (THRD_PRIORITY_LOW + 1)
+
+const DWORD THRD_POOL_MAX_THREADS = 64;
+const DWORD THRD_DEQUE_INITIAL_CAPACITY = 64;
+const DWORD THRD_INJECTION_SEGMENT_SIZE = 256;
+
+// How long a worker waiting on a group sleeps before looking for work to run again.
+const DWORD THRD_HELP_WAIT_SLICE = 1;
+
+struct THRD_GROUP_STRUCT;
+struct THRD_POOL_STRUCT;
+
+struct THRD_TASK
+{
+    PFN_THRDPOOL_WORK pfnWork;
+    LPVOID pvContext;
+    THRD_GROUP_STRUCT* pGroup;
+};
+
+// The owning worker pushes and pops at the bottom so nested work runs while it is still
+// warm in the cache. Thieves take from the top, which is the oldest and usually largest work.
+struct THRD_DEQUE
+{
+    CRITICAL_SECTION cs;
+    volatile LONG cTasks;
+    THRD_TASK** rgpTasks;
+    DWORD cCapacity;
+    DWORD iTop;
+    DWORD iBottom;
+};
+
+struct THRD_WORKER
+{
+    THRD_POOL_STRUCT* pPool;
+    HANDLE hThread;
+    volatile DWORD dwThreadId;
+    DWORD dwStealSeed;
+    THRD_DEQUE rgDeques[THRD_PRIORITY_LANES];
+};
+
+struct THRD_POOL_STRUCT
+{
+    DWORD cWorkers;
+    THRD_WORKER* rgWorkers;
+
+    // Work submitted from threads outside the pool.
+    QUEUTIL_SEGMENTED_HANDLE rghInjection[THRD_PRIORITY_LANES];
+
+    volatile LONG cQueued;
+    volatile LONG cIdle;
+    HANDLE hWorkSemaphore;
+    volatile LONG fShutdown;
+};
+
+// The group is freed when the creator has destroyed it and the last of its work has completed.
+struct THRD_GROUP_STRUCT
+{
+    THRD_POOL_STRUCT* pPool;
+    volatile LONG cRefs;
+    volatile LONG cOutstanding;
+    volatile LONG fCancelled;
+    volatile LONG hrFailure;
+    HANDLE hCompleteEvent;
+};
+
+// Guards the shared pool and its reference count, so no initializer returns before the pool is published.
+static SRWLOCK vsrwSharedPool = SRWLOCK_INIT;
+static DWORD vcPoolInitialized = 0;
+static THRD_POOL_STRUCT* volatile vpSharedPool = NULL;
+
+static DWORD WINAPI WorkerThreadProc(
+    __in LPVOID pvContext
+    );
+static THRD_WORKER* PoolFindCurrentWorker(
+    __in THRD_POOL_STRUCT* pPool
+    );
+static THRD_TASK* PoolTakeTask(
+    __in THRD_POOL_STRUCT* pPool,
+    __in THRD_WORKER* pWorker
+    );
+static THRD_TASK* PoolStealTask(
+    __in THRD_POOL_STRUCT* pPool,
+    __in THRD_WORKER* pThief,
+    __in DWORD iLane
+    );
+static BOOL PoolClaimIdleWorker(
+    __in THRD_POOL_STRUCT* pPool
+    );
+static HRESULT DequePushBottom(
+    __in THRD_DEQUE* pDeque,
+    __in THRD_TASK* pTask
+    );
+static THRD_TASK* DequePopBottom(
+    __in THRD_DEQUE* pDeque
+    );
+static THRD_TASK* DequeStealTop(
+    __in THRD_DEQUE* pDeque
+    );
+static void TaskComplete(
+    __in THRD_TASK* pTask,
+    __in BOOL fRun
+    );
+static void GroupCompleteTask(
+    __in THRD_GROUP_STRUCT* pGroup
+    );
+static void GroupRelease(
+    __in THRD_GROUP_STRUCT* pGroup
+    );
+
 DAPI_(HRESULT) ThrdWaitForCompletion(
     __in HANDLE hThread,
     __in DWORD dwTimeout,
@@ -44,3 +153,678 @@ DAPI_(HRESULT) ThrdWaitForCompletion(
 LExit:
     return hr;
 }
+
+
+DAPI_(HRESULT) ThrdPoolInitialize(
+    __in DWORD cThreads
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_POOL_HANDLE hPool = NULL;
+
+    ::AcquireSRWLockExclusive(&vsrwSharedPool);
+
+    if (!vcPoolInitialized)
+    {
+        hr = ThrdPoolCreate(cThreads, &hPool);
+        ThrdExitOnFailure(hr, "Failed to create shared thread pool.");
+
+        vpSharedPool = static_cast<THRD_POOL_STRUCT*>(hPool);
+    }
+
+    ++vcPoolInitialized;
+
+LExit:
+    ::ReleaseSRWLockExclusive(&vsrwSharedPool);
+
+    return hr;
+}
+
+DAPI_(void) ThrdPoolUninitialize(
+    )
+{
+    THRD_POOL_HANDLE hPool = NULL;
+
+    ::AcquireSRWLockExclusive(&vsrwSharedPool);
+
+    if (vcPoolInitialized && 0 == --vcPoolInitialized)
+    {
+        hPool = vpSharedPool;
+        vpSharedPool = NULL;
+    }
+
+    ::ReleaseSRWLockExclusive(&vsrwSharedPool);
+
+    // Outside the lock since it waits for the workers to finish.
+    ReleaseThreadPool(hPool);
+}
+
+DAPI_(HRESULT) ThrdPoolCreate(
+    __in DWORD cThreads,
+    __out THRD_POOL_HANDLE* phPool
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_POOL_STRUCT* pPool = NULL;
+    SYSTEM_INFO systemInfo = { };
+
+    if (!cThreads)
+    {
+        ::GetSystemInfo(&systemInfo);
+        cThreads = systemInfo.dwNumberOfProcessors;
+    }
+
+    cThreads = min(cThreads, THRD_POOL_MAX_THREADS);
+
+    pPool = static_cast<THRD_POOL_STRUCT*>(MemAlloc(sizeof(THRD_POOL_STRUCT), TRUE));
+    ThrdExitOnNull(pPool, hr, E_OUTOFMEMORY, "Failed to allocate thread pool.");
+
+    pPool->hWorkSemaphore = ::CreateSemaphoreW(NULL, 0, LONG_MAX, NULL);
+    ThrdExitOnNullWithLastError(pPool->hWorkSemaphore, hr, "Failed to create thread pool semaphore.");
+
+    for (DWORD i = 0; i < THRD_PRIORITY_LANES; ++i)
+    {
+        hr = QueSegmentedCreate(THRD_INJECTION_SEGMENT_SIZE, &pPool->rghInjection[i]);
+        ThrdExitOnFailure(hr, "Failed to create thread pool injection queue.");
+    }
+
+    pPool->rgWorkers = static_cast<THRD_WORKER*>(MemAlloc(sizeof(THRD_WORKER) * cThreads, TRUE));
+    ThrdExitOnNull(pPool->rgWorkers, hr, E_OUTOFMEMORY, "Failed to allocate thread pool workers.");
+
+    for (DWORD i = 0; i < cThreads; ++i)
+    {
+        THRD_WORKER* pWorker = pPool->rgWorkers + i;
+
+        pWorker->pPool = pPool;
+        pWorker->dwStealSeed = i + 1;
+
+        for (DWORD iLane = 0; iLane < THRD_PRIORITY_LANES; ++iLane)
+        {
+            ::InitializeCriticalSection(&pWorker->rgDeques[iLane].cs);
+        }
+    }
+
+    // Every worker must be visible to thieves before the first one starts.
+    pPool->cWorkers = cThreads;
+
+    for (DWORD i = 0; i < cThreads; ++i)
+    {
+        pPool->rgWorkers[i].hThread = ::CreateThread(NULL, 0, WorkerThreadProc, pPool->rgWorkers + i, 0, NULL);
+        ThrdExitOnNullWithLastError(pPool->rgWorkers[i].hThread, hr, "Failed to create thread pool worker.");
+    }
+
+    *phPool = pPool;
+    pPool = NULL;
+
+LExit:
+    ReleaseThreadPool(pPool);
+
+    return hr;
+}
+
+DAPI_(DWORD) ThrdPoolGetThreadCount(
+    __in_opt THRD_POOL_HANDLE hPool
+    )
+{
+    DWORD cThreads = 0;
+
+    if (hPool)
+    {
+        cThreads = static_cast<THRD_POOL_STRUCT*>(hPool)->cWorkers;
+    }
+    else
+    {
+        // Read under the lock so ThrdPoolUninitialize() can't take the shared pool away in between.
+        ::AcquireSRWLockShared(&vsrwSharedPool);
+
+        if (vpSharedPool)
+        {
+            cThreads = vpSharedPool->cWorkers;
+        }
+
+        ::ReleaseSRWLockShared(&vsrwSharedPool);
+    }
+
+    return cThreads;
+}
+
+DAPI_(void) ThrdPoolDestroy(
+    __in THRD_POOL_HANDLE hPool
+    )
+{
+    THRD_POOL_STRUCT* pPool = static_cast<THRD_POOL_STRUCT*>(hPool);
+    THRD_TASK* pTask = NULL;
+    void* pvTask = NULL;
+
+    ::InterlockedExchange(&pPool->fShutdown, TRUE);
+
+    if (pPool->hWorkSemaphore && pPool->cWorkers)
+    {
+        ::ReleaseSemaphore(pPool->hWorkSemaphore, pPool->cWorkers, NULL);
+    }
+
+    for (DWORD i = 0; i < pPool->cWorkers; ++i)
+    {
+        if (pPool->rgWorkers[i].hThread)
+        {
+            ::WaitForSingleObject(pPool->rgWorkers[i].hThread, INFINITE);
+            ReleaseHandle(pPool->rgWorkers[i].hThread);
+        }
+    }
+
+    // Complete any work that never ran so nothing waiting on its group is left blocked.
+    for (DWORD i = 0; i < pPool->cWorkers; ++i)
+    {
+        for (DWORD iLane = 0; iLane < THRD_PRIORITY_LANES; ++iLane)
+        {
+            THRD_DEQUE* pDeque = pPool->rgWorkers[i].rgDeques + iLane;
+
+            while (NULL != (pTask = DequePopBottom(pDeque)))
+            {
+                TaskComplete(pTask, FALSE);
+            }
+
+            ReleaseMem(pDeque->rgpTasks);
+            ::DeleteCriticalSection(&pDeque->cs);
+        }
+    }
+
+    for (DWORD i = 0; i < THRD_PRIORITY_LANES; ++i)
+    {
+        if (pPool->rghInjection[i])
+        {
+            while (SUCCEEDED(QueSegmentedTryDequeue(pPool->rghInjection[i], &pvTask)))
+            {
+                TaskComplete(static_cast<THRD_TASK*>(pvTask), FALSE);
+            }
+
+            QueSegmentedDestroy(pPool->rghInjection[i], NULL, NULL);
+        }
+    }
+
+    ReleaseHandle(pPool->hWorkSemaphore);
+    ReleaseMem(pPool->rgWorkers);
+    MemFree(pPool);
+}
+
+DAPI_(HRESULT) ThrdGroupCreate(
+    __in_opt THRD_POOL_HANDLE hPool,
+    __out THRD_GROUP_HANDLE* phGroup
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_POOL_STRUCT* pPool = hPool ? static_cast<THRD_POOL_STRUCT*>(hPool) : vpSharedPool;
+    THRD_GROUP_STRUCT* pGroup = NULL;
+
+    if (!pPool)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+        ThrdExitOnRootFailure(hr, "ThrdPoolInitialize() must be called before using the shared thread pool.");
+    }
+
+    pGroup = static_cast<THRD_GROUP_STRUCT*>(MemAlloc(sizeof(THRD_GROUP_STRUCT), TRUE));
+    ThrdExitOnNull(pGroup, hr, E_OUTOFMEMORY, "Failed to allocate thread group.");
+
+    pGroup->pPool = pPool;
+    pGroup->cRefs = 1;
+
+    pGroup->hCompleteEvent = ::CreateEventW(NULL, TRUE, TRUE, NULL);
+    ThrdExitOnNullWithLastError(pGroup->hCompleteEvent, hr, "Failed to create thread group event.");
+
+    *phGroup = pGroup;
+    pGroup = NULL;
+
+LExit:
+    if (pGroup)
+    {
+        GroupRelease(pGroup);
+    }
+
+    return hr;
+}
+
+DAPI_(HRESULT) ThrdGroupSubmit(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in THRD_PRIORITY priority,
+    __in PFN_THRDPOOL_WORK pfnWork,
+    __in_opt LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_GROUP_STRUCT* pGroup = static_cast<THRD_GROUP_STRUCT*>(hGroup);
+    THRD_POOL_STRUCT* pPool = pGroup->pPool;
+    THRD_WORKER* pWorker = NULL;
+    THRD_TASK* pTask = NULL;
+
+    if (THRD_PRIORITY_LANES <= static_cast<DWORD>(priority))
+    {
+        hr = E_INVALIDARG;
+        ThrdExitOnRootFailure(hr, "Invalid thread pool priority: %u", priority);
+    }
+
+    if (::ReadAcquire(&pGroup->fCancelled))
+    {
+        ExitFunction1(hr = HRESULT_FROM_WIN32(ERROR_CANCELLED));
+    }
+
+    pTask = static_cast<THRD_TASK*>(MemAlloc(sizeof(THRD_TASK), FALSE));
+    ThrdExitOnNull(pTask, hr, E_OUTOFMEMORY, "Failed to allocate thread pool work.");
+
+    pTask->pfnWork = pfnWork;
+    pTask->pvContext = pvContext;
+    pTask->pGroup = pGroup;
+
+    ::InterlockedIncrement(&pGroup->cRefs);
+    ::InterlockedIncrement(&pGroup->cOutstanding);
+
+    pWorker = PoolFindCurrentWorker(pPool);
+    if (pWorker)
+    {
+        hr = DequePushBottom(pWorker->rgDeques + priority, pTask);
+    }
+    else
+    {
+        hr = QueSegmentedEnqueue(pPool->rghInjection[priority], pTask);
+    }
+
+    if (FAILED(hr))
+    {
+        GroupCompleteTask(pGroup);
+    }
+    ThrdExitOnFailure(hr, "Failed to queue thread pool work.");
+
+    pTask = NULL;
+
+    // Counting the work is a full barrier, so any worker that went idle before it either
+    // sees the count or is registered in cIdle by now.
+    ::InterlockedIncrement(&pPool->cQueued);
+
+    if (PoolClaimIdleWorker(pPool))
+    {
+        ::ReleaseSemaphore(pPool->hWorkSemaphore, 1, NULL);
+    }
+
+LExit:
+    ReleaseMem(pTask);
+
+    return hr;
+}
+
+DAPI_(HRESULT) ThrdGroupWait(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in DWORD dwTimeout
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_GROUP_STRUCT* pGroup = static_cast<THRD_GROUP_STRUCT*>(hGroup);
+    THRD_WORKER* pWorker = NULL;
+    THRD_TASK* pTask = NULL;
+    DWORD dwStart = ::GetTickCount();
+    DWORD dwRemaining = dwTimeout;
+    DWORD dwElapsed = 0;
+    BOOL fTimedOut = FALSE;
+
+    // Only look at the pool while there is work outstanding; a destroyed pool completes all of its work first.
+    if (0 < ::ReadAcquire(&pGroup->cOutstanding))
+    {
+        pWorker = PoolFindCurrentWorker(pGroup->pPool);
+    }
+
+    while (0 < ::ReadAcquire(&pGroup->cOutstanding))
+    {
+        // A worker that blocked here would take a thread away from the very work it is
+        // waiting on, so it runs whatever is queued instead.
+        pTask = pWorker ? PoolTakeTask(pGroup->pPool, pWorker) : NULL;
+        if (pTask)
+        {
+            TaskComplete(pTask, TRUE);
+        }
+        else
+        {
+            hr = AppWaitForSingleObject(pGroup->hCompleteEvent, pWorker ? min(dwRemaining, THRD_HELP_WAIT_SLICE) : dwRemaining);
+            ThrdExitOnWaitObjectFailure(hr, fTimedOut, "Failed to wait for thread group.");
+
+            // The event may still be set from an earlier time the group drained. Reset it
+            // and let the loop check the count again; draining again will set it.
+            ::ResetEvent(pGroup->hCompleteEvent);
+        }
+
+        if (INFINITE != dwTimeout)
+        {
+            dwElapsed = ::GetTickCount() - dwStart;
+            if (dwElapsed >= dwTimeout)
+            {
+                if (0 < ::ReadAcquire(&pGroup->cOutstanding))
+                {
+                    ExitFunction1(hr = HRESULT_FROM_WIN32(WAIT_TIMEOUT));
+                }
+
+                break;
+            }
+
+            dwRemaining = dwTimeout - dwElapsed;
+        }
+    }
+
+    hr = ::ReadAcquire(&pGroup->hrFailure);
+    if (SUCCEEDED(hr) && ::ReadAcquire(&pGroup->fCancelled))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+    }
+
+LExit:
+    return hr;
+}
+
+DAPI_(void) ThrdGroupCancel(
+    __in THRD_GROUP_HANDLE hGroup
+    )
+{
+    THRD_GROUP_STRUCT* pGroup = static_cast<THRD_GROUP_STRUCT*>(hGroup);
+
+    ::InterlockedExchange(&pGroup->fCancelled, TRUE);
+}
+
+DAPI_(BOOL) ThrdGroupIsCancelled(
+    __in THRD_GROUP_HANDLE hGroup
+    )
+{
+    THRD_GROUP_STRUCT* pGroup = static_cast<THRD_GROUP_STRUCT*>(hGroup);
+
+    return ::ReadAcquire(&pGroup->fCancelled) ? TRUE : FALSE;
+}
+
+DAPI_(void) ThrdGroupDestroy(
+    __in THRD_GROUP_HANDLE hGroup
+    )
+{
+    THRD_GROUP_STRUCT* pGroup = static_cast<THRD_GROUP_STRUCT*>(hGroup);
+
+    ThrdGroupCancel(pGroup);
+    ThrdGroupWait(pGroup, INFINITE);
+
+    GroupRelease(pGroup);
+}
+
+
+static DWORD WINAPI WorkerThreadProc(
+    __in LPVOID pvContext
+    )
+{
+    THRD_WORKER* pWorker = static_cast<THRD_WORKER*>(pvContext);
+    THRD_POOL_STRUCT* pPool = pWorker->pPool;
+    THRD_TASK* pTask = NULL;
+
+    pWorker->dwThreadId = ::GetCurrentThreadId();
+
+    while (!::ReadAcquire(&pPool->fShutdown))
+    {
+        pTask = PoolTakeTask(pPool, pWorker);
+        if (pTask)
+        {
+            TaskComplete(pTask, TRUE);
+            continue;
+        }
+
+        ::InterlockedIncrement(&pPool->cIdle);
+
+        // Check again now that submitters will wake this worker so work queued in between isn't missed.
+        if (0 < ::ReadAcquire(&pPool->cQueued) || ::ReadAcquire(&pPool->fShutdown))
+        {
+            // If a submitter already claimed this worker it has released the semaphore for it, so that wake must be consumed.
+            if (!PoolClaimIdleWorker(pPool))
+            {
+                ::WaitForSingleObject(pPool->hWorkSemaphore, INFINITE);
+            }
+        }
+        else
+        {
+            ::WaitForSingleObject(pPool->hWorkSemaphore, INFINITE);
+        }
+    }
+
+    return 0;
+}
+
+static THRD_WORKER* PoolFindCurrentWorker(
+    __in THRD_POOL_STRUCT* pPool
+    )
+{
+    DWORD dwThreadId = ::GetCurrentThreadId();
+
+    for (DWORD i = 0; i < pPool->cWorkers; ++i)
+    {
+        if (dwThreadId == pPool->rgWorkers[i].dwThreadId)
+        {
+            return pPool->rgWorkers + i;
+        }
+    }
+
+    return NULL;
+}
+
+static THRD_TASK* PoolTakeTask(
+    __in THRD_POOL_STRUCT* pPool,
+    __in THRD_WORKER* pWorker
+    )
+{
+    THRD_TASK* pTask = NULL;
+    void* pvTask = NULL;
+
+    if (0 >= ::ReadAcquire(&pPool->cQueued))
+    {
+        ExitFunction();
+    }
+
+    // Higher priority work anywhere in the pool is taken before lower priority local work.
+    for (DWORD iLane = 0; !pTask && iLane < THRD_PRIORITY_LANES; ++iLane)
+    {
+        pTask = DequePopBottom(pWorker->rgDeques + iLane);
+
+        if (!pTask && SUCCEEDED(QueSegmentedTryDequeue(pPool->rghInjection[iLane], &pvTask)))
+        {
+            pTask = static_cast<THRD_TASK*>(pvTask);
+        }
+
+        if (!pTask)
+        {
+            pTask = PoolStealTask(pPool, pWorker, iLane);
+        }
+    }
+
+    if (pTask)
+    {
+        ::InterlockedDecrement(&pPool->cQueued);
+    }
+
+LExit:
+    return pTask;
+}
+
+static THRD_TASK* PoolStealTask(
+    __in THRD_POOL_STRUCT* pPool,
+    __in THRD_WORKER* pThief,
+    __in DWORD iLane
+    )
+{
+    THRD_TASK* pTask = NULL;
+    DWORD dwSeed = pThief->dwStealSeed;
+
+    // Start at a random victim so thieves spread out instead of all hitting the first worker.
+    dwSeed ^= dwSeed << 13;
+    dwSeed ^= dwSeed >> 17;
+    dwSeed ^= dwSeed << 5;
+    pThief->dwStealSeed = dwSeed;
+
+    for (DWORD i = 0; !pTask && i < pPool->cWorkers; ++i)
+    {
+        THRD_WORKER* pVictim = pPool->rgWorkers + (dwSeed + i) % pPool->cWorkers;
+
+        if (pVictim != pThief)
+        {
+            pTask = DequeStealTop(pVictim->rgDeques + iLane);
+        }
+    }
+
+    return pTask;
+}
+
+static BOOL PoolClaimIdleWorker(
+    __in THRD_POOL_STRUCT* pPool
+    )
+{
+    LONG cIdle = ::ReadAcquire(&pPool->cIdle);
+
+    while (0 < cIdle)
+    {
+        LONG cPrevious = ::InterlockedCompareExchange(&pPool->cIdle, cIdle - 1, cIdle);
+        if (cPrevious == cIdle)
+        {
+            return TRUE;
+        }
+
+        cIdle = cPrevious;
+    }
+
+    return FALSE;
+}
+
+static HRESULT DequePushBottom(
+    __in THRD_DEQUE* pDeque,
+    __in THRD_TASK* pTask
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_TASK** rgpTasks = NULL;
+    DWORD cCapacity = 0;
+
+    ::EnterCriticalSection(&pDeque->cs);
+
+    if (pDeque->iBottom - pDeque->iTop == pDeque->cCapacity)
+    {
+        cCapacity = pDeque->cCapacity ? pDeque->cCapacity * 2 : THRD_DEQUE_INITIAL_CAPACITY;
+
+        rgpTasks = static_cast<THRD_TASK**>(MemAlloc(sizeof(THRD_TASK*) * cCapacity, FALSE));
+        ThrdExitOnNull(rgpTasks, hr, E_OUTOFMEMORY, "Failed to grow thread pool deque.");
+
+        // The indices keep counting up and wrap, so each task keeps its index and is only
+        // masked into the larger array.
+        for (DWORD i = pDeque->iTop; i != pDeque->iBottom; ++i)
+        {
+            rgpTasks[i & (cCapacity - 1)] = pDeque->rgpTasks[i & (pDeque->cCapacity - 1)];
+        }
+
+        ReleaseMem(pDeque->rgpTasks);
+        pDeque->rgpTasks = rgpTasks;
+        pDeque->cCapacity = cCapacity;
+    }
+
+    pDeque->rgpTasks[pDeque->iBottom & (pDeque->cCapacity - 1)] = pTask;
+    ++pDeque->iBottom;
+
+    ::InterlockedIncrement(&pDeque->cTasks);
+
+LExit:
+    ::LeaveCriticalSection(&pDeque->cs);
+
+    return hr;
+}
+
+static THRD_TASK* DequePopBottom(
+    __in THRD_DEQUE* pDeque
+    )
+{
+    THRD_TASK* pTask = NULL;
+
+    // Skip the lock when the deque is empty, which is the common case for thieves scanning the pool.
+    if (0 < ::ReadNoFence(&pDeque->cTasks))
+    {
+        ::EnterCriticalSection(&pDeque->cs);
+
+        if (pDeque->iBottom != pDeque->iTop)
+        {
+            --pDeque->iBottom;
+            pTask = pDeque->rgpTasks[pDeque->iBottom & (pDeque->cCapacity - 1)];
+
+            ::InterlockedDecrement(&pDeque->cTasks);
+        }
+
+        ::LeaveCriticalSection(&pDeque->cs);
+    }
+
+    return pTask;
+}
+
+static THRD_TASK* DequeStealTop(
+    __in THRD_DEQUE* pDeque
+    )
+{
+    THRD_TASK* pTask = NULL;
+
+    if (0 < ::ReadNoFence(&pDeque->cTasks))
+    {
+        ::EnterCriticalSection(&pDeque->cs);
+
+        if (pDeque->iBottom != pDeque->iTop)
+        {
+            pTask = pDeque->rgpTasks[pDeque->iTop & (pDeque->cCapacity - 1)];
+            ++pDeque->iTop;
+
+            ::InterlockedDecrement(&pDeque->cTasks);
+        }
+
+        ::LeaveCriticalSection(&pDeque->cs);
+    }
+
+    return pTask;
+}
+
+static void TaskComplete(
+    __in THRD_TASK* pTask,
+    __in BOOL fRun
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_GROUP_STRUCT* pGroup = pTask->pGroup;
+
+    if (!fRun)
+    {
+        // Work dropped by a destroyed pool is reported the same as cancelled work.
+        ::InterlockedExchange(&pGroup->fCancelled, TRUE);
+    }
+    else if (!::ReadAcquire(&pGroup->fCancelled))
+    {
+        hr = pTask->pfnWork(pGroup, pTask->pvContext);
+        if (FAILED(hr))
+        {
+            ::InterlockedCompareExchange(&pGroup->hrFailure, hr, S_OK);
+        }
+    }
+
+    MemFree(pTask);
+
+    GroupCompleteTask(pGroup);
+}
+
+static void GroupCompleteTask(
+    __in THRD_GROUP_STRUCT* pGroup
+    )
+{
+    if (0 == ::InterlockedDecrement(&pGroup->cOutstanding))
+    {
+        ::SetEvent(pGroup->hCompleteEvent);
+    }
+
+    GroupRelease(pGroup);
+}
+
+static void GroupRelease(
+    __in THRD_GROUP_STRUCT* pGroup
+    )
+{
+    if (0 == ::InterlockedDecrement(&pGroup->cRefs))
+    {
+        ReleaseHandle(pGroup->hCompleteEvent);
+        MemFree(pGroup);
+    }
+}
@@ -17,12 +17,39 @@
 
 // constants
 const DWORD GROW_RELEASE_LABELS = 3;
+const DWORD GROW_CACHE_ENTRIES = 64;
+const DWORD MAX_CACHE_ENTRIES = 4096;
+
+// structs
+typedef struct _VERUTIL_CACHE_ENTRY
+{
+    LPWSTR sczKey;
+    VERUTIL_VERSION* pVersion;
+} VERUTIL_CACHE_ENTRY;
+
+// globals
+static volatile LONG vcVerCacheInitialized = 0;
+static CRITICAL_SECTION vcsVerCache = { };
+static STRINGDICT_HANDLE vsdVerCache = NULL;
+static VERUTIL_CACHE_ENTRY** vrgpVerCacheEntries = NULL;
+static DWORD vcVerCacheEntries = 0;
 
 // Forward declarations.
+static HRESULT AddCacheEntry(
+    __in_z LPCWSTR wzKey,
+    __in VERUTIL_VERSION* pVersion
+    );
+static void PackVersion(
+    __in VERUTIL_VERSION* pVersion
+    );
 static int CompareDword(
     __in const DWORD& dw1,
     __in const DWORD& dw2
     );
+static int CompareQword(
+    __in const DWORD64& qw1,
+    __in const DWORD64& qw2
+    );
 static HRESULT CompareReleaseLabel(
     __in const VERUTIL_VERSION_RELEASE_LABEL* p1,
     __in LPCWSTR wzVersion1,
@@ -39,6 +66,139 @@ static HRESULT CompareVersionSubstring(
     );
 
 
+DAPI_(HRESULT) VerCacheInitialize(
+    __in DWORD cExpectedVersions
+    )
+{
+    HRESULT hr = S_OK;
+
+    LONG cInitialized = ::InterlockedIncrement(&vcVerCacheInitialized);
+    if (1 == cInitialized)
+    {
+        ::InitializeCriticalSection(&vcsVerCache);
+
+        hr = DictCreateWithEmbeddedKey(&vsdVerCache, cExpectedVersions, NULL, offsetof(VERUTIL_CACHE_ENTRY, sczKey), DICT_FLAG_NONE);
+        VerExitOnFailure(hr, "Failed to create version cache dictionary.");
+    }
+
+LExit:
+    if (FAILED(hr))
+    {
+        ::DeleteCriticalSection(&vcsVerCache);
+        ::InterlockedDecrement(&vcVerCacheInitialized);
+    }
+
+    return hr;
+}
+
+DAPI_(void) VerCacheUninitialize(
+    )
+{
+    AssertSz(vcVerCacheInitialized, "VerCacheUninitialize called when not initialized");
+
+    LONG cInitialized = ::InterlockedDecrement(&vcVerCacheInitialized);
+    if (0 == cInitialized)
+    {
+        for (DWORD i = 0; i < vcVerCacheEntries; ++i)
+        {
+            VERUTIL_CACHE_ENTRY* pEntry = vrgpVerCacheEntries[i];
+
+            // Only releases the cache's reference, callers may still hold the version.
+            ReleaseVerutilVersion(pEntry->pVersion);
+            ReleaseStr(pEntry->sczKey);
+            MemFree(pEntry);
+        }
+
+        ReleaseNullMem(vrgpVerCacheEntries);
+        vcVerCacheEntries = 0;
+
+        ReleaseNullDict(vsdVerCache);
+
+        ::DeleteCriticalSection(&vcsVerCache);
+    }
+}
+
+DAPI_(HRESULT) VerCacheParseVersion(
+    __in_z LPCWSTR wzVersion,
+    __in SIZE_T cchVersion,
+    __in BOOL fStrict,
+    __out VERUTIL_VERSION** ppVersion
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczKey = NULL;
+    LPCWSTR wzKey = wzVersion;
+    VERUTIL_CACHE_ENTRY* pEntry = NULL;
+    VERUTIL_VERSION* pVersion = NULL;
+    BOOL fLocked = FALSE;
+
+    if (!wzVersion || !ppVersion)
+    {
+        ExitFunction1(hr = E_INVALIDARG);
+    }
+
+    if (!vcVerCacheInitialized || !vsdVerCache)
+    {
+        ExitFunction1(hr = VerParseVersion(wzVersion, cchVersion, fStrict, ppVersion));
+    }
+
+    // The dictionary needs a null terminated key.
+    if (cchVersion)
+    {
+        hr = StrAllocString(&sczKey, wzVersion, cchVersion);
+        VerExitOnFailure(hr, "Failed to copy version string to cache key.");
+
+        wzKey = sczKey;
+    }
+
+    ::EnterCriticalSection(&vcsVerCache);
+    fLocked = TRUE;
+
+    hr = DictGetValue(vsdVerCache, wzKey, reinterpret_cast<void**>(&pEntry));
+    if (E_NOTFOUND == hr)
+    {
+        // Always cache the non-strict parse so strict and non-strict callers share the entry.
+        hr = VerParseVersion(wzKey, 0, FALSE, &pVersion);
+        VerExitOnFailure(hr, "Failed to parse Verutil version '%ls' for the cache.", wzKey);
+
+        // Once the cache is full, new versions are handed out uncached.
+        if (MAX_CACHE_ENTRIES > vcVerCacheEntries)
+        {
+            hr = AddCacheEntry(wzKey, pVersion);
+            VerExitOnFailure(hr, "Failed to add Verutil version '%ls' to the cache.", wzKey);
+        }
+    }
+    else
+    {
+        VerExitOnFailure(hr, "Failed to find Verutil version '%ls' in the cache.", wzKey);
+
+        pVersion = pEntry->pVersion;
+        ::InterlockedIncrement(&pVersion->cReferences);
+    }
+
+    ::LeaveCriticalSection(&vcsVerCache);
+    fLocked = FALSE;
+
+    if (fStrict && pVersion->fInvalid)
+    {
+        ExitFunction1(hr = E_INVALIDARG);
+    }
+
+    *ppVersion = pVersion;
+    pVersion = NULL;
+
+LExit:
+    if (fLocked)
+    {
+        ::LeaveCriticalSection(&vcsVerCache);
+    }
+
+    ReleaseVerutilVersion(pVersion);
+    ReleaseStr(sczKey);
+
+    return hr;
+}
+
 DAPI_(HRESULT) VerCompareParsedVersions(
     __in_opt VERUTIL_VERSION* pVersion1,
     __in_opt VERUTIL_VERSION* pVersion2,
@@ -69,6 +229,11 @@ DAPI_(HRESULT) VerCompareParsedVersions(
         ExitFunction1(nResult = -1);
     }
 
+    if (pVersion1->fPacked && pVersion2->fPacked)
+    {
+        ExitFunction1(nResult = CompareQword(pVersion1->qwPacked, pVersion2->qwPacked));
+    }
+
     nResult = CompareDword(pVersion1->dwMajor, pVersion2->dwMajor);
     if (0 != nResult)
     {
@@ -188,6 +353,14 @@ DAPI_(HRESULT) VerCopyVersion(
     HRESULT hr = S_OK;
     VERUTIL_VERSION* pCopy = NULL;
 
+    // Cached versions are immutable so share them instead.
+    if (pSource->cReferences)
+    {
+        ::InterlockedIncrement(&pSource->cReferences);
+        *ppVersion = pSource;
+        ExitFunction();
+    }
+
     pCopy = reinterpret_cast<VERUTIL_VERSION*>(MemAlloc(sizeof(VERUTIL_VERSION), TRUE));
     VerExitOnNull(pCopy, hr, E_OUTOFMEMORY, "Failed to allocate memory for Verutil version copy.");
 
@@ -225,6 +398,8 @@ DAPI_(HRESULT) VerCopyVersion(
 
     pCopy->cchMetadataOffset = pSource->cchMetadataOffset;
     pCopy->fInvalid = pSource->fInvalid;
+    pCopy->fPacked = pSource->fPacked;
+    pCopy->qwPacked = pSource->qwPacked;
 
     *ppVersion = pCopy;
     pCopy = NULL;
@@ -241,6 +416,11 @@ DAPI_(void) VerFreeVersion(
 {
     if (pVersion)
     {
+        if (pVersion->cReferences && 0 < ::InterlockedDecrement(&pVersion->cReferences))
+        {
+            return;
+        }
+
         ReleaseStr(pVersion->sczVersion);
         ReleaseMem(pVersion->rgReleaseLabels);
         ReleaseMem(pVersion);
@@ -531,6 +711,8 @@ DAPI_(HRESULT) VerParseVersion(
     hr = StrAllocString(&pVersion->sczVersion, wzString, cchVersion);
     VerExitOnFailure(hr, "Failed to copy Verutil version string '%ls'.", wzVersion);
 
+    PackVersion(pVersion);
+
     *ppVersion = pVersion;
     pVersion = NULL;
     hr = S_OK;
@@ -567,6 +749,8 @@ DAPI_(HRESULT) VerVersionFromQword(
 
     pVersion->cchMetadataOffset = lstrlenW(pVersion->sczVersion);
 
+    PackVersion(pVersion);
+
     *ppVersion = pVersion;
     pVersion = NULL;
 
@@ -577,6 +761,58 @@ LExit:
 }
 
 
+static HRESULT AddCacheEntry(
+    __in_z LPCWSTR wzKey,
+    __in VERUTIL_VERSION* pVersion
+    )
+{
+    HRESULT hr = S_OK;
+    VERUTIL_CACHE_ENTRY* pEntry = NULL;
+
+    pEntry = reinterpret_cast<VERUTIL_CACHE_ENTRY*>(MemAlloc(sizeof(VERUTIL_CACHE_ENTRY), TRUE));
+    VerExitOnNull(pEntry, hr, E_OUTOFMEMORY, "Failed to allocate memory for Verutil version cache entry.");
+
+    hr = StrAllocString(&pEntry->sczKey, wzKey, 0);
+    VerExitOnFailure(hr, "Failed to copy Verutil version cache key.");
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&vrgpVerCacheEntries), vcVerCacheEntries, 1, sizeof(VERUTIL_CACHE_ENTRY*), GROW_CACHE_ENTRIES);
+    VerExitOnFailure(hr, "Failed to grow Verutil version cache.");
+
+    hr = DictAddValue(vsdVerCache, pEntry);
+    VerExitOnFailure(hr, "Failed to add Verutil version cache entry to dictionary.");
+
+    vrgpVerCacheEntries[vcVerCacheEntries] = pEntry;
+    ++vcVerCacheEntries;
+
+    // One reference for the cache and one for the caller.
+    pVersion->cReferences = 2;
+    pEntry->pVersion = pVersion;
+    pEntry = NULL;
+
+LExit:
+    if (pEntry)
+    {
+        ReleaseStr(pEntry->sczKey);
+        MemFree(pEntry);
+    }
+
+    return hr;
+}
+
+static void PackVersion(
+    __in VERUTIL_VERSION* pVersion
+    )
+{
+    pVersion->fPacked = !pVersion->fInvalid && !pVersion->cReleaseLabels &&
+                        USHRT_MAX >= pVersion->dwMajor && USHRT_MAX >= pVersion->dwMinor &&
+                        USHRT_MAX >= pVersion->dwPatch && USHRT_MAX >= pVersion->dwRevision;
+
+    if (pVersion->fPacked)
+    {
+        pVersion->qwPacked = MAKEQWORDVERSION(pVersion->dwMajor, pVersion->dwMinor, pVersion->dwPatch, pVersion->dwRevision);
+    }
+}
+
 static int CompareDword(
     __in const DWORD& dw1,
     __in const DWORD& dw2
@@ -596,6 +832,25 @@ static int CompareDword(
     return nResult;
 }
 
+static int CompareQword(
+    __in const DWORD64& qw1,
+    __in const DWORD64& qw2
+    )
+{
+    int nResult = 0;
+
+    if (qw1 > qw2)
+    {
+        nResult = 1;
+    }
+    else if (qw1 < qw2)
+    {
+        nResult = -1;
+    }
+
+    return nResult;
+}
+
 static HRESULT CompareReleaseLabel(
     __in const VERUTIL_VERSION_RELEASE_LABEL* p1,
     __in LPCWSTR wzVersion1,
@@ -280,6 +280,24 @@ extern "C" void DAPI WiuFunctionOverride(
 }
 
 
+/********************************************************************
+ WiuPatchFunctionOverride - overrides the Windows installer functions used
+                            to determine patch applicability. Typically used
+                            for unit testing.
+
+*********************************************************************/
+extern "C" void DAPI WiuPatchFunctionOverride(
+    __in_opt PFN_MSIENUMPRODUCTSEXW pfnMsiEnumProductsExW,
+    __in_opt PFN_MSIDETERMINEAPPLICABLEPATCHESW pfnMsiDetermineApplicablePatchesW,
+    __in_opt PFN_MSIDETERMINEPATCHSEQUENCEW pfnMsiDeterminePatchSequenceW
+    )
+{
+    vpfnMsiEnumProductsExW = pfnMsiEnumProductsExW ? pfnMsiEnumProductsExW : vpfnMsiEnumProductsExWFromLibrary;
+    vpfnMsiDetermineApplicablePatchesW = pfnMsiDetermineApplicablePatchesW ? pfnMsiDetermineApplicablePatchesW : vpfnMsiDetermineApplicablePatchesWFromLibrary;
+    vpfnMsiDeterminePatchSequenceW = pfnMsiDeterminePatchSequenceW ? pfnMsiDeterminePatchSequenceW : vpfnMsiDeterminePatchSequenceWFromLibrary;
+}
+
+
 extern "C" HRESULT DAPI WiuGetComponentPath(
     __in_z LPCWSTR wzProductCode,
     __in_z LPCWSTR wzComponentId,
@@ -0,0 +1,254 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+using namespace System;
+using namespace Xunit;
+using namespace WixInternal::TestSupport;
+
+// Internal to cabcutil, so it is not in cabcutil.h.
+extern "C" void DAPI CabCSetSynchronousIo(
+    __in_bcount(CABC_HANDLE_BYTES) HANDLE hContext,
+    __in BOOL fSynchronousIo
+    );
+
+namespace DutilTests
+{
+    public ref class CabCUtil
+    {
+    public:
+        [Fact]
+        void CabCStreamingMatchesSynchronousTest()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczTempDir = NULL;
+            LPWSTR sczSourceDir = NULL;
+            LPWSTR* rgsczFiles = NULL;
+            UINT cFiles = 0;
+            BYTE* pbData = NULL;
+            LPWSTR sczCabPath = NULL;
+            BYTE* pbSynchronous = NULL;
+            SIZE_T cbSynchronous = 0;
+            BYTE* pbStreaming = NULL;
+            SIZE_T cbStreaming = 0;
+            // Sizes around and well past a stream buffer, so reads ahead and writes behind are split and joined.
+            const DWORD rgcbFiles[] = { 1, 4095, 4096, 65537, 1024 * 1024 + 3, 3 * 1024 * 1024 };
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hr = PathExpand(&sczTempDir, L"%TEMP%\\CabCUtilStreamingTest\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::Succeeded(hr, "Failed to get temp dir");
+
+                hr = PathConcat(sczTempDir, L"source\\", &sczSourceDir);
+                NativeAssert::Succeeded(hr, "Failed to get source dir");
+
+                hr = DirEnsureExists(sczSourceDir, NULL);
+                NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczSourceDir);
+
+                pbData = static_cast<BYTE*>(MemAlloc(rgcbFiles[countof(rgcbFiles) - 1], FALSE));
+                Assert::True(NULL != pbData);
+
+                for (DWORD i = 0; i < countof(rgcbFiles); ++i)
+                {
+                    LPWSTR sczFile = NULL;
+
+                    hr = StrAllocFormatted(&sczFile, L"%lsfile%u.dat", sczSourceDir, i);
+                    NativeAssert::Succeeded(hr, "Failed to format source file path");
+
+                    hr = StrArrayAllocString(&rgsczFiles, &cFiles, sczFile, 0);
+                    ReleaseStr(sczFile);
+                    NativeAssert::Succeeded(hr, "Failed to store source file path");
+
+                    for (DWORD j = 0; j < rgcbFiles[i]; ++j)
+                    {
+                        pbData[j] = static_cast<BYTE>((j * 7919 + i) % 251 < 64 ? (j >> 5) : (j % 13));
+                    }
+
+                    hr = FileWrite(rgsczFiles[i], FILE_ATTRIBUTE_NORMAL, pbData, rgcbFiles[i], NULL);
+                    NativeAssert::Succeeded(hr, "Failed to write source file: {0}", rgsczFiles[i]);
+                }
+
+                CompressCorpus(sczTempDir, L"synchronous.cab", rgsczFiles, cFiles, TRUE);
+                CompressCorpus(sczTempDir, L"streaming.cab", rgsczFiles, cFiles, FALSE);
+
+                hr = PathConcat(sczTempDir, L"synchronous.cab", &sczCabPath);
+                NativeAssert::Succeeded(hr, "Failed to get cabinet path");
+
+                hr = FileRead(&pbSynchronous, &cbSynchronous, sczCabPath);
+                NativeAssert::Succeeded(hr, "Failed to read cabinet: {0}", sczCabPath);
+
+                hr = PathConcat(sczTempDir, L"streaming.cab", &sczCabPath);
+                NativeAssert::Succeeded(hr, "Failed to get cabinet path");
+
+                hr = FileRead(&pbStreaming, &cbStreaming, sczCabPath);
+                NativeAssert::Succeeded(hr, "Failed to read cabinet: {0}", sczCabPath);
+
+                // Neither cabinet spans, so the cabinet name isn't in either and they must match byte for byte.
+                Assert::Equal<SIZE_T>(cbSynchronous, cbStreaming);
+                Assert::True(0 == memcmp(pbSynchronous, pbStreaming, cbSynchronous), "Expected the streamed cabinet to match the synchronously written one");
+
+                hr = DirEnsureDelete(sczTempDir, TRUE, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to delete directory: {0}", sczTempDir);
+            }
+            finally
+            {
+                ReleaseMem(pbStreaming);
+                ReleaseMem(pbSynchronous);
+                ReleaseStr(sczCabPath);
+                ReleaseMem(pbData);
+                ReleaseStrArray(rgsczFiles, cFiles);
+                ReleaseStr(sczSourceDir);
+                ReleaseStr(sczTempDir);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact(Skip = "Benchmark, run manually to compare streaming with synchronous I/O.")]
+        void CabCStreamingThroughputBenchmark()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczTempDir = NULL;
+            LPWSTR sczSourceDir = NULL;
+            LPWSTR* rgsczFiles = NULL;
+            UINT cFiles = 0;
+            BYTE* pbData = NULL;
+            LPWSTR sczCabPath = NULL;
+            CAB_INDEX index = { };
+            const DWORD cSmallFiles = 400;
+            const DWORD cLargeFiles = 4;
+            const DWORD cbLargeFile = 32 * 1024 * 1024;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                PerfInitialize();
+
+                hr = PathExpand(&sczTempDir, L"%TEMP%\\CabCUtilTest\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::Succeeded(hr, "Failed to get temp dir");
+
+                hr = PathConcat(sczTempDir, L"source\\", &sczSourceDir);
+                NativeAssert::Succeeded(hr, "Failed to get source dir");
+
+                hr = DirEnsureExists(sczSourceDir, NULL);
+                NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczSourceDir);
+
+                // Compressible but not trivially so, like most installed files.
+                pbData = static_cast<BYTE*>(MemAlloc(cbLargeFile, FALSE));
+                Assert::True(NULL != pbData);
+
+                for (DWORD i = 0; i < cbLargeFile; ++i)
+                {
+                    pbData[i] = static_cast<BYTE>((i * 7919) % 251 < 64 ? (i >> 5) : (i % 13));
+                }
+
+                // A mix of many small files and a few large ones.
+                for (DWORD i = 0; i < cSmallFiles + cLargeFiles; ++i)
+                {
+                    DWORD cbFile = (i < cSmallFiles) ? 1024 + (i * 4093) % (128 * 1024) : cbLargeFile - i;
+                    LPWSTR sczFile = NULL;
+
+                    hr = StrAllocFormatted(&sczFile, L"%lsfile%u.dat", sczSourceDir, i);
+                    NativeAssert::Succeeded(hr, "Failed to format source file path");
+
+                    hr = StrArrayAllocString(&rgsczFiles, &cFiles, sczFile, 0);
+                    ReleaseStr(sczFile);
+                    NativeAssert::Succeeded(hr, "Failed to store source file path");
+
+                    // Each file differs so none of them are duplicates.
+                    pbData[0] = static_cast<BYTE>(i);
+                    pbData[1] = static_cast<BYTE>(i >> 8);
+
+                    hr = FileWrite(rgsczFiles[i], FILE_ATTRIBUTE_NORMAL, pbData, cbFile, NULL);
+                    NativeAssert::Succeeded(hr, "Failed to write source file: {0}", rgsczFiles[i]);
+                }
+
+                // The first pass warms the file cache so both measured passes read the same way.
+                CompressCorpus(sczTempDir, L"warmup.cab", rgsczFiles, cFiles, FALSE);
+
+                for (int nPass = 0; nPass < 2; ++nPass)
+                {
+                    BOOL fSynchronousIo = (0 == nPass);
+                    LPCWSTR wzCabName = fSynchronousIo ? L"synchronous.cab" : L"streaming.cab";
+                    CABC_STATISTICS statistics = { };
+                    LARGE_INTEGER liElapsed = { };
+
+                    PerfClickTime(NULL);
+                    statistics = CompressCorpus(sczTempDir, wzCabName, rgsczFiles, cFiles, fSynchronousIo);
+                    PerfClickTime(&liElapsed);
+
+                    hr = PathConcat(sczTempDir, wzCabName, &sczCabPath);
+                    NativeAssert::Succeeded(hr, "Failed to get cabinet path");
+
+                    hr = CabReadIndex(sczCabPath, 0, &index);
+                    NativeAssert::Succeeded(hr, "Failed to read index of cabinet: {0}", sczCabPath);
+
+                    Assert::Equal<DWORD>(cFiles, index.cFiles);
+
+                    CabReleaseIndex(&index);
+
+                    Console::WriteLine("{0}: {1:F0} MB/s over {2} files, {3} ms waiting on the disk",
+                        fSynchronousIo ? "Synchronous I/O" : "Streaming I/O", statistics.qwSourceBytes / (1024.0 * 1024.0) / PerfConvertToSeconds(&liElapsed),
+                        cFiles, statistics.dwStreamWaitMilliseconds);
+                }
+
+                hr = DirEnsureDelete(sczTempDir, TRUE, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to delete directory: {0}", sczTempDir);
+            }
+            finally
+            {
+                CabReleaseIndex(&index);
+                ReleaseStr(sczCabPath);
+                ReleaseMem(pbData);
+                ReleaseStrArray(rgsczFiles, cFiles);
+                ReleaseStr(sczSourceDir);
+                ReleaseStr(sczTempDir);
+                DutilUninitialize();
+            }
+        }
+
+    private:
+        CABC_STATISTICS CompressCorpus(
+            __in_z LPCWSTR wzCabDir,
+            __in_z LPCWSTR wzCabName,
+            __in_ecount(cFiles) LPWSTR* rgsczFiles,
+            __in UINT cFiles,
+            __in BOOL fSynchronousIo
+            )
+        {
+            HRESULT hr = S_OK;
+            HANDLE hCab = NULL;
+            CABC_STATISTICS statistics = { };
+
+            try
+            {
+                hr = CabCBegin(wzCabName, wzCabDir, cFiles, 0, 0, COMPRESSION_TYPE_MSZIP, &hCab);
+                NativeAssert::Succeeded(hr, "Failed to begin cabinet: {0}", wzCabName);
+
+                CabCSetSynchronousIo(hCab, fSynchronousIo);
+                CabCCollectStatistics(hCab, &statistics);
+
+                for (UINT i = 0; i < cFiles; ++i)
+                {
+                    hr = CabCAddFile(rgsczFiles[i], PathFile(rgsczFiles[i]), NULL, hCab);
+                    NativeAssert::Succeeded(hr, "Failed to add file to cabinet: {0}", rgsczFiles[i]);
+                }
+
+                hr = CabCFinish(hCab, NULL);
+                hCab = NULL;
+                NativeAssert::Succeeded(hr, "Failed to finish cabinet: {0}", wzCabName);
+            }
+            finally
+            {
+                if (hCab)
+                {
+                    CabCCancel(hCab);
+                }
+            }
+
+            return statistics;
+        }
+    };
+}
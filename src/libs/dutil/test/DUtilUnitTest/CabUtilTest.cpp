@@ -0,0 +1,399 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+using namespace System;
+using namespace Xunit;
+using namespace WixInternal::TestSupport;
+
+static volatile LONG vcCabTestEnumeratedFiles = 0;
+
+static INT_PTR __stdcall CabTestCountFiles(
+    __in FDINOTIFICATIONTYPE fdint,
+    __in PFDINOTIFICATION pfdin
+    );
+
+namespace DutilTests
+{
+    public ref class CabUtil
+    {
+    public:
+        [Fact]
+        void CabReadIndexTest()
+        {
+            HRESULT hr = S_OK;
+            CAB_INDEX index = { };
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                pin_ptr<const wchar_t> wzCabPath = PtrToStringChars(TestData::Get("TestData", "CabUtilTests", "test.cab"));
+
+                hr = CabReadIndex(wzCabPath, 0, &index);
+                NativeAssert::Succeeded(hr, "Failed to read index of cabinet: {0}", wzCabPath);
+
+                Assert::Equal<USHORT>(1, index.cFolders);
+                Assert::Equal<DWORD>(1, index.cFiles);
+                NativeAssert::StringEqual(L"test.txt", index.rgFiles[0].sczName);
+                Assert::Equal<DWORD>(17, index.rgFiles[0].cbFile);
+                Assert::Equal<USHORT>(0, index.rgFiles[0].iFolder);
+                Assert::Equal<USHORT>(19259, index.rgFiles[0].date);
+                Assert::Equal<USHORT>(47731, index.rgFiles[0].time);
+            }
+            finally
+            {
+                CabReleaseIndex(&index);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void CabReadIndexEmbeddedTest()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczTempDir = NULL;
+            LPWSTR sczEmbeddedPath = NULL;
+            BYTE* pbCabinet = NULL;
+            SIZE_T cbCabinet = 0;
+            BYTE* pbEmbedded = NULL;
+            CAB_INDEX index = { };
+            // Not a multiple of the allocation granularity so the index reader has to align its views.
+            const SIZE_T cbPrefix = 70001;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                pin_ptr<const wchar_t> wzCabPath = PtrToStringChars(TestData::Get("TestData", "CabUtilTests", "test.cab"));
+
+                hr = FileRead(&pbCabinet, &cbCabinet, wzCabPath);
+                NativeAssert::Succeeded(hr, "Failed to read cabinet: {0}", wzCabPath);
+
+                pbEmbedded = static_cast<BYTE*>(MemAlloc(cbPrefix + cbCabinet, TRUE));
+                Assert::True(NULL != pbEmbedded);
+
+                memcpy_s(pbEmbedded + cbPrefix, cbCabinet, pbCabinet, cbCabinet);
+
+                hr = PathExpand(&sczTempDir, L"%TEMP%\\CabUtilTest\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::Succeeded(hr, "Failed to get temp dir");
+
+                hr = DirEnsureExists(sczTempDir, NULL);
+                NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczTempDir);
+
+                hr = PathConcat(sczTempDir, L"embedded.bin", &sczEmbeddedPath);
+                NativeAssert::Succeeded(hr, "Failed to get embedded cabinet path");
+
+                hr = FileWrite(sczEmbeddedPath, FILE_ATTRIBUTE_NORMAL, pbEmbedded, cbPrefix + cbCabinet, NULL);
+                NativeAssert::Succeeded(hr, "Failed to write embedded cabinet: {0}", sczEmbeddedPath);
+
+                hr = CabReadIndex(sczEmbeddedPath, cbPrefix, &index);
+                NativeAssert::Succeeded(hr, "Failed to read index of embedded cabinet: {0}", sczEmbeddedPath);
+
+                Assert::Equal<DWORD>(1, index.cFiles);
+                NativeAssert::StringEqual(L"test.txt", index.rgFiles[0].sczName);
+                Assert::Equal<DWORD>(17, index.rgFiles[0].cbFile);
+
+                CabReleaseIndex(&index);
+
+                hr = CabReadIndex(sczEmbeddedPath, 0, &index);
+                NativeAssert::SpecificReturnCode(E_INVALIDDATA, hr, "Expected the zero filled prefix to not be a cabinet: {0}", sczEmbeddedPath);
+                Assert::Equal<DWORD>(0, index.cFiles);
+
+                hr = DirEnsureDelete(sczTempDir, TRUE, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to delete directory: {0}", sczTempDir);
+            }
+            finally
+            {
+                CabReleaseIndex(&index);
+                ReleaseMem(pbEmbedded);
+                ReleaseMem(pbCabinet);
+                ReleaseStr(sczEmbeddedPath);
+                ReleaseStr(sczTempDir);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void CabExtractParallelTest()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczTempDir = NULL;
+            LPWSTR sczSourcePath = NULL;
+            LPWSTR sczCabName = NULL;
+            LPWSTR sczCabPath = NULL;
+            LPWSTR sczExtractDir = NULL;
+            LPWSTR sczExtractedPath = NULL;
+            LPWSTR sczToken = NULL;
+            BYTE* pbSource = NULL;
+            BYTE* pbExtracted = NULL;
+            SIZE_T cbExtracted = 0;
+            HANDLE hCab = NULL;
+            CAB_INDEX index = { };
+            BOOL fCabInitialized = FALSE;
+            BOOL fPoolInitialized = FALSE;
+            const DWORD cCabinets = 3;
+            const DWORD cFiles = 8;
+            // Uncompressed files larger than the folder threshold, so every file starts a new folder.
+            const DWORD cbFile = 40000;
+            const DWORD cbFolderThreshold = 32768;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hr = PathExpand(&sczTempDir, L"%TEMP%\\CabUtilParallelTest\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::Succeeded(hr, "Failed to get temp dir");
+
+                hr = DirEnsureExists(sczTempDir, NULL);
+                NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczTempDir);
+
+                pbSource = static_cast<BYTE*>(MemAlloc(cbFile, FALSE));
+                Assert::True(NULL != pbSource);
+
+                hr = CabInitialize(FALSE);
+                NativeAssert::Succeeded(hr, "Failed to initialize cabinet support");
+
+                fCabInitialized = TRUE;
+
+                hr = ThrdPoolInitialize(4);
+                NativeAssert::Succeeded(hr, "Failed to initialize shared thread pool");
+
+                fPoolInitialized = TRUE;
+
+                for (DWORD iCabinet = 0; iCabinet < cCabinets; ++iCabinet)
+                {
+                    hr = StrAllocFormatted(&sczCabName, L"test%u.cab", iCabinet);
+                    NativeAssert::Succeeded(hr, "Failed to format cabinet name");
+
+                    hr = CabCBegin(sczCabName, sczTempDir, cFiles, 0, cbFolderThreshold, COMPRESSION_TYPE_NONE, &hCab);
+                    NativeAssert::Succeeded(hr, "Failed to begin cabinet: {0}", sczCabName);
+
+                    for (DWORD iFile = 0; iFile < cFiles; ++iFile)
+                    {
+                        // Contents differ by cabinet and file so a file extracted into the wrong place doesn't compare equal.
+                        for (DWORD i = 0; i < cbFile; ++i)
+                        {
+                            pbSource[i] = static_cast<BYTE>(i * 31 + iFile * 7 + iCabinet);
+                        }
+
+                        hr = StrAllocFormatted(&sczSourcePath, L"%lssource%u_%u.bin", sczTempDir, iCabinet, iFile);
+                        NativeAssert::Succeeded(hr, "Failed to format source path");
+
+                        hr = FileWrite(sczSourcePath, FILE_ATTRIBUTE_NORMAL, pbSource, cbFile, NULL);
+                        NativeAssert::Succeeded(hr, "Failed to write source file: {0}", sczSourcePath);
+
+                        hr = StrAllocFormatted(&sczToken, L"file%u.bin", iFile);
+                        NativeAssert::Succeeded(hr, "Failed to format file token");
+
+                        hr = CabCAddFile(sczSourcePath, sczToken, NULL, hCab);
+                        NativeAssert::Succeeded(hr, "Failed to add file to cabinet: {0}", sczToken);
+                    }
+
+                    hr = CabCFinish(hCab, NULL);
+                    hCab = NULL;
+                    NativeAssert::Succeeded(hr, "Failed to finish cabinet: {0}", sczCabName);
+
+                    hr = PathConcat(sczTempDir, sczCabName, &sczCabPath);
+                    NativeAssert::Succeeded(hr, "Failed to get cabinet path");
+
+                    hr = CabReadIndex(sczCabPath, 0, &index);
+                    NativeAssert::Succeeded(hr, "Failed to read index of cabinet: {0}", sczCabPath);
+
+                    Assert::True(1 < index.cFolders, "Expected the cabinet to have several folders to extract in parallel");
+
+                    CabReleaseIndex(&index);
+
+                    hr = StrAllocFormatted(&sczExtractDir, L"%lsextract%u\\", sczTempDir, iCabinet);
+                    NativeAssert::Succeeded(hr, "Failed to format extract dir");
+
+                    hr = DirEnsureExists(sczExtractDir, NULL);
+                    NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczExtractDir);
+
+                    hr = CabExtractParallel(sczCabPath, sczExtractDir, NULL, NULL, 0);
+                    NativeAssert::Succeeded(hr, "Failed to extract cabinet in parallel: {0}", sczCabPath);
+                }
+
+                for (DWORD iCabinet = 0; iCabinet < cCabinets; ++iCabinet)
+                {
+                    for (DWORD iFile = 0; iFile < cFiles; ++iFile)
+                    {
+                        hr = StrAllocFormatted(&sczExtractedPath, L"%lsextract%u\\file%u.bin", sczTempDir, iCabinet, iFile);
+                        NativeAssert::Succeeded(hr, "Failed to format extracted path");
+
+                        hr = FileRead(&pbExtracted, &cbExtracted, sczExtractedPath);
+                        NativeAssert::Succeeded(hr, "Failed to read extracted file: {0}", sczExtractedPath);
+
+                        Assert::Equal<SIZE_T>(cbFile, cbExtracted);
+
+                        for (DWORD i = 0; i < cbFile; ++i)
+                        {
+                            if (static_cast<BYTE>(i * 31 + iFile * 7 + iCabinet) != pbExtracted[i])
+                            {
+                                Assert::True(false, String::Format("Extracted file differs from its source at byte {0}: {1}", i, gcnew String(sczExtractedPath)));
+                            }
+                        }
+
+                        ReleaseNullMem(pbExtracted);
+                    }
+                }
+
+                hr = DirEnsureDelete(sczTempDir, TRUE, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to delete directory: {0}", sczTempDir);
+            }
+            finally
+            {
+                if (hCab)
+                {
+                    CabCCancel(hCab);
+                }
+
+                if (fPoolInitialized)
+                {
+                    ThrdPoolUninitialize();
+                }
+
+                if (fCabInitialized)
+                {
+                    CabUninitialize();
+                }
+
+                CabReleaseIndex(&index);
+                ReleaseMem(pbExtracted);
+                ReleaseMem(pbSource);
+                ReleaseStr(sczToken);
+                ReleaseStr(sczExtractedPath);
+                ReleaseStr(sczExtractDir);
+                ReleaseStr(sczCabPath);
+                ReleaseStr(sczCabName);
+                ReleaseStr(sczSourcePath);
+                ReleaseStr(sczTempDir);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void CabReadIndexBenchmark()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczTempDir = NULL;
+            LPWSTR sczSourcePath = NULL;
+            LPWSTR sczCabPath = NULL;
+            LPWSTR sczToken = NULL;
+            HANDLE hCab = NULL;
+            CAB_INDEX index = { };
+            BOOL fCabInitialized = FALSE;
+            LARGE_INTEGER liIndex = { };
+            LARGE_INTEGER liEnumerate = { };
+            const DWORD cFiles = 50000;
+            const DWORD cRepetitions = 5;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                PerfInitialize();
+
+                hr = PathExpand(&sczTempDir, L"%TEMP%\\CabUtilBenchmark\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::Succeeded(hr, "Failed to get temp dir");
+
+                hr = DirEnsureExists(sczTempDir, NULL);
+                NativeAssert::Succeeded(hr, "Failed to ensure directory exists: {0}", sczTempDir);
+
+                hr = PathConcat(sczTempDir, L"source.txt", &sczSourcePath);
+                NativeAssert::Succeeded(hr, "Failed to get source path");
+
+                hr = FileWrite(sczSourcePath, FILE_ATTRIBUTE_NORMAL, reinterpret_cast<const BYTE*>("cabinet benchmark"), 17, NULL);
+                NativeAssert::Succeeded(hr, "Failed to write source file: {0}", sczSourcePath);
+
+                // Every entry refers to the same file, so the cabinet holds a 50k file table over one file's data.
+                hr = CabCBegin(L"benchmark.cab", sczTempDir, cFiles, 0, 0, COMPRESSION_TYPE_MSZIP, &hCab);
+                NativeAssert::Succeeded(hr, "Failed to begin cabinet");
+
+                for (DWORD i = 0; i < cFiles; ++i)
+                {
+                    hr = StrAllocFormatted(&sczToken, L"file%05u.txt", i);
+                    NativeAssert::Succeeded(hr, "Failed to format file token");
+
+                    hr = CabCAddFile(sczSourcePath, sczToken, NULL, hCab);
+                    NativeAssert::Succeeded(hr, "Failed to add file to cabinet: {0}", sczToken);
+                }
+
+                hr = CabCFinish(hCab, NULL);
+                hCab = NULL;
+                NativeAssert::Succeeded(hr, "Failed to finish cabinet");
+
+                hr = PathConcat(sczTempDir, L"benchmark.cab", &sczCabPath);
+                NativeAssert::Succeeded(hr, "Failed to get cabinet path");
+
+                hr = CabInitialize(FALSE);
+                NativeAssert::Succeeded(hr, "Failed to initialize cabinet support");
+
+                fCabInitialized = TRUE;
+
+                PerfClickTime(NULL);
+                for (DWORD i = 0; i < cRepetitions; ++i)
+                {
+                    hr = CabReadIndex(sczCabPath, 0, &index);
+                    NativeAssert::Succeeded(hr, "Failed to read index of cabinet: {0}", sczCabPath);
+
+                    Assert::Equal<DWORD>(cFiles, index.cFiles);
+
+                    CabReleaseIndex(&index);
+                }
+                PerfClickTime(&liIndex);
+
+                for (DWORD i = 0; i < cRepetitions; ++i)
+                {
+                    vcCabTestEnumeratedFiles = 0;
+
+                    hr = CabEnumerate(sczCabPath, L"*", CabTestCountFiles, 0);
+                    NativeAssert::Succeeded(hr, "Failed to enumerate cabinet: {0}", sczCabPath);
+
+                    Assert::Equal<LONG>(cFiles, vcCabTestEnumeratedFiles);
+                }
+                PerfClickTime(&liEnumerate);
+
+                Console::WriteLine("{0} files: CabReadIndex {1:F1} ms, FDI enumeration {2:F1} ms",
+                    cFiles, PerfConvertToSeconds(&liIndex) * 1000 / cRepetitions, PerfConvertToSeconds(&liEnumerate) * 1000 / cRepetitions);
+
+                hr = DirEnsureDelete(sczTempDir, TRUE, TRUE);
+                NativeAssert::Succeeded(hr, "Failed to delete directory: {0}", sczTempDir);
+            }
+            finally
+            {
+                if (hCab)
+                {
+                    CabCCancel(hCab);
+                }
+
+                if (fCabInitialized)
+                {
+                    CabUninitialize();
+                }
+
+                CabReleaseIndex(&index);
+                ReleaseStr(sczToken);
+                ReleaseStr(sczCabPath);
+                ReleaseStr(sczSourcePath);
+                ReleaseStr(sczTempDir);
+                DutilUninitialize();
+            }
+        }
+    };
+}
+
+
+static INT_PTR __stdcall CabTestCountFiles(
+    __in FDINOTIFICATIONTYPE fdint,
+    __in PFDINOTIFICATION /*pfdin*/
+    )
+{
+    // Skip every file so only the enumeration itself is measured.
+    if (fdintCOPY_FILE == fdint)
+    {
+        ::InterlockedIncrement(&vcCabTestEnumeratedFiles);
+    }
+
+    return 0;
+}
@@ -191,6 +191,50 @@ namespace DutilTests
             }
         }
 
+        [Fact]
+        void MemUtilInsertMultipleTest()
+        {
+            HRESULT hr = S_OK;
+            ArrayValue *rgValues = NULL;
+            DWORD cValues = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hr = MemEnsureArraySize(reinterpret_cast<LPVOID*>(&rgValues), 6, sizeof(ArrayValue), 0);
+                NativeAssert::Succeeded(hr, "Failed to grow array size to 6");
+
+                // Leave a gap for 3 through 6.
+                cValues = 6;
+                for (DWORD i = 0; i < cValues; ++i)
+                {
+                    SetItem(rgValues + i, i < 3 ? i : i + 4);
+                }
+
+                // The array is full so this also has to grow it.
+                hr = MemInsertIntoArray(reinterpret_cast<LPVOID*>(&rgValues), 3, 4, cValues, sizeof(ArrayValue), 2);
+                NativeAssert::Succeeded(hr, "Failed to insert several items into middle of array");
+                cValues += 4;
+
+                for (DWORD i = 3; i < 7; ++i)
+                {
+                    CheckNullItem(rgValues + i);
+                    SetItem(rgValues + i, i);
+                }
+
+                for (DWORD i = 0; i < cValues; ++i)
+                {
+                    CheckItem(rgValues + i, i);
+                }
+            }
+            finally
+            {
+                ReleaseMem(rgValues);
+                DutilUninitialize();
+            }
+        }
+
         [Fact]
         void MemUtilRemovePreserveOrderTest()
         {
@@ -15,6 +15,7 @@ namespace DutilTests
     const int POSTWAIT = 480;
     const int FULLWAIT = 500;
     const int SILENCEPERIOD = 100;
+    const int NOTIFYTIMEOUT = 10000;
 
     struct RegKey
     {
@@ -36,8 +37,39 @@ namespace DutilTests
         DWORD cRegKeys;
         Directory *rgDirectories;
         DWORD cDirectories;
+        HANDLE hDirectoryNotified;
     };
 
+    struct TracedErrors
+    {
+        volatile LONG cErrors;
+        HRESULT hrLast;
+    };
+
+    static TracedErrors vMonUtilTracedErrors;
+
+    static void CALLBACK MonUtilTestTraceError(
+        __in_z LPCSTR szFile,
+        __in int iLine,
+        __in REPORT_LEVEL rl,
+        __in UINT source,
+        __in HRESULT hrError,
+        __in_z __format_string LPCSTR szFormat,
+        __in va_list args
+        )
+    {
+        if (DUTIL_SOURCE_MONUTIL == source)
+        {
+            // Traced on monutil's own threads, so remember it for the test thread to check
+            vMonUtilTracedErrors.hrLast = hrError;
+            ::InterlockedIncrement(&vMonUtilTracedErrors.cErrors);
+        }
+        else
+        {
+            DutilTestTraceError(szFile, iLine, rl, source, hrError, szFormat, args);
+        }
+    }
+
     public delegate void MonGeneralDelegate(HRESULT, LPVOID);
 
     public delegate void MonDriveStatusDelegate(WCHAR, BOOL, LPVOID);
@@ -83,6 +115,11 @@ namespace DutilTests
         pResults->rgDirectories[pResults->cDirectories - 1].hr = hrResult;
         pResults->rgDirectories[pResults->cDirectories - 1].wzPath = wzPath;
         pResults->rgDirectories[pResults->cDirectories - 1].fRecursive = fRecursive;
+
+        if (pResults->hDirectoryNotified)
+        {
+            ::SetEvent(pResults->hDirectoryNotified);
+        }
     }
 
     static void MonRegKey(
@@ -423,6 +460,77 @@ namespace DutilTests
             }
         }
 
+        void WaitForDirectoryNotification(Results *pResults)
+        {
+            DWORD dwWait = ::WaitForSingleObject(pResults->hDirectoryNotified, NOTIFYTIMEOUT);
+            Assert::Equal<DWORD>(WAIT_OBJECT_0, dwWait);
+        }
+
+        void TestRemoveWhileFiring(MON_HANDLE handle, Results *pResults, LPCWSTR wzBaseDir)
+        {
+            HRESULT hr  = S_OK;
+            LPWSTR sczDir = NULL;
+            LPWSTR sczFile = NULL;
+            DWORD cNotifiedBefore = 0;
+            DWORD dwWait = WAIT_TIMEOUT;
+            // One more than a waiter thread can hold, so the last directory gets a waiter thread of its own.
+            const DWORD cDirectories = 64;
+
+            try
+            {
+                for (DWORD i = 0; i < cDirectories; ++i)
+                {
+                    hr = StrAllocFormatted(&sczDir, L"%ls%u\\", wzBaseDir, i);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+
+                    hr = DirEnsureExists(sczDir, NULL);
+                    NativeAssert::ValidReturnCode(hr, S_OK, S_FALSE);
+
+                    hr = MonAddDirectory(handle, sczDir, FALSE, SILENCEPERIOD, NULL);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+                }
+
+                hr = StrAllocFormatted(&sczFile, L"%ls0\\file.txt", wzBaseDir);
+                NativeAssert::ValidReturnCode(hr, S_OK);
+
+                // The adds are processed asynchronously, so keep touching the file until the first waiter thread reports it.
+                for (DWORD i = 0; i < NOTIFYTIMEOUT / FULLWAIT && WAIT_OBJECT_0 != dwWait; ++i)
+                {
+                    hr = FileFromString(sczFile, 0, i % 2 ? L"contents" : L"contents2", FILE_ENCODING_UTF16_WITH_BOM);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+
+                    dwWait = ::WaitForSingleObject(pResults->hDirectoryNotified, FULLWAIT);
+                }
+                Assert::Equal<DWORD>(WAIT_OBJECT_0, dwWait);
+                cNotifiedBefore = pResults->cDirectories;
+
+                hr = StrAllocFormatted(&sczDir, L"%ls%u\\", wzBaseDir, cDirectories - 1);
+                NativeAssert::ValidReturnCode(hr, S_OK);
+
+                for (DWORD i = 0; i < 5; ++i)
+                {
+                    // Stop the second waiter thread while the first one is firing.
+                    hr = FileFromString(sczFile, 0, i % 2 ? L"contents2" : L"contents", FILE_ENCODING_UTF16_WITH_BOM);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+
+                    hr = MonRemoveDirectory(handle, sczDir, FALSE);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+
+                    WaitForDirectoryNotification(pResults);
+                    Assert::Equal<DWORD>(cNotifiedBefore + i + 1, pResults->cDirectories);
+
+                    // The coordinator handles messages in order, so this add is done before the next remove.
+                    hr = MonAddDirectory(handle, sczDir, FALSE, SILENCEPERIOD, NULL);
+                    NativeAssert::ValidReturnCode(hr, S_OK);
+                }
+            }
+            finally
+            {
+                ReleaseStr(sczDir);
+                ReleaseStr(sczFile);
+            }
+        }
+
         [Fact(Skip = "Test demonstrates failure")]
         void MonUtilTest()
         {
@@ -485,5 +593,86 @@ namespace DutilTests
                 RegUninitialize();
             }
         }
+
+        [Fact]
+        void MonUtilRemoveWhileFiringTest()
+        {
+            HRESULT hr = S_OK;
+            MON_HANDLE handle = NULL;
+            LPWSTR sczBaseDir = NULL;
+            List<GCHandle>^ gcHandles = gcnew List<GCHandle>();
+            Results *pResults = (Results *)MemAlloc(sizeof(Results), TRUE);
+            Assert::True(NULL != pResults);
+
+            ::ZeroMemory(&vMonUtilTracedErrors, sizeof(vMonUtilTracedErrors));
+            DutilInitialize(&MonUtilTestTraceError);
+
+            try
+            {
+                pResults->hDirectoryNotified = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+                Assert::True(NULL != pResults->hDirectoryNotified);
+
+                hr = PathExpand(&sczBaseDir, L"%TEMP%\\RemoveWhileFiringTest\\", PATH_EXPAND_ENVIRONMENT);
+                NativeAssert::ValidReturnCode(hr, S_OK);
+
+                RemoveDirectory(sczBaseDir);
+
+                MonGeneralDelegate^ fpMonGeneral = gcnew MonGeneralDelegate(MonGeneral);
+                GCHandle gchMonGeneral = GCHandle::Alloc(fpMonGeneral);
+                gcHandles->Add(gchMonGeneral);
+                IntPtr ipMonGeneral = Marshal::GetFunctionPointerForDelegate(fpMonGeneral);
+
+                MonDriveStatusDelegate^ fpMonDriveStatus = gcnew MonDriveStatusDelegate(MonDriveStatus);
+                GCHandle gchMonDriveStatus = GCHandle::Alloc(fpMonDriveStatus);
+                gcHandles->Add(gchMonDriveStatus);
+                IntPtr ipMonDriveStatus = Marshal::GetFunctionPointerForDelegate(fpMonDriveStatus);
+
+                MonDirectoryDelegate^ fpMonDirectory = gcnew MonDirectoryDelegate(MonDirectory);
+                GCHandle gchMonDirectory = GCHandle::Alloc(fpMonDirectory);
+                gcHandles->Add(gchMonDirectory);
+                IntPtr ipMonDirectory = Marshal::GetFunctionPointerForDelegate(fpMonDirectory);
+
+                MonRegKeyDelegate^ fpMonRegKey = gcnew MonRegKeyDelegate(MonRegKey);
+                GCHandle gchMonRegKey = GCHandle::Alloc(fpMonRegKey);
+                gcHandles->Add(gchMonRegKey);
+                IntPtr ipMonRegKey = Marshal::GetFunctionPointerForDelegate(fpMonRegKey);
+
+                hr = MonCreate(&handle, static_cast<PFN_MONGENERAL>(ipMonGeneral.ToPointer()), static_cast<PFN_MONDRIVESTATUS>(ipMonDriveStatus.ToPointer()), static_cast<PFN_MONDIRECTORY>(ipMonDirectory.ToPointer()), static_cast<PFN_MONREGKEY>(ipMonRegKey.ToPointer()), pResults);
+                NativeAssert::ValidReturnCode(hr, S_OK);
+
+                TestRemoveWhileFiring(handle, pResults, sczBaseDir);
+
+                // Shutting down also joins the waiter threads that were still stopping.
+                ReleaseMon(handle);
+                handle = NULL;
+
+                // Stopping a waiter thread while another one fires is not an error, so nothing may be traced on the way.
+                LONG cTracedErrors = vMonUtilTracedErrors.cErrors;
+                Assert::True(0 == cTracedErrors, String::Format("Expected no monutil errors to be traced, but {0} were, the last with hr = 0x{1:X8}", cTracedErrors, vMonUtilTracedErrors.hrLast));
+            }
+            finally
+            {
+                ReleaseMon(handle);
+
+                // The monitors hold handles to the directories, so they can only be deleted once the monitor is gone.
+                if (sczBaseDir)
+                {
+                    RemoveDirectory(sczBaseDir);
+                }
+
+                for each (GCHandle gcHandle in gcHandles)
+                {
+                    gcHandle.Free();
+                }
+
+                ReleaseHandle(pResults->hDirectoryNotified);
+                ReleaseMem(pResults->rgDirectories);
+                ReleaseMem(pResults->rgRegKeys);
+                ReleaseMem(pResults);
+                ReleaseStr(sczBaseDir);
+
+                DutilUninitialize();
+            }
+        }
     };
 }
@@ -0,0 +1,448 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+using namespace System;
+using namespace Xunit;
+using namespace WixInternal::TestSupport;
+
+enum QUE_TEST_KIND
+{
+    QUE_TEST_KIND_RING,
+    QUE_TEST_KIND_SEGMENTED,
+    QUE_TEST_KIND_LOCKED,
+};
+
+struct QUE_TEST_CONTEXT
+{
+    QUE_TEST_KIND kind;
+    void* hQueue;
+    CRITICAL_SECTION* pcsLocked;
+    DWORD cItemsPerThread;
+    volatile LONG64 llSum;
+    volatile LONG cFailures;
+};
+
+static DWORD STDAPICALLTYPE QueTestProducerThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static DWORD STDAPICALLTYPE QueTestConsumerThreadProc(
+    __in LPVOID lpThreadParameter
+    );
+static void CALLBACK QueTestCountRelease(
+    __in void* pvValue,
+    __in void* pvContext
+    );
+static HRESULT QueTestRunProducersConsumers(
+    __in QUE_TEST_CONTEXT* pContext,
+    __in DWORD cThreadPairs
+    );
+
+namespace DutilTests
+{
+    public ref class QueUtil
+    {
+    public:
+        [Fact]
+        void QueRingFifoTest()
+        {
+            HRESULT hr = S_OK;
+            QUEUTIL_RING_HANDLE hRing = NULL;
+            void* pvValue = NULL;
+            DWORD cReleased = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                // A capacity of 3 is rounded up to 4.
+                hr = QueRingCreate(3, &hRing);
+                NativeAssert::Succeeded(hr, "Failed to create ring.");
+
+                hr = QueRingTryDequeue(hRing, &pvValue);
+                NativeAssert::SpecificReturnCode(E_NOMOREITEMS, hr, "Expected empty ring.");
+
+                hr = QueRingDequeue(hRing, &pvValue, 10);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(WAIT_TIMEOUT), hr, "Expected dequeue timeout on empty ring.");
+
+                for (DWORD_PTR i = 1; i <= 4; ++i)
+                {
+                    hr = QueRingTryEnqueue(hRing, reinterpret_cast<void*>(i));
+                    NativeAssert::Succeeded(hr, "Failed to enqueue value {0}.", i);
+                }
+
+                hr = QueRingTryEnqueue(hRing, reinterpret_cast<void*>(5));
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER), hr, "Expected full ring.");
+
+                hr = QueRingEnqueue(hRing, reinterpret_cast<void*>(5), 10);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(WAIT_TIMEOUT), hr, "Expected enqueue timeout on full ring.");
+
+                for (DWORD_PTR i = 1; i <= 2; ++i)
+                {
+                    hr = QueRingDequeue(hRing, &pvValue, 0);
+                    NativeAssert::Succeeded(hr, "Failed to dequeue value {0}.", i);
+                    Assert::Equal<DWORD_PTR>(i, reinterpret_cast<DWORD_PTR>(pvValue));
+                }
+
+                // Wrap around the end of the ring.
+                for (DWORD_PTR i = 5; i <= 6; ++i)
+                {
+                    hr = QueRingEnqueue(hRing, reinterpret_cast<void*>(i), 0);
+                    NativeAssert::Succeeded(hr, "Failed to enqueue value {0}.", i);
+                }
+
+                for (DWORD_PTR i = 3; i <= 4; ++i)
+                {
+                    hr = QueRingTryDequeue(hRing, &pvValue);
+                    NativeAssert::Succeeded(hr, "Failed to dequeue value {0}.", i);
+                    Assert::Equal<DWORD_PTR>(i, reinterpret_cast<DWORD_PTR>(pvValue));
+                }
+
+                QueRingDestroy(hRing, QueTestCountRelease, &cReleased);
+                hRing = NULL;
+
+                Assert::Equal<DWORD>(2, cReleased);
+            }
+            finally
+            {
+                ReleaseRing(hRing, NULL, NULL);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void QueSegmentedGrowthTest()
+        {
+            HRESULT hr = S_OK;
+            QUEUTIL_SEGMENTED_HANDLE hQueue = NULL;
+            void* pvValue = NULL;
+            DWORD cReleased = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                // Tiny segments so the queue has to link and retire many of them.
+                hr = QueSegmentedCreate(4, &hQueue);
+                NativeAssert::Succeeded(hr, "Failed to create segmented queue.");
+
+                hr = QueSegmentedTryDequeue(hQueue, &pvValue);
+                NativeAssert::SpecificReturnCode(E_NOMOREITEMS, hr, "Expected empty queue.");
+
+                hr = QueSegmentedDequeue(hQueue, &pvValue, 10);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(WAIT_TIMEOUT), hr, "Expected dequeue timeout on empty queue.");
+
+                for (DWORD_PTR i = 1; i <= 100; ++i)
+                {
+                    hr = QueSegmentedEnqueue(hQueue, reinterpret_cast<void*>(i));
+                    NativeAssert::Succeeded(hr, "Failed to enqueue value {0}.", i);
+                }
+
+                for (DWORD_PTR i = 1; i <= 90; ++i)
+                {
+                    hr = QueSegmentedDequeue(hQueue, &pvValue, 0);
+                    NativeAssert::Succeeded(hr, "Failed to dequeue value {0}.", i);
+                    Assert::Equal<DWORD_PTR>(i, reinterpret_cast<DWORD_PTR>(pvValue));
+                }
+
+                QueSegmentedDestroy(hQueue, QueTestCountRelease, &cReleased);
+                hQueue = NULL;
+
+                Assert::Equal<DWORD>(10, cReleased);
+            }
+            finally
+            {
+                ReleaseSegmentedQueue(hQueue, NULL, NULL);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void QueMultithreadedTest()
+        {
+            HRESULT hr = S_OK;
+            QUE_TEST_CONTEXT context = { };
+            const DWORD cThreadPairs = 4;
+            const DWORD cItemsPerThread = 100000;
+            const LONG64 llExpectedSum = static_cast<LONG64>(cThreadPairs) * cItemsPerThread * (cItemsPerThread + 1) / 2;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                context.cItemsPerThread = cItemsPerThread;
+
+                // A small ring keeps producers blocked on a full ring and consumers blocked on an empty one.
+                context.kind = QUE_TEST_KIND_RING;
+                hr = QueRingCreate(16, &context.hQueue);
+                NativeAssert::Succeeded(hr, "Failed to create ring.");
+
+                hr = QueTestRunProducersConsumers(&context, cThreadPairs);
+                NativeAssert::Succeeded(hr, "Failed to run ring producers and consumers.");
+                Assert::Equal<LONG>(0, context.cFailures);
+                Assert::Equal<LONG64>(llExpectedSum, context.llSum);
+
+                QueRingDestroy(context.hQueue, NULL, NULL);
+                context.hQueue = NULL;
+
+                context.kind = QUE_TEST_KIND_SEGMENTED;
+                context.llSum = 0;
+                hr = QueSegmentedCreate(32, &context.hQueue);
+                NativeAssert::Succeeded(hr, "Failed to create segmented queue.");
+
+                hr = QueTestRunProducersConsumers(&context, cThreadPairs);
+                NativeAssert::Succeeded(hr, "Failed to run segmented producers and consumers.");
+                Assert::Equal<LONG>(0, context.cFailures);
+                Assert::Equal<LONG64>(llExpectedSum, context.llSum);
+            }
+            finally
+            {
+                if (QUE_TEST_KIND_RING == context.kind)
+                {
+                    ReleaseRing(context.hQueue, NULL, NULL);
+                }
+                else
+                {
+                    ReleaseSegmentedQueue(context.hQueue, NULL, NULL);
+                }
+
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void QueThroughputBenchmark()
+        {
+            HRESULT hr = S_OK;
+            CRITICAL_SECTION csLocked = { };
+            QUE_TEST_CONTEXT context = { };
+            const DWORD rgcThreadPairs[] = { 1, 2, 4, 8, 16 };
+            const DWORD cItemsTotal = 1600000;
+            LARGE_INTEGER liLocked = { };
+            LARGE_INTEGER liRing = { };
+            LARGE_INTEGER liSegmented = { };
+
+            ::InitializeCriticalSection(&csLocked);
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                PerfInitialize();
+
+                for (DWORD i = 0; i < countof(rgcThreadPairs); ++i)
+                {
+                    const DWORD cThreadPairs = rgcThreadPairs[i];
+
+                    context.cItemsPerThread = cItemsTotal / cThreadPairs;
+
+                    // Baseline: the single threaded queue behind a critical section.
+                    context.kind = QUE_TEST_KIND_LOCKED;
+                    context.pcsLocked = &csLocked;
+                    context.llSum = 0;
+                    hr = QueCreate(&context.hQueue);
+                    NativeAssert::Succeeded(hr, "Failed to create locked queue.");
+
+                    PerfClickTime(NULL);
+                    hr = QueTestRunProducersConsumers(&context, cThreadPairs);
+                    PerfClickTime(&liLocked);
+                    NativeAssert::Succeeded(hr, "Failed to run locked producers and consumers.");
+
+                    QueDestroy(context.hQueue, NULL, NULL);
+                    context.hQueue = NULL;
+
+                    context.kind = QUE_TEST_KIND_RING;
+                    context.llSum = 0;
+                    hr = QueRingCreate(1024, &context.hQueue);
+                    NativeAssert::Succeeded(hr, "Failed to create ring.");
+
+                    PerfClickTime(NULL);
+                    hr = QueTestRunProducersConsumers(&context, cThreadPairs);
+                    PerfClickTime(&liRing);
+                    NativeAssert::Succeeded(hr, "Failed to run ring producers and consumers.");
+
+                    QueRingDestroy(context.hQueue, NULL, NULL);
+                    context.hQueue = NULL;
+
+                    context.kind = QUE_TEST_KIND_SEGMENTED;
+                    context.llSum = 0;
+                    hr = QueSegmentedCreate(1024, &context.hQueue);
+                    NativeAssert::Succeeded(hr, "Failed to create segmented queue.");
+
+                    PerfClickTime(NULL);
+                    hr = QueTestRunProducersConsumers(&context, cThreadPairs);
+                    PerfClickTime(&liSegmented);
+                    NativeAssert::Succeeded(hr, "Failed to run segmented producers and consumers.");
+
+                    QueSegmentedDestroy(context.hQueue, NULL, NULL);
+                    context.hQueue = NULL;
+
+                    Assert::Equal<LONG>(0, context.cFailures);
+
+                    const double dItems = static_cast<double>(context.cItemsPerThread) * cThreadPairs;
+                    Console::WriteLine("{0,2} producers/{0,2} consumers: locked {1:F0} ops/s, ring {2:F0} ops/s, segmented {3:F0} ops/s",
+                        cThreadPairs, dItems / PerfConvertToSeconds(&liLocked), dItems / PerfConvertToSeconds(&liRing), dItems / PerfConvertToSeconds(&liSegmented));
+                }
+            }
+            finally
+            {
+                if (QUE_TEST_KIND_LOCKED == context.kind)
+                {
+                    ReleaseQueue(context.hQueue, NULL, NULL);
+                }
+                else if (QUE_TEST_KIND_RING == context.kind)
+                {
+                    ReleaseRing(context.hQueue, NULL, NULL);
+                }
+                else
+                {
+                    ReleaseSegmentedQueue(context.hQueue, NULL, NULL);
+                }
+
+                DutilUninitialize();
+                ::DeleteCriticalSection(&csLocked);
+            }
+        }
+    };
+}
+
+
+static DWORD STDAPICALLTYPE QueTestProducerThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    QUE_TEST_CONTEXT* pContext = static_cast<QUE_TEST_CONTEXT*>(lpThreadParameter);
+
+    for (DWORD_PTR i = 1; SUCCEEDED(hr) && i <= pContext->cItemsPerThread; ++i)
+    {
+        void* pvValue = reinterpret_cast<void*>(i);
+
+        switch (pContext->kind)
+        {
+        case QUE_TEST_KIND_RING:
+            hr = QueRingEnqueue(pContext->hQueue, pvValue, INFINITE);
+            break;
+
+        case QUE_TEST_KIND_SEGMENTED:
+            hr = QueSegmentedEnqueue(pContext->hQueue, pvValue);
+            break;
+
+        case QUE_TEST_KIND_LOCKED:
+            ::EnterCriticalSection(pContext->pcsLocked);
+            hr = QueEnqueue(pContext->hQueue, pvValue);
+            ::LeaveCriticalSection(pContext->pcsLocked);
+            break;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        ::InterlockedIncrement(&pContext->cFailures);
+    }
+
+    return hr;
+}
+
+static DWORD STDAPICALLTYPE QueTestConsumerThreadProc(
+    __in LPVOID lpThreadParameter
+    )
+{
+    HRESULT hr = S_OK;
+    QUE_TEST_CONTEXT* pContext = static_cast<QUE_TEST_CONTEXT*>(lpThreadParameter);
+    LONG64 llSum = 0;
+    void* pvValue = NULL;
+
+    for (DWORD i = 0; SUCCEEDED(hr) && i < pContext->cItemsPerThread; ++i)
+    {
+        switch (pContext->kind)
+        {
+        case QUE_TEST_KIND_RING:
+            hr = QueRingDequeue(pContext->hQueue, &pvValue, INFINITE);
+            break;
+
+        case QUE_TEST_KIND_SEGMENTED:
+            hr = QueSegmentedDequeue(pContext->hQueue, &pvValue, INFINITE);
+            break;
+
+        case QUE_TEST_KIND_LOCKED:
+            // The simple queue cannot block so spin until a producer catches up.
+            for (;;)
+            {
+                ::EnterCriticalSection(pContext->pcsLocked);
+                hr = QueDequeue(pContext->hQueue, &pvValue);
+                ::LeaveCriticalSection(pContext->pcsLocked);
+
+                if (E_NOMOREITEMS != hr)
+                {
+                    break;
+                }
+
+                ::SwitchToThread();
+            }
+            break;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            llSum += reinterpret_cast<LONG64>(pvValue);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        ::InterlockedIncrement(&pContext->cFailures);
+    }
+
+    ::InterlockedAdd64(&pContext->llSum, llSum);
+
+    return hr;
+}
+
+static void CALLBACK QueTestCountRelease(
+    __in void* /*pvValue*/,
+    __in void* pvContext
+    )
+{
+    ++*static_cast<DWORD*>(pvContext);
+}
+
+static HRESULT QueTestRunProducersConsumers(
+    __in QUE_TEST_CONTEXT* pContext,
+    __in DWORD cThreadPairs
+    )
+{
+    HRESULT hr = S_OK;
+    HANDLE rgThreads[32] = { };
+    DWORD cThreads = 0;
+
+    for (DWORD i = 0; i < cThreadPairs && cThreads + 1 < countof(rgThreads); ++i)
+    {
+        rgThreads[cThreads] = ::CreateThread(NULL, 0, QueTestConsumerThreadProc, pContext, 0, NULL);
+        if (!rgThreads[cThreads])
+        {
+            hr = HRESULT_FROM_WIN32(::GetLastError());
+            break;
+        }
+        ++cThreads;
+
+        rgThreads[cThreads] = ::CreateThread(NULL, 0, QueTestProducerThreadProc, pContext, 0, NULL);
+        if (!rgThreads[cThreads])
+        {
+            hr = HRESULT_FROM_WIN32(::GetLastError());
+            break;
+        }
+        ++cThreads;
+    }
+
+    if (cThreads)
+    {
+        ::WaitForMultipleObjects(cThreads, rgThreads, TRUE, INFINITE);
+    }
+
+    for (DWORD i = 0; i < cThreads; ++i)
+    {
+        ::CloseHandle(rgThreads[i]);
+    }
+
+    return hr;
+}
@@ -80,7 +80,517 @@ namespace DutilTests
             TestStrAnsiAllocString(b, 0, "abCd");
         }
 
+        [Fact]
+        void StrUtilFindMatchesScalarTest()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczString = NULL;
+            WCHAR wzFind[5] = { };
+            const WCHAR rgwchAlphabet[] = { L'a', L'A', L'b', L'B', L'z', L'[', L']', L'\\', L'\0', 0x00E9, 0x00C9, 0x4E2D };
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+            DWORD dwSeed = 0x5EED;
+
+            try
+            {
+                hr = StrAlloc(&sczString, 1025);
+                NativeAssert::Succeeded(hr, "Failed to allocate string.");
+
+                for (DWORD iIteration = 0; iIteration < 2000; ++iIteration)
+                {
+                    SIZE_T cchString = NextRandom(&dwSeed) % 1025;
+                    SIZE_T cchFind = NextRandom(&dwSeed) % countof(wzFind);
+
+                    for (SIZE_T i = 0; i < cchString; ++i)
+                    {
+                        sczString[i] = rgwchAlphabet[NextRandom(&dwSeed) % countof(rgwchAlphabet)];
+                    }
+
+                    for (SIZE_T i = 0; i < cchFind; ++i)
+                    {
+                        wzFind[i] = rgwchAlphabet[NextRandom(&dwSeed) % countof(rgwchAlphabet)];
+                    }
+
+                    // Plant the substring some of the time so there are matches away from the start.
+                    if (cchFind && cchFind <= cchString && 0 == NextRandom(&dwSeed) % 2)
+                    {
+                        memcpy(sczString + NextRandom(&dwSeed) % (cchString - cchFind + 1), wzFind, cchFind * sizeof(WCHAR));
+                    }
+
+                    for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                    {
+                        StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                        if (cchFind)
+                        {
+                            Assert::Equal<SIZE_T>(ReferenceFindCharInSet(sczString, cchString, wzFind, 1), IndexOf(sczString, StrFindChar(sczString, cchString, wzFind[0])));
+                        }
+
+                        Assert::Equal<SIZE_T>(ReferenceFindCharInSet(sczString, cchString, wzFind, cchFind), IndexOf(sczString, StrFindCharInSet(sczString, cchString, wzFind, cchFind)));
+                        Assert::Equal<SIZE_T>(ReferenceFindString(sczString, cchString, wzFind, cchFind, FALSE), IndexOf(sczString, StrFindString(sczString, cchString, wzFind, cchFind)));
+                        Assert::Equal<SIZE_T>(ReferenceFindString(sczString, cchString, wzFind, cchFind, TRUE), IndexOf(sczString, StrFindStringIgnoreCase(sczString, cchString, wzFind, cchFind)));
+                    }
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+                ReleaseStr(sczString);
+            }
+        }
+
+        [Fact]
+        void StrUtilMultiSzMatchesScalarTest()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczMultiSz = NULL;
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+            DWORD dwSeed = 0xC0FFEE;
+
+            try
+            {
+                hr = StrAlloc(&sczMultiSz, 4096);
+                NativeAssert::Succeeded(hr, "Failed to allocate MULTISZ.");
+
+                for (DWORD iIteration = 0; iIteration < 500; ++iIteration)
+                {
+                    SIZE_T cch = 0;
+                    DWORD cStrings = 1 + NextRandom(&dwSeed) % 20;
+
+                    for (DWORD i = 0; i < cStrings; ++i)
+                    {
+                        DWORD cchItem = 1 + NextRandom(&dwSeed) % 60;
+
+                        for (DWORD j = 0; j < cchItem; ++j)
+                        {
+                            sczMultiSz[cch++] = static_cast<WCHAR>(L'a' + NextRandom(&dwSeed) % 3);
+                        }
+
+                        sczMultiSz[cch++] = L'\0';
+                    }
+
+                    sczMultiSz[cch++] = L'\0';
+
+                    for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                    {
+                        SIZE_T cchActual = 0;
+                        DWORD_PTR dwIndex = 0;
+                        LPCWSTR wzFound = NULL;
+
+                        StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                        hr = MultiSzLen(sczMultiSz, &cchActual);
+                        NativeAssert::Succeeded(hr, "Failed to get MULTISZ length.");
+                        Assert::Equal<SIZE_T>(cch, cchActual);
+
+                        hr = MultiSzFindString(sczMultiSz, L"cab", &dwIndex, &wzFound);
+                        NativeAssert::Succeeded(hr, "Failed to find string in MULTISZ.");
+                        Assert::Equal<SIZE_T>(ReferenceMultiSzFind(sczMultiSz, L"cab", FALSE), S_OK == hr ? dwIndex : static_cast<SIZE_T>(-1));
+
+                        hr = MultiSzFindSubstring(sczMultiSz, L"CAB", &dwIndex, &wzFound);
+                        NativeAssert::Succeeded(hr, "Failed to find substring in MULTISZ.");
+                        Assert::Equal<SIZE_T>(ReferenceMultiSzFind(sczMultiSz, L"CAB", TRUE), S_OK == hr ? dwIndex : static_cast<SIZE_T>(-1));
+                    }
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+                ReleaseStr(sczMultiSz);
+            }
+        }
+
+        [Fact]
+        void StrUtilReplaceStringAllTest()
+        {
+            TestReplaceStringAll(L"100%", L"%", L"%%", L"100%%", S_OK);
+            TestReplaceStringAll(L"%a%b%", L"%", L"%%", L"%%a%%b%%", S_OK);
+            TestReplaceStringAll(L"!(loc.A) and !(loc.A)", L"!(loc.A)", L"x", L"x and x", S_OK);
+            TestReplaceStringAll(L"aaaa", L"aa", L"b", L"bb", S_OK);
+            TestReplaceStringAll(L"aaa", L"aa", L"", L"a", S_OK);
+            TestReplaceStringAll(L"nothing here", L"%", L"%%", L"nothing here", S_FALSE);
+            TestReplaceStringAll(L"", L"%", L"%%", L"", S_FALSE);
+        }
+
+        [Fact]
+        void StrUtilFindBenchmark()
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczString = NULL;
+            const SIZE_T cchString = 1024 * 1024 / sizeof(WCHAR);
+            const DWORD cRepetitions = 20;
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+
+            try
+            {
+                PerfInitialize();
+
+                hr = StrAlloc(&sczString, cchString + 2);
+                NativeAssert::Succeeded(hr, "Failed to allocate string.");
+
+                // 1 MB of text with a single match for every search at the very end.
+                for (SIZE_T i = 0; i < cchString; ++i)
+                {
+                    sczString[i] = static_cast<WCHAR>(L'a' + i % 25);
+                }
+
+                sczString[cchString - 3] = L'Z';
+                sczString[cchString - 2] = L'Z';
+                sczString[cchString - 1] = L'[';
+                sczString[cchString] = L'\0';
+                sczString[cchString + 1] = L'\0';
+
+                for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                {
+                    LARGE_INTEGER liFindChar = { };
+                    LARGE_INTEGER liFindCharInSet = { };
+                    LARGE_INTEGER liFindStringIgnoreCase = { };
+                    LARGE_INTEGER liMultiSzLen = { };
+                    SIZE_T cchMultiSz = 0;
+
+                    StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                    PerfClickTime(NULL);
+                    for (DWORD i = 0; i < cRepetitions; ++i)
+                    {
+                        Assert::True(sczString + cchString - 1 == StrFindChar(sczString, cchString, L'['));
+                    }
+                    PerfClickTime(&liFindChar);
+
+                    for (DWORD i = 0; i < cRepetitions; ++i)
+                    {
+                        Assert::True(sczString + cchString - 3 == StrFindCharInSet(sczString, cchString, L"Z[]", 3));
+                    }
+                    PerfClickTime(&liFindCharInSet);
+
+                    for (DWORD i = 0; i < cRepetitions; ++i)
+                    {
+                        Assert::True(sczString + cchString - 3 == StrFindStringIgnoreCase(sczString, cchString, L"zz[", 3));
+                    }
+                    PerfClickTime(&liFindStringIgnoreCase);
+
+                    for (DWORD i = 0; i < cRepetitions; ++i)
+                    {
+                        hr = MultiSzLen(sczString, &cchMultiSz);
+                        NativeAssert::Succeeded(hr, "Failed to get MULTISZ length.");
+                    }
+                    PerfClickTime(&liMultiSzLen);
+
+                    Assert::Equal<SIZE_T>(cchString + 2, cchMultiSz);
+
+                    Console::WriteLine("SIMD level {0}: StrFindChar {1:F0} MB/s, StrFindCharInSet {2:F0} MB/s, StrFindStringIgnoreCase {3:F0} MB/s, MultiSzLen {4:F0} MB/s",
+                        nLevel, cRepetitions / PerfConvertToSeconds(&liFindChar), cRepetitions / PerfConvertToSeconds(&liFindCharInSet),
+                        cRepetitions / PerfConvertToSeconds(&liFindStringIgnoreCase), cRepetitions / PerfConvertToSeconds(&liMultiSzLen));
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+                ReleaseStr(sczString);
+            }
+        }
+
+        [Fact]
+        void StrUtilEncodeKnownValuesTest()
+        {
+            const BYTE rgbHex[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10, 0x00, 0xFF };
+            const BYTE rgbMax[] = { 0xFF, 0xFF, 0xFF, 0xFF };
+            const BYTE rgbCounting[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+
+            try
+            {
+                for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                {
+                    StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                    TestHexEncode(rgbHex, sizeof(rgbHex), L"0123456789ABCDEFFEDCBA9876543210" L"00FF");
+                    TestBase85Encode(rgbMax, sizeof(rgbMax), L"!1_?|");
+                    TestBase85Encode(rgbCounting, sizeof(rgbCounting), L"/fZ@%BWAY'.!");
+                    TestBase85Encode(reinterpret_cast<const BYTE*>("WiX Toolset"), 11, L"cE_I/t9DrJwmK1");
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+            }
+        }
+
+        [Fact]
+        void StrUtilEncodeMatchesScalarTest()
+        {
+            HRESULT hr = S_OK;
+            BYTE rgbSource[1027] = { };
+            LPWSTR sczScalarHex = NULL;
+            LPWSTR sczScalarBase85 = NULL;
+            LPWSTR sczEncoded = NULL;
+            BYTE* pbDecoded = NULL;
+            DWORD cbHexDecoded = 0;
+            SIZE_T cbBase85Decoded = 0;
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+            DWORD dwSeed = 0xC0DE;
+
+            try
+            {
+                for (DWORD iIteration = 0; iIteration < 500; ++iIteration)
+                {
+                    SIZE_T cbSource = 1 + NextRandom(&dwSeed) % countof(rgbSource);
+
+                    for (SIZE_T i = 0; i < cbSource; ++i)
+                    {
+                        rgbSource[i] = static_cast<BYTE>(NextRandom(&dwSeed));
+                    }
+
+                    StrSetSimdLevel(STR_SIMD_LEVEL_NONE);
+
+                    hr = StrAllocHexEncode(rgbSource, cbSource, &sczScalarHex);
+                    NativeAssert::Succeeded(hr, "Failed to hex encode with scalar code.");
+
+                    hr = StrAllocBase85Encode(rgbSource, cbSource, &sczScalarBase85);
+                    NativeAssert::Succeeded(hr, "Failed to base85 encode with scalar code.");
+
+                    for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                    {
+                        StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                        hr = StrAllocHexEncode(rgbSource, cbSource, &sczEncoded);
+                        NativeAssert::Succeeded(hr, "Failed to hex encode.");
+                        NativeAssert::StringEqual(sczScalarHex, sczEncoded);
+
+                        // Decoding must accept lowercase the same as uppercase.
+                        for (LPWSTR wz = sczEncoded; *wz; ++wz)
+                        {
+                            if (0 == NextRandom(&dwSeed) % 2)
+                            {
+                                *wz = static_cast<WCHAR>(towlower(*wz));
+                            }
+                        }
+
+                        hr = StrAllocHexDecode(sczEncoded, &pbDecoded, &cbHexDecoded);
+                        NativeAssert::Succeeded(hr, "Failed to hex decode.");
+                        Assert::Equal<SIZE_T>(cbSource, cbHexDecoded);
+                        Assert::True(0 == memcmp(rgbSource, pbDecoded, cbSource));
+
+                        ReleaseNullMem(pbDecoded);
+
+                        hr = StrAllocBase85Encode(rgbSource, cbSource, &sczEncoded);
+                        NativeAssert::Succeeded(hr, "Failed to base85 encode.");
+                        NativeAssert::StringEqual(sczScalarBase85, sczEncoded);
+
+                        hr = StrAllocBase85Decode(sczEncoded, &pbDecoded, &cbBase85Decoded);
+                        NativeAssert::Succeeded(hr, "Failed to base85 decode.");
+                        Assert::Equal<SIZE_T>(cbSource, cbBase85Decoded);
+                        Assert::True(0 == memcmp(rgbSource, pbDecoded, cbSource));
+
+                        ReleaseNullMem(pbDecoded);
+                    }
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+                ReleaseStr(sczScalarHex);
+                ReleaseStr(sczScalarBase85);
+                ReleaseStr(sczEncoded);
+                ReleaseMem(pbDecoded);
+            }
+        }
+
+        [Fact]
+        void StrUtilEncodeBenchmark()
+        {
+            HRESULT hr = S_OK;
+            BYTE* pbSource = NULL;
+            BYTE* pbDecoded = NULL;
+            LPWSTR sczHex = NULL;
+            LPWSTR sczBase85 = NULL;
+            DWORD cbHexDecoded = 0;
+            SIZE_T cbBase85Decoded = 0;
+            const SIZE_T cbSource = 10 * 1024 * 1024;
+            const double dMegabytes = static_cast<double>(cbSource) / (1024 * 1024);
+            STR_SIMD_LEVEL maxLevel = StrGetSimdLevel();
+            DWORD dwSeed = 0xBEEF;
+
+            try
+            {
+                pbSource = static_cast<BYTE*>(MemAlloc(cbSource, FALSE));
+                Assert::True(NULL != pbSource);
+
+                for (SIZE_T i = 0; i < cbSource; ++i)
+                {
+                    pbSource[i] = static_cast<BYTE>(NextRandom(&dwSeed));
+                }
+
+                for (int nLevel = STR_SIMD_LEVEL_NONE; nLevel <= maxLevel; ++nLevel)
+                {
+                    LARGE_INTEGER liHexEncode = { };
+                    LARGE_INTEGER liHexDecode = { };
+                    LARGE_INTEGER liBase85Encode = { };
+                    LARGE_INTEGER liBase85Decode = { };
+
+                    StrSetSimdLevel(static_cast<STR_SIMD_LEVEL>(nLevel));
+
+                    PerfClickTime(NULL);
+                    hr = StrAllocHexEncode(pbSource, cbSource, &sczHex);
+                    PerfClickTime(&liHexEncode);
+                    NativeAssert::Succeeded(hr, "Failed to hex encode.");
+
+                    PerfClickTime(NULL);
+                    hr = StrAllocHexDecode(sczHex, &pbDecoded, &cbHexDecoded);
+                    PerfClickTime(&liHexDecode);
+                    NativeAssert::Succeeded(hr, "Failed to hex decode.");
+                    Assert::True(0 == memcmp(pbSource, pbDecoded, cbSource));
+
+                    ReleaseNullMem(pbDecoded);
+
+                    PerfClickTime(NULL);
+                    hr = StrAllocBase85Encode(pbSource, cbSource, &sczBase85);
+                    PerfClickTime(&liBase85Encode);
+                    NativeAssert::Succeeded(hr, "Failed to base85 encode.");
+
+                    PerfClickTime(NULL);
+                    hr = StrAllocBase85Decode(sczBase85, &pbDecoded, &cbBase85Decoded);
+                    PerfClickTime(&liBase85Decode);
+                    NativeAssert::Succeeded(hr, "Failed to base85 decode.");
+                    Assert::True(0 == memcmp(pbSource, pbDecoded, cbSource));
+
+                    ReleaseNullMem(pbDecoded);
+
+                    Console::WriteLine("SIMD level {0}: hex encode {1:F0} MB/s, hex decode {2:F0} MB/s, base85 encode {3:F0} MB/s, base85 decode {4:F0} MB/s",
+                        nLevel, dMegabytes / PerfConvertToSeconds(&liHexEncode), dMegabytes / PerfConvertToSeconds(&liHexDecode),
+                        dMegabytes / PerfConvertToSeconds(&liBase85Encode), dMegabytes / PerfConvertToSeconds(&liBase85Decode));
+                }
+            }
+            finally
+            {
+                StrSetSimdLevel(maxLevel);
+                ReleaseStr(sczHex);
+                ReleaseStr(sczBase85);
+                ReleaseMem(pbDecoded);
+                ReleaseMem(pbSource);
+            }
+        }
+
     private:
+        static DWORD NextRandom(DWORD* pdwSeed)
+        {
+            *pdwSeed = *pdwSeed * 1103515245 + 12345;
+            return *pdwSeed >> 8;
+        }
+
+        static SIZE_T IndexOf(LPCWSTR wzString, LPCWSTR wzFound)
+        {
+            return wzFound ? wzFound - wzString : static_cast<SIZE_T>(-1);
+        }
+
+        static SIZE_T ReferenceFindCharInSet(LPCWSTR wzString, SIZE_T cchString, LPCWSTR wzSet, SIZE_T cchSet)
+        {
+            for (SIZE_T i = 0; i < cchString; ++i)
+            {
+                for (SIZE_T j = 0; j < cchSet; ++j)
+                {
+                    if (wzString[i] == wzSet[j])
+                    {
+                        return i;
+                    }
+                }
+            }
+
+            return static_cast<SIZE_T>(-1);
+        }
+
+        static SIZE_T ReferenceFindString(LPCWSTR wzString, SIZE_T cchString, LPCWSTR wzFind, SIZE_T cchFind, BOOL fIgnoreCase)
+        {
+            for (SIZE_T i = 0; i + cchFind <= cchString; ++i)
+            {
+                SIZE_T j = 0;
+
+                while (j < cchFind && (fIgnoreCase ? towlower(wzString[i + j]) == towlower(wzFind[j]) : wzString[i + j] == wzFind[j]))
+                {
+                    ++j;
+                }
+
+                if (j == cchFind)
+                {
+                    return i;
+                }
+            }
+
+            return static_cast<SIZE_T>(-1);
+        }
+
+        static SIZE_T ReferenceMultiSzFind(LPCWSTR wzMultiSz, LPCWSTR wzFind, BOOL fSubstring)
+        {
+            SIZE_T cchFind = wcslen(wzFind);
+
+            for (SIZE_T iString = 0; *wzMultiSz; ++iString)
+            {
+                SIZE_T cchString = wcslen(wzMultiSz);
+
+                if (fSubstring ? static_cast<SIZE_T>(-1) != ReferenceFindString(wzMultiSz, cchString, wzFind, cchFind, TRUE) : 0 == wcscmp(wzMultiSz, wzFind))
+                {
+                    return iString;
+                }
+
+                wzMultiSz += cchString + 1;
+            }
+
+            return static_cast<SIZE_T>(-1);
+        }
+
+        void TestReplaceStringAll(LPCWSTR wzInput, LPCWSTR wzOld, LPCWSTR wzNew, LPCWSTR wzExpectedResult, HRESULT hrExpected)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczOutput = NULL;
+
+            try
+            {
+                hr = StrAllocString(&sczOutput, wzInput, 0);
+                NativeAssert::Succeeded(hr, "Failed to copy string: {0}", wzInput);
+
+                hr = StrReplaceStringAll(&sczOutput, wzOld, wzNew);
+                NativeAssert::SpecificReturnCode(hrExpected, hr, "Unexpected result replacing in string: {0}", wzInput);
+                NativeAssert::StringEqual(wzExpectedResult, sczOutput);
+            }
+            finally
+            {
+                ReleaseStr(sczOutput);
+            }
+        }
+
+        void TestHexEncode(const BYTE* pbSource, SIZE_T cbSource, LPCWSTR wzExpectedResult)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczOutput = NULL;
+
+            try
+            {
+                hr = StrAllocHexEncode(pbSource, cbSource, &sczOutput);
+                NativeAssert::Succeeded(hr, "Failed to hex encode.");
+                NativeAssert::StringEqual(wzExpectedResult, sczOutput);
+            }
+            finally
+            {
+                ReleaseStr(sczOutput);
+            }
+        }
+
+        void TestBase85Encode(const BYTE* pbSource, SIZE_T cbSource, LPCWSTR wzExpectedResult)
+        {
+            HRESULT hr = S_OK;
+            LPWSTR sczOutput = NULL;
+
+            try
+            {
+                hr = StrAllocBase85Encode(pbSource, cbSource, &sczOutput);
+                NativeAssert::Succeeded(hr, "Failed to base85 encode.");
+                NativeAssert::StringEqual(wzExpectedResult, sczOutput);
+            }
+            finally
+            {
+                ReleaseStr(sczOutput);
+            }
+        }
+
         void TestTrim(LPCWSTR wzInput, LPCWSTR wzExpectedResult)
         {
             HRESULT hr = S_OK;
@@ -0,0 +1,463 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+#include "precomp.h"
+
+using namespace System;
+using namespace Xunit;
+using namespace WixInternal::TestSupport;
+
+struct THRD_TEST_FIBONACCI
+{
+    THRD_POOL_HANDLE hPool;
+    DWORD dwN;
+    DWORD dwResult;
+};
+
+struct THRD_TEST_ORDER
+{
+    volatile LONG cRecorded;
+    DWORD rgdwOrder[10];
+};
+
+struct THRD_TEST_ORDER_ITEM
+{
+    THRD_TEST_ORDER* pOrder;
+    DWORD dwValue;
+};
+
+struct THRD_TEST_SHARED_INITIALIZE
+{
+    HANDLE hStart;
+    volatile LONG cRun;
+};
+
+static HRESULT CALLBACK ThrdTestIncrement(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT CALLBACK ThrdTestFibonacci(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT CALLBACK ThrdTestBlock(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT CALLBACK ThrdTestRecordOrder(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static HRESULT CALLBACK ThrdTestFail(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext
+    );
+static DWORD WINAPI ThrdTestSharedInitialize(
+    __in LPVOID pvContext
+    );
+
+namespace DutilTests
+{
+    public ref class ThrdUtil
+    {
+    public:
+        [Fact]
+        void ThrdPoolRunsAllWorkTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_POOL_HANDLE hPool = NULL;
+            THRD_GROUP_HANDLE hGroup = NULL;
+            LONG cRun = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hr = ThrdPoolCreate(4, &hPool);
+                NativeAssert::Succeeded(hr, "Failed to create thread pool.");
+                Assert::Equal<DWORD>(4, ThrdPoolGetThreadCount(hPool));
+
+                hr = ThrdGroupCreate(hPool, &hGroup);
+                NativeAssert::Succeeded(hr, "Failed to create thread group.");
+
+                for (DWORD i = 0; i < 10000; ++i)
+                {
+                    hr = ThrdGroupSubmit(hGroup, static_cast<THRD_PRIORITY>(i % 3), ThrdTestIncrement, &cRun);
+                    NativeAssert::Succeeded(hr, "Failed to submit work {0}.", i);
+                }
+
+                hr = ThrdGroupWait(hGroup, INFINITE);
+                NativeAssert::Succeeded(hr, "Failed to wait for thread group.");
+                Assert::Equal<LONG>(10000, cRun);
+            }
+            finally
+            {
+                ReleaseThreadGroup(hGroup);
+                ReleaseThreadPool(hPool);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void ThrdPoolNestedWaitTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_POOL_HANDLE hPool = NULL;
+            THRD_GROUP_HANDLE hGroup = NULL;
+            THRD_TEST_FIBONACCI fibonacci = { };
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                // A single worker can only finish this if waiting inside work runs the nested work.
+                hr = ThrdPoolCreate(1, &hPool);
+                NativeAssert::Succeeded(hr, "Failed to create thread pool.");
+
+                hr = ThrdGroupCreate(hPool, &hGroup);
+                NativeAssert::Succeeded(hr, "Failed to create thread group.");
+
+                fibonacci.hPool = hPool;
+                fibonacci.dwN = 15;
+
+                hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestFibonacci, &fibonacci);
+                NativeAssert::Succeeded(hr, "Failed to submit work.");
+
+                hr = ThrdGroupWait(hGroup, INFINITE);
+                NativeAssert::Succeeded(hr, "Failed to wait for thread group.");
+                Assert::Equal<DWORD>(610, fibonacci.dwResult);
+            }
+            finally
+            {
+                ReleaseThreadGroup(hGroup);
+                ReleaseThreadPool(hPool);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void ThrdGroupCancelTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_POOL_HANDLE hPool = NULL;
+            THRD_GROUP_HANDLE hGroup = NULL;
+            HANDLE hBlock = NULL;
+            LONG cRun = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hBlock = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+                Assert::True(NULL != hBlock);
+
+                hr = ThrdPoolCreate(1, &hPool);
+                NativeAssert::Succeeded(hr, "Failed to create thread pool.");
+
+                hr = ThrdGroupCreate(hPool, &hGroup);
+                NativeAssert::Succeeded(hr, "Failed to create thread group.");
+
+                hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestBlock, hBlock);
+                NativeAssert::Succeeded(hr, "Failed to submit blocking work.");
+
+                for (DWORD i = 0; i < 10; ++i)
+                {
+                    hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestIncrement, &cRun);
+                    NativeAssert::Succeeded(hr, "Failed to submit work {0}.", i);
+                }
+
+                hr = ThrdGroupWait(hGroup, 10);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(WAIT_TIMEOUT), hr, "Expected thread group wait to time out.");
+
+                ThrdGroupCancel(hGroup);
+                Assert::True(ThrdGroupIsCancelled(hGroup));
+
+                hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestIncrement, &cRun);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_CANCELLED), hr, "Expected submit to cancelled group to fail.");
+
+                ::SetEvent(hBlock);
+
+                hr = ThrdGroupWait(hGroup, INFINITE);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_CANCELLED), hr, "Expected cancelled thread group.");
+                Assert::Equal<LONG>(0, cRun);
+            }
+            finally
+            {
+                ReleaseThreadGroup(hGroup);
+                ReleaseThreadPool(hPool);
+                ReleaseHandle(hBlock);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void ThrdGroupPriorityAndFailureTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_POOL_HANDLE hPool = NULL;
+            THRD_GROUP_HANDLE hGroup = NULL;
+            HANDLE hBlock = NULL;
+            THRD_TEST_ORDER order = { };
+            THRD_TEST_ORDER_ITEM rgItems[10] = { };
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hBlock = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+                Assert::True(NULL != hBlock);
+
+                hr = ThrdPoolCreate(1, &hPool);
+                NativeAssert::Succeeded(hr, "Failed to create thread pool.");
+
+                hr = ThrdGroupCreate(hPool, &hGroup);
+                NativeAssert::Succeeded(hr, "Failed to create thread group.");
+
+                // Hold the only worker so everything below is queued before any of it runs.
+                hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestBlock, hBlock);
+                NativeAssert::Succeeded(hr, "Failed to submit blocking work.");
+
+                hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestFail, NULL);
+                NativeAssert::Succeeded(hr, "Failed to submit failing work.");
+
+                for (DWORD i = 0; i < countof(rgItems); ++i)
+                {
+                    rgItems[i].pOrder = &order;
+                    rgItems[i].dwValue = i;
+
+                    hr = ThrdGroupSubmit(hGroup, i < 5 ? THRD_PRIORITY_LOW : THRD_PRIORITY_HIGH, ThrdTestRecordOrder, rgItems + i);
+                    NativeAssert::Succeeded(hr, "Failed to submit work {0}.", i);
+                }
+
+                ::SetEvent(hBlock);
+
+                hr = ThrdGroupWait(hGroup, INFINITE);
+                NativeAssert::SpecificReturnCode(E_FAIL, hr, "Expected the failure from the group's work.");
+
+                Assert::Equal<LONG>(10, order.cRecorded);
+                for (DWORD i = 0; i < 5; ++i)
+                {
+                    Assert::Equal<DWORD>(5 + i, order.rgdwOrder[i]);
+                    Assert::Equal<DWORD>(i, order.rgdwOrder[5 + i]);
+                }
+            }
+            finally
+            {
+                ReleaseThreadGroup(hGroup);
+                ReleaseThreadPool(hPool);
+                ReleaseHandle(hBlock);
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void ThrdSharedPoolTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_GROUP_HANDLE hGroup = NULL;
+            BOOL fInitialized = FALSE;
+            LONG cRun = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                hr = ThrdGroupCreate(NULL, &hGroup);
+                NativeAssert::SpecificReturnCode(HRESULT_FROM_WIN32(ERROR_INVALID_STATE), hr, "Expected shared pool to require initialization.");
+
+                hr = ThrdPoolInitialize(0);
+                NativeAssert::Succeeded(hr, "Failed to initialize shared thread pool.");
+                fInitialized = TRUE;
+
+                Assert::True(0 < ThrdPoolGetThreadCount(NULL));
+
+                hr = ThrdGroupCreate(NULL, &hGroup);
+                NativeAssert::Succeeded(hr, "Failed to create thread group on shared pool.");
+
+                for (DWORD i = 0; i < 100; ++i)
+                {
+                    hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestIncrement, &cRun);
+                    NativeAssert::Succeeded(hr, "Failed to submit work {0}.", i);
+                }
+
+                hr = ThrdGroupWait(hGroup, INFINITE);
+                NativeAssert::Succeeded(hr, "Failed to wait for thread group.");
+                Assert::Equal<LONG>(100, cRun);
+            }
+            finally
+            {
+                ReleaseThreadGroup(hGroup);
+
+                if (fInitialized)
+                {
+                    ThrdPoolUninitialize();
+                }
+
+                DutilUninitialize();
+            }
+        }
+
+        [Fact]
+        void ThrdSharedPoolConcurrentInitializeTest()
+        {
+            HRESULT hr = S_OK;
+            THRD_TEST_SHARED_INITIALIZE context = { };
+            HANDLE rghThreads[8] = { };
+            DWORD dwExitCode = 0;
+
+            DutilInitialize(&DutilTestTraceError);
+
+            try
+            {
+                context.hStart = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+                Assert::True(NULL != context.hStart);
+
+                for (DWORD i = 0; i < countof(rghThreads); ++i)
+                {
+                    rghThreads[i] = ::CreateThread(NULL, 0, ThrdTestSharedInitialize, &context, 0, NULL);
+                    Assert::True(NULL != rghThreads[i]);
+                }
+
+                // Every thread initializes the shared pool at once and uses it right away.
+                ::SetEvent(context.hStart);
+
+                for (DWORD i = 0; i < countof(rghThreads); ++i)
+                {
+                    hr = ThrdWaitForCompletion(rghThreads[i], INFINITE, &dwExitCode);
+                    NativeAssert::Succeeded(hr, "Failed to wait for thread {0}.", i);
+                    NativeAssert::Succeeded(static_cast<HRESULT>(dwExitCode), "Thread {0} failed to use the shared pool.", i);
+                }
+
+                Assert::Equal<LONG>(countof(rghThreads) * 100, context.cRun);
+            }
+            finally
+            {
+                for (DWORD i = 0; i < countof(rghThreads); ++i)
+                {
+                    ReleaseHandle(rghThreads[i]);
+                }
+
+                ReleaseHandle(context.hStart);
+                DutilUninitialize();
+            }
+        }
+    };
+}
+
+
+static HRESULT CALLBACK ThrdTestIncrement(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+    )
+{
+    ::InterlockedIncrement(static_cast<LONG*>(pvContext));
+
+    return S_OK;
+}
+
+static HRESULT CALLBACK ThrdTestFibonacci(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_TEST_FIBONACCI* pFibonacci = static_cast<THRD_TEST_FIBONACCI*>(pvContext);
+    THRD_TEST_FIBONACCI rgChildren[2] = { };
+    THRD_GROUP_HANDLE hGroup = NULL;
+
+    if (2 > pFibonacci->dwN)
+    {
+        pFibonacci->dwResult = pFibonacci->dwN;
+        ExitFunction();
+    }
+
+    hr = ThrdGroupCreate(pFibonacci->hPool, &hGroup);
+    ExitOnFailure(hr, "Failed to create nested thread group.");
+
+    for (DWORD i = 0; i < countof(rgChildren); ++i)
+    {
+        rgChildren[i].hPool = pFibonacci->hPool;
+        rgChildren[i].dwN = pFibonacci->dwN - 1 - i;
+
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestFibonacci, rgChildren + i);
+        ExitOnFailure(hr, "Failed to submit nested work.");
+    }
+
+    hr = ThrdGroupWait(hGroup, INFINITE);
+    ExitOnFailure(hr, "Failed to wait for nested work.");
+
+    pFibonacci->dwResult = rgChildren[0].dwResult + rgChildren[1].dwResult;
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+
+    return hr;
+}
+
+static HRESULT CALLBACK ThrdTestBlock(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+    )
+{
+    ::WaitForSingleObject(static_cast<HANDLE>(pvContext), INFINITE);
+
+    return S_OK;
+}
+
+static HRESULT CALLBACK ThrdTestRecordOrder(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+    )
+{
+    THRD_TEST_ORDER_ITEM* pItem = static_cast<THRD_TEST_ORDER_ITEM*>(pvContext);
+    LONG iOrder = ::InterlockedIncrement(&pItem->pOrder->cRecorded) - 1;
+
+    pItem->pOrder->rgdwOrder[iOrder] = pItem->dwValue;
+
+    return S_OK;
+}
+
+static HRESULT CALLBACK ThrdTestFail(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID /*pvContext*/
+    )
+{
+    return E_FAIL;
+}
+
+static DWORD WINAPI ThrdTestSharedInitialize(
+    __in LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    THRD_TEST_SHARED_INITIALIZE* pContext = static_cast<THRD_TEST_SHARED_INITIALIZE*>(pvContext);
+    THRD_GROUP_HANDLE hGroup = NULL;
+    BOOL fInitialized = FALSE;
+
+    ::WaitForSingleObject(pContext->hStart, INFINITE);
+
+    hr = ThrdPoolInitialize(0);
+    ExitOnFailure(hr, "Failed to initialize shared thread pool.");
+    fInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ExitOnFailure(hr, "Failed to create thread group on shared pool.");
+
+    for (DWORD i = 0; i < 100; ++i)
+    {
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ThrdTestIncrement, const_cast<LONG*>(&pContext->cRun));
+        ExitOnFailure(hr, "Failed to submit work.");
+    }
+
+    hr = ThrdGroupWait(hGroup, INFINITE);
+    ExitOnFailure(hr, "Failed to wait for thread group.");
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+
+    if (fInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    return static_cast<DWORD>(hr);
+}
@@ -1159,7 +1159,214 @@ namespace DutilTests
             }
         }
 
+        [Fact]
+        void VerCompareParsedVersionsPacksNumericVersions()
+        {
+            HRESULT hr = S_OK;
+            VERUTIL_VERSION* pVersion1 = NULL;
+            VERUTIL_VERSION* pVersion2 = NULL;
+            VERUTIL_VERSION* pVersion3 = NULL;
+            VERUTIL_VERSION* pVersion4 = NULL;
+            VERUTIL_VERSION* pVersion5 = NULL;
+            LPCWSTR wzVersion1 = L"1.2.3.4";
+            LPCWSTR wzVersion2 = L"1.2.3.4+abc";
+            LPCWSTR wzVersion3 = L"1.2.3.65536";
+            LPCWSTR wzVersion4 = L"1.2.3.4-beta";
+            LPCWSTR wzVersion5 = L"1.2.65535";
+
+            try
+            {
+                hr = VerParseVersion(wzVersion1, 0, FALSE, &pVersion1);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion1);
+
+                hr = VerParseVersion(wzVersion2, 0, FALSE, &pVersion2);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion2);
+
+                hr = VerParseVersion(wzVersion3, 0, FALSE, &pVersion3);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion3);
+
+                hr = VerParseVersion(wzVersion4, 0, FALSE, &pVersion4);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion4);
+
+                hr = VerParseVersion(wzVersion5, 0, FALSE, &pVersion5);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion5);
+
+                Assert::Equal<BOOL>(TRUE, pVersion1->fPacked);
+                Assert::Equal<DWORD64>(MAKEQWORDVERSION(1, 2, 3, 4), pVersion1->qwPacked);
+                Assert::Equal<BOOL>(TRUE, pVersion2->fPacked);
+                Assert::Equal<DWORD64>(MAKEQWORDVERSION(1, 2, 3, 4), pVersion2->qwPacked);
+                Assert::Equal<BOOL>(FALSE, pVersion3->fPacked);
+                Assert::Equal<BOOL>(FALSE, pVersion4->fPacked);
+                Assert::Equal<BOOL>(TRUE, pVersion5->fPacked);
+                Assert::Equal<DWORD64>(MAKEQWORDVERSION(1, 2, 65535, 0), pVersion5->qwPacked);
+
+                TestVerutilCompareParsedVersions(pVersion1, pVersion2, 0);
+                TestVerutilCompareParsedVersions(pVersion3, pVersion1, 1);
+                TestVerutilCompareParsedVersions(pVersion1, pVersion4, 1);
+                TestVerutilCompareParsedVersions(pVersion5, pVersion1, 1);
+                TestVerutilCompareParsedVersions(pVersion5, pVersion3, 1);
+            }
+            finally
+            {
+                ReleaseVerutilVersion(pVersion1);
+                ReleaseVerutilVersion(pVersion2);
+                ReleaseVerutilVersion(pVersion3);
+                ReleaseVerutilVersion(pVersion4);
+                ReleaseVerutilVersion(pVersion5);
+            }
+        }
+
+        [Fact]
+        void VerCacheParseVersionSharesVersions()
+        {
+            HRESULT hr = S_OK;
+            VERUTIL_VERSION* pVersion1 = NULL;
+            VERUTIL_VERSION* pVersion2 = NULL;
+            VERUTIL_VERSION* pVersion3 = NULL;
+            VERUTIL_VERSION* pVersion4 = NULL;
+            VERUTIL_VERSION* pVersion5 = NULL;
+            LPCWSTR wzVersion1 = L"v1.2.3.4";
+            LPCWSTR wzVersion2 = L"1.2.3.4";
+            LPCWSTR wzVersion3 = L"1.2.3.4.5";
+            BOOL fInitialized = FALSE;
+
+            try
+            {
+                hr = VerCacheInitialize(0);
+                NativeAssert::Succeeded(hr, "Failed to initialize version cache");
+                fInitialized = TRUE;
+
+                hr = VerCacheParseVersion(wzVersion1, 0, FALSE, &pVersion1);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion1);
+
+                hr = VerCacheParseVersion(wzVersion1, 0, FALSE, &pVersion2);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion1);
+
+                hr = VerCacheParseVersion(wzVersion2, 0, FALSE, &pVersion3);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion2);
+
+                hr = VerCopyVersion(pVersion1, &pVersion4);
+                NativeAssert::Succeeded(hr, "Failed to copy version '{0}'", wzVersion1);
+
+                Assert::True(pVersion1 == pVersion2);
+                Assert::True(pVersion1 == pVersion4);
+                Assert::False(pVersion1 == pVersion3);
+                Assert::Equal<WCHAR>(L'v', pVersion1->chPrefix);
+                Assert::Equal<WCHAR>(L'\0', pVersion3->chPrefix);
+                TestVerutilCompareParsedVersions(pVersion1, pVersion3, 0);
+
+                hr = VerCacheParseVersion(wzVersion3, 0, TRUE, &pVersion5);
+                NativeAssert::SpecificReturnCode(E_INVALIDARG, hr, "Strict parse of version '{0}' should fail", wzVersion3);
+                Assert::True(NULL == pVersion5);
+
+                hr = VerCacheParseVersion(wzVersion3, 7, TRUE, &pVersion5);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", wzVersion3);
+                NativeAssert::StringEqual(L"1.2.3.4", pVersion5->sczVersion);
+                Assert::True(pVersion5 == pVersion3);
+
+                // Cached versions outlive the cache while they are referenced.
+                VerCacheUninitialize();
+                fInitialized = FALSE;
+
+                NativeAssert::StringEqual(L"1.2.3.4", pVersion1->sczVersion);
+                TestVerutilCompareParsedVersions(pVersion4, pVersion3, 0);
+            }
+            finally
+            {
+                ReleaseVerutilVersion(pVersion1);
+                ReleaseVerutilVersion(pVersion2);
+                ReleaseVerutilVersion(pVersion3);
+                ReleaseVerutilVersion(pVersion4);
+                ReleaseVerutilVersion(pVersion5);
+
+                if (fInitialized)
+                {
+                    VerCacheUninitialize();
+                }
+            }
+        }
+
+        [Fact]
+        void VerCacheParseVersionBenchmark()
+        {
+            HRESULT hr = S_OK;
+            const DWORD cIterations = 20000;
+            LPCWSTR rgwzVersions[] = { L"1.0.0.0", L"10.0.19041.1", L"v4.8.04084", L"5.0.0-preview.1+build.7", L"1.2.3.65536", L"2.0" };
+            VERUTIL_VERSION* rgpVersions[countof(rgwzVersions)] = { };
+            int rgnExpected[countof(rgwzVersions)] = { };
+            LARGE_INTEGER liUncached = { };
+            LARGE_INTEGER liCached = { };
+            BOOL fInitialized = FALSE;
+
+            try
+            {
+                PerfInitialize();
+
+                PerfClickTime(NULL);
+                for (DWORD i = 0; i < cIterations; ++i)
+                {
+                    DWORD iVersion = i % countof(rgwzVersions);
+                    ParseAndCompareVersions(FALSE, rgwzVersions, rgpVersions, countof(rgwzVersions), iVersion, rgnExpected + iVersion);
+                }
+                PerfClickTime(&liUncached);
+
+                hr = VerCacheInitialize(0);
+                NativeAssert::Succeeded(hr, "Failed to initialize version cache");
+                fInitialized = TRUE;
+
+                PerfClickTime(NULL);
+                for (DWORD i = 0; i < cIterations; ++i)
+                {
+                    int nResult = 0;
+                    DWORD iVersion = i % countof(rgwzVersions);
+                    ParseAndCompareVersions(TRUE, rgwzVersions, rgpVersions, countof(rgwzVersions), iVersion, &nResult);
+
+                    Assert::Equal(rgnExpected[iVersion], nResult);
+                }
+                PerfClickTime(&liCached);
+
+                Console::WriteLine("VerParseVersion: {0:F4}s, VerCacheParseVersion: {1:F4}s for {2} parse and compare iterations.", PerfConvertToSeconds(&liUncached), PerfConvertToSeconds(&liCached), cIterations);
+            }
+            finally
+            {
+                for (DWORD i = 0; i < countof(rgpVersions); ++i)
+                {
+                    ReleaseVerutilVersion(rgpVersions[i]);
+                }
+
+                if (fInitialized)
+                {
+                    VerCacheUninitialize();
+                }
+            }
+        }
+
     private:
+        void ParseAndCompareVersions(BOOL fCached, LPCWSTR* rgwzVersions, VERUTIL_VERSION** rgpVersions, DWORD cVersions, DWORD iVersion, int* pnResult)
+        {
+            HRESULT hr = S_OK;
+            int nResult = 0;
+
+            *pnResult = 0;
+
+            for (DWORD i = 0; i < cVersions; ++i)
+            {
+                ReleaseVerutilVersion(rgpVersions[i]);
+
+                hr = fCached ? VerCacheParseVersion(rgwzVersions[i], 0, FALSE, rgpVersions + i) : VerParseVersion(rgwzVersions[i], 0, FALSE, rgpVersions + i);
+                NativeAssert::Succeeded(hr, "Failed to parse version '{0}'", rgwzVersions[i]);
+            }
+
+            // Accumulate the comparison against every version so the result covers all of them.
+            for (DWORD i = 0; i < cVersions; ++i)
+            {
+                hr = VerCompareParsedVersions(rgpVersions[iVersion], rgpVersions[i], &nResult);
+                NativeAssert::Succeeded(hr, "Failed to compare versions '{0}' and '{1}'", rgwzVersions[iVersion], rgwzVersions[i]);
+
+                *pnResult = *pnResult * 3 + nResult;
+            }
+        }
+
         void TestVerutilCompareParsedVersions(VERUTIL_VERSION* pVersion1, VERUTIL_VERSION* pVersion2, int nExpectedResult)
         {
             HRESULT hr = S_OK;
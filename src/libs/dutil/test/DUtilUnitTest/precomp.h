@@ -15,6 +15,8 @@
 #include <verutil.h>
 #include <apputil.h>
 #include <atomutil.h>
+#include <cabcutil.h>
+#include <cabutil.h>
 #include <dictutil.h>
 #include <dirutil.h>
 #include <envutil.h>
@@ -24,9 +26,12 @@
 #include <locutil.h>
 #include <memutil.h>
 #include <pathutil.h>
+#include <perfutil.h>
 #include <pipeutil.h>
 #include <procutil.h>
+#include <queutil.h>
 #include <strutil.h>
+#include <thrdutil.h>
 #include <monutil.h>
 #include <regutil.h>
 #include <rssutil.h>
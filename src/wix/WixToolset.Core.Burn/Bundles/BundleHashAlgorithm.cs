@@ -2,6 +2,7 @@
 
 namespace WixToolset.Core.Burn.Bundles
 {
+    using System.Collections.Generic;
     using System.IO;
     using System.Security.Cryptography;
     using System.Text;
@@ -18,6 +19,49 @@ namespace WixToolset.Core.Burn.Bundles
                 hashBytes = managed.ComputeHash(stream);
             }
 
+            return ToHexString(hashBytes);
+        }
+
+        /// <summary>
+        /// Hashes each chunk of a file, the last of which may be shorter than the chunk size.
+        /// </summary>
+        public static IReadOnlyList<string> HashChunks(FileInfo fileInfo, int chunkSize)
+        {
+            var hashes = new List<string>();
+            var buffer = new byte[chunkSize];
+
+            using (var managed = new SHA512CryptoServiceProvider())
+            using (var stream = fileInfo.OpenRead())
+            {
+                int read;
+
+                do
+                {
+                    read = 0;
+
+                    while (read < chunkSize)
+                    {
+                        var cb = stream.Read(buffer, read, chunkSize - read);
+                        if (cb == 0)
+                        {
+                            break;
+                        }
+
+                        read += cb;
+                    }
+
+                    if (read > 0)
+                    {
+                        hashes.Add(ToHexString(managed.ComputeHash(buffer, 0, read)));
+                    }
+                } while (read == chunkSize);
+            }
+
+            return hashes;
+        }
+
+        private static string ToHexString(byte[] hashBytes)
+        {
             var sb = new StringBuilder(hashBytes.Length * 2);
             for (var i = 0; i < hashBytes.Length; i++)
             {
@@ -189,6 +189,18 @@ namespace WixToolset.Core.Burn.Bundles
                     {
                         writer.WriteStartElement("Container");
                         this.WriteBurnManifestContainerAttributes(writer, this.ExecutableName, container);
+
+                        // Chunk hashes let Burn verify the container a chunk at a time and only download again from the first bad chunk.
+                        if (!String.IsNullOrEmpty(container.ChunkHashes))
+                        {
+                            foreach (var chunkHash in container.ChunkHashes.Split(' '))
+                            {
+                                writer.WriteStartElement("Chunk");
+                                writer.WriteAttributeString("Hash", chunkHash);
+                                writer.WriteEndElement();
+                            }
+                        }
+
                         writer.WriteEndElement();
                     }
                 }
@@ -331,6 +343,16 @@ namespace WixToolset.Core.Burn.Bundles
                     writer.WriteAttributeString("ParallelCache", "yes");
                 }
 
+                if (this.Chain.ParallelDetect)
+                {
+                    writer.WriteAttributeString("ParallelDetect", "yes");
+                }
+
+                if (this.Chain.IncrementalPlan)
+                {
+                    writer.WriteAttributeString("IncrementalPlan", "yes");
+                }
+
                 // Index a few tables by package.
                 var targetCodesByPackagePayload = this.Section.Symbols.OfType<WixBundlePatchTargetCodeSymbol>().ToLookup(r => r.PackagePayloadRef);
                 var msiFeaturesByPackagePayload = this.Section.Symbols.OfType<WixBundleMsiFeatureSymbol>().ToLookup(r => r.PackagePayloadRef);
@@ -734,6 +756,11 @@ namespace WixToolset.Core.Burn.Bundles
                     writer.WriteAttributeString("DownloadUrl", container.DownloadUrl);
                 }
 
+                if (container.ChunkSize.HasValue)
+                {
+                    writer.WriteAttributeString("ChunkSize", (container.ChunkSize.Value * 1024).ToString(CultureInfo.InvariantCulture));
+                }
+
                 writer.WriteAttributeString("FilePath", container.Name);
             }
             else if (ContainerType.Attached == container.Type)
@@ -22,6 +22,12 @@ namespace WixToolset.Core.Burn.Bundles
             this.CompressionLevel = compressionLevel;
         }
 
+        public CreateContainerCommand(IEnumerable<WixBundlePayloadSymbol> payloads, string outputPath, CompressionLevel? compressionLevel, int? chunkSize)
+            : this(payloads, outputPath, compressionLevel)
+        {
+            this.ChunkSize = chunkSize;
+        }
+
         public CreateContainerCommand(string manifestPath, IEnumerable<WixBundlePayloadSymbol> payloads, string outputPath, CompressionLevel? compressionLevel)
         {
             this.ManifestFile = manifestPath;
@@ -30,6 +36,8 @@ namespace WixToolset.Core.Burn.Bundles
             this.CompressionLevel = compressionLevel;
         }
 
+        private int? ChunkSize { get; }
+
         private CompressionLevel? CompressionLevel { get; }
 
         private string ManifestFile { get; }
@@ -40,6 +48,8 @@ namespace WixToolset.Core.Burn.Bundles
 
         public string Hash { get; private set; }
 
+        public IReadOnlyList<string> ChunkHashes { get; private set; }
+
         public long Size { get; private set; }
 
         public void Execute()
@@ -67,6 +77,11 @@ namespace WixToolset.Core.Burn.Bundles
 
             this.Hash = BundleHashAlgorithm.Hash(fileInfo);
 
+            if (this.ChunkSize.HasValue)
+            {
+                this.ChunkHashes = BundleHashAlgorithm.HashChunks(fileInfo, this.ChunkSize.Value);
+            }
+
             this.Size = fileInfo.Length;
         }
     }
@@ -120,11 +120,16 @@ namespace WixToolset.Core.Burn.Bundles
 
         private void CreateContainer(WixBundleContainerSymbol container, IEnumerable<WixBundlePayloadSymbol> containerPayloads)
         {
-            var command = new CreateContainerCommand(containerPayloads, container.WorkingPath, this.DefaultCompressionLevel);
+            var command = new CreateContainerCommand(containerPayloads, container.WorkingPath, this.DefaultCompressionLevel, container.ChunkSize * 1024);
             command.Execute();
 
             container.Hash = command.Hash;
             container.Size = command.Size;
+
+            if (command.ChunkHashes != null)
+            {
+                container.ChunkHashes = String.Join(" ", command.ChunkHashes);
+            }
         }
     }
 }
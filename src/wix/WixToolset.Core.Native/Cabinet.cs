@@ -13,6 +13,7 @@ namespace WixToolset.Core.Native
     public sealed class Cabinet
     {
         private const string CompressionLevelVariable = "WIX_COMPRESSION_LEVEL";
+        private const string EmptyArgument = "\"\"";
         private static readonly char[] TextLineSplitter = new[] { '\t' };
 
         /// <summary>
@@ -36,8 +37,9 @@ namespace WixToolset.Core.Native
         /// <param name="compressionLevel">Level of compression to apply.</param>
         /// <param name="maxSize">Maximum size of cabinet.</param>
         /// <param name="maxThresh">Maximum threshold for each cabinet.</param>
+        /// <param name="cabinetCachePath">Optional folder of cabinets previously built from the same files and settings.</param>
         /// <returns>>List of CabinetCreated.</returns>
-        public IReadOnlyCollection<CabinetCreated> Compress(IEnumerable<CabinetCompressFile> files, CompressionLevel compressionLevel, int maxSize = 0, int maxThresh = 0)
+        public IReadOnlyCollection<CabinetCreated> Compress(IEnumerable<CabinetCompressFile> files, CompressionLevel compressionLevel, int maxSize = 0, int maxThresh = 0, string cabinetCachePath = null)
         {
             var compressionLevelVariable = Environment.GetEnvironmentVariable(CompressionLevelVariable);
 
@@ -50,7 +52,9 @@ namespace WixToolset.Core.Native
                 }
             }
 
-            var wixnative = new WixNativeExe("smartcab", this.Path, Convert.ToInt32(compressionLevel), files.Count(), maxSize, maxThresh);
+            var wixnative = String.IsNullOrEmpty(cabinetCachePath) ?
+                new WixNativeExe("smartcab", this.Path, Convert.ToInt32(compressionLevel), files.Count(), maxSize, maxThresh) :
+                new WixNativeExe("smartcab", this.Path, Convert.ToInt32(compressionLevel), files.Count(), maxSize, maxThresh, EmptyArgument, cabinetCachePath);
 
             foreach (var file in files)
             {
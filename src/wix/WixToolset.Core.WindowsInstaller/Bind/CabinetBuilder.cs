@@ -21,7 +21,7 @@ namespace WixToolset.Core.WindowsInstaller.Bind
         private readonly Queue<CabinetWorkItem> cabinetWorkItems;
         private readonly List<CompletedCabinetWorkItem> completedCabinets;
 
-        public CabinetBuilder(IMessaging messaging, int threadCount, int maximumCabinetSizeForLargeFileSplitting, int maximumUncompressedMediaSize)
+        public CabinetBuilder(IMessaging messaging, int threadCount, int maximumCabinetSizeForLargeFileSplitting, int maximumUncompressedMediaSize, string cabinetCachePath)
         {
             if (0 >= threadCount)
             {
@@ -35,6 +35,7 @@ namespace WixToolset.Core.WindowsInstaller.Bind
             this.ThreadCount = threadCount;
             this.MaximumCabinetSizeForLargeFileSplitting = maximumCabinetSizeForLargeFileSplitting;
             this.MaximumUncompressedMediaSize = maximumUncompressedMediaSize;
+            this.CabinetCachePath = cabinetCachePath;
         }
 
         private IMessaging Messaging { get; }
@@ -45,6 +46,8 @@ namespace WixToolset.Core.WindowsInstaller.Bind
 
         private int MaximumUncompressedMediaSize { get; }
 
+        private string CabinetCachePath { get; }
+
         public IReadOnlyCollection<CompletedCabinetWorkItem> CompletedCabinets => this.completedCabinets;
 
         /// <summary>
@@ -193,7 +196,7 @@ namespace WixToolset.Core.WindowsInstaller.Bind
 
             try
             {
-                var created = cab.Compress(compressFiles, cabinetWorkItem.CompressionLevel, maxCabinetSize, cabinetWorkItem.MaxThreshold);
+                var created = cab.Compress(compressFiles, cabinetWorkItem.CompressionLevel, maxCabinetSize, cabinetWorkItem.MaxThreshold, this.CabinetCachePath);
 
                 // Best effort check to see if the cabinet is too large for the Windows Installer.
                 try
@@ -22,6 +22,9 @@ namespace WixToolset.Core.WindowsInstaller.Bind
         public const int DefaultMaximumUncompressedMediaSize = 200;             // Default value is 200 MB
         public const int MaxValueOfMaxCabSizeForLargeFileSplitting = 2 * 1024;  // 2048 MB (i.e. 2 GB)
 
+        // Keeps the content-addressed cabinets apart from the cabinets the cache path holds by name.
+        private const string CabinetContentCacheFolder = "smartcab";
+
         private readonly CabinetResolver cabinetResolver;
         private readonly List<IFileTransfer> fileTransfers;
         private readonly List<ITrackedFile> trackedFiles;
@@ -48,6 +51,8 @@ namespace WixToolset.Core.WindowsInstaller.Bind
 
             this.ResolveMedia = resolveMedia;
 
+            this.CabinetCachePath = String.IsNullOrEmpty(cabCachePath) ? null : Path.Combine(cabCachePath, CabinetContentCacheFolder);
+
             this.cabinetResolver = new CabinetResolver(serviceProvider, cabCachePath, backendExtensions);
             this.fileTransfers = new List<IFileTransfer>();
             this.trackedFiles = new List<ITrackedFile>();
@@ -61,6 +66,8 @@ namespace WixToolset.Core.WindowsInstaller.Bind
 
         private int CabbingThreadCount { get; set; }
 
+        private string CabinetCachePath { get; }
+
         private string IntermediateFolder { get; }
 
         private string LayoutDirectory { get; }
@@ -87,7 +94,7 @@ namespace WixToolset.Core.WindowsInstaller.Bind
 
             this.GetMediaTemplateAttributes(out var maximumCabinetSizeForLargeFileSplitting, out var maximumUncompressedMediaSize);
 
-            var cabinetBuilder = new CabinetBuilder(this.Messaging, calculatedCabbingThreadCount, maximumCabinetSizeForLargeFileSplitting, maximumUncompressedMediaSize);
+            var cabinetBuilder = new CabinetBuilder(this.Messaging, calculatedCabbingThreadCount, maximumCabinetSizeForLargeFileSplitting, maximumUncompressedMediaSize, this.CabinetCachePath);
 
             var hashesByFileId = this.Section.Symbols.OfType<MsiFileHashSymbol>().ToDictionary(s => s.Id.Id);
 
@@ -515,6 +515,7 @@ namespace WixToolset.Core
         {
             var sourceLineNumbers = Preprocessor.GetSourceLineNumbers(node);
             Identifier id = null;
+            int? chunkSize = null;
             string downloadUrl = null;
             string name = null;
             var type = ContainerType.Detached;
@@ -532,6 +533,9 @@ namespace WixToolset.Core
                                 this.Messaging.Write(CompilerErrors.ReservedValue(sourceLineNumbers, node.Name.LocalName, "Id", id.Id));
                             }
                             break;
+                        case "ChunkSize":
+                            chunkSize = this.Core.GetAttributeIntegerValue(sourceLineNumbers, attrib, 1, Int32.MaxValue / 1024);
+                            break;
                         case "DownloadUrl":
                             downloadUrl = this.Core.GetAttributeValue(sourceLineNumbers, attrib);
                             break;
@@ -591,6 +595,11 @@ namespace WixToolset.Core
                 this.Core.Write(ErrorMessages.IllegalAttributeWithOtherAttribute(sourceLineNumbers, node.Name.LocalName, "DownloadUrl", "Type", "attached"));
             }
 
+            if (chunkSize.HasValue && ContainerType.Detached != type)
+            {
+                this.Core.Write(ErrorMessages.IllegalAttributeWithOtherAttribute(sourceLineNumbers, node.Name.LocalName, "ChunkSize", "Type", "attached"));
+            }
+
             foreach (var child in node.Elements())
             {
                 if (CompilerCore.WixNamespace == child.Name.Namespace)
@@ -618,7 +627,8 @@ namespace WixToolset.Core
                 {
                     Name = name,
                     Type = type,
-                    DownloadUrl = downloadUrl
+                    DownloadUrl = downloadUrl,
+                    ChunkSize = chunkSize,
                 });
             }
         }
@@ -1731,6 +1741,18 @@ namespace WixToolset.Core
                                 attributes |= WixChainAttributes.ParallelCache;
                             }
                             break;
+                        case "ParallelDetect":
+                            if (YesNoType.Yes == this.Core.GetAttributeYesNoValue(sourceLineNumbers, attrib))
+                            {
+                                attributes |= WixChainAttributes.ParallelDetect;
+                            }
+                            break;
+                        case "IncrementalPlan":
+                            if (YesNoType.Yes == this.Core.GetAttributeYesNoValue(sourceLineNumbers, attrib))
+                            {
+                                attributes |= WixChainAttributes.IncrementalPlan;
+                            }
+                            break;
                         default:
                             this.Core.UnexpectedAttribute(node, attrib);
                             break;
@@ -3,8 +3,10 @@
 namespace WixToolsetTest.CoreNative
 {
     using System;
+    using System.Diagnostics;
     using System.IO;
     using System.Linq;
+    using System.Text;
     using WixInternal.TestSupport;
     using WixToolset.Core.Native;
     using WixToolset.Data;
@@ -83,6 +85,116 @@ namespace WixToolsetTest.CoreNative
             }
         }
 
+        [Fact]
+        public void CanCreateSpannedCabinetsInOneBatch()
+        {
+            using (var fs = new DisposableFileSystem())
+            {
+                var intermediateFolder = fs.GetFolder(true);
+
+                // Files of the same size are hashed for duplicates on the shared pool, so a
+                // single worker thread may compress the second cabinet while the first waits.
+                var firstPath = Path.Combine(intermediateFolder, "first.dat");
+                var secondPath = Path.Combine(intermediateFolder, "second.dat");
+                TestData.CreateFile(firstPath, (long)(2.9 * 1024 * 1024), fill: true);
+                TestData.CreateFile(secondPath, (long)(2.9 * 1024 * 1024), fill: true);
+
+                var stdin = new StringBuilder();
+                stdin.AppendLine(":");
+
+                foreach (var name in new[] { "one", "two" })
+                {
+                    stdin.AppendLine($"{Path.Combine(intermediateFolder, name + ".cab")}\t0\t2\t1\t0");
+                    stdin.AppendLine($"{firstPath}\t{name}_first");
+                    stdin.AppendLine($"{secondPath}\t{name}_second");
+                }
+
+                stdin.AppendLine();
+
+                var output = RunWixNative("smartcabbatch 1", stdin.ToString());
+
+                Assert.True(File.Exists(Path.Combine(intermediateFolder, "one.cab")));
+                Assert.True(File.Exists(Path.Combine(intermediateFolder, "two.cab")));
+
+                // Each cabinet's names are written together and only name that cabinet's files.
+                var created = output.Select(l => l.Split('\t')).Where(d => d.Length == 3).ToArray();
+                Assert.Equal(new[] { "one.cab", "two.cab" }, created.Select(d => d[0]).Distinct().ToArray());
+                Assert.Equal(created.Select(d => d[0]).ToArray(), created.Select(d => d[0]).OrderBy(n => n, StringComparer.Ordinal).ToArray());
+                Assert.All(created, d => Assert.StartsWith(Path.GetFileNameWithoutExtension(d[0]) + "_", d[2]));
+            }
+        }
+
+        [Fact]
+        public void CabinetCacheMissStoresCabinet()
+        {
+            using (var fs = new DisposableFileSystem())
+            {
+                var cacheFolder = Path.Combine(fs.GetFolder(true), "cache");
+                var files = new[] { new CabinetCompressFile(CopySourceFile(fs), "test.txt") };
+
+                var cabPath = Path.Combine(fs.GetFolder(true), "testout.cab");
+                var created = new Cabinet(cabPath).Compress(files, CompressionLevel.Low, cabinetCachePath: cacheFolder);
+
+                Assert.True(File.Exists(cabPath));
+                Assert.Equal(new[]
+                {
+                    "testout.cab, test.txt"
+                }, created.Select(c => String.Join(", ", c.CabinetName, c.FirstFileToken)).ToArray());
+
+                // One complete entry and no temporary entry left behind.
+                var entry = Directory.GetDirectories(cacheFolder).Single();
+                Assert.Equal(File.ReadAllBytes(cabPath), File.ReadAllBytes(Path.Combine(entry, "testout.cab")));
+            }
+        }
+
+        [Fact]
+        public void CabinetCacheHitRestoresCabinet()
+        {
+            using (var fs = new DisposableFileSystem())
+            {
+                var cacheFolder = Path.Combine(fs.GetFolder(true), "cache");
+                var files = new[] { new CabinetCompressFile(CopySourceFile(fs), "test.txt") };
+
+                var firstCabPath = Path.Combine(fs.GetFolder(true), "testout.cab");
+                var firstCreated = new Cabinet(firstCabPath).Compress(files, CompressionLevel.Low, cabinetCachePath: cacheFolder);
+
+                // Mark the cached cabinet so a cabinet copied from the cache can be told apart from one built again.
+                var cachedTime = new DateTime(2001, 1, 1, 0, 0, 0, DateTimeKind.Utc);
+                File.SetLastWriteTimeUtc(Path.Combine(Directory.GetDirectories(cacheFolder).Single(), "testout.cab"), cachedTime);
+
+                var secondCabPath = Path.Combine(fs.GetFolder(true), "testout.cab");
+                var secondCreated = new Cabinet(secondCabPath).Compress(files, CompressionLevel.Low, cabinetCachePath: cacheFolder);
+
+                Assert.Equal(cachedTime, File.GetLastWriteTimeUtc(secondCabPath));
+                Assert.Equal(File.ReadAllBytes(firstCabPath), File.ReadAllBytes(secondCabPath));
+                Assert.Equal(firstCreated.Select(c => String.Join(", ", c.CabinetName, c.FirstFileToken)).ToArray(), secondCreated.Select(c => String.Join(", ", c.CabinetName, c.FirstFileToken)).ToArray());
+                Assert.Single(Directory.GetDirectories(cacheFolder));
+            }
+        }
+
+        [Fact]
+        public void CabinetCacheMissesWhenFileChanges()
+        {
+            using (var fs = new DisposableFileSystem())
+            {
+                var cacheFolder = Path.Combine(fs.GetFolder(true), "cache");
+                var sourcePath = CopySourceFile(fs);
+                var files = new[] { new CabinetCompressFile(sourcePath, "test.txt") };
+
+                var firstCabPath = Path.Combine(fs.GetFolder(true), "testout.cab");
+                new Cabinet(firstCabPath).Compress(files, CompressionLevel.Low, cabinetCachePath: cacheFolder);
+
+                File.WriteAllText(sourcePath, "This file changed.");
+
+                var secondCabPath = Path.Combine(fs.GetFolder(true), "testout.cab");
+                new Cabinet(secondCabPath).Compress(files, CompressionLevel.Low, cabinetCachePath: cacheFolder);
+
+                Assert.Equal(17, new Cabinet(firstCabPath).Enumerate().Single().Size);
+                Assert.Equal(18, new Cabinet(secondCabPath).Enumerate().Single().Size);
+                Assert.Equal(2, Directory.GetDirectories(cacheFolder).Length);
+            }
+        }
+
         [Fact]
         public void CanEnumerateSingleFileCabinet()
         {
@@ -147,5 +259,42 @@ namespace WixToolsetTest.CoreNative
                 }
             }
         }
+
+        private static string CopySourceFile(DisposableFileSystem fs)
+        {
+            // A copy, so a test can change the file the cache key is computed from.
+            var sourcePath = Path.Combine(fs.GetFolder(true), "test.txt");
+            File.Copy(TestData.Get(@"TestData", "test.txt"), sourcePath);
+
+            return sourcePath;
+        }
+
+        private static string[] RunWixNative(string commandLine, string stdin)
+        {
+            var wixNativePath = Directory.EnumerateFiles(AppContext.BaseDirectory, "wixnative.exe", SearchOption.AllDirectories).First();
+
+            var startInfo = new ProcessStartInfo(wixNativePath, commandLine)
+            {
+                RedirectStandardInput = true,
+                RedirectStandardOutput = true,
+                StandardOutputEncoding = Encoding.UTF8,
+                CreateNoWindow = true,
+                UseShellExecute = false
+            };
+
+            using (var process = Process.Start(startInfo))
+            {
+                var bytes = Encoding.UTF8.GetBytes(stdin);
+                process.StandardInput.BaseStream.Write(bytes, 0, bytes.Length);
+                process.StandardInput.Close();
+
+                var output = process.StandardOutput.ReadToEnd();
+                process.WaitForExit();
+
+                Assert.Equal(0, process.ExitCode);
+
+                return output.Split(new[] { "\r\n", "\n" }, StringSplitOptions.RemoveEmptyEntries);
+            }
+        }
     }
 }
@@ -0,0 +1,79 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved. Licensed under the Microsoft Reciprocal License. See LICENSE.TXT file in the project root for full license information.
+
+namespace WixToolsetTest.CoreNative
+{
+    using System;
+    using System.Diagnostics;
+    using System.IO;
+    using System.Linq;
+    using System.Text;
+    using WixInternal.TestSupport;
+    using Xunit;
+
+    public class WixNativeServeFixture
+    {
+        [Fact]
+        public void CanServeTwoRequestsInOneSession()
+        {
+            var cabFile = TestData.Get(@"TestData\test.cab");
+
+            var stdin = new StringBuilder();
+            stdin.AppendLine(":");
+
+            // enumcab reads nothing from stdin but its request still ends with a blank line.
+            stdin.AppendLine($"first\tenumcab\t{cabFile}");
+            stdin.AppendLine();
+
+            stdin.AppendLine("second\tcerthashes");
+            stdin.AppendLine(cabFile);
+            stdin.AppendLine();
+
+            // A blank request line ends the session.
+            stdin.AppendLine();
+
+            var output = ServeWixNative(stdin.ToString());
+
+            Assert.Equal(new[]
+            {
+                "test.txt\t17\t19259\t47731",
+                ":first\t0x0",
+                $"{cabFile}\t7EC90B3FC3D580EB571210011F1095E149DCC6BB\t0B13494DB50BC185A34389BBBAA01EDD1CF56350\t0x0",
+                ":second\t0x0",
+            }, output);
+        }
+
+        private static string[] ServeWixNative(string stdin)
+        {
+            var wixNativePath = Directory.EnumerateFiles(AppContext.BaseDirectory, "wixnative.exe", SearchOption.AllDirectories).First();
+
+            var startInfo = new ProcessStartInfo(wixNativePath, "serve")
+            {
+                RedirectStandardInput = true,
+                RedirectStandardOutput = true,
+                StandardOutputEncoding = Encoding.UTF8,
+                CreateNoWindow = true,
+                UseShellExecute = false
+            };
+
+            using (var process = Process.Start(startInfo))
+            {
+                var bytes = Encoding.UTF8.GetBytes(stdin);
+                process.StandardInput.BaseStream.Write(bytes, 0, bytes.Length);
+                process.StandardInput.BaseStream.Flush();
+
+                // Stdin stays open, so the server only exits because of the blank request line.
+                var output = process.StandardOutput.ReadToEndAsync();
+                var exited = process.WaitForExit(60000);
+                if (!exited)
+                {
+                    process.Kill();
+                }
+
+                Assert.True(exited, "wixnative serve did not exit after the blank request line.");
+                Assert.Equal(0, process.ExitCode);
+
+                return output.Result.Split(new[] { "\r\n", "\n" }, StringSplitOptions.RemoveEmptyEntries);
+            }
+        }
+    }
+}
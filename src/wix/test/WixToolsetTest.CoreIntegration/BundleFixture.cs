@@ -537,6 +537,98 @@ namespace WixToolsetTest.CoreIntegration
             }
         }
 
+        [Fact]
+        public void CanBuildBundleWithIncrementalPlan()
+        {
+            var folder = TestData.Get(@"TestData");
+
+            using (var fs = new DisposableFileSystem())
+            {
+                var baseFolder = fs.GetFolder();
+                var intermediateFolder = Path.Combine(baseFolder, "obj");
+                var exePath = Path.Combine(baseFolder, @"bin\test.exe");
+                var pdbPath = Path.Combine(baseFolder, @"bin\test.wixpdb");
+                var baFolderPath = Path.Combine(baseFolder, "ba");
+                var extractFolderPath = Path.Combine(baseFolder, "extract");
+
+                var result = WixRunner.Execute(new[]
+                {
+                    "build",
+                    Path.Combine(folder, "BundleWithIncrementalPlan", "Bundle.wxs"),
+                    "-bindpath", Path.Combine(folder, "SimpleBundle", "data"),
+                    "-intermediateFolder", intermediateFolder,
+                    "-o", exePath,
+                });
+
+                result.AssertSuccess();
+
+                using (var wixOutput = WixOutput.Read(pdbPath))
+                {
+                    var intermediate = Intermediate.Load(wixOutput);
+                    var section = intermediate.Sections.Single();
+
+                    var chainSymbol = section.Symbols.OfType<WixChainSymbol>().Single();
+                    Assert.True(chainSymbol.IncrementalPlan);
+                    Assert.False(chainSymbol.ParallelDetect);
+                }
+
+                var extractResult = BundleExtractor.ExtractBAContainer(null, exePath, baFolderPath, extractFolderPath);
+                extractResult.AssertSuccess();
+
+                var incrementalPlan = extractResult.SelectManifestNodes("/burn:BurnManifest/burn:Chain/@IncrementalPlan")
+                                                   .Cast<XmlAttribute>()
+                                                   .Single();
+                WixAssert.StringEqual("yes", incrementalPlan.Value);
+                Assert.Empty(extractResult.SelectManifestNodes("/burn:BurnManifest/burn:Chain/@ParallelDetect"));
+            }
+        }
+
+        [Fact]
+        public void CanBuildBundleWithParallelDetect()
+        {
+            var folder = TestData.Get(@"TestData");
+
+            using (var fs = new DisposableFileSystem())
+            {
+                var baseFolder = fs.GetFolder();
+                var intermediateFolder = Path.Combine(baseFolder, "obj");
+                var exePath = Path.Combine(baseFolder, @"bin\test.exe");
+                var pdbPath = Path.Combine(baseFolder, @"bin\test.wixpdb");
+                var baFolderPath = Path.Combine(baseFolder, "ba");
+                var extractFolderPath = Path.Combine(baseFolder, "extract");
+
+                var result = WixRunner.Execute(new[]
+                {
+                    "build",
+                    Path.Combine(folder, "BundleWithParallelDetect", "Bundle.wxs"),
+                    "-bindpath", Path.Combine(folder, "SimpleBundle", "data"),
+                    "-intermediateFolder", intermediateFolder,
+                    "-o", exePath,
+                });
+
+                result.AssertSuccess();
+
+                using (var wixOutput = WixOutput.Read(pdbPath))
+                {
+                    var intermediate = Intermediate.Load(wixOutput);
+                    var section = intermediate.Sections.Single();
+
+                    var chainSymbol = section.Symbols.OfType<WixChainSymbol>().Single();
+                    Assert.True(chainSymbol.ParallelDetect);
+                    Assert.False(chainSymbol.ParallelCache);
+                }
+
+                var extractResult = BundleExtractor.ExtractBAContainer(null, exePath, baFolderPath, extractFolderPath);
+                extractResult.AssertSuccess();
+
+                var parallelDetect = extractResult.SelectManifestNodes("/burn:BurnManifest/burn:Chain/@ParallelDetect")
+                                                  .Cast<XmlAttribute>()
+                                                  .Single();
+                WixAssert.StringEqual("yes", parallelDetect.Value);
+                Assert.Empty(extractResult.SelectManifestNodes("/burn:BurnManifest/burn:Chain/@ParallelCache"));
+            }
+        }
+
         [Fact]
         public void CanBuildUncompressedBundle()
         {
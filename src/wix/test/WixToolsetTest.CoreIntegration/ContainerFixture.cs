@@ -2,9 +2,11 @@
 
 namespace WixToolsetTest.CoreIntegration
 {
+    using System;
     using System.Collections.Generic;
     using System.IO;
     using System.Linq;
+    using System.Security.Cryptography;
     using System.Xml;
     using WixInternal.TestSupport;
     using WixToolset.Core.Burn.Bundles;
@@ -266,6 +268,60 @@ namespace WixToolsetTest.CoreIntegration
             }
         }
 
+        [Fact]
+        public void ChunkedDetachedContainerHasChunkHashes()
+        {
+            var folder = TestData.Get(@"TestData");
+
+            using (var fs = new DisposableFileSystem())
+            {
+                var baseFolder = fs.GetFolder();
+                var intermediateFolder = Path.Combine(baseFolder, "obj");
+                var binFolder = Path.Combine(baseFolder, "bin");
+                var bundlePath = Path.Combine(binFolder, "test.exe");
+                var baFolderPath = Path.Combine(baseFolder, "ba");
+                var extractFolderPath = Path.Combine(baseFolder, "extract");
+
+                this.BuildMsis(folder, intermediateFolder, binFolder);
+
+                var result = WixRunner.Execute(new[]
+                {
+                    "build",
+                    Path.Combine(folder, "Container", "ChunkedDetachedContainer.wxs"),
+                    Path.Combine(folder, "BundleWithPackageGroupRef", "Bundle.wxs"),
+                    "-bindpath", Path.Combine(folder, "SimpleBundle", "data"),
+                    "-bindpath", binFolder,
+                    "-intermediateFolder", intermediateFolder,
+                    "-o", bundlePath
+                });
+
+                result.AssertSuccess();
+                Assert.True(File.Exists(bundlePath));
+
+                var extractResult = BundleExtractor.ExtractBAContainer(null, bundlePath, baFolderPath, extractFolderPath);
+                extractResult.AssertSuccess();
+
+                var container = extractResult.ManifestDocument.SelectSingleNode("/burn:BurnManifest/burn:Container[@Id='FirstX64']", extractResult.ManifestNamespaceManager);
+                Assert.Equal("1024", container.Attributes["ChunkSize"].Value);
+
+                var containerBytes = File.ReadAllBytes(Path.Combine(binFolder, "FirstX64"));
+                var expectedHashes = new List<string>();
+
+                using (var sha512 = SHA512.Create())
+                {
+                    for (var offset = 0; offset < containerBytes.Length; offset += 1024)
+                    {
+                        var hash = sha512.ComputeHash(containerBytes, offset, Math.Min(1024, containerBytes.Length - offset));
+                        expectedHashes.Add(BitConverter.ToString(hash).Replace("-", String.Empty));
+                    }
+                }
+
+                var chunkHashes = container.SelectNodes("burn:Chunk", extractResult.ManifestNamespaceManager).Cast<XmlNode>().Select(n => n.Attributes["Hash"].Value).ToArray();
+                Assert.True(expectedHashes.Count > 1, "Expected the container to span more than one chunk.");
+                WixAssert.CompareLineByLine(expectedHashes.ToArray(), chunkHashes);
+            }
+        }
+
         [Fact]
         public void PayloadIsNotPutInMultipleContainers()
         {
@@ -4,16 +4,68 @@
 
 #define SHA1_HASH_LEN 20
 
+struct CERTHASHES_CERTIFICATE
+{
+    LPWSTR sczKey;
+    BYTE* pbEncoded;
+    DWORD cbEncoded;
+
+    LPWSTR sczThumbprint;
+    LPWSTR sczPublicKeyIdentifier;
+};
+
+// Signed payloads are mostly signed by a few certificates, so the hashes are kept per certificate.
+// A certificate is keyed by the SHA-256 hash of its whole encoding, and a hit is only used when
+// the cached encoding matches byte for byte.
+struct CERTHASHES_CACHE
+{
+    CRITICAL_SECTION cs;
+    STRINGDICT_HANDLE shCertificates;
+    CERTHASHES_CERTIFICATE** rgpCertificates;
+    DWORD cCertificates;
+};
+
+struct CERTHASHES_FILE
+{
+    LPWSTR sczPath;
+    CERTHASHES_CACHE* pCache;
+    HANDLE hCompleted;
+
+    LPWSTR sczPublicKeyIdentifier;
+    LPWSTR sczThumbprint;
+    HRESULT hrResult;
+    volatile LONG fCompleted;
+};
+
+static HRESULT CALLBACK GetFileCertificateHashes(
+    __in THRD_GROUP_HANDLE hGroup,
+    __in_opt LPVOID pvContext);
+
+static HRESULT WriteCompletedFiles(
+    __in_ecount(cFiles) CERTHASHES_FILE** rgpFiles,
+    __in DWORD cFiles,
+    __inout DWORD* piNextFile,
+    __in BOOL fWait,
+    __in HANDLE hCompleted);
+
 static HRESULT GetPublicKeyIdentifierAndThumbprint(
+    __in CERTHASHES_CACHE* pCache,
     __in_z LPCWSTR wzPath,
     __inout_z LPWSTR* psczPublicKeyIdentifier,
     __inout_z LPWSTR* psczThumbprint);
 
-static HRESULT GetChainContext(
+static HRESULT GetCertificateHashes(
+    __in CERTHASHES_CACHE* pCache,
+    __in PCCERT_CONTEXT pCertContext,
+    __out CERTHASHES_CERTIFICATE** ppCertificate);
+
+static HRESULT GetSignerCertificate(
     __in_z LPCWSTR wzPath,
-    __out PCCERT_CHAIN_CONTEXT* ppChainContext);
+    __out PCCERT_CONTEXT* ppCertContext);
 
 
+// Files are checked on a thread pool. Results are still written in input order, each as soon
+// as it and every file before it have been checked.
 HRESULT CertificateHashesCommand(
     __in int argc,
     __in_ecount(argc) LPWSTR argv[])
@@ -24,8 +76,32 @@ HRESULT CertificateHashesCommand(
     HRESULT hr = S_OK;
 
     LPWSTR sczFilePath = NULL;
-    LPWSTR sczPublicKeyIdentifier = NULL;
-    LPWSTR sczThumbprint = NULL;
+    CERTHASHES_CACHE cache = { };
+    BOOL fCacheInitialized = FALSE;
+    HANDLE hCompleted = NULL;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+    CERTHASHES_FILE** rgpFiles = NULL;
+    DWORD cFiles = 0;
+    DWORD iNextFile = 0;
+
+    ::InitializeCriticalSection(&cache.cs);
+    fCacheInitialized = TRUE;
+
+    hr = DictCreateWithEmbeddedKey(&cache.shCertificates, 0, NULL, offsetof(CERTHASHES_CERTIFICATE, sczKey), DICT_FLAG_CASEINSENSITIVE);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to create certificate cache");
+
+    // One auto-reset event wakes the writer when any file completes.
+    hCompleted = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+    ConsoleExitOnNullWithLastError(hCompleted, hr, CONSOLE_COLOR_RED, "Failed to create certificate hashes completion event");
+
+    hr = ThrdPoolInitialize(0);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to create certificate hashes thread pool");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to create certificate hashes group");
 
     hr = WixNativeReadStdinPreamble();
     ExitOnFailure(hr, "Failed to read stdin preamble before reading paths to get certificate hashes");
@@ -33,7 +109,7 @@ HRESULT CertificateHashesCommand(
     // Get the hash for each provided file.
     for (;;)
     {
-        hr = ConsoleReadW(&sczFilePath);
+        hr = WixNativeReadStdinLine(&sczFilePath);
         ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to read file path to signed file from stdin");
 
         if (!*sczFilePath)
@@ -41,68 +117,266 @@ HRESULT CertificateHashesCommand(
             break;
         }
 
-        hr = GetPublicKeyIdentifierAndThumbprint(sczFilePath, &sczPublicKeyIdentifier, &sczThumbprint);
-        if (FAILED(hr))
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&rgpFiles), cFiles, 1, sizeof(CERTHASHES_FILE*), 64);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to grow signed file list");
+
+        rgpFiles[cFiles] = static_cast<CERTHASHES_FILE*>(MemAlloc(sizeof(CERTHASHES_FILE), TRUE));
+        ConsoleExitOnNull(rgpFiles[cFiles], hr, E_OUTOFMEMORY, CONSOLE_COLOR_RED, "Failed to allocate signed file");
+
+        CERTHASHES_FILE* pFile = rgpFiles[cFiles];
+        ++cFiles;
+
+        pFile->sczPath = sczFilePath;
+        sczFilePath = NULL;
+        pFile->pCache = &cache;
+        pFile->hCompleted = hCompleted;
+
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, GetFileCertificateHashes, pFile);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Failed to queue signed file: %ls", pFile->sczPath);
+
+        hr = WriteCompletedFiles(rgpFiles, cFiles, &iNextFile, FALSE, hCompleted);
+        ExitOnFailure(hr, "Failed to write certificate hashes");
+    }
+
+    hr = WriteCompletedFiles(rgpFiles, cFiles, &iNextFile, TRUE, hCompleted);
+    ExitOnFailure(hr, "Failed to write certificate hashes");
+
+LExit:
+    // Every queued file must finish before the files, cache and event it uses are released.
+    if (hGroup)
+    {
+        ThrdGroupWait(hGroup, INFINITE);
+        ReleaseThreadGroup(hGroup);
+    }
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    for (DWORD i = 0; i < cFiles; ++i)
+    {
+        if (rgpFiles[i])
+        {
+            ReleaseStr(rgpFiles[i]->sczThumbprint);
+            ReleaseStr(rgpFiles[i]->sczPublicKeyIdentifier);
+            ReleaseStr(rgpFiles[i]->sczPath);
+            MemFree(rgpFiles[i]);
+        }
+    }
+    ReleaseMem(rgpFiles);
+
+    ReleaseHandle(hCompleted);
+
+    for (DWORD i = 0; i < cache.cCertificates; ++i)
+    {
+        ReleaseStr(cache.rgpCertificates[i]->sczPublicKeyIdentifier);
+        ReleaseStr(cache.rgpCertificates[i]->sczThumbprint);
+        ReleaseMem(cache.rgpCertificates[i]->pbEncoded);
+        ReleaseStr(cache.rgpCertificates[i]->sczKey);
+        MemFree(cache.rgpCertificates[i]);
+    }
+    ReleaseMem(cache.rgpCertificates);
+    ReleaseDict(cache.shCertificates);
+
+    if (fCacheInitialized)
+    {
+        ::DeleteCriticalSection(&cache.cs);
+    }
+
+    ReleaseStr(sczFilePath);
+
+    return hr;
+}
+
+static HRESULT CALLBACK GetFileCertificateHashes(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext)
+{
+    CERTHASHES_FILE* pFile = static_cast<CERTHASHES_FILE*>(pvContext);
+
+    pFile->hrResult = GetPublicKeyIdentifierAndThumbprint(pFile->pCache, pFile->sczPath, &pFile->sczPublicKeyIdentifier, &pFile->sczThumbprint);
+
+    ::InterlockedExchange(&pFile->fCompleted, TRUE);
+    ::SetEvent(pFile->hCompleted);
+
+    // A file without certificate hashes is reported in the output, not as a failure of the group.
+    return S_OK;
+}
+
+static HRESULT WriteCompletedFiles(
+    __in_ecount(cFiles) CERTHASHES_FILE** rgpFiles,
+    __in DWORD cFiles,
+    __inout DWORD* piNextFile,
+    __in BOOL fWait,
+    __in HANDLE hCompleted)
+{
+    HRESULT hr = S_OK;
+
+    while (*piNextFile < cFiles)
+    {
+        const CERTHASHES_FILE* pFile = rgpFiles[*piNextFile];
+
+        if (!pFile->fCompleted)
+        {
+            if (!fWait)
+            {
+                break;
+            }
+
+            // Another file completing also wakes the wait, so check again either way.
+            if (WAIT_FAILED == ::WaitForSingleObject(hCompleted, INFINITE))
+            {
+                ConsoleExitWithLastError(hr, CONSOLE_COLOR_RED, "Failed to wait for certificate hashes");
+            }
+
+            continue;
+        }
+
+        if (FAILED(pFile->hrResult))
         {
             // Treat no signature as success without finding certificate hashes.
-            ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%ls\t\t\t0x%x", sczFilePath, TRUST_E_NOSIGNATURE == hr ? 0 : hr);
+            ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%ls\t\t\t0x%x", pFile->sczPath, TRUST_E_NOSIGNATURE == pFile->hrResult ? 0 : pFile->hrResult);
         }
         else
         {
-            ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%ls\t%ls\t%ls\t0x%x", sczFilePath, sczPublicKeyIdentifier, sczThumbprint, hr);
+            ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%ls\t%ls\t%ls\t0x%x", pFile->sczPath, pFile->sczPublicKeyIdentifier, pFile->sczThumbprint, pFile->hrResult);
         }
+
+        ++*piNextFile;
     }
 
 LExit:
-    ReleaseStr(sczThumbprint);
-    ReleaseStr(sczPublicKeyIdentifier);
-    ReleaseStr(sczFilePath);
-
     return hr;
 }
 
 static HRESULT GetPublicKeyIdentifierAndThumbprint(
+    __in CERTHASHES_CACHE* pCache,
     __in_z LPCWSTR wzPath,
     __inout_z LPWSTR* psczPublicKeyIdentifier,
     __inout_z LPWSTR* psczThumbprint)
 {
     HRESULT hr = S_OK;
-    PCCERT_CHAIN_CONTEXT pChainContext = NULL;
     PCCERT_CONTEXT pCertContext = NULL;
-    BYTE rgbPublicKeyIdentifier[SHA1_HASH_LEN] = { };
-    DWORD cbPublicKeyIdentifier = sizeof(rgbPublicKeyIdentifier);
+    CERTHASHES_CERTIFICATE* pCertificate = NULL;
+
+    hr = GetSignerCertificate(wzPath, &pCertContext);
+    ExitOnFailure(hr, "Failed to get signer certificate for file: %ls", wzPath);
+
+    hr = GetCertificateHashes(pCache, pCertContext, &pCertificate);
+    ExitOnFailure(hr, "Failed to get certificate hashes for file: %ls", wzPath);
+
+    hr = StrAllocString(psczPublicKeyIdentifier, pCertificate->sczPublicKeyIdentifier, 0);
+    ExitOnFailure(hr, "Failed to copy certificate public key identifier for file: %ls", wzPath);
+
+    hr = StrAllocString(psczThumbprint, pCertificate->sczThumbprint, 0);
+    ExitOnFailure(hr, "Failed to copy certificate thumbprint for file: %ls", wzPath);
+
+LExit:
+    if (pCertContext)
+    {
+        ::CertFreeCertificateContext(pCertContext);
+    }
+
+    return hr;
+}
+
+static HRESULT GetCertificateHashes(
+    __in CERTHASHES_CACHE* pCache,
+    __in PCCERT_CONTEXT pCertContext,
+    __out CERTHASHES_CERTIFICATE** ppCertificate)
+{
+    HRESULT hr = S_OK;
+    BYTE rgbKey[SHA256_HASH_LEN] = { };
+    LPWSTR sczKey = NULL;
+    CERTHASHES_CERTIFICATE* pCached = NULL;
     BYTE* pbThumbprint = NULL;
     DWORD cbThumbprint = 0;
+    BYTE rgbPublicKeyIdentifier[SHA1_HASH_LEN] = { };
+    DWORD cbPublicKeyIdentifier = sizeof(rgbPublicKeyIdentifier);
+    CERTHASHES_CERTIFICATE* pCertificate = NULL;
+    BOOL fLocked = FALSE;
+
+    hr = CrypHashBuffer(pCertContext->pbCertEncoded, pCertContext->cbCertEncoded, PROV_RSA_AES, CALG_SHA_256, rgbKey, sizeof(rgbKey));
+    ExitOnFailure(hr, "Failed to hash certificate");
+
+    hr = StrAllocHexEncode(rgbKey, sizeof(rgbKey), &sczKey);
+    ExitOnFailure(hr, "Failed to convert certificate hash to hex");
 
-    hr = GetChainContext(wzPath, &pChainContext);
-    ExitOnFailure(hr, "Failed to get chain context for file: %ls", wzPath);
+    ::EnterCriticalSection(&pCache->cs);
+    fLocked = TRUE;
 
-    pCertContext = pChainContext->rgpChain[0]->rgpElement[0]->pCertContext;
+    hr = DictGetValue(pCache->shCertificates, sczKey, reinterpret_cast<void**>(&pCached));
+    if (E_NOTFOUND != hr)
+    {
+        ExitOnFailure(hr, "Failed to look up certificate: %ls", sczKey);
+
+        if (pCached->cbEncoded == pCertContext->cbCertEncoded && 0 == memcmp(pCached->pbEncoded, pCertContext->pbCertEncoded, pCached->cbEncoded))
+        {
+            *ppCertificate = pCached;
+            ExitFunction();
+        }
+    }
 
-    // Get the certificate's public key identifier and thumbprint.
+    // Get the certificate's public key identifier and thumbprint in hex.
     if (!::CryptHashPublicKeyInfo(NULL, CALG_SHA1, 0, X509_ASN_ENCODING, &pCertContext->pCertInfo->SubjectPublicKeyInfo, rgbPublicKeyIdentifier, &cbPublicKeyIdentifier))
     {
-        ExitWithLastError(hr, "Failed to get certificate public key identifier from file: %ls", wzPath);
+        ExitWithLastError(hr, "Failed to get certificate public key identifier for certificate: %ls", sczKey);
     }
 
     hr = CertReadProperty(pCertContext, CERT_SHA1_HASH_PROP_ID, &pbThumbprint, &cbThumbprint);
-    ExitOnFailure(hr, "Failed to read certificate thumbprint from file: %ls", wzPath);
+    ExitOnFailure(hr, "Failed to read certificate thumbprint for certificate: %ls", sczKey);
+
+    hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&pCache->rgpCertificates), pCache->cCertificates, 1, sizeof(CERTHASHES_CERTIFICATE*), 8);
+    ExitOnFailure(hr, "Failed to grow certificate cache");
+
+    pCertificate = static_cast<CERTHASHES_CERTIFICATE*>(MemAlloc(sizeof(CERTHASHES_CERTIFICATE), TRUE));
+    ExitOnNull(pCertificate, hr, E_OUTOFMEMORY, "Failed to allocate cached certificate");
+
+    pCache->rgpCertificates[pCache->cCertificates] = pCertificate;
+    ++pCache->cCertificates;
+
+    hr = StrAllocHexEncode(rgbPublicKeyIdentifier, cbPublicKeyIdentifier, &pCertificate->sczPublicKeyIdentifier);
+    ExitOnFailure(hr, "Failed to convert certificate public key to hex for certificate: %ls", sczKey);
+
+    hr = StrAllocHexEncode(pbThumbprint, cbThumbprint, &pCertificate->sczThumbprint);
+    ExitOnFailure(hr, "Failed to convert certificate thumbprint to hex for certificate: %ls", sczKey);
 
-    // Get the public key indentifier and thumbprint in hex.
-    hr = StrAllocHexEncode(rgbPublicKeyIdentifier, cbPublicKeyIdentifier, psczPublicKeyIdentifier);
-    ExitOnFailure(hr, "Failed to convert certificate public key to hex for file: %ls", wzPath);
+    *ppCertificate = pCertificate;
 
-    hr = StrAllocHexEncode(pbThumbprint, cbThumbprint, psczThumbprint);
-    ExitOnFailure(hr, "Failed to convert certificate thumbprint to hex for file: %ls", wzPath);
+    // A different certificate with the same hash is still answered, just not cached.
+    if (!pCached)
+    {
+        pCertificate->pbEncoded = static_cast<BYTE*>(MemAlloc(pCertContext->cbCertEncoded, FALSE));
+        ExitOnNull(pCertificate->pbEncoded, hr, E_OUTOFMEMORY, "Failed to allocate cached certificate encoding");
+
+        memcpy_s(pCertificate->pbEncoded, pCertContext->cbCertEncoded, pCertContext->pbCertEncoded, pCertContext->cbCertEncoded);
+        pCertificate->cbEncoded = pCertContext->cbCertEncoded;
+
+        pCertificate->sczKey = sczKey;
+        sczKey = NULL;
+
+        hr = DictAddValue(pCache->shCertificates, pCertificate);
+        ExitOnFailure(hr, "Failed to cache certificate: %ls", pCertificate->sczKey);
+    }
 
 LExit:
+    if (fLocked)
+    {
+        ::LeaveCriticalSection(&pCache->cs);
+    }
+
     ReleaseMem(pbThumbprint);
+    ReleaseStr(sczKey);
+
     return hr;
 }
 
-static HRESULT GetChainContext(
+// WinVerifyTrust builds the signer's chain on the process-wide default chain engine, which
+// all threads share along with the chains it has already built.
+static HRESULT GetSignerCertificate(
     __in_z LPCWSTR wzPath,
-    __out PCCERT_CHAIN_CONTEXT* ppChainContext)
+    __out PCCERT_CONTEXT* ppCertContext)
 {
     HRESULT hr = S_OK;
 
@@ -111,6 +385,7 @@ static HRESULT GetChainContext(
     WINTRUST_DATA wtd = { };
     CRYPT_PROVIDER_DATA* pProviderData = NULL;
     CRYPT_PROVIDER_SGNR* pSigner = NULL;
+    PCCERT_CHAIN_CONTEXT pChainContext = NULL;
 
     wfi.cbStruct = sizeof(wfi);
     wfi.pcwszFilePath = wzPath;
@@ -131,8 +406,17 @@ static HRESULT GetChainContext(
     pSigner = ::WTHelperGetProvSignerFromChain(pProviderData, 0, FALSE, 0);
     ExitOnNullWithLastError(pSigner, hr, "Failed to get signer chain from authenticode certificate on file: %ls", wzPath);
 
-    *ppChainContext = pSigner->pChainContext;
+    pChainContext = pSigner->pChainContext;
+
+    // The certificate must outlive the verification state released below.
+    *ppCertContext = ::CertDuplicateCertificateContext(pChainContext->rgpChain[0]->rgpElement[0]->pCertContext);
 
 LExit:
+    if (wtd.hWVTStateData)
+    {
+        wtd.dwStateAction = WTD_STATEACTION_CLOSE;
+        ::WinVerifyTrust(static_cast<HWND>(INVALID_HANDLE_VALUE), &guidAuthenticode, &wtd);
+    }
+
     return hr;
 }
@@ -2,46 +2,175 @@
 
 #include "precomp.h"
 
-static INT_PTR __stdcall EnumCallback(FDINOTIFICATIONTYPE fdint, PFDINOTIFICATION pfdin);
+// Characters in a file line besides the name: three tabs, a signed size, a date, a time and CRLF.
+#define ENUMCAB_MAX_FILE_LINE_NUMBERS (3 + 11 + 5 + 5 + 2)
 
+struct ENUMCAB_CABINET
+{
+    LPCWSTR wzCabPath;
+    LPWSTR sczOutput;
+    HRESULT hrResult;
+};
+
+static HRESULT CALLBACK EnumerateCabinet(__in THRD_GROUP_HANDLE hGroup, __in_opt LPVOID pvContext);
+static HRESULT FormatCabinetFiles(__in_z LPCWSTR wzCabPath, __deref_out_z LPWSTR* psczOutput);
 
+
+// Lists the files in each cabinet. When more than one cabinet is given they are enumerated
+// on a thread pool and each cabinet's files are written, in the order the cabinets were
+// given, after a line with ':' and the cabinet path.
 HRESULT EnumCabCommand(
     __in int argc,
     __in LPWSTR argv[]
 )
 {
     HRESULT hr = E_INVALIDARG;
-    LPCWSTR wzCabPath = NULL;
+    LPWSTR sczOutput = NULL;
+    ENUMCAB_CABINET* rgCabinets = NULL;
+    DWORD cCabinets = 0;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
 
     if (argc < 1)
     {
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: cabPath outputFolder");
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: cabPath [cabPath]...");
+    }
+
+    if (1 == argc)
+    {
+        hr = FormatCabinetFiles(argv[0], &sczOutput);
+        ExitOnFailure(hr, "failed to enumerate cabinet: %ls", argv[0]);
+
+        ConsoleWriteW(CONSOLE_COLOR_NORMAL, sczOutput);
+
+        ExitFunction();
+    }
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&rgCabinets), sizeof(ENUMCAB_CABINET), argc);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate cabinets to enumerate");
+
+    for (; cCabinets < static_cast<DWORD>(argc); ++cCabinets)
+    {
+        rgCabinets[cCabinets].wzCabPath = argv[cCabinets];
+    }
+
+    hr = ThrdPoolInitialize(0);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create enumcab thread pool");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create enumcab group");
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, EnumerateCabinet, rgCabinets + i);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to queue cabinet: %ls", rgCabinets[i].wzCabPath);
     }
 
-    wzCabPath = argv[0];
+    // Failures are reported per cabinet below so every cabinet's output is still written.
+    ThrdGroupWait(hGroup, INFINITE);
 
-    hr = CabInitialize(FALSE);
-    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", wzCabPath);
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        ConsoleWriteLine(CONSOLE_COLOR_NORMAL, ":%ls", rgCabinets[i].wzCabPath);
 
-    hr = CabEnumerate(wzCabPath, L"*", EnumCallback, 0);
-    ExitOnFailure(hr, "failed to compress files into cabinet: %ls", wzCabPath);
+        if (rgCabinets[i].sczOutput)
+        {
+            ConsoleWriteW(CONSOLE_COLOR_NORMAL, rgCabinets[i].sczOutput);
+        }
+
+        if (SUCCEEDED(hr) && FAILED(rgCabinets[i].hrResult))
+        {
+            hr = rgCabinets[i].hrResult;
+        }
+    }
+
+    ExitOnFailure(hr, "failed to enumerate cabinets");
 
 LExit:
-    CabUninitialize();
+    ReleaseThreadGroup(hGroup);
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        ReleaseStr(rgCabinets[i].sczOutput);
+    }
+
+    ReleaseMem(rgCabinets);
+    ReleaseStr(sczOutput);
+
+    return hr;
+}
+
+
+static HRESULT CALLBACK EnumerateCabinet(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+)
+{
+    HRESULT hr = S_OK;
+    ENUMCAB_CABINET* pCabinet = static_cast<ENUMCAB_CABINET*>(pvContext);
+
+    hr = FormatCabinetFiles(pCabinet->wzCabPath, &pCabinet->sczOutput);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to enumerate cabinet: %ls", pCabinet->wzCabPath);
+
+LExit:
+    pCabinet->hrResult = hr;
 
     return hr;
 }
 
 
-static INT_PTR __stdcall EnumCallback(
-    __in FDINOTIFICATIONTYPE fdint,
-    __in PFDINOTIFICATION pfdin
+// Reads the cabinet's file table directly rather than through FDI, which opens the cabinet
+// through its callbacks and walks every folder only to report the file entries.
+static HRESULT FormatCabinetFiles(
+    __in_z LPCWSTR wzCabPath,
+    __deref_out_z LPWSTR* psczOutput
 )
 {
-    if (fdint == fdintCOPY_FILE)
+    HRESULT hr = S_OK;
+    CAB_INDEX index = { };
+    SIZE_T cchOutput = 1;
+    LPWSTR wzEnd = NULL;
+    size_t cchRemaining = 0;
+
+    hr = CabReadIndex(wzCabPath, 0, &index);
+    ExitOnFailure(hr, "failed to read index of cabinet: %ls", wzCabPath);
+
+    // Size the output for every file up front so it is formatted in one pass.
+    for (DWORD i = 0; i < index.cFiles; ++i)
+    {
+        cchOutput += lstrlenW(index.rgFiles[i].sczName) + ENUMCAB_MAX_FILE_LINE_NUMBERS;
+    }
+
+    hr = StrAlloc(psczOutput, cchOutput);
+    ExitOnFailure(hr, "failed to allocate output for cabinet: %ls", wzCabPath);
+
+    **psczOutput = L'\0';
+    wzEnd = *psczOutput;
+    cchRemaining = cchOutput;
+
+    for (DWORD i = 0; i < index.cFiles; ++i)
     {
-        ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%s\t%d\t%u\t%u", pfdin->psz1, pfdin->cb, pfdin->date, pfdin->time);
+        const CAB_INDEX_FILE* pFile = index.rgFiles + i;
+
+        // FDI reports files continued from a previous cabinet as partial files, which were never listed.
+        if (ifoldCONTINUED_FROM_PREV == pFile->iFolder || ifoldCONTINUED_PREV_AND_NEXT == pFile->iFolder)
+        {
+            continue;
+        }
+
+        hr = ::StringCchPrintfExW(wzEnd, cchRemaining, &wzEnd, &cchRemaining, 0, L"%ls\t%d\t%u\t%u\r\n", pFile->sczName, pFile->cbFile, pFile->date, pFile->time);
+        ExitOnFailure(hr, "failed to format file in cabinet: %ls", wzCabPath);
     }
 
-    return 0;
+LExit:
+    CabReleaseIndex(&index);
+
+    return hr;
 }
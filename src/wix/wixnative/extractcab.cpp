@@ -2,34 +2,125 @@
 
 #include "precomp.h"
 
+struct EXTRACTCAB_CABINET
+{
+    LPCWSTR wzCabPath;
+    LPCWSTR wzOutputFolder;
+
+    CRITICAL_SECTION csOutput;
+    LPWSTR sczOutput;
+    HRESULT hrResult;
+};
+
+static HRESULT CALLBACK ExtractCabinet(__in THRD_GROUP_HANDLE hGroup, __in_opt LPVOID pvContext);
 static HRESULT ProgressCallback(__in BOOL fBeginFile, __in_z LPCWSTR wzFileId, __in_opt LPVOID pvContext);
 
 
+// Extracts each cabinet to its output folder. The cabinets, and the folders within each
+// cabinet, are extracted on a thread pool. The extracted file ids are written once all the
+// cabinets are extracted, in the order the cabinets were given; when more than one cabinet
+// is given each cabinet's file ids follow a line with ':' and the cabinet path.
 HRESULT ExtractCabCommand(
     __in int argc,
     __in_ecount(argc) LPWSTR argv[]
 )
 {
     HRESULT hr = E_INVALIDARG;
-    LPCWSTR wzCabPath = NULL;
-    LPCWSTR wzOutputFolder = NULL;
+    EXTRACTCAB_CABINET* rgCabinets = NULL;
+    DWORD cCabinets = 0;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+
+    if (argc < 2 || argc % 2)
+    {
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: cabPath outputFolder [cabPath outputFolder]...");
+    }
+
+    hr = MemAllocArray(reinterpret_cast<LPVOID*>(&rgCabinets), sizeof(EXTRACTCAB_CABINET), argc / 2);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate cabinets to extract");
+
+    for (; cCabinets < static_cast<DWORD>(argc / 2); ++cCabinets)
+    {
+        rgCabinets[cCabinets].wzCabPath = argv[cCabinets * 2];
+        rgCabinets[cCabinets].wzOutputFolder = argv[cCabinets * 2 + 1];
+        ::InitializeCriticalSection(&rgCabinets[cCabinets].csOutput);
+    }
+
+    hr = WixNativeCabInitialize();
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", rgCabinets[0].wzCabPath);
+
+    hr = ThrdPoolInitialize(0);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create extractcab thread pool");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create extractcab group");
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, ExtractCabinet, rgCabinets + i);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to queue cabinet: %ls", rgCabinets[i].wzCabPath);
+    }
+
+    // Failures are reported per cabinet below so every cabinet's output is still written.
+    ThrdGroupWait(hGroup, INFINITE);
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        if (1 < cCabinets)
+        {
+            ConsoleWriteLine(CONSOLE_COLOR_NORMAL, ":%ls", rgCabinets[i].wzCabPath);
+        }
 
-    if (argc < 2)
+        if (rgCabinets[i].sczOutput)
+        {
+            ConsoleWriteW(CONSOLE_COLOR_NORMAL, rgCabinets[i].sczOutput);
+        }
+
+        if (SUCCEEDED(hr) && FAILED(rgCabinets[i].hrResult))
+        {
+            hr = rgCabinets[i].hrResult;
+        }
+    }
+
+    ExitOnFailure(hr, "failed to extract cabinets");
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    WixNativeCabUninitialize();
+
+    for (DWORD i = 0; i < cCabinets; ++i)
     {
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: cabPath outputFolder");
+        ReleaseStr(rgCabinets[i].sczOutput);
+        ::DeleteCriticalSection(&rgCabinets[i].csOutput);
     }
 
-    wzCabPath = argv[0];
-    wzOutputFolder = argv[1];
+    ReleaseMem(rgCabinets);
 
-    hr = CabInitialize(FALSE);
-    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", wzCabPath);
+    return hr;
+}
+
+
+static HRESULT CALLBACK ExtractCabinet(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+)
+{
+    HRESULT hr = S_OK;
+    EXTRACTCAB_CABINET* pCabinet = static_cast<EXTRACTCAB_CABINET*>(pvContext);
 
-    hr = CabExtract(wzCabPath, L"*", wzOutputFolder, ProgressCallback, NULL, 0);
-    ExitOnFailure(hr, "failed to compress files into cabinet: %ls", wzCabPath);
+    hr = CabExtractParallel(pCabinet->wzCabPath, pCabinet->wzOutputFolder, ProgressCallback, pCabinet, 0);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to extract cabinet: %ls", pCabinet->wzCabPath);
 
 LExit:
-    CabUninitialize();
+    pCabinet->hrResult = hr;
 
     return hr;
 }
@@ -38,13 +129,21 @@ LExit:
 static HRESULT ProgressCallback(
     __in BOOL fBeginFile,
     __in_z LPCWSTR wzFileId,
-    __in_opt LPVOID /*pvContext*/
+    __in_opt LPVOID pvContext
 )
 {
+    HRESULT hr = S_OK;
+    EXTRACTCAB_CABINET* pCabinet = static_cast<EXTRACTCAB_CABINET*>(pvContext);
+
     if (fBeginFile)
     {
-        ConsoleWriteLine(CONSOLE_COLOR_NORMAL, "%ls", wzFileId);
+        // The cabinet's folders are extracted on several threads at once.
+        ::EnterCriticalSection(&pCabinet->csOutput);
+
+        hr = StrAllocConcatFormatted(&pCabinet->sczOutput, L"%ls\r\n", wzFileId);
+
+        ::LeaveCriticalSection(&pCabinet->csOutput);
     }
 
-    return S_OK;
+    return hr;
 }
@@ -9,16 +9,26 @@
 #include <wintrust.h>
 
 #include "dutil.h"
+#include "buffutil.h"
 #include "certutil.h"
 #include "conutil.h"
+#include "cryputil.h"
+#include "dictutil.h"
+#include "dirutil.h"
+#include "fileutil.h"
 #include "memutil.h"
 #include "pathutil.h"
 #include "strutil.h"
+#include "thrdutil.h"
 #include "cabcutil.h"
 #include "cabutil.h"
 
 HRESULT WixNativeReadStdinPreamble();
+HRESULT WixNativeReadStdinLine(__deref_out_z LPWSTR* psczLine);
+HRESULT WixNativeCabInitialize();
+void WixNativeCabUninitialize();
 HRESULT CertificateHashesCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
 HRESULT SmartCabCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
+HRESULT SmartCabBatchCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
 HRESULT EnumCabCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
 HRESULT ExtractCabCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
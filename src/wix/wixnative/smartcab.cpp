@@ -2,98 +2,246 @@
 
 #include "precomp.h"
 
+static const DWORD SMARTCAB_CACHE_VERSION = 1;
+static LPCWSTR SMARTCAB_CACHE_NAMES_FILE = L"cabinets.txt";
+
+struct SMARTCAB_BATCH_CABINET
+{
+    LPWSTR sczCabPath;
+    LPCWSTR wzCabName;
+    LPWSTR sczCabDir;
+    COMPRESSION_TYPE ct;
+    UINT uiFileCount;
+    UINT uiMaxSize;
+    UINT uiMaxThresh;
+    LPWSTR sczHashCachePath;
+    LPWSTR sczCabinetCachePath;
+
+    LPWSTR* rgsczFileLines;
+    UINT cFileLines;
+
+    LPWSTR sczOutput;
+    HRESULT hrResult;
+    LONGLONG llElapsed;
+    BOOL fCached;
+    CABC_STATISTICS statistics;
+};
+
 static HRESULT CompressFiles(__in HANDLE hCab, __inout_z LPWSTR* psczFirstFileToken);
+static HRESULT AddFileLine(__in HANDLE hCab, __in_z LPCWSTR wzLine, __inout_z LPWSTR* psczFirstFileToken);
+static HRESULT ParseCabinetArguments(__in int argc, __in_ecount(argc) LPWSTR argv[], __inout SMARTCAB_BATCH_CABINET* pCabinet);
+static HRESULT ReadBatchCabinet(__in_z LPCWSTR wzLine, __inout SMARTCAB_BATCH_CABINET* pCabinet);
+static HRESULT CALLBACK CompressBatchCabinet(__in THRD_GROUP_HANDLE hGroup, __in_opt LPVOID pvContext);
+static HRESULT CompressCabinet(__in SMARTCAB_BATCH_CABINET* pCabinet);
+static HRESULT GetCabinetCacheKey(__in const SMARTCAB_BATCH_CABINET* pCabinet, __deref_out_z LPWSTR* psczKey);
+static HRESULT RestoreCachedCabinet(__in SMARTCAB_BATCH_CABINET* pCabinet, __in_z LPCWSTR wzEntryPath);
+static HRESULT StoreCachedCabinet(__in const SMARTCAB_BATCH_CABINET* pCabinet, __in_z LPCWSTR wzEntryPath);
+static void ReleaseBatchCabinet(__in SMARTCAB_BATCH_CABINET* pCabinet);
 static void __stdcall CabNamesCallback(__in_z LPCWSTR wzFirstCabName, __in_z LPCWSTR wzNewCabName, __in_z LPCWSTR wzFileToken);
 
+// FCI does not pass a context to the cabinet names callback, so a batch records which
+// cabinet each worker thread is compressing to collect that cabinet's output. A worker
+// waiting on a cabinet's duplicate hashing can compress another cabinet on the same
+// thread, so each cabinet restores the previous value when it finishes.
+__declspec(thread) static SMARTCAB_BATCH_CABINET* vpBatchCabinet;
+
 
 HRESULT SmartCabCommand(
     __in int argc,
     __in_ecount(argc) LPWSTR argv[]
     )
 {
-    HRESULT hr = E_INVALIDARG;
-    LPWSTR sczCabPath = NULL;
-    LPCWSTR wzCabName = NULL;
-    LPWSTR sczCabDir = NULL;
-    UINT uiFileCount = 0;
-    UINT uiMaxSize = 0;
-    UINT uiMaxThresh = 0;
-    COMPRESSION_TYPE ct = COMPRESSION_TYPE_NONE;
+    HRESULT hr = S_OK;
+    SMARTCAB_BATCH_CABINET cabinet = { };
     HANDLE hCab = NULL;
     LPWSTR sczFirstFileToken = NULL;
+    LPWSTR sczLine = NULL;
 
-    if (argc < 1)
-    {
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: outCabPath [compressionType] [fileCount] [maxSizePerCabInMB [maxThreshold]]");
-    }
-    else
-    {
-        hr = PathExpand(&sczCabPath, argv[0], PATH_EXPAND_FULLPATH);
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not expand path: %ls", argv[0]);
+    hr = ParseCabinetArguments(argc, argv, &cabinet);
+    ExitOnFailure(hr, "failed to parse smartcab arguments");
 
-        wzCabName = PathFile(sczCabPath);
+    if (cabinet.sczCabinetCachePath)
+    {
+        // The cache key covers every file so all the files are read before compressing any.
+        if (cabinet.uiFileCount > 0)
+        {
+            hr = WixNativeReadStdinPreamble();
+            ExitOnFailure(hr, "failed to read stdin preamble before smartcabbing");
 
-        hr = PathGetDirectory(sczCabPath, &sczCabDir);
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse directory from path: %ls", sczCabPath);
+            for (;;)
+            {
+                hr = WixNativeReadStdinLine(&sczLine);
+                ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read smartcab line from stdin");
 
-        if (argc > 1)
-        {
-            UINT uiCompressionType;
-            hr = StrStringToUInt32(argv[1], 0, &uiCompressionType);
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse compression type as number: %ls", argv[1]);
+                if (!*sczLine)
+                {
+                    break;
+                }
 
-            ct = (uiCompressionType > 4) ? COMPRESSION_TYPE_HIGH : static_cast<COMPRESSION_TYPE>(uiCompressionType);
+                hr = StrArrayAllocString(&cabinet.rgsczFileLines, &cabinet.cFileLines, sczLine, 0);
+                ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to store smartcab line: %ls", sczLine);
+            }
         }
 
-        if (argc > 2)
-        {
-            hr = StrStringToUInt32(argv[2], 0, &uiFileCount);
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse file count as number: %ls", argv[2]);
-        }
+        SMARTCAB_BATCH_CABINET* pPreviousBatchCabinet = vpBatchCabinet;
+        vpBatchCabinet = &cabinet;
+        hr = CompressCabinet(&cabinet);
+        vpBatchCabinet = pPreviousBatchCabinet;
+        ExitOnFailure(hr, "failed to compress cabinet: %ls", cabinet.sczCabPath);
 
-        if (argc > 3)
-        {
-            hr = StrStringToUInt32(argv[3], 0, &uiMaxSize);
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse max size as number: %ls", argv[3]);
-        }
+        hr = ConsoleWriteW(CONSOLE_COLOR_NORMAL, cabinet.sczOutput);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to send cabinet names message");
 
-        if (argc > 4)
-        {
-            hr = StrStringToUInt32(argv[4], 0, &uiMaxThresh);
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse max threshold as number: %ls", argv[4]);
-        }
+        ExitFunction();
     }
 
-    hr = CabCBegin(wzCabName, sczCabDir, uiFileCount, uiMaxSize, uiMaxThresh, ct, &hCab);
-    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", sczCabPath);
+    hr = CabCBegin(cabinet.wzCabName, cabinet.sczCabDir, cabinet.uiFileCount, cabinet.uiMaxSize, cabinet.uiMaxThresh, cabinet.ct, &hCab);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", cabinet.sczCabPath);
 
-    if (uiFileCount > 0)
+    hr = CabCSetHashCachePath(hCab, cabinet.sczHashCachePath);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to set hash cache for cabinet: %ls", cabinet.sczCabPath);
+
+    if (cabinet.uiFileCount > 0)
     {
         hr = WixNativeReadStdinPreamble();
         ExitOnFailure(hr, "failed to read stdin preamble before smartcabbing");
 
         hr = CompressFiles(hCab, &sczFirstFileToken);
-        ExitOnFailure(hr, "failed to compress files into cabinet: %ls", sczCabPath);
+        ExitOnFailure(hr, "failed to compress files into cabinet: %ls", cabinet.sczCabPath);
 
-        CabNamesCallback(wzCabName, wzCabName, sczFirstFileToken);
+        CabNamesCallback(cabinet.wzCabName, cabinet.wzCabName, sczFirstFileToken);
     }
     else
     {
-        CabNamesCallback(wzCabName, wzCabName, L"");
+        CabNamesCallback(cabinet.wzCabName, cabinet.wzCabName, L"");
     }
 
     hr = CabCFinish(hCab, CabNamesCallback);
     hCab = NULL; // once finish is called, the handle is invalid.
-    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to compress cabinet: %ls", sczCabPath);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to compress cabinet: %ls", cabinet.sczCabPath);
 
 LExit:
+    ReleaseStr(sczLine);
     ReleaseStr(sczFirstFileToken);
     if (hCab)
     {
         CabCCancel(hCab);
     }
-    ReleaseStr(sczCabDir);
-    ReleaseStr(sczCabPath);
+    ReleaseBatchCabinet(&cabinet);
+
+    return hr;
+}
+
+// Compresses several cabinets at once on a thread pool. After the preamble, stdin holds one
+// line per cabinet with the smartcab arguments separated by tabs (outCabPath, compressionType,
+// fileCount, maxSizePerCabInMB, maxThreshold, hashCachePath, cabinetCachePath), each followed by fileCount
+// smartcab file lines. A blank line ends the batch. Each cabinet is built exactly as smartcab
+// would build it and the output is written in batch order once all cabinets finish, followed
+// by a timing line per cabinet with the milliseconds taken, the file count, the result,
+// whether the cabinet came from the cabinet cache, the bytes compressed, the MB/s achieved
+// and the milliseconds spent waiting on the disk.
+HRESULT SmartCabBatchCommand(
+    __in int argc,
+    __in_ecount(argc) LPWSTR argv[]
+    )
+{
+    HRESULT hr = S_OK;
+    UINT uiThreads = 0;
+    LPWSTR sczLine = NULL;
+    SMARTCAB_BATCH_CABINET* rgCabinets = NULL;
+    DWORD cCabinets = 0;
+    BOOL fPoolInitialized = FALSE;
+    THRD_GROUP_HANDLE hGroup = NULL;
+    LARGE_INTEGER liFrequency = { };
+
+    if (argc > 0)
+    {
+        hr = StrStringToUInt32(argv[0], 0, &uiThreads);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse thread count as number: %ls", argv[0]);
+    }
+
+    hr = WixNativeReadStdinPreamble();
+    ExitOnFailure(hr, "failed to read stdin preamble before smartcabbing batch");
+
+    for (;;)
+    {
+        hr = WixNativeReadStdinLine(&sczLine);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read smartcab batch line from stdin");
+
+        if (!*sczLine)
+        {
+            break;
+        }
+
+        hr = MemEnsureArraySizeForNewItems(reinterpret_cast<LPVOID*>(&rgCabinets), cCabinets, 1, sizeof(SMARTCAB_BATCH_CABINET), 8);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to grow smartcab batch");
+
+        hr = ReadBatchCabinet(sczLine, rgCabinets + cCabinets);
+        ++cCabinets;
+        ExitOnFailure(hr, "failed to read smartcab batch cabinet: %ls", sczLine);
+    }
+
+    // Use the shared pool so the files each cabinet hashes for duplicates use the same threads.
+    hr = ThrdPoolInitialize(uiThreads);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create smartcab thread pool");
+
+    fPoolInitialized = TRUE;
+
+    hr = ThrdGroupCreate(NULL, &hGroup);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to create smartcab batch");
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        hr = ThrdGroupSubmit(hGroup, THRD_PRIORITY_NORMAL, CompressBatchCabinet, rgCabinets + i);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to queue cabinet: %ls", rgCabinets[i].sczCabPath);
+    }
+
+    // Failures are reported per cabinet below so every cabinet's output is still written.
+    ThrdGroupWait(hGroup, INFINITE);
+
+    ::QueryPerformanceFrequency(&liFrequency);
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        SMARTCAB_BATCH_CABINET* pCabinet = rgCabinets + i;
+
+        if (pCabinet->sczOutput)
+        {
+            ConsoleWriteW(CONSOLE_COLOR_NORMAL, pCabinet->sczOutput);
+        }
+
+        if (SUCCEEDED(hr) && FAILED(pCabinet->hrResult))
+        {
+            hr = pCabinet->hrResult;
+        }
+    }
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        const SMARTCAB_BATCH_CABINET* pCabinet = rgCabinets + i;
+        DWORD64 qwMilliseconds = liFrequency.QuadPart ? pCabinet->llElapsed * 1000 / liFrequency.QuadPart : 0;
+        DWORD64 qwMegabytesPerSecond = qwMilliseconds ? pCabinet->statistics.qwSourceBytes * 1000 / qwMilliseconds / (1024 * 1024) : 0;
+
+        ConsoleWriteLine(CONSOLE_COLOR_NORMAL, ":timing\t%ls\t%I64u\t%u\t0x%x\t%d\t%I64u\t%I64u\t%u", pCabinet->sczCabPath, qwMilliseconds, pCabinet->uiFileCount, pCabinet->hrResult, pCabinet->fCached, pCabinet->statistics.qwSourceBytes, qwMegabytesPerSecond, pCabinet->statistics.dwStreamWaitMilliseconds);
+    }
+
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to compress smartcab batch");
+
+LExit:
+    ReleaseThreadGroup(hGroup);
+
+    if (fPoolInitialized)
+    {
+        ThrdPoolUninitialize();
+    }
+
+    for (DWORD i = 0; i < cCabinets; ++i)
+    {
+        ReleaseBatchCabinet(rgCabinets + i);
+    }
+
+    ReleaseMem(rgCabinets);
+    ReleaseStr(sczLine);
 
     return hr;
 }
@@ -106,13 +254,10 @@ static HRESULT CompressFiles(
 {
     HRESULT hr = S_OK;
     LPWSTR sczLine = NULL;
-    LPWSTR* rgsczSplit = NULL;
-    UINT cSplit = 0;
-    MSIFILEHASHINFO hashInfo = { sizeof(MSIFILEHASHINFO) };
 
     for (;;)
     {
-        hr = ConsoleReadW(&sczLine);
+        hr = WixNativeReadStdinLine(&sczLine);
         ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read smartcab line from stdin");
 
         if (!*sczLine)
@@ -120,51 +265,527 @@ static HRESULT CompressFiles(
             break;
         }
 
-        hr = StrSplitAllocArray(&rgsczSplit, &cSplit, sczLine, L"\t");
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line from stdin: %ls", sczLine);
+        hr = AddFileLine(hCab, sczLine, psczFirstFileToken);
+        ExitOnFailure(hr, "failed to add smartcab line: %ls", sczLine);
+    }
+
+LExit:
+    ReleaseStr(sczLine);
+
+    return hr;
+}
+
+static HRESULT AddFileLine(
+    __in HANDLE hCab,
+    __in_z LPCWSTR wzLine,
+    __inout_z LPWSTR* psczFirstFileToken
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR* rgsczSplit = NULL;
+    UINT cSplit = 0;
+    MSIFILEHASHINFO hashInfo = { sizeof(MSIFILEHASHINFO) };
+
+    hr = StrSplitAllocArray(&rgsczSplit, &cSplit, wzLine, L"\t");
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line from stdin: %ls", wzLine);
+
+    if (!rgsczSplit || (cSplit != 2 && cSplit != 6))
+    {
+        hr = E_INVALIDARG;
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line into hash x 4, token, source file: %ls", wzLine);
+    }
+
+    LPCWSTR wzFilePath = rgsczSplit[0];
+    LPCWSTR wzToken = rgsczSplit[1];
+    PMSIFILEHASHINFO pHashInfo = NULL;
+
+    if (cSplit == 6)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            LPCWSTR wzHash = rgsczSplit[i + 2];
+
+            hr = StrStringToInt32(wzHash, 0, reinterpret_cast<INT*>(hashInfo.dwData + i));
+            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to parse hash: %ls for file: %ls", wzHash, wzFilePath);
+        }
+
+        pHashInfo = &hashInfo;
+    }
+
+    if (psczFirstFileToken && !*psczFirstFileToken)
+    {
+        hr = StrAllocString(psczFirstFileToken, wzToken, 0);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate first file token: %ls", wzToken);
+    }
+
+    hr = CabCAddFile(wzFilePath, wzToken, pHashInfo, hCab);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to add file: %ls", wzFilePath);
+
+LExit:
+    ReleaseStrArray(rgsczSplit, cSplit);
+
+    return hr;
+}
+
+static HRESULT ParseCabinetArguments(
+    __in int argc,
+    __in_ecount(argc) LPWSTR argv[],
+    __inout SMARTCAB_BATCH_CABINET* pCabinet
+    )
+{
+    HRESULT hr = E_INVALIDARG;
+
+    if (argc < 1)
+    {
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Must specify: outCabPath [compressionType] [fileCount] [maxSizePerCabInMB [maxThreshold [hashCachePath [cabinetCachePath]]]]");
+    }
+
+    hr = PathExpand(&pCabinet->sczCabPath, argv[0], PATH_EXPAND_FULLPATH);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not expand path: %ls", argv[0]);
+
+    pCabinet->wzCabName = PathFile(pCabinet->sczCabPath);
+
+    hr = PathGetDirectory(pCabinet->sczCabPath, &pCabinet->sczCabDir);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse directory from path: %ls", pCabinet->sczCabPath);
+
+    if (argc > 1)
+    {
+        UINT uiCompressionType;
+        hr = StrStringToUInt32(argv[1], 0, &uiCompressionType);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse compression type as number: %ls", argv[1]);
+
+        pCabinet->ct = (uiCompressionType > 4) ? COMPRESSION_TYPE_HIGH : static_cast<COMPRESSION_TYPE>(uiCompressionType);
+    }
+
+    if (argc > 2)
+    {
+        hr = StrStringToUInt32(argv[2], 0, &pCabinet->uiFileCount);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse file count as number: %ls", argv[2]);
+    }
+
+    if (argc > 3)
+    {
+        hr = StrStringToUInt32(argv[3], 0, &pCabinet->uiMaxSize);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse max size as number: %ls", argv[3]);
+    }
+
+    if (argc > 4)
+    {
+        hr = StrStringToUInt32(argv[4], 0, &pCabinet->uiMaxThresh);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not parse max threshold as number: %ls", argv[4]);
+    }
+
+    if (argc > 5 && *argv[5])
+    {
+        hr = PathExpand(&pCabinet->sczHashCachePath, argv[5], PATH_EXPAND_FULLPATH);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not expand hash cache path: %ls", argv[5]);
+    }
+
+    if (argc > 6 && *argv[6])
+    {
+        hr = PathExpand(&pCabinet->sczCabinetCachePath, argv[6], PATH_EXPAND_FULLPATH);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "Could not expand cabinet cache path: %ls", argv[6]);
+    }
+
+LExit:
+    return hr;
+}
+
+static HRESULT ReadBatchCabinet(
+    __in_z LPCWSTR wzLine,
+    __inout SMARTCAB_BATCH_CABINET* pCabinet
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR* rgsczArguments = NULL;
+    UINT cArguments = 0;
+    LPWSTR sczFileLine = NULL;
+
+    hr = StrSplitAllocArray(&rgsczArguments, &cArguments, wzLine, L"\t");
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab batch line: %ls", wzLine);
+
+    hr = ParseCabinetArguments(static_cast<int>(cArguments), rgsczArguments, pCabinet);
+    ExitOnFailure(hr, "failed to parse smartcab batch arguments: %ls", wzLine);
+
+    for (UINT i = 0; i < pCabinet->uiFileCount; ++i)
+    {
+        hr = WixNativeReadStdinLine(&sczFileLine);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read smartcab line from stdin");
+
+        if (!*sczFileLine)
+        {
+            hr = E_INVALIDARG;
+            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "expected %u files for cabinet: %ls", pCabinet->uiFileCount, pCabinet->sczCabPath);
+        }
+
+        hr = StrArrayAllocString(&pCabinet->rgsczFileLines, &pCabinet->cFileLines, sczFileLine, 0);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to store smartcab line: %ls", sczFileLine);
+    }
+
+LExit:
+    ReleaseStr(sczFileLine);
+    ReleaseStrArray(rgsczArguments, cArguments);
+
+    return hr;
+}
+
+static HRESULT CALLBACK CompressBatchCabinet(
+    __in THRD_GROUP_HANDLE /*hGroup*/,
+    __in_opt LPVOID pvContext
+    )
+{
+    HRESULT hr = S_OK;
+    SMARTCAB_BATCH_CABINET* pCabinet = static_cast<SMARTCAB_BATCH_CABINET*>(pvContext);
+    SMARTCAB_BATCH_CABINET* pPreviousBatchCabinet = vpBatchCabinet;
+    LARGE_INTEGER liStart = { };
+    LARGE_INTEGER liEnd = { };
+
+    vpBatchCabinet = pCabinet;
+    ::QueryPerformanceCounter(&liStart);
+
+    hr = CompressCabinet(pCabinet);
+
+    ::QueryPerformanceCounter(&liEnd);
+    pCabinet->llElapsed = liEnd.QuadPart - liStart.QuadPart;
+    pCabinet->hrResult = hr;
+    vpBatchCabinet = pPreviousBatchCabinet;
+
+    return hr;
+}
+
+// Builds a cabinet from its stored file lines. The cabinet names are collected in the
+// cabinet's output, so the current thread's batch cabinet must be set. With a cabinet
+// cache, a cabinet built from the same files and settings before is copied from the
+// cache instead.
+static HRESULT CompressCabinet(
+    __in SMARTCAB_BATCH_CABINET* pCabinet
+    )
+{
+    HRESULT hr = S_OK;
+    HANDLE hCab = NULL;
+    LPWSTR sczFirstFileToken = NULL;
+    LPWSTR sczKey = NULL;
+    LPWSTR sczEntryPath = NULL;
+
+    if (pCabinet->sczCabinetCachePath)
+    {
+        hr = GetCabinetCacheKey(pCabinet, &sczKey);
+        ExitOnFailure(hr, "failed to compute cache key for cabinet: %ls", pCabinet->sczCabPath);
+
+        hr = PathConcat(pCabinet->sczCabinetCachePath, sczKey, &sczEntryPath);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate cabinet cache entry path");
+
+        hr = RestoreCachedCabinet(pCabinet, sczEntryPath);
+        if (S_OK == hr)
+        {
+            pCabinet->fCached = TRUE;
+            ExitFunction();
+        }
+
+        // A damaged cache entry is no worse than a miss, the cabinet is built and stored again.
+        hr = S_OK;
+    }
+
+    hr = CabCBegin(pCabinet->wzCabName, pCabinet->sczCabDir, pCabinet->uiFileCount, pCabinet->uiMaxSize, pCabinet->uiMaxThresh, pCabinet->ct, &hCab);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet: %ls", pCabinet->sczCabPath);
+
+    hr = CabCSetHashCachePath(hCab, pCabinet->sczHashCachePath);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to set hash cache for cabinet: %ls", pCabinet->sczCabPath);
+
+    CabCCollectStatistics(hCab, &pCabinet->statistics);
+
+    for (UINT i = 0; i < pCabinet->cFileLines; ++i)
+    {
+        hr = AddFileLine(hCab, pCabinet->rgsczFileLines[i], &sczFirstFileToken);
+        ExitOnFailure(hr, "failed to compress files into cabinet: %ls", pCabinet->sczCabPath);
+    }
+
+    CabNamesCallback(pCabinet->wzCabName, pCabinet->wzCabName, sczFirstFileToken ? sczFirstFileToken : L"");
+
+    hr = CabCFinish(hCab, CabNamesCallback);
+    hCab = NULL; // once finish is called, the handle is invalid.
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to compress cabinet: %ls", pCabinet->sczCabPath);
+
+    if (sczEntryPath)
+    {
+        // The cache only saves work for the next build so failing to store the cabinet is not an error.
+        StoreCachedCabinet(pCabinet, sczEntryPath);
+    }
+
+LExit:
+    ReleaseStr(sczEntryPath);
+    ReleaseStr(sczKey);
+    ReleaseStr(sczFirstFileToken);
+    if (hCab)
+    {
+        CabCCancel(hCab);
+    }
+
+    return hr;
+}
+
+// The key covers everything the cabinet is built from: the settings, and the token,
+// attributes, time and content of each file in order. Split cabinets name each other so
+// the cabinet name is part of the key when splitting.
+static HRESULT GetCabinetCacheKey(
+    __in const SMARTCAB_BATCH_CABINET* pCabinet,
+    __deref_out_z LPWSTR* psczKey
+    )
+{
+    HRESULT hr = S_OK;
+    BYTE* pbKey = NULL;
+    SIZE_T cbKey = 0;
+    LPWSTR* rgsczSplit = NULL;
+    UINT cSplit = 0;
+    WIN32_FILE_ATTRIBUTE_DATA fad = { };
+    BYTE rgbHash[SHA256_HASH_LEN] = { };
+
+    hr = BuffWriteNumber(&pbKey, &cbKey, SMARTCAB_CACHE_VERSION);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    hr = BuffWriteNumber(&pbKey, &cbKey, pCabinet->ct);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    hr = BuffWriteNumber(&pbKey, &cbKey, pCabinet->uiMaxSize);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    hr = BuffWriteNumber(&pbKey, &cbKey, pCabinet->uiMaxThresh);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    hr = BuffWriteString(&pbKey, &cbKey, pCabinet->uiMaxSize ? pCabinet->wzCabName : NULL);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    hr = BuffWriteNumber(&pbKey, &cbKey, pCabinet->cFileLines);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+    for (UINT i = 0; i < pCabinet->cFileLines; ++i)
+    {
+        hr = StrSplitAllocArray(&rgsczSplit, &cSplit, pCabinet->rgsczFileLines[i], L"\t");
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line: %ls", pCabinet->rgsczFileLines[i]);
 
         if (!rgsczSplit || (cSplit != 2 && cSplit != 6))
         {
             hr = E_INVALIDARG;
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line into hash x 4, token, source file: %ls", sczLine);
+            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split smartcab line into hash x 4, token, source file: %ls", pCabinet->rgsczFileLines[i]);
         }
 
         LPCWSTR wzFilePath = rgsczSplit[0];
-        LPCWSTR wzToken = rgsczSplit[1];
-        PMSIFILEHASHINFO pHashInfo = NULL;
 
-        if (cSplit == 6)
+        // The token and any hash given for duplicate detection, but not the source path.
+        hr = BuffWriteNumber(&pbKey, &cbKey, cSplit);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+        for (UINT j = 1; j < cSplit; ++j)
         {
-            for (int i = 0; i < 4; ++i)
-            {
-                LPCWSTR wzHash = rgsczSplit[i + 2];
+            hr = BuffWriteString(&pbKey, &cbKey, rgsczSplit[j]);
+            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+        }
 
-                hr = StrStringToInt32(wzHash, 0, reinterpret_cast<INT*>(hashInfo.dwData + i));
-                ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to parse hash: %ls for file: %ls", wzHash, wzFilePath);
-            }
+        if (!::GetFileAttributesExW(wzFilePath, GetFileExInfoStandard, &fad))
+        {
+            ConsoleExitWithLastError(hr, CONSOLE_COLOR_RED, "failed to get attributes of file: %ls", wzFilePath);
+        }
+
+        hr = BuffWriteNumber(&pbKey, &cbKey, fad.dwFileAttributes);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+        hr = BuffWriteNumber64(&pbKey, &cbKey, (static_cast<DWORD64>(fad.ftLastWriteTime.dwHighDateTime) << 32) | fad.ftLastWriteTime.dwLowDateTime);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+        hr = CrypHashFile(wzFilePath, PROV_RSA_AES, CALG_SHA_256, rgbHash, sizeof(rgbHash), NULL);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to hash file: %ls", wzFilePath);
+
+        hr = BuffWriteStream(&pbKey, &cbKey, rgbHash, sizeof(rgbHash));
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to write cabinet cache key");
+
+        ReleaseNullStrArray(rgsczSplit, cSplit);
+    }
+
+    hr = CrypHashBuffer(pbKey, cbKey, PROV_RSA_AES, CALG_SHA_256, rgbHash, sizeof(rgbHash));
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to hash cabinet cache key");
 
-            pHashInfo = &hashInfo;
+    hr = StrAllocHexEncode(rgbHash, sizeof(rgbHash), psczKey);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to encode cabinet cache key");
+
+LExit:
+    ReleaseStrArray(rgsczSplit, cSplit);
+    ReleaseMem(pbKey);
+
+    return hr;
+}
+
+// Copies the cabinets in a cache entry to the cabinet's directory and adds their names to
+// the cabinet's output. Returns S_FALSE if the entry does not exist.
+static HRESULT RestoreCachedCabinet(
+    __in SMARTCAB_BATCH_CABINET* pCabinet,
+    __in_z LPCWSTR wzEntryPath
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczNamesPath = NULL;
+    BYTE* pbNames = NULL;
+    SIZE_T cbNames = 0;
+    LPWSTR sczNames = NULL;
+    LPWSTR* rgsczLines = NULL;
+    UINT cLines = 0;
+    LPWSTR* rgsczFields = NULL;
+    UINT cFields = 0;
+    LPWSTR sczSource = NULL;
+    LPWSTR sczTarget = NULL;
+
+    hr = PathConcat(wzEntryPath, SMARTCAB_CACHE_NAMES_FILE, &sczNamesPath);
+    ExitOnFailure(hr, "failed to allocate cabinet cache names path");
+
+    hr = FileRead(&pbNames, &cbNames, sczNamesPath);
+    if (E_FILENOTFOUND == hr || E_PATHNOTFOUND == hr)
+    {
+        ExitFunction1(hr = S_FALSE);
+    }
+    ExitOnFailure(hr, "failed to read cabinet cache names: %ls", sczNamesPath);
+
+    hr = StrAllocString(&sczNames, reinterpret_cast<LPCWSTR>(pbNames), cbNames / sizeof(WCHAR));
+    ExitOnFailure(hr, "failed to copy cabinet cache names");
+
+    hr = StrSplitAllocArray(&rgsczLines, &cLines, sczNames, L"\r\n");
+    ExitOnFailure(hr, "failed to split cabinet cache names");
+
+    for (UINT i = 0; i < cLines; ++i)
+    {
+        hr = StrSplitAllocArray(&rgsczFields, &cFields, rgsczLines[i], L"\t");
+        ExitOnFailure(hr, "failed to split cabinet cache names line: %ls", rgsczLines[i]);
+
+        if (!rgsczFields || cFields < 2)
+        {
+            hr = E_INVALIDDATA;
+            ExitOnRootFailure(hr, "invalid cabinet cache names line: %ls", rgsczLines[i]);
         }
 
-        if (psczFirstFileToken && !*psczFirstFileToken)
+        hr = PathConcat(wzEntryPath, rgsczFields[1], &sczSource);
+        ExitOnFailure(hr, "failed to allocate cached cabinet path");
+
+        hr = PathConcat(pCabinet->sczCabDir, rgsczFields[1], &sczTarget);
+        ExitOnFailure(hr, "failed to allocate cabinet path");
+
+        hr = FileEnsureCopy(sczSource, sczTarget, TRUE);
+        ExitOnFailure(hr, "failed to copy cached cabinet: %ls", sczSource);
+
+        ReleaseNullStrArray(rgsczFields, cFields);
+    }
+
+    hr = StrAllocConcat(&pCabinet->sczOutput, sczNames, 0);
+    ExitOnFailure(hr, "failed to buffer cabinet names message");
+
+LExit:
+    ReleaseStr(sczTarget);
+    ReleaseStr(sczSource);
+    ReleaseStrArray(rgsczFields, cFields);
+    ReleaseStrArray(rgsczLines, cLines);
+    ReleaseStr(sczNames);
+    ReleaseMem(pbNames);
+    ReleaseStr(sczNamesPath);
+
+    return hr;
+}
+
+// Copies the cabinets just built and their names into a new cache entry. The entry is
+// filled under a temporary name and renamed into place so a build sharing the cache never
+// sees a partial entry.
+static HRESULT StoreCachedCabinet(
+    __in const SMARTCAB_BATCH_CABINET* pCabinet,
+    __in_z LPCWSTR wzEntryPath
+    )
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczTempPath = NULL;
+    LPWSTR sczNamesPath = NULL;
+    LPWSTR* rgsczLines = NULL;
+    UINT cLines = 0;
+    LPWSTR* rgsczFields = NULL;
+    UINT cFields = 0;
+    LPWSTR sczSource = NULL;
+    LPWSTR sczTarget = NULL;
+    size_t cchOutput = 0;
+    BOOL fMoved = FALSE;
+
+    hr = StrAllocFormatted(&sczTempPath, L"%ls.%x.%x.tmp", wzEntryPath, ::GetCurrentProcessId(), ::GetCurrentThreadId());
+    ExitOnFailure(hr, "failed to allocate temporary cabinet cache entry path");
+
+    hr = DirEnsureExists(sczTempPath, NULL);
+    ExitOnFailure(hr, "failed to create cabinet cache entry: %ls", sczTempPath);
+
+    hr = StrSplitAllocArray(&rgsczLines, &cLines, pCabinet->sczOutput, L"\r\n");
+    ExitOnFailure(hr, "failed to split cabinet names");
+
+    for (UINT i = 0; i < cLines; ++i)
+    {
+        hr = StrSplitAllocArray(&rgsczFields, &cFields, rgsczLines[i], L"\t");
+        ExitOnFailure(hr, "failed to split cabinet names line: %ls", rgsczLines[i]);
+
+        if (!rgsczFields || cFields < 2)
         {
-            hr = StrAllocString(psczFirstFileToken, wzToken, 0);
-            ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate first file token: %ls", wzToken);
+            hr = E_INVALIDDATA;
+            ExitOnRootFailure(hr, "invalid cabinet names line: %ls", rgsczLines[i]);
         }
 
-        hr = CabCAddFile(wzFilePath, wzToken, pHashInfo, hCab);
-        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to add file: %ls", wzFilePath);
+        hr = PathConcat(pCabinet->sczCabDir, rgsczFields[1], &sczSource);
+        ExitOnFailure(hr, "failed to allocate cabinet path");
 
-        ReleaseNullStrArray(rgsczSplit, cSplit);
+        hr = PathConcat(sczTempPath, rgsczFields[1], &sczTarget);
+        ExitOnFailure(hr, "failed to allocate cached cabinet path");
+
+        hr = FileEnsureCopy(sczSource, sczTarget, TRUE);
+        ExitOnFailure(hr, "failed to copy cabinet to cache: %ls", sczSource);
+
+        ReleaseNullStrArray(rgsczFields, cFields);
+    }
+
+    hr = ::StringCchLengthW(pCabinet->sczOutput, STRSAFE_MAX_CCH, &cchOutput);
+    ExitOnRootFailure(hr, "failed to get length of cabinet names");
+
+    hr = PathConcat(sczTempPath, SMARTCAB_CACHE_NAMES_FILE, &sczNamesPath);
+    ExitOnFailure(hr, "failed to allocate cabinet cache names path");
+
+    hr = FileWrite(sczNamesPath, FILE_ATTRIBUTE_NORMAL, reinterpret_cast<LPCBYTE>(pCabinet->sczOutput), cchOutput * sizeof(WCHAR), NULL);
+    ExitOnFailure(hr, "failed to write cabinet cache names: %ls", sczNamesPath);
+
+    // If another build stored the same cabinet first, its entry is just as good.
+    if (::MoveFileExW(sczTempPath, wzEntryPath, 0))
+    {
+        fMoved = TRUE;
+    }
+    else if (ERROR_ALREADY_EXISTS != ::GetLastError())
+    {
+        ExitWithLastError(hr, "failed to move cabinet cache entry into place: %ls", wzEntryPath);
     }
 
 LExit:
-    ReleaseNullStrArray(rgsczSplit, cSplit);
-    ReleaseStr(sczLine);
+    if (!fMoved && sczTempPath)
+    {
+        DirEnsureDelete(sczTempPath, TRUE, TRUE);
+    }
+
+    ReleaseStr(sczTarget);
+    ReleaseStr(sczSource);
+    ReleaseStrArray(rgsczFields, cFields);
+    ReleaseStrArray(rgsczLines, cLines);
+    ReleaseStr(sczNamesPath);
+    ReleaseStr(sczTempPath);
 
     return hr;
 }
 
+static void ReleaseBatchCabinet(
+    __in SMARTCAB_BATCH_CABINET* pCabinet
+    )
+{
+    ReleaseStr(pCabinet->sczOutput);
+    ReleaseStrArray(pCabinet->rgsczFileLines, pCabinet->cFileLines);
+    ReleaseStr(pCabinet->sczCabinetCachePath);
+    ReleaseStr(pCabinet->sczHashCachePath);
+    ReleaseStr(pCabinet->sczCabDir);
+    ReleaseStr(pCabinet->sczCabPath);
+}
+
 
 // Callback from PFNFCIGETNEXTCABINET CabCGetNextCabinet method
 // First argument is the name of splitting cabinet without extension e.g. "cab1"
@@ -182,8 +803,16 @@ static void __stdcall CabNamesCallback(
     hr = StrAllocFormatted(&scz, L"%s\t%s\t%s\r\n", wzFirstCabName, wzNewCabName, wzFileToken);
     ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to allocate cabinet names message");
 
-    hr = ConsoleWriteW(CONSOLE_COLOR_NORMAL, scz);
-    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to send cabinet names message");
+    if (vpBatchCabinet)
+    {
+        hr = StrAllocConcat(&vpBatchCabinet->sczOutput, scz, 0);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to buffer cabinet names message");
+    }
+    else
+    {
+        hr = ConsoleWriteW(CONSOLE_COLOR_NORMAL, scz);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to send cabinet names message");
+    }
 
 LExit:
     ReleaseStr(scz);
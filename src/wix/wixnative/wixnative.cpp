@@ -2,6 +2,17 @@
 
 #include "precomp.h"
 
+static HRESULT RunCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
+static HRESULT ServeCommand(__in int argc, __in_ecount(argc) LPWSTR argv[]);
+static HRESULT ReadServeRequestInput();
+
+// Set while serving so commands share one CABINET.DLL load and read their input from the current request.
+static BOOL vfServing = FALSE;
+static LPWSTR* vrgsczRequestInput = NULL;
+static UINT vcRequestInput = 0;
+static UINT viRequestInput = 0;
+
+
 int __cdecl wmain(int argc, LPWSTR argv[])
 {
     HRESULT hr = E_INVALIDARG;
@@ -12,25 +23,13 @@ int __cdecl wmain(int argc, LPWSTR argv[])
     {
         ConsoleWriteError(hr, CONSOLE_COLOR_RED, "Must specify a command");
     }
-    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[1], -1, L"smartcab", -1))
-    {
-        hr = SmartCabCommand(argc - 2, argv + 2);
-    }
-    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[1], -1, L"extractcab", -1))
-    {
-        hr = ExtractCabCommand(argc - 2, argv + 2);
-    }
-    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[1], -1, L"enumcab", -1))
-    {
-        hr = EnumCabCommand(argc - 2, argv + 2);
-    }
-    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[1], -1, L"certhashes", -1))
+    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[1], -1, L"serve", -1))
     {
-        hr = CertificateHashesCommand(argc - 2, argv + 2);
+        hr = ServeCommand(argc - 2, argv + 2);
     }
     else
     {
-        ConsoleWriteError(hr, CONSOLE_COLOR_RED, "Unknown command: %ls", argv[1]);
+        hr = RunCommand(argc - 1, argv + 1);
     }
 
     ConsoleUninitialize();
@@ -43,6 +42,12 @@ HRESULT WixNativeReadStdinPreamble()
     LPWSTR sczLine = NULL;
     size_t cchPreamble = 0;
 
+    // A serve session reads the preamble once before the first request.
+    if (vfServing)
+    {
+        ExitFunction();
+    }
+
     // Read the first line to determine if a byte-order-mark was prepended to stdin.
     // A byte-order-mark is not normally expected but has been seen in some CI/CD systems.
     // The preable is a single line with ":".
@@ -64,3 +69,192 @@ LExit:
 
     return hr;
 }
+
+HRESULT WixNativeReadStdinLine(
+    __deref_out_z LPWSTR* psczLine
+    )
+{
+    HRESULT hr = S_OK;
+
+    if (!vfServing)
+    {
+        hr = ConsoleReadW(psczLine);
+    }
+    else if (viRequestInput < vcRequestInput)
+    {
+        hr = StrAllocString(psczLine, vrgsczRequestInput[viRequestInput], 0);
+        ++viRequestInput;
+    }
+    else
+    {
+        // Past the end of the request's input looks the same as the blank line that ends stdin.
+        hr = StrAllocString(psczLine, L"", 0);
+    }
+
+    return hr;
+}
+
+HRESULT WixNativeCabInitialize()
+{
+    return vfServing ? S_OK : CabInitialize(FALSE);
+}
+
+void WixNativeCabUninitialize()
+{
+    if (!vfServing)
+    {
+        CabUninitialize();
+    }
+}
+
+
+static HRESULT RunCommand(
+    __in int argc,
+    __in_ecount(argc) LPWSTR argv[]
+    )
+{
+    HRESULT hr = E_INVALIDARG;
+
+    if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[0], -1, L"smartcab", -1))
+    {
+        hr = SmartCabCommand(argc - 1, argv + 1);
+    }
+    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[0], -1, L"smartcabbatch", -1))
+    {
+        hr = SmartCabBatchCommand(argc - 1, argv + 1);
+    }
+    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[0], -1, L"extractcab", -1))
+    {
+        hr = ExtractCabCommand(argc - 1, argv + 1);
+    }
+    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[0], -1, L"enumcab", -1))
+    {
+        hr = EnumCabCommand(argc - 1, argv + 1);
+    }
+    else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, argv[0], -1, L"certhashes", -1))
+    {
+        hr = CertificateHashesCommand(argc - 1, argv + 1);
+    }
+    else
+    {
+        ConsoleWriteError(hr, CONSOLE_COLOR_RED, "Unknown command: %ls", argv[0]);
+    }
+
+    return hr;
+}
+
+// Serves commands from stdin until stdin is closed or a blank request line is read.
+//
+// Each request is a line of tab separated fields: a request id chosen by the caller, the
+// command and the command's arguments. It is followed by the lines the command would read
+// from stdin and a blank line, which is sent even when the command reads nothing. The
+// command's output is written as usual and followed by a line with ':', the request id, a
+// tab and the command's HRESULT, so a command that fails never leaves unread input behind.
+static HRESULT ServeCommand(
+    __in int argc,
+    __in_ecount(argc) LPWSTR argv[]
+    )
+{
+    Unused(argc);
+    Unused(argv);
+
+    HRESULT hr = S_OK;
+    HRESULT hrRequest = S_OK;
+    LPWSTR sczRequest = NULL;
+    LPWSTR* rgsczFields = NULL;
+    UINT cFields = 0;
+    BOOL fCabInitialized = FALSE;
+
+    hr = WixNativeReadStdinPreamble();
+    ExitOnFailure(hr, "Failed to read stdin preamble before serving");
+
+    hr = CabInitialize(FALSE);
+    ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to initialize cabinet support");
+    fCabInitialized = TRUE;
+
+    vfServing = TRUE;
+
+    for (;;)
+    {
+        hr = ConsoleReadW(&sczRequest);
+        if (HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE) == hr)
+        {
+            // The caller closed stdin, which ends the session like a blank line.
+            ExitFunction1(hr = S_OK);
+        }
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read request from stdin");
+
+        if (!*sczRequest)
+        {
+            break;
+        }
+
+        hr = StrSplitAllocArray(&rgsczFields, &cFields, sczRequest, L"\t");
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to split request: %ls", sczRequest);
+
+        hr = ReadServeRequestInput();
+        ExitOnFailure(hr, "failed to read input for request: %ls", sczRequest);
+
+        if (2 > cFields)
+        {
+            hrRequest = E_INVALIDARG;
+            ConsoleWriteError(hrRequest, CONSOLE_COLOR_RED, "Request must specify: id command [arguments]");
+        }
+        else if (CSTR_EQUAL == ::CompareString(LOCALE_INVARIANT, NORM_IGNORECASE, rgsczFields[1], -1, L"serve", -1))
+        {
+            hrRequest = E_INVALIDARG;
+            ConsoleWriteError(hrRequest, CONSOLE_COLOR_RED, "Cannot serve from a serve request");
+        }
+        else
+        {
+            hrRequest = RunCommand(cFields - 1, rgsczFields + 1);
+        }
+
+        hr = ConsoleWriteLine(CONSOLE_COLOR_NORMAL, ":%ls\t0x%x", rgsczFields && cFields ? rgsczFields[0] : L"", hrRequest);
+        ExitOnFailure(hr, "failed to write result of request: %ls", sczRequest);
+
+        ReleaseNullStrArray(rgsczFields, cFields);
+        ReleaseNullStrArray(vrgsczRequestInput, vcRequestInput);
+    }
+
+LExit:
+    vfServing = FALSE;
+
+    ReleaseNullStrArray(vrgsczRequestInput, vcRequestInput);
+    ReleaseStrArray(rgsczFields, cFields);
+    ReleaseStr(sczRequest);
+
+    if (fCabInitialized)
+    {
+        CabUninitialize();
+    }
+
+    return hr;
+}
+
+static HRESULT ReadServeRequestInput()
+{
+    HRESULT hr = S_OK;
+    LPWSTR sczLine = NULL;
+
+    viRequestInput = 0;
+
+    for (;;)
+    {
+        hr = ConsoleReadW(&sczLine);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to read request input from stdin");
+
+        if (!*sczLine)
+        {
+            break;
+        }
+
+        hr = StrArrayAllocString(&vrgsczRequestInput, &vcRequestInput, sczLine, 0);
+        ConsoleExitOnFailure(hr, CONSOLE_COLOR_RED, "failed to store request input line");
+    }
+
+LExit:
+    ReleaseStr(sczLine);
+
+    return hr;
+}